@@ -25,6 +25,7 @@
 #include "exec/address-spaces.h"
 #include "exec/cpu_ldst.h"
 #include "exec/cputlb.h"
+#include "exec/tb-hash.h"
 #include "exec/memory-internal.h"
 #include "exec/ram_addr.h"
 #include "tcg/tcg.h"
@@ -286,8 +287,8 @@ void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
 static void tlb_flush_one_mmuidx_locked(CPUArchState *env, int mmu_idx)
 {
     tlb_table_flush_by_mmuidx(env, mmu_idx);
-    env_tlb(env)->d[mmu_idx].large_page_addr = -1;
-    env_tlb(env)->d[mmu_idx].large_page_mask = -1;
+    memset(env_tlb(env)->d[mmu_idx].large_page, -1,
+           sizeof(env_tlb(env)->d[0].large_page));
     env_tlb(env)->d[mmu_idx].vindex = 0;
     memset(env_tlb(env)->d[mmu_idx].vtable, -1,
            sizeof(env_tlb(env)->d[0].vtable));
@@ -305,6 +306,7 @@ static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 
     qemu_spin_lock(&env_tlb(env)->c.lock);
 
+    env_tlb(env)->c.flush_gen++;
     all_dirty = env_tlb(env)->c.dirty;
     to_clean = asked & all_dirty;
     all_dirty &= ~to_clean;
@@ -423,19 +425,73 @@ static inline void tlb_flush_vtlb_page_locked(CPUArchState *env, int mmu_idx,
     }
 }
 
+static inline bool tlb_hit_region(target_ulong tlb_addr, target_ulong addr,
+                                  target_ulong mask)
+{
+    return tlb_addr != -1 && (tlb_addr & mask) == addr;
+}
+
+static inline bool tlb_flush_entry_region_locked(CPUTLBEntry *tlb_entry,
+                                                 target_ulong addr,
+                                                 target_ulong mask)
+{
+    if (tlb_hit_region(tlb_entry->addr_read, addr, mask) ||
+        tlb_hit_region(tlb_addr_write(tlb_entry), addr, mask) ||
+        tlb_hit_region(tlb_entry->addr_code, addr, mask)) {
+        memset(tlb_entry, -1, sizeof(*tlb_entry));
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Evict every entry of the large page region @lp, then forget the region:
+ * no large page entries are left within it.  Entries outside the region
+ * survive, unlike with the full flush this used to need.
+ * Called with tlb_c.lock held.
+ */
+static void tlb_flush_large_page_locked(CPUArchState *env, int midx,
+                                        CPUTLBLargePage *lp)
+{
+    CPUTLBDescFast *f = &env_tlb(env)->f[midx];
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    size_t i, n = tlb_n_entries(env, midx);
+
+    tlb_debug("flushing large page region midx %d ("
+              TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
+              midx, lp->addr, lp->mask);
+
+    for (i = 0; i < n; i++) {
+        if (tlb_flush_entry_region_locked(&f->table[i], lp->addr, lp->mask)) {
+            tlb_n_used_entries_dec(env, midx);
+        }
+    }
+    for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        if (tlb_flush_entry_region_locked(&d->vtable[i], lp->addr, lp->mask)) {
+            tlb_n_used_entries_dec(env, midx);
+        }
+    }
+    lp->addr = -1;
+    lp->mask = -1;
+}
+
 static void tlb_flush_page_locked(CPUArchState *env, int midx,
                                   target_ulong page)
 {
-    target_ulong lp_addr = env_tlb(env)->d[midx].large_page_addr;
-    target_ulong lp_mask = env_tlb(env)->d[midx].large_page_mask;
+    CPUTLBDesc *d = &env_tlb(env)->d[midx];
+    bool in_large_page = false;
+    int i;
 
     /* Check if we need to flush due to large pages.  */
-    if ((page & lp_mask) == lp_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  midx, lp_addr, lp_mask);
-        tlb_flush_one_mmuidx_locked(env, midx);
-    } else {
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        CPUTLBLargePage *lp = &d->large_page[i];
+
+        if ((page & lp->mask) == lp->addr) {
+            tlb_flush_large_page_locked(env, midx, lp);
+            in_large_page = true;
+        }
+    }
+    if (!in_large_page) {
         if (tlb_flush_entry_locked(tlb_entry(env, midx, page), page)) {
             tlb_n_used_entries_dec(env, midx);
         }
@@ -463,6 +519,7 @@ static void tlb_flush_page_by_mmuidx_async_work(CPUState *cpu,
               addr, mmu_idx_bitmap);
 
     qemu_spin_lock(&env_tlb(env)->c.lock);
+    env_tlb(env)->c.flush_gen++;
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         if (test_bit(mmu_idx, &mmu_idx_bitmap)) {
             tlb_flush_page_locked(env, mmu_idx, addr);
@@ -540,6 +597,150 @@ void tlb_flush_page_all_cpus_synced(CPUState *src, target_ulong addr)
     tlb_flush_page_by_mmuidx_all_cpus_synced(src, addr, ALL_MMUIDX_BITS);
 }
 
+typedef struct {
+    target_ulong addr;
+    target_ulong len;
+    uint16_t idxmap;
+} TLBFlushRangeData;
+
+static void tlb_flush_range_by_mmuidx_work(CPUState *cpu,
+                                           const TLBFlushRangeData *d)
+{
+    CPUArchState *env = cpu->env_ptr;
+    target_ulong npages = d->len >> TARGET_PAGE_BITS;
+    target_ulong i;
+    uint16_t full = 0, work;
+
+    assert_cpu_is_self(cpu);
+
+    tlb_debug("range addr:" TARGET_FMT_lx "/" TARGET_FMT_lx " mmu_map:0x%x\n",
+              d->addr, d->len, d->idxmap);
+
+    qemu_spin_lock(&env_tlb(env)->c.lock);
+    env_tlb(env)->c.flush_gen++;
+    for (work = d->idxmap; work != 0; work &= work - 1) {
+        int mmu_idx = ctz32(work);
+
+        /*
+         * Once the range has more pages than the TLB has entries,
+         * dropping the whole table is cheaper than probing it per page.
+         */
+        if (npages > tlb_n_entries(env, mmu_idx)) {
+            tlb_flush_one_mmuidx_locked(env, mmu_idx);
+            full |= 1 << mmu_idx;
+            continue;
+        }
+        for (i = 0; i < npages; i++) {
+            tlb_flush_page_locked(env, mmu_idx,
+                                  d->addr + (i << TARGET_PAGE_BITS));
+        }
+    }
+    qemu_spin_unlock(&env_tlb(env)->c.lock);
+
+    /* Each tb_flush_jmp_cache clears two pages' worth of slots */
+    if (full || npages * 2 * TB_JMP_PAGE_SIZE >= TB_JMP_CACHE_SIZE) {
+        cpu_tb_jmp_cache_clear(cpu);
+    } else {
+        for (i = 0; i < npages; i++) {
+            tb_flush_jmp_cache(cpu, d->addr + (i << TARGET_PAGE_BITS));
+        }
+    }
+}
+
+static void tlb_flush_range_by_mmuidx_async_work(CPUState *cpu,
+                                                 run_on_cpu_data data)
+{
+    TLBFlushRangeData *d = data.host_ptr;
+
+    tlb_flush_range_by_mmuidx_work(cpu, d);
+    g_free(d);
+}
+
+static void tlb_flush_range_init(TLBFlushRangeData *d, target_ulong addr,
+                                 target_ulong len, uint16_t idxmap)
+{
+    d->addr = addr & TARGET_PAGE_MASK;
+    d->len = ROUND_UP(addr + len, TARGET_PAGE_SIZE) - d->addr;
+    d->idxmap = idxmap;
+}
+
+void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
+                               target_ulong len, uint16_t idxmap)
+{
+    TLBFlushRangeData d;
+
+    tlb_flush_range_init(&d, addr, len, idxmap);
+    if (!qemu_cpu_is_self(cpu)) {
+        async_run_on_cpu(cpu, tlb_flush_range_by_mmuidx_async_work,
+                         RUN_ON_CPU_HOST_PTR(g_memdup(&d, sizeof(d))));
+    } else {
+        tlb_flush_range_by_mmuidx_work(cpu, &d);
+    }
+}
+
+void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
+                                               target_ulong addr,
+                                               target_ulong len,
+                                               uint16_t idxmap)
+{
+    const run_on_cpu_func fn = tlb_flush_range_by_mmuidx_async_work;
+    TLBFlushRangeData d;
+    CPUState *cpu;
+
+    tlb_flush_range_init(&d, addr, len, idxmap);
+
+    /* Every CPU frees its own copy once the flush is done */
+    CPU_FOREACH(cpu) {
+        if (cpu != src_cpu) {
+            async_run_on_cpu(cpu, fn,
+                             RUN_ON_CPU_HOST_PTR(g_memdup(&d, sizeof(d))));
+        }
+    }
+    async_safe_run_on_cpu(src_cpu, fn,
+                          RUN_ON_CPU_HOST_PTR(g_memdup(&d, sizeof(d))));
+}
+
+void tlb_flush_by_mmuidx_filtered(CPUState *cpu, uint16_t idxmap,
+                                  bool (*keep)(MemTxAttrs attrs))
+{
+    CPUArchState *env = cpu->env_ptr;
+    uint16_t work;
+
+    assert_cpu_is_self(cpu);
+
+    tlb_debug("mmu_idx: 0x%" PRIx16 "\n", idxmap);
+
+    qemu_spin_lock(&env_tlb(env)->c.lock);
+    env_tlb(env)->c.flush_gen++;
+    for (work = idxmap; work != 0; work &= work - 1) {
+        int mmu_idx = ctz32(work);
+        CPUTLBDescFast *f = &env_tlb(env)->f[mmu_idx];
+        CPUTLBDesc *d = &env_tlb(env)->d[mmu_idx];
+        size_t i, n = tlb_n_entries(env, mmu_idx);
+
+        for (i = 0; i < n; i++) {
+            if (!tlb_entry_is_empty(&f->table[i]) &&
+                !keep(d->iotlb[i].attrs)) {
+                memset(&f->table[i], -1, sizeof(f->table[i]));
+                tlb_n_used_entries_dec(env, mmu_idx);
+            }
+        }
+        for (i = 0; i < CPU_VTLB_SIZE; i++) {
+            if (!tlb_entry_is_empty(&d->vtable[i]) &&
+                !keep(d->viotlb[i].attrs)) {
+                memset(&d->vtable[i], -1, sizeof(d->vtable[i]));
+                tlb_n_used_entries_dec(env, mmu_idx);
+            }
+        }
+    }
+    qemu_spin_unlock(&env_tlb(env)->c.lock);
+
+    cpu_tb_jmp_cache_clear(cpu);
+
+    atomic_set(&env_tlb(env)->c.part_flush_count,
+               env_tlb(env)->c.part_flush_count + ctpop16(idxmap));
+}
+
 /* update the TLBs so that writes to code in the virtual page 'addr'
    can be detected */
 void tlb_protect_code(ram_addr_t ram_addr)
@@ -668,23 +869,46 @@ void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
 static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
                                target_ulong vaddr, target_ulong size)
 {
-    target_ulong lp_addr = env_tlb(env)->d[mmu_idx].large_page_addr;
+    CPUTLBLargePage *lp = env_tlb(env)->d[mmu_idx].large_page;
+    CPUTLBLargePage *best = NULL;
     target_ulong lp_mask = ~(size - 1);
+    target_ulong best_mask = 0;
+    int i;
 
-    if (lp_addr == (target_ulong)-1) {
-        /* No previous large page.  */
-        lp_addr = vaddr;
-    } else {
-        /* Extend the existing region to include the new page.
-           This is a compromise between unnecessary flushes and
-           the cost of maintaining a full variable size TLB.  */
-        lp_mask &= env_tlb(env)->d[mmu_idx].large_page_mask;
-        while (((lp_addr ^ vaddr) & lp_mask) != 0) {
-            lp_mask <<= 1;
+    /* Reuse a region already covering the page, or a free one.  */
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        if (lp[i].addr == (target_ulong)-1) {
+            if (!best) {
+                best = &lp[i];
+            }
+        } else if (((lp[i].addr ^ vaddr) & lp[i].mask & lp_mask) == 0) {
+            lp[i].mask &= lp_mask;
+            lp[i].addr &= lp[i].mask;
+            return;
+        }
+    }
+    if (best) {
+        best->addr = vaddr & lp_mask;
+        best->mask = lp_mask;
+        return;
+    }
+
+    /* All in use: extend the region that grows least to include the page.
+       This is a compromise between unnecessary flushes and the cost of
+       maintaining a full variable size TLB.  */
+    for (i = 0; i < CPU_TLB_LARGE_PAGES; i++) {
+        target_ulong mask = lp[i].mask & lp_mask;
+
+        while (((lp[i].addr ^ vaddr) & mask) != 0) {
+            mask <<= 1;
+        }
+        if (!best || mask > best_mask) {
+            best = &lp[i];
+            best_mask = mask;
         }
     }
-    env_tlb(env)->d[mmu_idx].large_page_addr = lp_addr & lp_mask;
-    env_tlb(env)->d[mmu_idx].large_page_mask = lp_mask;
+    best->mask = best_mask;
+    best->addr &= best_mask;
 }
 
 /* Add a new TLB entry. At most one entry for a given virtual address
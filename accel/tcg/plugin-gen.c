@@ -0,0 +1,319 @@
+/*
+ * TCG plugin support, generation of the instrumentation
+ *
+ * The plugins decide what to instrument once they see the whole block,
+ * so the instrumentation cannot be emitted while translating.  Instead,
+ * the translator records where each instruction and each guest memory
+ * access starts in the list of ops.  Once the block is translated, the
+ * plugins are given the block, and the callbacks and inline ops that they
+ * register are emitted at the end of the list then moved to their place:
+ *
+ * - block callbacks before the first instruction,
+ * - instruction callbacks after the insn_start op of the instruction,
+ * - memory callbacks after the qemu_ld/st op, with a copy of the address
+ *   made before the access since the access may overwrite it.
+ *
+ * Copies of addresses that no callback uses are dead, and removed by the
+ * liveness pass.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "cpu.h"
+#include "tcg/tcg.h"
+#include "tcg/tcg-op.h"
+#include "exec/exec-all.h"
+#include "exec/cpu_ldst.h"
+#include "exec/helper-proto.h"
+#include "exec/helper-gen.h"
+#include "exec/translator.h"
+#include "exec/plugin-gen.h"
+
+#if TARGET_LONG_BITS == 32
+# define tcgv_tl_temp   tcgv_i32_temp
+# define temp_tcgv_tl   temp_tcgv_i32
+#else
+# define tcgv_tl_temp   tcgv_i64_temp
+# define temp_tcgv_tl   temp_tcgv_i64
+#endif
+
+void HELPER(plugin_vcpu_udata_cb)(uint32_t cpu_index, void *cb, void *udata)
+{
+    qemu_plugin_vcpu_udata_cb_t func = cb;
+
+    func(cpu_index, udata);
+}
+
+void HELPER(plugin_vcpu_mem_cb)(uint32_t cpu_index, uint32_t info,
+                                uint64_t vaddr, void *cb, void *udata)
+{
+    qemu_plugin_vcpu_mem_cb_t func = cb;
+
+    func(cpu_index, info, vaddr, udata);
+}
+
+static void gen_cpu_index(TCGv_i32 idx)
+{
+    tcg_gen_ld_i32(idx, cpu_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+}
+
+static void gen_inline_op(const struct qemu_plugin_dyn_cb *cb)
+{
+    TCGv_i64 val = tcg_temp_new_i64();
+    TCGv_ptr ptr;
+    intptr_t ofs = 0;
+
+    if (cb->inline_op.score) {
+        ptr = tcg_temp_new_ptr();
+        tcg_gen_ld_ptr(ptr, cpu_env,
+                       -offsetof(ArchCPU, env) +
+                       offsetof(CPUState, plugin_scoreboards) +
+                       cb->inline_op.score->slot * sizeof(void *));
+        ofs = cb->inline_op.offset;
+    } else {
+        ptr = tcg_const_ptr(cb->inline_op.ptr);
+    }
+
+    switch (cb->inline_op.op) {
+    case QEMU_PLUGIN_INLINE_ADD_U64:
+        tcg_gen_ld_i64(val, ptr, ofs);
+        tcg_gen_addi_i64(val, val, cb->inline_op.imm);
+        tcg_gen_st_i64(val, ptr, ofs);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i64(val);
+}
+
+static void gen_udata_cb(const struct qemu_plugin_dyn_cb *cb)
+{
+    TCGv_i32 idx = tcg_temp_new_i32();
+    TCGv_ptr func = tcg_const_ptr(cb->regular.f);
+    TCGv_ptr udata = tcg_const_ptr(cb->regular.userdata);
+
+    gen_cpu_index(idx);
+    gen_helper_plugin_vcpu_udata_cb(idx, func, udata);
+
+    tcg_temp_free_ptr(udata);
+    tcg_temp_free_ptr(func);
+    tcg_temp_free_i32(idx);
+}
+
+static void gen_mem_cb(const struct qemu_plugin_dyn_cb *cb,
+                       const struct qemu_plugin_mem_op *mem)
+{
+    TCGv_i32 idx = tcg_temp_new_i32();
+    TCGv_i32 info = tcg_const_i32(mem->info);
+    TCGv_i64 vaddr = tcg_temp_new_i64();
+    TCGv_ptr func = tcg_const_ptr(cb->regular.f_mem);
+    TCGv_ptr udata = tcg_const_ptr(cb->regular.userdata);
+
+    gen_cpu_index(idx);
+    tcg_gen_extu_tl_i64(vaddr, temp_tcgv_tl(mem->addr));
+    gen_helper_plugin_vcpu_mem_cb(idx, info, vaddr, func, udata);
+
+    tcg_temp_free_ptr(udata);
+    tcg_temp_free_ptr(func);
+    tcg_temp_free_i64(vaddr);
+    tcg_temp_free_i32(info);
+    tcg_temp_free_i32(idx);
+}
+
+/* Move the ops emitted after @last to right after @where */
+static void plugin_move_ops(TCGOp *last, TCGOp *where)
+{
+    TCGOp *op;
+
+    if (where == last) {
+        return;
+    }
+    while ((op = tcg_last_op()) != last) {
+        QTAILQ_REMOVE(&tcg_ctx->ops, op, link);
+        if (where) {
+            QTAILQ_INSERT_AFTER(&tcg_ctx->ops, where, op, link);
+        } else {
+            QTAILQ_INSERT_HEAD(&tcg_ctx->ops, op, link);
+        }
+    }
+}
+
+static void inject_exec_cbs(GArray *cbs, TCGOp *where)
+{
+    TCGOp *last = tcg_last_op();
+    guint i;
+
+    if (!cbs || !cbs->len) {
+        return;
+    }
+    for (i = 0; i < cbs->len; i++) {
+        struct qemu_plugin_dyn_cb *cb =
+            &g_array_index(cbs, struct qemu_plugin_dyn_cb, i);
+
+        if (cb->type == PLUGIN_CB_INLINE) {
+            gen_inline_op(cb);
+        } else {
+            gen_udata_cb(cb);
+        }
+    }
+    plugin_move_ops(last, where);
+}
+
+static void inject_mem_cbs(struct qemu_plugin_insn *insn)
+{
+    guint i, j;
+
+    if (!insn->mem_cbs || !insn->mem_cbs->len ||
+        !insn->mem_ops || !insn->mem_ops->len) {
+        return;
+    }
+    for (i = 0; i < insn->mem_ops->len; i++) {
+        struct qemu_plugin_mem_op *mem =
+            &g_array_index(insn->mem_ops, struct qemu_plugin_mem_op, i);
+        enum qemu_plugin_mem_rw rw = qemu_plugin_mem_is_store(mem->info) ?
+            QEMU_PLUGIN_MEM_W : QEMU_PLUGIN_MEM_R;
+        TCGOp *last = tcg_last_op();
+
+        for (j = 0; j < insn->mem_cbs->len; j++) {
+            struct qemu_plugin_dyn_cb *cb =
+                &g_array_index(insn->mem_cbs, struct qemu_plugin_dyn_cb, j);
+
+            if (!(cb->rw & rw)) {
+                continue;
+            }
+            if (cb->type == PLUGIN_CB_INLINE) {
+                gen_inline_op(cb);
+            } else {
+                gen_mem_cb(cb, mem);
+            }
+        }
+        plugin_move_ops(last, mem->op);
+    }
+}
+
+static void plugin_reset_array(GArray *arr)
+{
+    if (arr) {
+        g_array_set_size(arr, 0);
+    }
+}
+
+bool plugin_gen_tb_start(CPUState *cpu, const TranslationBlock *tb)
+{
+    struct qemu_plugin_tb *ptb;
+
+    if (!qemu_plugin_tb_trans_enabled()) {
+        return false;
+    }
+
+    ptb = tcg_ctx->plugin_tb;
+    if (ptb == NULL) {
+        ptb = g_new0(struct qemu_plugin_tb, 1);
+        ptb->insns = g_ptr_array_new();
+        tcg_ctx->plugin_tb = ptb;
+    }
+    ptb->n_insns = 0;
+    ptb->vaddr = tb->pc;
+    ptb->start = tcg_last_op();
+    plugin_reset_array(ptb->exec_cbs);
+    tcg_ctx->plugin_insn = NULL;
+    return true;
+}
+
+void plugin_gen_insn_start(CPUState *cpu, const DisasContextBase *db)
+{
+    struct qemu_plugin_tb *ptb = tcg_ctx->plugin_tb;
+    struct qemu_plugin_insn *insn;
+
+    if (ptb->n_insns == ptb->insns->len) {
+        insn = g_new0(struct qemu_plugin_insn, 1);
+        insn->data = g_byte_array_sized_new(4);
+        g_ptr_array_add(ptb->insns, insn);
+    }
+    insn = g_ptr_array_index(ptb->insns, ptb->n_insns);
+    g_byte_array_set_size(insn->data, 0);
+    plugin_reset_array(insn->exec_cbs);
+    plugin_reset_array(insn->mem_cbs);
+    plugin_reset_array(insn->mem_ops);
+    insn->vaddr = db->pc_next;
+    insn->start = tcg_last_op();
+    tcg_ctx->plugin_insn = insn;
+}
+
+/*
+ * An instruction that was started but not translated, because of a
+ * breakpoint, is left out of the block.
+ */
+void plugin_gen_insn_end(CPUState *cpu, const DisasContextBase *db)
+{
+    struct qemu_plugin_tb *ptb = tcg_ctx->plugin_tb;
+    struct qemu_plugin_insn *insn = tcg_ctx->plugin_insn;
+    CPUArchState *env = cpu->env_ptr;
+    target_ulong pc;
+
+    /* the translator has just read these bytes */
+    for (pc = insn->vaddr; pc != db->pc_next; pc++) {
+        uint8_t byte = cpu_ldub_code(env, pc);
+
+        g_byte_array_append(insn->data, &byte, 1);
+    }
+    ptb->n_insns++;
+    tcg_ctx->plugin_insn = NULL;
+}
+
+void plugin_gen_tb_end(CPUState *cpu)
+{
+    struct qemu_plugin_tb *ptb = tcg_ctx->plugin_tb;
+    size_t i;
+
+    tcg_ctx->plugin_insn = NULL;
+    qemu_plugin_tb_trans_cb(cpu, ptb);
+
+    inject_exec_cbs(ptb->exec_cbs, ptb->start);
+    for (i = 0; i < ptb->n_insns; i++) {
+        struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, i);
+
+        inject_exec_cbs(insn->exec_cbs, insn->start);
+        inject_mem_cbs(insn);
+    }
+}
+
+TCGv plugin_prep_mem_callbacks(TCGv addr)
+{
+    TCGv copy;
+
+    if (tcg_ctx->plugin_insn == NULL) {
+        return addr;
+    }
+    copy = tcg_temp_new();
+    tcg_gen_mov_tl(copy, addr);
+    return copy;
+}
+
+/*
+ * Called right after the qemu_ld/st op, with what
+ * plugin_prep_mem_callbacks() returned.  The copy of the address is
+ * freed here: the callbacks are inserted right after the access, before
+ * any later use of the temp.
+ */
+void plugin_gen_mem_callbacks(TCGv addr, uint8_t info)
+{
+    struct qemu_plugin_insn *insn = tcg_ctx->plugin_insn;
+    struct qemu_plugin_mem_op mem;
+
+    if (insn == NULL) {
+        return;
+    }
+    mem.op = tcg_last_op();
+    mem.addr = tcgv_tl_temp(addr);
+    mem.info = info;
+    if (insn->mem_ops == NULL) {
+        insn->mem_ops = g_array_new(false, false, sizeof(mem));
+    }
+    g_array_append_val(insn->mem_ops, mem);
+    tcg_temp_free(addr);
+}
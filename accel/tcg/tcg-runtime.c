@@ -152,7 +152,7 @@ void *HELPER(lookup_tb_ptr)(CPUArchState *env)
     uint32_t flags;
 
     tb = tb_lookup__cpu_state(cpu, &pc, &cs_base, &flags, curr_cflags());
-    if (tb == NULL) {
+    if (tb == NULL || atomic_read(&tb_profile)) {
         return tcg_ctx->code_gen_epilogue;
     }
     qemu_log_mask_and_addr(CPU_LOG_EXEC, pc,
@@ -54,6 +54,8 @@
 #include "qemu/qemu-print.h"
 #include "qemu/timer.h"
 #include "qemu/main-loop.h"
+#include "qemu/rcu.h"
+#include "qemu/seqlock.h"
 #include "exec/log.h"
 #include "sysemu/cpus.h"
 #include "sysemu/tcg.h"
@@ -108,8 +110,6 @@ typedef struct PageDesc {
        of lookups we do to a given page to use a bitmap */
     unsigned long *code_bitmap;
     unsigned int code_write_count;
-#else
-    unsigned long flags;
 #endif
 #ifndef CONFIG_USER_ONLY
     QemuSpin lock;
@@ -214,6 +214,10 @@ TCGContext tcg_init_ctx;
 __thread TCGContext *tcg_ctx;
 TBContext tb_ctx;
 bool parallel_cpus;
+bool tb_profile;
+
+/* perf map file (see tools/perf/Documentation/jit-interface.txt) */
+static FILE *tb_perf_map;
 
 static void page_table_config_init(void)
 {
@@ -548,6 +552,249 @@ static inline PageDesc *page_find(tb_page_addr_t index)
     return page_find_alloc(index, 0);
 }
 
+#ifdef CONFIG_USER_ONLY
+/*
+ * Page flags for user-mode emulation.
+ *
+ * The guest address space is described by disjoint ranges of pages with
+ * the same flags, kept in a treap ordered by address, so that changing
+ * the flags of a range costs O(log n) in the number of ranges instead of
+ * O(pages).  Pages outside any range have no flags.
+ *
+ * Writers hold mmap_lock and make their changes inside a write section
+ * of pageflags_seq.  Readers take no lock: they walk the tree inside an
+ * RCU critical section and start again if the sequence count shows that
+ * they raced with a writer.  Removed nodes are only freed after a grace
+ * period, so a racing reader never follows a pointer to freed memory.
+ */
+typedef struct PageFlagsNode {
+    struct rcu_head rcu;
+    struct PageFlagsNode *left, *right;
+    target_ulong start, last;
+    uint32_t prio;
+    int flags;
+} PageFlagsNode;
+
+static PageFlagsNode *pageflags_root;
+static QemuSeqLock pageflags_seq;
+static uint32_t pageflags_prio_state = 1;
+
+/* Return the first range that ends at or after @addr */
+static PageFlagsNode *pageflags_lower_bound(target_ulong addr)
+{
+    PageFlagsNode *t = atomic_rcu_read(&pageflags_root);
+    PageFlagsNode *best = NULL;
+
+    while (t) {
+        if (t->last >= addr) {
+            best = t;
+            t = atomic_rcu_read(&t->left);
+        } else {
+            t = atomic_rcu_read(&t->right);
+        }
+    }
+    return best;
+}
+
+static PageFlagsNode *pageflags_next(PageFlagsNode *p)
+{
+    target_ulong last = p->last;
+
+    return last == (target_ulong)-1 ? NULL : pageflags_lower_bound(last + 1);
+}
+
+/* Return the flags of the page at @addr, or 0 */
+static int pageflags_find(target_ulong addr)
+{
+    PageFlagsNode *p = pageflags_lower_bound(addr);
+
+    return p && p->start <= addr ? p->flags : 0;
+}
+
+/* Return the union of the flags of the pages in [@start, @last] */
+static int pageflags_range_prot(target_ulong start, target_ulong last)
+{
+    PageFlagsNode *p;
+    int prot = 0;
+
+    for (p = pageflags_lower_bound(start); p && p->start <= last;
+         p = pageflags_next(p)) {
+        prot |= p->flags;
+    }
+    return prot;
+}
+
+/*
+ * The tree manipulation below is only done by writers.  Every pointer is
+ * stored with atomic_rcu_set(), so that a reader never sees a node before
+ * it is initialized.
+ */
+
+/* Split @t into the nodes that start before @start and the others */
+static void pageflags_tree_split(PageFlagsNode *t, target_ulong start,
+                                 PageFlagsNode **l, PageFlagsNode **r)
+{
+    PageFlagsNode *sub;
+
+    if (!t) {
+        *l = *r = NULL;
+    } else if (t->start < start) {
+        pageflags_tree_split(t->right, start, &sub, r);
+        atomic_rcu_set(&t->right, sub);
+        *l = t;
+    } else {
+        pageflags_tree_split(t->left, start, l, &sub);
+        atomic_rcu_set(&t->left, sub);
+        *r = t;
+    }
+}
+
+/* Join @l and @r, where all of @l is below all of @r */
+static PageFlagsNode *pageflags_tree_join(PageFlagsNode *l, PageFlagsNode *r)
+{
+    if (!l) {
+        return r;
+    }
+    if (!r) {
+        return l;
+    }
+    if (l->prio > r->prio) {
+        atomic_rcu_set(&l->right, pageflags_tree_join(l->right, r));
+        return l;
+    }
+    atomic_rcu_set(&r->left, pageflags_tree_join(l, r->left));
+    return r;
+}
+
+static PageFlagsNode *pageflags_tree_insert(PageFlagsNode *t, PageFlagsNode *p)
+{
+    if (!t || p->prio > t->prio) {
+        pageflags_tree_split(t, p->start, &p->left, &p->right);
+        return p;
+    }
+    if (p->start < t->start) {
+        atomic_rcu_set(&t->left, pageflags_tree_insert(t->left, p));
+    } else {
+        atomic_rcu_set(&t->right, pageflags_tree_insert(t->right, p));
+    }
+    return t;
+}
+
+static PageFlagsNode *pageflags_tree_remove(PageFlagsNode *t, PageFlagsNode *p)
+{
+    if (t == p) {
+        return pageflags_tree_join(t->left, t->right);
+    }
+    if (p->start < t->start) {
+        atomic_rcu_set(&t->left, pageflags_tree_remove(t->left, p));
+    } else {
+        atomic_rcu_set(&t->right, pageflags_tree_remove(t->right, p));
+    }
+    return t;
+}
+
+static void pageflags_insert(target_ulong start, target_ulong last, int flags)
+{
+    PageFlagsNode *p = g_new0(PageFlagsNode, 1);
+    uint32_t x = pageflags_prio_state;
+
+    /* xorshift32: the priorities only need to be spread out */
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    pageflags_prio_state = x;
+
+    p->start = start;
+    p->last = last;
+    p->flags = flags;
+    p->prio = x;
+    atomic_rcu_set(&pageflags_root, pageflags_tree_insert(pageflags_root, p));
+}
+
+static void pageflags_free(PageFlagsNode *p)
+{
+    g_free(p);
+}
+
+static void pageflags_remove(PageFlagsNode *p)
+{
+    atomic_rcu_set(&pageflags_root, pageflags_tree_remove(pageflags_root, p));
+    call_rcu(p, pageflags_free, rcu);
+}
+
+/* Make sure that no range goes across @addr */
+static void pageflags_split(target_ulong addr)
+{
+    PageFlagsNode *p = pageflags_lower_bound(addr);
+
+    if (p && p->start < addr) {
+        target_ulong last = p->last;
+
+        p->last = addr - 1;
+        pageflags_insert(addr, last, p->flags);
+    }
+}
+
+/* Merge adjacent ranges with the same flags in and around [@start, @last] */
+static void pageflags_merge(target_ulong start, target_ulong last)
+{
+    PageFlagsNode *p = pageflags_lower_bound(start ? start - 1 : 0);
+
+    while (p && p->last != (target_ulong)-1 && p->last <= last) {
+        PageFlagsNode *next = pageflags_lower_bound(p->last + 1);
+
+        if (next && next->start == p->last + 1 && next->flags == p->flags) {
+            p->last = next->last;
+            pageflags_remove(next);
+        } else {
+            p = next;
+        }
+    }
+}
+
+/* Give the pages in [@start, @last] the flags @flags */
+static void pageflags_set(target_ulong start, target_ulong last, int flags)
+{
+    PageFlagsNode *p, *next;
+
+    pageflags_split(start);
+    if (last != (target_ulong)-1) {
+        pageflags_split(last + 1);
+    }
+    for (p = pageflags_lower_bound(start); p && p->start <= last; p = next) {
+        next = pageflags_next(p);
+        pageflags_remove(p);
+    }
+    if (flags) {
+        pageflags_insert(start, last, flags);
+    }
+    pageflags_merge(start, last);
+}
+
+/* Set and clear flags of the pages in [@start, @last] that have some */
+static void pageflags_set_clear(target_ulong start, target_ulong last,
+                                int set_flags, int clear_flags)
+{
+    PageFlagsNode *p, *next;
+
+    pageflags_split(start);
+    if (last != (target_ulong)-1) {
+        pageflags_split(last + 1);
+    }
+    for (p = pageflags_lower_bound(start); p && p->start <= last; p = next) {
+        int flags = (p->flags & ~clear_flags) | set_flags;
+
+        next = pageflags_next(p);
+        if (flags) {
+            p->flags = flags;
+        } else {
+            pageflags_remove(p);
+        }
+    }
+    pageflags_merge(start, last);
+}
+#endif
+
 static void page_lock_pair(PageDesc **ret_p1, tb_page_addr_t phys1,
                            PageDesc **ret_p2, tb_page_addr_t phys2, int alloc);
 
@@ -1184,6 +1431,21 @@ static inline void invalidate_page_bitmap(PageDesc *p)
 #endif
 }
 
+/*
+ * A TB has left the page, so the bitmap would over-report code: drop it,
+ * but keep the write count so that a page already known to be written to
+ * gets its bitmap back on the next write.
+ * call with @p->lock held
+ */
+static inline void page_bitmap_tb_removed(PageDesc *p)
+{
+    assert_page_locked(p);
+#ifdef CONFIG_SOFTMMU
+    g_free(p->code_bitmap);
+    p->code_bitmap = NULL;
+#endif
+}
+
 /* Set to NULL all the 'first_tb' fields in all PageDescs. */
 static void page_flush_tb_1(int level, void **lp)
 {
@@ -1259,6 +1521,8 @@ static void do_tb_flush(CPUState *cpu, run_on_cpu_data tb_flush_count)
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
     atomic_mb_set(&tb_ctx.tb_flush_count, tb_ctx.tb_flush_count + 1);
+    /* the flush made room too */
+    atomic_mb_set(&tb_ctx.tb_reclaim_count, tb_ctx.tb_reclaim_count + 1);
 
 done:
     mmap_unlock();
@@ -1273,6 +1537,51 @@ void tb_flush(CPUState *cpu)
     }
 }
 
+static gboolean tb_reclaim_iter(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+
+    if (!(tb_cflags(tb) & CF_INVALID)) {
+        tb_phys_invalidate(tb, -1);
+    }
+    return false;
+}
+
+/*
+ * Make room in the code buffer by discarding the TBs of the oldest
+ * regions, falling back to a full flush if there are too few of them.
+ * Reclaims have their own count: a tb_flush() queued before this one
+ * must still happen, whereas another reclaim or a flush in between has
+ * already made room.
+ */
+static void do_tb_reclaim(CPUState *cpu, run_on_cpu_data tb_reclaim_count)
+{
+    bool done;
+
+    mmap_lock();
+    if (tb_ctx.tb_reclaim_count != tb_reclaim_count.host_int) {
+        mmap_unlock();
+        return;
+    }
+    done = tcg_region_reclaim(tb_reclaim_iter, NULL);
+    if (done) {
+        atomic_mb_set(&tb_ctx.tb_reclaim_count, tb_ctx.tb_reclaim_count + 1);
+    }
+    mmap_unlock();
+
+    if (!done) {
+        do_tb_flush(cpu, RUN_ON_CPU_HOST_INT(tb_ctx.tb_flush_count));
+    }
+}
+
+static void tb_reclaim(CPUState *cpu)
+{
+    unsigned tb_reclaim_count = atomic_mb_read(&tb_ctx.tb_reclaim_count);
+
+    async_safe_run_on_cpu(cpu, do_tb_reclaim,
+                          RUN_ON_CPU_HOST_INT(tb_reclaim_count));
+}
+
 /*
  * Formerly ifdef DEBUG_TB_CHECK. These debug functions are user-mode-only,
  * so in order to prevent bit rot we compile them unconditionally in user-mode,
@@ -1452,19 +1761,23 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     if (rm_from_page_list) {
         p = page_find(tb->page_addr[0] >> TARGET_PAGE_BITS);
         tb_page_remove(p, tb);
-        invalidate_page_bitmap(p);
+        page_bitmap_tb_removed(p);
         if (tb->page_addr[1] != -1) {
             p = page_find(tb->page_addr[1] >> TARGET_PAGE_BITS);
             tb_page_remove(p, tb);
-            invalidate_page_bitmap(p);
+            page_bitmap_tb_removed(p);
         }
     }
 
     /* remove the TB from the hash list */
-    h = tb_jmp_cache_hash_func(tb->pc);
+    h = tb_jmp_cache_set_func(tb->pc);
     CPU_FOREACH(cpu) {
-        if (atomic_read(&cpu->tb_jmp_cache[h]) == tb) {
-            atomic_set(&cpu->tb_jmp_cache[h], NULL);
+        int way;
+
+        for (way = 0; way < TB_JMP_CACHE_WAYS; way++) {
+            if (atomic_read(&cpu->tb_jmp_cache[h + way]) == tb) {
+                atomic_set(&cpu->tb_jmp_cache[h + way], NULL);
+            }
         }
     }
 
@@ -1500,30 +1813,38 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 }
 
 #ifdef CONFIG_SOFTMMU
+/* Mark the bytes of page @n of @tb in the page's code bitmap */
+static void page_bitmap_add_tb(PageDesc *p, TranslationBlock *tb, int n)
+{
+    int tb_start, tb_end;
+
+    /* NOTE: this is subtle as a TB may span two physical pages */
+    if (n == 0) {
+        /* NOTE: tb_end may be after the end of the page, but
+           it is not a problem */
+        tb_start = tb->pc & ~TARGET_PAGE_MASK;
+        tb_end = tb_start + tb->size;
+        if (tb_end > TARGET_PAGE_SIZE) {
+            tb_end = TARGET_PAGE_SIZE;
+        }
+    } else {
+        tb_start = 0;
+        tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
+    }
+    bitmap_set(p->code_bitmap, tb_start, tb_end - tb_start);
+}
+
 /* call with @p->lock held */
 static void build_page_bitmap(PageDesc *p)
 {
-    int n, tb_start, tb_end;
+    int n;
     TranslationBlock *tb;
 
     assert_page_locked(p);
     p->code_bitmap = bitmap_new(TARGET_PAGE_SIZE);
 
     PAGE_FOR_EACH_TB(p, tb, n) {
-        /* NOTE: this is subtle as a TB may span two physical pages */
-        if (n == 0) {
-            /* NOTE: tb_end may be after the end of the page, but
-               it is not a problem */
-            tb_start = tb->pc & ~TARGET_PAGE_MASK;
-            tb_end = tb_start + tb->size;
-            if (tb_end > TARGET_PAGE_SIZE) {
-                tb_end = TARGET_PAGE_SIZE;
-             }
-        } else {
-            tb_start = 0;
-            tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
-        }
-        bitmap_set(p->code_bitmap, tb_start, tb_end - tb_start);
+        page_bitmap_add_tb(p, tb, n);
     }
 }
 #endif
@@ -1548,28 +1869,29 @@ static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
     page_already_protected = p->first_tb != (uintptr_t)NULL;
 #endif
     p->first_tb = (uintptr_t)tb | n;
-    invalidate_page_bitmap(p);
+#ifdef CONFIG_SOFTMMU
+    /*
+     * Keep an existing bitmap up to date rather than throwing it away:
+     * pages that JITs keep writing code into also keep gaining TBs.
+     */
+    if (p->code_bitmap) {
+        page_bitmap_add_tb(p, tb, n);
+    }
+#endif
 
 #if defined(CONFIG_USER_ONLY)
-    if (p->flags & PAGE_WRITE) {
-        target_ulong addr;
-        PageDesc *p2;
+    if (pageflags_find(page_addr) & PAGE_WRITE) {
+        target_ulong last;
         int prot;
 
         /* force the host page as non writable (writes will have a
            page fault + mprotect overhead) */
         page_addr &= qemu_host_page_mask;
-        prot = 0;
-        for (addr = page_addr; addr < page_addr + qemu_host_page_size;
-            addr += TARGET_PAGE_SIZE) {
-
-            p2 = page_find(addr >> TARGET_PAGE_BITS);
-            if (!p2) {
-                continue;
-            }
-            prot |= p2->flags;
-            p2->flags &= ~PAGE_WRITE;
-          }
+        last = page_addr + qemu_host_page_size - 1;
+        prot = pageflags_range_prot(page_addr, last);
+        seqlock_write_begin(&pageflags_seq);
+        pageflags_set_clear(page_addr, last, 0, PAGE_WRITE);
+        seqlock_write_end(&pageflags_seq);
         mprotect(g2h(page_addr), qemu_host_page_size,
                  (prot & PAGE_BITS) & ~PAGE_WRITE);
         if (DEBUG_TB_INVALIDATE_GATE) {
@@ -1644,10 +1966,10 @@ tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
         /* remove TB from the page(s) if we couldn't insert it */
         if (unlikely(existing_tb)) {
             tb_page_remove(p, tb);
-            invalidate_page_bitmap(p);
+            page_bitmap_tb_removed(p);
             if (p2) {
                 tb_page_remove(p2, tb);
-                invalidate_page_bitmap(p2);
+                page_bitmap_tb_removed(p2);
             }
             tb = existing_tb;
         }
@@ -1708,8 +2030,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
  buffer_overflow:
     tb = tb_alloc(pc);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* make room, flushing everything if need be */
+        tb_reclaim(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -1723,6 +2045,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->exec_count = 0;
+    tb->exec_ticks = 0;
     tcg_ctx->tb_cflags = cflags;
  tb_overflow:
 
@@ -1877,9 +2201,131 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         return existing_tb;
     }
     tcg_tb_insert(tb);
+    if (unlikely(tb_perf_map)) {
+        fprintf(tb_perf_map, "%" PRIxPTR " %zx guest:" TARGET_FMT_lx " %s\n",
+                (uintptr_t)tb->tc.ptr, tb->tc.size, tb->pc,
+                lookup_symbol(tb->pc));
+    }
     return tb;
 }
 
+#ifdef CONFIG_USER_ONLY
+/*
+ * Translate the guest code in [@start, @end) @passes times, with the
+ * flags of the current CPU state, and print how fast the frontend and
+ * the backend went.  Nothing is added to the TB cache and the code is
+ * generated again and again at the same spot of code_gen_buffer, so the
+ * next pass does the same work and the guest can still run afterwards.
+ *
+ * Optimization and liveness analysis are timed separately when QEMU is
+ * built with --enable-profiler.  Register allocation and emission are
+ * done op by op, and are reported together as "codegen".
+ */
+void tb_bench(CPUState *cpu, target_ulong start, target_ulong end,
+              int passes)
+{
+    CPUArchState *env = cpu->env_ptr;
+    TranslationBlock *tb = g_new0(TranslationBlock, 1);
+    target_ulong pc, cs_base;
+    uint32_t flags;
+    int cflags = curr_cflags();
+    int max_insns = singlestep ? 1 : TCG_MAX_INSNS;
+    int pass, size;
+    int64_t t0, t1, t2;
+#ifdef CONFIG_PROFILER
+    TCGProfile *prof = &tcg_ctx->prof;
+    int64_t opt_time, la_time;
+#endif
+
+    cflags &= ~CF_CLUSTER_MASK;
+    cflags |= cpu->cluster_index << CF_CLUSTER_SHIFT;
+    cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
+
+    mmap_lock();
+    for (pass = 1; pass <= passes; pass++) {
+        uint64_t tbs = 0, insns = 0, in_len = 0, out_len = 0;
+        int64_t front_time = 0, back_time = 0;
+
+#ifdef CONFIG_PROFILER
+        opt_time = prof->opt_time;
+        la_time = prof->la_time;
+#endif
+        for (pc = start; pc < end; pc += tb->size ? tb->size : 1) {
+            if (!(page_get_flags(pc) & PAGE_EXEC)) {
+                /* a hole in the text, skip the rest of the page */
+                tb->size = TARGET_PAGE_SIZE - (pc & ~TARGET_PAGE_MASK);
+                continue;
+            }
+
+            memset(tb, 0, sizeof(*tb));
+            tb->tc.ptr = tcg_ctx->code_gen_ptr;
+            tb->pc = pc;
+            tb->cs_base = cs_base;
+            tb->flags = flags;
+            tb->cflags = cflags;
+            tb->trace_vcpu_dstate = *cpu->trace_dstate;
+            tcg_ctx->tb_cflags = cflags;
+
+            t0 = get_clock();
+            tcg_func_start(tcg_ctx);
+            tcg_ctx->cpu = cpu;
+            gen_intermediate_code(cpu, tb, max_insns);
+            tcg_ctx->cpu = NULL;
+
+            tb->jmp_reset_offset[0] = TB_JMP_RESET_OFFSET_INVALID;
+            tb->jmp_reset_offset[1] = TB_JMP_RESET_OFFSET_INVALID;
+            tcg_ctx->tb_jmp_reset_offset = tb->jmp_reset_offset;
+            if (TCG_TARGET_HAS_direct_jump) {
+                tcg_ctx->tb_jmp_insn_offset = tb->jmp_target_arg;
+                tcg_ctx->tb_jmp_target_addr = NULL;
+            } else {
+                tcg_ctx->tb_jmp_insn_offset = NULL;
+                tcg_ctx->tb_jmp_target_addr = tb->jmp_target_arg;
+            }
+
+            t1 = get_clock();
+            size = tcg_gen_code(tcg_ctx, tb);
+            if (size >= 0) {
+                encode_search(tb, (void *)tb->tc.ptr + size);
+            }
+            t2 = get_clock();
+
+            if (size < 0) {
+                /* too large for one TB, or for a whole region */
+                error_report("tb-bench: cannot translate " TARGET_FMT_lx,
+                             pc);
+                continue;
+            }
+            tbs++;
+            insns += tb->icount;
+            in_len += tb->size;
+            out_len += size;
+            front_time += t1 - t0;
+            back_time += t2 - t1;
+        }
+
+        printf("tb-bench: pass %d: %" PRIu64 " TBs, %" PRIu64 " insns, "
+               "%" PRIu64 " guest bytes, %" PRIu64 " host bytes\n",
+               pass, tbs, insns, in_len, out_len);
+        printf("tb-bench: pass %d: %.0f TBs/s, %.2f host bytes/insn, "
+               "frontend %.3f ms, backend %.3f ms",
+               pass, tbs * 1e9 / MAX(front_time + back_time, 1),
+               (double)out_len / MAX(insns, 1),
+               front_time / 1e6, back_time / 1e6);
+#ifdef CONFIG_PROFILER
+        opt_time = prof->opt_time - opt_time;
+        la_time = prof->la_time - la_time;
+        printf(" (optimize %.3f ms, liveness %.3f ms, codegen %.3f ms)",
+               opt_time / 1e6, la_time / 1e6,
+               (back_time - opt_time - la_time) / 1e6);
+#endif
+        printf("\n");
+    }
+    mmap_unlock();
+    g_free(tb);
+}
+#endif /* CONFIG_USER_ONLY */
+
 /*
  * @p must be non-NULL.
  * user-mode: call with mmap_lock held.
@@ -2037,6 +2483,34 @@ void tb_invalidate_phys_range(target_ulong start, target_ulong end)
 }
 
 #ifdef CONFIG_SOFTMMU
+/* len must be <= 8 and start must be a multiple of len.
+ * Return false if a write to [@start, @start + len[ is known not to
+ * touch any translated code, so that the caller can skip
+ * page_collection_lock() and tb_invalidate_phys_page_fast().  This is
+ * only known once the page has a code bitmap.
+ */
+bool tb_page_write_hits_code(tb_page_addr_t start, int len)
+{
+    PageDesc *p;
+    bool ret = true;
+
+    p = page_find(start >> TARGET_PAGE_BITS);
+    if (!p) {
+        return false;
+    }
+
+    page_lock(p);
+    if (p->code_bitmap) {
+        unsigned int nr = start & ~TARGET_PAGE_MASK;
+        unsigned long b;
+
+        b = p->code_bitmap[BIT_WORD(nr)] >> (nr & (BITS_PER_LONG - 1));
+        ret = b & ((1 << len) - 1);
+    }
+    page_unlock(p);
+    return ret;
+}
+
 /* len must be <= 8 and start must be a multiple of len.
  * Called via softmmu_template.h when code areas are written to with
  * iothread mutex not held.
@@ -2266,6 +2740,10 @@ static void print_qht_statistics(struct qht_stats hst)
     qemu_printf("TB hash buckets     %zu/%zu (%0.2f%% head buckets used)\n",
                 hst.used_head_buckets, hst.head_buckets,
                 (double)hst.used_head_buckets / hst.head_buckets * 100);
+    if (hst.pending_buckets) {
+        qemu_printf("TB hash resizing    %zu buckets left to migrate\n",
+                    hst.pending_buckets);
+    }
 
     hgram_opts =  QDIST_PR_BORDER | QDIST_PR_LABELS;
     hgram_opts |= QDIST_PR_100X   | QDIST_PR_PERCENT;
@@ -2329,6 +2807,8 @@ void dump_exec_info(void)
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
     size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t jc_hits = 0, jc_misses = 0, ht_misses = 0;
+    CPUState *cpu;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -2366,6 +2846,17 @@ void dump_exec_info(void)
     qemu_printf("TB invalidate count %zu\n",
                 tcg_tb_phys_invalidate_count());
 
+    CPU_FOREACH(cpu) {
+        jc_hits += atomic_read(&cpu->tb_jmp_cache_hits);
+        jc_misses += atomic_read(&cpu->tb_jmp_cache_misses);
+        ht_misses += atomic_read(&cpu->tb_htable_misses);
+    }
+    qemu_printf("TB jmp cache hits   %zu (%zu%%)\n", jc_hits,
+                jc_hits + jc_misses ?
+                (jc_hits * 100) / (jc_hits + jc_misses) : 0);
+    qemu_printf("TB jmp cache misses %zu (htable misses=%zu)\n",
+                jc_misses, ht_misses);
+
     tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
     qemu_printf("TLB full flushes    %zu\n", flush_full);
     qemu_printf("TLB partial flushes %zu\n", flush_part);
@@ -2378,6 +2869,133 @@ void dump_opcount_info(void)
     tcg_dump_op_count();
 }
 
+/* Runs as safe work, so that no vCPU is writing to the perf map */
+static void tb_profile_close_map(CPUState *cpu, run_on_cpu_data data)
+{
+    if (tb_perf_map && !atomic_read(&tb_profile)) {
+        fclose(tb_perf_map);
+        tb_perf_map = NULL;
+    }
+}
+
+/*
+ * While profiling, TBs are not chained, so that every execution goes
+ * through cpu_tb_exec() and is counted there.  Flush on enabling to get
+ * rid of the existing direct jumps, and start a perf map so that host
+ * samples in generated code can be attributed to guest code.  The map
+ * is closed again when profiling stops.
+ */
+void tb_profile_set(CPUState *cpu, bool on)
+{
+    if (on && !tb_profile) {
+        if (!tb_perf_map) {
+            char *name = g_strdup_printf("/tmp/perf-%d.map", getpid());
+
+            tb_perf_map = fopen(name, "w");
+            if (tb_perf_map) {
+                setvbuf(tb_perf_map, NULL, _IOLBF, 0);
+            } else {
+                warn_report("jit-profile: cannot open %s: %s",
+                            name, strerror(errno));
+            }
+            g_free(name);
+        }
+        tb_flush(cpu);
+    }
+    atomic_set(&tb_profile, on);
+    if (!on && tb_perf_map) {
+        async_safe_run_on_cpu(cpu, tb_profile_close_map, RUN_ON_CPU_NULL);
+    }
+}
+
+static gboolean tb_profile_reset_iter(gpointer key, gpointer value,
+                                      gpointer data)
+{
+    TranslationBlock *tb = value;
+
+    tb->exec_count = 0;
+    tb->exec_ticks = 0;
+    return false;
+}
+
+void tb_profile_reset(void)
+{
+    tcg_tb_foreach(tb_profile_reset_iter, NULL);
+}
+
+typedef struct TBProfileEntry {
+    target_ulong pc;
+    uint64_t exec_count;
+    uint64_t exec_ticks;
+} TBProfileEntry;
+
+static gboolean tb_profile_collect_iter(gpointer key, gpointer value,
+                                        gpointer data)
+{
+    TranslationBlock *tb = value;
+    TBProfileEntry e = {
+        .pc = tb->pc,
+        .exec_count = tb->exec_count,
+        .exec_ticks = tb->exec_ticks,
+    };
+
+    if (e.exec_count) {
+        g_array_append_val(data, e);
+    }
+    return false;
+}
+
+static gint tb_profile_cmp(gconstpointer ap, gconstpointer bp)
+{
+    const TBProfileEntry *a = ap;
+    const TBProfileEntry *b = bp;
+
+    return a->exec_count < b->exec_count ? 1 :
+           a->exec_count > b->exec_count ? -1 : 0;
+}
+
+void dump_tb_profile(int max)
+{
+    GArray *tbs = g_array_new(false, false, sizeof(TBProfileEntry));
+    uint64_t total = 0;
+    unsigned reclaim_count;
+    guint i, n;
+
+    /*
+     * vCPUs keep running, and a flush or a reclaim may reuse the memory
+     * of the TBs while they are walked.  Only copy their counters, and
+     * start over if that happened.
+     */
+    do {
+        g_array_set_size(tbs, 0);
+        reclaim_count = atomic_mb_read(&tb_ctx.tb_reclaim_count);
+        tcg_tb_foreach(tb_profile_collect_iter, tbs);
+        smp_rmb();
+    } while (reclaim_count != atomic_read(&tb_ctx.tb_reclaim_count));
+
+    g_array_sort(tbs, tb_profile_cmp);
+    for (i = 0; i < tbs->len; i++) {
+        total += g_array_index(tbs, TBProfileEntry, i).exec_count;
+    }
+
+    qemu_printf("JIT profile is %s, %u TBs executed\n",
+                tb_profile ? "on" : "off", tbs->len);
+    qemu_printf("%-18s %12s %6s %14s %8s  %s\n",
+                "guest pc", "executions", "%", "host ticks", "ticks/ex",
+                "symbol");
+    n = max > 0 ? MIN(tbs->len, (guint)max) : 0;
+    for (i = 0; i < n; i++) {
+        const TBProfileEntry *e = &g_array_index(tbs, TBProfileEntry, i);
+
+        qemu_printf("0x" TARGET_FMT_lx " %12" PRIu64 " %6.2f %14" PRIu64
+                    " %8" PRIu64 "  %s\n",
+                    e->pc, e->exec_count, e->exec_count * 100.0 / total,
+                    e->exec_ticks, e->exec_ticks / e->exec_count,
+                    lookup_symbol(e->pc));
+    }
+    g_array_free(tbs, true);
+}
+
 #else /* CONFIG_USER_ONLY */
 
 void cpu_interrupt(CPUState *cpu, int mask)
@@ -2414,65 +3032,39 @@ static int walk_memory_regions_end(struct walk_memory_regions_data *data,
     return 0;
 }
 
-static int walk_memory_regions_1(struct walk_memory_regions_data *data,
-                                 target_ulong base, int level, void **lp)
-{
-    target_ulong pa;
-    int i, rc;
-
-    if (*lp == NULL) {
-        return walk_memory_regions_end(data, base, 0);
-    }
-
-    if (level == 0) {
-        PageDesc *pd = *lp;
-
-        for (i = 0; i < V_L2_SIZE; ++i) {
-            int prot = pd[i].flags;
-
-            pa = base | (i << TARGET_PAGE_BITS);
-            if (prot != data->prot) {
-                rc = walk_memory_regions_end(data, pa, prot);
-                if (rc != 0) {
-                    return rc;
-                }
-            }
-        }
-    } else {
-        void **pp = *lp;
-
-        for (i = 0; i < V_L2_SIZE; ++i) {
-            pa = base | ((target_ulong)i <<
-                (TARGET_PAGE_BITS + V_L2_BITS * level));
-            rc = walk_memory_regions_1(data, pa, level - 1, pp + i);
-            if (rc != 0) {
-                return rc;
-            }
-        }
-    }
-
-    return 0;
-}
-
 int walk_memory_regions(void *priv, walk_memory_regions_fn fn)
 {
     struct walk_memory_regions_data data;
-    uintptr_t i, l1_sz = v_l1_size;
+    PageFlagsNode *p;
+    target_ulong end = 0;
+    int rc = 0;
 
     data.fn = fn;
     data.priv = priv;
     data.start = -1u;
     data.prot = 0;
 
-    for (i = 0; i < l1_sz; i++) {
-        target_ulong base = i << (v_l1_shift + TARGET_PAGE_BITS);
-        int rc = walk_memory_regions_1(&data, base, v_l2_levels, l1_map + i);
-        if (rc != 0) {
-            return rc;
+    mmap_lock();
+    for (p = pageflags_lower_bound(0); p; p = pageflags_next(p)) {
+        if (p->start != end) {
+            /* unmapped pages end the region */
+            rc = walk_memory_regions_end(&data, end, 0);
+            if (rc != 0) {
+                goto out;
+            }
         }
+        if (p->flags != data.prot) {
+            rc = walk_memory_regions_end(&data, p->start, p->flags);
+            if (rc != 0) {
+                goto out;
+            }
+        }
+        end = p->last + 1;
     }
-
-    return walk_memory_regions_end(&data, 0, 0);
+    rc = walk_memory_regions_end(&data, end, 0);
+out:
+    mmap_unlock();
+    return rc;
 }
 
 static int dump_region(void *priv, target_ulong start,
@@ -2501,13 +3093,45 @@ void page_dump(FILE *f)
 
 int page_get_flags(target_ulong address)
 {
-    PageDesc *p;
+    unsigned seq;
+    int flags;
 
-    p = page_find(address >> TARGET_PAGE_BITS);
-    if (!p) {
-        return 0;
+    rcu_read_lock();
+    do {
+        seq = seqlock_read_begin(&pageflags_seq);
+        flags = pageflags_find(address);
+    } while (seqlock_read_retry(&pageflags_seq, seq));
+    rcu_read_unlock();
+    return flags;
+}
+
+/*
+ * Invalidate the code in [@start, @last].  Pages without a PageDesc have
+ * no TBs, and the PageDescs come in blocks of V_L2_SIZE, so that ranges
+ * without code are skipped quickly.
+ */
+static void page_invalidate_code(target_ulong start, target_ulong last)
+{
+    tb_page_addr_t index = start >> TARGET_PAGE_BITS;
+    tb_page_addr_t end = last >> TARGET_PAGE_BITS;
+
+    for (;;) {
+        PageDesc *p = page_find(index);
+        tb_page_addr_t next;
+
+        if (p) {
+            if (p->first_tb) {
+                tb_invalidate_phys_page(index << TARGET_PAGE_BITS, 0);
+            }
+            next = index + 1;
+        } else {
+            next = (index | (V_L2_SIZE - 1)) + 1;
+        }
+        if (next > end || next <= index) {
+            break;
+        }
+        index = next;
     }
-    return p->flags;
 }
 
 /* Modify the flags of a page and invalidate the code if necessary.
@@ -2515,7 +3139,7 @@ int page_get_flags(target_ulong address)
    on PAGE_WRITE.  The mmap_lock should already be held.  */
 void page_set_flags(target_ulong start, target_ulong end, int flags)
 {
-    target_ulong addr, len;
+    target_ulong last;
 
     /* This function should never be called with addresses outside the
        guest address space.  If this assert fires, it probably indicates
@@ -2527,33 +3151,89 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
     assert_memory_lock();
 
     start = start & TARGET_PAGE_MASK;
-    end = TARGET_PAGE_ALIGN(end);
+    last = TARGET_PAGE_ALIGN(end) - 1;
 
     if (flags & PAGE_WRITE) {
+        PageFlagsNode *p;
+        target_ulong addr = start;
+        bool done = false;
+
         flags |= PAGE_WRITE_ORG;
+
+        /* If the write protection bit is set, then we invalidate
+           the code inside: in every page that is not writable.  */
+        for (p = pageflags_lower_bound(start); p && p->start <= last;
+             p = pageflags_next(p)) {
+            if (!(p->flags & PAGE_WRITE)) {
+                continue;
+            }
+            if (p->start > addr) {
+                page_invalidate_code(addr, p->start - 1);
+            }
+            if (p->last >= last) {
+                done = true;
+                break;
+            }
+            addr = p->last + 1;
+        }
+        if (!done) {
+            page_invalidate_code(addr, last);
+        }
     }
 
-    for (addr = start, len = end - start;
-         len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        PageDesc *p = page_find_alloc(addr >> TARGET_PAGE_BITS, 1);
+    seqlock_write_begin(&pageflags_seq);
+    pageflags_set(start, last, flags);
+    seqlock_write_end(&pageflags_seq);
+}
+
+/*
+ * Check [@start, @last] for page_check_range().  Return 0 if the access
+ * is allowed, -1 if it is not, and 1 with the page in *@unprotect if
+ * that page has to be unprotected first.
+ */
+static int pageflags_check(target_ulong start, target_ulong last, int flags,
+                           target_ulong *unprotect)
+{
+    PageFlagsNode *p = pageflags_lower_bound(start);
+    target_ulong addr = start;
+
+    for (;;) {
+        target_ulong p_last;
+        int p_flags;
 
-        /* If the write protection bit is set, then we invalidate
-           the code inside.  */
-        if (!(p->flags & PAGE_WRITE) &&
-            (flags & PAGE_WRITE) &&
-            p->first_tb) {
-            tb_invalidate_phys_page(addr, 0);
+        if (!p || p->start > addr) {
+            return -1;
+        }
+        p_last = p->last;
+        p_flags = p->flags;
+        if (p_last < addr || !(p_flags & PAGE_VALID)) {
+            /* or raced with a writer */
+            return -1;
+        }
+
+        if ((flags & PAGE_READ) && !(p_flags & PAGE_READ)) {
+            return -1;
+        }
+        if (flags & PAGE_WRITE) {
+            if (!(p_flags & PAGE_WRITE_ORG)) {
+                return -1;
+            }
+            if (!(p_flags & PAGE_WRITE)) {
+                *unprotect = addr;
+                return 1;
+            }
         }
-        p->flags = flags;
+        if (p_last >= last) {
+            return 0;
+        }
+        addr = p_last + 1;
+        p = pageflags_lower_bound(addr);
     }
 }
 
 int page_check_range(target_ulong start, target_ulong len, int flags)
 {
-    PageDesc *p;
-    target_ulong end;
-    target_ulong addr;
+    target_ulong last;
 
     /* This function should never be called with addresses outside the
        guest address space.  If this assert fires, it probably indicates
@@ -2571,37 +3251,34 @@ int page_check_range(target_ulong start, target_ulong len, int flags)
     }
 
     /* must do before we loose bits in the next step */
-    end = TARGET_PAGE_ALIGN(start + len);
+    last = TARGET_PAGE_ALIGN(start + len) - 1;
     start = start & TARGET_PAGE_MASK;
 
-    for (addr = start, len = end - start;
-         len != 0;
-         len -= TARGET_PAGE_SIZE, addr += TARGET_PAGE_SIZE) {
-        p = page_find(addr >> TARGET_PAGE_BITS);
-        if (!p) {
-            return -1;
+    for (;;) {
+        target_ulong addr;
+        unsigned seq;
+        int ret;
+
+        rcu_read_lock();
+        do {
+            seq = seqlock_read_begin(&pageflags_seq);
+            ret = pageflags_check(start, last, flags, &addr);
+        } while (seqlock_read_retry(&pageflags_seq, seq));
+        rcu_read_unlock();
+
+        if (ret <= 0) {
+            return ret;
         }
-        if (!(p->flags & PAGE_VALID)) {
+        /* unprotect the page if it was put read-only because it
+           contains translated code */
+        if (!page_unprotect(addr, 0)) {
             return -1;
         }
-
-        if ((flags & PAGE_READ) && !(p->flags & PAGE_READ)) {
-            return -1;
-        }
-        if (flags & PAGE_WRITE) {
-            if (!(p->flags & PAGE_WRITE_ORG)) {
-                return -1;
-            }
-            /* unprotect the page if it was put read-only because it
-               contains translated code */
-            if (!(p->flags & PAGE_WRITE)) {
-                if (!page_unprotect(addr, 0)) {
-                    return -1;
-                }
-            }
+        if (addr + TARGET_PAGE_SIZE - 1 >= last) {
+            return 0;
         }
+        start = addr + TARGET_PAGE_SIZE;
     }
-    return 0;
 }
 
 /* called from signal handler: invalidate the code and unprotect the
@@ -2614,7 +3291,7 @@ int page_unprotect(target_ulong address, uintptr_t pc)
 {
     unsigned int prot;
     bool current_tb_invalidated;
-    PageDesc *p;
+    int flags;
     target_ulong host_start, host_end, addr;
 
     /* Technically this isn't safe inside a signal handler.  However we
@@ -2622,17 +3299,13 @@ int page_unprotect(target_ulong address, uintptr_t pc)
        practice it seems to be ok.  */
     mmap_lock();
 
-    p = page_find(address >> TARGET_PAGE_BITS);
-    if (!p) {
-        mmap_unlock();
-        return 0;
-    }
+    flags = pageflags_find(address);
 
     /* if the page was really writable, then we change its
        protection back to writable */
-    if (p->flags & PAGE_WRITE_ORG) {
+    if (flags & PAGE_WRITE_ORG) {
         current_tb_invalidated = false;
-        if (p->flags & PAGE_WRITE) {
+        if (flags & PAGE_WRITE) {
             /* If the page is actually marked WRITE then assume this is because
              * this thread raced with another one which got here first and
              * set the page to PAGE_WRITE and did the TB invalidate for us.
@@ -2647,12 +3320,12 @@ int page_unprotect(target_ulong address, uintptr_t pc)
             host_start = address & qemu_host_page_mask;
             host_end = host_start + qemu_host_page_size;
 
-            prot = 0;
-            for (addr = host_start; addr < host_end; addr += TARGET_PAGE_SIZE) {
-                p = page_find(addr >> TARGET_PAGE_BITS);
-                p->flags |= PAGE_WRITE;
-                prot |= p->flags;
+            seqlock_write_begin(&pageflags_seq);
+            pageflags_set_clear(host_start, host_end - 1, PAGE_WRITE, 0);
+            seqlock_write_end(&pageflags_seq);
+            prot = pageflags_range_prot(host_start, host_end - 1);
 
+            for (addr = host_start; addr < host_end; addr += TARGET_PAGE_SIZE) {
                 /* and since the content will be modified, we must invalidate
                    the corresponding translated code. */
                 current_tb_invalidated |= tb_invalidate_phys_page(addr, pc);
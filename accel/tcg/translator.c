@@ -16,6 +16,7 @@
 #include "exec/gen-icount.h"
 #include "exec/log.h"
 #include "exec/translator.h"
+#include "exec/plugin-gen.h"
 
 /* Pairs with tcg_clear_temp_count.
    To be called by #TranslatorOps.{translate_insn,tb_stop} if
@@ -30,10 +31,34 @@ void translator_loop_temp_check(DisasContextBase *db)
     }
 }
 
+/*
+ * Only forward branches within the page qualify: the TB's extent
+ * [pc_first, pc_next) then still covers all the code it was translated
+ * from, plus the skipped gap, so the invalidation of the TB on writes
+ * to its page stays correct.
+ */
+bool translator_follow_branch(DisasContextBase *db, target_ulong dest,
+                              int insn_size)
+{
+    target_ulong page_end = (db->pc_first | ~TARGET_PAGE_MASK) + 1;
+
+    if (dest < db->pc_next || dest >= page_end || db->singlestep_enabled ||
+        (tb_cflags(db->tb) & (CF_USE_ICOUNT | CF_LAST_IO))) {
+        return false;
+    }
+
+    db->pc_next = dest;
+    /* Re-bound the insn count to what is left of the page from here */
+    db->max_insns = MIN(db->max_insns,
+                        db->num_insns + (page_end - dest) / insn_size);
+    return true;
+}
+
 void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
                      CPUState *cpu, TranslationBlock *tb, int max_insns)
 {
     int bp_insn = 0;
+    bool plugin_enabled;
 
     /* Initialize DisasContext */
     db->tb = tb;
@@ -55,11 +80,17 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     ops->tb_start(db, cpu);
     tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
 
+    plugin_enabled = plugin_gen_tb_start(cpu, tb);
+
     while (true) {
         db->num_insns++;
         ops->insn_start(db, cpu);
         tcg_debug_assert(db->is_jmp == DISAS_NEXT);  /* no early exit */
 
+        if (plugin_enabled) {
+            plugin_gen_insn_start(cpu, db);
+        }
+
         /* Pass breakpoint hits to target for further processing */
         if (!db->singlestep_enabled
             && unlikely(!QTAILQ_EMPTY(&cpu->breakpoints))) {
@@ -94,6 +125,10 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
             ops->translate_insn(db, cpu);
         }
 
+        if (plugin_enabled) {
+            plugin_gen_insn_end(cpu, db);
+        }
+
         /* Stop translation if translate_insn so indicated.  */
         if (db->is_jmp != DISAS_NEXT) {
             break;
@@ -111,6 +146,10 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
     ops->tb_stop(db, cpu);
     gen_tb_end(db->tb, db->num_insns - bp_insn);
 
+    if (plugin_enabled) {
+        plugin_gen_tb_end(cpu);
+    }
+
     /* The disas_log hook may use these values rather than recompute.  */
     db->tb->size = db->pc_next - db->pc_first;
     db->tb->icount = db->num_insns;
@@ -801,15 +801,55 @@ static int audio_is_timer_needed(AudioState *s)
     return 0;
 }
 
+static int64_t audio_samples_to_ns(struct audio_pcm_info *info,
+                                   size_t samples)
+{
+    return muldiv64(samples, NANOSECONDS_PER_SECOND, info->freq);
+}
+
+/*
+ * Time until the next run: before what is queued for playback has
+ * drained halfway (or, if nothing is queued, half the playback buffer,
+ * so that a starved voice is refilled quickly), and before half of the
+ * capture buffer has filled.  timer-period is the longest wait, and
+ * also the shortest when it is below 1 ms.
+ */
+static int64_t audio_timer_wait(AudioState *s)
+{
+    HWVoiceIn *hwi = NULL;
+    HWVoiceOut *hwo = NULL;
+    int64_t wait = s->period_ticks;
+
+    while ((hwo = audio_pcm_hw_find_any_enabled_out(s, hwo))) {
+        size_t live;
+
+        if (hwo->poll_mode) {
+            continue;
+        }
+        live = audio_pcm_hw_get_live_out(hwo, NULL);
+        wait = MIN(wait, audio_samples_to_ns(&hwo->info,
+                                             (live ?: hwo->samples) / 2));
+    }
+    while ((hwi = audio_pcm_hw_find_any_enabled_in(s, hwi))) {
+        if (!hwi->poll_mode) {
+            wait = MIN(wait, audio_samples_to_ns(&hwi->info,
+                                                 hwi->samples / 2));
+        }
+    }
+
+    return MAX(wait, MIN(s->period_ticks, SCALE_MS));
+}
+
 static void audio_reset_timer (AudioState *s)
 {
     if (audio_is_timer_needed(s)) {
+        s->timer_wait = audio_timer_wait(s);
         timer_mod_anticipate_ns(s->ts,
-            qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + s->period_ticks);
+            qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + s->timer_wait);
         if (!s->timer_running) {
             s->timer_running = true;
             s->timer_last = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
-            trace_audio_timer_start(s->period_ticks / SCALE_MS);
+            trace_audio_timer_start(s->timer_wait / SCALE_MS);
         }
     } else {
         timer_del(s->ts);
@@ -827,7 +867,7 @@ static void audio_timer (void *opaque)
 
     now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
     diff = now - s->timer_last;
-    if (diff > s->period_ticks * 3 / 2) {
+    if (diff > s->timer_wait * 3 / 2) {
         trace_audio_timer_delayed(diff / SCALE_MS);
     }
     s->timer_last = now;
@@ -194,6 +194,7 @@ typedef struct AudioState {
 
     bool timer_running;
     uint64_t timer_last;
+    int64_t timer_wait;         /* Time until the timer was last set to run */
 
     QTAILQ_ENTRY(AudioState) list;
 } AudioState;
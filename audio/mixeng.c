@@ -23,6 +23,7 @@
  * THE SOFTWARE.
  */
 #include "qemu/osdep.h"
+#include <math.h>
 #include "qemu/bswap.h"
 #include "qemu/error-report.h"
 #include "audio.h"
@@ -315,29 +316,102 @@ void audio_sample_from_uint64(void *samples, int pos,
  * Sound Tools rate change effect file.
  */
 /*
- * Linear Interpolation.
+ * Polyphase interpolation.
  *
  * The use of fractional increment allows us to use no buffer. It
  * avoid the problems at the end of the buffer we had with the old
  * method which stored a possibly big buffer of size
  * lcm(in_rate,out_rate).
  *
- * Limited to 16 bit samples and sampling frequency <= 65535 Hz. If
- * the input & output frequencies are equal, a delay of one sample is
- * introduced.  Limited to processing 32-bit count worth of samples.
- *
- * 1 << FRAC_BITS evaluating to zero in several places.  Changed with
- * an (unsigned long) cast to make it safe.  MarkMLl 2/1/99
+ * Each output sample is a RATE_TAPS-tap FIR over the last input
+ * samples, using one of RATE_PHASES windowed sinc filters picked by
+ * the fractional output position.  This delays the output by
+ * RATE_TAPS / 2 input samples.  When downsampling, the filters also
+ * cut off at the output Nyquist frequency.  Limited to processing
+ * 32-bit count worth of samples.
  */
+#define RATE_TAPS       8
+#define RATE_PHASE_BITS 6
+#define RATE_PHASES     (1 << RATE_PHASE_BITS)
+
+#ifdef FLOAT_MIXENG
+typedef mixeng_real rate_coef;
+#else
+/* Fixed point with RATE_COEF_SHIFT fraction bits */
+#define RATE_COEF_SHIFT 20
+typedef int32_t rate_coef;
+#endif
 
 /* Private data */
 struct rate {
     uint64_t opos;
     uint64_t opos_inc;
     uint32_t ipos;              /* position in the input stream (integer) */
-    struct st_sample ilast;          /* last sample in the input stream */
+    /*
+     * The last RATE_TAPS input samples, oldest first, are
+     * hist[hpos..hpos + RATE_TAPS - 1]; the two halves are kept
+     * identical so that this window never wraps.
+     */
+    unsigned int hpos;
+    struct st_sample hist[2 * RATE_TAPS];
+    rate_coef coef[RATE_PHASES][RATE_TAPS];
 };
 
+static void st_rate_init_coef(struct rate *rate, int inrate, int outrate)
+{
+    double fc = inrate > outrate ? (double) outrate / inrate : 1.0;
+    double h[RATE_TAPS], sum;
+    int phase, i;
+
+    for (phase = 0; phase < RATE_PHASES; phase++) {
+        double t = (double) phase / RATE_PHASES;
+
+        sum = 0;
+        for (i = 0; i < RATE_TAPS; i++) {
+            /* Distance from the output position, in input samples */
+            double d = i + 1 - RATE_TAPS / 2 - t;
+            double x = M_PI * fc * d;
+            double w = 0.5 * (1 + cos(M_PI * d / (RATE_TAPS / 2)));
+
+            h[i] = (d == 0 ? 1 : sin(x) / x) * w;
+            sum += h[i];
+        }
+        for (i = 0; i < RATE_TAPS; i++) {
+#ifdef FLOAT_MIXENG
+            rate->coef[phase][i] = h[i] / sum;
+#else
+            rate->coef[phase][i] = lrint(h[i] / sum * (1 << RATE_COEF_SHIFT));
+#endif
+        }
+    }
+}
+
+static inline void st_rate_push(struct rate *rate, const struct st_sample *s)
+{
+    rate->hist[rate->hpos] = *s;
+    rate->hist[rate->hpos + RATE_TAPS] = *s;
+    rate->hpos = (rate->hpos + 1) % RATE_TAPS;
+}
+
+static inline struct st_sample st_rate_filter(struct rate *rate)
+{
+    const struct st_sample *win = rate->hist + rate->hpos;
+    const rate_coef *coef =
+        rate->coef[(rate->opos & UINT_MAX) >> (32 - RATE_PHASE_BITS)];
+    struct st_sample out = { 0, 0 };
+    int i;
+
+    for (i = 0; i < RATE_TAPS; i++) {
+        out.l += win[i].l * coef[i];
+        out.r += win[i].r * coef[i];
+    }
+#ifndef FLOAT_MIXENG
+    out.l >>= RATE_COEF_SHIFT;
+    out.r >>= RATE_COEF_SHIFT;
+#endif
+    return out;
+}
+
 /*
  * Prepare processing.
  */
@@ -356,8 +430,8 @@ void *st_rate_start (int inrate, int outrate)
     rate->opos_inc = ((uint64_t) inrate << 32) / outrate;
 
     rate->ipos = 0;
-    rate->ilast.l = 0;
-    rate->ilast.r = 0;
+    rate->hpos = 0;
+    st_rate_init_coef(rate, inrate, outrate);
     return rate;
 }
 
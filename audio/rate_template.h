@@ -33,14 +33,7 @@ void NAME (void *opaque, struct st_sample *ibuf, struct st_sample *obuf,
     struct rate *rate = opaque;
     struct st_sample *istart, *iend;
     struct st_sample *ostart, *oend;
-    struct st_sample ilast, icur, out;
-#ifdef FLOAT_MIXENG
-    mixeng_real t;
-#else
-    int64_t t;
-#endif
-
-    ilast = rate->ilast;
+    struct st_sample out;
 
     istart = ibuf;
     iend = ibuf + *isamp;
@@ -61,15 +54,15 @@ void NAME (void *opaque, struct st_sample *ibuf, struct st_sample *obuf,
 
     while (obuf < oend) {
 
-        /* Safety catch to make sure we have input samples.  */
-        if (ibuf >= iend) {
-            break;
-        }
-
         /* read as many input samples so that ipos > opos */
 
         while (rate->ipos <= (rate->opos >> 32)) {
-            ilast = *ibuf++;
+            /* See if we finished the input buffer yet */
+            if (ibuf >= iend) {
+                goto the_end;
+            }
+
+            st_rate_push(rate, ibuf++);
             rate->ipos++;
 
             /* if ipos overflow, there is  a infinite loop */
@@ -77,28 +70,9 @@ void NAME (void *opaque, struct st_sample *ibuf, struct st_sample *obuf,
                 rate->ipos = 1;
                 rate->opos = rate->opos & 0xffffffff;
             }
-            /* See if we finished the input buffer yet */
-            if (ibuf >= iend) {
-                goto the_end;
-            }
         }
 
-        icur = *ibuf;
-
-        /* interpolate */
-#ifdef FLOAT_MIXENG
-#ifdef RECIPROCAL
-        t = (rate->opos & UINT_MAX) * (1.f / UINT_MAX);
-#else
-        t = (rate->opos & UINT_MAX) / (mixeng_real) UINT_MAX;
-#endif
-        out.l = (ilast.l * (1.0 - t)) + icur.l * t;
-        out.r = (ilast.r * (1.0 - t)) + icur.r * t;
-#else
-        t = rate->opos & 0xffffffff;
-        out.l = (ilast.l * ((int64_t) UINT_MAX - t) + icur.l * t) >> 32;
-        out.r = (ilast.r * ((int64_t) UINT_MAX - t) + icur.r * t) >> 32;
-#endif
+        out = st_rate_filter(rate);
 
         /* output sample & increment position */
         OP (obuf->l, out.l);
@@ -110,7 +84,6 @@ void NAME (void *opaque, struct st_sample *ibuf, struct st_sample *obuf,
 the_end:
     *isamp = ibuf - istart;
     *osamp = obuf - ostart;
-    rate->ilast = ilast;
 }
 
 #undef NAME
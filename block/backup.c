@@ -22,11 +22,15 @@
 #include "qapi/qmp/qerror.h"
 #include "qemu/ratelimit.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "sysemu/block-backend.h"
 #include "qemu/bitmap.h"
 #include "qemu/error-report.h"
 
 #define BACKUP_CLUSTER_SIZE_DEFAULT (1 << 16)
+/* backup_loop() copies up to BACKUP_MAX_WORKERS chunks at a time */
+#define BACKUP_MAX_WORKERS 8
+#define BACKUP_MAX_CHUNK (4 * MiB)
 
 typedef struct CowRequest {
     int64_t start_byte;
@@ -58,8 +62,19 @@ typedef struct BackupBlockJob {
 
     BdrvRequestFlags write_flags;
     bool initializing_bitmap;
+
+    int workers;                /* backup_loop() chunks in flight */
+    CoQueue worker_queue;       /* backup_loop() waiting for a worker */
+    int worker_ret;             /* first error of a worker */
+    bool worker_error_is_read;
 } BackupBlockJob;
 
+typedef struct BackupWorker {
+    BackupBlockJob *job;
+    int64_t offset;
+    uint64_t bytes;
+} BackupWorker;
+
 static const BlockJobDriver backup_job_driver;
 
 /* See if in-flight requests overlap and wait for them to complete */
@@ -473,30 +488,102 @@ static bool coroutine_fn yield_and_check(BackupBlockJob *job)
     return false;
 }
 
-static int coroutine_fn backup_loop(BackupBlockJob *job)
+static void coroutine_fn backup_worker(void *opaque)
 {
+    BackupWorker *w = opaque;
+    BackupBlockJob *job = w->job;
     bool error_is_read;
+    int ret;
+
+    ret = backup_do_cow(job, w->offset, w->bytes, &error_is_read, false);
+    if (ret < 0 && job->worker_ret >= 0) {
+        job->worker_ret = ret;
+        job->worker_error_is_read = error_is_read;
+    }
+    g_free(w);
+
+    job->workers--;
+    qemu_co_queue_next(&job->worker_queue);
+}
+
+static void coroutine_fn backup_wait_for_workers(BackupBlockJob *job)
+{
+    while (job->workers) {
+        qemu_co_queue_wait(&job->worker_queue, NULL);
+    }
+}
+
+/*
+ * Copy the dirty clusters with up to BACKUP_MAX_WORKERS coroutines, each
+ * taking a chunk of the image.  Chunks start at one cluster and double
+ * while the copy goes well, so that offloaded copies get to be large.
+ */
+static int coroutine_fn backup_loop(BackupBlockJob *job)
+{
+    int64_t max_chunk = MAX(job->cluster_size,
+                            QEMU_ALIGN_DOWN(BACKUP_MAX_CHUNK,
+                                            job->cluster_size));
+    int64_t chunk = job->cluster_size;
     int64_t offset;
     BdrvDirtyBitmapIter *bdbi;
+    BackupWorker *w;
+    bool at_end = false;
     int ret = 0;
 
+    qemu_co_queue_init(&job->worker_queue);
+    job->worker_ret = 0;
+
     bdbi = bdrv_dirty_iter_new(job->copy_bitmap);
-    while ((offset = bdrv_dirty_iter_next(bdbi)) != -1) {
-        do {
-            if (yield_and_check(job)) {
-                goto out;
+    for (;;) {
+        if (yield_and_check(job)) {
+            break;
+        }
+        while (job->workers >= BACKUP_MAX_WORKERS) {
+            qemu_co_queue_wait(&job->worker_queue, NULL);
+        }
+
+        if (job->worker_ret < 0) {
+            backup_wait_for_workers(job);
+            ret = job->worker_ret;
+            job->worker_ret = 0;
+            if (backup_error_action(job, job->worker_error_is_read, -ret) ==
+                BLOCK_ERROR_ACTION_REPORT) {
+                break;
             }
-            ret = backup_do_cow(job, offset,
-                                job->cluster_size, &error_is_read, false);
-            if (ret < 0 && backup_error_action(job, error_is_read, -ret) ==
-                           BLOCK_ERROR_ACTION_REPORT)
-            {
-                goto out;
+            /* failed chunks are dirty again, start over */
+            ret = 0;
+            chunk = job->cluster_size;
+            bdrv_set_dirty_iter(bdbi, 0);
+            at_end = false;
+            continue;
+        }
+
+        offset = at_end ? -1 : bdrv_dirty_iter_next(bdbi);
+        if (offset == -1) {
+            if (!job->workers) {
+                break;
             }
-        } while (ret < 0);
+            /* a failure could make clusters dirty again */
+            qemu_co_queue_wait(&job->worker_queue, NULL);
+            continue;
+        }
+
+        w = g_new(BackupWorker, 1);
+        w->job = job;
+        w->offset = offset;
+        w->bytes = MIN(chunk, job->len - offset);
+        if (offset + w->bytes < job->len) {
+            bdrv_set_dirty_iter(bdbi, offset + w->bytes);
+        } else {
+            at_end = true;
+        }
+        chunk = MIN(chunk * 2, max_chunk);
+
+        job->workers++;
+        qemu_coroutine_enter(qemu_coroutine_create(backup_worker, w));
     }
 
- out:
+    backup_wait_for_workers(job);
     bdrv_dirty_iter_free(bdbi);
     return ret;
 }
@@ -79,6 +79,9 @@ static CURLMcode __curl_multi_socket_action(CURLM *multi_handle,
 #define CURL_BLOCK_OPT_SSLVERIFY_DEFAULT true
 #define CURL_BLOCK_OPT_TIMEOUT_DEFAULT 5
 
+/* Sequential reads grow the readahead window up to this size */
+#define CURL_READAHEAD_MAX (4 * 1024 * 1024)
+
 struct BDRVCURLState;
 
 static bool libcurl_initialized;
@@ -113,6 +116,7 @@ typedef struct CURLState
     char range[128];
     char errmsg[CURL_ERROR_SIZE];
     char in_use;
+    uint64_t last_use;
 } CURLState;
 
 typedef struct BDRVCURLState {
@@ -122,6 +126,11 @@ typedef struct BDRVCURLState {
     CURLState states[CURL_NUM_STATES];
     char *url;
     size_t readahead_size;
+    /* Adaptive readahead, see curl_update_readahead() */
+    size_t readahead_cur;
+    uint64_t seq_end;
+    uint64_t fetch_end;
+    uint64_t use_count;
     bool sslverify;
     uint64_t timeout;
     char *cookie;
@@ -301,6 +310,7 @@ static bool curl_find_buf(BDRVCURLState *s, uint64_t start, uint64_t len,
         {
             char *buf = state->orig_buf + (start - state->buf_start);
 
+            state->last_use = ++s->use_count;
             qemu_iovec_from_buf(acb->qiov, 0, buf, clamped_len);
             if (clamped_len < len) {
                 qemu_iovec_memset(acb->qiov, clamped_len, 0, len - clamped_len);
@@ -448,19 +458,24 @@ static void curl_multi_timeout_do(void *arg)
 #endif
 }
 
-/* Called with s->mutex held.  */
+/*
+ * Called with s->mutex held.  The buffers of the free states are a cache
+ * of the ranges already fetched, so reuse the least recently used one.
+ */
 static CURLState *curl_find_state(BDRVCURLState *s)
 {
     CURLState *state = NULL;
     int i;
 
     for (i = 0; i < CURL_NUM_STATES; i++) {
-        if (!s->states[i].in_use) {
+        if (!s->states[i].in_use &&
+            (!state || s->states[i].last_use < state->last_use)) {
             state = &s->states[i];
-            state->in_use = 1;
-            break;
         }
     }
+    if (state) {
+        state->in_use = 1;
+    }
     return state;
 }
 
@@ -516,6 +531,17 @@ static int curl_init_state(BDRVCURLState *s, CURLState *state)
         curl_easy_setopt(state->curl, CURLOPT_REDIR_PROTOCOLS, PROTOCOLS);
 #endif
 
+        /* Prefer HTTP/2 over TLS, and wait for an existing connection to
+         * multiplex on instead of opening a new one for each state.
+         */
+#if LIBCURL_VERSION_NUM >= 0x072f00
+        curl_easy_setopt(state->curl, CURLOPT_HTTP_VERSION,
+                         (long)CURL_HTTP_VERSION_2TLS);
+#endif
+#if LIBCURL_VERSION_NUM >= 0x072b00
+        curl_easy_setopt(state->curl, CURLOPT_PIPEWAIT, 1L);
+#endif
+
 #ifdef DEBUG_VERBOSE
         curl_easy_setopt(state->curl, CURLOPT_VERBOSE, 1);
 #endif
@@ -577,6 +603,7 @@ static void curl_detach_aio_context(BlockDriverState *bs)
         curl_multi_cleanup(s->multi);
         s->multi = NULL;
     }
+    s->fetch_end = 0;
     qemu_mutex_unlock(&s->mutex);
 
     timer_del(&s->timer);
@@ -595,6 +622,10 @@ static void curl_attach_aio_context(BlockDriverState *bs,
     s->multi = curl_multi_init();
     s->aio_context = new_context;
     curl_multi_setopt(s->multi, CURLMOPT_SOCKETFUNCTION, curl_sock_cb);
+#if LIBCURL_VERSION_NUM >= 0x072b00
+    /* The range requests of all states share one HTTP/2 connection */
+    curl_multi_setopt(s->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
 #ifdef NEED_CURL_TIMER_CALLBACK
     curl_multi_setopt(s->multi, CURLMOPT_TIMERDATA, s);
     curl_multi_setopt(s->multi, CURLMOPT_TIMERFUNCTION, curl_timer_cb);
@@ -705,6 +736,7 @@ static int curl_open(BlockDriverState *bs, QDict *options, int flags,
                    s->readahead_size);
         goto out_noclean;
     }
+    s->readahead_cur = s->readahead_size;
 
     s->timeout = qemu_opt_get_number(opts, CURL_BLOCK_OPT_TIMEOUT,
                                      CURL_BLOCK_OPT_TIMEOUT_DEFAULT);
@@ -850,18 +882,108 @@ out_noclean:
     return -EINVAL;
 }
 
-static void curl_setup_preadv(BlockDriverState *bs, CURLAIOCB *acb)
+/*
+ * Called with s->mutex held.  Start fetching @len bytes at @start into
+ * @state, which curl_find_state() returned.  @acb is NULL for readahead.
+ */
+static int curl_fetch(BDRVCURLState *s, CURLState *state, uint64_t start,
+                      size_t len, CURLAIOCB *acb)
 {
-    CURLState *state;
     int running;
 
-    BDRVCURLState *s = bs->opaque;
+    if (curl_init_state(s, state) < 0) {
+        curl_clean_state(state);
+        return -EIO;
+    }
+
+    state->buf_off = 0;
+    g_free(state->orig_buf);
+    state->buf_start = start;
+    state->buf_len = len;
+    state->orig_buf = g_try_malloc(state->buf_len);
+    if (state->buf_len && state->orig_buf == NULL) {
+        curl_clean_state(state);
+        return -ENOMEM;
+    }
+    state->acb[0] = acb;
+    state->last_use = ++s->use_count;
+    s->fetch_end = start + len;
+
+    snprintf(state->range, 127, "%" PRIu64 "-%" PRIu64,
+             start, start + len - 1);
+    curl_easy_setopt(state->curl, CURLOPT_RANGE, state->range);
+
+    curl_multi_add_handle(s->multi, state->curl);
+
+    /* Tell curl it needs to kick things off */
+    curl_multi_socket_action(s->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+    return 0;
+}
+
+/*
+ * Called with s->mutex held.  The readahead window starts at the
+ * "readahead" option, and doubles each time a sequential read needs a
+ * new range, up to CURL_READAHEAD_MAX.  Any other read resets it.
+ */
+static bool curl_update_readahead(BDRVCURLState *s, uint64_t start,
+                                  uint64_t bytes)
+{
+    bool sequential = start == s->seq_end;
+
+    if (!sequential) {
+        s->readahead_cur = s->readahead_size;
+    }
+    s->seq_end = MIN(start + bytes, s->len);
+    return sequential;
+}
 
+static void curl_grow_readahead(BDRVCURLState *s)
+{
+    size_t max = MAX(s->readahead_size, CURL_READAHEAD_MAX);
+
+    s->readahead_cur = MIN(s->readahead_cur * 2, max);
+}
+
+/*
+ * Called with s->mutex held.  Once less than a window is left ahead of a
+ * sequential reader, fetch the next window with a free state, in
+ * parallel with the ranges already in flight.  This never waits for a
+ * state.
+ */
+static void curl_readahead(BDRVCURLState *s)
+{
+    CURLState *state;
+    uint64_t start = MAX(s->fetch_end, s->seq_end);
+    size_t len;
+
+    if (!s->readahead_cur || start >= s->len ||
+        start >= s->seq_end + s->readahead_cur) {
+        return;
+    }
+
+    state = curl_find_state(s);
+    if (!state) {
+        return;
+    }
+    curl_grow_readahead(s);
+    len = MIN(s->readahead_cur, s->len - start);
+    if (curl_fetch(s, state, start, len, NULL) == 0) {
+        trace_curl_readahead(len, start, state->range);
+    }
+}
+
+static void curl_setup_preadv(BlockDriverState *bs, CURLAIOCB *acb)
+{
+    CURLState *state;
+    BDRVCURLState *s = bs->opaque;
     uint64_t start = acb->offset;
-    uint64_t end;
+    bool sequential;
+    int ret;
 
     qemu_mutex_lock(&s->mutex);
 
+    sequential = curl_update_readahead(s, start, acb->bytes);
+
     // In case we have the requested data already (e.g. read-ahead),
     // we can just call the callback and be done.
     if (curl_find_buf(s, start, acb->bytes, acb)) {
@@ -877,38 +999,25 @@ static void curl_setup_preadv(BlockDriverState *bs, CURLAIOCB *acb)
         qemu_co_queue_wait(&s->free_state_waitq, &s->mutex);
     }
 
-    if (curl_init_state(s, state) < 0) {
-        curl_clean_state(state);
-        acb->ret = -EIO;
-        goto out;
+    if (sequential) {
+        curl_grow_readahead(s);
     }
 
     acb->start = 0;
     acb->end = MIN(acb->bytes, s->len - start);
 
-    state->buf_off = 0;
-    g_free(state->orig_buf);
-    state->buf_start = start;
-    state->buf_len = MIN(acb->end + s->readahead_size, s->len - start);
-    end = start + state->buf_len - 1;
-    state->orig_buf = g_try_malloc(state->buf_len);
-    if (state->buf_len && state->orig_buf == NULL) {
-        curl_clean_state(state);
-        acb->ret = -ENOMEM;
+    ret = curl_fetch(s, state, start,
+                     MIN(acb->end + s->readahead_cur, s->len - start), acb);
+    if (ret < 0) {
+        acb->ret = ret;
         goto out;
     }
-    state->acb[0] = acb;
-
-    snprintf(state->range, 127, "%" PRIu64 "-%" PRIu64, start, end);
     trace_curl_setup_preadv(acb->bytes, start, state->range);
-    curl_easy_setopt(state->curl, CURLOPT_RANGE, state->range);
-
-    curl_multi_add_handle(s->multi, state->curl);
-
-    /* Tell curl it needs to kick things off */
-    curl_multi_socket_action(s->multi, CURL_SOCKET_TIMEOUT, 0, &running);
 
 out:
+    if (sequential && (acb->ret == 0 || acb->ret == -EINPROGRESS)) {
+        curl_readahead(s);
+    }
     qemu_mutex_unlock(&s->mutex);
 }
 
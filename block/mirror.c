@@ -83,6 +83,8 @@ typedef struct MirrorBlockJob {
     int in_active_write_counter;
     bool prepared;
     bool in_drain;
+    /* Copy without a bounce buffer, cleared once it fails */
+    bool use_copy_range;
 } MirrorBlockJob;
 
 typedef struct MirrorBDSOpaque {
@@ -345,6 +347,30 @@ static void coroutine_fn mirror_co_read(void *opaque)
     assert(QEMU_IS_ALIGNED(op->bytes, BDRV_SECTOR_SIZE));
     nb_chunks = DIV_ROUND_UP(op->bytes, s->granularity);
 
+    if (s->use_copy_range) {
+        int copy_ret;
+
+        /* no buffer to fill, but mirror_iteration_done() frees the qiov */
+        qemu_iovec_init(&op->qiov, 0);
+        s->in_flight++;
+        s->bytes_in_flight += op->bytes;
+        trace_mirror_one_iteration(s, op->offset, op->bytes);
+
+        copy_ret = bdrv_co_copy_range(s->mirror_top_bs->backing, op->offset,
+                                      blk_root(s->target), op->offset,
+                                      op->bytes, 0, 0);
+        if (copy_ret >= 0) {
+            mirror_write_complete(op, 0);
+            return;
+        }
+        /* Not supported, or a real error that the slow path will see too */
+        trace_mirror_copy_range_fail(s, op->offset, copy_ret);
+        s->use_copy_range = false;
+        s->in_flight--;
+        s->bytes_in_flight -= op->bytes;
+        qemu_iovec_destroy(&op->qiov);
+    }
+
     while (s->buf_free_count < nb_chunks) {
         trace_mirror_yield_in_flight(s, op->offset, s->in_flight);
         mirror_wait_for_free_in_flight_slot(s);
@@ -1648,6 +1674,7 @@ static BlockJob *mirror_start_job(
     s->backing_mode = backing_mode;
     s->zero_target = zero_target;
     s->copy_mode = copy_mode;
+    s->use_copy_range = true;
     s->base = base;
     s->granularity = granularity;
     s->buf_size = ROUND_UP(buf_size, granularity);
@@ -44,6 +44,7 @@
 
 #define EN_OPTSTR ":exportname="
 #define MAX_NBD_REQUESTS    16
+#define MAX_NBD_REQUESTS_LIMIT  1024
 
 #define HANDLE_TO_INDEX(bs, handle) ((handle) ^ (uint64_t)(intptr_t)(bs))
 #define INDEX_TO_HANDLE(bs, index)  ((index)  ^ (uint64_t)(intptr_t)(bs))
@@ -70,11 +71,12 @@ typedef struct BDRVNBDState {
     int in_flight;
     NBDClientState state;
 
-    NBDClientRequest requests[MAX_NBD_REQUESTS];
+    NBDClientRequest *requests;
     NBDReply reply;
     BlockDriverState *bs;
 
     /* Connection parameters */
+    uint32_t max_requests;  /* number of entries in @requests */
     uint32_t reconnect_delay;
     SocketAddress *saddr;
     char *export, *tlscredsid;
@@ -93,7 +95,7 @@ static void nbd_recv_coroutines_wake_all(BDRVNBDState *s)
 {
     int i;
 
-    for (i = 0; i < MAX_NBD_REQUESTS; i++) {
+    for (i = 0; i < s->max_requests; i++) {
         NBDClientRequest *req = &s->requests[i];
 
         if (req->coroutine && req->receiving) {
@@ -195,7 +197,7 @@ static coroutine_fn void nbd_connection_entry(void *opaque)
          * one coroutine is called until the reply finishes.
          */
         i = HANDLE_TO_INDEX(s, s->reply.handle);
-        if (i >= MAX_NBD_REQUESTS ||
+        if (i >= s->max_requests ||
             !s->requests[i].coroutine ||
             !s->requests[i].receiving ||
             (nbd_reply_is_structured(&s->reply) && !s->info.structured_reply))
@@ -235,7 +237,7 @@ static int nbd_co_send_request(BlockDriverState *bs,
     int rc, i = -1;
 
     qemu_co_mutex_lock(&s->send_mutex);
-    while (s->in_flight == MAX_NBD_REQUESTS) {
+    while (s->in_flight == s->max_requests) {
         qemu_co_queue_wait(&s->free_sema, &s->send_mutex);
     }
 
@@ -246,14 +248,14 @@ static int nbd_co_send_request(BlockDriverState *bs,
 
     s->in_flight++;
 
-    for (i = 0; i < MAX_NBD_REQUESTS; i++) {
+    for (i = 0; i < s->max_requests; i++) {
         if (s->requests[i].coroutine == NULL) {
             break;
         }
     }
 
     g_assert(qemu_in_coroutine());
-    assert(i < MAX_NBD_REQUESTS);
+    assert(i < s->max_requests);
 
     s->requests[i].coroutine = qemu_coroutine_self();
     s->requests[i].offset = request->from;
@@ -1586,6 +1588,12 @@ static QemuOptsList nbd_runtime_opts = {
                     "future requests before a successful reconnect will "
                     "immediately fail. Default 0",
         },
+        {
+            .name = "max-requests",
+            .type = QEMU_OPT_NUMBER,
+            .help = "Maximum number of requests in flight on the connection "
+                    "(default 16)",
+        },
         { /* end of list */ }
     },
 };
@@ -1596,6 +1604,7 @@ static int nbd_process_options(BlockDriverState *bs, QDict *options,
     BDRVNBDState *s = bs->opaque;
     QemuOpts *opts;
     Error *local_err = NULL;
+    uint64_t max_requests;
     int ret = -EINVAL;
 
     opts = qemu_opts_create(&nbd_runtime_opts, NULL, 0, &error_abort);
@@ -1636,6 +1645,15 @@ static int nbd_process_options(BlockDriverState *bs, QDict *options,
     s->x_dirty_bitmap = g_strdup(qemu_opt_get(opts, "x-dirty-bitmap"));
     s->reconnect_delay = qemu_opt_get_number(opts, "reconnect-delay", 0);
 
+    max_requests = qemu_opt_get_number(opts, "max-requests",
+                                       MAX_NBD_REQUESTS);
+    if (max_requests < 1 || max_requests > MAX_NBD_REQUESTS_LIMIT) {
+        error_setg(errp, "max-requests must be between 1 and %d",
+                   MAX_NBD_REQUESTS_LIMIT);
+        goto error;
+    }
+    s->max_requests = max_requests;
+
     ret = 0;
 
  error:
@@ -1644,6 +1662,7 @@ static int nbd_process_options(BlockDriverState *bs, QDict *options,
         qapi_free_SocketAddress(s->saddr);
         g_free(s->export);
         g_free(s->tlscredsid);
+        g_free(s->x_dirty_bitmap);
     }
     qemu_opts_del(opts);
     return ret;
@@ -1670,6 +1689,7 @@ static int nbd_open(BlockDriverState *bs, QDict *options, int flags,
     }
     /* successfully connected */
     s->state = NBD_CLIENT_CONNECTED;
+    s->requests = g_new0(NBDClientRequest, s->max_requests);
 
     s->connection_co = qemu_coroutine_create(nbd_connection_entry, s);
     bdrv_inc_in_flight(bs);
@@ -1728,6 +1748,7 @@ static void nbd_close(BlockDriverState *bs)
     g_free(s->export);
     g_free(s->tlscredsid);
     g_free(s->x_dirty_bitmap);
+    g_free(s->requests);
 }
 
 static int64_t nbd_getlength(BlockDriverState *bs)
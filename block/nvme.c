@@ -31,6 +31,7 @@
 #define NVME_CQ_ENTRY_BYTES 16
 #define NVME_QUEUE_SIZE 128
 #define NVME_BAR_SIZE 8192
+#define NVME_MAX_IO_QUEUES 64
 
 typedef struct {
     int32_t  head, tail;
@@ -54,8 +55,11 @@ typedef struct {
     QemuMutex   lock;
 
     /* Fields protected by BQL */
+    BlockDriverState *bs;
     int         index;
     uint8_t     *prp_list_pages;
+    /* Rings the doorbell of an I/O queue, see nvme_submit_command() */
+    QEMUBH      *kick_bh;
 
     /* Fields protected by @lock */
     NVMeQueue   sq, cq;
@@ -98,6 +102,8 @@ typedef struct {
      */
     NVMeQueuePair **queues;
     int nr_queues;
+    /* How many io queues were requested with the "queues" option */
+    int nr_io_queues;
     size_t page_size;
     /* How many uint32_t elements does each doorbell entry take. */
     size_t doorbell_scale;
@@ -123,6 +129,7 @@ typedef struct {
 
 #define NVME_BLOCK_OPT_DEVICE "device"
 #define NVME_BLOCK_OPT_NAMESPACE "namespace"
+#define NVME_BLOCK_OPT_QUEUES "queues"
 
 static QemuOptsList runtime_opts = {
     .name = "nvme",
@@ -138,6 +145,11 @@ static QemuOptsList runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "NVMe namespace",
         },
+        {
+            .name = NVME_BLOCK_OPT_QUEUES,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of I/O queue pairs (default: 1)",
+        },
         { /* end of list */ }
     },
 };
@@ -165,6 +177,9 @@ static void nvme_init_queue(BlockDriverState *bs, NVMeQueue *q,
 
 static void nvme_free_queue_pair(BlockDriverState *bs, NVMeQueuePair *q)
 {
+    if (q->kick_bh) {
+        qemu_bh_delete(q->kick_bh);
+    }
     qemu_vfree(q->prp_list_pages);
     qemu_vfree(q->sq.queue);
     qemu_vfree(q->cq.queue);
@@ -194,6 +209,7 @@ static NVMeQueuePair *nvme_create_queue_pair(BlockDriverState *bs,
     uint64_t prp_list_iova;
 
     qemu_mutex_init(&q->lock);
+    q->bs = bs;
     q->index = idx;
     qemu_co_queue_init(&q->free_req_queue);
     q->prp_list_pages = qemu_blockalign0(bs, s->page_size * NVME_QUEUE_SIZE);
@@ -358,6 +374,17 @@ static bool nvme_process_completion(BDRVNVMeState *s, NVMeQueuePair *q)
     return progress;
 }
 
+static void nvme_kick_bh(void *opaque)
+{
+    NVMeQueuePair *q = opaque;
+    BDRVNVMeState *s = q->bs->opaque;
+
+    qemu_mutex_lock(&q->lock);
+    nvme_kick(s, q);
+    nvme_process_completion(s, q);
+    qemu_mutex_unlock(&q->lock);
+}
+
 static void nvme_trace_command(const NvmeCmd *cmd)
 {
     int i;
@@ -386,7 +413,18 @@ static void nvme_submit_command(BDRVNVMeState *s, NVMeQueuePair *q,
            q->sq.tail * NVME_SQ_ENTRY_BYTES, cmd, sizeof(*cmd));
     q->sq.tail = (q->sq.tail + 1) % NVME_QUEUE_SIZE;
     q->need_kick++;
-    nvme_kick(s, q);
+    if (q->kick_bh) {
+        /*
+         * Ring the doorbell once for all the commands submitted to this
+         * queue in the current aio_poll() iteration.  When plugged, the
+         * unplug does it.
+         */
+        if (!s->plugged) {
+            qemu_bh_schedule(q->kick_bh);
+        }
+    } else {
+        nvme_kick(s, q);
+    }
     nvme_process_completion(s, q);
     qemu_mutex_unlock(&q->lock);
 }
@@ -549,12 +587,31 @@ static bool nvme_add_io_queue(BlockDriverState *bs, Error **errp)
         nvme_free_queue_pair(bs, q);
         return false;
     }
+    q->kick_bh = aio_bh_new(s->aio_context, nvme_kick_bh, q);
     s->queues = g_renew(NVMeQueuePair *, s->queues, n + 1);
     s->queues[n] = q;
     s->nr_queues++;
     return true;
 }
 
+/*
+ * Ask the controller for @n io queue pairs.  It may allocate fewer, in
+ * which case creating the extra queues fails.
+ */
+static void nvme_set_nr_io_queues(BlockDriverState *bs, int n)
+{
+    BDRVNVMeState *s = bs->opaque;
+    NvmeCmd cmd = {
+        .opcode = NVME_ADM_CMD_SET_FEATURES,
+        .cdw10 = cpu_to_le32(0x07),
+        .cdw11 = cpu_to_le32(((n - 1) << 16) | (n - 1)),
+    };
+
+    if (nvme_cmd_sync(bs, s->queues[0], &cmd)) {
+        warn_report("nvme: failed to request %d I/O queues", n);
+    }
+}
+
 static bool nvme_poll_cb(void *opaque)
 {
     EventNotifier *e = opaque;
@@ -567,7 +624,7 @@ static bool nvme_poll_cb(void *opaque)
 }
 
 static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
-                     Error **errp)
+                     int nr_io_queues, Error **errp)
 {
     BDRVNVMeState *s = bs->opaque;
     int ret;
@@ -580,6 +637,7 @@ static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
     qemu_co_queue_init(&s->dma_flush_queue);
     s->device = g_strdup(device);
     s->nsid = namespace;
+    s->nr_io_queues = nr_io_queues;
     s->aio_context = bdrv_get_aio_context(bs);
     ret = event_notifier_init(&s->irq_notifier, 0);
     if (ret) {
@@ -674,8 +732,20 @@ static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
     }
 
     /* Set up command queues. */
+    if (s->nr_io_queues > 1) {
+        nvme_set_nr_io_queues(bs, s->nr_io_queues);
+    }
     if (!nvme_add_io_queue(bs, errp)) {
         ret = -EIO;
+        goto out;
+    }
+    while (s->nr_queues <= s->nr_io_queues) {
+        if (!nvme_add_io_queue(bs, &local_err)) {
+            warn_reportf_err(local_err, "nvme: using %d I/O queues: ",
+                             s->nr_queues - 1);
+            local_err = NULL;
+            break;
+        }
     }
 out:
     /* Cleaning up is done in nvme_file_open() upon error. */
@@ -761,6 +831,7 @@ static int nvme_file_open(BlockDriverState *bs, QDict *options, int flags,
     const char *device;
     QemuOpts *opts;
     int namespace;
+    int64_t nr_io_queues;
     int ret;
     BDRVNVMeState *s = bs->opaque;
 
@@ -774,7 +845,14 @@ static int nvme_file_open(BlockDriverState *bs, QDict *options, int flags,
     }
 
     namespace = qemu_opt_get_number(opts, NVME_BLOCK_OPT_NAMESPACE, 1);
-    ret = nvme_init(bs, device, namespace, errp);
+    nr_io_queues = qemu_opt_get_number(opts, NVME_BLOCK_OPT_QUEUES, 1);
+    if (nr_io_queues < 1 || nr_io_queues > NVME_MAX_IO_QUEUES) {
+        error_setg(errp, "'" NVME_BLOCK_OPT_QUEUES "' must be between 1 "
+                   "and %d", NVME_MAX_IO_QUEUES);
+        qemu_opts_del(opts);
+        return -EINVAL;
+    }
+    ret = nvme_init(bs, device, namespace, nr_io_queues, errp);
     qemu_opts_del(opts);
     if (ret) {
         goto fail;
@@ -921,6 +999,30 @@ typedef struct {
     AioContext *ctx;
 } NVMeCoData;
 
+/*
+ * Pick the least busy io queue.  Ties go to the lowest index, so that a
+ * light load stays on one queue and its doorbell writes can be batched.
+ */
+static NVMeQueuePair *nvme_get_io_queue(BDRVNVMeState *s)
+{
+    NVMeQueuePair *best = s->queues[1];
+    int best_load = INT_MAX;
+    int i;
+
+    assert(s->nr_queues > 1);
+    for (i = 1; i < s->nr_queues; i++) {
+        NVMeQueuePair *q = s->queues[i];
+        /* racy, but only a hint */
+        int load = atomic_read(&q->inflight) + atomic_read(&q->need_kick);
+
+        if (load < best_load) {
+            best = q;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
 static void nvme_rw_cb_bh(void *opaque)
 {
     NVMeCoData *data = opaque;
@@ -946,7 +1048,7 @@ static coroutine_fn int nvme_co_prw_aligned(BlockDriverState *bs,
 {
     int r;
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[1];
+    NVMeQueuePair *ioq;
     NVMeRequest *req;
 
     uint32_t cdw12 = (((bytes >> s->blkshift) - 1) & 0xFFFF) |
@@ -964,7 +1066,7 @@ static coroutine_fn int nvme_co_prw_aligned(BlockDriverState *bs,
     };
 
     trace_nvme_prw_aligned(s, is_write, offset, bytes, flags, qiov->niov);
-    assert(s->nr_queues > 1);
+    ioq = nvme_get_io_queue(s);
     req = nvme_get_free_req(ioq);
     assert(req);
 
@@ -1061,7 +1163,7 @@ static coroutine_fn int nvme_co_pwritev(BlockDriverState *bs,
 static coroutine_fn int nvme_co_flush(BlockDriverState *bs)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[1];
+    NVMeQueuePair *ioq;
     NVMeRequest *req;
     NvmeCmd cmd = {
         .opcode = NVME_CMD_FLUSH,
@@ -1072,7 +1174,7 @@ static coroutine_fn int nvme_co_flush(BlockDriverState *bs)
         .ret = -EINPROGRESS,
     };
 
-    assert(s->nr_queues > 1);
+    ioq = nvme_get_io_queue(s);
     req = nvme_get_free_req(ioq);
     assert(req);
     nvme_submit_command(s, ioq, req, &cmd, nvme_rw_cb, &data);
@@ -1112,7 +1214,18 @@ static void nvme_refresh_limits(BlockDriverState *bs, Error **errp)
 static void nvme_detach_aio_context(BlockDriverState *bs)
 {
     BDRVNVMeState *s = bs->opaque;
+    int i;
+
+    for (i = 1; i < s->nr_queues; i++) {
+        NVMeQueuePair *q = s->queues[i];
 
+        /* Ring the doorbell that a pending kick_bh would have rung */
+        qemu_mutex_lock(&q->lock);
+        nvme_kick(s, q);
+        qemu_mutex_unlock(&q->lock);
+        qemu_bh_delete(q->kick_bh);
+        q->kick_bh = NULL;
+    }
     aio_set_event_notifier(bdrv_get_aio_context(bs), &s->irq_notifier,
                            false, NULL, NULL);
 }
@@ -1121,8 +1234,13 @@ static void nvme_attach_aio_context(BlockDriverState *bs,
                                     AioContext *new_context)
 {
     BDRVNVMeState *s = bs->opaque;
+    int i;
 
     s->aio_context = new_context;
+    for (i = 1; i < s->nr_queues; i++) {
+        s->queues[i]->kick_bh = aio_bh_new(new_context, nvme_kick_bh,
+                                           s->queues[i]);
+    }
     aio_set_event_notifier(new_context, &s->irq_notifier,
                            false, nvme_handle_event, nvme_poll_cb);
 }
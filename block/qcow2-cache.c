@@ -411,6 +411,32 @@ int qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     return qcow2_cache_do_get(bs, c, offset, table, false);
 }
 
+/*
+ * Like qcow2_cache_get(), but only returns tables that are already in the
+ * cache.  Nothing is read, written back or evicted, so this never yields.
+ * Returns -EAGAIN if the table at @offset is not cached.
+ */
+int qcow2_cache_get_cached(Qcow2Cache *c, uint64_t offset, void **table)
+{
+    int i, lookup_index;
+
+    assert(offset != 0);
+
+    i = lookup_index = (offset / c->table_size * 4) % c->size;
+    do {
+        if (c->entries[i].offset == offset) {
+            c->entries[i].ref++;
+            *table = qcow2_cache_get_table_addr(c, i);
+            return 0;
+        }
+        if (++i == c->size) {
+            i = 0;
+        }
+    } while (i != lookup_index);
+
+    return -EAGAIN;
+}
+
 void qcow2_cache_put(Qcow2Cache *c, void **table)
 {
     int i = qcow2_cache_get_table_idx(c, *table);
@@ -216,6 +216,18 @@ static int l2_load(BlockDriverState *bs, uint64_t offset,
                            (void **)l2_slice);
 }
 
+static int l2_load_cached(BlockDriverState *bs, uint64_t offset,
+                          uint64_t l2_offset, uint64_t **l2_slice)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int start_of_slice = sizeof(uint64_t) *
+        (offset_to_l2_index(s, offset) - offset_to_l2_slice_index(s, offset));
+
+    return qcow2_cache_get_cached(s->l2_table_cache,
+                                  l2_offset + start_of_slice,
+                                  (void **)l2_slice);
+}
+
 /*
  * Writes one sector of the L1 table to the disk (can't update single entries
  * and we really don't want bdrv_pread to perform a read-modify-write)
@@ -528,8 +540,9 @@ static int coroutine_fn do_perform_cow_write(BlockDriverState *bs,
  * Returns the cluster type (QCOW2_CLUSTER_*) on success, -errno in error
  * cases.
  */
-int qcow2_get_cluster_offset(BlockDriverState *bs, uint64_t offset,
-                             unsigned int *bytes, uint64_t *cluster_offset)
+static int get_cluster_offset(BlockDriverState *bs, uint64_t offset,
+                              unsigned int *bytes, uint64_t *cluster_offset,
+                              bool cached_only)
 {
     BDRVQcow2State *s = bs->opaque;
     unsigned int l2_index;
@@ -571,6 +584,9 @@ int qcow2_get_cluster_offset(BlockDriverState *bs, uint64_t offset,
     }
 
     if (offset_into_cluster(s, l2_offset)) {
+        if (cached_only) {
+            return -EAGAIN;
+        }
         qcow2_signal_corruption(bs, true, -1, -1, "L2 table offset %#" PRIx64
                                 " unaligned (L1 index: %#" PRIx64 ")",
                                 l2_offset, l1_index);
@@ -579,7 +595,11 @@ int qcow2_get_cluster_offset(BlockDriverState *bs, uint64_t offset,
 
     /* load the l2 slice in memory */
 
-    ret = l2_load(bs, offset, l2_offset, &l2_slice);
+    if (cached_only) {
+        ret = l2_load_cached(bs, offset, l2_offset, &l2_slice);
+    } else {
+        ret = l2_load(bs, offset, l2_offset, &l2_slice);
+    }
     if (ret < 0) {
         return ret;
     }
@@ -598,6 +618,10 @@ int qcow2_get_cluster_offset(BlockDriverState *bs, uint64_t offset,
     type = qcow2_get_cluster_type(bs, *cluster_offset);
     if (s->qcow_version < 3 && (type == QCOW2_CLUSTER_ZERO_PLAIN ||
                                 type == QCOW2_CLUSTER_ZERO_ALLOC)) {
+        if (cached_only) {
+            ret = -EAGAIN;
+            goto fail;
+        }
         qcow2_signal_corruption(bs, true, -1, -1, "Zero cluster entry found"
                                 " in pre-v3 image (L2 offset: %#" PRIx64
                                 ", L2 index: %#x)", l2_offset, l2_index);
@@ -607,6 +631,10 @@ int qcow2_get_cluster_offset(BlockDriverState *bs, uint64_t offset,
     switch (type) {
     case QCOW2_CLUSTER_COMPRESSED:
         if (has_data_file(bs)) {
+            if (cached_only) {
+                ret = -EAGAIN;
+                goto fail;
+            }
             qcow2_signal_corruption(bs, true, -1, -1, "Compressed cluster "
                                     "entry found in image with external data "
                                     "file (L2 offset: %#" PRIx64 ", L2 index: "
@@ -632,6 +660,10 @@ int qcow2_get_cluster_offset(BlockDriverState *bs, uint64_t offset,
                                       &l2_slice[l2_index], QCOW_OFLAG_ZERO);
         *cluster_offset &= L2E_OFFSET_MASK;
         if (offset_into_cluster(s, *cluster_offset)) {
+            if (cached_only) {
+                ret = -EAGAIN;
+                goto fail;
+            }
             qcow2_signal_corruption(bs, true, -1, -1,
                                     "Cluster allocation offset %#"
                                     PRIx64 " unaligned (L2 offset: %#" PRIx64
@@ -642,6 +674,10 @@ int qcow2_get_cluster_offset(BlockDriverState *bs, uint64_t offset,
         }
         if (has_data_file(bs) && *cluster_offset != offset - offset_in_cluster)
         {
+            if (cached_only) {
+                ret = -EAGAIN;
+                goto fail;
+            }
             qcow2_signal_corruption(bs, true, -1, -1,
                                     "External data file host cluster offset %#"
                                     PRIx64 " does not match guest cluster "
@@ -678,6 +714,28 @@ fail:
     return ret;
 }
 
+int qcow2_get_cluster_offset(BlockDriverState *bs, uint64_t offset,
+                             unsigned int *bytes, uint64_t *cluster_offset)
+{
+    return get_cluster_offset(bs, offset, bytes, cluster_offset, false);
+}
+
+/*
+ * Like qcow2_get_cluster_offset(), but fails with -EAGAIN instead of
+ * reading the L2 slice from disk (or reporting corruption), so it never
+ * yields.  All of a BDS's requests run in its AioContext, so a lookup that
+ * doesn't yield only sees L2 entries as they are between the yield points
+ * of the request holding s->lock, and can be done without the lock: an
+ * entry is only changed once the cluster it points to is ready.  Callers
+ * retry with the lock on -EAGAIN.
+ */
+int qcow2_get_cluster_offset_cached(BlockDriverState *bs, uint64_t offset,
+                                    unsigned int *bytes,
+                                    uint64_t *cluster_offset)
+{
+    return get_cluster_offset(bs, offset, bytes, cluster_offset, true);
+}
+
 /*
  * get_cluster_table
  *
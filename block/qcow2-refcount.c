@@ -1585,10 +1585,95 @@ enum {
     CHECK_FRAG_INFO = 0x2,      /* update BlockFragInfo counters */
 };
 
+/*
+ * check_refcounts_l1() reads the L2 tables a group at a time.  The reads of
+ * a group are issued together, each from its own coroutine, so that the
+ * check is not bound by the latency of one read after the other.
+ */
+#define CHECK_L2_READAHEAD_MAX      64
+#define CHECK_L2_READAHEAD_BYTES    (16 * 1024 * 1024)
+
+typedef struct CheckL2Readahead CheckL2Readahead;
+
+typedef struct CheckL2Read {
+    CheckL2Readahead *ra;
+    BlockDriverState *bs;
+    uint64_t offset;
+    uint64_t *table;
+    int ret;
+} CheckL2Read;
+
+struct CheckL2Readahead {
+    Coroutine *co;      /* the coroutine of the check */
+    int in_flight;
+    bool waiting;
+    int max;            /* number of tables read at a time */
+    uint64_t *tables;
+    CheckL2Read reads[CHECK_L2_READAHEAD_MAX];
+};
+
+static void coroutine_fn check_refcounts_l2_read_entry(void *opaque)
+{
+    CheckL2Read *r = opaque;
+    CheckL2Readahead *ra = r->ra;
+    BDRVQcow2State *s = r->bs->opaque;
+
+    r->ret = bdrv_co_pread(r->bs->file, r->offset,
+                           s->l2_size * sizeof(uint64_t), r->table, 0);
+
+    ra->in_flight--;
+    if (ra->waiting) {
+        ra->waiting = false;
+        qemu_coroutine_enter_if_inactive(ra->co);
+    }
+}
+
+/*
+ * Read the L2 tables of the L1 entries from @start on, at most ra->max of
+ * them, and return the index of the first L1 entry whose table was not
+ * read.  Outside coroutine context the tables are read one by one.
+ */
+static int check_refcounts_l2_readahead(BlockDriverState *bs,
+                                        CheckL2Readahead *ra,
+                                        const uint64_t *l1_table,
+                                        int start, int l1_size)
+{
+    BDRVQcow2State *s = bs->opaque;
+    CheckL2Read *r;
+    int i, n = 0;
+
+    for (i = start; i < l1_size && n < ra->max; i++) {
+        if (!l1_table[i]) {
+            continue;
+        }
+        r = &ra->reads[n];
+        r->ra = ra;
+        r->bs = bs;
+        r->offset = l1_table[i] & L1E_OFFSET_MASK;
+        r->table = ra->tables + (size_t)n * s->l2_size;
+        n++;
+
+        if (qemu_in_coroutine()) {
+            ra->in_flight++;
+            qemu_coroutine_enter(
+                qemu_coroutine_create(check_refcounts_l2_read_entry, r));
+        } else {
+            r->ret = bdrv_pread(bs->file, r->offset, r->table,
+                                s->l2_size * sizeof(uint64_t));
+        }
+    }
+
+    while (ra->in_flight) {
+        ra->waiting = true;
+        qemu_coroutine_yield();
+    }
+    return i;
+}
+
 /*
  * Increases the refcount in the given refcount table for the all clusters
  * referenced in the L2 table. While doing so, performs some checks on L2
- * entries.
+ * entries.  @l2_table is the table at @l2_offset, as read from disk.
  *
  * Returns the number of errors found by the checks or -errno if an internal
  * error occurred.
@@ -1596,23 +1681,13 @@ enum {
 static int check_refcounts_l2(BlockDriverState *bs, BdrvCheckResult *res,
                               void **refcount_table,
                               int64_t *refcount_table_size, int64_t l2_offset,
-                              int flags, BdrvCheckMode fix, bool active)
+                              uint64_t *l2_table, int flags,
+                              BdrvCheckMode fix, bool active)
 {
     BDRVQcow2State *s = bs->opaque;
-    uint64_t *l2_table, l2_entry;
+    uint64_t l2_entry;
     uint64_t next_contiguous_offset = 0;
-    int i, l2_size, nb_csectors, ret;
-
-    /* Read L2 table from disk */
-    l2_size = s->l2_size * sizeof(uint64_t);
-    l2_table = g_malloc(l2_size);
-
-    ret = bdrv_pread(bs->file, l2_offset, l2_table, l2_size);
-    if (ret < 0) {
-        fprintf(stderr, "ERROR: I/O error in check_refcounts_l2\n");
-        res->check_errors++;
-        goto fail;
-    }
+    int i, nb_csectors, ret;
 
     /* Do the actual checks */
     for(i = 0; i < s->l2_size; i++) {
@@ -1645,7 +1720,7 @@ static int check_refcounts_l2(BlockDriverState *bs, BdrvCheckResult *res,
                 l2_entry & QCOW2_COMPRESSED_SECTOR_MASK,
                 nb_csectors * QCOW2_COMPRESSED_SECTOR_SIZE);
             if (ret < 0) {
-                goto fail;
+                return ret;
             }
 
             if (flags & CHECK_FRAG_INFO) {
@@ -1693,7 +1768,7 @@ static int check_refcounts_l2(BlockDriverState *bs, BdrvCheckResult *res,
                             res->check_errors++;
                             /* Something is seriously wrong, so abort checking
                              * this L2 table */
-                            goto fail;
+                            return ret;
                         }
 
                         ret = bdrv_pwrite_sync(bs->file, l2e_offset,
@@ -1733,7 +1808,7 @@ static int check_refcounts_l2(BlockDriverState *bs, BdrvCheckResult *res,
                                                refcount_table_size,
                                                offset, s->cluster_size);
                 if (ret < 0) {
-                    goto fail;
+                    return ret;
                 }
             }
             break;
@@ -1748,12 +1823,7 @@ static int check_refcounts_l2(BlockDriverState *bs, BdrvCheckResult *res,
         }
     }
 
-    g_free(l2_table);
     return 0;
-
-fail:
-    g_free(l2_table);
-    return ret;
 }
 
 /*
@@ -1773,7 +1843,11 @@ static int check_refcounts_l1(BlockDriverState *bs,
 {
     BDRVQcow2State *s = bs->opaque;
     uint64_t *l1_table = NULL, l2_offset, l1_size2;
-    int i, ret;
+    CheckL2Readahead ra = {
+        .co = qemu_in_coroutine() ? qemu_coroutine_self() : NULL,
+    };
+    CheckL2Read *r;
+    int i, j, end, ret;
 
     l1_size2 = l1_size * sizeof(uint64_t);
 
@@ -1800,12 +1874,28 @@ static int check_refcounts_l1(BlockDriverState *bs,
         }
         for(i = 0;i < l1_size; i++)
             be64_to_cpus(&l1_table[i]);
+
+        ra.max = MIN(CHECK_L2_READAHEAD_MAX,
+                     MAX(1, CHECK_L2_READAHEAD_BYTES / s->cluster_size));
+        ra.max = MIN(ra.max, l1_size);
+        ra.tables = g_try_malloc((size_t)ra.max * s->cluster_size);
+        if (ra.tables == NULL) {
+            ret = -ENOMEM;
+            res->check_errors++;
+            goto fail;
+        }
     }
 
     /* Do the actual checks */
-    for(i = 0; i < l1_size; i++) {
-        l2_offset = l1_table[i];
-        if (l2_offset) {
+    for (i = 0; i < l1_size; ) {
+        end = check_refcounts_l2_readahead(bs, &ra, l1_table, i, l1_size);
+        for (j = 0; i < end; i++) {
+            l2_offset = l1_table[i];
+            if (!l2_offset) {
+                continue;
+            }
+            r = &ra.reads[j++];
+
             /* Mark L2 table as used */
             l2_offset &= L1E_OFFSET_MASK;
             ret = qcow2_inc_refcounts_imrt(bs, res,
@@ -1822,19 +1912,28 @@ static int check_refcounts_l1(BlockDriverState *bs,
                 res->corruptions++;
             }
 
+            if (r->ret < 0) {
+                fprintf(stderr, "ERROR: I/O error in check_refcounts_l2\n");
+                res->check_errors++;
+                ret = r->ret;
+                goto fail;
+            }
+
             /* Process and check L2 entries */
             ret = check_refcounts_l2(bs, res, refcount_table,
-                                     refcount_table_size, l2_offset, flags,
-                                     fix, active);
+                                     refcount_table_size, l2_offset, r->table,
+                                     flags, fix, active);
             if (ret < 0) {
                 goto fail;
             }
         }
     }
+    g_free(ra.tables);
     g_free(l1_table);
     return 0;
 
 fail:
+    g_free(ra.tables);
     g_free(l1_table);
     return ret;
 }
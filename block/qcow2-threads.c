@@ -32,6 +32,17 @@
 #include "block/thread-pool.h"
 #include "crypto.h"
 
+int qcow2_max_threads(void)
+{
+    static int max_threads;
+
+    if (!max_threads) {
+        max_threads = MIN(MAX(g_get_num_processors(), QCOW2_MIN_THREADS),
+                          QCOW2_MAX_THREADS);
+    }
+    return max_threads;
+}
+
 static int coroutine_fn
 qcow2_co_process(BlockDriverState *bs, ThreadPoolFunc *func, void *arg)
 {
@@ -40,7 +51,7 @@ qcow2_co_process(BlockDriverState *bs, ThreadPoolFunc *func, void *arg)
     ThreadPool *pool = aio_get_thread_pool(bdrv_get_aio_context(bs));
 
     qemu_co_mutex_lock(&s->lock);
-    while (s->nb_threads >= QCOW2_MAX_THREADS) {
+    while (s->nb_threads >= qcow2_max_threads()) {
         qemu_co_queue_wait(&s->thread_task_queue, &s->lock);
     }
     s->nb_threads++;
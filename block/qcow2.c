@@ -299,7 +299,8 @@ static int qcow2_read_extensions(BlockDriverState *bs, uint64_t start_offset,
             }
             s->crypto = qcrypto_block_open(s->crypto_opts, "encrypt.",
                                            qcow2_crypto_hdr_read_func,
-                                           bs, cflags, QCOW2_MAX_THREADS, errp);
+                                           bs, cflags, qcow2_max_threads(),
+                                           errp);
             if (!s->crypto) {
                 return -EINVAL;
             }
@@ -1541,7 +1542,7 @@ static int coroutine_fn qcow2_do_open(BlockDriverState *bs, QDict *options,
             }
             s->crypto = qcrypto_block_open(s->crypto_opts, "encrypt.",
                                            NULL, NULL, cflags,
-                                           QCOW2_MAX_THREADS, errp);
+                                           qcow2_max_threads(), errp);
             if (!s->crypto) {
                 ret = -EINVAL;
                 goto fail;
@@ -1968,6 +1969,96 @@ out:
     return ret;
 }
 
+/*
+ * qcow2_get_cluster_offset() stops at the end of an L2 slice.  Extend the
+ * run of @cur_bytes at guest @offset, whose first cluster starts at host
+ * @cluster_offset, with the following clusters for as long as they are
+ * allocated contiguously in the data file and their L2 slices are cached,
+ * so that sequential reads are not split at every slice boundary.
+ *
+ * Returns the new length of the run, at most @bytes.
+ */
+static unsigned int qcow2_extend_host_run(BlockDriverState *bs,
+                                          uint64_t offset, uint64_t bytes,
+                                          unsigned int cur_bytes,
+                                          uint64_t cluster_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t host_end = cluster_offset + offset_into_cluster(s, offset);
+
+    bytes = MIN(bytes, INT_MAX);
+    while (cur_bytes < bytes) {
+        uint64_t next = offset + cur_bytes;
+        unsigned int next_bytes = bytes - cur_bytes;
+        uint64_t next_cluster_offset;
+        int ret;
+
+        ret = qcow2_get_cluster_offset_cached(bs, next, &next_bytes,
+                                              &next_cluster_offset);
+        if (ret != QCOW2_CLUSTER_NORMAL ||
+            next_cluster_offset + offset_into_cluster(s, next) !=
+            host_end + cur_bytes) {
+            break;
+        }
+        cur_bytes += next_bytes;
+    }
+
+    return cur_bytes;
+}
+
+/*
+ * Compressed clusters of one read request are decompressed in parallel,
+ * each by its own coroutine, so that a sequential read of a compressed
+ * image keeps several thread pool workers busy.
+ */
+typedef struct Qcow2CompressedRead {
+    Coroutine *co;      /* the coroutine of the request */
+    int in_flight;
+    bool waiting;
+    int ret;
+} Qcow2CompressedRead;
+
+typedef struct Qcow2CompressedReadTask {
+    BlockDriverState *bs;
+    Qcow2CompressedRead *req;
+    uint64_t file_cluster_offset;
+    uint64_t offset;
+    uint64_t bytes;
+    QEMUIOVector *qiov;
+    size_t qiov_offset;
+} Qcow2CompressedReadTask;
+
+static void coroutine_fn qcow2_co_preadv_compressed_entry(void *opaque)
+{
+    Qcow2CompressedReadTask *task = opaque;
+    Qcow2CompressedRead *req = task->req;
+    int ret;
+
+    /* @task lives on the stack of the request and is not valid after this */
+    ret = qcow2_co_preadv_compressed(task->bs, task->file_cluster_offset,
+                                     task->offset, task->bytes,
+                                     task->qiov, task->qiov_offset);
+    if (ret < 0 && req->ret == 0) {
+        req->ret = ret;
+    }
+
+    req->in_flight--;
+    if (req->waiting) {
+        req->waiting = false;
+        qemu_coroutine_enter_if_inactive(req->co);
+    }
+}
+
+/* Wait until at most @max_in_flight compressed clusters are being read */
+static void coroutine_fn
+qcow2_compressed_read_wait(Qcow2CompressedRead *req, int max_in_flight)
+{
+    while (req->in_flight > max_in_flight) {
+        req->waiting = true;
+        qemu_coroutine_yield();
+    }
+}
+
 static coroutine_fn int qcow2_co_preadv_part(BlockDriverState *bs,
                                              uint64_t offset, uint64_t bytes,
                                              QEMUIOVector *qiov,
@@ -1979,6 +2070,9 @@ static coroutine_fn int qcow2_co_preadv_part(BlockDriverState *bs,
     unsigned int cur_bytes; /* number of bytes in current iteration */
     uint64_t cluster_offset = 0;
     uint8_t *cluster_data = NULL;
+    Qcow2CompressedRead creq = {
+        .co = qemu_coroutine_self(),
+    };
 
     while (bytes != 0) {
 
@@ -1989,9 +2083,18 @@ static coroutine_fn int qcow2_co_preadv_part(BlockDriverState *bs,
                             QCOW_MAX_CRYPT_CLUSTERS * s->cluster_size);
         }
 
-        qemu_co_mutex_lock(&s->lock);
-        ret = qcow2_get_cluster_offset(bs, offset, &cur_bytes, &cluster_offset);
-        qemu_co_mutex_unlock(&s->lock);
+        /*
+         * Lookups that hit the L2 cache don't need to wait for s->lock,
+         * which may be held by a request reading metadata from disk.
+         */
+        ret = qcow2_get_cluster_offset_cached(bs, offset, &cur_bytes,
+                                              &cluster_offset);
+        if (ret == -EAGAIN) {
+            qemu_co_mutex_lock(&s->lock);
+            ret = qcow2_get_cluster_offset(bs, offset, &cur_bytes,
+                                           &cluster_offset);
+            qemu_co_mutex_unlock(&s->lock);
+        }
         if (ret < 0) {
             goto fail;
         }
@@ -2019,15 +2122,30 @@ static coroutine_fn int qcow2_co_preadv_part(BlockDriverState *bs,
             qemu_iovec_memset(qiov, qiov_offset, 0, cur_bytes);
             break;
 
-        case QCOW2_CLUSTER_COMPRESSED:
-            ret = qcow2_co_preadv_compressed(bs, cluster_offset,
-                                             offset, cur_bytes,
-                                             qiov, qiov_offset);
-            if (ret < 0) {
+        case QCOW2_CLUSTER_COMPRESSED: {
+            Qcow2CompressedReadTask task = {
+                .bs                  = bs,
+                .req                 = &creq,
+                .file_cluster_offset = cluster_offset,
+                .offset              = offset,
+                .bytes               = cur_bytes,
+                .qiov                = qiov,
+                .qiov_offset         = qiov_offset,
+            };
+            Coroutine *co;
+
+            qcow2_compressed_read_wait(&creq, qcow2_max_threads() - 1);
+            if (creq.ret < 0) {
+                ret = creq.ret;
                 goto fail;
             }
 
+            creq.in_flight++;
+            co = qemu_coroutine_create(qcow2_co_preadv_compressed_entry,
+                                       &task);
+            qemu_coroutine_enter(co);
             break;
+        }
 
         case QCOW2_CLUSTER_NORMAL:
             if ((cluster_offset & 511) != 0) {
@@ -2072,6 +2190,8 @@ static coroutine_fn int qcow2_co_preadv_part(BlockDriverState *bs,
                 }
                 qemu_iovec_from_buf(qiov, qiov_offset, cluster_data, cur_bytes);
             } else {
+                cur_bytes = qcow2_extend_host_run(bs, offset, bytes, cur_bytes,
+                                                  cluster_offset);
                 BLKDBG_EVENT(bs->file, BLKDBG_READ_AIO);
                 ret = bdrv_co_preadv_part(s->data_file,
                                           cluster_offset + offset_in_cluster,
@@ -2095,6 +2215,10 @@ static coroutine_fn int qcow2_co_preadv_part(BlockDriverState *bs,
     ret = 0;
 
 fail:
+    qcow2_compressed_read_wait(&creq, 0);
+    if (ret == 0) {
+        ret = creq.ret;
+    }
     qemu_vfree(cluster_data);
 
     return ret;
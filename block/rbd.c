@@ -22,6 +22,7 @@
 #include "block/qdict.h"
 #include "crypto/secret.h"
 #include "qemu/cutils.h"
+#include "qemu/queue.h"
 #include "qapi/qmp/qstring.h"
 #include "qapi/qmp/qdict.h"
 #include "qapi/qmp/qjson.h"
@@ -95,8 +96,32 @@ typedef struct RADOSCB {
     int64_t size;
     char *buf;
     int64_t ret;
+    QSLIST_ENTRY(RADOSCB) next;
 } RADOSCB;
 
+/*
+ * The completions of all the images attached to an AioContext.  librbd
+ * queues them from its own threads, and only the one that finds the queue
+ * empty kicks the notifier, so that the AioContext completes a whole
+ * batch, of possibly several images, for one wakeup.
+ */
+typedef struct RBDCompletionQueue {
+    AioContext *ctx;
+    EventNotifier notifier;
+    QSLIST_HEAD(, RADOSCB) completed;
+    int refcnt;
+    QLIST_ENTRY(RBDCompletionQueue) next;
+} RBDCompletionQueue;
+
+/*
+ * Protected by the BQL.  The queues are never freed: a librbd thread may
+ * still kick the notifier of a queue after the AioContext completed its
+ * requests and its images were detached, so an unused queue only leaves
+ * its AioContext (ctx == NULL) and waits for the next one.
+ */
+static QLIST_HEAD(, RBDCompletionQueue) rbd_completion_queues =
+    QLIST_HEAD_INITIALIZER(rbd_completion_queues);
+
 typedef struct BDRVRBDState {
     rados_t cluster;
     rados_ioctx_t io_ctx;
@@ -104,6 +129,7 @@ typedef struct BDRVRBDState {
     char *image_name;
     char *snap;
     uint64_t image_size;
+    RBDCompletionQueue *cq;
 } BDRVRBDState;
 
 static int qemu_rbd_connect(rados_t *cluster, rados_ioctx_t *io_ctx,
@@ -486,8 +512,8 @@ exit:
 }
 
 /*
- * This aio completion is being called from rbd_finish_bh() and runs in qemu
- * BH context.
+ * This aio completion is being called from rbd_completion_queue_process()
+ * and runs in the AioContext of the image.
  */
 static void qemu_rbd_complete_aio(RADOSCB *rcb)
 {
@@ -520,7 +546,7 @@ static void qemu_rbd_complete_aio(RADOSCB *rcb)
 
     g_free(rcb);
 
-    if (!LIBRBD_USE_IOVEC) {
+    if (!LIBRBD_USE_IOVEC && acb->bounce) {
         if (acb->cmd == RBD_AIO_READ) {
             qemu_iovec_from_buf(acb->qiov, 0, acb->bounce, acb->qiov->size);
         }
@@ -707,6 +733,93 @@ static int qemu_rbd_attempt_legacy_options(QDict *options,
     return r;
 }
 
+static bool rbd_completion_queue_process(RBDCompletionQueue *cq)
+{
+    QSLIST_HEAD(, RADOSCB) batch, fifo = QSLIST_HEAD_INITIALIZER(fifo);
+    RADOSCB *rcb;
+
+    QSLIST_MOVE_ATOMIC(&batch, &cq->completed);
+    if (QSLIST_EMPTY(&batch)) {
+        return false;
+    }
+
+    /* The queue is LIFO, complete in the order librbd did */
+    while ((rcb = QSLIST_FIRST(&batch))) {
+        QSLIST_REMOVE_HEAD(&batch, next);
+        QSLIST_INSERT_HEAD(&fifo, rcb, next);
+    }
+    while ((rcb = QSLIST_FIRST(&fifo))) {
+        QSLIST_REMOVE_HEAD(&fifo, next);
+        qemu_rbd_complete_aio(rcb);
+    }
+    return true;
+}
+
+static void rbd_completion_queue_cb(EventNotifier *e)
+{
+    RBDCompletionQueue *cq = container_of(e, RBDCompletionQueue, notifier);
+
+    if (event_notifier_test_and_clear(e)) {
+        rbd_completion_queue_process(cq);
+    }
+}
+
+static bool rbd_completion_queue_poll_cb(void *opaque)
+{
+    EventNotifier *e = opaque;
+    RBDCompletionQueue *cq = container_of(e, RBDCompletionQueue, notifier);
+
+    return rbd_completion_queue_process(cq);
+}
+
+/* Returns the completion queue of @ctx, which images of @ctx share */
+static RBDCompletionQueue *rbd_completion_queue_get(AioContext *ctx,
+                                                    Error **errp)
+{
+    RBDCompletionQueue *cq, *idle = NULL;
+    int r;
+
+    QLIST_FOREACH(cq, &rbd_completion_queues, next) {
+        if (cq->ctx == ctx) {
+            cq->refcnt++;
+            return cq;
+        }
+        if (!cq->ctx) {
+            idle = cq;
+        }
+    }
+
+    cq = idle;
+    if (!cq) {
+        cq = g_new0(RBDCompletionQueue, 1);
+        r = event_notifier_init(&cq->notifier, false);
+        if (r < 0) {
+            error_setg_errno(errp, -r, "failed to initialize event notifier");
+            g_free(cq);
+            return NULL;
+        }
+        QSLIST_INIT(&cq->completed);
+        QLIST_INSERT_HEAD(&rbd_completion_queues, cq, next);
+    }
+    cq->ctx = ctx;
+    cq->refcnt = 1;
+    aio_set_event_notifier(ctx, &cq->notifier, false,
+                           rbd_completion_queue_cb,
+                           rbd_completion_queue_poll_cb);
+    return cq;
+}
+
+/* Called with the images drained, so nothing is left in the queue */
+static void rbd_completion_queue_put(RBDCompletionQueue *cq)
+{
+    if (--cq->refcnt) {
+        return;
+    }
+    assert(QSLIST_EMPTY(&cq->completed));
+    aio_set_event_notifier(cq->ctx, &cq->notifier, false, NULL, NULL);
+    cq->ctx = NULL;
+}
+
 static int qemu_rbd_open(BlockDriverState *bs, QDict *options, int flags,
                          Error **errp)
 {
@@ -797,6 +910,13 @@ static int qemu_rbd_open(BlockDriverState *bs, QDict *options, int flags,
         }
     }
 
+    s->cq = rbd_completion_queue_get(bdrv_get_aio_context(bs), errp);
+    if (!s->cq) {
+        r = -EIO;
+        rbd_close(s->image);
+        goto failed_open;
+    }
+
     r = 0;
     goto out;
 
@@ -837,6 +957,9 @@ static void qemu_rbd_close(BlockDriverState *bs)
     BDRVRBDState *s = bs->opaque;
 
     rbd_close(s->image);
+    if (s->cq) {
+        rbd_completion_queue_put(s->cq);
+    }
     rados_ioctx_destroy(s->io_ctx);
     g_free(s->snap);
     g_free(s->image_name);
@@ -863,10 +986,20 @@ static const AIOCBInfo rbd_aiocb_info = {
     .aiocb_size = sizeof(RBDAIOCB),
 };
 
-static void rbd_finish_bh(void *opaque)
+static void qemu_rbd_detach_aio_context(BlockDriverState *bs)
 {
-    RADOSCB *rcb = opaque;
-    qemu_rbd_complete_aio(rcb);
+    BDRVRBDState *s = bs->opaque;
+
+    rbd_completion_queue_put(s->cq);
+    s->cq = NULL;
+}
+
+static void qemu_rbd_attach_aio_context(BlockDriverState *bs,
+                                        AioContext *new_context)
+{
+    BDRVRBDState *s = bs->opaque;
+
+    s->cq = rbd_completion_queue_get(new_context, &error_abort);
 }
 
 /*
@@ -874,18 +1007,29 @@ static void rbd_finish_bh(void *opaque)
  *
  * Note: this function is being called from a non qemu thread so
  * we need to be careful about what we do here. Generally we only
- * schedule a BH, and do the rest of the io completion handling
- * from rbd_finish_bh() which runs in a qemu context.
+ * queue the request, and do the rest of the io completion handling
+ * from rbd_completion_queue_process() which runs in a qemu context.
  */
 static void rbd_finish_aiocb(rbd_completion_t c, RADOSCB *rcb)
 {
-    RBDAIOCB *acb = rcb->acb;
+    RBDCompletionQueue *cq = rcb->s->cq;
+    RADOSCB *head;
 
     rcb->ret = rbd_aio_get_return_value(c);
     rbd_aio_release(c);
 
-    aio_bh_schedule_oneshot(bdrv_get_aio_context(acb->common.bs),
-                            rbd_finish_bh, rcb);
+    /*
+     * Like QSLIST_INSERT_HEAD_ATOMIC, but remember whether the queue was
+     * empty: rcb may be completed and freed as soon as it is queued.
+     */
+    do {
+        head = atomic_read(&cq->completed.slh_first);
+        rcb->next.sle_next = head;
+    } while (atomic_cmpxchg(&cq->completed.slh_first, head, rcb) != head);
+
+    if (!head) {
+        event_notifier_set(&cq->notifier);
+    }
 }
 
 static int rbd_aio_discard_wrapper(rbd_image_t image,
@@ -933,18 +1077,22 @@ static BlockAIOCB *rbd_start_aio(BlockDriverState *bs,
     rcb = g_new(RADOSCB, 1);
 
     if (!LIBRBD_USE_IOVEC) {
+        acb->bounce = NULL;
         if (cmd == RBD_AIO_DISCARD || cmd == RBD_AIO_FLUSH) {
-            acb->bounce = NULL;
+            rcb->buf = NULL;
+        } else if (qiov->niov == 1) {
+            /* A linear request needs no bounce buffer */
+            rcb->buf = qiov->iov[0].iov_base;
         } else {
             acb->bounce = qemu_try_blockalign(bs, qiov->size);
             if (acb->bounce == NULL) {
                 goto failed;
             }
+            if (cmd == RBD_AIO_WRITE) {
+                qemu_iovec_to_buf(acb->qiov, 0, acb->bounce, qiov->size);
+            }
+            rcb->buf = acb->bounce;
         }
-        if (cmd == RBD_AIO_WRITE) {
-            qemu_iovec_to_buf(acb->qiov, 0, acb->bounce, qiov->size);
-        }
-        rcb->buf = acb->bounce;
     }
 
     acb->ret = 0;
@@ -1285,6 +1433,8 @@ static BlockDriver bdrv_rbd = {
     .bdrv_file_open         = qemu_rbd_open,
     .bdrv_close             = qemu_rbd_close,
     .bdrv_reopen_prepare    = qemu_rbd_reopen_prepare,
+    .bdrv_detach_aio_context = qemu_rbd_detach_aio_context,
+    .bdrv_attach_aio_context = qemu_rbd_attach_aio_context,
     .bdrv_co_create         = qemu_rbd_co_create,
     .bdrv_co_create_opts    = qemu_rbd_co_create_opts,
     .bdrv_has_zero_init     = bdrv_has_zero_init_1,
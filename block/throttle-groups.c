@@ -70,11 +70,17 @@ typedef struct ThrottleGroup {
     bool is_initialized;
     char *name; /* This is constant during the lifetime of the group */
 
-    QemuMutex lock; /* This lock protects the following four fields */
+    QemuMutex lock; /* This lock protects the following five fields */
     ThrottleState ts;
     QLIST_HEAD(, ThrottleGroupMember) head;
     ThrottleGroupMember *tokens[2];
     bool any_timer_armed[2];
+    /*
+     * Members with pending requests, in round-robin order: a member moves
+     * to the back when it gets the token.  This keeps picking the next
+     * member O(1) however many members the group has.
+     */
+    QTAILQ_HEAD(, ThrottleGroupMember) pending[2];
     QEMUClockType clock_type;
 
     /* This field is protected by the global QEMU mutex */
@@ -206,6 +212,27 @@ static inline bool tgm_has_pending_reqs(ThrottleGroupMember *tgm,
     return tgm->pending_reqs[is_write];
 }
 
+/* Make a ThrottleGroupMember the current token, and move it behind the other
+ * members with pending requests.
+ *
+ * This assumes that tg->lock is held.
+ *
+ * @tgm:       the new token
+ * @is_write:  the type of operation (read/write)
+ */
+static void throttle_group_set_token(ThrottleGroupMember *tgm, bool is_write)
+{
+    ThrottleState *ts = tgm->throttle_state;
+    ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
+
+    tg->tokens[is_write] = tgm;
+    if (tgm_has_pending_reqs(tgm, is_write)) {
+        QTAILQ_REMOVE(&tg->pending[is_write], tgm, pending_entry[is_write]);
+        QTAILQ_INSERT_TAIL(&tg->pending[is_write], tgm,
+                           pending_entry[is_write]);
+    }
+}
+
 /* Return the next ThrottleGroupMember in the round-robin sequence with pending
  * I/O requests.
  *
@@ -221,7 +248,7 @@ static ThrottleGroupMember *next_throttle_token(ThrottleGroupMember *tgm,
 {
     ThrottleState *ts = tgm->throttle_state;
     ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
-    ThrottleGroupMember *token, *start;
+    ThrottleGroupMember *token;
 
     /* If this member has its I/O limits disabled then it means that
      * it's being drained. Skip the round-robin search and return tgm
@@ -232,19 +259,15 @@ static ThrottleGroupMember *next_throttle_token(ThrottleGroupMember *tgm,
         return tgm;
     }
 
-    start = token = tg->tokens[is_write];
-
-    /* get next bs round in round robin style */
-    token = throttle_group_next_tgm(token);
-    while (token != start && !tgm_has_pending_reqs(token, is_write)) {
-        token = throttle_group_next_tgm(token);
-    }
+    /* The current token is at the back of the queue, so this is the next
+     * member with pending requests in round robin style */
+    token = QTAILQ_FIRST(&tg->pending[is_write]);
 
     /* If no IO are queued for scheduling on the next round robin token
      * then decide the token is the current tgm because chances are
      * the current tgm got the current request queued.
      */
-    if (token == start && !tgm_has_pending_reqs(token, is_write)) {
+    if (!token) {
         token = tgm;
     }
 
@@ -285,7 +308,7 @@ static bool throttle_group_schedule_timer(ThrottleGroupMember *tgm,
 
     /* If a timer just got armed, set tgm as the current token */
     if (must_wait) {
-        tg->tokens[is_write] = tgm;
+        throttle_group_set_token(tgm, is_write);
         tg->any_timer_armed[is_write] = true;
     }
 
@@ -345,7 +368,7 @@ static void schedule_next_request(ThrottleGroupMember *tgm, bool is_write)
             timer_mod(tt->timers[is_write], now);
             tg->any_timer_armed[is_write] = true;
         }
-        tg->tokens[is_write] = token;
+        throttle_group_set_token(token, is_write);
     }
 }
 
@@ -372,14 +395,20 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
 
     /* Wait if there's a timer set or queued requests of this type */
     if (must_wait || tgm->pending_reqs[is_write]) {
-        tgm->pending_reqs[is_write]++;
+        if (tgm->pending_reqs[is_write]++ == 0) {
+            QTAILQ_INSERT_TAIL(&tg->pending[is_write], tgm,
+                               pending_entry[is_write]);
+        }
         qemu_mutex_unlock(&tg->lock);
         qemu_co_mutex_lock(&tgm->throttled_reqs_lock);
         qemu_co_queue_wait(&tgm->throttled_reqs[is_write],
                            &tgm->throttled_reqs_lock);
         qemu_co_mutex_unlock(&tgm->throttled_reqs_lock);
         qemu_mutex_lock(&tg->lock);
-        tgm->pending_reqs[is_write]--;
+        if (--tgm->pending_reqs[is_write] == 0) {
+            QTAILQ_REMOVE(&tg->pending[is_write], tgm,
+                          pending_entry[is_write]);
+        }
     }
 
     /* The I/O will be executed, so do the accounting */
@@ -760,6 +789,8 @@ static void throttle_group_obj_init(Object *obj)
     qemu_mutex_init(&tg->lock);
     throttle_init(&tg->ts);
     QLIST_INIT(&tg->head);
+    QTAILQ_INIT(&tg->pending[0]);
+    QTAILQ_INIT(&tg->pending[1]);
 }
 
 /* This function edits throttle_groups and must be called under the global
@@ -187,8 +187,10 @@ void qmp_nbd_server_add(const char *device, bool has_name, const char *name,
         writable = false;
     }
 
+    /* A read-only export is consistent across any number of connections */
     exp = nbd_export_new(bs, 0, len, name, NULL, bitmap,
-                         writable ? 0 : NBD_FLAG_READ_ONLY,
+                         writable ? 0 : NBD_FLAG_READ_ONLY |
+                                        NBD_FLAG_CAN_MULTI_CONN,
                          NULL, false, on_eject_blk, errp);
     if (!exp) {
         return;
@@ -67,6 +67,9 @@ int qemu_chr_fe_read_all(CharBackend *be, uint8_t *buf, int len)
         return replay_char_read_all_load(buf);
     }
 
+    /* the reply may be to a request still sitting in the output buffer */
+    qemu_chr_flush(s);
+
     while (offset < len) {
     retry:
         res = CHARDEV_GET_CLASS(s)->chr_sync_read(s, buf + offset,
@@ -143,6 +146,8 @@ int qemu_chr_fe_set_msgfds(CharBackend *be, int *fds, int num)
         return -1;
     }
 
+    /* the fds go with the next write, not with output written before */
+    qemu_chr_flush(s);
     return CHARDEV_GET_CLASS(s)->set_msgfds ?
         CHARDEV_GET_CLASS(s)->set_msgfds(s, fds, num) : -1;
 }
@@ -381,6 +386,7 @@ void qemu_chr_fe_disconnect(CharBackend *be)
     Chardev *chr = be->chr;
 
     if (chr && CHARDEV_GET_CLASS(chr)->chr_disconnect) {
+        qemu_chr_flush(chr);
         CHARDEV_GET_CLASS(chr)->chr_disconnect(chr);
     }
 }
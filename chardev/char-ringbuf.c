@@ -23,9 +23,14 @@
  */
 
 #include "qemu/osdep.h"
+#ifdef CONFIG_POSIX
+#include <sys/mman.h>
+#endif
 #include "chardev/char.h"
+#include "chardev/ringbuf-file.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-char.h"
+#include "qemu/atomic.h"
 #include "qemu/base64.h"
 #include "qemu/module.h"
 #include "qemu/option.h"
@@ -38,6 +43,9 @@ typedef struct {
     size_t prod;
     size_t cons;
     uint8_t *cbuf;
+    /* with a path, cbuf is in the mapping of the file after this header */
+    RingbufFileHeader *hdr;
+    size_t map_size;
 } RingBufChardev;
 
 #define RINGBUF_CHARDEV(obj)                                    \
@@ -53,19 +61,36 @@ static size_t ringbuf_count(const Chardev *chr)
 static int ringbuf_chr_write(Chardev *chr, const uint8_t *buf, int len)
 {
     RingBufChardev *d = RINGBUF_CHARDEV(chr);
-    int i;
+    size_t n = len, off, first;
 
     if (!buf || (len < 0)) {
         return -1;
     }
 
-    for (i = 0; i < len; i++) {
-        d->cbuf[d->prod++ & (d->size - 1)] = buf[i];
-        if (d->prod - d->cons > d->size) {
-            d->cons = d->prod - d->size;
-        }
+    /* only the last size bytes survive */
+    if (n > d->size) {
+        buf += n - d->size;
+        d->prod += n - d->size;
+        n = d->size;
+    }
+    if (d->hdr) {
+        atomic_set(&d->hdr->writing, d->prod + n);
+        smp_wmb();
     }
 
+    off = d->prod & (d->size - 1);
+    first = MIN(n, d->size - off);
+    memcpy(d->cbuf + off, buf, first);
+    memcpy(d->cbuf, buf + first, n - first);
+    d->prod += n;
+    if (d->prod - d->cons > d->size) {
+        d->cons = d->prod - d->size;
+    }
+
+    if (d->hdr) {
+        smp_wmb();
+        atomic_set(&d->hdr->written, d->prod);
+    }
     return len;
 }
 
@@ -87,9 +112,70 @@ static void char_ringbuf_finalize(Object *obj)
 {
     RingBufChardev *d = RINGBUF_CHARDEV(obj);
 
+#ifdef CONFIG_POSIX
+    if (d->hdr) {
+        munmap(d->hdr, d->map_size);
+        return;
+    }
+#endif
     g_free(d->cbuf);
 }
 
+#ifdef CONFIG_POSIX
+/*
+ * Preallocate and map the file, so that writes are plain stores into
+ * memory that is already there.
+ */
+static void ringbuf_open_file(RingBufChardev *d, const char *path,
+                              Error **errp)
+{
+    size_t data_offset = ROUND_UP(sizeof(RingbufFileHeader),
+                                  qemu_real_host_page_size);
+    void *p;
+    int fd;
+
+    if (d->size > RINGBUF_FILE_MAX_SIZE) {
+        error_setg(errp, "size of ringbuf chardev with a path must be at "
+                   "most %u", RINGBUF_FILE_MAX_SIZE);
+        return;
+    }
+
+    fd = qemu_open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        error_setg_file_open(errp, errno, path);
+        return;
+    }
+    d->map_size = data_offset + d->size;
+#ifdef CONFIG_POSIX_FALLOCATE
+    errno = posix_fallocate(fd, 0, d->map_size);
+    if (errno && errno != EINVAL && errno != EOPNOTSUPP) {
+        error_setg_errno(errp, errno, "Unable to allocate %s", path);
+        goto out;
+    }
+#endif
+    if (ftruncate(fd, d->map_size) < 0) {
+        error_setg_errno(errp, errno, "Unable to size %s", path);
+        goto out;
+    }
+    p = mmap(NULL, d->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        error_setg_errno(errp, errno, "Unable to map %s", path);
+        goto out;
+    }
+
+    d->hdr = p;
+    d->cbuf = p + data_offset;
+    d->hdr->version = RINGBUF_FILE_VERSION;
+    d->hdr->data_offset = data_offset;
+    d->hdr->size = d->size;
+    smp_wmb();
+    d->hdr->magic = RINGBUF_FILE_MAGIC;
+
+out:
+    close(fd);
+}
+#endif
+
 static void qemu_chr_open_ringbuf(Chardev *chr,
                                   ChardevBackend *backend,
                                   bool *be_opened,
@@ -108,6 +194,14 @@ static void qemu_chr_open_ringbuf(Chardev *chr,
 
     d->prod = 0;
     d->cons = 0;
+    if (opts->has_path) {
+#ifdef CONFIG_POSIX
+        ringbuf_open_file(d, opts->path, errp);
+#else
+        error_setg(errp, "ringbuf chardev path is not supported on this host");
+#endif
+        return;
+    }
     d->cbuf = g_malloc0(d->size);
 }
 
@@ -219,6 +313,9 @@ static void qemu_chr_parse_ringbuf(QemuOpts *opts, ChardevBackend *backend,
         ringbuf->has_size = true;
         ringbuf->size = val;
     }
+
+    ringbuf->path = g_strdup(qemu_opt_get(opts, "path"));
+    ringbuf->has_path = ringbuf->path != NULL;
 }
 
 static void char_ringbuf_class_init(ObjectClass *oc, void *data)
@@ -100,6 +100,108 @@ static void qemu_chr_write_log(Chardev *s, const uint8_t *buf, size_t len)
     }
 }
 
+/*
+ * With flush-ms, output is collected in chr->outbuf and handed to the
+ * backend when it fills up or flush_ms after the first byte went in,
+ * so that a guest writing a byte at a time costs one syscall per
+ * buffer instead of per byte.  Called with chr_write_lock held.
+ */
+static void qemu_chr_flush_locked(Chardev *s)
+{
+    ChardevClass *cc = CHARDEV_GET_CLASS(s);
+    int done = 0;
+    int res;
+
+    while (done < s->outbuf_len) {
+        res = cc->chr_write(s, s->outbuf + done, s->outbuf_len - done);
+        if (res < 0 && errno != EAGAIN) {
+            /* the backend is broken, don't keep frontends waiting on it */
+            done = s->outbuf_len;
+            break;
+        }
+        if (res <= 0) {
+            break;
+        }
+        done += res;
+    }
+    s->outbuf_len -= done;
+    memmove(s->outbuf, s->outbuf + done, s->outbuf_len);
+}
+
+static gboolean qemu_chr_flush_timeout(gpointer opaque)
+{
+    Chardev *s = opaque;
+    gboolean again;
+
+    qemu_mutex_lock(&s->chr_write_lock);
+    if (g_source_is_destroyed(g_main_current_source())) {
+        /* qemu_chr_flush() got there first */
+        qemu_mutex_unlock(&s->chr_write_lock);
+        return G_SOURCE_REMOVE;
+    }
+    qemu_chr_flush_locked(s);
+    /* try again later if the backend could not take everything */
+    again = s->outbuf_len > 0;
+    if (!again) {
+        g_source_unref(s->flush_source);
+        s->flush_source = NULL;
+    }
+    qemu_mutex_unlock(&s->chr_write_lock);
+
+    return again ? G_SOURCE_CONTINUE : G_SOURCE_REMOVE;
+}
+
+static void qemu_chr_flush_cancel(Chardev *s)
+{
+    if (s->flush_source) {
+        g_source_destroy(s->flush_source);
+        g_source_unref(s->flush_source);
+        s->flush_source = NULL;
+    }
+}
+
+void qemu_chr_flush(Chardev *s)
+{
+    if (!s->outbuf) {
+        return;
+    }
+
+    qemu_mutex_lock(&s->chr_write_lock);
+    qemu_chr_flush_locked(s);
+    if (!s->outbuf_len) {
+        qemu_chr_flush_cancel(s);
+    }
+    qemu_mutex_unlock(&s->chr_write_lock);
+}
+
+/* Called with chr_write_lock held, same return value as chr_write */
+static int qemu_chr_write_coalesced(Chardev *s, const uint8_t *buf, int len)
+{
+    int n;
+
+    if (s->outbuf_len + len > CHR_OUT_BUF_LEN) {
+        qemu_chr_flush_locked(s);
+        if (!s->outbuf_len && len >= CHR_OUT_BUF_LEN) {
+            /* nothing to gain from copying it */
+            return CHARDEV_GET_CLASS(s)->chr_write(s, buf, len);
+        }
+    }
+
+    n = MIN(len, CHR_OUT_BUF_LEN - s->outbuf_len);
+    if (n == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    memcpy(s->outbuf + s->outbuf_len, buf, n);
+    s->outbuf_len += n;
+
+    if (!s->flush_source) {
+        s->flush_source = qemu_chr_timeout_add_ms(s, s->flush_ms,
+                                                  qemu_chr_flush_timeout, s);
+    }
+    return n;
+}
+
 static int qemu_chr_write_buffer(Chardev *s,
                                  const uint8_t *buf, int len,
                                  int *offset, bool write_all)
@@ -111,7 +213,11 @@ static int qemu_chr_write_buffer(Chardev *s,
     qemu_mutex_lock(&s->chr_write_lock);
     while (*offset < len) {
     retry:
-        res = cc->chr_write(s, buf + *offset, len - *offset);
+        if (s->outbuf) {
+            res = qemu_chr_write_coalesced(s, buf + *offset, len - *offset);
+        } else {
+            res = cc->chr_write(s, buf + *offset, len - *offset);
+        }
         if (res < 0 && errno == EAGAIN && write_all) {
             g_usleep(100);
             goto retry;
@@ -233,6 +339,11 @@ static void qemu_char_open(Chardev *chr, ChardevBackend *backend,
         }
     }
 
+    if (common && common->has_flush_ms && common->flush_ms) {
+        chr->flush_ms = common->flush_ms;
+        chr->outbuf = g_malloc(CHR_OUT_BUF_LEN);
+    }
+
     if (cc->open) {
         cc->open(chr, backend, be_opened, errp);
     }
@@ -260,10 +371,17 @@ static int null_chr_write(Chardev *chr, const uint8_t *buf, int len)
     return len;
 }
 
+/* Runs before the backends' own finalize, while they can still write */
+static void char_unparent(Object *obj)
+{
+    qemu_chr_flush(CHARDEV(obj));
+}
+
 static void char_class_init(ObjectClass *oc, void *data)
 {
     ChardevClass *cc = CHARDEV_CLASS(oc);
 
+    oc->unparent = char_unparent;
     cc->chr_write = null_chr_write;
     cc->chr_be_event = chr_be_event;
 }
@@ -272,6 +390,8 @@ static void char_finalize(Object *obj)
 {
     Chardev *chr = CHARDEV(obj);
 
+    qemu_chr_flush_cancel(chr);
+    g_free(chr->outbuf);
     if (chr->be) {
         chr->be->chr = NULL;
     }
@@ -508,6 +628,9 @@ void qemu_chr_parse_common(QemuOpts *opts, ChardevCommon *backend)
 
     backend->has_logappend = true;
     backend->logappend = qemu_opt_get_bool(opts, "logappend", false);
+
+    backend->has_flush_ms = qemu_opt_get(opts, "flush-ms") != NULL;
+    backend->flush_ms = qemu_opt_get_number(opts, "flush-ms", 0);
 }
 
 static const ChardevClass *char_get_class(const char *driver, Error **errp)
@@ -927,6 +1050,9 @@ QemuOptsList qemu_chardev_opts = {
         },{
             .name = "logappend",
             .type = QEMU_OPT_BOOL,
+        },{
+            .name = "flush-ms",
+            .type = QEMU_OPT_NUMBER,
         },
         { /* end of list */ }
     },
@@ -83,6 +83,8 @@ int64_t max_advance;
 /* vcpu throttling controls */
 static QEMUTimer *throttle_timer;
 static unsigned int throttle_percentage;
+/* Set once a vCPU is given its own percentage with cpu_throttle_set_vcpu */
+static bool throttle_per_vcpu;
 
 #define CPU_THROTTLE_PCT_MIN 1
 #define CPU_THROTTLE_PCT_MAX 99
@@ -205,9 +207,17 @@ static bool default_mttcg_enabled(void)
     }
 }
 
+/*
+ * With MTTCG, how long a halted vCPU may spin waiting for a kick before it
+ * sleeps on its halt_cond; 0 disables polling.
+ */
+static int64_t tcg_halt_poll_ns;
+
 void qemu_tcg_configure(QemuOpts *opts, Error **errp)
 {
     const char *t = qemu_opt_get(opts, "thread");
+
+    tcg_halt_poll_ns = qemu_opt_get_number(opts, "halt-poll-ns", 0);
     if (t) {
         if (strcmp(t, "multi") == 0) {
             if (TCG_OVERSIZED_GUEST) {
@@ -234,6 +244,11 @@ void qemu_tcg_configure(QemuOpts *opts, Error **errp)
     } else {
         mttcg_enabled = default_mttcg_enabled();
     }
+
+    /* The round-robin thread never sleeps on a single vCPU's halt_cond */
+    if (tcg_halt_poll_ns && !mttcg_enabled) {
+        warn_report("halt-poll-ns has no effect with single-threaded TCG");
+    }
 }
 
 /* The current number of executed instructions is based on what we
@@ -778,18 +793,26 @@ static const VMStateDescription vmstate_timers = {
     }
 };
 
+/*
+ * The timer ticks once every CPU_THROTTLE_TIMESLICE_NS / (1 - max), where
+ * max is the highest percentage of all vCPUs.  A vCPU throttled by pct
+ * sleeps for pct of that period, so that it runs (1 - pct) of the time
+ * whatever the percentage of the others.
+ */
 static void cpu_throttle_thread(CPUState *cpu, run_on_cpu_data opaque)
 {
-    double pct;
+    double pct, max_pct;
     double throttle_ratio;
     long sleeptime_ns;
 
-    if (!cpu_throttle_get_percentage()) {
+    pct = (double)cpu_throttle_get_vcpu_percentage(cpu) / 100;
+    if (!pct) {
+        atomic_set(&cpu->throttle_thread_scheduled, 0);
         return;
     }
 
-    pct = (double)cpu_throttle_get_percentage()/100;
-    throttle_ratio = pct / (1 - pct);
+    max_pct = MAX((double)cpu_throttle_get_percentage() / 100, pct);
+    throttle_ratio = pct / (1 - max_pct);
     sleeptime_ns = (long)(throttle_ratio * CPU_THROTTLE_TIMESLICE_NS);
 
     qemu_mutex_unlock_iothread();
@@ -808,6 +831,9 @@ static void cpu_throttle_timer_tick(void *opaque)
         return;
     }
     CPU_FOREACH(cpu) {
+        if (!cpu_throttle_get_vcpu_percentage(cpu)) {
+            continue;
+        }
         if (!atomic_xchg(&cpu->throttle_thread_scheduled, 1)) {
             async_run_on_cpu(cpu, cpu_throttle_thread,
                              RUN_ON_CPU_NULL);
@@ -825,15 +851,53 @@ void cpu_throttle_set(int new_throttle_pct)
     new_throttle_pct = MIN(new_throttle_pct, CPU_THROTTLE_PCT_MAX);
     new_throttle_pct = MAX(new_throttle_pct, CPU_THROTTLE_PCT_MIN);
 
+    atomic_set(&throttle_per_vcpu, false);
     atomic_set(&throttle_percentage, new_throttle_pct);
 
     timer_mod(throttle_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT) +
                                        CPU_THROTTLE_TIMESLICE_NS);
 }
 
+void cpu_throttle_set_vcpu(CPUState *cpu, int new_throttle_pct)
+{
+    CPUState *other;
+    bool was_active = cpu_throttle_active();
+    int max_pct = 0;
+
+    /* 0 leaves the vCPU alone while the others are throttled */
+    new_throttle_pct = MIN(new_throttle_pct, CPU_THROTTLE_PCT_MAX);
+    new_throttle_pct = MAX(new_throttle_pct, 0);
+
+    if (!atomic_read(&throttle_per_vcpu)) {
+        /* The vCPUs start where the uniform throttling left them */
+        CPU_FOREACH(other) {
+            atomic_set(&other->throttle_percentage,
+                       cpu_throttle_get_percentage());
+        }
+        atomic_set(&throttle_per_vcpu, true);
+    }
+    atomic_set(&cpu->throttle_percentage, new_throttle_pct);
+
+    CPU_FOREACH(other) {
+        max_pct = MAX(max_pct, atomic_read(&other->throttle_percentage));
+    }
+    atomic_set(&throttle_percentage, max_pct);
+
+    if (max_pct && !was_active) {
+        timer_mod(throttle_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT) +
+                                           CPU_THROTTLE_TIMESLICE_NS);
+    }
+}
+
 void cpu_throttle_stop(void)
 {
+    CPUState *cpu;
+
     atomic_set(&throttle_percentage, 0);
+    atomic_set(&throttle_per_vcpu, false);
+    CPU_FOREACH(cpu) {
+        atomic_set(&cpu->throttle_percentage, 0);
+    }
 }
 
 bool cpu_throttle_active(void)
@@ -846,6 +910,14 @@ int cpu_throttle_get_percentage(void)
     return atomic_read(&throttle_percentage);
 }
 
+int cpu_throttle_get_vcpu_percentage(CPUState *cpu)
+{
+    if (!atomic_read(&throttle_per_vcpu)) {
+        return cpu_throttle_get_percentage();
+    }
+    return atomic_read(&cpu->throttle_percentage);
+}
+
 void cpu_ticks_init(void)
 {
     seqlock_init(&timers_state.vm_clock_seqlock);
@@ -1244,11 +1316,59 @@ static void qemu_tcg_rr_wait_io_event(void)
     }
 }
 
+/*
+ * Adaptive halt polling for MTTCG vCPUs.  A vCPU woken from halt_cond has
+ * to wait for the thread that kicked it to drop the BQL, and then win the
+ * BQL back; polling without the BQL catches kicks that come soon, such as
+ * IPIs, without sleeping at all.  As with KVM's halt_poll_ns, the window
+ * grows while wake-ups arrive just after it runs out, and shrinks while
+ * the vCPU sleeps for longer than tcg_halt_poll_ns anyway.
+ */
+static __thread int64_t halt_poll_window_ns;
+
+static void qemu_tcg_halt_poll(CPUState *cpu)
+{
+    int64_t deadline;
+
+    if (!halt_poll_window_ns) {
+        return;
+    }
+
+    qemu_mutex_unlock_iothread();
+    deadline = get_clock() + halt_poll_window_ns;
+    /* for TCG, a kick always comes with cpu_exit() */
+    while (!atomic_read(&cpu->exit_request) && get_clock() < deadline) {
+        cpu_relax();
+    }
+    qemu_mutex_lock_iothread();
+}
+
+static void qemu_tcg_halt_poll_adjust(int64_t halted_ns)
+{
+    if (halted_ns <= halt_poll_window_ns) {
+        /* polling was enough */
+    } else if (halted_ns > tcg_halt_poll_ns) {
+        halt_poll_window_ns /= 2;
+    } else {
+        halt_poll_window_ns = MIN(MAX(halt_poll_window_ns * 2, 10000),
+                                  tcg_halt_poll_ns);
+    }
+}
+
 static void qemu_wait_io_event(CPUState *cpu)
 {
+    int64_t start = 0;
+
+    if (tcg_halt_poll_ns && cpu_thread_is_idle(cpu)) {
+        start = get_clock();
+        qemu_tcg_halt_poll(cpu);
+    }
     while (cpu_thread_is_idle(cpu)) {
         qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
     }
+    if (start) {
+        qemu_tcg_halt_poll_adjust(get_clock() - start);
+    }
 
 #ifdef _WIN32
     /* Eat dummy APC queued by qemu_cpu_kick_thread.  */
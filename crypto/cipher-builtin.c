@@ -19,6 +19,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bswap.h"
 #include "crypto/aes.h"
 #include "crypto/desrfb.h"
 #include "crypto/xts.h"
@@ -74,6 +75,103 @@ static void qcrypto_cipher_free_aes(QCryptoCipher *cipher)
 }
 
 
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("aes")
+#include <wmmintrin.h>
+#include "qemu/host-cpuinfo.h"
+
+/* Blocks in flight: enough to hide the latency of AESENC/AESDEC */
+#define AESNI_LANES 8
+
+static inline __m128i qcrypto_cipher_aesni_round(__m128i b, __m128i k,
+                                                 bool enc)
+{
+    return enc ? _mm_aesenc_si128(b, k) : _mm_aesdec_si128(b, k);
+}
+
+static inline __m128i qcrypto_cipher_aesni_last(__m128i b, __m128i k,
+                                                bool enc)
+{
+    return enc ? _mm_aesenclast_si128(b, k) : _mm_aesdeclast_si128(b, k);
+}
+
+/* Apply @op with round key @k to every lane, keeping them in registers */
+#define AESNI_LANES_OP(op, k)                                           \
+    do {                                                                \
+        b[0] = op(b[0], k, enc); b[1] = op(b[1], k, enc);               \
+        b[2] = op(b[2], k, enc); b[3] = op(b[3], k, enc);               \
+        b[4] = op(b[4], k, enc); b[5] = op(b[5], k, enc);               \
+        b[6] = op(b[6], k, enc); b[7] = op(b[7], k, enc);               \
+    } while (0)
+
+/*
+ * ECB over whole blocks with AES-NI, AESNI_LANES blocks at a time.  An
+ * AES_KEY holds the round keys as words of big-endian bytes, and the
+ * decryption schedule in the "equivalent inverse cipher" form that
+ * AESDEC expects, so both only need byte swapping.
+ */
+static inline __attribute__((always_inline))
+void qcrypto_cipher_aesni_ecb(const AES_KEY *key, bool enc,
+                              const uint8_t *in, uint8_t *out, size_t len)
+{
+    __m128i rk[AES_MAXNR + 1];
+    __m128i b[AESNI_LANES];
+    int nr = key->rounds;
+    int i, r;
+
+    for (r = 0; r <= nr; r++) {
+        const uint32_t *k = key->rd_key + r * 4;
+
+        rk[r] = _mm_set_epi32(bswap32(k[3]), bswap32(k[2]),
+                              bswap32(k[1]), bswap32(k[0]));
+    }
+
+    for (; len >= AESNI_LANES * AES_BLOCK_SIZE;
+         len -= AESNI_LANES * AES_BLOCK_SIZE,
+         in += AESNI_LANES * AES_BLOCK_SIZE,
+         out += AESNI_LANES * AES_BLOCK_SIZE) {
+        for (i = 0; i < AESNI_LANES; i++) {
+            b[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in + i),
+                                 rk[0]);
+        }
+        for (r = 1; r < nr; r++) {
+            AESNI_LANES_OP(qcrypto_cipher_aesni_round, rk[r]);
+        }
+        AESNI_LANES_OP(qcrypto_cipher_aesni_last, rk[nr]);
+        for (i = 0; i < AESNI_LANES; i++) {
+            _mm_storeu_si128((__m128i *)out + i, b[i]);
+        }
+    }
+
+    for (; len; len -= AES_BLOCK_SIZE,
+         in += AES_BLOCK_SIZE, out += AES_BLOCK_SIZE) {
+        b[0] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), rk[0]);
+        for (r = 1; r < nr; r++) {
+            b[0] = qcrypto_cipher_aesni_round(b[0], rk[r], enc);
+        }
+        b[0] = qcrypto_cipher_aesni_last(b[0], rk[nr], enc);
+        _mm_storeu_si128((__m128i *)out, b[0]);
+    }
+}
+
+static void qcrypto_cipher_aesni_ecb_encrypt(const AES_KEY *key,
+                                             const void *in, void *out,
+                                             size_t len)
+{
+    qcrypto_cipher_aesni_ecb(key, true, in, out, len);
+}
+
+static void qcrypto_cipher_aesni_ecb_decrypt(const AES_KEY *key,
+                                             const void *in, void *out,
+                                             size_t len)
+{
+    qcrypto_cipher_aesni_ecb(key, false, in, out, len);
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AVX2_OPT */
+
+
 static void qcrypto_cipher_aes_ecb_encrypt(AES_KEY *key,
                                            const void *in,
                                            void *out,
@@ -81,6 +179,14 @@ static void qcrypto_cipher_aes_ecb_encrypt(AES_KEY *key,
 {
     const uint8_t *inptr = in;
     uint8_t *outptr = out;
+
+#ifdef CONFIG_AVX2_OPT
+    if ((host_cpuinfo & CPUINFO_AES) && len % AES_BLOCK_SIZE == 0) {
+        qcrypto_cipher_aesni_ecb_encrypt(key, in, out, len);
+        return;
+    }
+#endif
+
     while (len) {
         if (len > AES_BLOCK_SIZE) {
             AES_encrypt(inptr, outptr, key);
@@ -107,6 +213,14 @@ static void qcrypto_cipher_aes_ecb_decrypt(AES_KEY *key,
 {
     const uint8_t *inptr = in;
     uint8_t *outptr = out;
+
+#ifdef CONFIG_AVX2_OPT
+    if ((host_cpuinfo & CPUINFO_AES) && len % AES_BLOCK_SIZE == 0) {
+        qcrypto_cipher_aesni_ecb_decrypt(key, in, out, len);
+        return;
+    }
+#endif
+
     while (len) {
         if (len > AES_BLOCK_SIZE) {
             AES_decrypt(inptr, outptr, key);
@@ -32,6 +32,17 @@
 
 #include <gnutls/x509.h>
 
+#ifdef CONFIG_KTLS
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#endif
 
 struct QCryptoTLSSession {
     QCryptoTLSCreds *creds;
@@ -43,6 +54,7 @@ struct QCryptoTLSSession {
     QCryptoTLSSessionReadFunc readFunc;
     void *opaque;
     char *peername;
+    bool ktlsULP;
 };
 
 
@@ -538,6 +550,118 @@ qcrypto_tls_session_get_key_size(QCryptoTLSSession *session,
 }
 
 
+#ifdef CONFIG_KTLS
+/*
+ * The AES-GCM crypto_info structures only differ by the key size.
+ * TLS 1.2 sends the explicit nonce in each record, and the kernel
+ * starts it from the sequence number like gnutls does; TLS 1.3
+ * derives the nonce from the static IV that follows the salt.
+ */
+#define QCRYPTO_KTLS_FILL(ci, name, tls13, ivd, keyd, seq)              \
+    do {                                                                \
+        memcpy((ci).key, (keyd)->data, TLS_CIPHER_##name##_KEY_SIZE);   \
+        memcpy((ci).salt, (ivd)->data, TLS_CIPHER_##name##_SALT_SIZE);  \
+        memcpy((ci).iv, (tls13) ?                                       \
+               (ivd)->data + TLS_CIPHER_##name##_SALT_SIZE : (seq),     \
+               TLS_CIPHER_##name##_IV_SIZE);                            \
+        memcpy((ci).rec_seq, (seq), TLS_CIPHER_##name##_REC_SEQ_SIZE);  \
+    } while (0)
+
+int
+qcrypto_tls_session_enable_ktls(QCryptoTLSSession *session,
+                                int fd,
+                                bool read,
+                                Error **errp)
+{
+    gnutls_protocol_t version = gnutls_protocol_get_version(session->handle);
+    gnutls_cipher_algorithm_t cipher = gnutls_cipher_get(session->handle);
+    gnutls_datum_t mac_key, iv, key;
+    unsigned char seq[8];
+    union {
+        struct tls_crypto_info info;
+        struct tls12_crypto_info_aes_gcm_128 aes128;
+        struct tls12_crypto_info_aes_gcm_256 aes256;
+    } crypto;
+    size_t len;
+    bool tls13;
+    int ret;
+
+    if (!session->handshakeComplete) {
+        error_setg(errp, "TLS handshake is not complete");
+        return -1;
+    }
+    if (version != GNUTLS_TLS1_2 && version != GNUTLS_TLS1_3) {
+        error_setg(errp, "Kernel TLS requires TLS 1.2 or 1.3");
+        return -1;
+    }
+    tls13 = version == GNUTLS_TLS1_3;
+
+    /* Records that gnutls already decrypted would be skipped */
+    if (read && gnutls_record_check_pending(session->handle)) {
+        error_setg(errp, "TLS session has pending data");
+        return -1;
+    }
+
+    ret = gnutls_record_get_state(session->handle, read,
+                                  &mac_key, &iv, &key, seq);
+    if (ret < 0) {
+        error_setg(errp, "Cannot get TLS record state: %s",
+                   gnutls_strerror(ret));
+        return -1;
+    }
+
+    memset(&crypto, 0, sizeof(crypto));
+    crypto.info.version = tls13 ? TLS_1_3_VERSION : TLS_1_2_VERSION;
+    switch (cipher) {
+    case GNUTLS_CIPHER_AES_128_GCM:
+        crypto.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+        QCRYPTO_KTLS_FILL(crypto.aes128, AES_GCM_128, tls13, &iv, &key, seq);
+        len = sizeof(crypto.aes128);
+        break;
+    case GNUTLS_CIPHER_AES_256_GCM:
+        crypto.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+        QCRYPTO_KTLS_FILL(crypto.aes256, AES_GCM_256, tls13, &iv, &key, seq);
+        len = sizeof(crypto.aes256);
+        break;
+    default:
+        error_setg(errp, "Kernel TLS does not support cipher %s",
+                   gnutls_cipher_get_name(cipher));
+        return -1;
+    }
+
+    if (!session->ktlsULP) {
+        if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) < 0) {
+            error_setg_errno(errp, errno, "Cannot enable kernel TLS");
+            memset(&crypto, 0, sizeof(crypto));
+            return -1;
+        }
+        session->ktlsULP = true;
+    }
+
+    ret = setsockopt(fd, SOL_TLS, read ? TLS_RX : TLS_TX, &crypto, len);
+    memset(&crypto, 0, sizeof(crypto));
+    if (ret < 0) {
+        error_setg_errno(errp, errno, "Cannot set kernel TLS %s keys",
+                         read ? "receive" : "send");
+        return -1;
+    }
+
+    trace_qcrypto_tls_session_enable_ktls(session, read);
+    return 0;
+}
+#else
+int
+qcrypto_tls_session_enable_ktls(QCryptoTLSSession *session G_GNUC_UNUSED,
+                                int fd G_GNUC_UNUSED,
+                                bool read G_GNUC_UNUSED,
+                                Error **errp)
+{
+    error_setg(errp, "Kernel TLS is not supported by this build");
+    return -1;
+}
+#endif
+
+
 char *
 qcrypto_tls_session_get_peer_name(QCryptoTLSSession *session)
 {
@@ -633,6 +757,17 @@ qcrypto_tls_session_get_key_size(QCryptoTLSSession *sess,
 }
 
 
+int
+qcrypto_tls_session_enable_ktls(QCryptoTLSSession *sess G_GNUC_UNUSED,
+                                int fd G_GNUC_UNUSED,
+                                bool read G_GNUC_UNUSED,
+                                Error **errp)
+{
+    error_setg(errp, "TLS requires GNUTLS support");
+    return -1;
+}
+
+
 char *
 qcrypto_tls_session_get_peer_name(QCryptoTLSSession *sess)
 {
@@ -124,8 +124,6 @@ static void dma_complete(DMAAIOCB *dbs, int ret)
 static void dma_blk_cb(void *opaque, int ret)
 {
     DMAAIOCB *dbs = (DMAAIOCB *)opaque;
-    dma_addr_t cur_addr, cur_len;
-    void *mem;
 
     trace_dma_blk_cb(dbs, ret);
 
@@ -138,24 +136,13 @@ static void dma_blk_cb(void *opaque, int ret)
     }
     dma_blk_unmap(dbs);
 
-    while (dbs->sg_cur_index < dbs->sg->nsg) {
-        cur_addr = dbs->sg->sg[dbs->sg_cur_index].base + dbs->sg_cur_byte;
-        cur_len = dbs->sg->sg[dbs->sg_cur_index].len - dbs->sg_cur_byte;
-        mem = dma_memory_map(dbs->sg->as, cur_addr, &cur_len, dbs->dir);
-        if (!mem)
-            break;
-        qemu_iovec_add(&dbs->iov, mem, cur_len);
-        dbs->sg_cur_byte += cur_len;
-        if (dbs->sg_cur_byte == dbs->sg->sg[dbs->sg_cur_index].len) {
-            dbs->sg_cur_byte = 0;
-            ++dbs->sg_cur_index;
-        }
-    }
+    dma_memory_map_sg(dbs->sg, &dbs->sg_cur_index, &dbs->sg_cur_byte,
+                      &dbs->iov, dbs->dir);
 
     if (dbs->iov.size == 0) {
         trace_dma_map_wait(dbs);
         dbs->bh = aio_bh_new(dbs->ctx, reschedule_dma, dbs);
-        cpu_register_map_client(dbs->bh);
+        cpu_register_map_client(dbs->sg->as, dbs->bh);
         return;
     }
 
@@ -1301,20 +1301,264 @@ static inline bool is_zero_page(const uint8_t *buf, size_t page_size)
     return buffer_is_zero(buf, page_size);
 }
 
+/*
+ * Compressing the pages
+ *
+ * The pages are compressed by a few worker threads, a batch of pages at
+ * a time.  The dump thread fills the batches in the order of the pages,
+ * and writes them back in the same order once compressed, so that the
+ * layout of the dump does not depend on the number of workers.
+ */
+#define DUMP_BATCH_PAGES 256
+#define DUMP_MAX_COMPRESS_THREADS 8
+
+typedef struct DumpPage {
+    uint8_t *buf;               /* the guest page */
+    uint32_t flags;             /* the compression, 0 if stored as is */
+    size_t size;                /* 0 for a zero page */
+} DumpPage;
+
+typedef struct DumpBatch {
+    DumpPage pages[DUMP_BATCH_PAGES];
+    int nr_pages;
+    uint8_t *buf_out;           /* len_buf_out bytes for each page */
+    bool done;
+} DumpBatch;
+
+typedef struct DumpCompress {
+    DumpState *s;
+    size_t len_buf_out;
+
+    QemuMutex lock;
+    QemuCond cond;
+    /* Fields protected by @lock */
+    DumpBatch *batches;         /* a ring of nr_batches */
+    int nr_batches;
+    uint64_t submitted;         /* batches handed to the workers */
+    uint64_t taken;             /* batches taken by a worker */
+    bool quit;
+
+    QemuThread *threads;
+    int nr_threads;
+} DumpCompress;
+
+/*
+ * Compress @buf into @buf_out, and return the size of the data to store.
+ * The page is stored as is, with *@flags set to 0, if compressing it
+ * fails or does not save space.
+ */
+static size_t dump_compress_page(DumpState *s, const uint8_t *buf,
+                                 uint8_t *buf_out, size_t len_buf_out,
+                                 void *wrkmem, uint32_t *flags)
+{
+    size_t size_out = len_buf_out;
+
+    if ((s->flag_compress & DUMP_DH_COMPRESSED_ZLIB) &&
+        (compress2(buf_out, (uLongf *)&size_out, buf,
+                   s->dump_info.page_size, Z_BEST_SPEED) == Z_OK) &&
+        (size_out < s->dump_info.page_size)) {
+        *flags = DUMP_DH_COMPRESSED_ZLIB;
+        return size_out;
+    }
+#ifdef CONFIG_LZO
+    size_out = len_buf_out;
+    if ((s->flag_compress & DUMP_DH_COMPRESSED_LZO) &&
+        (lzo1x_1_compress(buf, s->dump_info.page_size, buf_out,
+                          (lzo_uint *)&size_out, wrkmem) == LZO_E_OK) &&
+        (size_out < s->dump_info.page_size)) {
+        *flags = DUMP_DH_COMPRESSED_LZO;
+        return size_out;
+    }
+#endif
+#ifdef CONFIG_SNAPPY
+    size_out = len_buf_out;
+    if ((s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) &&
+        (snappy_compress((char *)buf, s->dump_info.page_size,
+                         (char *)buf_out, &size_out) == SNAPPY_OK) &&
+        (size_out < s->dump_info.page_size)) {
+        *flags = DUMP_DH_COMPRESSED_SNAPPY;
+        return size_out;
+    }
+#endif
+    /* fall back to save in plaintext */
+    *flags = 0;
+    return s->dump_info.page_size;
+}
+
+static void *dump_compress_thread(void *opaque)
+{
+    DumpCompress *dc = opaque;
+    DumpState *s = dc->s;
+    void *wrkmem = NULL;
+    DumpBatch *batch;
+    int i;
+
+#ifdef CONFIG_LZO
+    wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
+#endif
+
+    qemu_mutex_lock(&dc->lock);
+    for (;;) {
+        while (dc->taken == dc->submitted && !dc->quit) {
+            qemu_cond_wait(&dc->cond, &dc->lock);
+        }
+        if (dc->quit) {
+            break;
+        }
+        batch = &dc->batches[dc->taken++ % dc->nr_batches];
+        qemu_mutex_unlock(&dc->lock);
+
+        for (i = 0; i < batch->nr_pages; i++) {
+            DumpPage *page = &batch->pages[i];
+
+            if (is_zero_page(page->buf, s->dump_info.page_size)) {
+                page->size = 0;
+                continue;
+            }
+            page->size = dump_compress_page(s, page->buf,
+                                            batch->buf_out +
+                                            i * dc->len_buf_out,
+                                            dc->len_buf_out, wrkmem,
+                                            &page->flags);
+        }
+
+        qemu_mutex_lock(&dc->lock);
+        batch->done = true;
+        qemu_cond_broadcast(&dc->cond);
+    }
+    qemu_mutex_unlock(&dc->lock);
+
+    g_free(wrkmem);
+    return NULL;
+}
+
+static void dump_compress_start(DumpCompress *dc, DumpState *s)
+{
+    int i;
+
+    dc->s = s;
+    dc->len_buf_out = get_len_buf_out(s->dump_info.page_size,
+                                      s->flag_compress);
+    assert(dc->len_buf_out != 0);
+    qemu_mutex_init(&dc->lock);
+    qemu_cond_init(&dc->cond);
+
+    dc->nr_threads = MIN(g_get_num_processors(), DUMP_MAX_COMPRESS_THREADS);
+    /* keep every worker busy while the dump thread writes */
+    dc->nr_batches = dc->nr_threads * 2;
+    dc->batches = g_new0(DumpBatch, dc->nr_batches);
+    for (i = 0; i < dc->nr_batches; i++) {
+        dc->batches[i].buf_out = g_malloc(DUMP_BATCH_PAGES * dc->len_buf_out);
+    }
+    dc->submitted = dc->taken = 0;
+    dc->quit = false;
+
+    dc->threads = g_new0(QemuThread, dc->nr_threads);
+    for (i = 0; i < dc->nr_threads; i++) {
+        qemu_thread_create(&dc->threads[i], "dump-compress",
+                           dump_compress_thread, dc, QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void dump_compress_stop(DumpCompress *dc)
+{
+    int i;
+
+    qemu_mutex_lock(&dc->lock);
+    dc->quit = true;
+    qemu_cond_broadcast(&dc->cond);
+    qemu_mutex_unlock(&dc->lock);
+
+    for (i = 0; i < dc->nr_threads; i++) {
+        qemu_thread_join(&dc->threads[i]);
+    }
+    g_free(dc->threads);
+    for (i = 0; i < dc->nr_batches; i++) {
+        g_free(dc->batches[i].buf_out);
+    }
+    g_free(dc->batches);
+    qemu_cond_destroy(&dc->cond);
+    qemu_mutex_destroy(&dc->lock);
+}
+
+static void dump_compress_submit(DumpCompress *dc, DumpBatch *batch)
+{
+    qemu_mutex_lock(&dc->lock);
+    batch->done = false;
+    dc->submitted++;
+    qemu_cond_broadcast(&dc->cond);
+    qemu_mutex_unlock(&dc->lock);
+}
+
+static void dump_compress_wait(DumpCompress *dc, DumpBatch *batch)
+{
+    qemu_mutex_lock(&dc->lock);
+    while (!batch->done) {
+        qemu_cond_wait(&dc->cond, &dc->lock);
+    }
+    qemu_mutex_unlock(&dc->lock);
+}
+
+/* Write the page descriptors and the data of a compressed batch */
+static int dump_write_batch(DumpState *s, DumpCompress *dc, DumpBatch *batch,
+                            DataCache *page_desc, DataCache *page_data,
+                            const PageDescriptor *pd_zero,
+                            off_t *offset_data, Error **errp)
+{
+    PageDescriptor pd;
+    int i, ret;
+
+    for (i = 0; i < batch->nr_pages; i++) {
+        DumpPage *page = &batch->pages[i];
+
+        if (!page->size) {
+            /* zero pages all share the first page of the page section */
+            ret = write_cache(page_desc, pd_zero, sizeof(PageDescriptor),
+                              false);
+            if (ret < 0) {
+                error_setg(errp, "dump: failed to write page desc");
+                return ret;
+            }
+        } else {
+            ret = write_cache(page_data,
+                              page->flags ?
+                              batch->buf_out + i * dc->len_buf_out :
+                              page->buf,
+                              page->size, false);
+            if (ret < 0) {
+                error_setg(errp, "dump: failed to write page data");
+                return ret;
+            }
+
+            pd.flags = cpu_to_dump32(s, page->flags);
+            pd.size = cpu_to_dump32(s, page->size);
+            pd.page_flags = cpu_to_dump64(s, 0);
+            pd.offset = cpu_to_dump64(s, *offset_data);
+            *offset_data += page->size;
+
+            ret = write_cache(page_desc, &pd, sizeof(PageDescriptor), false);
+            if (ret < 0) {
+                error_setg(errp, "dump: failed to write page desc");
+                return ret;
+            }
+        }
+        s->written_size += s->dump_info.page_size;
+    }
+    return 0;
+}
+
 static void write_dump_pages(DumpState *s, Error **errp)
 {
     int ret = 0;
     DataCache page_desc, page_data;
-    size_t len_buf_out, size_out;
-#ifdef CONFIG_LZO
-    lzo_bytep wrkmem = NULL;
-#endif
-    uint8_t *buf_out = NULL;
+    DumpCompress dc;
     off_t offset_desc, offset_data;
-    PageDescriptor pd, pd_zero;
+    PageDescriptor pd_zero;
     uint8_t *buf;
     GuestPhysBlock *block_iter = NULL;
     uint64_t pfn_iter;
+    uint64_t written = 0;
+    bool more = true;
 
     /* get offset of page_desc and page_data in dump file */
     offset_desc = s->offset_page;
@@ -1323,16 +1567,6 @@ static void write_dump_pages(DumpState *s, Error **errp)
     prepare_data_cache(&page_desc, s, offset_desc);
     prepare_data_cache(&page_data, s, offset_data);
 
-    /* prepare buffer to store compressed data */
-    len_buf_out = get_len_buf_out(s->dump_info.page_size, s->flag_compress);
-    assert(len_buf_out != 0);
-
-#ifdef CONFIG_LZO
-    wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
-#endif
-
-    buf_out = g_malloc(len_buf_out);
-
     /*
      * init zero page's page_desc and page_data, because every zero page
      * uses the same page_data
@@ -1346,106 +1580,45 @@ static void write_dump_pages(DumpState *s, Error **errp)
     g_free(buf);
     if (ret < 0) {
         error_setg(errp, "dump: failed to write page data (zero page)");
-        goto out;
+        free_data_cache(&page_desc);
+        free_data_cache(&page_data);
+        return;
     }
 
     offset_data += s->dump_info.page_size;
 
     /*
-     * dump memory to vmcore page by page. zero page will all be resided in the
-     * first page of page section
+     * dump memory to vmcore page by page: fill the free batches, then
+     * write the oldest one once it is compressed
      */
-    while (get_next_page(&block_iter, &pfn_iter, &buf, s)) {
-        /* check zero page */
-        if (is_zero_page(buf, s->dump_info.page_size)) {
-            ret = write_cache(&page_desc, &pd_zero, sizeof(PageDescriptor),
-                              false);
-            if (ret < 0) {
-                error_setg(errp, "dump: failed to write page desc");
-                goto out;
+    dump_compress_start(&dc, s);
+    while (more || written < dc.submitted) {
+        DumpBatch *batch;
+
+        while (more && dc.submitted - written < dc.nr_batches) {
+            batch = &dc.batches[dc.submitted % dc.nr_batches];
+            batch->nr_pages = 0;
+            while (batch->nr_pages < DUMP_BATCH_PAGES &&
+                   (more = get_next_page(&block_iter, &pfn_iter, &buf, s))) {
+                batch->pages[batch->nr_pages++].buf = buf;
             }
-        } else {
-            /*
-             * not zero page, then:
-             * 1. compress the page
-             * 2. write the compressed page into the cache of page_data
-             * 3. get page desc of the compressed page and write it into the
-             *    cache of page_desc
-             *
-             * only one compression format will be used here, for
-             * s->flag_compress is set. But when compression fails to work,
-             * we fall back to save in plaintext.
-             */
-             size_out = len_buf_out;
-             if ((s->flag_compress & DUMP_DH_COMPRESSED_ZLIB) &&
-                    (compress2(buf_out, (uLongf *)&size_out, buf,
-                               s->dump_info.page_size, Z_BEST_SPEED) == Z_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_ZLIB);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#ifdef CONFIG_LZO
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_LZO) &&
-                    (lzo1x_1_compress(buf, s->dump_info.page_size, buf_out,
-                    (lzo_uint *)&size_out, wrkmem) == LZO_E_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_LZO);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#endif
-#ifdef CONFIG_SNAPPY
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) &&
-                    (snappy_compress((char *)buf, s->dump_info.page_size,
-                    (char *)buf_out, &size_out) == SNAPPY_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_SNAPPY);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#endif
-            } else {
-                /*
-                 * fall back to save in plaintext, size_out should be
-                 * assigned the target's page size
-                 */
-                pd.flags = cpu_to_dump32(s, 0);
-                size_out = s->dump_info.page_size;
-                pd.size = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf,
-                                  s->dump_info.page_size, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
+            if (!batch->nr_pages) {
+                break;
             }
+            dump_compress_submit(&dc, batch);
+        }
+        if (written == dc.submitted) {
+            break;
+        }
 
-            /* get and write page desc here */
-            pd.page_flags = cpu_to_dump64(s, 0);
-            pd.offset = cpu_to_dump64(s, offset_data);
-            offset_data += size_out;
-
-            ret = write_cache(&page_desc, &pd, sizeof(PageDescriptor), false);
-            if (ret < 0) {
-                error_setg(errp, "dump: failed to write page desc");
-                goto out;
-            }
+        batch = &dc.batches[written % dc.nr_batches];
+        dump_compress_wait(&dc, batch);
+        ret = dump_write_batch(s, &dc, batch, &page_desc, &page_data,
+                               &pd_zero, &offset_data, errp);
+        if (ret < 0) {
+            goto out;
         }
-        s->written_size += s->dump_info.page_size;
+        written++;
     }
 
     ret = write_cache(&page_desc, NULL, 0, true);
@@ -1460,14 +1633,9 @@ static void write_dump_pages(DumpState *s, Error **errp)
     }
 
 out:
+    dump_compress_stop(&dc);
     free_data_cache(&page_desc);
     free_data_cache(&page_data);
-
-#ifdef CONFIG_LZO
-    g_free(wrkmem);
-#endif
-
-    g_free(buf_out);
 }
 
 static void create_kdump_vmcore(DumpState *s, Error **errp)
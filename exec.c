@@ -2724,7 +2724,14 @@ void memory_notdirty_write_prepare(NotDirtyInfo *ndi,
     ndi->pages = NULL;
 
     assert(tcg_enabled());
-    if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE)) {
+    /* Attribute the page to the vCPU the first time it is dirtied */
+    if (global_dirty_log && cpu &&
+        !cpu_physical_memory_get_dirty_flag(ram_addr,
+                                            DIRTY_MEMORY_MIGRATION)) {
+        atomic_set(&cpu->dirty_pages, cpu->dirty_pages + 1);
+    }
+    if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE) &&
+        tb_page_write_hits_code(ram_addr, size)) {
         ndi->pages = page_collection_lock(ram_addr, ram_addr + size);
         tb_invalidate_phys_page_fast(ndi->pages, ram_addr, size);
     }
@@ -3495,18 +3502,26 @@ void cpu_flush_icache_range(hwaddr start, hwaddr len)
                                      NULL, len, FLUSH_CACHE);
 }
 
-typedef struct {
+/* Limit on the bounce buffer memory that address_space_map() hands out
+ * for each AddressSpace.  Each mapping is at most one page, so several
+ * devices can bounce at the same time.
+ */
+#define BOUNCE_BUFFER_LIMIT (16 * TARGET_PAGE_SIZE)
+
+typedef struct BounceBuffer {
     MemoryRegion *mr;
-    void *buffer;
     hwaddr addr;
     hwaddr len;
-    bool in_use;
+    QLIST_ENTRY(BounceBuffer) link;
+    uint8_t buffer[];
 } BounceBuffer;
 
-static BounceBuffer bounce;
+/* Protects the bounce buffer lists and sizes of all address spaces */
+static QemuMutex bounce_lock;
 
 typedef struct MapClient {
     QEMUBH *bh;
+    AddressSpace *as;
     QLIST_ENTRY(MapClient) link;
 } MapClient;
 
@@ -3520,26 +3535,28 @@ static void cpu_unregister_map_client_do(MapClient *client)
     g_free(client);
 }
 
-static void cpu_notify_map_clients_locked(void)
+static void cpu_notify_map_clients_locked(AddressSpace *as)
 {
-    MapClient *client;
+    MapClient *client, *next;
 
-    while (!QLIST_EMPTY(&map_client_list)) {
-        client = QLIST_FIRST(&map_client_list);
-        qemu_bh_schedule(client->bh);
-        cpu_unregister_map_client_do(client);
+    QLIST_FOREACH_SAFE(client, &map_client_list, link, next) {
+        if (client->as == as) {
+            qemu_bh_schedule(client->bh);
+            cpu_unregister_map_client_do(client);
+        }
     }
 }
 
-void cpu_register_map_client(QEMUBH *bh)
+void cpu_register_map_client(AddressSpace *as, QEMUBH *bh)
 {
     MapClient *client = g_malloc(sizeof(*client));
 
     qemu_mutex_lock(&map_client_list_lock);
     client->bh = bh;
+    client->as = as;
     QLIST_INSERT_HEAD(&map_client_list, client, link);
-    if (!atomic_read(&bounce.in_use)) {
-        cpu_notify_map_clients_locked();
+    if (atomic_read(&as->bounce_buffer_size) < BOUNCE_BUFFER_LIMIT) {
+        cpu_notify_map_clients_locked(as);
     }
     qemu_mutex_unlock(&map_client_list_lock);
 }
@@ -3558,6 +3575,7 @@ void cpu_exec_init_all(void)
     io_mem_init();
     memory_map_init();
     qemu_mutex_init(&map_client_list_lock);
+    qemu_mutex_init(&bounce_lock);
 }
 
 void cpu_unregister_map_client(QEMUBH *bh)
@@ -3574,10 +3592,10 @@ void cpu_unregister_map_client(QEMUBH *bh)
     qemu_mutex_unlock(&map_client_list_lock);
 }
 
-static void cpu_notify_map_clients(void)
+static void cpu_notify_map_clients(AddressSpace *as)
 {
     qemu_mutex_lock(&map_client_list_lock);
-    cpu_notify_map_clients_locked();
+    cpu_notify_map_clients_locked(as);
     qemu_mutex_unlock(&map_client_list_lock);
 }
 
@@ -3644,62 +3662,114 @@ flatview_extend_translation(FlatView *fv, hwaddr addr,
     }
 }
 
-/* Map a physical memory region into a host virtual address.
- * May map a subset of the requested range, given by and returned in *plen.
- * May return NULL if resources needed to perform the mapping are exhausted.
- * Use only for reads OR writes - not for read-modify-write operations.
- * Use cpu_register_map_client() to know when retrying the map operation is
- * likely to succeed.
+/* Take up to @len bytes of bounce buffer from @as, returning NULL if its
+ * limit has been reached.  The length actually taken is stored in
+ * the buffer.
  */
-void *address_space_map(AddressSpace *as,
-                        hwaddr addr,
-                        hwaddr *plen,
-                        bool is_write,
-                        MemTxAttrs attrs)
+static BounceBuffer *bounce_buffer_get(AddressSpace *as, hwaddr len)
+{
+    BounceBuffer *bounce = NULL;
+
+    qemu_mutex_lock(&bounce_lock);
+    if (as->bounce_buffer_size < BOUNCE_BUFFER_LIMIT) {
+        len = MIN(len, BOUNCE_BUFFER_LIMIT - as->bounce_buffer_size);
+        bounce = g_malloc(sizeof(*bounce) + len);
+        bounce->len = len;
+        atomic_set(&as->bounce_buffer_size, as->bounce_buffer_size + len);
+        QLIST_INSERT_HEAD(&as->bounce_buffers, bounce, link);
+    }
+    qemu_mutex_unlock(&bounce_lock);
+    return bounce;
+}
+
+static BounceBuffer *bounce_buffer_find(AddressSpace *as, void *buffer)
+{
+    BounceBuffer *bounce;
+
+    if (!atomic_read(&as->bounce_buffer_size)) {
+        return NULL;
+    }
+
+    qemu_mutex_lock(&bounce_lock);
+    QLIST_FOREACH(bounce, &as->bounce_buffers, link) {
+        if (bounce->buffer == buffer) {
+            break;
+        }
+    }
+    qemu_mutex_unlock(&bounce_lock);
+    return bounce;
+}
+
+static void bounce_buffer_put(AddressSpace *as, BounceBuffer *bounce)
+{
+    qemu_mutex_lock(&bounce_lock);
+    QLIST_REMOVE(bounce, link);
+    atomic_set(&as->bounce_buffer_size, as->bounce_buffer_size - bounce->len);
+    qemu_mutex_unlock(&bounce_lock);
+    memory_region_unref(bounce->mr);
+    g_free(bounce);
+}
+
+/* Called within RCU critical section.  */
+static void *flatview_map(AddressSpace *as, FlatView *fv, hwaddr addr,
+                          hwaddr *plen, bool is_write, MemTxAttrs attrs)
 {
     hwaddr len = *plen;
     hwaddr l, xlat;
     MemoryRegion *mr;
-    void *ptr;
-    FlatView *fv;
+    BounceBuffer *bounce;
 
     if (len == 0) {
         return NULL;
     }
 
     l = len;
-    rcu_read_lock();
-    fv = address_space_to_flatview(as);
     mr = flatview_translate(fv, addr, &xlat, &l, is_write, attrs);
 
     if (!memory_access_is_direct(mr, is_write)) {
-        if (atomic_xchg(&bounce.in_use, true)) {
-            rcu_read_unlock();
+        /* Avoid unbounded allocations */
+        bounce = bounce_buffer_get(as, MIN(l, TARGET_PAGE_SIZE));
+        if (!bounce) {
             return NULL;
         }
-        /* Avoid unbounded allocations */
-        l = MIN(l, TARGET_PAGE_SIZE);
-        bounce.buffer = qemu_memalign(TARGET_PAGE_SIZE, l);
-        bounce.addr = addr;
-        bounce.len = l;
+        bounce->addr = addr;
 
         memory_region_ref(mr);
-        bounce.mr = mr;
+        bounce->mr = mr;
         if (!is_write) {
             flatview_read(fv, addr, MEMTXATTRS_UNSPECIFIED,
-                               bounce.buffer, l);
+                               bounce->buffer, bounce->len);
         }
 
-        rcu_read_unlock();
-        *plen = l;
-        return bounce.buffer;
+        *plen = bounce->len;
+        return bounce->buffer;
     }
 
 
     memory_region_ref(mr);
     *plen = flatview_extend_translation(fv, addr, len, mr, xlat,
                                         l, is_write, attrs);
-    ptr = qemu_ram_ptr_length(mr->ram_block, xlat, plen, true);
+    return qemu_ram_ptr_length(mr->ram_block, xlat, plen, true);
+}
+
+/* Map a physical memory region into a host virtual address.
+ * May map a subset of the requested range, given by and returned in *plen.
+ * May return NULL if resources needed to perform the mapping are exhausted.
+ * Use only for reads OR writes - not for read-modify-write operations.
+ * Use cpu_register_map_client() to know when retrying the map operation is
+ * likely to succeed.
+ */
+void *address_space_map(AddressSpace *as,
+                        hwaddr addr,
+                        hwaddr *plen,
+                        bool is_write,
+                        MemTxAttrs attrs)
+{
+    void *ptr;
+
+    rcu_read_lock();
+    ptr = flatview_map(as, address_space_to_flatview(as), addr, plen,
+                       is_write, attrs);
     rcu_read_unlock();
 
     return ptr;
@@ -3712,7 +3782,9 @@ void *address_space_map(AddressSpace *as,
 void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
                          int is_write, hwaddr access_len)
 {
-    if (buffer != bounce.buffer) {
+    BounceBuffer *bounce = bounce_buffer_find(as, buffer);
+
+    if (!bounce) {
         MemoryRegion *mr;
         ram_addr_t addr1;
 
@@ -3728,14 +3800,50 @@ void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
         return;
     }
     if (is_write) {
-        address_space_write(as, bounce.addr, MEMTXATTRS_UNSPECIFIED,
-                            bounce.buffer, access_len);
-    }
-    qemu_vfree(bounce.buffer);
-    bounce.buffer = NULL;
-    memory_region_unref(bounce.mr);
-    atomic_mb_set(&bounce.in_use, false);
-    cpu_notify_map_clients();
+        address_space_write(as, bounce->addr, MEMTXATTRS_UNSPECIFIED,
+                            bounce->buffer, access_len);
+    }
+    bounce_buffer_put(as, bounce);
+    cpu_notify_map_clients(as);
+}
+
+/* Map as much as possible of @sg, starting @*offset bytes into entry
+ * @*index, and append the host mappings to @qiov.  The whole list is
+ * resolved against a single FlatView.  On return @*index and @*offset
+ * point just past the mapped part; the number of bytes mapped is
+ * returned, 0 if nothing could be mapped.
+ */
+size_t dma_memory_map_sg(QEMUSGList *sg, int *index, dma_addr_t *offset,
+                         QEMUIOVector *qiov, DMADirection dir)
+{
+    AddressSpace *as = sg->as;
+    bool is_write = dir == DMA_DIRECTION_FROM_DEVICE;
+    size_t done = 0;
+    FlatView *fv;
+
+    rcu_read_lock();
+    fv = address_space_to_flatview(as);
+    while (*index < sg->nsg) {
+        ScatterGatherEntry *entry = &sg->sg[*index];
+        hwaddr len = entry->len - *offset;
+        void *mem;
+
+        mem = flatview_map(as, fv, entry->base + *offset, &len, is_write,
+                           MEMTXATTRS_UNSPECIFIED);
+        if (!mem) {
+            break;
+        }
+        qemu_iovec_add(qiov, mem, len);
+        done += len;
+        *offset += len;
+        if (*offset == entry->len) {
+            *offset = 0;
+            ++*index;
+        }
+    }
+    rcu_read_unlock();
+
+    return done;
 }
 
 void *cpu_physical_memory_map(hwaddr addr,
@@ -44,6 +44,9 @@ static QemuOptsList qemu_fsdev_opts = {
         }, {
             .name = "dmode",
             .type = QEMU_OPT_NUMBER,
+        }, {
+            .name = "attr_cache",
+            .type = QEMU_OPT_BOOL,
         },
 
         THROTTLE_OPTS,
@@ -58,6 +58,7 @@ static FsDriverTable FsDrivers[] = {
             "writeout",
             "fmode",
             "dmode",
+            "attr_cache",
             "throttling.bps-total",
             "throttling.bps-read",
             "throttling.bps-write",
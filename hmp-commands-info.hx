@@ -311,6 +311,24 @@ STEXI
 @item info opcount
 @findex info opcount
 Show dynamic compiler opcode counters
+ETEXI
+
+#if defined(CONFIG_TCG)
+    {
+        .name       = "jit-profile",
+        .args_type  = "max:i?",
+        .params     = "[max]",
+        .help       = "show the most executed translation blocks, up to max "
+                      "entries (default: 20)",
+        .cmd        = hmp_info_jit_profile,
+    },
+#endif
+
+STEXI
+@item info jit-profile [@var{max}]
+@findex info jit-profile
+Show the translation blocks executed most often since @code{jit-profile on},
+with the host ticks spent in them and the guest symbol at their start.
 ETEXI
 
     {
@@ -335,6 +353,25 @@ When different objects that share the same call site are coalesced, the "Object"
 field shows---enclosed in brackets---the number of objects being coalesced.
 ETEXI
 
+    {
+        .name       = "mmio-hotspots",
+        .args_type  = "time:-t,max:i?",
+        .params     = "[-t] [max]",
+        .help       = "show the most accessed MMIO registers, up to max "
+                      "entries (default: 20), sorted by access count. "
+                      "(-t: sort by time spent in the device)",
+        .cmd        = hmp_info_mmio_hotspots,
+    },
+
+STEXI
+@item info mmio-hotspots [-t] [@var{max}]
+@findex info mmio-hotspots
+Show the memory region offsets accessed most often since @code{mmio-stats on},
+up to @var{max} entries (default: 20), with the number of reads and writes and
+the host time spent dispatching them.
+        -t: sort by time instead of access count
+ETEXI
+
     {
         .name       = "kvm",
         .args_type  = "",
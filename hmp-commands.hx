@@ -681,6 +681,44 @@ STEXI
 @findex sync-profile
 Enable, disable or reset synchronization profiling. With no arguments, prints
 whether profiling is on or off.
+ETEXI
+
+    {
+        .name       = "mmio-stats",
+        .args_type  = "op:s?",
+        .params     = "[on|off|reset]",
+        .help       = "enable, disable or reset MMIO access counting. "
+                      "With no arguments, prints whether counting is on or off.",
+        .cmd        = hmp_mmio_stats,
+    },
+
+STEXI
+@item mmio-stats [on|off|reset]
+@findex mmio-stats
+Enable, disable or reset the per-register MMIO access counters shown by
+@code{info mmio-hotspots}. With no arguments, prints whether counting is on
+or off.
+ETEXI
+
+#if defined(CONFIG_TCG)
+    {
+        .name       = "jit-profile",
+        .args_type  = "op:s?",
+        .params     = "[on|off|reset]",
+        .help       = "enable, disable or reset TB execution profiling. "
+                      "With no arguments, prints whether profiling is on or off.",
+        .cmd        = hmp_jit_profile,
+    },
+#endif
+
+STEXI
+@item jit-profile [on|off|reset]
+@findex jit-profile
+Enable, disable or reset TB execution profiling.  While it is on, TBs are
+not chained so that every execution is counted, and the host address of
+each new TB is written to @file{/tmp/perf-@var{pid}.map} for
+@command{perf report}.  With no arguments, prints whether profiling is on
+or off.
 ETEXI
 
     {
@@ -1403,7 +1441,7 @@ ETEXI
     {
         .name       = "netdev_add",
         .args_type  = "netdev:O",
-        .params     = "[user|tap|socket|vde|bridge|hubport|netmap|vhost-user],id=str[,prop=value][,...]",
+        .params     = "[user|tap|socket|vde|bridge|hubport|netmap|af-xdp|vhost-user],id=str[,prop=value][,...]",
         .help       = "add host network device",
         .cmd        = hmp_netdev_add,
         .command_completion = netdev_add_completion,
@@ -26,6 +26,7 @@
 #include "qemu/cutils.h"
 #include "qemu/error-report.h"
 #include "qemu/option.h"
+#include "qemu/filemonitor.h"
 #include <libgen.h>
 #include <linux/fs.h>
 #ifdef CONFIG_LINUX_MAGIC_H
@@ -46,10 +47,433 @@
 #define BTRFS_SUPER_MAGIC 0x9123683E
 #endif
 
+/*
+ * Attribute cache, enabled with attr_cache=on
+ *
+ * Every Tgetattr and every step of a Twalk ends in local_lstat(), which
+ * opens each directory on the path and calls fstatat().  The cache keeps
+ * the results by path, failures with ENOENT included.  Changes made by
+ * this export drop the entries they affect as soon as they are done.
+ * Changes made directly on the host are seen through inotify, which
+ * watches every directory holding cached entries; they reach the cache a
+ * bit later, as with cache=loose on the client side.
+ */
+#define LOCAL_CACHE_MAX_ENTRIES 16384
+#define LOCAL_CACHE_MAX_DIRS    1024
+
+typedef struct LocalCache LocalCache;
+
+typedef struct LocalCacheIno {
+    uint64_t dev;
+    uint64_t ino;
+} LocalCacheIno;
+
+typedef struct LocalCacheEntry {
+    char *path;
+    LocalCacheIno ino;
+    int err;                    /* errno of a failed lstat */
+    struct stat st;
+} LocalCacheEntry;
+
+typedef struct LocalCacheDir {
+    LocalCache *cache;
+    char *path;
+} LocalCacheDir;
+
+struct LocalCache {
+    /* Serializes use of @mon; taken before @lock and the monitor's lock */
+    QemuMutex watch_lock;
+    QFileMonitor *mon;
+
+    QemuMutex lock;
+    GHashTable *entries;        /* path -> LocalCacheEntry */
+    GHashTable *inodes;         /* LocalCacheIno -> GList of entries */
+    GHashTable *dirs;           /* path -> watched LocalCacheDir */
+    uint64_t gen;               /* bumped by every invalidation */
+    bool reset;                 /* watches are stale, start again */
+};
+
 typedef struct {
     int mountfd;
+    LocalCache *cache;
 } LocalData;
 
+static void local_cache_entry_free(gpointer p)
+{
+    LocalCacheEntry *e = p;
+
+    g_free(e->path);
+    g_free(e);
+}
+
+static void local_cache_dir_free(gpointer p)
+{
+    LocalCacheDir *dir = p;
+
+    g_free(dir->path);
+    g_free(dir);
+}
+
+static guint local_cache_ino_hash(gconstpointer p)
+{
+    const LocalCacheIno *k = p;
+
+    return g_int64_hash(&k->ino) ^ g_int64_hash(&k->dev);
+}
+
+static gboolean local_cache_ino_equal(gconstpointer a, gconstpointer b)
+{
+    const LocalCacheIno *ka = a, *kb = b;
+
+    return ka->ino == kb->ino && ka->dev == kb->dev;
+}
+
+/*
+ * Called with c->lock held.  Hard links give an inode several paths,
+ * hence a list of entries for each.
+ */
+static void local_cache_link_ino(LocalCache *c, LocalCacheEntry *e)
+{
+    gpointer key;
+    GList *l = NULL;
+
+    if (g_hash_table_lookup_extended(c->inodes, &e->ino, &key,
+                                     (gpointer *)&l)) {
+        g_hash_table_steal(c->inodes, key);
+    } else {
+        key = g_memdup(&e->ino, sizeof(e->ino));
+    }
+    g_hash_table_insert(c->inodes, key, g_list_prepend(l, e));
+}
+
+/* Called with c->lock held */
+static void local_cache_unlink_ino(LocalCache *c, LocalCacheEntry *e)
+{
+    gpointer key;
+    GList *l;
+
+    if (e->err ||
+        !g_hash_table_lookup_extended(c->inodes, &e->ino, &key,
+                                      (gpointer *)&l)) {
+        return;
+    }
+    g_hash_table_steal(c->inodes, key);
+    l = g_list_remove(l, e);
+    if (l) {
+        g_hash_table_insert(c->inodes, key, l);
+    } else {
+        g_free(key);
+    }
+}
+
+/* Called with c->lock held */
+static void local_cache_remove(LocalCache *c, const char *path)
+{
+    LocalCacheEntry *e = g_hash_table_lookup(c->entries, path);
+
+    if (!e) {
+        return;
+    }
+    local_cache_unlink_ino(c, e);
+    g_hash_table_remove(c->entries, path);
+}
+
+/* Called with c->lock held */
+static void local_cache_remove_all(LocalCache *c)
+{
+    g_hash_table_remove_all(c->inodes);
+    g_hash_table_remove_all(c->entries);
+    c->gen++;
+}
+
+/* Called with c->lock held.  @subtree also drops what is below @path. */
+static void local_cache_invalidate(LocalCache *c, const char *path,
+                                   bool subtree)
+{
+    c->gen++;
+    local_cache_remove(c, path);
+    if (subtree && g_hash_table_size(c->entries)) {
+        GHashTableIter iter;
+        LocalCacheEntry *e;
+        size_t len = strlen(path);
+
+        g_hash_table_iter_init(&iter, c->entries);
+        while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&e)) {
+            if (!strncmp(e->path, path, len) && e->path[len] == '/') {
+                local_cache_unlink_ino(c, e);
+                g_hash_table_iter_remove(&iter);
+            }
+        }
+    }
+}
+
+/* Called with c->lock held.  Drops every path of the inode @ino. */
+static void local_cache_invalidate_ino(LocalCache *c, const LocalCacheIno *ino)
+{
+    GList *l;
+
+    while ((l = g_hash_table_lookup(c->inodes, ino))) {
+        LocalCacheEntry *e = l->data;
+
+        local_cache_invalidate(c, e->path, false);
+    }
+}
+
+/* Runs in the main loop with the monitor's lock held */
+static void local_cache_event(int64_t id, QFileMonitorEvent event,
+                              const char *filename, void *opaque)
+{
+    LocalCacheDir *dir = opaque;
+    LocalCache *c = dir->cache;
+    char *path;
+
+    qemu_mutex_lock(&c->lock);
+    if (event == QFILE_MONITOR_EVENT_IGNORED) {
+        /* the directory is gone, and the watch with it */
+        c->reset = true;
+    } else if (*filename) {
+        LocalCacheEntry *e;
+        bool entries_changed = event == QFILE_MONITOR_EVENT_CREATED ||
+                               event == QFILE_MONITOR_EVENT_DELETED;
+
+        path = g_strdup_printf("%s/%s", dir->path, filename);
+        if (entries_changed && g_hash_table_contains(c->dirs, path)) {
+            /*
+             * A watched directory was moved or removed: inotify follows
+             * the directory, not its path, so the watches can no longer
+             * be trusted
+             */
+            c->reset = true;
+        } else {
+            /* the other links to the same file changed as well */
+            e = g_hash_table_lookup(c->entries, path);
+            if (e && !e->err) {
+                LocalCacheIno ino = e->ino;
+
+                local_cache_invalidate_ino(c, &ino);
+            }
+            local_cache_invalidate(c, path, true);
+            if (entries_changed) {
+                /* so did the size, times and link count of the directory */
+                local_cache_invalidate(c, dir->path, false);
+            }
+        }
+        g_free(path);
+    }
+    if (c->reset) {
+        local_cache_remove_all(c);
+    }
+    qemu_mutex_unlock(&c->lock);
+}
+
+/* Called with c->watch_lock held */
+static void local_cache_reset(LocalCache *c)
+{
+    /* no more calls to local_cache_event() once this returns */
+    qemu_file_monitor_free(c->mon);
+
+    qemu_mutex_lock(&c->lock);
+    g_hash_table_remove_all(c->dirs);
+    local_cache_remove_all(c);
+    c->reset = false;
+    qemu_mutex_unlock(&c->lock);
+
+    c->mon = qemu_file_monitor_new(NULL);
+}
+
+/* Make sure that changes in @dirpath reach the cache, if it is possible */
+static bool local_cache_watch(FsContext *ctx, LocalCache *c,
+                              const char *dirpath)
+{
+    LocalCacheDir *dir;
+    char *abspath;
+    int64_t id;
+    bool ok, full;
+
+    qemu_mutex_lock(&c->lock);
+    ok = !c->reset && g_hash_table_contains(c->dirs, dirpath);
+    qemu_mutex_unlock(&c->lock);
+    if (ok) {
+        return true;
+    }
+
+    qemu_mutex_lock(&c->watch_lock);
+    if (c->reset) {
+        local_cache_reset(c);
+    }
+    if (!c->mon) {
+        goto out;
+    }
+
+    qemu_mutex_lock(&c->lock);
+    ok = g_hash_table_contains(c->dirs, dirpath);
+    full = g_hash_table_size(c->dirs) >= LOCAL_CACHE_MAX_DIRS;
+    qemu_mutex_unlock(&c->lock);
+    if (ok || full) {
+        goto out;
+    }
+
+    dir = g_new0(LocalCacheDir, 1);
+    dir->cache = c;
+    dir->path = g_strdup(dirpath);
+    abspath = g_strdup_printf("%s/%s", ctx->fs_root, dirpath);
+    id = qemu_file_monitor_add_watch(c->mon, abspath, NULL,
+                                     local_cache_event, dir, NULL);
+    g_free(abspath);
+    if (id < 0) {
+        local_cache_dir_free(dir);
+        goto out;
+    }
+
+    qemu_mutex_lock(&c->lock);
+    g_hash_table_insert(c->dirs, dir->path, dir);
+    qemu_mutex_unlock(&c->lock);
+    ok = true;
+
+out:
+    qemu_mutex_unlock(&c->watch_lock);
+    return ok;
+}
+
+/*
+ * Look @path up.  Returns true if it is cached, with the result of lstat
+ * in @err and @stbuf.  Otherwise, *@gen is to be passed to
+ * local_cache_add() with the result.
+ */
+static bool local_cache_lookup(LocalCache *c, const char *path,
+                               struct stat *stbuf, int *err, uint64_t *gen)
+{
+    LocalCacheEntry *e;
+
+    qemu_mutex_lock(&c->lock);
+    e = g_hash_table_lookup(c->entries, path);
+    if (e) {
+        *err = e->err;
+        *stbuf = e->st;
+    }
+    *gen = c->gen;
+    qemu_mutex_unlock(&c->lock);
+    return e != NULL;
+}
+
+static void local_cache_add(LocalCache *c, const char *path, int err,
+                            const struct stat *stbuf, uint64_t gen)
+{
+    LocalCacheEntry *e;
+
+    qemu_mutex_lock(&c->lock);
+    /* an invalidation may have raced with the lstat */
+    if (gen != c->gen || c->reset) {
+        goto out;
+    }
+    if (g_hash_table_size(c->entries) >= LOCAL_CACHE_MAX_ENTRIES) {
+        local_cache_remove_all(c);
+    }
+    local_cache_remove(c, path);
+
+    e = g_new0(LocalCacheEntry, 1);
+    e->path = g_strdup(path);
+    e->err = err;
+    if (!err) {
+        e->st = *stbuf;
+        e->ino.dev = stbuf->st_dev;
+        e->ino.ino = stbuf->st_ino;
+        local_cache_link_ino(c, e);
+    }
+    g_hash_table_insert(c->entries, e->path, e);
+out:
+    qemu_mutex_unlock(&c->lock);
+}
+
+/* Drop @path after this export changed it */
+static void local_cache_drop(FsContext *ctx, const char *path, bool subtree)
+{
+    LocalData *data = ctx->private;
+    int saved_errno = errno;
+
+    if (data->cache) {
+        qemu_mutex_lock(&data->cache->lock);
+        local_cache_invalidate(data->cache, path, subtree);
+        qemu_mutex_unlock(&data->cache->lock);
+    }
+    errno = saved_errno;
+}
+
+/* Same for @name in @dirpath, which also changes @dirpath itself */
+static void local_cache_drop_at(FsContext *ctx, const char *dirpath,
+                                const char *name, bool subtree)
+{
+    LocalData *data = ctx->private;
+    char *path;
+
+    if (data->cache) {
+        path = g_strdup_printf("%s/%s", dirpath, name);
+        local_cache_drop(ctx, path, subtree);
+        local_cache_drop(ctx, dirpath, false);
+        g_free(path);
+    }
+}
+
+/*
+ * Same for the file open as @fd, by inode since its path is not known;
+ * this drops all of its links
+ */
+static void local_cache_drop_fd(FsContext *ctx, int fd)
+{
+    LocalData *data = ctx->private;
+    LocalCache *c = data->cache;
+    int saved_errno = errno;
+    LocalCacheIno ino;
+    struct stat st;
+
+    if (!c || fstat(fd, &st) < 0) {
+        errno = saved_errno;
+        return;
+    }
+    ino.dev = st.st_dev;
+    ino.ino = st.st_ino;
+    qemu_mutex_lock(&c->lock);
+    local_cache_invalidate_ino(c, &ino);
+    qemu_mutex_unlock(&c->lock);
+    errno = saved_errno;
+}
+
+static LocalCache *local_cache_new(Error **errp)
+{
+    LocalCache *c;
+    QFileMonitor *mon = qemu_file_monitor_new(errp);
+
+    if (!mon) {
+        return NULL;
+    }
+    c = g_new0(LocalCache, 1);
+    c->mon = mon;
+    qemu_mutex_init(&c->watch_lock);
+    qemu_mutex_init(&c->lock);
+    c->entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                       local_cache_entry_free);
+    c->inodes = g_hash_table_new_full(local_cache_ino_hash,
+                                      local_cache_ino_equal, g_free,
+                                      (GDestroyNotify)g_list_free);
+    c->dirs = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
+                                    local_cache_dir_free);
+    return c;
+}
+
+static void local_cache_free(LocalCache *c)
+{
+    if (!c) {
+        return;
+    }
+    qemu_file_monitor_free(c->mon);
+    g_hash_table_destroy(c->dirs);
+    g_hash_table_destroy(c->inodes);
+    g_hash_table_destroy(c->entries);
+    qemu_mutex_destroy(&c->lock);
+    qemu_mutex_destroy(&c->watch_lock);
+    g_free(c);
+}
+
 int local_open_nofollow(FsContext *fs_ctx, const char *path, int flags,
                         mode_t mode)
 {
@@ -177,10 +601,28 @@ static void local_mapped_file_attr(int dirfd, const char *name,
 
 static int local_lstat(FsContext *fs_ctx, V9fsPath *fs_path, struct stat *stbuf)
 {
+    LocalData *data = fs_ctx->private;
     int err = -1;
-    char *dirpath = g_path_get_dirname(fs_path->data);
-    char *name = g_path_get_basename(fs_path->data);
+    char *dirpath;
+    char *name;
     int dirfd;
+    int cached_err;
+    uint64_t gen;
+    bool cache = false;
+
+    if (data->cache && strcmp(fs_path->data, ".")) {
+        if (local_cache_lookup(data->cache, fs_path->data, stbuf,
+                               &cached_err, &gen)) {
+            errno = cached_err;
+            return cached_err ? -1 : 0;
+        }
+        cache = true;
+    }
+
+    dirpath = g_path_get_dirname(fs_path->data);
+    name = g_path_get_basename(fs_path->data);
+    /* watch first, so that no change goes unnoticed */
+    cache = cache && local_cache_watch(fs_ctx, data->cache, dirpath);
 
     dirfd = local_opendir_nofollow(fs_ctx, dirpath);
     if (dirfd == -1) {
@@ -221,6 +663,13 @@ static int local_lstat(FsContext *fs_ctx, V9fsPath *fs_path, struct stat *stbuf)
 err_out:
     close_preserve_errno(dirfd);
 out:
+    if (cache && (!err || errno == ENOENT)) {
+        int saved_errno = errno;
+
+        local_cache_add(data->cache, fs_path->data, err ? errno : 0,
+                        stbuf, gen);
+        errno = saved_errno;
+    }
     g_free(name);
     g_free(dirpath);
     return err;
@@ -506,6 +955,9 @@ static int local_open(FsContext *ctx, V9fsPath *fs_path,
     if (fd == -1) {
         return -1;
     }
+    if (flags & O_TRUNC) {
+        local_cache_drop(ctx, fs_path->data, false);
+    }
     fs->fd = fd;
     return fs->fd;
 }
@@ -616,6 +1068,9 @@ static ssize_t local_pwritev(FsContext *ctx, V9fsFidOpenState *fs,
                         SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE);
     }
 #endif
+    if (ret > 0) {
+        local_cache_drop_fd(ctx, fs->fd);
+    }
     return ret;
 }
 
@@ -640,6 +1095,7 @@ static int local_chmod(FsContext *fs_ctx, V9fsPath *fs_path, FsCred *credp)
         ret = fchmodat_nofollow(dirfd, name, credp->fc_mode);
     }
     close_preserve_errno(dirfd);
+    local_cache_drop(fs_ctx, fs_path->data, false);
 
 out:
     g_free(dirpath);
@@ -695,6 +1151,7 @@ static int local_mknod(FsContext *fs_ctx, V9fsPath *dir_path,
 err_end:
     unlinkat_preserve_errno(dirfd, name, 0);
 out:
+    local_cache_drop_at(fs_ctx, dir_path->data, name, false);
     close_preserve_errno(dirfd);
     return err;
 }
@@ -748,6 +1205,7 @@ static int local_mkdir(FsContext *fs_ctx, V9fsPath *dir_path,
 err_end:
     unlinkat_preserve_errno(dirfd, name, AT_REMOVEDIR);
 out:
+    local_cache_drop_at(fs_ctx, dir_path->data, name, false);
     close_preserve_errno(dirfd);
     return err;
 }
@@ -853,6 +1311,7 @@ err_end:
                             flags & O_DIRECTORY ? AT_REMOVEDIR : 0);
     close_preserve_errno(fd);
 out:
+    local_cache_drop_at(fs_ctx, dir_path->data, name, false);
     close_preserve_errno(dirfd);
     return err;
 }
@@ -932,6 +1391,7 @@ static int local_symlink(FsContext *fs_ctx, const char *oldpath,
 err_end:
     unlinkat_preserve_errno(dirfd, name, 0);
 out:
+    local_cache_drop_at(fs_ctx, dir_path->data, name, false);
     close_preserve_errno(dirfd);
     return err;
 }
@@ -1002,6 +1462,8 @@ err:
 err_undo_link:
     unlinkat_preserve_errno(ndirfd, name, 0);
 out_close:
+    local_cache_drop_at(ctx, dirpath->data, name, false);
+    local_cache_drop(ctx, oldpath->data, false);    /* st_nlink */
     close_preserve_errno(ndirfd);
     close_preserve_errno(odirfd);
 out:
@@ -1020,6 +1482,7 @@ static int local_truncate(FsContext *ctx, V9fsPath *fs_path, off_t size)
     }
     ret = ftruncate(fd, size);
     close_preserve_errno(fd);
+    local_cache_drop(ctx, fs_path->data, false);
     return ret;
 }
 
@@ -1047,6 +1510,7 @@ static int local_chown(FsContext *fs_ctx, V9fsPath *fs_path, FsCred *credp)
     }
 
     close_preserve_errno(dirfd);
+    local_cache_drop(fs_ctx, fs_path->data, false);
 out:
     g_free(name);
     g_free(dirpath);
@@ -1067,6 +1531,7 @@ static int local_utimensat(FsContext *s, V9fsPath *fs_path,
 
     ret = utimensat(dirfd, name, buf, AT_SYMLINK_NOFOLLOW);
     close_preserve_errno(dirfd);
+    local_cache_drop(s, fs_path->data, false);
 out:
     g_free(dirpath);
     g_free(name);
@@ -1142,6 +1607,7 @@ static int local_remove(FsContext *ctx, const char *path)
     }
 
     err = local_unlinkat_common(ctx, dirfd, name, flags);
+    local_cache_drop_at(ctx, dirpath, name, true);
 err_out:
     close_preserve_errno(dirfd);
 out:
@@ -1201,16 +1667,22 @@ static int local_lsetxattr(FsContext *ctx, V9fsPath *fs_path, const char *name,
                            void *value, size_t size, int flags)
 {
     char *path = fs_path->data;
+    int ret;
 
-    return v9fs_set_xattr(ctx, path, name, value, size, flags);
+    ret = v9fs_set_xattr(ctx, path, name, value, size, flags);
+    local_cache_drop(ctx, path, false);
+    return ret;
 }
 
 static int local_lremovexattr(FsContext *ctx, V9fsPath *fs_path,
                               const char *name)
 {
     char *path = fs_path->data;
+    int ret;
 
-    return v9fs_remove_xattr(ctx, path, name);
+    ret = v9fs_remove_xattr(ctx, path, name);
+    local_cache_drop(ctx, path, false);
+    return ret;
 }
 
 static int local_name_to_path(FsContext *ctx, V9fsPath *dir_path,
@@ -1319,6 +1791,8 @@ err:
 err_undo_rename:
     renameat_preserve_errno(ndirfd, new_name, odirfd, old_name);
 out:
+    local_cache_drop_at(ctx, olddir->data, old_name, true);
+    local_cache_drop_at(ctx, newdir->data, new_name, true);
     close_preserve_errno(ndirfd);
     close_preserve_errno(odirfd);
     return ret;
@@ -1369,6 +1843,7 @@ static int local_unlinkat(FsContext *ctx, V9fsPath *dir,
     }
 
     ret = local_unlinkat_common(ctx, dirfd, name, flags);
+    local_cache_drop_at(ctx, dir->data, name, true);
     close_preserve_errno(dirfd);
     return ret;
 }
@@ -1425,7 +1900,7 @@ static int local_ioc_getversion_init(FsContext *ctx, LocalData *data, Error **er
 
 static int local_init(FsContext *ctx, Error **errp)
 {
-    LocalData *data = g_malloc(sizeof(*data));
+    LocalData *data = g_new0(LocalData, 1);
 
     data->mountfd = open(ctx->fs_root, O_DIRECTORY | O_RDONLY);
     if (data->mountfd == -1) {
@@ -1438,6 +1913,15 @@ static int local_init(FsContext *ctx, Error **errp)
         goto err;
     }
 
+    if (ctx->export_flags & V9FS_ATTR_CACHE) {
+        data->cache = local_cache_new(errp);
+        if (!data->cache) {
+            error_prepend(errp, "attr_cache=on: ");
+            close(data->mountfd);
+            goto err;
+        }
+    }
+
     if (ctx->export_flags & V9FS_SM_PASSTHROUGH) {
         ctx->xops = passthrough_xattr_ops;
     } else if (ctx->export_flags & V9FS_SM_MAPPED) {
@@ -1465,6 +1949,7 @@ static void local_cleanup(FsContext *ctx)
 {
     LocalData *data = ctx->private;
 
+    local_cache_free(data->cache);
     close(data->mountfd);
     g_free(data);
 }
@@ -1531,6 +2016,10 @@ static int local_parse_opts(QemuOpts *opts, FsDriverEntry *fse, Error **errp)
         }
     }
 
+    if (qemu_opt_get_bool(opts, "attr_cache", false)) {
+        fse->export_flags |= V9FS_ATTR_CACHE;
+    }
+
     fse->path = g_strdup(path);
 
     return 0;
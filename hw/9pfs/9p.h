@@ -198,6 +198,12 @@ static inline void v9fs_readdir_unlock(V9fsDir *dir)
     qemu_mutex_unlock(&dir->readdir_mutex);
 }
 
+/* Directory entries read in one go by v9fs_co_readdir_many() */
+typedef struct V9fsDirEnt {
+    struct dirent *dent;
+    struct V9fsDirEnt *next;
+} V9fsDirEnt;
+
 static inline void v9fs_readdir_init(V9fsDir *dir)
 {
     qemu_mutex_init(&dir->readdir_mutex);
@@ -348,6 +354,8 @@ void v9fs_path_init(V9fsPath *path);
 void v9fs_path_free(V9fsPath *path);
 void v9fs_path_sprintf(V9fsPath *path, const char *fmt, ...);
 void v9fs_path_copy(V9fsPath *dst, const V9fsPath *src);
+size_t v9fs_readdir_response_size(V9fsString *name);
+void v9fs_free_dirents(V9fsDirEnt *e);
 int v9fs_name_to_path(V9fsState *s, V9fsPath *dirpath,
                       const char *name, V9fsPath *path);
 int v9fs_device_realize_common(V9fsState *s, const V9fsTransport *t,
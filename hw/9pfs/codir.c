@@ -43,6 +43,90 @@ int coroutine_fn v9fs_co_readdir(V9fsPDU *pdu, V9fsFidState *fidp,
     return err;
 }
 
+/* Runs in the worker thread */
+static int do_readdir_many(V9fsPDU *pdu, V9fsFidState *fidp,
+                           V9fsDirEnt **entries, off_t offset,
+                           int32_t maxsize)
+{
+    V9fsState *s = pdu->s;
+    V9fsDirEnt *e, **tail = entries;
+    struct dirent *dent;
+    V9fsString name;
+    off_t saved_dir_pos;
+    int32_t size = 0, len;
+    int err = 0;
+
+    *entries = NULL;
+    v9fs_readdir_lock(&fidp->fs.dir);
+
+    if (offset == 0) {
+        s->ops->rewinddir(&s->ctx, &fidp->fs);
+    } else {
+        s->ops->seekdir(&s->ctx, &fidp->fs, offset);
+    }
+    saved_dir_pos = s->ops->telldir(&s->ctx, &fidp->fs);
+    if (saved_dir_pos < 0) {
+        err = -errno;
+        goto out;
+    }
+
+    while (!v9fs_request_cancelled(pdu)) {
+        errno = 0;
+        dent = s->ops->readdir(&s->ctx, &fidp->fs);
+        if (!dent) {
+            err = -errno;
+            break;
+        }
+        name.data = dent->d_name;
+        name.size = strlen(dent->d_name);
+        len = v9fs_readdir_response_size(&name);
+        if (size + len > maxsize) {
+            /* Ran out of buffer, leave this one for the next request */
+            s->ops->seekdir(&s->ctx, &fidp->fs, saved_dir_pos);
+            break;
+        }
+        e = g_new0(V9fsDirEnt, 1);
+        e->dent = g_memdup(dent, sizeof(*dent));
+        *tail = e;
+        tail = &e->next;
+        size += len;
+        saved_dir_pos = dent->d_off;
+    }
+
+out:
+    v9fs_readdir_unlock(&fidp->fs.dir);
+    if (err < 0) {
+        v9fs_free_dirents(*entries);
+        *entries = NULL;
+        return err;
+    }
+    return size;
+}
+
+/*
+ * Seek to @offset (0 means rewind) and read as many entries as fit in
+ * @maxsize bytes of a readdir response, all with a single round trip to
+ * the worker thread instead of one per entry.  The entries are returned
+ * in @entries and must be freed with v9fs_free_dirents().
+ *
+ * Returns the size the entries take in the response, or a negative errno.
+ */
+int coroutine_fn v9fs_co_readdir_many(V9fsPDU *pdu, V9fsFidState *fidp,
+                                      V9fsDirEnt **entries, off_t offset,
+                                      int32_t maxsize)
+{
+    int err;
+
+    if (v9fs_request_cancelled(pdu)) {
+        return -EINTR;
+    }
+    v9fs_co_run_in_worker(
+        {
+            err = do_readdir_many(pdu, fidp, entries, offset, maxsize);
+        });
+    return err;
+}
+
 off_t v9fs_co_telldir(V9fsPDU *pdu, V9fsFidState *fidp)
 {
     off_t err;
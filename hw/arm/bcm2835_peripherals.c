@@ -11,17 +11,59 @@
 #include "qemu/osdep.h"
 #include "qapi/error.h"
 #include "qemu/module.h"
+#include "qemu/units.h"
 #include "hw/arm/bcm2835_peripherals.h"
 #include "hw/misc/bcm2835_mbox_defs.h"
 #include "hw/arm/raspi_platform.h"
+#include "hw/qdev-properties.h"
 #include "sysemu/sysemu.h"
+#include "migration/vmstate.h"
+#include "qemu/memfd.h"
 
 /* Peripheral base address on the VC (GPU) system bus */
 #define BCM2835_VC_PERI_BASE 0x7e000000
 
+/*
+ * The VideoCore addresses only the first GiB of RAM, so its carve-out
+ * sits at the top of that even on boards with more.
+ */
+#define BCM2835_VC_RAM_LIMIT (1 * GiB)
+
+/* Peripheral base address as seen by the BCM2711 DMA4 (40-bit) engines */
+#define BCM2838_DMA4_PERI_BASE 0x47e000000ULL
+
 /* Capabilities for SD controller: no DMA, high-speed, default clocks etc. */
 #define BCM2835_SDHC_CAPAREG 0x52134b4
 
+/*
+ * Capabilities for the BCM2711 EMMC2 controller: SDMA and 64-bit ADMA2,
+ * high-speed, 3.3V and 1.8V signalling, SDR50/SDR104/DDR50, 100MHz base clock
+ */
+#define BCM2838_EMMC2_CAPAREG 0x7156864b2ULL
+
+/* SPI masters other than the two in the aux block */
+static const struct {
+    int n;
+    hwaddr offset;
+} bcm2835_spi_masters[] = {
+    { 0, SPI0_OFFSET }, { 3, SPI3_OFFSET }, { 4, SPI4_OFFSET },
+    { 5, SPI5_OFFSET }, { 6, SPI6_OFFSET },
+};
+
+static const hwaddr bcm2835_bsc_offsets[] = {
+    BSC0_OFFSET, BSC1_OFFSET, BSC2_OFFSET, BSC3_OFFSET,
+    BSC4_OFFSET, BSC5_OFFSET, BSC6_OFFSET,
+};
+
+/* PERMAP numbers of the SPI0 DMA requests */
+#define BCM2835_DREQ_SPI0_TX 6
+#define BCM2835_DREQ_SPI0_RX 7
+/* and of the PCM/I2S ones */
+#define BCM2835_DREQ_PCM_TX 2
+#define BCM2835_DREQ_PCM_RX 3
+/* and of SDHOST, for both directions */
+#define BCM2835_DREQ_SDHOST 13
+
 static void create_unimp(BCM2835PeripheralState *ps,
                          UnimplementedDeviceState *uds,
                          const char *name, hwaddr ofs, hwaddr size)
@@ -39,6 +81,7 @@ static void create_unimp(BCM2835PeripheralState *ps,
 static void bcm2835_peripherals_init(Object *obj)
 {
     BCM2835PeripheralState *s = BCM2835_PERIPHERALS(obj);
+    int n;
 
     /* Memory region for peripheral devices, which we export to our parent */
     memory_region_init(&s->peri_mr, obj,"bcm2835-peripherals", 0x1000000);
@@ -58,6 +101,10 @@ static void bcm2835_peripherals_init(Object *obj)
     /* Interrupt Controller */
     sysbus_init_child_obj(obj, "ic", &s->ic, sizeof(s->ic), TYPE_BCM2835_IC);
 
+    /* SYS Timer */
+    sysbus_init_child_obj(obj, "systimer", &s->systmr, sizeof(s->systmr),
+                          TYPE_BCM2835_SYSTIMER);
+
     /* UART0 */
     sysbus_init_child_obj(obj, "uart0", &s->uart0, sizeof(s->uart0),
                           TYPE_PL011);
@@ -81,6 +128,31 @@ static void bcm2835_peripherals_init(Object *obj)
     object_property_add_const_link(OBJECT(&s->fb), "dma-mr",
                                    OBJECT(&s->gpu_bus_mr), &error_abort);
 
+    /* Hardware Video Scaler */
+    sysbus_init_child_obj(obj, "hvs", &s->hvs, sizeof(s->hvs),
+                          TYPE_BCM2835_HVS);
+    object_property_add_alias(obj, "hvs5", OBJECT(&s->hvs), "hvs5",
+                              &error_abort);
+
+    object_property_add_const_link(OBJECT(&s->hvs), "dma-mr",
+                                   OBJECT(&s->gpu_bus_mr), &error_abort);
+
+    /* Power management, reset and watchdog */
+    sysbus_init_child_obj(obj, "pm", &s->pm, sizeof(s->pm),
+                          TYPE_BCM2835_POWERMGT);
+
+    /* Clock manager and PLLs */
+    sysbus_init_child_obj(obj, "cprman", &s->cprman, sizeof(s->cprman),
+                          TYPE_BCM2835_CPRMAN);
+    object_property_add_alias(obj, "xosc-freq", OBJECT(&s->cprman),
+                              "xosc-freq", &error_abort);
+    object_property_add_alias(obj, "arm-freq", OBJECT(&s->cprman),
+                              "arm-freq", &error_abort);
+
+    /* Temperature sensor */
+    sysbus_init_child_obj(obj, "thermal", &s->thermal, sizeof(s->thermal),
+                          TYPE_BCM2835_THERMAL);
+
     /* Property channel */
     sysbus_init_child_obj(obj, "property", &s->property, sizeof(s->property),
                           TYPE_BCM2835_PROPERTY);
@@ -91,6 +163,16 @@ static void bcm2835_peripherals_init(Object *obj)
                                    OBJECT(&s->fb), &error_abort);
     object_property_add_const_link(OBJECT(&s->property), "dma-mr",
                                    OBJECT(&s->gpu_bus_mr), &error_abort);
+    object_property_add_const_link(OBJECT(&s->property), "cprman",
+                                   OBJECT(&s->cprman), &error_abort);
+    object_property_add_const_link(OBJECT(&s->property), "thermal",
+                                   OBJECT(&s->thermal), &error_abort);
+
+    /* PCM/I2S */
+    sysbus_init_child_obj(obj, "i2s", &s->i2s, sizeof(s->i2s),
+                          TYPE_BCM2835_I2S);
+    object_property_add_const_link(OBJECT(&s->i2s), "cprman",
+                                   OBJECT(&s->cprman), &error_abort);
 
     /* Random Number Generator */
     sysbus_init_child_obj(obj, "rng", &s->rng, sizeof(s->rng),
@@ -100,6 +182,10 @@ static void bcm2835_peripherals_init(Object *obj)
     sysbus_init_child_obj(obj, "sdhci", &s->sdhci, sizeof(s->sdhci),
                           TYPE_SYSBUS_SDHCI);
 
+    /* bcm2838 EMMC2 controller (only realized when enabled) */
+    sysbus_init_child_obj(obj, "emmc2", &s->emmc2, sizeof(s->emmc2),
+                          TYPE_SYSBUS_SDHCI);
+
     /* SDHOST */
     sysbus_init_child_obj(obj, "sdhost", &s->sdhost, sizeof(s->sdhost),
                           TYPE_BCM2835_SDHOST);
@@ -111,23 +197,104 @@ static void bcm2835_peripherals_init(Object *obj)
     object_property_add_const_link(OBJECT(&s->dma), "dma-mr",
                                    OBJECT(&s->gpu_bus_mr), &error_abort);
 
+    /* Internal memory region for the 40-bit DMA4 bus (not exported) */
+    memory_region_init(&s->dma4_bus_mr, obj, "bcm2838-dma4-bus",
+                       (uint64_t)1 << 40);
+    object_property_add_child(obj, "dma4-bus", OBJECT(&s->dma4_bus_mr), NULL);
+
+    object_property_add_const_link(OBJECT(&s->dma), "dma4-mr",
+                                   OBJECT(&s->dma4_bus_mr), &error_abort);
+    object_property_add_alias(obj, "dma4-chans", OBJECT(&s->dma), "dma4-chans",
+                              &error_abort);
+
     /* GPIO */
     sysbus_init_child_obj(obj, "gpio", &s->gpio, sizeof(s->gpio),
                           TYPE_BCM2835_GPIO);
 
+    /* SPI masters; the shared interrupt line is ORed together */
+    for (n = 0; n < ARRAY_SIZE(bcm2835_spi_masters); n++) {
+        int i = bcm2835_spi_masters[n].n;
+        char *name = g_strdup_printf("spi[%d]", i);
+
+        sysbus_init_child_obj(obj, name, &s->spi[i], sizeof(s->spi[i]),
+                              TYPE_BCM2835_SPI);
+        g_free(name);
+    }
+    object_initialize_child(obj, "spi-irq-orgate", &s->spi_irq_orgate,
+                            sizeof(s->spi_irq_orgate), TYPE_OR_IRQ,
+                            &error_abort, NULL);
+
+    /* BSC I2C masters, likewise sharing one interrupt */
+    for (n = 0; n < ARRAY_SIZE(s->i2c); n++) {
+        char *name = g_strdup_printf("i2c[%d]", n);
+
+        sysbus_init_child_obj(obj, name, &s->i2c[n], sizeof(s->i2c[n]),
+                              TYPE_BCM2835_I2C);
+        g_free(name);
+    }
+    object_initialize_child(obj, "i2c-irq-orgate", &s->i2c_irq_orgate,
+                            sizeof(s->i2c_irq_orgate), TYPE_OR_IRQ,
+                            &error_abort, NULL);
+
+    /* USB OTG */
+    sysbus_init_child_obj(obj, "dwc2", &s->dwc2, sizeof(s->dwc2),
+                          TYPE_DWC2_USB);
+
+    object_property_add_const_link(OBJECT(&s->dwc2), "dma-mr",
+                                   OBJECT(&s->gpu_bus_mr), &error_abort);
+
+    /* bcm2838 xHCI (only realized when enabled) */
+    sysbus_init_child_obj(obj, "xhci", &s->xhci, sizeof(s->xhci),
+                          TYPE_XHCI_SYSBUS);
+
     object_property_add_const_link(OBJECT(&s->gpio), "sdbus-sdhci",
                                    OBJECT(&s->sdhci.sdbus), &error_abort);
     object_property_add_const_link(OBJECT(&s->gpio), "sdbus-sdhost",
                                    OBJECT(&s->sdhost.sdbus), &error_abort);
 }
 
+/*
+ * Back the VideoCore carve-out at the top of RAM with a sealed memfd, so
+ * that the framebuffer pixels can be handed to display consumers outside
+ * of QEMU by file descriptor rather than copied.
+ */
+static void bcm2835_peripherals_init_vcram(BCM2835PeripheralState *s,
+                                           MemoryRegion *ram, hwaddr base,
+                                           uint64_t size, Error **errp)
+{
+#ifdef CONFIG_POSIX
+    Error *err = NULL;
+    int fd;
+
+    fd = qemu_memfd_create("bcm2835-vcram", size, false, 0,
+                           F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL, errp);
+    if (fd < 0) {
+        return;
+    }
+
+    memory_region_init_ram_from_fd(&s->vcram_mr, OBJECT(s), "bcm2835-vcram",
+                                   size, true, fd, &err);
+    if (err) {
+        close(fd);
+        error_propagate(errp, err);
+        return;
+    }
+    vmstate_register_ram(&s->vcram_mr, DEVICE(s));
+
+    memory_region_add_subregion_overlap(ram, base, &s->vcram_mr, 1);
+#else
+    error_setg(errp, "%s: vcram-memfd is not supported on this host",
+               __func__);
+#endif
+}
+
 static void bcm2835_peripherals_realize(DeviceState *dev, Error **errp)
 {
     BCM2835PeripheralState *s = BCM2835_PERIPHERALS(dev);
     Object *obj;
     MemoryRegion *ram;
     Error *err = NULL;
-    uint64_t ram_size, vcram_size;
+    uint64_t ram_size, vc_ram_size, vcram_size;
     int n;
 
     obj = object_property_get_link(OBJECT(dev), "ram", &err);
@@ -139,6 +306,7 @@ static void bcm2835_peripherals_realize(DeviceState *dev, Error **errp)
 
     ram = MEMORY_REGION(obj);
     ram_size = memory_region_size(ram);
+    vc_ram_size = MIN(ram_size, BCM2835_VC_RAM_LIMIT);
 
     /* Map peripherals and RAM into the GPU address space. */
     memory_region_init_alias(&s->peri_mr_alias, OBJECT(s),
@@ -151,11 +319,22 @@ static void bcm2835_peripherals_realize(DeviceState *dev, Error **errp)
     /* RAM is aliased four times (different cache configurations) on the GPU */
     for (n = 0; n < 4; n++) {
         memory_region_init_alias(&s->ram_alias[n], OBJECT(s),
-                                 "bcm2835-gpu-ram-alias[*]", ram, 0, ram_size);
+                                 "bcm2835-gpu-ram-alias[*]", ram, 0,
+                                 vc_ram_size);
         memory_region_add_subregion_overlap(&s->gpu_bus_mr, (hwaddr)n << 30,
                                             &s->ram_alias[n], 0);
     }
 
+    /* The DMA4 engines see all of RAM, and the peripherals up high */
+    memory_region_init_alias(&s->dma4_ram_alias, OBJECT(s),
+                             "bcm2838-dma4-ram-alias", ram, 0, ram_size);
+    memory_region_add_subregion(&s->dma4_bus_mr, 0, &s->dma4_ram_alias);
+    memory_region_init_alias(&s->dma4_peri_alias, OBJECT(s),
+                             "bcm2838-dma4-peripherals", &s->peri_mr, 0,
+                             memory_region_size(&s->peri_mr));
+    memory_region_add_subregion(&s->dma4_bus_mr, BCM2838_DMA4_PERI_BASE,
+                                &s->dma4_peri_alias);
+
     /* Interrupt Controller */
     object_property_set_bool(OBJECT(&s->ic), true, "realized", &err);
     if (err) {
@@ -167,6 +346,21 @@ static void bcm2835_peripherals_realize(DeviceState *dev, Error **errp)
                 sysbus_mmio_get_region(SYS_BUS_DEVICE(&s->ic), 0));
     sysbus_pass_irq(SYS_BUS_DEVICE(s), SYS_BUS_DEVICE(&s->ic));
 
+    /* SYS Timer */
+    object_property_set_bool(OBJECT(&s->systmr), true, "realized", &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+
+    memory_region_add_subregion(&s->peri_mr, ST_OFFSET,
+                sysbus_mmio_get_region(SYS_BUS_DEVICE(&s->systmr), 0));
+    for (n = 0; n < BCM2835_SYSTIMER_COUNT; n++) {
+        sysbus_connect_irq(SYS_BUS_DEVICE(&s->systmr), n,
+            qdev_get_gpio_in_named(DEVICE(&s->ic), BCM2835_IC_GPU_IRQ,
+                                   INTERRUPT_TIMER0 + n));
+    }
+
     /* UART0 */
     qdev_prop_set_chr(DEVICE(&s->uart0), "chardev", serial_hd(0));
     object_property_set_bool(OBJECT(&s->uart0), true, "realized", &err);
@@ -215,7 +409,16 @@ static void bcm2835_peripherals_realize(DeviceState *dev, Error **errp)
         return;
     }
 
-    object_property_set_uint(OBJECT(&s->fb), ram_size - vcram_size,
+    if (s->vcram_memfd) {
+        bcm2835_peripherals_init_vcram(s, ram, vc_ram_size - vcram_size,
+                                       vcram_size, &err);
+        if (err) {
+            error_propagate(errp, err);
+            return;
+        }
+    }
+
+    object_property_set_uint(OBJECT(&s->fb), vc_ram_size - vcram_size,
                              "vcram-base", &err);
     if (err) {
         error_propagate(errp, err);
@@ -233,6 +436,46 @@ static void bcm2835_peripherals_realize(DeviceState *dev, Error **errp)
     sysbus_connect_irq(SYS_BUS_DEVICE(&s->fb), 0,
                        qdev_get_gpio_in(DEVICE(&s->mboxes), MBOX_CHAN_FB));
 
+    /* Hardware Video Scaler */
+    object_property_set_bool(OBJECT(&s->hvs), true, "realized", &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+
+    memory_region_add_subregion(&s->peri_mr, HVS_OFFSET,
+                sysbus_mmio_get_region(SYS_BUS_DEVICE(&s->hvs), 0));
+
+    /* Power management, reset and watchdog */
+    object_property_set_bool(OBJECT(&s->pm), true, "realized", &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+
+    memory_region_add_subregion(&s->peri_mr, PM_OFFSET,
+                sysbus_mmio_get_region(SYS_BUS_DEVICE(&s->pm), 0));
+
+    /* Clock manager and PLLs */
+    object_property_set_bool(OBJECT(&s->cprman), true, "realized", &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+
+    memory_region_add_subregion(&s->peri_mr, CPRMAN_OFFSET,
+                sysbus_mmio_get_region(SYS_BUS_DEVICE(&s->cprman), 0));
+
+    /* Temperature sensor */
+    object_property_set_bool(OBJECT(&s->thermal), true, "realized", &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+
+    memory_region_add_subregion(&s->peri_mr, THERMAL_OFFSET,
+                sysbus_mmio_get_region(SYS_BUS_DEVICE(&s->thermal), 0));
+
     /* Property channel */
     object_property_set_bool(OBJECT(&s->property), true, "realized", &err);
     if (err) {
@@ -288,6 +531,30 @@ static void bcm2835_peripherals_realize(DeviceState *dev, Error **errp)
         qdev_get_gpio_in_named(DEVICE(&s->ic), BCM2835_IC_GPU_IRQ,
                                INTERRUPT_ARASANSDIO));
 
+    /* bcm2838 EMMC2: SD Host Controller v3.0 with 64-bit ADMA2 and UHS-I.
+     * Its interrupt goes straight to the GIC, so the SoC wires it up.
+     */
+    if (s->enable_emmc2) {
+        object_property_set_uint(OBJECT(&s->emmc2), 3, "sd-spec-version",
+                                 &err);
+        object_property_set_uint(OBJECT(&s->emmc2), BCM2838_EMMC2_CAPAREG,
+                                 "capareg", &err);
+        object_property_set_uint(OBJECT(&s->emmc2), UHS_I, "uhs", &err);
+        if (err) {
+            error_propagate(errp, err);
+            return;
+        }
+
+        object_property_set_bool(OBJECT(&s->emmc2), true, "realized", &err);
+        if (err) {
+            error_propagate(errp, err);
+            return;
+        }
+
+        memory_region_add_subregion(&s->peri_mr, EMMC2_OFFSET,
+                    sysbus_mmio_get_region(SYS_BUS_DEVICE(&s->emmc2), 0));
+    }
+
     /* SDHOST */
     object_property_set_bool(OBJECT(&s->sdhost), true, "realized", &err);
     if (err) {
@@ -320,6 +587,15 @@ static void bcm2835_peripherals_realize(DeviceState *dev, Error **errp)
                                                   INTERRUPT_DMA0 + n));
     }
 
+    /* SDHOST data moves in bursts on the channels that its DREQ paces */
+    qdev_connect_gpio_out_named(DEVICE(&s->sdhost), BCM2835_SDHOST_DREQ, 0,
+        qdev_get_gpio_in_named(DEVICE(&s->dma), BCM2835_DMA_DREQ,
+                               BCM2835_DREQ_SDHOST));
+    bcm2835_dma_set_fifo(&s->dma, BCM2835_DREQ_SDHOST,
+                         sysbus_mmio_get_region(SYS_BUS_DEVICE(&s->sdhost), 0),
+                         BCM2835_SDHOST_DATA_OFFSET, bcm2835_sdhost_dma_fifo,
+                         &s->sdhost);
+
     /* GPIO */
     object_property_set_bool(OBJECT(&s->gpio), true, "realized", &err);
     if (err) {
@@ -329,51 +605,181 @@ static void bcm2835_peripherals_realize(DeviceState *dev, Error **errp)
 
     memory_region_add_subregion(&s->peri_mr, GPIO_OFFSET,
                 sysbus_mmio_get_region(SYS_BUS_DEVICE(&s->gpio), 0));
+    for (n = 0; n < BCM2835_GPIO_NUM_IRQS; n++) {
+        sysbus_connect_irq(SYS_BUS_DEVICE(&s->gpio), n,
+            qdev_get_gpio_in_named(DEVICE(&s->ic), BCM2835_IC_GPU_IRQ,
+                                   INTERRUPT_GPIO0 + n));
+    }
+
+    /* The boot SD card sits on EMMC2 when present, else behind the GPIO mux */
+    if (s->enable_emmc2) {
+        object_property_add_alias(OBJECT(s), "sd-bus", OBJECT(&s->emmc2),
+                                  "sd-bus", &err);
+    } else {
+        object_property_add_alias(OBJECT(s), "sd-bus", OBJECT(&s->gpio),
+                                  "sd-bus", &err);
+    }
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+
+    /* SPI masters */
+    object_property_set_int(OBJECT(&s->spi_irq_orgate),
+                            ARRAY_SIZE(bcm2835_spi_masters), "num-lines", &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+    object_property_set_bool(OBJECT(&s->spi_irq_orgate), true, "realized",
+                             &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+    qdev_connect_gpio_out(DEVICE(&s->spi_irq_orgate), 0,
+        qdev_get_gpio_in_named(DEVICE(&s->ic), BCM2835_IC_GPU_IRQ,
+                               INTERRUPT_SPI));
+
+    for (n = 0; n < ARRAY_SIZE(bcm2835_spi_masters); n++) {
+        BCM2835SPIState *spi = &s->spi[bcm2835_spi_masters[n].n];
+
+        object_property_set_bool(OBJECT(spi), true, "realized", &err);
+        if (err) {
+            error_propagate(errp, err);
+            return;
+        }
+
+        memory_region_add_subregion(&s->peri_mr, bcm2835_spi_masters[n].offset,
+                    sysbus_mmio_get_region(SYS_BUS_DEVICE(spi), 0));
+        sysbus_connect_irq(SYS_BUS_DEVICE(spi), 0,
+                           qdev_get_gpio_in(DEVICE(&s->spi_irq_orgate), n));
+    }
 
-    object_property_add_alias(OBJECT(s), "sd-bus", OBJECT(&s->gpio), "sd-bus",
-                              &err);
+    /* Only SPI0 has DMA requests with a fixed PERMAP */
+    qdev_connect_gpio_out_named(DEVICE(&s->spi[0]), BCM2835_SPI_DREQ_TX, 0,
+        qdev_get_gpio_in_named(DEVICE(&s->dma), BCM2835_DMA_DREQ,
+                               BCM2835_DREQ_SPI0_TX));
+    qdev_connect_gpio_out_named(DEVICE(&s->spi[0]), BCM2835_SPI_DREQ_RX, 0,
+        qdev_get_gpio_in_named(DEVICE(&s->dma), BCM2835_DMA_DREQ,
+                               BCM2835_DREQ_SPI0_RX));
+
+    /* PCM/I2S */
+    object_property_set_bool(OBJECT(&s->i2s), true, "realized", &err);
     if (err) {
         error_propagate(errp, err);
         return;
     }
 
-    create_unimp(s, &s->pm, "bcm2835-pm", PM_OFFSET, 0x1000);
-    create_unimp(s, &s->cprman, "bcm2835-cprman", CPRMAN_OFFSET, 0x1000);
-    create_unimp(s, &s->a2w, "bcm2835-a2w", 0x102000, 0x1000);
-    create_unimp(s, &s->i2s, "bcm2835-i2s", I2S_OFFSET, 0x100);
+    memory_region_add_subregion(&s->peri_mr, I2S_OFFSET,
+                sysbus_mmio_get_region(SYS_BUS_DEVICE(&s->i2s), 0));
+    sysbus_connect_irq(SYS_BUS_DEVICE(&s->i2s), 0,
+        qdev_get_gpio_in_named(DEVICE(&s->ic), BCM2835_IC_GPU_IRQ,
+                               INTERRUPT_I2SPCM));
+    qdev_connect_gpio_out_named(DEVICE(&s->i2s), BCM2835_I2S_DREQ_TX, 0,
+        qdev_get_gpio_in_named(DEVICE(&s->dma), BCM2835_DMA_DREQ,
+                               BCM2835_DREQ_PCM_TX));
+    qdev_connect_gpio_out_named(DEVICE(&s->i2s), BCM2835_I2S_DREQ_RX, 0,
+        qdev_get_gpio_in_named(DEVICE(&s->dma), BCM2835_DMA_DREQ,
+                               BCM2835_DREQ_PCM_RX));
+
+    /* BSC I2C masters */
+    object_property_set_int(OBJECT(&s->i2c_irq_orgate), ARRAY_SIZE(s->i2c),
+                            "num-lines", &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+    object_property_set_bool(OBJECT(&s->i2c_irq_orgate), true, "realized",
+                             &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+    qdev_connect_gpio_out(DEVICE(&s->i2c_irq_orgate), 0,
+        qdev_get_gpio_in_named(DEVICE(&s->ic), BCM2835_IC_GPU_IRQ,
+                               INTERRUPT_I2C));
+
+    for (n = 0; n < ARRAY_SIZE(s->i2c); n++) {
+        object_property_set_bool(OBJECT(&s->i2c[n]), true, "realized", &err);
+        if (err) {
+            error_propagate(errp, err);
+            return;
+        }
+
+        memory_region_add_subregion(&s->peri_mr, bcm2835_bsc_offsets[n],
+                    sysbus_mmio_get_region(SYS_BUS_DEVICE(&s->i2c[n]), 0));
+        sysbus_connect_irq(SYS_BUS_DEVICE(&s->i2c[n]), 0,
+                           qdev_get_gpio_in(DEVICE(&s->i2c_irq_orgate), n));
+    }
+
+    /* USB OTG */
+    object_property_set_bool(OBJECT(&s->dwc2), true, "realized", &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+
+    memory_region_add_subregion(&s->peri_mr, USB_OTG_OFFSET,
+                sysbus_mmio_get_region(SYS_BUS_DEVICE(&s->dwc2), 0));
+    sysbus_connect_irq(SYS_BUS_DEVICE(&s->dwc2), 0,
+        qdev_get_gpio_in_named(DEVICE(&s->ic), BCM2835_IC_GPU_IRQ,
+                               INTERRUPT_USB));
+
+    /* bcm2838 xHCI, a 40-bit bus master on the DMA4 bus.
+     * Its interrupt goes straight to the GIC, so the SoC wires it up.
+     */
+    if (s->enable_xhci) {
+        object_property_set_link(OBJECT(&s->xhci), OBJECT(&s->dma4_bus_mr),
+                                 "dma", &err);
+        if (err) {
+            error_propagate(errp, err);
+            return;
+        }
+
+        object_property_set_bool(OBJECT(&s->xhci), true, "realized", &err);
+        if (err) {
+            error_propagate(errp, err);
+            return;
+        }
+
+        memory_region_add_subregion(&s->peri_mr, USB_XHCI_OFFSET,
+                    sysbus_mmio_get_region(SYS_BUS_DEVICE(&s->xhci), 0));
+    } else {
+        create_unimp(s, &s->xhci_unimp, "bcm2838-xhci", USB_XHCI_OFFSET,
+                     0x100000);
+    }
+
     create_unimp(s, &s->smi, "bcm2835-smi", SMI_OFFSET, 0x100);
     create_unimp(s, &s->uartu[2], "!pl011[2]", UART2_OFFSET, 0x100);
     create_unimp(s, &s->uartu[3], "!pl011[3]", UART3_OFFSET, 0x100);
     create_unimp(s, &s->uartu[4], "!pl011[4]", UART4_OFFSET, 0x100);
     create_unimp(s, &s->uartu[5], "!pl011[5]", UART5_OFFSET, 0x100);
-    create_unimp(s, &s->spi[0], "bcm2835-spi[0]", SPI0_OFFSET, 0x20);
-    create_unimp(s, &s->spi[3], "bcm2835-spi[3]", SPI3_OFFSET, 0x20);
-    create_unimp(s, &s->spi[4], "bcm2835-spi[4]", SPI4_OFFSET, 0x20);
-    create_unimp(s, &s->spi[5], "bcm2835-spi[5]", SPI5_OFFSET, 0x20);
-    create_unimp(s, &s->spi[6], "bcm2835-spi[6]", SPI6_OFFSET, 0x20);
     create_unimp(s, &s->bscsl, "bcm2835-spis", BSC_SL_OFFSET, 0x100);
-    create_unimp(s, &s->i2c[0], "bcm2835-i2c[0]", BSC0_OFFSET, 0x20);
-    create_unimp(s, &s->i2c[1], "bcm2835-i2c[1]", BSC1_OFFSET, 0x20);
-    create_unimp(s, &s->i2c[2], "bcm2835-i2c[2]", BSC2_OFFSET, 0x20);
-    create_unimp(s, &s->i2c[3], "bcm2835-i2c[3]", BSC3_OFFSET, 0x20);
-    create_unimp(s, &s->i2c[4], "bcm2835-i2c[4]", BSC4_OFFSET, 0x20);
-    create_unimp(s, &s->i2c[5], "bcm2835-i2c[5]", BSC5_OFFSET, 0x20);
-    create_unimp(s, &s->i2c[6], "bcm2835-i2c[6]", BSC6_OFFSET, 0x20);
     create_unimp(s, &s->otp, "bcm2835-otp", OTP_OFFSET, 0x80);
     create_unimp(s, &s->dbus, "bcm2835-dbus", DBUS_OFFSET, 0x8000);
     create_unimp(s, &s->ave0, "bcm2835-ave0", AVE0_OFFSET, 0x8000);
-    create_unimp(s, &s->dwc2, "dwc-usb2", USB_OTG_OFFSET, 0x100);
-    create_unimp(s, &s->xhci, "bcm2838-xhci", USB_XHCI_OFFSET, 0x100000);
     create_unimp(s, &s->argon, "bcm2838-argon", ARGON_OFFSET, 4 * 0x10000);
     create_unimp(s, &s->v3d, "bcm2835-v3d", V3D_OFFSET, 0x10000);
     create_unimp(s, &s->sdramc, "bcm2835-sdramc", SDRAMC_OFFSET, 0x100);
 }
 
+static Property bcm2835_peripherals_props[] = {
+    DEFINE_PROP_BOOL("enable-emmc2", BCM2835PeripheralState, enable_emmc2,
+                     false),
+    DEFINE_PROP_BOOL("enable-xhci", BCM2835PeripheralState, enable_xhci,
+                     false),
+    DEFINE_PROP_BOOL("vcram-memfd", BCM2835PeripheralState, vcram_memfd,
+                     false),
+    DEFINE_PROP_END_OF_LIST()
+};
+
 static void bcm2835_peripherals_class_init(ObjectClass *oc, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(oc);
 
     dc->realize = bcm2835_peripherals_realize;
+    dc->props = bcm2835_peripherals_props;
 }
 
 static const TypeInfo bcm2835_peripherals_type_info = {
@@ -15,7 +15,9 @@
 #include "hw/arm/bcm2836.h"
 #include "hw/arm/raspi_platform.h"
 #include "hw/sysbus.h"
-#include "hw/misc/unimp.h"
+#include "net/net.h"
+#include "kvm_arm.h"
+#include "trace.h"
 
 struct BCM283XInfo {
     const char *name;
@@ -23,6 +25,12 @@ struct BCM283XInfo {
     hwaddr peri_base; /* Peripheral base address seen by the CPU */
     hwaddr ctrl_base; /* Interrupt controller and mailboxes etc. */
     hwaddr gic_base;
+    uint32_t dma4_chans; /* DMA channels that are 40-bit DMA4 engines */
+    uint32_t xosc_freq; /* Crystal oscillator feeding the PLLs */
+    uint32_t arm_freq; /* ARM clock as left by the firmware */
+    bool has_emmc2;
+    bool has_xhci;
+    bool has_hvs5;
     int clusterid;
 };
 
@@ -32,6 +40,8 @@ static const BCM283XInfo bcm283x_socs[] = {
         .cpu_type = ARM_CPU_TYPE_NAME("cortex-a7"),
         .peri_base = 0x3f000000,
         .ctrl_base = 0x40000000,
+        .xosc_freq = 19200000,
+        .arm_freq = 900000000,
         .clusterid = 0xf,
     },
 #ifdef TARGET_AARCH64
@@ -40,6 +50,8 @@ static const BCM283XInfo bcm283x_socs[] = {
         .cpu_type = ARM_CPU_TYPE_NAME("cortex-a53"),
         .peri_base = 0x3f000000,
         .ctrl_base = 0x40000000,
+        .xosc_freq = 19200000,
+        .arm_freq = 1200000000,
         .clusterid = 0x0,
     },
     {
@@ -48,6 +60,12 @@ static const BCM283XInfo bcm283x_socs[] = {
         .peri_base = 0xfe000000,
         .ctrl_base = 0xff800000,
         .gic_base = 0x40000,
+        .dma4_chans = 0x7800, /* channels 11-14 */
+        .xosc_freq = 54000000,
+        .arm_freq = 1500000000,
+        .has_emmc2 = true,
+        .has_xhci = true,
+        .has_hvs5 = true,
     },
 #endif
 };
@@ -61,23 +79,46 @@ static const BCM283XInfo bcm283x_socs[] = {
 #define GIC_VIFACE_OTHER_OFS(cpu)  (0x5000 + (cpu) * 0x200)
 #define GIC_VCPU_OFS                0x6000
 
-#define PCIE_BASE                   0x7d500000
+#define GIC_PPI_BASE(cpu)           (GIC_NUM_IRQS + (cpu) * GIC_INTERNAL \
+                                     + GIC_NR_SGIS)
+#define GIC_PPI_MAINT               9
+
+/* Generic timer PPIs, as in the bcm2711 device tree */
+static const int bcm2838_gtimer_ppi[NUM_GTIMERS] = {
+    [GTIMER_PHYS] = 14,
+    [GTIMER_VIRT] = 11,
+    [GTIMER_HYP] = 10,
+    [GTIMER_SEC] = 13,
+};
+
+#define PCIE_BASE                   0xfd500000
+#define PCIE_INTA_SPI               143
+#define PCIE_MSI_SPI                148
+
+#define GENET_BASE                  (PCIE_BASE + 0x80000)
+#define GENET_SPI                   157
+
+#define EMMC2_SPI                   126 /* VC interrupt 62 */
+#define XHCI_SPI                    176
 
 static void bcm2836_init(Object *obj)
 {
     BCM283XState *s = BCM283X(obj);
     BCM283XClass *bc = BCM283X_GET_CLASS(obj);
     const BCM283XInfo *info = bc->info;
-    int n;
 
-    for (n = 0; n < BCM283X_NCPUS; n++) {
-        object_initialize_child(obj, "cpu[*]", &s->cpus[n], sizeof(s->cpus[n]),
-                                info->cpu_type, &error_abort, NULL);
-    }
+    /* The CPUs are created at realize time, once num-cpus is known */
 
     if (info->gic_base) {
+        /* With KVM this is the in-kernel vGIC, see gic_class_name() */
         sysbus_init_child_obj(obj, "gic", &s->gic, sizeof(s->gic),
-                              TYPE_ARM_GIC);
+                              gic_class_name());
+
+        sysbus_init_child_obj(obj, "pcie", &s->pcie, sizeof(s->pcie),
+                              TYPE_BCM2838_PCIE_HOST);
+
+        sysbus_init_child_obj(obj, "genet", &s->genet, sizeof(s->genet),
+                              TYPE_BCM2838_GENET);
     }
 
     sysbus_init_child_obj(obj, "control", &s->control, sizeof(s->control),
@@ -91,15 +132,216 @@ static void bcm2836_init(Object *obj)
                               "vcram-size", &error_abort);
 }
 
-static void bcm2836_realize(DeviceState *dev, Error **errp)
+static bool bcm2838_realize_cpu_gates(BCM283XState *s, int n, Error **errp)
+{
+    Object *gates[] = { OBJECT(&s->irq_orgate[n]), OBJECT(&s->fiq_orgate[n]) };
+    Error *err = NULL;
+    char *name;
+    int i, t;
+
+    /*
+     * Name the children explicitly: "[*]" probes every index below the
+     * first free one, which is quadratic in the number of CPUs.
+     */
+    name = g_strdup_printf("irq-orgate[%d]", n);
+    object_initialize_child(OBJECT(s), name, &s->irq_orgate[n],
+                            sizeof(s->irq_orgate[n]), TYPE_OR_IRQ,
+                            &error_abort, NULL);
+    g_free(name);
+    name = g_strdup_printf("fiq-orgate[%d]", n);
+    object_initialize_child(OBJECT(s), name, &s->fiq_orgate[n],
+                            sizeof(s->fiq_orgate[n]), TYPE_OR_IRQ,
+                            &error_abort, NULL);
+    g_free(name);
+    for (t = 0; t < NUM_GTIMERS; t++) {
+        name = g_strdup_printf("gtimer-splitter[%d]", n * NUM_GTIMERS + t);
+        object_initialize_child(OBJECT(s), name,
+                                &s->gtimer_splitter[n][t],
+                                sizeof(s->gtimer_splitter[n][t]),
+                                TYPE_SPLIT_IRQ, &error_abort, NULL);
+        g_free(name);
+    }
+
+    for (i = 0; i < ARRAY_SIZE(gates); i++) {
+        object_property_set_int(gates[i], 2, "num-lines", &err);
+        if (err) {
+            error_propagate(errp, err);
+            return false;
+        }
+        object_property_set_bool(gates[i], true, "realized", &err);
+        if (err) {
+            error_propagate(errp, err);
+            return false;
+        }
+    }
+
+    for (t = 0; t < NUM_GTIMERS; t++) {
+        object_property_set_int(OBJECT(&s->gtimer_splitter[n][t]), 2,
+                                "num-lines", &err);
+        if (err) {
+            error_propagate(errp, err);
+            return false;
+        }
+        object_property_set_bool(OBJECT(&s->gtimer_splitter[n][t]), true,
+                                 "realized", &err);
+        if (err) {
+            error_propagate(errp, err);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * On bcm2838 both the legacy ARM control block and the GICv2 can interrupt
+ * the cores, depending on which one the guest device tree uses. OR their
+ * irq/fiq outputs together, and feed the generic timers to both.
+ * Cores beyond the four the control block knows about only see the GIC.
+ */
+static void bcm2838_connect_cpu(BCM283XState *s, int n)
+{
+    static const char *const gtimer_names[NUM_GTIMERS] = {
+        [GTIMER_PHYS] = "cntpnsirq",
+        [GTIMER_VIRT] = "cntvirq",
+        [GTIMER_HYP] = "cnthpirq",
+        [GTIMER_SEC] = "cntpsirq",
+    };
+    DeviceState *cpu = DEVICE(&s->cpus[n]);
+    DeviceState *gic = DEVICE(&s->gic);
+    SysBusDevice *gicbus = SYS_BUS_DEVICE(&s->gic);
+    bool has_control = n < BCM283X_NCPUS;
+    int t;
+
+    if (has_control) {
+        qdev_connect_gpio_out_named(DEVICE(&s->control), "irq", n,
+                qdev_get_gpio_in(DEVICE(&s->irq_orgate[n]), 0));
+        qdev_connect_gpio_out_named(DEVICE(&s->control), "fiq", n,
+                qdev_get_gpio_in(DEVICE(&s->fiq_orgate[n]), 0));
+    }
+    sysbus_connect_irq(gicbus, n,
+            qdev_get_gpio_in(DEVICE(&s->irq_orgate[n]), 1));
+    sysbus_connect_irq(gicbus, n + s->num_cpus,
+            qdev_get_gpio_in(DEVICE(&s->fiq_orgate[n]), 1));
+    sysbus_connect_irq(gicbus, n + 2 * s->num_cpus,
+            qdev_get_gpio_in(cpu, ARM_CPU_VIRQ));
+    sysbus_connect_irq(gicbus, n + 3 * s->num_cpus,
+            qdev_get_gpio_in(cpu, ARM_CPU_VFIQ));
+    if (s->gic.virt_extn) {
+        sysbus_connect_irq(gicbus, n + 4 * s->num_cpus,
+                qdev_get_gpio_in(gic, GIC_PPI_BASE(n) + GIC_PPI_MAINT));
+    }
+
+    /*
+     * With the in-kernel vGIC, KVM refuses to have the IRQ and FIQ lines of
+     * a vCPU set from userspace, and kvm_set_irq() would abort.  Leave the
+     * control block unconnected then; the in-kernel GIC does not use the
+     * outputs of the QEMU-side one.
+     */
+    if (!kvm_irqchip_in_kernel()) {
+        qdev_connect_gpio_out(DEVICE(&s->irq_orgate[n]), 0,
+                qdev_get_gpio_in(cpu, ARM_CPU_IRQ));
+        qdev_connect_gpio_out(DEVICE(&s->fiq_orgate[n]), 0,
+                qdev_get_gpio_in(cpu, ARM_CPU_FIQ));
+    }
+
+    for (t = 0; t < NUM_GTIMERS; t++) {
+        DeviceState *splitter = DEVICE(&s->gtimer_splitter[n][t]);
+
+        qdev_connect_gpio_out(cpu, t, qdev_get_gpio_in(splitter, 0));
+        if (has_control) {
+            qdev_connect_gpio_out(splitter, 0,
+                    qdev_get_gpio_in_named(DEVICE(&s->control),
+                                           gtimer_names[t], n));
+        }
+        qdev_connect_gpio_out(splitter, 1,
+                qdev_get_gpio_in(gic, GIC_PPI_BASE(n)
+                                      + bcm2838_gtimer_ppi[t]));
+    }
+}
+
+/*
+ * The transports are created in forwards order, so as on the virt board
+ * -device options in command line order land on decreasing addresses.
+ */
+static bool bcm283x_realize_virtio_mmio(BCM283XState *s,
+                                        const BCM283XInfo *info, Error **errp)
+{
+    Error *err = NULL;
+    int n;
+
+    s->virtio_mmio_base = info->peri_base + BCM283X_VIRTIO_MMIO_OFFSET;
+    s->virtio_mmio_on_gic = info->gic_base != 0;
+
+    for (n = 0; n < BCM283X_VIRTIO_MMIO_NUM; n++) {
+        DeviceState *dev = qdev_create(NULL, "virtio-mmio");
+        qemu_irq irq;
+
+        object_property_set_bool(OBJECT(dev), true, "realized", &err);
+        if (err) {
+            error_propagate(errp, err);
+            return false;
+        }
+
+        memory_region_add_subregion(&s->peripherals.peri_mr,
+                    BCM283X_VIRTIO_MMIO_OFFSET + n * BCM283X_VIRTIO_MMIO_SIZE,
+                    sysbus_mmio_get_region(SYS_BUS_DEVICE(dev), 0));
+        if (s->virtio_mmio_on_gic) {
+            irq = qdev_get_gpio_in(DEVICE(&s->gic),
+                                   BCM2838_VIRTIO_MMIO_SPI + n);
+        } else {
+            irq = qdev_get_gpio_in_named(DEVICE(&s->peripherals.ic),
+                                         BCM2835_IC_GPU_IRQ,
+                                         BCM283X_VIRTIO_MMIO_GPU_IRQ + n);
+        }
+        sysbus_connect_irq(SYS_BUS_DEVICE(dev), 0, irq);
+    }
+
+    return true;
+}
+
+static void bcm2836_do_realize(DeviceState *dev, Error **errp)
 {
     BCM283XState *s = BCM283X(dev);
     BCM283XClass *bc = BCM283X_GET_CLASS(dev);
     const BCM283XInfo *info = bc->info;
+    const char *cpu_type = info->cpu_type;
     Object *obj;
     Error *err = NULL;
     int n;
 
+    /*
+     * Under KVM the cores are the host's.  Only the bcm2838 has a GIC that
+     * KVM can provide; the legacy ARM control block can only drive the
+     * cores when the interrupt controller is left to userspace.  With the
+     * in-kernel vGIC, bcm2838_connect_cpu() leaves the control block
+     * unconnected, so a SoC without a GIC would get no interrupts at all.
+     */
+    if (kvm_enabled()) {
+        if (!info->gic_base && kvm_irqchip_in_kernel()) {
+            error_setg(errp, "%s: KVM needs kernel-irqchip=off on %s",
+                       __func__, info->name);
+            return;
+        }
+        cpu_type = ARM_CPU_TYPE_NAME("host");
+    }
+
+    if (s->num_cpus < BCM283X_NCPUS ||
+        s->num_cpus > (info->gic_base ? BCM283X_MAX_CPUS : BCM283X_NCPUS)) {
+        error_setg(errp, "%s: unsupported number of CPUs %u", __func__,
+                   s->num_cpus);
+        return;
+    }
+
+    for (n = 0; n < s->num_cpus; n++) {
+        char *name = g_strdup_printf("cpu[%d]", n);
+
+        object_initialize_child(OBJECT(dev), name, &s->cpus[n],
+                                sizeof(s->cpus[n]), cpu_type,
+                                &error_abort, NULL);
+        g_free(name);
+    }
+
     /* common peripherals from bcm2835 */
 
     obj = object_property_get_link(OBJECT(dev), "ram", &err);
@@ -115,6 +357,48 @@ static void bcm2836_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    object_property_set_uint(OBJECT(&s->peripherals), info->dma4_chans,
+                             "dma4-chans", &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+
+    object_property_set_uint(OBJECT(&s->peripherals), info->xosc_freq,
+                             "xosc-freq", &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+
+    object_property_set_uint(OBJECT(&s->peripherals), info->arm_freq,
+                             "arm-freq", &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+
+    object_property_set_bool(OBJECT(&s->peripherals), info->has_emmc2,
+                             "enable-emmc2", &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+
+    object_property_set_bool(OBJECT(&s->peripherals), info->has_xhci,
+                             "enable-xhci", &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+
+    object_property_set_bool(OBJECT(&s->peripherals), info->has_hvs5,
+                             "hvs5", &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+
     object_property_set_bool(OBJECT(&s->peripherals), true, "realized", &err);
     if (err) {
         error_propagate(errp, err);
@@ -149,7 +433,7 @@ static void bcm2836_realize(DeviceState *dev, Error **errp)
         }
 
         object_property_set_uint(OBJECT(&s->gic),
-                                 BCM283X_NCPUS, "num-cpu", &err);
+                                 s->num_cpus, "num-cpu", &err);
         if (err) {
             error_propagate(errp, err);
             return;
@@ -162,8 +446,9 @@ static void bcm2836_realize(DeviceState *dev, Error **errp)
             return;
         }
 
-        object_property_set_bool(OBJECT(&s->gic),
-                                 true, "has-virtualization-extensions", &err);
+        /* KVM guests have no EL2 to use the virtual interface from */
+        object_property_set_bool(OBJECT(&s->gic), !kvm_enabled(),
+                                 "has-virtualization-extensions", &err);
         if (err) {
             error_propagate(errp, err);
             return;
@@ -179,18 +464,77 @@ static void bcm2836_realize(DeviceState *dev, Error **errp)
                         info->ctrl_base + info->gic_base + GIC_DIST_OFS);
         sysbus_mmio_map(SYS_BUS_DEVICE(&s->gic), 1,
                         info->ctrl_base + info->gic_base + GIC_CPU_OFS);
-        sysbus_mmio_map(SYS_BUS_DEVICE(&s->gic), 2,
-                        info->ctrl_base + info->gic_base + GIC_VIFACE_THIS_OFS);
-        sysbus_mmio_map(SYS_BUS_DEVICE(&s->gic), 3,
-                        info->ctrl_base + info->gic_base + GIC_VCPU_OFS);
-
-        for (n = 0; n < BCM283X_NCPUS; n++) {
-            sysbus_mmio_map(SYS_BUS_DEVICE(&s->gic), 4 + n,
+        if (s->gic.virt_extn) {
+            sysbus_mmio_map(SYS_BUS_DEVICE(&s->gic), 2,
                             info->ctrl_base + info->gic_base
-                            + GIC_VIFACE_OTHER_OFS(n));
+                            + GIC_VIFACE_THIS_OFS);
+            sysbus_mmio_map(SYS_BUS_DEVICE(&s->gic), 3,
+                            info->ctrl_base + info->gic_base + GIC_VCPU_OFS);
+
+            for (n = 0; n < s->num_cpus; n++) {
+                sysbus_mmio_map(SYS_BUS_DEVICE(&s->gic), 4 + n,
+                                info->ctrl_base + info->gic_base
+                                + GIC_VIFACE_OTHER_OFS(n));
+            }
+        }
+
+        for (n = 0; n < s->num_cpus; n++) {
+            if (!bcm2838_realize_cpu_gates(s, n, errp)) {
+                return;
+            }
         }
 
-        /* TODO wire IRQs!!! */
+        /* bcm2838 PCIe root complex */
+        object_property_set_bool(OBJECT(&s->pcie), true, "realized", &err);
+        if (err) {
+            error_propagate(errp, err);
+            return;
+        }
+
+        sysbus_mmio_map(SYS_BUS_DEVICE(&s->pcie), 0, PCIE_BASE);
+        for (n = 0; n < BCM2838_PCIE_NUM_IRQS; n++) {
+            sysbus_connect_irq(SYS_BUS_DEVICE(&s->pcie), n,
+                qdev_get_gpio_in(DEVICE(&s->gic), PCIE_INTA_SPI + n));
+        }
+        sysbus_connect_irq(SYS_BUS_DEVICE(&s->pcie), BCM2838_PCIE_NUM_IRQS,
+            qdev_get_gpio_in(DEVICE(&s->gic), PCIE_MSI_SPI));
+
+        /* bcm2838 EMMC2, the boot SD card controller */
+        sysbus_connect_irq(SYS_BUS_DEVICE(&s->peripherals.emmc2), 0,
+            qdev_get_gpio_in(DEVICE(&s->gic), EMMC2_SPI));
+
+        /* bcm2838 xHCI, a single interrupter without MSI */
+        sysbus_connect_irq(SYS_BUS_DEVICE(&s->peripherals.xhci), 0,
+            qdev_get_gpio_in(DEVICE(&s->gic), XHCI_SPI));
+
+        /* bcm2838 GENET Ethernet, bus mastering straight into RAM */
+        object_property_add_const_link(OBJECT(&s->genet), "dma-mr", obj,
+                                       &err);
+        if (err) {
+            error_propagate(errp, err);
+            return;
+        }
+
+        if (nd_table[0].used) {
+            qemu_check_nic_model(&nd_table[0], TYPE_BCM2838_GENET);
+            qdev_set_nic_properties(DEVICE(&s->genet), &nd_table[0]);
+        }
+
+        object_property_set_bool(OBJECT(&s->genet), true, "realized", &err);
+        if (err) {
+            error_propagate(errp, err);
+            return;
+        }
+
+        sysbus_mmio_map(SYS_BUS_DEVICE(&s->genet), 0, GENET_BASE);
+        for (n = 0; n < 2; n++) {
+            sysbus_connect_irq(SYS_BUS_DEVICE(&s->genet), n,
+                qdev_get_gpio_in(DEVICE(&s->gic), GENET_SPI + n));
+        }
+    }
+
+    if (s->virtio_mmio && !bcm283x_realize_virtio_mmio(s, info, errp)) {
+        return;
     }
 
     sysbus_connect_irq(SYS_BUS_DEVICE(&s->peripherals), 0,
@@ -198,17 +542,19 @@ static void bcm2836_realize(DeviceState *dev, Error **errp)
     sysbus_connect_irq(SYS_BUS_DEVICE(&s->peripherals), 1,
         qdev_get_gpio_in_named(DEVICE(&s->control), "gpu-fiq", 0));
 
-    for (n = 0; n < BCM283X_NCPUS; n++) {
+    for (n = 0; n < s->num_cpus; n++) {
         /* TODO: this should be converted to a property of ARM_CPU */
         s->cpus[n].mp_affinity = (info->clusterid << 8) | n;
 
         /* set periphbase/CBAR value for CPU-local registers */
-        object_property_set_int(OBJECT(&s->cpus[n]),
-                                info->peri_base,
-                                "reset-cbar", &err);
-        if (err) {
-            error_propagate(errp, err);
-            return;
+        if (object_property_find(OBJECT(&s->cpus[n]), "reset-cbar", NULL)) {
+            object_property_set_int(OBJECT(&s->cpus[n]),
+                                    info->peri_base,
+                                    "reset-cbar", &err);
+            if (err) {
+                error_propagate(errp, err);
+                return;
+            }
         }
 
         /* start powered off if not enabled */
@@ -225,6 +571,11 @@ static void bcm2836_realize(DeviceState *dev, Error **errp)
             return;
         }
 
+        if (info->gic_base) {
+            bcm2838_connect_cpu(s, n);
+            continue;
+        }
+
         /* Connect irq/fiq outputs from the interrupt controller. */
         qdev_connect_gpio_out_named(DEVICE(&s->control), "irq", n,
                 qdev_get_gpio_in(DEVICE(&s->cpus[n]), ARM_CPU_IRQ));
@@ -241,18 +592,20 @@ static void bcm2836_realize(DeviceState *dev, Error **errp)
         qdev_connect_gpio_out(DEVICE(&s->cpus[n]), GTIMER_SEC,
                 qdev_get_gpio_in_named(DEVICE(&s->control), "cntpsirq", n));
     }
+}
 
-    /* bcm2838 kludge to easily create PCIe */
-    if (info->gic_base) {
-        create_unimplemented_device("bcm2838-pcie", PCIE_BASE, 0x100000);
-        create_unimplemented_device("bcm54213-geth",
-                                    PCIE_BASE + 0x80000, 0x10000);
-    }
+static void bcm2836_realize(DeviceState *dev, Error **errp)
+{
+    trace_bcm2836_realize_begin(object_get_typename(OBJECT(dev)));
+    bcm2836_do_realize(dev, errp);
+    trace_bcm2836_realize_end(object_get_typename(OBJECT(dev)));
 }
 
 static Property bcm2836_props[] = {
+    DEFINE_PROP_UINT32("num-cpus", BCM283XState, num_cpus, BCM283X_NCPUS),
     DEFINE_PROP_UINT32("enabled-cpus", BCM283XState, enabled_cpus,
                        BCM283X_NCPUS),
+    DEFINE_PROP_BOOL("virtio-mmio", BCM283XState, virtio_mmio, false),
     DEFINE_PROP_END_OF_LIST()
 };
 
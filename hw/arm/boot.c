@@ -557,15 +557,6 @@ int arm_load_dtb(hwaddr addr, const struct arm_boot_info *binfo,
         }
     }
 
-    if (addr_limit > addr && size > (addr_limit - addr)) {
-        /* Installing the device tree blob at addr would exceed addr_limit.
-         * Whether this constitutes failure is up to the caller to decide,
-         * so just return 0 as size, i.e., no error.
-         */
-        g_free(fdt);
-        return 0;
-    }
-
     acells = qemu_fdt_getprop_cell(fdt, "/", "#address-cells",
                                    NULL, &error_fatal);
     scells = qemu_fdt_getprop_cell(fdt, "/", "#size-cells",
@@ -658,6 +649,26 @@ int arm_load_dtb(hwaddr addr, const struct arm_boot_info *binfo,
         binfo->modify_dtb(binfo, fdt);
     }
 
+    /* The blob has free space for the changes above, 1MB of it when the
+     * board built the tree.  Drop it, so that only the tree itself is
+     * kept as a ROM and copied to guest memory on every reset.
+     */
+    rc = fdt_pack(fdt);
+    if (rc < 0) {
+        fprintf(stderr, "couldn't pack dtb: %s\n", fdt_strerror(rc));
+        goto fail;
+    }
+    size = fdt_totalsize(fdt);
+
+    if (addr_limit > addr && size > (addr_limit - addr)) {
+        /* Installing the device tree blob at addr would exceed addr_limit.
+         * Whether this constitutes failure is up to the caller to decide,
+         * so just return 0 as size, i.e., no error.
+         */
+        g_free(fdt);
+        return 0;
+    }
+
     qemu_fdt_dumpdtb(fdt, size);
 
     /* Put the DTB into the memory map as a ROM image: this will ensure
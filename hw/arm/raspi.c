@@ -22,6 +22,10 @@
 #include "hw/loader.h"
 #include "hw/arm/boot.h"
 #include "sysemu/sysemu.h"
+#include "sysemu/device_tree.h"
+#include <libfdt.h>
+#include "sysemu/hostmem.h"
+#include "migration/vmstate.h"
 
 #define SMPBOOT_ADDR    0x300 /* this should leave enough space for ATAGS */
 #define MVBAR_ADDR      0x400 /* secure vectors */
@@ -30,6 +34,9 @@
 #define FIRMWARE_ADDR_3 0x80000 /* Pi 3 loads kernel.img here by default */
 #define SPINTABLE_ADDR  0xd8 /* Pi 3 bootloader spintable */
 
+/* On the Pi 4 the ARM peripherals window hides RAM from here to 4 GiB */
+#define RASPI4_LOW_RAM_TOP 0xfc000000ULL
+
 enum BoardIdManufacturer {
     M_SONY_UK = 0,
     M_EMBEST = 2,
@@ -102,10 +109,21 @@ static const BoardInfo bcm283x_boards[] = {
 };
 
 typedef struct RasPiState {
+    /*< private >*/
+    MachineState parent_obj;
+    /*< public >*/
     BCM283XState soc;
     MemoryRegion ram;
+
+    char *memdev;
+    bool fastboot;
+    bool virtio_mmio;
 } RasPiState;
 
+#define TYPE_RASPI_MACHINE MACHINE_TYPE_NAME("raspi-common")
+#define RASPI_MACHINE(obj) \
+    OBJECT_CHECK(RasPiState, (obj), TYPE_RASPI_MACHINE)
+
 static void write_smpboot(ARMCPU *cpu, const struct arm_boot_info *info)
 {
     static const uint32_t smpboot[] = {
@@ -114,7 +132,7 @@ static void write_smpboot(ARMCPU *cpu, const struct arm_boot_info *info)
         0xee100fb0, /*    mrc     p15, 0, r0, c0, c0, 5;get core ID */
         0xe7e10050, /*    ubfx    r0, r0, #0, #2       ;extract LSB */
         0xe59f5014, /*    ldr     r5, =0x400000CC      ;load mbox base */
-        0xe320f001, /* 1: yield */
+        0xe320f002, /* 1: wfe */
         0xe7953200, /*    ldr     r3, [r5, r0, lsl #4] ;read mbox for our core*/
         0xe3530000, /*    cmp     r3, #0               ;spin while zero */
         0x0afffffb, /*    beq     1b */
@@ -137,16 +155,17 @@ static void write_smpboot64(ARMCPU *cpu, const struct arm_boot_info *info)
 {
     /* Unlike the AArch32 version we don't need to call the board setup hook.
      * The mechanism for doing the spin-table is also entirely different.
-     * We must have four 64-bit fields at absolute addresses
-     * 0xd8, 0xe0, 0xe8, 0xf0 in RAM, which are the flag variables for
-     * our CPUs, and which we must ensure are zero initialized before
-     * the primary CPU goes into the kernel. We put these variables inside
-     * a rom blob, so that the reset for ROM contents zeroes them for us.
+     * We must have one 64-bit field per CPU at absolute addresses
+     * 0xd8, 0xe0, 0xe8, 0xf0 (and onwards) in RAM, which are the flag
+     * variables for our CPUs, and which we must ensure are zero initialized
+     * before the primary CPU goes into the kernel. We put these variables
+     * inside a rom blob, so that the reset for ROM contents zeroes them
+     * for us.
      */
     static const uint32_t smpboot[] = {
         0xd2801b05, /*        mov     x5, 0xd8 */
         0xd53800a6, /*        mrs     x6, mpidr_el1 */
-        0x924004c6, /*        and     x6, x6, #0x3 */
+        0x924008c6, /*        and     x6, x6, #0x7 */
         0xd503205f, /* spin:  wfe */
         0xf86678a4, /*        ldr     x4, [x5,x6,lsl #3] */
         0xb4ffffc4, /*        cbz     x4, spin */
@@ -157,13 +176,15 @@ static void write_smpboot64(ARMCPU *cpu, const struct arm_boot_info *info)
         0xd61f0080, /*        br      x4 */
     };
 
-    static const uint64_t spintables[] = {
-        0, 0, 0, 0
-    };
+    static const uint64_t spintables[BCM283X_MAX_CPUS];
+
+    /* check that the spintables don't run into the secondary boot code */
+    QEMU_BUILD_BUG_ON(SPINTABLE_ADDR + sizeof(spintables) > SMPBOOT_ADDR);
 
     rom_add_blob_fixed("raspi_smpboot", smpboot, sizeof(smpboot),
                        info->smp_loader_start);
-    rom_add_blob_fixed("raspi_spintables", spintables, sizeof(spintables),
+    rom_add_blob_fixed("raspi_spintables", spintables,
+                       info->nb_cpus * sizeof(spintables[0]),
                        SPINTABLE_ADDR);
 }
 
@@ -178,6 +199,174 @@ static void reset_secondary(ARMCPU *cpu, const struct arm_boot_info *info)
     cpu_set_pc(cs, info->smp_loader_start);
 }
 
+/* simple-framebuffer pixel format names for the bcm2835_fb configuration */
+static const char *raspi_simplefb_format(BCM2835FBConfig *config)
+{
+    switch (config->bpp) {
+    case 16:
+        return config->pixo ? "r5g6b5" : NULL;
+    case 24:
+        return config->pixo ? NULL : "r8g8b8";
+    case 32:
+        return config->pixo ? "x8b8g8r8" : "x8r8g8b8";
+    default:
+        return NULL;
+    }
+}
+
+/*
+ * Fast boot: describe the framebuffer the firmware would have set up as a
+ * simple-framebuffer node, so that the kernel can use it straight away
+ * rather than negotiating a mode over the mailbox property channel.
+ */
+static void raspi_fdt_add_framebuffer(RasPiState *s, void *fdt,
+                                      uint32_t acells, uint32_t scells)
+{
+    BCM2835FBConfig *config = &s->soc.peripherals.fb.config;
+    const char *format = raspi_simplefb_format(config);
+    char *nodename;
+
+    if (!format) {
+        warn_report("raspi: no simple-framebuffer format for %u bpp",
+                    config->bpp);
+        return;
+    }
+
+    nodename = g_strdup_printf("/framebuffer@%" PRIx32, config->base);
+    qemu_fdt_add_subnode(fdt, nodename);
+    qemu_fdt_setprop_string(fdt, nodename, "compatible", "simple-framebuffer");
+    qemu_fdt_setprop_sized_cells(fdt, nodename, "reg",
+                                 acells, config->base,
+                                 scells, bcm2835_fb_get_size(config));
+    qemu_fdt_setprop_cell(fdt, nodename, "width", config->xres);
+    qemu_fdt_setprop_cell(fdt, nodename, "height", config->yres);
+    qemu_fdt_setprop_cell(fdt, nodename, "stride",
+                          bcm2835_fb_get_pitch(config));
+    qemu_fdt_setprop_string(fdt, nodename, "format", format);
+    qemu_fdt_setprop_string(fdt, nodename, "status", "okay");
+    g_free(nodename);
+}
+
+/*
+ * Describe RAM the way the firmware does: below the VideoCore carve-out,
+ * from the carve-out up to the peripherals window, and from 4 GiB on.
+ * The single RAM block is mapped 1:1, so the part the peripherals window
+ * covers is simply not listed. One range may not outgrow the size cells.
+ */
+static void raspi_fdt_set_memory(RasPiState *s, void *fdt,
+                                 uint32_t acells, uint32_t scells)
+{
+    BCM2835FBState *fb = &s->soc.peripherals.fb;
+    uint64_t ram_size = MACHINE(s)->ram_size;
+    const uint64_t ranges[][2] = {
+        { 0, fb->vcram_base },
+        { fb->vcram_base + fb->vcram_size, MIN(ram_size, RASPI4_LOW_RAM_TOP) },
+        { 4 * GiB, ram_size },
+    };
+    uint64_t max_len = scells < 2 ? 2 * GiB : UINT64_MAX;
+    uint64_t values[ARRAY_SIZE(ranges) * 8];
+    int n = 0, i;
+
+    for (i = 0; i < ARRAY_SIZE(ranges); i++) {
+        uint64_t start = ranges[i][0];
+
+        while (start < ranges[i][1] && n < ARRAY_SIZE(values)) {
+            uint64_t len = MIN(ranges[i][1] - start, max_len);
+
+            if (acells < 2 && start + len > 4 * GiB) {
+                warn_report("raspi: dtb cannot describe RAM above 4 GiB");
+                break;
+            }
+            values[n++] = acells;
+            values[n++] = start;
+            values[n++] = scells;
+            values[n++] = len;
+            start += len;
+        }
+    }
+
+    if (qemu_fdt_setprop_sized_cells_from_array(fdt, "/memory@0", "reg",
+                                                n / 2, values) < 0) {
+        warn_report("raspi: could not describe RAM in the dtb");
+    }
+}
+
+/*
+ * The transports sit at the root rather than under /soc, whose dma-ranges
+ * would translate the CPU physical addresses virtio-mmio uses for DMA.
+ * Nodes are added in reverse so that they end up lowest address first.
+ */
+static void raspi_fdt_add_virtio_mmio(RasPiState *s, void *fdt,
+                                      uint32_t acells, uint32_t scells)
+{
+    BCM283XState *soc = &s->soc;
+    const char *intc_compat[] = {
+        "brcm,bcm2836-armctrl-ic", "brcm,bcm2835-armctrl-ic",
+    };
+    uint32_t intc = 0;
+    int offset, i;
+
+    if (soc->virtio_mmio_on_gic) {
+        offset = fdt_node_offset_by_compatible(fdt, -1, "arm,gic-400");
+        if (offset >= 0) {
+            intc = fdt_get_phandle(fdt, offset);
+        }
+    } else {
+        for (i = 0; i < ARRAY_SIZE(intc_compat) && !intc; i++) {
+            offset = fdt_node_offset_by_compatible(fdt, -1, intc_compat[i]);
+            if (offset >= 0) {
+                intc = fdt_get_phandle(fdt, offset);
+            }
+        }
+    }
+    if (!intc) {
+        warn_report("raspi: couldn't find interrupt controller in dtb; "
+                    "will not include virtio-mmio devices in the dtb");
+        return;
+    }
+
+    for (i = BCM283X_VIRTIO_MMIO_NUM - 1; i >= 0; i--) {
+        hwaddr base = soc->virtio_mmio_base + i * BCM283X_VIRTIO_MMIO_SIZE;
+        char *nodename = g_strdup_printf("/virtio_mmio@%" PRIx64, base);
+
+        qemu_fdt_add_subnode(fdt, nodename);
+        qemu_fdt_setprop_string(fdt, nodename, "compatible", "virtio,mmio");
+        qemu_fdt_setprop_sized_cells(fdt, nodename, "reg",
+                                     acells, base,
+                                     scells, BCM283X_VIRTIO_MMIO_SIZE);
+        qemu_fdt_setprop_cell(fdt, nodename, "interrupt-parent", intc);
+        if (soc->virtio_mmio_on_gic) {
+            /* SPI, level high */
+            qemu_fdt_setprop_cells(fdt, nodename, "interrupts",
+                                   0, BCM2838_VIRTIO_MMIO_SPI + i, 4);
+        } else {
+            /* Bank 1 holds GPU interrupts 0-31 */
+            qemu_fdt_setprop_cells(fdt, nodename, "interrupts",
+                                   1, BCM283X_VIRTIO_MMIO_GPU_IRQ + i);
+        }
+        g_free(nodename);
+    }
+}
+
+static void raspi_modify_dtb(const struct arm_boot_info *info, void *fdt)
+{
+    RasPiState *s = RASPI_MACHINE(qdev_get_machine());
+    uint32_t acells, scells;
+
+    acells = qemu_fdt_getprop_cell(fdt, "/", "#address-cells",
+                                   NULL, &error_fatal);
+    scells = qemu_fdt_getprop_cell(fdt, "/", "#size-cells",
+                                   NULL, &error_fatal);
+
+    raspi_fdt_set_memory(s, fdt, acells, scells);
+    if (s->fastboot) {
+        raspi_fdt_add_framebuffer(s, fdt, acells, scells);
+    }
+    if (s->virtio_mmio) {
+        raspi_fdt_add_virtio_mmio(s, fdt, acells, scells);
+    }
+}
+
 static void setup_boot(MachineState *machine, int version, size_t ram_size)
 {
     static struct arm_boot_info binfo;
@@ -211,6 +400,8 @@ static void setup_boot(MachineState *machine, int version, size_t ram_size)
         binfo.secondary_cpu_reset_hook = reset_secondary;
     }
 
+    binfo.modify_dtb = raspi_modify_dtb;
+
     /* If the user specified a "firmware" image (e.g. UEFI), we bypass
      * the normal Linux boot process
      */
@@ -231,10 +422,49 @@ static void setup_boot(MachineState *machine, int version, size_t ram_size)
     arm_load_kernel(ARM_CPU(first_cpu), machine, &binfo);
 }
 
+/*
+ * Back RAM with a user-supplied memory backend (file, memfd, ...) rather
+ * than anonymous memory, so that it can be shared or pre-populated from
+ * outside. Everything the board puts in RAM, the VideoCore carve-out and
+ * the boot stubs included, then lives in the backend.
+ */
+static void raspi_init_memdev_ram(RasPiState *s, uint64_t ram_size)
+{
+    HostMemoryBackend *backend;
+    MemoryRegion *seg;
+    Object *obj;
+    char *size_str;
+
+    obj = object_resolve_path_type(s->memdev, TYPE_MEMORY_BACKEND, NULL);
+    if (obj == NULL) {
+        error_report("memdev '%s' is not a memory backend", s->memdev);
+        exit(1);
+    }
+
+    backend = MEMORY_BACKEND(obj);
+    if (host_memory_backend_is_mapped(backend)) {
+        error_report("memdev '%s' is already in use", s->memdev);
+        exit(1);
+    }
+
+    seg = host_memory_backend_get_memory(backend);
+    if (memory_region_size(seg) != ram_size) {
+        size_str = size_to_str(ram_size);
+        error_report("memdev '%s' size does not match the ram size %s",
+                     s->memdev, size_str);
+        g_free(size_str);
+        exit(1);
+    }
+
+    memory_region_init(&s->ram, OBJECT(s), "ram", ram_size);
+    memory_region_add_subregion(&s->ram, 0, seg);
+    host_memory_backend_set_mapped(backend, true);
+    vmstate_register_ram_global(seg);
+}
+
 static void raspi_init(MachineState *machine, int version)
 {
-    RasPiState *s = g_new0(RasPiState, 1);
-    uint32_t vcram_size;
+    RasPiState *s = RASPI_MACHINE(machine);
     DriveInfo *di;
     BlockBackend *blk;
     BusState *bus;
@@ -267,14 +497,20 @@ static void raspi_init(MachineState *machine, int version)
                             soc_type, &error_abort, NULL);
 
     /* Allocate and map RAM */
-    memory_region_allocate_system_memory(&s->ram, OBJECT(machine), "ram",
-                                         machine->ram_size);
+    if (s->memdev) {
+        raspi_init_memdev_ram(s, machine->ram_size);
+    } else {
+        memory_region_allocate_system_memory(&s->ram, OBJECT(machine), "ram",
+                                             machine->ram_size);
+    }
     /* FIXME: Remove when we have custom CPU address space support */
     memory_region_add_subregion_overlap(get_system_memory(), 0, &s->ram, 0);
 
     /* Setup the SOC */
     object_property_add_const_link(OBJECT(&s->soc), "ram", OBJECT(&s->ram),
                                    &error_abort);
+    object_property_set_int(OBJECT(&s->soc), machine->smp.cpus, "num-cpus",
+                            &error_abort);
     object_property_set_int(OBJECT(&s->soc), machine->smp.cpus, "enabled-cpus",
                             &error_abort);
 
@@ -285,6 +521,8 @@ static void raspi_init(MachineState *machine, int version)
                 | (bcm283x_boards[version].board_rev.revision << 0);
     object_property_set_int(OBJECT(&s->soc), board_rev,
                             "board-rev", &error_abort);
+    object_property_set_bool(OBJECT(&s->soc), s->virtio_mmio, "virtio-mmio",
+                             &error_abort);
     object_property_set_bool(OBJECT(&s->soc), true, "realized", &error_abort);
 
     /* Create and plug in the SD cards */
@@ -299,9 +537,8 @@ static void raspi_init(MachineState *machine, int version)
     qdev_prop_set_drive(carddev, "drive", blk, &error_fatal);
     object_property_set_bool(OBJECT(carddev), true, "realized", &error_fatal);
 
-    vcram_size = object_property_get_uint(OBJECT(&s->soc), "vcram-size",
-                                          &error_abort);
-    setup_boot(machine, version, machine->ram_size - vcram_size);
+    /* Boot from the RAM below the VideoCore carve-out */
+    setup_boot(machine, version, s->soc.peripherals.fb.vcram_base);
 }
 
 static void raspi2_init(MachineState *machine)
@@ -309,8 +546,10 @@ static void raspi2_init(MachineState *machine)
     raspi_init(machine, 2);
 }
 
-static void raspi2_machine_init(MachineClass *mc)
+static void raspi2_machine_class_init(ObjectClass *oc, void *data)
 {
+    MachineClass *mc = MACHINE_CLASS(oc);
+
     mc->desc = "Raspberry Pi 2B";
     mc->init = raspi2_init;
     mc->block_default_type = IF_SD;
@@ -322,8 +561,7 @@ static void raspi2_machine_init(MachineClass *mc)
     mc->default_cpus = BCM283X_NCPUS;
     mc->default_ram_size = 1 * GiB;
     mc->ignore_memory_transaction_failures = true;
-};
-DEFINE_MACHINE("raspi2", raspi2_machine_init)
+}
 
 #ifdef TARGET_AARCH64
 static void raspi3_init(MachineState *machine)
@@ -331,8 +569,10 @@ static void raspi3_init(MachineState *machine)
     raspi_init(machine, 3);
 }
 
-static void raspi3_machine_init(MachineClass *mc)
+static void raspi3_machine_class_init(ObjectClass *oc, void *data)
 {
+    MachineClass *mc = MACHINE_CLASS(oc);
+
     mc->desc = "Raspberry Pi 3B";
     mc->init = raspi3_init;
     mc->block_default_type = IF_SD;
@@ -344,15 +584,16 @@ static void raspi3_machine_init(MachineClass *mc)
     mc->default_cpus = BCM283X_NCPUS;
     mc->default_ram_size = 1 * GiB;
 }
-DEFINE_MACHINE("raspi3", raspi3_machine_init)
 
 static void raspi4_init(MachineState *machine)
 {
     raspi_init(machine, 4);
 }
 
-static void raspi4_machine_init(MachineClass *mc)
+static void raspi4_machine_class_init(ObjectClass *oc, void *data)
 {
+    MachineClass *mc = MACHINE_CLASS(oc);
+
     mc->desc = "Raspberry Pi 4B";
     mc->init = raspi4_init;
     mc->block_default_type = IF_SD;
@@ -364,5 +605,100 @@ static void raspi4_machine_init(MachineClass *mc)
     mc->default_cpus = BCM283X_NCPUS;
     mc->default_ram_size = 1 * GiB;
 }
-DEFINE_MACHINE("raspi4", raspi4_machine_init)
+
+/*
+ * Not a real board: a Pi 4 with extra cores behind the GIC, for guests
+ * that boot from a device tree describing them.
+ */
+static void raspi4_smp_machine_class_init(ObjectClass *oc, void *data)
+{
+    MachineClass *mc = MACHINE_CLASS(oc);
+
+    raspi4_machine_class_init(oc, data);
+    mc->desc = "Raspberry Pi 4B with up to 8 cores (experimental)";
+    mc->max_cpus = BCM283X_MAX_CPUS;
+    mc->default_cpus = BCM283X_MAX_CPUS;
+}
 #endif /* TARGET_AARCH64 */
+
+static bool raspi_get_fastboot(Object *obj, Error **errp)
+{
+    return RASPI_MACHINE(obj)->fastboot;
+}
+
+static void raspi_set_fastboot(Object *obj, bool value, Error **errp)
+{
+    RASPI_MACHINE(obj)->fastboot = value;
+}
+
+static bool raspi_get_virtio_mmio(Object *obj, Error **errp)
+{
+    return RASPI_MACHINE(obj)->virtio_mmio;
+}
+
+static void raspi_set_virtio_mmio(Object *obj, bool value, Error **errp)
+{
+    RASPI_MACHINE(obj)->virtio_mmio = value;
+}
+
+static char *raspi_get_memdev(Object *obj, Error **errp)
+{
+    return g_strdup(RASPI_MACHINE(obj)->memdev);
+}
+
+static void raspi_set_memdev(Object *obj, const char *value, Error **errp)
+{
+    RasPiState *s = RASPI_MACHINE(obj);
+
+    g_free(s->memdev);
+    s->memdev = g_strdup(value);
+}
+
+static void raspi_machine_class_init(ObjectClass *oc, void *data)
+{
+    object_class_property_add_bool(oc, "fastboot", raspi_get_fastboot,
+                                   raspi_set_fastboot, &error_abort);
+    object_class_property_set_description(oc, "fastboot",
+        "Describe the boot framebuffer to the kernel in the device tree",
+        &error_abort);
+    object_class_property_add_str(oc, "memdev", raspi_get_memdev,
+                                  raspi_set_memdev, &error_abort);
+    object_class_property_set_description(oc, "memdev",
+        "Memory backend object to use for RAM, whose size must match -m",
+        &error_abort);
+    object_class_property_add_bool(oc, "virtio-mmio", raspi_get_virtio_mmio,
+                                   raspi_set_virtio_mmio, &error_abort);
+    object_class_property_set_description(oc, "virtio-mmio",
+        "Add virtio-mmio transports for virtio-*-device devices",
+        &error_abort);
+}
+
+static const TypeInfo raspi_machine_types[] = {
+    {
+        .name           = TYPE_RASPI_MACHINE,
+        .parent         = TYPE_MACHINE,
+        .instance_size  = sizeof(RasPiState),
+        .class_init     = raspi_machine_class_init,
+        .abstract       = true,
+    }, {
+        .name           = MACHINE_TYPE_NAME("raspi2"),
+        .parent         = TYPE_RASPI_MACHINE,
+        .class_init     = raspi2_machine_class_init,
+#ifdef TARGET_AARCH64
+    }, {
+        .name           = MACHINE_TYPE_NAME("raspi3"),
+        .parent         = TYPE_RASPI_MACHINE,
+        .class_init     = raspi3_machine_class_init,
+    }, {
+        .name           = MACHINE_TYPE_NAME("raspi4"),
+        .parent         = TYPE_RASPI_MACHINE,
+        .class_init     = raspi4_machine_class_init,
+    }, {
+        .name           = MACHINE_TYPE_NAME("raspi4-smp"),
+        .parent         = TYPE_RASPI_MACHINE,
+        .class_init     = raspi4_smp_machine_class_init,
+#endif
+    }
+};
+
+DEFINE_TYPES(raspi_machine_types)
@@ -30,35 +30,144 @@
 #include "hw/arm/smmu-common.h"
 #include "smmu-internal.h"
 
-/* IOTLB Management */
+/*
+ * IOTLB Management
+ *
+ * Entries are found through s->iotlb, indexed by (asid, iova).  They are
+ * also on the LRU list, which gives the entry to evict once the IOTLB is
+ * full, and on the list of their ASID, so that invalidating an ASID
+ * only visits its own entries.
+ */
 
-inline void smmu_iotlb_inv_all(SMMUState *s)
+static void smmu_iotlb_remove(SMMUState *s, SMMUTLBEntry *e)
 {
-    trace_smmu_iotlb_inv_all();
-    g_hash_table_remove_all(s->iotlb);
+    SMMUIOTLBAsid *a = g_hash_table_lookup(s->iotlb_asids,
+                                           GUINT_TO_POINTER(e->key.asid));
+
+    g_hash_table_remove(s->iotlb, &e->key);
+    QTAILQ_REMOVE(&s->iotlb_lru, e, lru);
+    QLIST_REMOVE(e, asid_next);
+    if (QLIST_EMPTY(&a->entries)) {
+        g_hash_table_remove(s->iotlb_asids, GUINT_TO_POINTER(e->key.asid));
+    }
+    g_free(e);
 }
 
-static gboolean smmu_hash_remove_by_asid(gpointer key, gpointer value,
-                                         gpointer user_data)
+IOMMUTLBEntry *smmu_iotlb_lookup(SMMUState *s, uint16_t asid, dma_addr_t iova)
 {
-    uint16_t asid = *(uint16_t *)user_data;
-    SMMUIOTLBKey *iotlb_key = (SMMUIOTLBKey *)key;
+    SMMUIOTLBKey key = {.asid = asid, .iova = iova};
+    SMMUTLBEntry *e = g_hash_table_lookup(s->iotlb, &key);
 
-    return iotlb_key->asid == asid;
+    if (!e) {
+        s->iotlb_misses++;
+        return NULL;
+    }
+    s->iotlb_hits++;
+    if (e != QTAILQ_FIRST(&s->iotlb_lru)) {
+        QTAILQ_REMOVE(&s->iotlb_lru, e, lru);
+        QTAILQ_INSERT_HEAD(&s->iotlb_lru, e, lru);
+    }
+    return &e->entry;
+}
+
+void smmu_iotlb_insert(SMMUState *s, uint16_t asid, IOMMUTLBEntry *entry)
+{
+    SMMUTLBEntry *e;
+    SMMUIOTLBAsid *a;
+
+    if (g_hash_table_size(s->iotlb) >= s->iotlb_size) {
+        e = QTAILQ_LAST(&s->iotlb_lru);
+        trace_smmu_iotlb_evict(e->key.asid, e->key.iova);
+        smmu_iotlb_remove(s, e);
+    }
+
+    e = g_new0(SMMUTLBEntry, 1);
+    e->entry = *entry;
+    e->key.asid = asid;
+    e->key.iova = entry->iova;
+
+    a = g_hash_table_lookup(s->iotlb_asids, GUINT_TO_POINTER(asid));
+    if (!a) {
+        a = g_new0(SMMUIOTLBAsid, 1);
+        g_hash_table_insert(s->iotlb_asids, GUINT_TO_POINTER(asid), a);
+    }
+    QLIST_INSERT_HEAD(&a->entries, e, asid_next);
+    QTAILQ_INSERT_HEAD(&s->iotlb_lru, e, lru);
+    g_hash_table_insert(s->iotlb, &e->key, e);
+}
+
+inline void smmu_iotlb_inv_all(SMMUState *s)
+{
+    SMMUTLBEntry *e, *next;
+
+    trace_smmu_iotlb_inv_all();
+    g_hash_table_remove_all(s->iotlb);
+    g_hash_table_remove_all(s->iotlb_asids);
+    QTAILQ_FOREACH_SAFE(e, &s->iotlb_lru, lru, next) {
+        g_free(e);
+    }
+    QTAILQ_INIT(&s->iotlb_lru);
 }
 
 inline void smmu_iotlb_inv_iova(SMMUState *s, uint16_t asid, dma_addr_t iova)
 {
     SMMUIOTLBKey key = {.asid = asid, .iova = iova};
+    SMMUTLBEntry *e = g_hash_table_lookup(s->iotlb, &key);
 
     trace_smmu_iotlb_inv_iova(asid, iova);
-    g_hash_table_remove(s->iotlb, &key);
+    if (e) {
+        smmu_iotlb_remove(s, e);
+    }
 }
 
 inline void smmu_iotlb_inv_asid(SMMUState *s, uint16_t asid)
 {
+    SMMUIOTLBAsid *a = g_hash_table_lookup(s->iotlb_asids,
+                                           GUINT_TO_POINTER(asid));
+    SMMUTLBEntry *e, *next;
+
     trace_smmu_iotlb_inv_asid(asid);
-    g_hash_table_foreach_remove(s->iotlb, smmu_hash_remove_by_asid, &asid);
+    if (!a) {
+        return;
+    }
+    /* the last removal frees @a */
+    QLIST_FOREACH_SAFE(e, &a->entries, asid_next, next) {
+        smmu_iotlb_remove(s, e);
+    }
+}
+
+static bool smmu_iotlb_overlaps(SMMUTLBEntry *e, dma_addr_t iova,
+                                uint64_t size)
+{
+    return e->key.iova <= iova + size - 1 &&
+           iova <= e->key.iova + e->entry.addr_mask;
+}
+
+void smmu_iotlb_inv_range(SMMUState *s, int asid, dma_addr_t iova,
+                          uint64_t size)
+{
+    SMMUIOTLBAsid *a;
+    SMMUTLBEntry *e, *next;
+
+    trace_smmu_iotlb_inv_range(asid, iova, size);
+    if (asid < 0) {
+        QTAILQ_FOREACH_SAFE(e, &s->iotlb_lru, lru, next) {
+            if (smmu_iotlb_overlaps(e, iova, size)) {
+                smmu_iotlb_remove(s, e);
+            }
+        }
+        return;
+    }
+
+    a = g_hash_table_lookup(s->iotlb_asids, GUINT_TO_POINTER(asid));
+    if (!a) {
+        return;
+    }
+    QLIST_FOREACH_SAFE(e, &a->entries, asid_next, next) {
+        if (smmu_iotlb_overlaps(e, iova, size)) {
+            smmu_iotlb_remove(s, e);
+        }
+    }
 }
 
 /* VMSAv8-64 Translation */
@@ -430,9 +539,18 @@ static void smmu_base_realize(DeviceState *dev, Error **errp)
         error_propagate(errp, local_err);
         return;
     }
+    if (!s->iotlb_size) {
+        error_setg(errp, "iotlb-size must be at least 1");
+        return;
+    }
     s->configs = g_hash_table_new_full(NULL, NULL, NULL, g_free);
-    s->iotlb = g_hash_table_new_full(smmu_iotlb_key_hash, smmu_iotlb_key_equal,
-                                     g_free, g_free);
+    s->iotlb = g_hash_table_new(smmu_iotlb_key_hash, smmu_iotlb_key_equal);
+    s->iotlb_asids = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+    QTAILQ_INIT(&s->iotlb_lru);
+    object_property_add_uint64_ptr(OBJECT(dev), "iotlb-hits",
+                                   &s->iotlb_hits, &error_abort);
+    object_property_add_uint64_ptr(OBJECT(dev), "iotlb-misses",
+                                   &s->iotlb_misses, &error_abort);
     s->smmu_pcibus_by_busptr = g_hash_table_new(NULL, NULL);
 
     if (s->primary_bus) {
@@ -447,12 +565,14 @@ static void smmu_base_reset(DeviceState *dev)
     SMMUState *s = ARM_SMMU(dev);
 
     g_hash_table_remove_all(s->configs);
-    g_hash_table_remove_all(s->iotlb);
+    smmu_iotlb_inv_all(s);
 }
 
 static Property smmu_dev_properties[] = {
     DEFINE_PROP_UINT8("bus_num", SMMUState, bus_num, 0),
     DEFINE_PROP_LINK("primary-bus", SMMUState, primary_bus, "PCI", PCIBus *),
+    DEFINE_PROP_UINT32("iotlb-size", SMMUState, iotlb_size,
+                       SMMU_IOTLB_MAX_SIZE),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -0,0 +1,445 @@
+/*
+ * BCM2835 (Raspberry Pi) PCM/I2S audio interface
+ *
+ * Only playback is modelled. Words written to the TX FIFO, normally by the
+ * DMA engine on DREQ, are queued in a ring that the audio callback drains
+ * at PCM_CLK divided by the frame length, or at the "freq" property when
+ * the codec is the clock master. The guest sees the last 64 words of the
+ * ring as the FIFO, so its DMA keeps a few milliseconds of samples queued
+ * and nothing has to be done per sample by either side. Channel positions,
+ * sign extension, PDM mode and the receiver are not modelled; the RX FIFO
+ * reads as empty and never requests DMA.
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/bitops.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "hw/audio/bcm2835_i2s.h"
+#include "migration/vmstate.h"
+
+#define PCM_CS          0x00
+#define PCM_FIFO        0x04
+#define PCM_MODE        0x08
+#define PCM_RXC         0x0c
+#define PCM_TXC         0x10
+#define PCM_DREQ        0x14
+#define PCM_INTEN       0x18
+#define PCM_INTSTC      0x1c
+#define PCM_GRAY        0x20
+
+#define PCM_CS_EN       (1 << 0)
+#define PCM_CS_TXON     (1 << 2)
+#define PCM_CS_TXCLR    (1 << 3)
+#define PCM_CS_TXTHR_SHIFT 5
+#define PCM_CS_DMAEN    (1 << 9)
+#define PCM_CS_TXERR    (1 << 15)
+#define PCM_CS_RXERR    (1 << 16)
+#define PCM_CS_TXW      (1 << 17)
+#define PCM_CS_TXD      (1 << 19)
+#define PCM_CS_TXE      (1 << 21)
+/* everything except the status bits, the error bits and the FIFO clears */
+#define PCM_CS_WMASK    0x038063e7
+
+#define PCM_MODE_FLEN_SHIFT 10
+#define PCM_MODE_FLEN_LEN   10
+#define PCM_MODE_CLKM   (1 << 23)
+#define PCM_MODE_FTXP   (1 << 24)
+#define PCM_MODE_WMASK  0x1fffffff
+
+/* TXC has channel 1 in the top half and channel 2 in the bottom half */
+#define PCM_XC_WID_MASK 0xf
+#define PCM_XC_EN       (1 << 14)
+#define PCM_XC_WEX      (1 << 15)
+
+#define PCM_DREQ_TX_SHIFT   8
+#define PCM_DREQ_TX_LEN     7
+#define PCM_DREQ_WMASK  0x7f7f7f7f
+
+#define PCM_INT_TXW     (1 << 0)
+#define PCM_INT_TXERR   (1 << 2)
+#define PCM_INT_MASK    0xf
+
+#define RING_MASK       (BCM2835_I2S_RING_SIZE - 1)
+
+/* Frames converted for each AUD_write() */
+#define CHUNK_FRAMES    256
+
+QEMU_BUILD_BUG_ON(BCM2835_I2S_RING_SIZE & RING_MASK);
+
+static bool bcm2835_i2s_playing(BCM2835I2SState *s)
+{
+    return (s->cs & (PCM_CS_EN | PCM_CS_TXON)) == (PCM_CS_EN | PCM_CS_TXON);
+}
+
+static uint32_t bcm2835_i2s_level(BCM2835I2SState *s)
+{
+    return s->head - s->tail;
+}
+
+/* Words in the part of the ring that stands for the hardware FIFO */
+static uint32_t bcm2835_i2s_fifo_level(BCM2835I2SState *s)
+{
+    uint32_t level = bcm2835_i2s_level(s);
+    uint32_t below = BCM2835_I2S_RING_SIZE - BCM2835_I2S_FIFO_SIZE;
+
+    return level > below ? level - below : 0;
+}
+
+static uint32_t bcm2835_i2s_status(BCM2835I2SState *s)
+{
+    uint32_t st = s->cs;
+    uint32_t fifo = bcm2835_i2s_fifo_level(s);
+    bool txw;
+
+    switch (extract32(s->cs, PCM_CS_TXTHR_SHIFT, 2)) {
+    case 0:
+        txw = fifo == 0;
+        break;
+    case 3:
+        txw = fifo < BCM2835_I2S_FIFO_SIZE - 1;
+        break;
+    default:
+        txw = fifo < BCM2835_I2S_FIFO_SIZE;
+        break;
+    }
+    if (txw) {
+        st |= PCM_CS_TXW;
+    }
+    if (bcm2835_i2s_level(s) < BCM2835_I2S_RING_SIZE) {
+        st |= PCM_CS_TXD;
+    }
+    if (bcm2835_i2s_level(s) == 0) {
+        st |= PCM_CS_TXE;
+    }
+
+    return st;
+}
+
+static void bcm2835_i2s_update(BCM2835I2SState *s)
+{
+    uint32_t thresh = extract32(s->dreq, PCM_DREQ_TX_SHIFT, PCM_DREQ_TX_LEN);
+    bool dma = (s->cs & (PCM_CS_EN | PCM_CS_DMAEN))
+               == (PCM_CS_EN | PCM_CS_DMAEN);
+
+    if ((s->cs & PCM_CS_EN) && (bcm2835_i2s_status(s) & PCM_CS_TXW)) {
+        s->intstc |= PCM_INT_TXW;
+    }
+    qemu_set_irq(s->irq, s->intstc & s->inten);
+    qemu_set_irq(s->dreq_tx, dma && bcm2835_i2s_fifo_level(s) < thresh);
+}
+
+static void bcm2835_i2s_tx_error(BCM2835I2SState *s)
+{
+    s->cs |= PCM_CS_TXERR;
+    s->intstc |= PCM_INT_TXERR;
+}
+
+static void bcm2835_i2s_out_cb(void *opaque, int avail)
+{
+    BCM2835I2SState *s = opaque;
+    bool wide = s->width > 16;
+    int bpf = s->channels * (wide ? 4 : 2);
+    int wpf = s->packed ? 1 : s->channels;
+    union {
+        int16_t s16[CHUNK_FRAMES * 2];
+        int32_t s32[CHUNK_FRAMES * 2];
+    } buf;
+    int frames, written, i, c;
+    uint32_t w;
+
+    if (!s->channels) {
+        return;
+    }
+    if (avail >= bpf && bcm2835_i2s_level(s) < wpf) {
+        /* the guest did not keep up */
+        bcm2835_i2s_tx_error(s);
+    }
+
+    while (avail >= bpf && bcm2835_i2s_level(s) >= wpf) {
+        frames = MIN(MIN(avail / bpf, bcm2835_i2s_level(s) / wpf),
+                     CHUNK_FRAMES);
+        for (i = 0; i < frames; i++) {
+            for (c = 0; c < s->channels; c++) {
+                if (s->packed) {
+                    w = s->ring[(s->tail + i) & RING_MASK];
+                    buf.s16[i * 2 + c] = w >> (c * 16);
+                    continue;
+                }
+                /* samples are right-justified in their FIFO word */
+                w = s->ring[(s->tail + i * wpf + c) & RING_MASK];
+                if (wide) {
+                    buf.s32[i * s->channels + c] = w << (32 - s->width);
+                } else {
+                    buf.s16[i * s->channels + c] = w << (16 - s->width);
+                }
+            }
+        }
+
+        written = AUD_write(s->voice, &buf, frames * bpf) / bpf;
+        s->tail += written * wpf;
+        avail -= written * bpf;
+        if (written < frames) {
+            break;
+        }
+    }
+
+    bcm2835_i2s_update(s);
+}
+
+/* Open the voice for the frames described by TXC and MODE, and start it */
+static void bcm2835_i2s_start(BCM2835I2SState *s)
+{
+    uint32_t ch1 = extract32(s->txc, 16, 16);
+    uint32_t ch2 = extract32(s->txc, 0, 16);
+    uint32_t ch = (ch1 & PCM_XC_EN) ? ch1 : ch2;
+    unsigned flen = extract32(s->mode, PCM_MODE_FLEN_SHIFT,
+                              PCM_MODE_FLEN_LEN) + 1;
+    uint64_t clk = 0;
+    struct audsettings as;
+
+    s->channels = !!(ch1 & PCM_XC_EN) + !!(ch2 & PCM_XC_EN);
+    s->width = MIN((ch & PCM_XC_WID_MASK) + 8 + (ch & PCM_XC_WEX ? 16 : 0),
+                   32);
+    s->packed = (s->mode & PCM_MODE_FTXP) && s->channels == 2
+                && s->width <= 16;
+    if (!s->channels) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: no TX channel enabled\n",
+                      __func__);
+        AUD_set_active_out(s->voice, 0);
+        return;
+    }
+
+    if (!(s->mode & PCM_MODE_CLKM)) {
+        clk = bcm2835_cprman_get_pcm_rate(s->cprman);
+    }
+    as.freq = clk ? clk / flen : s->freq;
+    as.nchannels = s->channels;
+    as.fmt = s->width > 16 ? AUDIO_FORMAT_S32 : AUDIO_FORMAT_S16;
+    as.endianness = AUDIO_HOST_ENDIANNESS;
+
+    s->voice = AUD_open_out(&s->card, s->voice, "bcm2835-i2s.out", s,
+                            bcm2835_i2s_out_cb, &as);
+    AUD_set_active_out(s->voice, 1);
+}
+
+static void bcm2835_i2s_write_cs(BCM2835I2SState *s, uint32_t value)
+{
+    bool was_playing = bcm2835_i2s_playing(s);
+
+    if (value & PCM_CS_TXCLR) {
+        s->head = s->tail;
+    }
+    /* the error bits are write 1 to clear */
+    s->cs = (s->cs & ~value & (PCM_CS_TXERR | PCM_CS_RXERR))
+            | (value & PCM_CS_WMASK);
+
+    if (!was_playing && bcm2835_i2s_playing(s)) {
+        bcm2835_i2s_start(s);
+    } else if (was_playing && !bcm2835_i2s_playing(s)) {
+        AUD_set_active_out(s->voice, 0);
+    }
+}
+
+static uint64_t bcm2835_i2s_read(void *opaque, hwaddr offset, unsigned size)
+{
+    BCM2835I2SState *s = opaque;
+
+    switch (offset) {
+    case PCM_CS:
+        return bcm2835_i2s_status(s);
+    case PCM_FIFO:
+        return 0;
+    case PCM_MODE:
+        return s->mode;
+    case PCM_RXC:
+        return s->rxc;
+    case PCM_TXC:
+        return s->txc;
+    case PCM_DREQ:
+        return s->dreq;
+    case PCM_INTEN:
+        return s->inten;
+    case PCM_INTSTC:
+        return s->intstc;
+    case PCM_GRAY:
+        return s->gray;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return 0;
+    }
+}
+
+static void bcm2835_i2s_write(void *opaque, hwaddr offset, uint64_t value,
+                              unsigned size)
+{
+    BCM2835I2SState *s = opaque;
+
+    switch (offset) {
+    case PCM_CS:
+        bcm2835_i2s_write_cs(s, value);
+        break;
+    case PCM_FIFO:
+        if (bcm2835_i2s_level(s) == BCM2835_I2S_RING_SIZE) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: TX FIFO overrun\n", __func__);
+            bcm2835_i2s_tx_error(s);
+            break;
+        }
+        s->ring[s->head++ & RING_MASK] = value;
+        break;
+    case PCM_MODE:
+        s->mode = value & PCM_MODE_WMASK;
+        break;
+    case PCM_RXC:
+        s->rxc = value;
+        break;
+    case PCM_TXC:
+        s->txc = value;
+        break;
+    case PCM_DREQ:
+        s->dreq = value & PCM_DREQ_WMASK;
+        break;
+    case PCM_INTEN:
+        s->inten = value & PCM_INT_MASK;
+        break;
+    case PCM_INTSTC:
+        s->intstc &= ~value;
+        break;
+    case PCM_GRAY:
+        s->gray = value;
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return;
+    }
+
+    bcm2835_i2s_update(s);
+}
+
+static const MemoryRegionOps bcm2835_i2s_ops = {
+    .read = bcm2835_i2s_read,
+    .write = bcm2835_i2s_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static int bcm2835_i2s_post_load(void *opaque, int version_id)
+{
+    BCM2835I2SState *s = opaque;
+
+    if (bcm2835_i2s_level(s) > BCM2835_I2S_RING_SIZE) {
+        return -EINVAL;
+    }
+    if (bcm2835_i2s_playing(s)) {
+        bcm2835_i2s_start(s);
+    }
+    return 0;
+}
+
+static const VMStateDescription vmstate_bcm2835_i2s = {
+    .name = TYPE_BCM2835_I2S,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = bcm2835_i2s_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(cs, BCM2835I2SState),
+        VMSTATE_UINT32(mode, BCM2835I2SState),
+        VMSTATE_UINT32(rxc, BCM2835I2SState),
+        VMSTATE_UINT32(txc, BCM2835I2SState),
+        VMSTATE_UINT32(dreq, BCM2835I2SState),
+        VMSTATE_UINT32(inten, BCM2835I2SState),
+        VMSTATE_UINT32(intstc, BCM2835I2SState),
+        VMSTATE_UINT32(gray, BCM2835I2SState),
+        VMSTATE_UINT32_ARRAY(ring, BCM2835I2SState, BCM2835_I2S_RING_SIZE),
+        VMSTATE_UINT32(head, BCM2835I2SState),
+        VMSTATE_UINT32(tail, BCM2835I2SState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void bcm2835_i2s_reset(DeviceState *dev)
+{
+    BCM2835I2SState *s = BCM2835_I2S(dev);
+
+    AUD_set_active_out(s->voice, 0);
+    s->cs = 0;
+    s->mode = 0;
+    s->rxc = 0;
+    s->txc = 0;
+    s->dreq = 0x10303020;
+    s->inten = 0;
+    s->intstc = 0;
+    s->gray = 0;
+    s->head = s->tail = 0;
+
+    bcm2835_i2s_update(s);
+}
+
+static void bcm2835_i2s_init(Object *obj)
+{
+    BCM2835I2SState *s = BCM2835_I2S(obj);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
+
+    memory_region_init_io(&s->iomem, obj, &bcm2835_i2s_ops, s,
+                          TYPE_BCM2835_I2S, 0x24);
+    sysbus_init_mmio(sbd, &s->iomem);
+    sysbus_init_irq(sbd, &s->irq);
+    qdev_init_gpio_out_named(DEVICE(obj), &s->dreq_tx, BCM2835_I2S_DREQ_TX, 1);
+    qdev_init_gpio_out_named(DEVICE(obj), &s->dreq_rx, BCM2835_I2S_DREQ_RX, 1);
+}
+
+static void bcm2835_i2s_realize(DeviceState *dev, Error **errp)
+{
+    BCM2835I2SState *s = BCM2835_I2S(dev);
+    Object *obj;
+    Error *err = NULL;
+
+    obj = object_property_get_link(OBJECT(dev), "cprman", &err);
+    if (obj == NULL) {
+        error_setg(errp, "%s: required cprman link not found: %s",
+                   __func__, error_get_pretty(err));
+        return;
+    }
+    s->cprman = BCM2835_CPRMAN(obj);
+
+    AUD_register_card("bcm2835-i2s", &s->card);
+}
+
+static Property bcm2835_i2s_properties[] = {
+    DEFINE_AUDIO_PROPERTIES(BCM2835I2SState, card),
+    DEFINE_PROP_UINT32("freq", BCM2835I2SState, freq, 48000),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void bcm2835_i2s_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = bcm2835_i2s_realize;
+    dc->reset = bcm2835_i2s_reset;
+    dc->vmsd = &vmstate_bcm2835_i2s;
+    dc->props = bcm2835_i2s_properties;
+}
+
+static TypeInfo bcm2835_i2s_info = {
+    .name          = TYPE_BCM2835_I2S,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(BCM2835I2SState),
+    .class_init    = bcm2835_i2s_class_init,
+    .instance_init = bcm2835_i2s_init,
+};
+
+static void bcm2835_i2s_register_types(void)
+{
+    type_register_static(&bcm2835_i2s_info);
+}
+
+type_init(bcm2835_i2s_register_types)
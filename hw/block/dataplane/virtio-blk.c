@@ -36,6 +36,13 @@ struct VirtIOBlockDataPlane {
     unsigned long *batch_notify_vqs;
     bool batch_notifications;
 
+    /*
+     * With several virtqueues, the BlockBackend stays plugged until all
+     * virtqueues kicked in one event loop iteration have been processed.
+     */
+    QEMUBH *unplug_bh;
+    bool plugged;
+
     /* Note that these EventNotifiers are assigned by value.  This is
      * fine as long as you do not call event_notifier_cleanup on them
      * (because you don't own the file descriptor or handle; you just
@@ -67,7 +74,7 @@ static void notify_guest_bh(void *opaque)
     memset(s->batch_notify_vqs, 0, sizeof(bitmap));
 
     for (j = 0; j < nvqs; j += BITS_PER_LONG) {
-        unsigned long bits = bitmap[j];
+        unsigned long bits = bitmap[j / BITS_PER_LONG];
 
         while (bits != 0) {
             unsigned i = j + ctzl(bits);
@@ -80,6 +87,16 @@ static void notify_guest_bh(void *opaque)
     }
 }
 
+static void unplug_bh(void *opaque)
+{
+    VirtIOBlockDataPlane *s = opaque;
+
+    aio_context_acquire(s->ctx);
+    blk_io_unplug(s->conf->conf.blk);
+    s->plugged = false;
+    aio_context_release(s->ctx);
+}
+
 /* Context: QEMU global mutex held */
 bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
                                   VirtIOBlockDataPlane **dataplane,
@@ -129,6 +146,7 @@ bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
     }
     s->bh = aio_bh_new(s->ctx, notify_guest_bh, s);
     s->batch_notify_vqs = bitmap_new(conf->num_queues);
+    s->unplug_bh = aio_bh_new(s->ctx, unplug_bh, s);
 
     *dataplane = s;
 
@@ -148,6 +166,7 @@ void virtio_blk_data_plane_destroy(VirtIOBlockDataPlane *s)
     assert(!vblk->dataplane_started);
     g_free(s->batch_notify_vqs);
     qemu_bh_delete(s->bh);
+    qemu_bh_delete(s->unplug_bh);
     if (s->iothread) {
         object_unref(OBJECT(s->iothread));
     }
@@ -158,10 +177,23 @@ static bool virtio_blk_data_plane_handle_output(VirtIODevice *vdev,
                                                 VirtQueue *vq)
 {
     VirtIOBlock *s = (VirtIOBlock *)vdev;
+    VirtIOBlockDataPlane *dp = s->dataplane;
 
-    assert(s->dataplane);
+    assert(dp);
     assert(s->dataplane_started);
 
+    /*
+     * Submit the requests of all queues kicked in this iteration together;
+     * unplug_bh runs once the remaining ready handlers have been called.
+     */
+    if (dp->conf->num_queues > 1 && !dp->plugged) {
+        aio_context_acquire(dp->ctx);
+        blk_io_plug(s->blk);
+        dp->plugged = true;
+        aio_context_release(dp->ctx);
+        qemu_bh_schedule(dp->unplug_bh);
+    }
+
     return virtio_blk_handle_vq(s, vq);
 }
 
@@ -259,6 +291,11 @@ static void virtio_blk_data_plane_stop_bh(void *opaque)
 
         virtio_queue_aio_set_host_notifier_handler(vq, s->ctx, NULL);
     }
+
+    qemu_bh_cancel(s->unplug_bh);
+    if (s->plugged) {
+        unplug_bh(s);
+    }
 }
 
 /* Context: QEMU global mutex held */
@@ -26,7 +26,9 @@
 #include "hw/qdev-properties.h"
 #include "migration/vmstate.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "qemu/module.h"
+#include "sysemu/runstate.h"
 
 #define AUX_IRQ         0x0
 #define AUX_ENABLES     0x4
@@ -153,11 +155,40 @@ static uint64_t bcm2835_aux_read(void *opaque, hwaddr offset, unsigned size)
     }
 }
 
+/*
+ * The tx fifo always reads back empty, so output is collected in tx_buf
+ * and written to the chardev when it fills or from a bottom half, and
+ * at the latest before migration or when the VM stops.
+ */
+static void bcm2835_aux_tx_flush(BCM2835AuxState *s)
+{
+    if (s->tx_count == 0) {
+        return;
+    }
+    /* XXX this blocks entire thread. Rewrite to use
+     * qemu_chr_fe_write and background I/O callbacks */
+    qemu_chr_fe_write_all(&s->chr, s->tx_buf, s->tx_count);
+    s->tx_count = 0;
+}
+
+static void bcm2835_aux_tx_bh(void *opaque)
+{
+    bcm2835_aux_tx_flush(opaque);
+}
+
+/* Don't lose the last output when the VM stops, e.g. at QEMU exit. */
+static void bcm2835_aux_vm_state_change(void *opaque, int running,
+                                        RunState state)
+{
+    if (!running) {
+        bcm2835_aux_tx_flush(opaque);
+    }
+}
+
 static void bcm2835_aux_write(void *opaque, hwaddr offset, uint64_t value,
                               unsigned size)
 {
     BCM2835AuxState *s = opaque;
-    unsigned char ch;
 
     switch (offset) {
     case AUX_ENABLES:
@@ -170,11 +201,14 @@ static void bcm2835_aux_write(void *opaque, hwaddr offset, uint64_t value,
 
     case AUX_MU_IO_REG:
         /* "DLAB bit set means access baudrate register" is NYI */
-        ch = value;
-        /* XXX this blocks entire thread. Rewrite to use
-         * qemu_chr_fe_write and background I/O callbacks */
-        qemu_chr_fe_write_all(&s->chr, &ch, 1);
-        break;
+        s->tx_buf[s->tx_count++] = value;
+        if (s->tx_count == BCM2835_AUX_TX_BATCH) {
+            bcm2835_aux_tx_flush(s);
+        } else {
+            qemu_bh_schedule(s->tx_bh);
+        }
+        /* the interrupt state cannot change, since the tx fifo stays empty */
+        return;
 
     case AUX_MU_IER_REG:
         /* "DLAB bit set means access baudrate register" is NYI */
@@ -220,12 +254,11 @@ static int bcm2835_aux_can_receive(void *opaque)
 {
     BCM2835AuxState *s = opaque;
 
-    return s->read_count < BCM2835_AUX_RX_FIFO_LEN;
+    return BCM2835_AUX_RX_FIFO_LEN - s->read_count;
 }
 
-static void bcm2835_aux_put_fifo(void *opaque, uint8_t value)
+static void bcm2835_aux_push_fifo(BCM2835AuxState *s, uint8_t value)
 {
-    BCM2835AuxState *s = opaque;
     int slot;
 
     slot = s->read_pos + s->read_count;
@@ -237,12 +270,17 @@ static void bcm2835_aux_put_fifo(void *opaque, uint8_t value)
     if (s->read_count == BCM2835_AUX_RX_FIFO_LEN) {
         /* buffer full */
     }
-    bcm2835_aux_update(s);
 }
 
 static void bcm2835_aux_receive(void *opaque, const uint8_t *buf, int size)
 {
-    bcm2835_aux_put_fifo(opaque, *buf);
+    BCM2835AuxState *s = opaque;
+    int i;
+
+    for (i = 0; i < size; i++) {
+        bcm2835_aux_push_fifo(s, buf[i]);
+    }
+    bcm2835_aux_update(s);
 }
 
 static const MemoryRegionOps bcm2835_aux_ops = {
@@ -253,10 +291,18 @@ static const MemoryRegionOps bcm2835_aux_ops = {
     .valid.max_access_size = 4,
 };
 
+static int bcm2835_aux_pre_save(void *opaque)
+{
+    /* Buffered output is not part of the migrated state */
+    bcm2835_aux_tx_flush(opaque);
+    return 0;
+}
+
 static const VMStateDescription vmstate_bcm2835_aux = {
     .name = TYPE_BCM2835_AUX,
     .version_id = 1,
     .minimum_version_id = 1,
+    .pre_save = bcm2835_aux_pre_save,
     .fields = (VMStateField[]) {
         VMSTATE_UINT8_ARRAY(read_fifo, BCM2835AuxState,
                             BCM2835_AUX_RX_FIFO_LEN),
@@ -283,6 +329,8 @@ static void bcm2835_aux_realize(DeviceState *dev, Error **errp)
 {
     BCM2835AuxState *s = BCM2835_AUX(dev);
 
+    s->tx_bh = qemu_bh_new(bcm2835_aux_tx_bh, s);
+    qemu_add_vm_change_state_handler(bcm2835_aux_vm_state_change, s);
     qemu_chr_fe_set_handlers(&s->chr, bcm2835_aux_can_receive,
                              bcm2835_aux_receive, NULL, NULL, s, NULL, true);
 }
@@ -25,7 +25,9 @@
 #include "migration/vmstate.h"
 #include "chardev/char-fe.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "qemu/module.h"
+#include "sysemu/runstate.h"
 #include "trace.h"
 
 #define PL011_INT_TX 0x20
@@ -169,23 +171,57 @@ static void pl011_set_read_trigger(PL011State *s)
         s->read_trigger = 1;
 }
 
+/*
+ * The transmitter always appears empty to the guest, so characters can
+ * be collected here and handed to the chardev in one go, either when the
+ * buffer fills up or from a bottom half once the guest stops writing.
+ * Whatever is left is flushed before migration and when the VM stops.
+ */
+static void pl011_tx_flush(PL011State *s)
+{
+    if (s->tx_count == 0) {
+        return;
+    }
+    trace_pl011_tx_flush(s->tx_count);
+    /* XXX this blocks entire thread. Rewrite to use
+     * qemu_chr_fe_write and background I/O callbacks */
+    qemu_chr_fe_write_all(&s->chr, s->tx_buf, s->tx_count);
+    s->tx_count = 0;
+}
+
+static void pl011_tx_bh(void *opaque)
+{
+    pl011_tx_flush(opaque);
+}
+
+/* Don't lose the last output when the VM stops, e.g. at QEMU exit. */
+static void pl011_vm_state_change(void *opaque, int running, RunState state)
+{
+    if (!running) {
+        pl011_tx_flush(opaque);
+    }
+}
+
 static void pl011_write(void *opaque, hwaddr offset,
                         uint64_t value, unsigned size)
 {
     PL011State *s = (PL011State *)opaque;
-    unsigned char ch;
 
     trace_pl011_write(offset, value);
 
     switch (offset >> 2) {
     case 0: /* UARTDR */
         /* ??? Check if transmitter is enabled.  */
-        ch = value;
-        /* XXX this blocks entire thread. Rewrite to use
-         * qemu_chr_fe_write and background I/O callbacks */
-        qemu_chr_fe_write_all(&s->chr, &ch, 1);
-        s->int_level |= PL011_INT_TX;
-        pl011_update(s);
+        s->tx_buf[s->tx_count++] = value;
+        if (s->tx_count == PL011_TX_BATCH) {
+            pl011_tx_flush(s);
+        } else {
+            qemu_bh_schedule(s->tx_bh);
+        }
+        if (!(s->int_level & PL011_INT_TX)) {
+            s->int_level |= PL011_INT_TX;
+            pl011_update(s);
+        }
         break;
     case 1: /* UARTRSR/UARTECR */
         s->rsr = 0;
@@ -244,18 +280,20 @@ static int pl011_can_receive(void *opaque)
     PL011State *s = (PL011State *)opaque;
     int r;
 
+    /* Accept as many characters as there are free FIFO slots */
     if (s->lcr & 0x10) {
-        r = s->read_count < 16;
+        r = 16 - s->read_count;
     } else {
-        r = s->read_count < 1;
+        r = 1 - s->read_count;
     }
+    r = MAX(r, 0);
     trace_pl011_can_receive(s->lcr, s->read_count, r);
     return r;
 }
 
-static void pl011_put_fifo(void *opaque, uint32_t value)
+/* Returns true if the receive interrupt was raised by this character */
+static bool pl011_push_fifo(PL011State *s, uint32_t value)
 {
-    PL011State *s = (PL011State *)opaque;
     int slot;
 
     slot = s->read_pos + s->read_count;
@@ -271,13 +309,32 @@ static void pl011_put_fifo(void *opaque, uint32_t value)
     }
     if (s->read_count == s->read_trigger) {
         s->int_level |= PL011_INT_RX;
+        return true;
+    }
+    return false;
+}
+
+static void pl011_put_fifo(void *opaque, uint32_t value)
+{
+    PL011State *s = (PL011State *)opaque;
+
+    if (pl011_push_fifo(s, value)) {
         pl011_update(s);
     }
 }
 
 static void pl011_receive(void *opaque, const uint8_t *buf, int size)
 {
-    pl011_put_fifo(opaque, *buf);
+    PL011State *s = (PL011State *)opaque;
+    bool raised = false;
+    int i;
+
+    for (i = 0; i < size; i++) {
+        raised |= pl011_push_fifo(s, buf[i]);
+    }
+    if (raised) {
+        pl011_update(s);
+    }
 }
 
 static void pl011_event(void *opaque, int event)
@@ -292,10 +349,18 @@ static const MemoryRegionOps pl011_ops = {
     .endianness = DEVICE_NATIVE_ENDIAN,
 };
 
+static int pl011_pre_save(void *opaque)
+{
+    /* Buffered output is not part of the migrated state */
+    pl011_tx_flush(opaque);
+    return 0;
+}
+
 static const VMStateDescription vmstate_pl011 = {
     .name = "pl011",
     .version_id = 2,
     .minimum_version_id = 2,
+    .pre_save = pl011_pre_save,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32(readbuff, PL011State),
         VMSTATE_UINT32(flags, PL011State),
@@ -346,6 +411,8 @@ static void pl011_realize(DeviceState *dev, Error **errp)
 {
     PL011State *s = PL011(dev);
 
+    s->tx_bh = qemu_bh_new(pl011_tx_bh, s);
+    qemu_add_vm_change_state_handler(pl011_vm_state_change, s);
     qemu_chr_fe_set_handlers(&s->chr, pl011_can_receive, pl011_receive,
                              pl011_event, NULL, s, NULL, true);
 }
@@ -59,6 +59,7 @@
 #include "hw/boards.h"
 #include "qemu/cutils.h"
 #include "sysemu/runstate.h"
+#include "trace.h"
 
 #include <zlib.h>
 
@@ -851,8 +852,8 @@ static FWCfgState *fw_cfg;
 static QTAILQ_HEAD(, Rom) roms = QTAILQ_HEAD_INITIALIZER(roms);
 
 /*
- * rom->data can be heap-allocated or memory-mapped (e.g. when added with
- * rom_add_elf_program())
+ * rom->data can be heap-allocated or memory-mapped (when added with
+ * rom_add_file() or rom_add_elf_program())
  */
 static void rom_free_data(Rom *rom)
 {
@@ -940,8 +941,9 @@ int rom_add_file(const char *file, const char *fw_dir,
 {
     MachineClass *mc = MACHINE_GET_CLASS(qdev_get_machine());
     Rom *rom;
-    int rc, fd = -1;
+    int fd = -1;
     char devpath[100];
+    GError *gerr = NULL;
 
     if (as && mr) {
         fprintf(stderr, "Specifying an Address Space and Memory Region is " \
@@ -970,22 +972,24 @@ int rom_add_file(const char *file, const char *fw_dir,
         rom->fw_file = g_strdup(file);
     }
     rom->addr     = addr;
-    rom->romsize  = lseek(fd, 0, SEEK_END);
-    if (rom->romsize == -1) {
-        fprintf(stderr, "rom: file %-20s: get size error: %s\n",
-                rom->name, strerror(errno));
-        goto err;
-    }
 
-    rom->datasize = rom->romsize;
-    rom->data     = g_malloc0(rom->datasize);
-    lseek(fd, 0, SEEK_SET);
-    rc = read(fd, rom->data, rom->datasize);
-    if (rc != rom->datasize) {
-        fprintf(stderr, "rom: file %-20s: read error: rc=%d (expected %zd)\n",
-                rom->name, rc, rom->datasize);
+    /*
+     * Map the file rather than reading it: a kernel or initrd of hundreds
+     * of megabytes is then paged in from the page cache as rom_reset()
+     * copies it, and does not stay in anonymous memory afterwards.  The
+     * mapping is private, so changes made through rom_ptr() are not
+     * written back.
+     */
+    rom->mapped_file = g_mapped_file_new_from_fd(fd, true, &gerr);
+    if (!rom->mapped_file) {
+        fprintf(stderr, "rom: file %-20s: map error: %s\n",
+                rom->name, gerr->message);
+        g_error_free(gerr);
         goto err;
     }
+    rom->data     = (uint8_t *)g_mapped_file_get_contents(rom->mapped_file);
+    rom->datasize = g_mapped_file_get_length(rom->mapped_file);
+    rom->romsize  = rom->datasize;
     close(fd);
     rom_insert(rom);
     if (rom->fw_file && fw_cfg) {
@@ -1111,6 +1115,51 @@ int rom_add_option(const char *file, int32_t bootindex)
     return rom_add_file(file, "genroms", 0, bootindex, true, NULL, NULL);
 }
 
+/*
+ * Granularity at which rom_write_changed() compares the guest copy; TCG
+ * invalidates translations no wider than the range actually written.
+ */
+#define ROM_COMPARE_CHUNK 4096
+
+/*
+ * Copy @rom into guest RAM, leaving alone the chunks that already hold
+ * its contents. On a warm system reset most of a loaded kernel is
+ * untouched, and skipping the rewrite keeps the code TCG translated for
+ * it, so an in-process reboot does not start translating from scratch.
+ * Anything not backed by plain RAM is written out in full.
+ */
+static void rom_write_changed(Rom *rom)
+{
+    MemoryRegionSection section;
+    const uint8_t *host;
+    hwaddr off, len;
+
+    section = memory_region_find(rom->as->root, rom->addr, rom->datasize);
+    if (!section.mr) {
+        address_space_write_rom(rom->as, rom->addr, MEMTXATTRS_UNSPECIFIED,
+                                rom->data, rom->datasize);
+        return;
+    }
+
+    if (!memory_region_is_ram(section.mr) ||
+        int128_get64(section.size) != rom->datasize) {
+        address_space_write_rom(rom->as, rom->addr, MEMTXATTRS_UNSPECIFIED,
+                                rom->data, rom->datasize);
+    } else {
+        host = memory_region_get_ram_ptr(section.mr) +
+               section.offset_within_region;
+        for (off = 0; off < rom->datasize; off += len) {
+            len = MIN(ROM_COMPARE_CHUNK, rom->datasize - off);
+            if (memcmp(host + off, rom->data + off, len)) {
+                address_space_write_rom(rom->as, rom->addr + off,
+                                        MEMTXATTRS_UNSPECIFIED,
+                                        rom->data + off, len);
+            }
+        }
+    }
+    memory_region_unref(section.mr);
+}
+
 static void rom_reset(void *unused)
 {
     Rom *rom;
@@ -1131,12 +1180,12 @@ static void rom_reset(void *unused)
         if (rom->data == NULL) {
             continue;
         }
+        trace_loader_write_rom(rom->name, rom->addr, rom->datasize, rom->isrom);
         if (rom->mr) {
             void *host = memory_region_get_ram_ptr(rom->mr);
             memcpy(host, rom->data, rom->datasize);
         } else {
-            address_space_write_rom(rom->as, rom->addr, MEMTXATTRS_UNSPECIFIED,
-                                    rom->data, rom->datasize);
+            rom_write_changed(rom);
         }
         if (rom->isrom) {
             /* rom needs to be written only once */
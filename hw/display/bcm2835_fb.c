@@ -35,6 +35,7 @@
 #include "migration/vmstate.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
+#include "trace.h"
 
 #define DEFAULT_VCRAM_SIZE 0x4000000
 #define BCM2835_FB_OFFSET  0x00100000
@@ -53,88 +54,179 @@ static void fb_invalidate_display(void *opaque)
     s->invalidate = true;
 }
 
+/*
+ * Generic converter, for surfaces that are not 32bpp: convert a chunk
+ * of the line to x8r8g8b8, then down to the surface depth.
+ */
 static void draw_line_src16(void *opaque, uint8_t *dst, const uint8_t *src,
                             int width, int deststep)
 {
     BCM2835FBState *s = opaque;
-    uint16_t rgb565;
-    uint32_t rgb888;
-    uint8_t r, g, b;
     DisplaySurface *surface = qemu_console_surface(s->con);
     int bpp = surface_bits_per_pixel(surface);
-
-    while (width--) {
-        switch (s->config.bpp) {
-        case 8:
-            /* lookup palette starting at video ram base
-             * TODO: cache translation, rather than doing this each time!
-             */
-            rgb888 = ldl_le_phys(&s->dma_as, s->vcram_base + (*src << 2));
-            r = (rgb888 >> 0) & 0xff;
-            g = (rgb888 >> 8) & 0xff;
-            b = (rgb888 >> 16) & 0xff;
-            src++;
-            break;
-        case 16:
-            rgb565 = lduw_le_p(src);
-            r = ((rgb565 >> 11) & 0x1f) << 3;
-            g = ((rgb565 >>  5) & 0x3f) << 2;
-            b = ((rgb565 >>  0) & 0x1f) << 3;
-            src += 2;
-            break;
-        case 24:
-            rgb888 = ldl_le_p(src);
-            r = (rgb888 >> 0) & 0xff;
-            g = (rgb888 >> 8) & 0xff;
-            b = (rgb888 >> 16) & 0xff;
-            src += 3;
-            break;
-        case 32:
-            rgb888 = ldl_le_p(src);
-            r = (rgb888 >> 0) & 0xff;
-            g = (rgb888 >> 8) & 0xff;
-            b = (rgb888 >> 16) & 0xff;
-            src += 4;
-            break;
-        default:
-            r = 0;
-            g = 0;
-            b = 0;
-            break;
+    uint32_t buf[64];
+    uint32_t rgb888;
+    uint8_t r, g, b;
+    int i, n;
+
+    while (width > 0) {
+        n = MIN(width, ARRAY_SIZE(buf));
+        if (s->conv) {
+            s->conv(buf, src, n, s->palette);
+            src += n * (s->config.bpp >> 3);
+        } else {
+            memset(buf, 0, n * sizeof(buf[0]));
         }
-
-        if (s->config.pixo == 0) {
-            /* swap to BGR pixel format */
-            uint8_t tmp = r;
-            r = b;
-            b = tmp;
+        width -= n;
+
+        for (i = 0; i < n; i++) {
+            r = buf[i] >> 16;
+            g = buf[i] >> 8;
+            b = buf[i];
+
+            switch (bpp) {
+            case 8:
+                *dst++ = rgb_to_pixel8(r, g, b);
+                break;
+            case 15:
+                *(uint16_t *)dst = rgb_to_pixel15(r, g, b);
+                dst += 2;
+                break;
+            case 16:
+                *(uint16_t *)dst = rgb_to_pixel16(r, g, b);
+                dst += 2;
+                break;
+            case 24:
+                rgb888 = rgb_to_pixel24(r, g, b);
+                *dst++ = rgb888 & 0xff;
+                *dst++ = (rgb888 >> 8) & 0xff;
+                *dst++ = (rgb888 >> 16) & 0xff;
+                break;
+            case 32:
+                *(uint32_t *)dst = rgb_to_pixel32(r, g, b);
+                dst += 4;
+                break;
+            default:
+                return;
+            }
         }
+    }
+}
+
+/* The common case of a 32bpp surface: convert straight into it */
+static void draw_line_conv(void *opaque, uint8_t *dst, const uint8_t *src,
+                           int width, int deststep)
+{
+    BCM2835FBState *s = opaque;
+
+    s->conv((uint32_t *)dst, src, width, s->palette);
+}
+
+/* The surface aliases guest memory: only the dirty tracking is needed */
+static void draw_line_shared(void *opaque, uint8_t *dst, const uint8_t *src,
+                             int width, int deststep)
+{
+}
+
+/*
+ * Return the converter from the guest framebuffer format to x8r8g8b8,
+ * or NULL for an unknown depth.  Note that pixo selects red in the top
+ * bits for 16bpp, but red in the lowest byte for 24 and 32bpp.
+ */
+static PixelConvFunc *fb_get_conv(BCM2835FBState *s)
+{
+    bool rgb = s->config.pixo;
 
-        switch (bpp) {
-        case 8:
-            *dst++ = rgb_to_pixel8(r, g, b);
-            break;
-        case 15:
-            *(uint16_t *)dst = rgb_to_pixel15(r, g, b);
-            dst += 2;
-            break;
-        case 16:
-            *(uint16_t *)dst = rgb_to_pixel16(r, g, b);
-            dst += 2;
-            break;
-        case 24:
-            rgb888 = rgb_to_pixel24(r, g, b);
-            *dst++ = rgb888 & 0xff;
-            *dst++ = (rgb888 >> 8) & 0xff;
-            *dst++ = (rgb888 >> 16) & 0xff;
-            break;
-        case 32:
-            *(uint32_t *)dst = rgb_to_pixel32(r, g, b);
-            dst += 4;
-            break;
-        default:
-            return;
+    switch (s->config.bpp) {
+    case 8:
+        return pixel_conv_get(PIXEL_CONV_PAL8, 0);
+    case 16:
+        return pixel_conv_get(PIXEL_CONV_RGB565, rgb ? 0 : PIXEL_CONV_BGR);
+    case 24:
+        return pixel_conv_get(PIXEL_CONV_RGB888, rgb ? PIXEL_CONV_BGR : 0);
+    case 32:
+        return pixel_conv_get(PIXEL_CONV_XRGB8888, rgb ? PIXEL_CONV_BGR : 0);
+    default:
+        return NULL;
+    }
+}
+
+/*
+ * 8bpp modes look up a palette at the start of video RAM.  Load it
+ * once per refresh rather than once per pixel.
+ */
+static void fb_update_palette(BCM2835FBState *s)
+{
+    uint32_t rgb888;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(s->palette); i++) {
+        rgb888 = ldl_le_phys(&s->dma_as, s->vcram_base + (i << 2));
+        if (s->config.pixo) {
+            rgb888 = ((rgb888 & 0xff) << 16) | (rgb888 & 0xff00) |
+                     ((rgb888 >> 16) & 0xff);
         }
+        s->palette[i] = rgb888 & 0xffffff;
+    }
+}
+
+static drawfn fb_get_draw_line(BCM2835FBState *s, DisplaySurface *surface)
+{
+    if (is_buffer_shared(surface)) {
+        return draw_line_shared;
+    }
+    s->conv = fb_get_conv(s);
+    if (s->config.bpp == 8) {
+        fb_update_palette(s);
+    }
+    if (s->conv && surface_bits_per_pixel(surface) == 32) {
+        return draw_line_conv;
+    }
+    return draw_line_src16;
+}
+
+/*
+ * Return the pixman format that describes the guest framebuffer as it
+ * sits in memory, or 0 if there is none (palettized modes, or a host
+ * byte order that no pixman format matches).
+ */
+static pixman_format_code_t fb_pixman_format(BCM2835FBConfig *config)
+{
+#ifdef HOST_WORDS_BIGENDIAN
+    return 0;
+#else
+    switch (config->bpp) {
+    case 16:
+        return config->pixo ? PIXMAN_r5g6b5 : PIXMAN_b5g6r5;
+    case 24:
+        return config->pixo ? PIXMAN_b8g8r8 : PIXMAN_r8g8b8;
+    case 32:
+        return config->pixo ? PIXMAN_x8b8g8r8 : PIXMAN_x8r8g8b8;
+    default:
+        return 0;
+    }
+#endif
+}
+
+/*
+ * Scan out straight from guest memory when the UI can display the guest
+ * pixel format as-is, otherwise fall back to a converted copy.
+ */
+static void fb_update_surface(BCM2835FBState *s, int src_width)
+{
+    pixman_format_code_t format = fb_pixman_format(&s->config);
+    DisplaySurface *surface;
+
+    if (s->fbsection.mr && format && dpy_gfx_check_format(s->con, format)) {
+        uint8_t *ptr = memory_region_get_ram_ptr(s->fbsection.mr) +
+                       s->fbsection.offset_within_region + s->scanout_offset;
+
+        surface = qemu_create_displaysurface_from(s->config.xres,
+                                                  s->config.yres, format,
+                                                  src_width, ptr);
+        dpy_gfx_replace_surface(s->con, surface);
+    } else {
+        qemu_console_resize(s->con, s->config.xres, s->config.yres);
     }
 }
 
@@ -150,10 +242,58 @@ static bool fb_use_offsets(BCM2835FBConfig *config)
         config->yres_virtual > config->yres;
 }
 
+/*
+ * Page flip: move the scan-out window to another part of the virtual
+ * framebuffer.  Rather than redrawing the whole screen, mark dirty only
+ * those lines of the new window whose contents may differ from what is
+ * currently displayed, and let the normal dirty scan pick them up.
+ * Lines of the old window that were written but not yet scanned out stay
+ * dirty, so they are drawn when that buffer is shown again.
+ */
+static void fb_flip(BCM2835FBState *s, hwaddr offset, int src_width)
+{
+    MemoryRegion *mr = s->fbsection.mr;
+    hwaddr old_addr, new_addr;
+    DirtyBitmapSnapshot *snap;
+    size_t line_len;
+    uint8_t *ram;
+    int y;
+
+    if (mr) {
+        ram = memory_region_get_ram_ptr(mr);
+        line_len = s->config.xres * (s->config.bpp >> 3);
+        old_addr = s->fbsection.offset_within_region + s->scanout_offset;
+        new_addr = s->fbsection.offset_within_region + offset;
+
+        snap = memory_region_snapshot_and_clear_dirty(mr, old_addr,
+                                                      (hwaddr)src_width *
+                                                      s->config.yres,
+                                                      DIRTY_MEMORY_VGA);
+        for (y = 0; y < s->config.yres; y++) {
+            if (memory_region_snapshot_get_dirty(mr, snap, old_addr,
+                                                 src_width)) {
+                memory_region_set_dirty(mr, old_addr, src_width);
+                memory_region_set_dirty(mr, new_addr, src_width);
+            } else if (memcmp(ram + old_addr, ram + new_addr, line_len)) {
+                memory_region_set_dirty(mr, new_addr, src_width);
+            }
+            old_addr += src_width;
+            new_addr += src_width;
+        }
+        g_free(snap);
+    }
+
+    s->scanout_offset = offset;
+    if (is_buffer_shared(qemu_console_surface(s->con))) {
+        fb_update_surface(s, src_width);
+    }
+}
+
 static void fb_update_display(void *opaque)
 {
     BCM2835FBState *s = opaque;
-    DisplaySurface *surface = qemu_console_surface(s->con);
+    DisplaySurface *surface;
+    MemoryRegionSection section;
     int first = 0;
     int last = 0;
     int src_width = 0;
@@ -170,6 +310,25 @@ static void fb_update_display(void *opaque)
         yoff = s->config.yoffset;
     }
 
+    if (s->invalidate || xoff != s->scanout_xoffset) {
+        /*
+         * Track the whole virtual framebuffer, so that buffers which are
+         * not on screen keep their dirty state across page flips.
+         */
+        hwaddr base = s->config.base + xoff * (s->config.bpp >> 3);
+        framebuffer_update_memory_section(&s->fbsection, s->dma_mr, base,
+                                          MAX(s->config.yres,
+                                              s->config.yres_virtual),
+                                          src_width);
+        s->scanout_xoffset = xoff;
+        s->scanout_offset = (hwaddr)yoff * src_width;
+        s->invalidate = true;
+        fb_update_surface(s, src_width);
+    } else if ((hwaddr)yoff * src_width != s->scanout_offset) {
+        fb_flip(s, (hwaddr)yoff * src_width, src_width);
+    }
+
+    surface = qemu_console_surface(s->con);
     dest_width = s->config.xres;
 
     switch (surface_bits_per_pixel(surface)) {
@@ -194,17 +353,15 @@ static void fb_update_display(void *opaque)
         break;
     }
 
-    if (s->invalidate) {
-        hwaddr base = s->config.base + xoff + (hwaddr)yoff * src_width;
-        framebuffer_update_memory_section(&s->fbsection, s->dma_mr,
-                                          base,
-                                          s->config.yres, src_width);
-    }
+    /* Only scan out the visible window of the virtual framebuffer */
+    section = s->fbsection;
+    section.offset_within_region += s->scanout_offset;
 
-    framebuffer_update_display(surface, &s->fbsection,
+    framebuffer_update_display(surface, &section,
                                s->config.xres, s->config.yres,
                                src_width, dest_width, 0, s->invalidate,
-                               draw_line_src16, s, &first, &last);
+                               fb_get_draw_line(s, surface), s,
+                               &first, &last);
 
     if (first >= 0) {
         dpy_gfx_update(s->con, 0, first, s->config.xres,
@@ -255,12 +412,26 @@ void bcm2835_fb_validate_config(BCM2835FBConfig *config)
 
 void bcm2835_fb_reconfigure(BCM2835FBState *s, BCM2835FBConfig *newconfig)
 {
+    BCM2835FBConfig oldconfig = s->config;
+
+    trace_bcm2835_fb_reconfigure(newconfig->xres, newconfig->yres,
+                                 newconfig->bpp, newconfig->base,
+                                 newconfig->xoffset, newconfig->yoffset);
+
     s->lock = true;
 
     s->config = *newconfig;
 
-    s->invalidate = true;
-    qemu_console_resize(s->con, s->config.xres, s->config.yres);
+    /*
+     * A change of viewport offset alone is a page flip, which
+     * fb_update_display() handles without redrawing everything.
+     */
+    oldconfig.xoffset = newconfig->xoffset;
+    oldconfig.yoffset = newconfig->yoffset;
+    if (memcmp(&oldconfig, newconfig, sizeof(oldconfig)) != 0) {
+        s->invalidate = true;
+        qemu_console_resize(s->con, s->config.xres, s->config.yres);
+    }
     s->lock = false;
 }
 
@@ -349,10 +520,20 @@ static const MemoryRegionOps bcm2835_fb_ops = {
     .valid.max_access_size = 4,
 };
 
+static int bcm2835_fb_post_load(void *opaque, int version_id)
+{
+    BCM2835FBState *s = opaque;
+
+    /* The scan-out window is not migrated; rebuild it on the next redraw */
+    s->invalidate = true;
+    return 0;
+}
+
 static const VMStateDescription vmstate_bcm2835_fb = {
     .name = TYPE_BCM2835_FB,
     .version_id = 1,
     .minimum_version_id = 1,
+    .post_load = bcm2835_fb_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_BOOL(lock, BCM2835FBState),
         VMSTATE_BOOL(invalidate, BCM2835FBState),
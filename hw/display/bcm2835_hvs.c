@@ -0,0 +1,522 @@
+/*
+ * BCM2835 (Raspberry Pi) Hardware Video Scaler (HVS)
+ *
+ * The HVS composites the planes of a display list, held in its own
+ * memory, onto one of three output channels. We scan out the first
+ * enabled channel to a console at each display refresh: linear RGB
+ * planes are fetched over the GPU bus, scaled nearest-neighbour,
+ * blended in list order over the channel background, and only output
+ * lines that changed are passed on to the UI. Tiled and YUV planes, the
+ * gamma and colour-space stages, and interrupts are not modelled, and
+ * display lists are latched immediately.
+ *
+ * The bcm2838 HVS5 moves the display list memory up and changes the
+ * layout of some position and control words; the "hvs5" property
+ * selects it.
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "hw/display/bcm2835_hvs.h"
+#include "hw/qdev-properties.h"
+#include "migration/vmstate.h"
+
+#define SCALER_DISPCTRL             0x00
+#define SCALER_DISPCTRL_ENABLE      (1u << 31)
+#define SCALER_DISPLIST0            0x20    /* DISPLISTx, 4 apart */
+#define SCALER_DISPLACT0            0x30    /* DISPLACTx, 4 apart */
+#define SCALER_DISPCTRL0            0x40    /* channel registers, 0x10 apart */
+#define SCALER_DISPBKGND0           0x44
+#define SCALER_DISPSTAT0            0x48
+#define SCALER_CHAN_STRIDE          0x10
+
+#define SCALER_DISPCTRLX_ENABLE     (1u << 31)
+#define SCALER_DISPBKGND_FILL       (1 << 24)
+#define SCALER_DISPSTATX_EMPTY      (1 << 28)
+#define SCALER_DISPSTATX_FRAME_SHIFT 12
+#define SCALER_DISPSTATX_FRAME_LEN  6
+
+#define SCALER_CTL0_END             (1u << 31)
+#define SCALER_CTL0_VALID           (1 << 30)
+#define SCALER_CTL0_SIZE_SHIFT      24
+#define SCALER_CTL0_SIZE_LEN        6
+#define SCALER_CTL0_TILING_SHIFT    20
+#define SCALER_CTL0_TILING_LEN      2
+#define SCALER_CTL0_ORDER_SHIFT     13
+#define SCALER_CTL0_ORDER_LEN       2
+#define SCALER_CTL0_UNITY           (1 << 4)
+#define SCALER5_CTL0_UNITY          (1 << 15)
+#define SCALER_CTL0_FORMAT_MASK     0xf
+
+#define SCALER_ALPHA_MODE_SHIFT     30
+#define SCALER_ALPHA_MODE_PIPELINE  0
+#define SCALER_SRC_PITCH_MASK       0xffff
+
+#define HVS_PIXEL_FORMAT_RGB565     4
+#define HVS_PIXEL_FORMAT_RGB888     5
+#define HVS_PIXEL_FORMAT_RGBA8888   7
+
+#define HVS_PIXEL_ORDER_ARGB        2
+#define HVS_PIXEL_ORDER_ABGR        3
+
+/* Largest line either generation can describe (13-bit fields) */
+#define HVS_MAX_WIDTH               8192
+#define HVS_MAX_PLANES              32
+
+typedef struct {
+    int x, y;
+    int src_w, src_h;
+    int dst_w, dst_h;
+    hwaddr ptr;
+    uint32_t pitch;
+    unsigned format;
+    unsigned order;
+    bool pixel_alpha;
+} HVSPlane;
+
+static hwaddr hvs_regs_size(BCM2835HVSState *s)
+{
+    return s->hvs5 ? BCM2838_HVS_REGS_SIZE : BCM2835_HVS_REGS_SIZE;
+}
+
+static uint32_t hvs_chan_reg(BCM2835HVSState *s, hwaddr base, int chan)
+{
+    return s->regs[(base + chan * SCALER_CHAN_STRIDE) >> 2];
+}
+
+static bool hvs_chan_enabled(BCM2835HVSState *s, int chan)
+{
+    return (s->regs[SCALER_DISPCTRL >> 2] & SCALER_DISPCTRL_ENABLE) &&
+           (hvs_chan_reg(s, SCALER_DISPCTRL0, chan) & SCALER_DISPCTRLX_ENABLE);
+}
+
+static void hvs_chan_size(BCM2835HVSState *s, int chan, int *w, int *h)
+{
+    uint32_t ctrl = hvs_chan_reg(s, SCALER_DISPCTRL0, chan);
+
+    if (s->hvs5) {
+        *w = extract32(ctrl, 16, 13);
+        *h = extract32(ctrl, 0, 13);
+    } else {
+        *w = extract32(ctrl, 12, 12);
+        *h = extract32(ctrl, 0, 12);
+    }
+}
+
+static uint32_t hvs_dlist_start(BCM2835HVSState *s, int chan)
+{
+    return s->regs[(SCALER_DISPLIST0 >> 2) + chan] % ARRAY_SIZE(s->dlist);
+}
+
+static int hvs_format_bpp(unsigned format)
+{
+    switch (format) {
+    case HVS_PIXEL_FORMAT_RGB565:
+        return 2;
+    case HVS_PIXEL_FORMAT_RGB888:
+        return 3;
+    case HVS_PIXEL_FORMAT_RGBA8888:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+/* Decode the @size words of one plane at @w; false if we can't draw it */
+static bool hvs_parse_plane(BCM2835HVSState *s, const uint32_t *w,
+                            unsigned size, HVSPlane *p)
+{
+    uint32_t pos0, pos1 = 0, pos2, alpha;
+    unsigned i = 1;
+    bool unity;
+
+    p->format = w[0] & SCALER_CTL0_FORMAT_MASK;
+    p->order = extract32(w[0], SCALER_CTL0_ORDER_SHIFT, SCALER_CTL0_ORDER_LEN);
+    if (extract32(w[0], SCALER_CTL0_TILING_SHIFT, SCALER_CTL0_TILING_LEN) ||
+        !hvs_format_bpp(p->format)) {
+        qemu_log_mask(LOG_UNIMP, "%s: unsupported plane 0x%08x\n",
+                      __func__, w[0]);
+        return false;
+    }
+
+    /*
+     * CTL0, POS0, [CTL2,] [POS1,] POS2, POS3 (context), then for each
+     * colour plane a pointer, a pointer context and a pitch.
+     */
+    pos0 = w[i++];
+    if (s->hvs5) {
+        unity = w[0] & SCALER5_CTL0_UNITY;
+        alpha = w[i++];
+        if (!unity) {
+            pos1 = w[i++];
+        }
+        pos2 = w[i++];
+        p->x = extract32(pos0, 0, 12);
+        p->y = extract32(pos0, 16, 12);
+        p->src_w = extract32(pos2, 0, 13);
+        p->src_h = extract32(pos2, 16, 13);
+        p->dst_w = extract32(pos1, 0, 13);
+        p->dst_h = extract32(pos1, 16, 13);
+    } else {
+        unity = w[0] & SCALER_CTL0_UNITY;
+        if (!unity) {
+            pos1 = w[i++];
+        }
+        pos2 = w[i++];
+        alpha = pos2;
+        p->x = extract32(pos0, 0, 12);
+        p->y = extract32(pos0, 12, 12);
+        p->src_w = extract32(pos2, 0, 12);
+        p->src_h = extract32(pos2, 16, 12);
+        p->dst_w = extract32(pos1, 0, 12);
+        p->dst_h = extract32(pos1, 16, 12);
+    }
+    i++;
+
+    if (i + 3 > size) {
+        return false;
+    }
+    p->ptr = w[i];
+    p->pitch = w[i + 2] & SCALER_SRC_PITCH_MASK;
+
+    if (unity) {
+        p->dst_w = p->src_w;
+        p->dst_h = p->src_h;
+    }
+    p->pixel_alpha = p->format == HVS_PIXEL_FORMAT_RGBA8888 &&
+        (alpha >> SCALER_ALPHA_MODE_SHIFT) == SCALER_ALPHA_MODE_PIPELINE;
+
+    return p->src_w && p->src_h && p->dst_w && p->dst_h;
+}
+
+static int hvs_parse_dlist(BCM2835HVSState *s, int chan, HVSPlane *planes)
+{
+    uint32_t i = hvs_dlist_start(s, chan);
+    int n = 0;
+
+    while (n < HVS_MAX_PLANES && i < ARRAY_SIZE(s->dlist)) {
+        uint32_t ctl0 = s->dlist[i];
+        unsigned size = extract32(ctl0, SCALER_CTL0_SIZE_SHIFT,
+                                  SCALER_CTL0_SIZE_LEN);
+
+        if ((ctl0 & SCALER_CTL0_END) || !(ctl0 & SCALER_CTL0_VALID) ||
+            size == 0 || i + size > ARRAY_SIZE(s->dlist)) {
+            break;
+        }
+        if (hvs_parse_plane(s, &s->dlist[i], size, &planes[n])) {
+            n++;
+        }
+        i += size;
+    }
+
+    return n;
+}
+
+/* Fetch one pixel as premultiplied 0xAARRGGBB */
+static uint32_t hvs_fetch(BCM2835HVSState *s, const HVSPlane *p,
+                          const uint8_t *src)
+{
+    uint32_t v;
+    bool swap;
+
+    switch (p->format) {
+    case HVS_PIXEL_FORMAT_RGB565:
+        v = lduw_le_p(src);
+        v = 0xff000000 | ((v & 0xf800) << 8) | ((v & 0x07e0) << 5) |
+            ((v & 0x001f) << 3);
+        swap = p->order == HVS_PIXEL_ORDER_ABGR;
+        break;
+    case HVS_PIXEL_FORMAT_RGB888:
+        v = 0xff000000 | (src[2] << 16) | (src[1] << 8) | src[0];
+        swap = p->order == HVS_PIXEL_ORDER_ABGR;
+        break;
+    default:
+        v = ldl_le_p(src);
+        /* HVS5 numbers the 32-bit component orders the other way round */
+        swap = p->order == (s->hvs5 ? HVS_PIXEL_ORDER_ABGR
+                                    : HVS_PIXEL_ORDER_ARGB);
+        if (!p->pixel_alpha) {
+            v |= 0xff000000;
+        }
+        break;
+    }
+
+    if (swap) {
+        v = (v & 0xff00ff00) | ((v >> 16) & 0xff) | ((v & 0xff) << 16);
+    }
+    return v;
+}
+
+static uint32_t hvs_blend(uint32_t src, uint32_t dst)
+{
+    unsigned a = src >> 24;
+    uint32_t res = 0;
+    int shift;
+
+    if (a == 0xff) {
+        return src;
+    }
+    for (shift = 0; shift < 24; shift += 8) {
+        unsigned c = ((src >> shift) & 0xff) +
+                     ((dst >> shift) & 0xff) * (0xff - a) / 0xff;
+        res |= MIN(c, 0xff) << shift;
+    }
+    return res;
+}
+
+static void hvs_draw_plane_line(BCM2835HVSState *s, const HVSPlane *p,
+                                int y, uint32_t *out, int width)
+{
+    int bpp = hvs_format_bpp(p->format);
+    int sy = (y - p->y) * p->src_h / p->dst_h;
+    int x0 = p->x;
+    int x1 = MIN(p->x + p->dst_w, width);
+    int x;
+
+    if (x0 >= x1) {
+        return;
+    }
+
+    address_space_read(&s->dma_as, p->ptr + (hwaddr)sy * p->pitch,
+                       MEMTXATTRS_UNSPECIFIED, s->src_line,
+                       MIN(p->src_w, HVS_MAX_WIDTH) * bpp);
+
+    for (x = x0; x < x1; x++) {
+        int sx = (x - p->x) * p->src_w / p->dst_w;
+        uint32_t v = hvs_fetch(s, p, s->src_line + sx * bpp);
+
+        out[x] = hvs_blend(v, out[x]) & 0xffffff;
+    }
+}
+
+static int hvs_scanout_channel(BCM2835HVSState *s)
+{
+    int chan;
+
+    for (chan = 0; chan < BCM2835_HVS_CHANNELS; chan++) {
+        if (hvs_chan_enabled(s, chan) &&
+            !(s->dlist[hvs_dlist_start(s, chan)] & SCALER_CTL0_END)) {
+            return chan;
+        }
+    }
+    return -1;
+}
+
+static void hvs_update_display(void *opaque)
+{
+    BCM2835HVSState *s = opaque;
+    HVSPlane planes[HVS_MAX_PLANES];
+    DisplaySurface *surface = qemu_console_surface(s->con);
+    int chan = hvs_scanout_channel(s);
+    int width, height, n, y, i;
+    int first = -1, last = -1;
+    uint32_t bkgnd, bg;
+
+    if (chan < 0) {
+        return;
+    }
+
+    hvs_chan_size(s, chan, &width, &height);
+    if (width == 0 || height == 0) {
+        return;
+    }
+    if (surface_width(surface) != width ||
+        surface_height(surface) != height) {
+        qemu_console_resize(s->con, width, height);
+        surface = qemu_console_surface(s->con);
+        s->invalidate = true;
+    }
+    if (surface_bits_per_pixel(surface) != 32) {
+        return;
+    }
+
+    n = hvs_parse_dlist(s, chan, planes);
+    bkgnd = hvs_chan_reg(s, SCALER_DISPBKGND0, chan);
+    bg = (bkgnd & SCALER_DISPBKGND_FILL) ? bkgnd & 0xffffff : 0;
+
+    for (y = 0; y < height; y++) {
+        uint8_t *row = surface_data(surface) + y * surface_stride(surface);
+
+        for (i = 0; i < width; i++) {
+            s->out_line[i] = bg;
+        }
+        for (i = 0; i < n; i++) {
+            if (y >= planes[i].y && y < planes[i].y + planes[i].dst_h) {
+                hvs_draw_plane_line(s, &planes[i], y, s->out_line, width);
+            }
+        }
+
+        if (s->invalidate || memcmp(row, s->out_line, width * 4)) {
+            memcpy(row, s->out_line, width * 4);
+            if (first < 0) {
+                first = y;
+            }
+            last = y;
+        }
+    }
+
+    if (first >= 0) {
+        dpy_gfx_update(s->con, 0, first, width, last - first + 1);
+    }
+    s->frame_count[chan]++;
+    s->invalidate = false;
+}
+
+static void hvs_invalidate_display(void *opaque)
+{
+    BCM2835HVSState *s = opaque;
+
+    s->invalidate = true;
+}
+
+static const GraphicHwOps bcm2835_hvs_gfx_ops = {
+    .invalidate  = hvs_invalidate_display,
+    .gfx_update  = hvs_update_display,
+};
+
+static uint64_t bcm2835_hvs_read(void *opaque, hwaddr offset, unsigned size)
+{
+    BCM2835HVSState *s = opaque;
+    hwaddr regs_size = hvs_regs_size(s);
+    int chan;
+
+    if (offset >= regs_size) {
+        return s->dlist[(offset - regs_size) >> 2];
+    }
+
+    if (offset >= SCALER_DISPLACT0 &&
+        offset < SCALER_DISPLACT0 + 4 * BCM2835_HVS_CHANNELS) {
+        /* new display lists take effect at once */
+        return s->regs[(SCALER_DISPLIST0 >> 2) +
+                       ((offset - SCALER_DISPLACT0) >> 2)];
+    }
+
+    for (chan = 0; chan < BCM2835_HVS_CHANNELS; chan++) {
+        if (offset == SCALER_DISPSTAT0 + chan * SCALER_CHAN_STRIDE) {
+            if (!hvs_chan_enabled(s, chan)) {
+                return SCALER_DISPSTATX_EMPTY;
+            }
+            return deposit32(0, SCALER_DISPSTATX_FRAME_SHIFT,
+                             SCALER_DISPSTATX_FRAME_LEN,
+                             s->frame_count[chan]);
+        }
+    }
+
+    return s->regs[offset >> 2];
+}
+
+static void bcm2835_hvs_write(void *opaque, hwaddr offset, uint64_t value,
+                              unsigned size)
+{
+    BCM2835HVSState *s = opaque;
+    hwaddr regs_size = hvs_regs_size(s);
+
+    if (offset >= regs_size) {
+        s->dlist[(offset - regs_size) >> 2] = value;
+    } else {
+        s->regs[offset >> 2] = value;
+    }
+}
+
+static const MemoryRegionOps bcm2835_hvs_ops = {
+    .read = bcm2835_hvs_read,
+    .write = bcm2835_hvs_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static int bcm2835_hvs_post_load(void *opaque, int version_id)
+{
+    BCM2835HVSState *s = opaque;
+
+    s->invalidate = true;
+    return 0;
+}
+
+static const VMStateDescription vmstate_bcm2835_hvs = {
+    .name = TYPE_BCM2835_HVS,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = bcm2835_hvs_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, BCM2835HVSState,
+                             BCM2838_HVS_REGS_SIZE / 4),
+        VMSTATE_UINT32_ARRAY(dlist, BCM2835HVSState,
+                             BCM2835_HVS_DLIST_SIZE / 4),
+        VMSTATE_UINT32_ARRAY(frame_count, BCM2835HVSState,
+                             BCM2835_HVS_CHANNELS),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void bcm2835_hvs_reset(DeviceState *dev)
+{
+    BCM2835HVSState *s = BCM2835_HVS(dev);
+
+    memset(s->regs, 0, sizeof(s->regs));
+    memset(s->frame_count, 0, sizeof(s->frame_count));
+    /* an empty list everywhere, as the firmware leaves it */
+    memset(s->dlist, 0, sizeof(s->dlist));
+    s->dlist[0] = SCALER_CTL0_END;
+    s->invalidate = true;
+}
+
+static void bcm2835_hvs_realize(DeviceState *dev, Error **errp)
+{
+    BCM2835HVSState *s = BCM2835_HVS(dev);
+    Error *err = NULL;
+    Object *obj;
+
+    obj = object_property_get_link(OBJECT(dev), "dma-mr", &err);
+    if (obj == NULL) {
+        error_setg(errp, "%s: required dma-mr link not found: %s",
+                   __func__, error_get_pretty(err));
+        return;
+    }
+
+    s->dma_mr = MEMORY_REGION(obj);
+    address_space_init(&s->dma_as, s->dma_mr, TYPE_BCM2835_HVS "-memory");
+
+    memory_region_init_io(&s->iomem, OBJECT(s), &bcm2835_hvs_ops, s,
+                          TYPE_BCM2835_HVS,
+                          hvs_regs_size(s) + BCM2835_HVS_DLIST_SIZE);
+    sysbus_init_mmio(SYS_BUS_DEVICE(s), &s->iomem);
+
+    s->src_line = g_malloc(HVS_MAX_WIDTH * 4);
+    s->out_line = g_new(uint32_t, HVS_MAX_WIDTH);
+    s->con = graphic_console_init(dev, 0, &bcm2835_hvs_gfx_ops, s);
+}
+
+static Property bcm2835_hvs_props[] = {
+    DEFINE_PROP_BOOL("hvs5", BCM2835HVSState, hvs5, false),
+    DEFINE_PROP_END_OF_LIST()
+};
+
+static void bcm2835_hvs_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->props = bcm2835_hvs_props;
+    dc->realize = bcm2835_hvs_realize;
+    dc->reset = bcm2835_hvs_reset;
+    dc->vmsd = &vmstate_bcm2835_hvs;
+}
+
+static TypeInfo bcm2835_hvs_info = {
+    .name          = TYPE_BCM2835_HVS,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(BCM2835HVSState),
+    .class_init    = bcm2835_hvs_class_init,
+};
+
+static void bcm2835_hvs_register_types(void)
+{
+    type_register_static(&bcm2835_hvs_info);
+}
+
+type_init(bcm2835_hvs_register_types)
@@ -14,6 +14,7 @@
 #include "ui/console.h"
 #include "framebuffer.h"
 #include "ui/pixel_ops.h"
+#include "ui/pixel-conv.h"
 #include "qemu/timer.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
@@ -72,6 +73,7 @@ typedef struct PL110State {
     uint32_t mux_ctrl;
     uint32_t palette[256];
     uint32_t raw_palette[128];
+    PixelConvFunc *conv;
     qemu_irq irq;
 } PL110State;
 
@@ -133,6 +135,48 @@ static const unsigned char *idregs[] = {
 #define BITS 32
 #include "pl110_template.h"
 
+/*
+ * Converter into a 32bpp surface for the draw function table entry
+ * @mode (a pl110_bppmode, plus 24 for red in the low bits), or NULL for
+ * the modes below 8bpp, which only the templates handle.  For 8bpp and
+ * up, BEPO is the same as little-endian.
+ */
+static PixelConvFunc *pl110_get_conv(PL110State *s, int mode)
+{
+    unsigned flags = 0;
+
+    if (mode >= 24) {
+        flags |= PIXEL_CONV_BGR;
+        mode -= 24;
+    }
+    if (s->cr & PL110_CR_BEBO) {
+        flags |= PIXEL_CONV_BE32;
+    }
+
+    switch (mode) {
+    case BPP_8:
+        return pixel_conv_get(PIXEL_CONV_PAL8, flags & ~PIXEL_CONV_BGR);
+    case BPP_16:
+        return pixel_conv_get(PIXEL_CONV_RGB555, flags);
+    case BPP_32:
+        return pixel_conv_get(PIXEL_CONV_XRGB8888, flags);
+    case BPP_16_565:
+        return pixel_conv_get(PIXEL_CONV_RGB565, flags);
+    case BPP_12:
+        return pixel_conv_get(PIXEL_CONV_RGB444, flags);
+    default:
+        return NULL;
+    }
+}
+
+static void pl110_draw_line_conv(void *opaque, uint8_t *d, const uint8_t *src,
+                                 int width, int deststep)
+{
+    PL110State *s = opaque;
+
+    s->conv((uint32_t *)d, src, width, s->palette);
+}
+
 static int pl110_enabled(PL110State *s)
 {
   return (s->cr & PL110_CR_EN) && (s->cr & PL110_CR_PWR);
@@ -145,6 +189,7 @@ static void pl110_update_display(void *opaque)
     DisplaySurface *surface = qemu_console_surface(s->con);
     drawfn* fntable;
     drawfn fn;
+    void *fn_opaque;
     int dest_width;
     int src_width;
     int bpp_offset;
@@ -223,6 +268,15 @@ static void pl110_update_display(void *opaque)
         fn = fntable[s->bpp + 16 + bpp_offset];
     else
         fn = fntable[s->bpp + bpp_offset];
+    fn_opaque = s->palette;
+
+    if (surface_bits_per_pixel(surface) == 32) {
+        s->conv = pl110_get_conv(s, s->bpp + bpp_offset);
+        if (s->conv) {
+            fn = pl110_draw_line_conv;
+            fn_opaque = s;
+        }
+    }
 
     src_width = s->cols;
     switch (s->bpp) {
@@ -259,7 +313,7 @@ static void pl110_update_display(void *opaque)
                                s->cols, s->rows,
                                src_width, dest_width, 0,
                                s->invalidate,
-                               fn, s->palette,
+                               fn, fn_opaque,
                                &first, &last);
 
     if (first >= 0) {
@@ -139,6 +139,11 @@ virtio_gpu_base_device_realize(DeviceState *qdev,
     g->use_virgl_renderer = false;
     if (virtio_gpu_virgl_enabled(g->conf)) {
         error_setg(&g->migration_blocker, "virgl is not yet migratable");
+    } else if (virtio_gpu_blob_enabled(g->conf)) {
+        error_setg(&g->migration_blocker,
+                   "blob resources are not yet migratable");
+    }
+    if (g->migration_blocker) {
         migrate_add_blocker(g->migration_blocker, &local_err);
         if (local_err) {
             error_propagate(errp, local_err);
@@ -188,6 +193,9 @@ virtio_gpu_base_get_features(VirtIODevice *vdev, uint64_t features,
     if (virtio_gpu_edid_enabled(g->conf)) {
         features |= (1 << VIRTIO_GPU_F_EDID);
     }
+    if (virtio_gpu_blob_enabled(g->conf)) {
+        features |= (1 << VIRTIO_GPU_F_RESOURCE_BLOB);
+    }
 
     return features;
 }
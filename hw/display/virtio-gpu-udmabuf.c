@@ -0,0 +1,129 @@
+/*
+ * Virtio GPU Device, blob resources backed by udmabuf
+ *
+ * The backing of a blob resource is a list of guest pages that are
+ * scattered in the host address space.  udmabuf turns them into a single
+ * dma-buf, whose mapping shows the pages contiguously, so that the
+ * display can scan them out without a copy.  The guest RAM must be
+ * backed by a sealed memfd for this, i.e. memory-backend-memfd.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "exec/memory.h"
+#include "hw/virtio/virtio-gpu.h"
+
+#ifdef CONFIG_LINUX
+
+#include <sys/ioctl.h>
+#include <linux/udmabuf.h>
+
+static int udmabuf_dev = -1;
+
+static int virtio_gpu_udmabuf_dev(void)
+{
+    static bool opened;
+
+    if (!opened) {
+        udmabuf_dev = qemu_open("/dev/udmabuf", O_RDWR);
+        opened = true;
+    }
+    return udmabuf_dev;
+}
+
+bool virtio_gpu_have_udmabuf(void)
+{
+    return virtio_gpu_udmabuf_dev() >= 0;
+}
+
+static int virtio_gpu_create_udmabuf(struct virtio_gpu_simple_resource *res)
+{
+    struct udmabuf_create_list *list;
+    int i, fd = -1;
+
+    list = g_malloc0(sizeof(*list) + sizeof(list->list[0]) * res->iov_cnt);
+    list->flags = UDMABUF_FLAGS_CLOEXEC;
+    list->count = res->iov_cnt;
+    for (i = 0; i < res->iov_cnt; i++) {
+        MemoryRegion *mr;
+        ram_addr_t offset;
+
+        mr = memory_region_from_host(res->iov[i].iov_base, &offset);
+        if (!mr || memory_region_get_fd(mr) < 0) {
+            goto out;
+        }
+        list->list[i].memfd = memory_region_get_fd(mr);
+        list->list[i].offset = offset;
+        list->list[i].size = res->iov[i].iov_len;
+    }
+
+    fd = ioctl(virtio_gpu_udmabuf_dev(), UDMABUF_CREATE_LIST, list);
+    if (fd < 0) {
+        error_report("virtio-gpu: cannot create udmabuf for resource %d: %s",
+                     res->resource_id, strerror(errno));
+    }
+
+out:
+    g_free(list);
+    return fd;
+}
+
+void virtio_gpu_init_udmabuf(struct virtio_gpu_simple_resource *res)
+{
+    void *map;
+    int fd;
+
+    res->dmabuf_fd = -1;
+    if (res->iov_cnt == 1) {
+        /* already contiguous */
+        res->blob = res->iov[0].iov_base;
+        return;
+    }
+
+    fd = virtio_gpu_create_udmabuf(res);
+    if (fd < 0) {
+        return;
+    }
+    map = mmap(NULL, res->blob_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return;
+    }
+    res->dmabuf_fd = fd;
+    res->blob = map;
+}
+
+void virtio_gpu_fini_udmabuf(struct virtio_gpu_simple_resource *res)
+{
+    if (res->dmabuf_fd >= 0) {
+        munmap(res->blob, res->blob_size);
+        close(res->dmabuf_fd);
+        res->dmabuf_fd = -1;
+    }
+    res->blob = NULL;
+}
+
+#else
+
+bool virtio_gpu_have_udmabuf(void)
+{
+    return false;
+}
+
+void virtio_gpu_init_udmabuf(struct virtio_gpu_simple_resource *res)
+{
+    res->dmabuf_fd = -1;
+    if (res->iov_cnt == 1) {
+        res->blob = res->iov[0].iov_base;
+    }
+}
+
+void virtio_gpu_fini_udmabuf(struct virtio_gpu_simple_resource *res)
+{
+    res->blob = NULL;
+}
+
+#endif
@@ -4,11 +4,14 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/units.h"
 #include "qapi/error.h"
 #include "hw/dma/bcm2835_dma.h"
 #include "hw/irq.h"
+#include "hw/qdev-properties.h"
 #include "migration/vmstate.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "qemu/module.h"
 
 /* DMA CS Control and Status bits */
@@ -33,6 +36,7 @@
 #define BCM2708_DMA_S_WIDTH     (1 << 9)
 #define BCM2708_DMA_S_DREQ      (1 << 10)
 #define BCM2708_DMA_S_IGNORE    (1 << 11)
+#define BCM2708_DMA_PERMAP(ti)  extract32(ti, 16, 5) /* DREQ to pace with */
 
 /* Register offsets */
 #define BCM2708_DMA_CS          0x00 /* Control and Status */
@@ -51,93 +55,490 @@
 
 #define BCM2708_DMA_CS_RW_MASK  0x30ff0001 /* All RW bits in DMA_CS */
 
-static void bcm2835_dma_update(BCM2835DMAState *s, unsigned c)
+/* BCM2711 DMA4 ("40-bit") channel registers. CS is laid out (nearly) like
+ * the legacy one; bit 31 is HALT rather than RESET.
+ */
+#define BCM2711_DMA4_CS         0x00
+#define BCM2711_DMA4_CB         0x04 /* CB address >> 5 */
+#define BCM2711_DMA4_DEBUG      0x0c
+#define BCM2711_DMA4_TI         0x10
+#define BCM2711_DMA4_SRC        0x14
+#define BCM2711_DMA4_SRCI       0x18
+#define BCM2711_DMA4_DEST       0x1c
+#define BCM2711_DMA4_DESTI      0x20
+#define BCM2711_DMA4_LEN        0x24
+#define BCM2711_DMA4_NEXT_CB    0x28
+#define BCM2711_DMA4_DEBUG2     0x2c
+
+#define BCM2711_DMA4_DREQ_PAUSED (1 << 6) /* CS: held by DREQ flow control */
+#define BCM2711_DMA4_DEBUG_RESET (1 << 23)
+
+/* DMA4 TI bits */
+#define BCM2711_DMA4_INTEN      (1 << 0)
+#define BCM2711_DMA4_TDMODE     (1 << 1)
+#define BCM2711_DMA4_PERMAP(ti) extract32(ti, 9, 5)
+#define BCM2711_DMA4_S_DREQ     (1 << 14)
+#define BCM2711_DMA4_D_DREQ     (1 << 15)
+
+/* DMA4 SRCI/DESTI bits; bits 7:0 hold bits 39:32 of the address */
+#define BCM2711_DMA4_INC        (1 << 12)
+#define BCM2711_DMA4_IGNORE     (1 << 15)
+#define BCM2711_DMA4_STRIDE(i)  ((int16_t)extract32(i, 16, 16))
+
+#define BCM2711_DMA4_CB_SHIFT   5 /* CBs are 32-byte aligned */
+
+/* Maximum number of bytes moved by one channel per bottom-half run, before
+ * yielding back to the main loop so that vCPUs and other devices can make
+ * progress.
+ */
+#define BCM2835_DMA_SLICE_BYTES (64 * KiB)
+
+/* Map as much of [addr, addr + *plen) as is backed by directly accessible
+ * RAM. Returns NULL if addr is not RAM (e.g. a peripheral FIFO), so that
+ * the caller can fall back to register-sized accesses.
+ */
+static void *bcm2835_dma_map_ram(AddressSpace *as, hwaddr addr, hwaddr *plen,
+                                 bool is_write)
+{
+    MemoryRegion *mr;
+    hwaddr xlat, len = *plen;
+    bool direct;
+
+    rcu_read_lock();
+    mr = address_space_translate(as, addr, &xlat, &len, is_write,
+                                 MEMTXATTRS_UNSPECIFIED);
+    direct = memory_access_is_direct(mr, is_write);
+    rcu_read_unlock();
+
+    if (!direct) {
+        return NULL;
+    }
+
+    return address_space_map(as, addr, plen, is_write, MEMTXATTRS_UNSPECIFIED);
+}
+
+/* Bulk copy between two RAM ranges. Returns the number of bytes copied,
+ * which is less than len if either range runs into something that is not
+ * RAM.
+ */
+static uint32_t bcm2835_dma_copy_ram(AddressSpace *as, hwaddr src,
+                                     hwaddr dst, uint32_t len)
+{
+    uint32_t done = 0;
+
+    while (done < len) {
+        hwaddr slen = len - done;
+        hwaddr dlen;
+        void *sptr, *dptr;
+
+        sptr = bcm2835_dma_map_ram(as, src + done, &slen, false);
+        if (!sptr) {
+            break;
+        }
+
+        dlen = slen;
+        dptr = bcm2835_dma_map_ram(as, dst + done, &dlen, true);
+        if (!dptr) {
+            address_space_unmap(as, sptr, slen, false, 0);
+            break;
+        }
+
+        /* source and destination may overlap */
+        memmove(dptr, sptr, dlen);
+
+        address_space_unmap(as, dptr, dlen, true, dlen);
+        address_space_unmap(as, sptr, slen, false, dlen);
+        done += dlen;
+    }
+
+    return done;
+}
+
+/* Return the channel's transfer information in the legacy TI format, so
+ * that the engine can treat legacy and DMA4 channels alike.
+ */
+static uint32_t bcm2835_dma_flags(BCM2835DMAChan *ch)
+{
+    uint32_t info;
+
+    if (!ch->dma4) {
+        return ch->ti;
+    }
+
+    info = ch->ti & (BCM2711_DMA4_INTEN | BCM2711_DMA4_TDMODE);
+    if (ch->srci & BCM2711_DMA4_INC) {
+        info |= BCM2708_DMA_S_INC;
+    }
+    if (ch->srci & BCM2711_DMA4_IGNORE) {
+        info |= BCM2708_DMA_S_IGNORE;
+    }
+    if (ch->dsti & BCM2711_DMA4_INC) {
+        info |= BCM2708_DMA_D_INC;
+    }
+    if (ch->dsti & BCM2711_DMA4_IGNORE) {
+        info |= BCM2708_DMA_D_IGNORE;
+    }
+    if (ch->ti & BCM2711_DMA4_S_DREQ) {
+        info |= BCM2708_DMA_S_DREQ;
+    }
+    if (ch->ti & BCM2711_DMA4_D_DREQ) {
+        info |= BCM2708_DMA_D_DREQ;
+    }
+
+    return deposit32(info, 16, 5, BCM2711_DMA4_PERMAP(ch->ti));
+}
+
+static hwaddr bcm2835_dma_src(BCM2835DMAChan *ch)
+{
+    return ch->dma4 ? deposit64(ch->source_ad, 32, 8, ch->srci)
+                    : ch->source_ad;
+}
+
+static hwaddr bcm2835_dma_dst(BCM2835DMAChan *ch)
+{
+    return ch->dma4 ? deposit64(ch->dest_ad, 32, 8, ch->dsti)
+                    : ch->dest_ad;
+}
+
+/* Move the source and destination addresses on; legacy channels wrap at
+ * 32 bits, DMA4 channels at 40.
+ */
+static void bcm2835_dma_advance(BCM2835DMAChan *ch, int64_t src_inc,
+                                int64_t dst_inc)
+{
+    hwaddr src = bcm2835_dma_src(ch) + src_inc;
+    hwaddr dst = bcm2835_dma_dst(ch) + dst_inc;
+
+    ch->source_ad = src;
+    ch->dest_ad = dst;
+    if (ch->dma4) {
+        ch->srci = deposit32(ch->srci, 0, 8, src >> 32);
+        ch->dsti = deposit32(ch->dsti, 0, 8, dst >> 32);
+    }
+}
+
+/* Is the channel allowed to move data right now, given its DREQ pacing? */
+static bool bcm2835_dma_dreq_ready(BCM2835DMAState *s, BCM2835DMAChan *ch)
+{
+    uint32_t info = bcm2835_dma_flags(ch);
+    unsigned permap = BCM2708_DMA_PERMAP(info);
+
+    if (!(info & (BCM2708_DMA_S_DREQ | BCM2708_DMA_D_DREQ)) || permap == 0) {
+        return true;
+    }
+
+    return s->dreq & (1u << permap);
+}
+
+/* Paced transfer between RAM and a FIFO registered with
+ * bcm2835_dma_set_fifo(), moved in bursts straight from or to guest memory.
+ * Returns the number of bytes moved, which is 0 if the channel does not
+ * use such a FIFO and may be short if the FIFO runs full or empty.
+ */
+static uint32_t bcm2835_dma_xfer_fifo(BCM2835DMAState *s, BCM2835DMAChan *ch,
+                                      uint32_t info, uint32_t len)
+{
+    BCM2835DMAFifo *f = &s->fifo[BCM2708_DMA_PERMAP(info)];
+    hwaddr fifo_addr, ram_addr, xlat, plen = 4;
+    MemoryRegion *mr;
+    uint32_t n, done = 0;
+    bool to_fifo;
+    void *ram;
+
+    if (!(info & (BCM2708_DMA_S_DREQ | BCM2708_DMA_D_DREQ)) || !f->fn) {
+        return 0;
+    }
+
+    switch (info & (BCM2708_DMA_S_INC | BCM2708_DMA_D_INC |
+                    BCM2708_DMA_S_IGNORE | BCM2708_DMA_D_IGNORE)) {
+    case BCM2708_DMA_D_INC:
+        to_fifo = false;
+        fifo_addr = bcm2835_dma_src(ch);
+        ram_addr = bcm2835_dma_dst(ch);
+        break;
+    case BCM2708_DMA_S_INC:
+        to_fifo = true;
+        fifo_addr = bcm2835_dma_dst(ch);
+        ram_addr = bcm2835_dma_src(ch);
+        break;
+    default:
+        return 0;
+    }
+
+    rcu_read_lock();
+    mr = address_space_translate(ch->as, fifo_addr, &xlat, &plen, to_fifo,
+                                 MEMTXATTRS_UNSPECIFIED);
+    rcu_read_unlock();
+    if (mr != f->mr || xlat != f->offset) {
+        return 0;
+    }
+
+    while (len - done >= 4) {
+        plen = (len - done) & ~3;
+        ram = bcm2835_dma_map_ram(ch->as, ram_addr + done, &plen, !to_fifo);
+        if (!ram) {
+            break;
+        }
+        n = plen >= 4 ? f->fn(f->opaque, ram, plen & ~3, to_fifo) : 0;
+        address_space_unmap(ch->as, ram, plen, !to_fifo, to_fifo ? 0 : n);
+        done += n;
+        if (n == 0 || n < (plen & ~3)) {
+            break;
+        }
+    }
+
+    bcm2835_dma_advance(ch, to_fifo ? done : 0, to_fifo ? 0 : done);
+    return done;
+}
+
+/* Transfer up to len bytes of the current row. Returns the number of bytes
+ * moved, which may be short if the peripheral's DREQ drops.
+ */
+static uint32_t bcm2835_dma_xfer(BCM2835DMAState *s, BCM2835DMAChan *ch,
+                                 uint32_t len)
+{
+    uint32_t info = bcm2835_dma_flags(ch);
+    uint32_t data, done = 0;
+
+    /* Fast path: unpaced memory-to-memory copies are done in bulk */
+    if ((info & (BCM2708_DMA_S_INC | BCM2708_DMA_D_INC |
+                 BCM2708_DMA_S_IGNORE | BCM2708_DMA_D_IGNORE))
+        == (BCM2708_DMA_S_INC | BCM2708_DMA_D_INC)
+        && (!(info & (BCM2708_DMA_S_DREQ | BCM2708_DMA_D_DREQ))
+            || BCM2708_DMA_PERMAP(info) == 0)) {
+        done = bcm2835_dma_copy_ram(ch->as, bcm2835_dma_src(ch),
+                                    bcm2835_dma_dst(ch), len);
+        bcm2835_dma_advance(ch, done, done);
+    } else if (BCM2708_DMA_PERMAP(info) != 0) {
+        done = bcm2835_dma_xfer_fifo(s, ch, info, len);
+    }
+
+    /* Slow path: word by word, for FIFOs and other MMIO endpoints */
+    while (done < len && bcm2835_dma_dreq_ready(s, ch)) {
+        if (info & BCM2708_DMA_S_IGNORE) {
+            /* Ignore reads */
+            data = 0;
+        } else {
+            data = ldl_le_phys(ch->as, bcm2835_dma_src(ch));
+        }
+
+        if (info & BCM2708_DMA_D_IGNORE) {
+            /* Ignore writes */
+        } else {
+            stl_le_phys(ch->as, bcm2835_dma_dst(ch), data);
+        }
+
+        bcm2835_dma_advance(ch, (info & BCM2708_DMA_S_INC) ? 4 : 0,
+                            (info & BCM2708_DMA_D_INC) ? 4 : 0);
+
+        done += MIN(len - done, 4);
+    }
+
+    return done;
+}
+
+/* Load the control block at CONBLK_AD into the channel registers */
+static void bcm2835_dma_load_cb(BCM2835DMAChan *ch)
+{
+    hwaddr cb;
+
+    if (ch->dma4) {
+        cb = (hwaddr)ch->conblk_ad << BCM2711_DMA4_CB_SHIFT;
+        ch->ti = ldl_le_phys(ch->as, cb);
+        ch->source_ad = ldl_le_phys(ch->as, cb + 4);
+        ch->srci = ldl_le_phys(ch->as, cb + 8);
+        ch->dest_ad = ldl_le_phys(ch->as, cb + 12);
+        ch->dsti = ldl_le_phys(ch->as, cb + 16);
+        ch->txfr_len = ldl_le_phys(ch->as, cb + 20);
+        ch->nextconbk = ldl_le_phys(ch->as, cb + 24);
+    } else {
+        cb = ch->conblk_ad;
+        ch->ti = ldl_le_phys(ch->as, cb);
+        ch->source_ad = ldl_le_phys(ch->as, cb + 4);
+        ch->dest_ad = ldl_le_phys(ch->as, cb + 8);
+        ch->txfr_len = ldl_le_phys(ch->as, cb + 12);
+        ch->stride = ldl_le_phys(ch->as, cb + 16);
+        ch->nextconbk = ldl_le_phys(ch->as, cb + 20);
+    }
+
+    if (bcm2835_dma_flags(ch) & BCM2708_DMA_TDMODE) {
+        ch->xlength = ch->txfr_len & 0xffff;
+    } else {
+        ch->xlength = ch->txfr_len;
+    }
+    ch->cb_loaded = true;
+}
+
+/* Finish the current CB (signalling END/INT as requested when complete is
+ * set, rather than aborted) and move on to the next one in the chain.
+ */
+static void bcm2835_dma_next_cb(BCM2835DMAState *s, unsigned c, bool complete)
 {
     BCM2835DMAChan *ch = &s->chan[c];
-    uint32_t data, xlen, ylen;
-    int16_t dst_stride, src_stride;
 
-    if (!(s->enable & (1 << c))) {
-        return;
+    if (complete) {
+        ch->cs |= BCM2708_DMA_END;
+        if (bcm2835_dma_flags(ch) & BCM2708_DMA_INT_EN) {
+            ch->cs |= BCM2708_DMA_INT;
+            s->int_status |= (1 << c);
+            qemu_set_irq(ch->irq, 1);
+        }
+    }
+
+    ch->cb_loaded = false;
+    ch->conblk_ad = ch->nextconbk;
+    if (ch->conblk_ad != 0) {
+        bcm2835_dma_load_cb(ch);
+    } else {
+        ch->cs &= ~BCM2708_DMA_ACTIVE;
+        ch->cs |= BCM2708_DMA_ISPAUSED;
     }
+}
+
+static bool bcm2835_dma_runnable(BCM2835DMAState *s, unsigned c)
+{
+    BCM2835DMAChan *ch = &s->chan[c];
+
+    return (s->enable & (1 << c)) && (ch->cs & BCM2708_DMA_ACTIVE)
+        && ch->cb_loaded;
+}
 
-    while ((s->enable & (1 << c)) && (ch->conblk_ad != 0)) {
-        /* CB fetch */
-        ch->ti = ldl_le_phys(&s->dma_as, ch->conblk_ad);
-        ch->source_ad = ldl_le_phys(&s->dma_as, ch->conblk_ad + 4);
-        ch->dest_ad = ldl_le_phys(&s->dma_as, ch->conblk_ad + 8);
-        ch->txfr_len = ldl_le_phys(&s->dma_as, ch->conblk_ad + 12);
-        ch->stride = ldl_le_phys(&s->dma_as, ch->conblk_ad + 16);
-        ch->nextconbk = ldl_le_phys(&s->dma_as, ch->conblk_ad + 20);
+/* Run channel c for at most budget bytes. Returns true if the channel ran
+ * out of budget while it still had work that it could make progress on.
+ */
+static bool bcm2835_dma_run_chan(BCM2835DMAState *s, unsigned c,
+                                 uint32_t budget)
+{
+    BCM2835DMAChan *ch = &s->chan[c];
+    uint32_t held = ch->dma4 ? BCM2711_DMA4_DREQ_PAUSED : BCM2708_DMA_ISHELD;
+    uint32_t xlen, ylen, done;
+    int16_t dst_stride, src_stride;
+    bool tdmode;
 
-        if (ch->ti & BCM2708_DMA_TDMODE) {
-            /* 2D transfer mode */
+    while (bcm2835_dma_runnable(s, c)) {
+        tdmode = bcm2835_dma_flags(ch) & BCM2708_DMA_TDMODE;
+        if (tdmode) {
+            /* 2D transfer mode: ylen counts the rows left, including the
+             * current one, and xlen the bytes left in the current row */
             ylen = (ch->txfr_len >> 16) & 0x3fff;
             xlen = ch->txfr_len & 0xffff;
-            dst_stride = ch->stride >> 16;
-            src_stride = ch->stride & 0xffff;
         } else {
             ylen = 1;
             xlen = ch->txfr_len;
-            dst_stride = 0;
-            src_stride = 0;
         }
 
-        while (ylen != 0) {
-            /* Normal transfer mode */
-            while (xlen != 0) {
-                if (ch->ti & BCM2708_DMA_S_IGNORE) {
-                    /* Ignore reads */
-                    data = 0;
-                } else {
-                    data = ldl_le_phys(&s->dma_as, ch->source_ad);
-                }
-                if (ch->ti & BCM2708_DMA_S_INC) {
-                    ch->source_ad += 4;
-                }
-
-                if (ch->ti & BCM2708_DMA_D_IGNORE) {
-                    /* Ignore writes */
-                } else {
-                    stl_le_phys(&s->dma_as, ch->dest_ad, data);
-                }
-                if (ch->ti & BCM2708_DMA_D_INC) {
-                    ch->dest_ad += 4;
-                }
-
-                /* update remaining transfer length */
-                xlen -= 4;
-                if (ch->ti & BCM2708_DMA_TDMODE) {
-                    ch->txfr_len = (ylen << 16) | xlen;
-                } else {
-                    ch->txfr_len = xlen;
-                }
-            }
+        if (ylen == 0 || (!tdmode && xlen == 0)) {
+            bcm2835_dma_next_cb(s, c, true);
+            continue;
+        }
 
+        if (xlen == 0) {
+            /* end of row: apply the strides and start the next one */
+            if (ch->dma4) {
+                dst_stride = BCM2711_DMA4_STRIDE(ch->dsti);
+                src_stride = BCM2711_DMA4_STRIDE(ch->srci);
+            } else {
+                dst_stride = ch->stride >> 16;
+                src_stride = ch->stride & 0xffff;
+            }
             if (--ylen != 0) {
-                ch->source_ad += src_stride;
-                ch->dest_ad += dst_stride;
+                bcm2835_dma_advance(ch, src_stride, dst_stride);
             }
+            ch->txfr_len = ylen ? (ylen << 16) | ch->xlength : 0;
+            continue;
         }
-        ch->cs |= BCM2708_DMA_END;
-        if (ch->ti & BCM2708_DMA_INT_EN) {
-            ch->cs |= BCM2708_DMA_INT;
-            s->int_status |= (1 << c);
-            qemu_set_irq(ch->irq, 1);
+
+        if (budget == 0) {
+            return true;
         }
 
-        /* Process next CB */
-        ch->conblk_ad = ch->nextconbk;
+        if (!bcm2835_dma_dreq_ready(s, ch)) {
+            /* held off by the peripheral; we are rescheduled when its DREQ
+             * is next asserted */
+            ch->cs |= held;
+            return false;
+        }
+        ch->cs &= ~held;
+
+        done = bcm2835_dma_xfer(s, ch, MIN(xlen, budget));
+        budget -= MIN(done, budget);
+        xlen -= done;
+
+        /* update remaining transfer length */
+        if (tdmode) {
+            ch->txfr_len = (ylen << 16) | xlen;
+        } else {
+            ch->txfr_len = xlen;
+        }
     }
 
-    ch->cs &= ~BCM2708_DMA_ACTIVE;
-    ch->cs |= BCM2708_DMA_ISPAUSED;
+    return false;
+}
+
+/* Channel engine: gives each runnable channel a bounded slice in turn, and
+ * reschedules itself while any channel still has work to do.
+ */
+static void bcm2835_dma_bh(void *opaque)
+{
+    BCM2835DMAState *s = opaque;
+    bool more = false;
+    unsigned c;
+
+    for (c = 0; c < BCM2835_DMA_NCHANS; c++) {
+        if (bcm2835_dma_run_chan(s, c, BCM2835_DMA_SLICE_BYTES)) {
+            more = true;
+        }
+    }
+
+    if (more) {
+        qemu_bh_schedule(s->bh);
+    }
+}
+
+/* Start or resume a channel whose ACTIVE bit was just set */
+static void bcm2835_dma_activate(BCM2835DMAState *s, unsigned c)
+{
+    BCM2835DMAChan *ch = &s->chan[c];
+
+    if (!ch->cb_loaded) {
+        if (ch->conblk_ad == 0) {
+            ch->cs &= ~BCM2708_DMA_ACTIVE;
+            ch->cs |= BCM2708_DMA_ISPAUSED;
+            return;
+        }
+        bcm2835_dma_load_cb(ch);
+    }
+
+    ch->cs &= ~BCM2708_DMA_ISPAUSED;
+    qemu_bh_schedule(s->bh);
+}
+
+static void bcm2835_dma_set_dreq(void *opaque, int n, int level)
+{
+    BCM2835DMAState *s = opaque;
+
+    s->dreq = deposit32(s->dreq, n, 1, !!level);
+    if (level) {
+        qemu_bh_schedule(s->bh);
+    }
+}
+
+void bcm2835_dma_set_fifo(BCM2835DMAState *s, unsigned permap,
+                          MemoryRegion *mr, hwaddr offset,
+                          BCM2835DMAFifoFn *fn, void *opaque)
+{
+    assert(permap > 0 && permap < BCM2835_DMA_NDREQ);
+    s->fifo[permap].mr = mr;
+    s->fifo[permap].offset = offset;
+    s->fifo[permap].fn = fn;
+    s->fifo[permap].opaque = opaque;
 }
 
 static void bcm2835_dma_chan_reset(BCM2835DMAChan *ch)
 {
     ch->cs = 0;
     ch->conblk_ad = 0;
+    ch->cb_loaded = false;
 }
 
 static uint64_t bcm2835_dma_read(BCM2835DMAState *s, hwaddr offset,
@@ -187,11 +588,46 @@ static uint64_t bcm2835_dma_read(BCM2835DMAState *s, hwaddr offset,
     return res;
 }
 
+/* CS is common to legacy and DMA4 channels */
+static void bcm2835_dma_write_cs(BCM2835DMAState *s, unsigned c,
+                                 uint32_t value)
+{
+    BCM2835DMAChan *ch = &s->chan[c];
+    uint32_t oldcs = ch->cs;
+
+    if (value & BCM2708_DMA_RESET) {
+        /* for DMA4 channels this is HALT, which we treat the same */
+        bcm2835_dma_chan_reset(ch);
+    }
+    if ((value & BCM2708_DMA_ABORT) && ch->cb_loaded) {
+        /* drop the rest of the current CB and load the next one */
+        bcm2835_dma_next_cb(s, c, false);
+        oldcs = ch->cs;
+    }
+    if (value & BCM2708_DMA_END) {
+        ch->cs &= ~BCM2708_DMA_END;
+    }
+    if (value & BCM2708_DMA_INT) {
+        ch->cs &= ~BCM2708_DMA_INT;
+        s->int_status &= ~(1 << c);
+        qemu_set_irq(ch->irq, 0);
+    }
+    ch->cs &= ~BCM2708_DMA_CS_RW_MASK;
+    ch->cs |= (value & BCM2708_DMA_CS_RW_MASK);
+    if (!(oldcs & BCM2708_DMA_ACTIVE) && (ch->cs & BCM2708_DMA_ACTIVE)) {
+        bcm2835_dma_activate(s, c);
+    } else if (!(ch->cs & BCM2708_DMA_ACTIVE)) {
+        /* paused (or idle); the engine skips inactive channels */
+        ch->cs |= BCM2708_DMA_ISPAUSED;
+    } else if ((value & BCM2708_DMA_ABORT) && ch->cb_loaded) {
+        qemu_bh_schedule(s->bh);
+    }
+}
+
 static void bcm2835_dma_write(BCM2835DMAState *s, hwaddr offset,
                               uint64_t value, unsigned size, unsigned c)
 {
     BCM2835DMAChan *ch;
-    uint32_t oldcs;
 
     assert(size == 4);
     assert(c < BCM2835_DMA_NCHANS);
@@ -200,29 +636,11 @@ static void bcm2835_dma_write(BCM2835DMAState *s, hwaddr offset,
 
     switch (offset) {
     case BCM2708_DMA_CS:
-        oldcs = ch->cs;
-        if (value & BCM2708_DMA_RESET) {
-            bcm2835_dma_chan_reset(ch);
-        }
-        if (value & BCM2708_DMA_ABORT) {
-            /* abort is a no-op, since we always run to completion */
-        }
-        if (value & BCM2708_DMA_END) {
-            ch->cs &= ~BCM2708_DMA_END;
-        }
-        if (value & BCM2708_DMA_INT) {
-            ch->cs &= ~BCM2708_DMA_INT;
-            s->int_status &= ~(1 << c);
-            qemu_set_irq(ch->irq, 0);
-        }
-        ch->cs &= ~BCM2708_DMA_CS_RW_MASK;
-        ch->cs |= (value & BCM2708_DMA_CS_RW_MASK);
-        if (!(oldcs & BCM2708_DMA_ACTIVE) && (ch->cs & BCM2708_DMA_ACTIVE)) {
-            bcm2835_dma_update(s, c);
-        }
+        bcm2835_dma_write_cs(s, c, value);
         break;
     case BCM2708_DMA_ADDR:
         ch->conblk_ad = value;
+        ch->cb_loaded = false;
         break;
     case BCM2708_DMA_DEBUG:
         ch->debug = value;
@@ -234,12 +652,102 @@ static void bcm2835_dma_write(BCM2835DMAState *s, hwaddr offset,
     }
 }
 
+static uint64_t bcm2711_dma4_read(BCM2835DMAState *s, hwaddr offset,
+                                  unsigned size, unsigned c)
+{
+    BCM2835DMAChan *ch;
+    uint32_t res = 0;
+
+    assert(size == 4);
+    assert(c < BCM2835_DMA_NCHANS);
+
+    ch = &s->chan[c];
+
+    switch (offset) {
+    case BCM2711_DMA4_CS:
+        res = ch->cs;
+        break;
+    case BCM2711_DMA4_CB:
+        res = ch->conblk_ad;
+        break;
+    case BCM2711_DMA4_DEBUG:
+        res = ch->debug;
+        break;
+    case BCM2711_DMA4_TI:
+        res = ch->ti;
+        break;
+    case BCM2711_DMA4_SRC:
+        res = ch->source_ad;
+        break;
+    case BCM2711_DMA4_SRCI:
+        res = ch->srci;
+        break;
+    case BCM2711_DMA4_DEST:
+        res = ch->dest_ad;
+        break;
+    case BCM2711_DMA4_DESTI:
+        res = ch->dsti;
+        break;
+    case BCM2711_DMA4_LEN:
+        res = ch->txfr_len;
+        break;
+    case BCM2711_DMA4_NEXT_CB:
+        res = ch->nextconbk;
+        break;
+    case BCM2711_DMA4_DEBUG2:
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%"HWADDR_PRIx"\n",
+                      __func__, offset);
+        break;
+    }
+    return res;
+}
+
+static void bcm2711_dma4_write(BCM2835DMAState *s, hwaddr offset,
+                               uint64_t value, unsigned size, unsigned c)
+{
+    BCM2835DMAChan *ch;
+
+    assert(size == 4);
+    assert(c < BCM2835_DMA_NCHANS);
+
+    ch = &s->chan[c];
+
+    switch (offset) {
+    case BCM2711_DMA4_CS:
+        bcm2835_dma_write_cs(s, c, value);
+        break;
+    case BCM2711_DMA4_CB:
+        ch->conblk_ad = value;
+        ch->cb_loaded = false;
+        break;
+    case BCM2711_DMA4_DEBUG:
+        if (value & BCM2711_DMA4_DEBUG_RESET) {
+            bcm2835_dma_chan_reset(ch);
+        }
+        ch->debug = value & ~BCM2711_DMA4_DEBUG_RESET;
+        break;
+    case BCM2711_DMA4_DEBUG2:
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%"HWADDR_PRIx"\n",
+                      __func__, offset);
+        break;
+    }
+}
+
 static uint64_t bcm2835_dma0_read(void *opaque, hwaddr offset, unsigned size)
 {
     BCM2835DMAState *s = opaque;
 
     if (offset < 0xf00) {
-        return bcm2835_dma_read(s, (offset & 0xff), size, (offset >> 8) & 0xf);
+        unsigned c = (offset >> 8) & 0xf;
+
+        if (s->chan[c].dma4) {
+            return bcm2711_dma4_read(s, (offset & 0xff), size, c);
+        }
+        return bcm2835_dma_read(s, (offset & 0xff), size, c);
     } else {
         switch (offset) {
         case BCM2708_DMA_INT_STATUS:
@@ -265,13 +773,20 @@ static void bcm2835_dma0_write(void *opaque, hwaddr offset, uint64_t value,
     BCM2835DMAState *s = opaque;
 
     if (offset < 0xf00) {
-        bcm2835_dma_write(s, (offset & 0xff), value, size, (offset >> 8) & 0xf);
+        unsigned c = (offset >> 8) & 0xf;
+
+        if (s->chan[c].dma4) {
+            bcm2711_dma4_write(s, (offset & 0xff), value, size, c);
+        } else {
+            bcm2835_dma_write(s, (offset & 0xff), value, size, c);
+        }
     } else {
         switch (offset) {
         case BCM2708_DMA_INT_STATUS:
             break;
         case BCM2708_DMA_ENABLE:
             s->enable = (value & 0xffff);
+            qemu_bh_schedule(s->bh);
             break;
         default:
             qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%"HWADDR_PRIx"\n",
@@ -305,8 +820,8 @@ static const MemoryRegionOps bcm2835_dma15_ops = {
 
 static const VMStateDescription vmstate_bcm2835_dma_chan = {
     .name = TYPE_BCM2835_DMA "-chan",
-    .version_id = 1,
-    .minimum_version_id = 1,
+    .version_id = 3,
+    .minimum_version_id = 3,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32(cs, BCM2835DMAChan),
         VMSTATE_UINT32(conblk_ad, BCM2835DMAChan),
@@ -317,19 +832,34 @@ static const VMStateDescription vmstate_bcm2835_dma_chan = {
         VMSTATE_UINT32(stride, BCM2835DMAChan),
         VMSTATE_UINT32(nextconbk, BCM2835DMAChan),
         VMSTATE_UINT32(debug, BCM2835DMAChan),
+        VMSTATE_UINT32(srci, BCM2835DMAChan),
+        VMSTATE_UINT32(dsti, BCM2835DMAChan),
+        VMSTATE_UINT32(xlength, BCM2835DMAChan),
+        VMSTATE_BOOL(cb_loaded, BCM2835DMAChan),
         VMSTATE_END_OF_LIST()
     }
 };
 
+static int bcm2835_dma_post_load(void *opaque, int version_id)
+{
+    BCM2835DMAState *s = opaque;
+
+    /* pick up any transfers that were in flight */
+    qemu_bh_schedule(s->bh);
+    return 0;
+}
+
 static const VMStateDescription vmstate_bcm2835_dma = {
     .name = TYPE_BCM2835_DMA,
-    .version_id = 1,
-    .minimum_version_id = 1,
+    .version_id = 3,
+    .minimum_version_id = 3,
+    .post_load = bcm2835_dma_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_STRUCT_ARRAY(chan, BCM2835DMAState, BCM2835_DMA_NCHANS, 1,
                              vmstate_bcm2835_dma_chan, BCM2835DMAChan),
         VMSTATE_UINT32(int_status, BCM2835DMAState),
         VMSTATE_UINT32(enable, BCM2835DMAState),
+        VMSTATE_UINT32(dreq, BCM2835DMAState),
         VMSTATE_END_OF_LIST()
     }
 };
@@ -355,6 +885,13 @@ static void bcm2835_dma_init(Object *obj)
     for (n = 0; n < 16; n++) {
         sysbus_init_irq(SYS_BUS_DEVICE(s), &s->chan[n].irq);
     }
+
+    /* DREQ lines from peripherals. Lines that nobody drives read as
+     * asserted, so paced transfers to unmodelled peripherals still run.
+     */
+    qdev_init_gpio_in_named(DEVICE(s), bcm2835_dma_set_dreq,
+                            BCM2835_DMA_DREQ, BCM2835_DMA_NDREQ);
+    s->dreq = UINT32_MAX;
 }
 
 static void bcm2835_dma_reset(DeviceState *dev)
@@ -374,6 +911,7 @@ static void bcm2835_dma_realize(DeviceState *dev, Error **errp)
     BCM2835DMAState *s = BCM2835_DMA(dev);
     Error *err = NULL;
     Object *obj;
+    int n;
 
     obj = object_property_get_link(OBJECT(dev), "dma-mr", &err);
     if (obj == NULL) {
@@ -385,14 +923,41 @@ static void bcm2835_dma_realize(DeviceState *dev, Error **errp)
     s->dma_mr = MEMORY_REGION(obj);
     address_space_init(&s->dma_as, s->dma_mr, TYPE_BCM2835_DMA "-memory");
 
+    if (s->dma4_chans) {
+        obj = object_property_get_link(OBJECT(dev), "dma4-mr", &err);
+        if (obj == NULL) {
+            error_setg(errp, "%s: required dma4-mr link not found: %s",
+                       __func__, error_get_pretty(err));
+            return;
+        }
+
+        s->dma4_mr = MEMORY_REGION(obj);
+        address_space_init(&s->dma4_as, s->dma4_mr,
+                           TYPE_BCM2835_DMA "-dma4-memory");
+    }
+
+    for (n = 0; n < BCM2835_DMA_NCHANS; n++) {
+        s->chan[n].dma4 = s->dma4_chans & (1 << n);
+        s->chan[n].as = s->chan[n].dma4 ? &s->dma4_as : &s->dma_as;
+    }
+
+    s->bh = qemu_bh_new(bcm2835_dma_bh, s);
+
     bcm2835_dma_reset(dev);
 }
 
+static Property bcm2835_dma_props[] = {
+    /* channels implemented as BCM2711 DMA4 (40-bit address) engines */
+    DEFINE_PROP_UINT32("dma4-chans", BCM2835DMAState, dma4_chans, 0),
+    DEFINE_PROP_END_OF_LIST()
+};
+
 static void bcm2835_dma_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
 
     dc->realize = bcm2835_dma_realize;
+    dc->props = bcm2835_dma_props;
     dc->reset = bcm2835_dma_reset;
     dc->vmsd = &vmstate_bcm2835_dma;
 }
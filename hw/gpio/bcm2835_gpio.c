@@ -12,11 +12,15 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "qemu/module.h"
 #include "qemu/timer.h"
 #include "qapi/error.h"
 #include "hw/sysbus.h"
+#include "hw/qdev-properties.h"
 #include "migration/vmstate.h"
 #include "hw/sd/sd.h"
 #include "hw/gpio/bcm2835_gpio.h"
@@ -52,6 +56,219 @@
 #define GPPUDCLK0 0x98
 #define GPPUDCLK1 0x9C
 
+#define BCM2835_GPIO_PIN_MASK   ((1ULL << BCM2835_GPIO_NUM_PINS) - 1)
+
+/* Limit on injected transitions waiting for their timestamp */
+#define BCM2835_GPIO_INJECT_MAX 4096
+
+/* Pins behind each of the GPU's gpio_int[] lines; the last is "any" */
+static const uint64_t bcm2835_gpio_irq_pins[BCM2835_GPIO_NUM_IRQS] = {
+    0x000000000fffffffULL,  /* GPIO 0-27 */
+    0x00003ffff0000000ULL,  /* GPIO 28-45 */
+    0x003fc00000000000ULL,  /* GPIO 46-53 */
+    BCM2835_GPIO_PIN_MASK,
+};
+
+static uint64_t bcm2835_gpio_levels(BCM2835GpioState *s)
+{
+    uint64_t latch = ((uint64_t)s->lev1 << 32) | s->lev0;
+    uint64_t out = 0;
+    int i;
+
+    for (i = 0; i < BCM2835_GPIO_NUM_PINS; i++) {
+        if (s->fsel[i] == 1) {
+            out |= 1ULL << i;
+        }
+    }
+
+    /* outputs read back the latch, everything else what is driven on it */
+    return ((latch & out) | (s->in_lev & ~out)) & BCM2835_GPIO_PIN_MASK;
+}
+
+/*
+ * Run the edge and level detectors against the current pin levels.
+ * Call with s->lock held.
+ */
+static void bcm2835_gpio_detect(BCM2835GpioState *s)
+{
+    uint64_t level = bcm2835_gpio_levels(s);
+    uint64_t rising = level & ~s->level;
+    uint64_t falling = ~level & s->level;
+
+    /* the asynchronous detectors see the same edges, just unsampled */
+    s->eds |= (rising & (s->ren | s->aren)) | (falling & (s->fen | s->afen))
+              | (level & s->hen) | (~level & s->len);
+    s->eds &= BCM2835_GPIO_PIN_MASK;
+    s->level = level;
+}
+
+static void bcm2835_gpio_update_irq(BCM2835GpioState *s)
+{
+    int i;
+
+    for (i = 0; i < BCM2835_GPIO_NUM_IRQS; i++) {
+        qemu_set_irq(s->irq[i], !!(s->eds & bcm2835_gpio_irq_pins[i]));
+    }
+}
+
+static void bcm2835_gpio_update(BCM2835GpioState *s)
+{
+    qemu_mutex_lock(&s->lock);
+    bcm2835_gpio_detect(s);
+    qemu_mutex_unlock(&s->lock);
+    bcm2835_gpio_update_irq(s);
+}
+
+/* Report an output pin change on the side channel */
+static void bcm2835_gpio_notify(BCM2835GpioState *s, int pin, int level)
+{
+    char buf[48];
+    int len;
+
+    if (!qemu_chr_fe_backend_connected(&s->chr)) {
+        return;
+    }
+
+    len = snprintf(buf, sizeof(buf), "%" PRId64 " %d %d\n",
+                   qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL), pin, level);
+    /* XXX this blocks entire thread. Rewrite to use
+     * qemu_chr_fe_write and background I/O callbacks */
+    qemu_chr_fe_write_all(&s->chr, (uint8_t *)buf, len);
+}
+
+static void bcm2835_gpio_set_pin(BCM2835GpioState *s, int pin, bool level)
+{
+    s->in_lev = deposit64(s->in_lev, pin, 1, level);
+}
+
+static void bcm2835_gpio_set_input(void *opaque, int pin, int level)
+{
+    BCM2835GpioState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    bcm2835_gpio_set_pin(s, pin, level);
+    qemu_mutex_unlock(&s->lock);
+    bcm2835_gpio_update(s);
+}
+
+/* Apply every injected transition that is due, then update the IRQs once */
+static void bcm2835_gpio_inject(void *opaque)
+{
+    BCM2835GpioState *s = opaque;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    BCM2835GpioEvent *ev;
+
+    qemu_mutex_lock(&s->lock);
+    while ((ev = QTAILQ_FIRST(&s->inject_queue)) && ev->when <= now) {
+        QTAILQ_REMOVE(&s->inject_queue, ev, next);
+        s->inject_count--;
+        /* detect per event, so a pulse within one batch is still seen */
+        bcm2835_gpio_set_pin(s, ev->pin, ev->level);
+        bcm2835_gpio_detect(s);
+        g_free(ev);
+    }
+    qemu_mutex_unlock(&s->lock);
+    bcm2835_gpio_update_irq(s);
+
+    if (ev) {
+        timer_mod(s->inject_timer, ev->when);
+    }
+}
+
+static void bcm2835_gpio_queue_event(BCM2835GpioState *s, int64_t when,
+                                     unsigned pin, bool level)
+{
+    BCM2835GpioEvent *ev, *pos;
+
+    if (s->inject_count >= BCM2835_GPIO_INJECT_MAX) {
+        warn_report("bcm2835_gpio: too many pending events, dropping one");
+        return;
+    }
+
+    ev = g_new0(BCM2835GpioEvent, 1);
+    ev->when = when;
+    ev->pin = pin;
+    ev->level = level;
+
+    /* batches normally arrive in order, so search from the tail */
+    QTAILQ_FOREACH_REVERSE(pos, &s->inject_queue, next) {
+        if (pos->when <= when) {
+            break;
+        }
+    }
+    if (pos) {
+        QTAILQ_INSERT_AFTER(&s->inject_queue, pos, ev, next);
+    } else {
+        QTAILQ_INSERT_HEAD(&s->inject_queue, ev, next);
+    }
+    s->inject_count++;
+}
+
+/*
+ * One transition per line: "<time> <pin> <level>". The time is in
+ * nanoseconds of QEMU_CLOCK_VIRTUAL, or relative to now with a leading '+'.
+ */
+static void bcm2835_gpio_parse_line(BCM2835GpioState *s)
+{
+    const char *p = s->line;
+    bool relative = false;
+    unsigned pin, level;
+    int64_t when;
+
+    while (g_ascii_isspace(*p)) {
+        p++;
+    }
+    if (*p == '\0' || *p == '#') {
+        return;
+    }
+    if (*p == '+') {
+        relative = true;
+        p++;
+    }
+
+    if (qemu_strtoi64(p, &p, 10, &when) < 0
+        || qemu_strtoui(p, &p, 10, &pin) < 0
+        || qemu_strtoui(p, &p, 10, &level) < 0
+        || pin >= BCM2835_GPIO_NUM_PINS || level > 1) {
+        warn_report("bcm2835_gpio: malformed event '%s'", s->line);
+        return;
+    }
+
+    if (relative) {
+        when += qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    }
+    bcm2835_gpio_queue_event(s, when, pin, level);
+}
+
+static int bcm2835_gpio_can_receive(void *opaque)
+{
+    BCM2835GpioState *s = opaque;
+
+    return sizeof(s->line);
+}
+
+static void bcm2835_gpio_receive(void *opaque, const uint8_t *buf, int size)
+{
+    BCM2835GpioState *s = opaque;
+    BCM2835GpioEvent *first;
+    int i;
+
+    for (i = 0; i < size; i++) {
+        if (buf[i] == '\n' || buf[i] == '\r') {
+            s->line[s->line_len] = '\0';
+            bcm2835_gpio_parse_line(s);
+            s->line_len = 0;
+        } else if (s->line_len < sizeof(s->line) - 1) {
+            s->line[s->line_len++] = buf[i];
+        }
+    }
+
+    first = QTAILQ_FIRST(&s->inject_queue);
+    if (first) {
+        timer_mod(s->inject_timer, first->when);
+    }
+}
+
 static uint32_t gpfsel_get(BCM2835GpioState *s, uint8_t reg)
 {
     int i;
@@ -68,6 +285,8 @@ static uint32_t gpfsel_get(BCM2835GpioState *s, uint8_t reg)
 static void gpfsel_set(BCM2835GpioState *s, uint8_t reg, uint32_t value)
 {
     int i;
+
+    qemu_mutex_lock(&s->lock);
     for (i = 0; i < 10; i++) {
         uint32_t index = 10 * reg + i;
         if (index < sizeof(s->fsel)) {
@@ -75,6 +294,7 @@ static void gpfsel_set(BCM2835GpioState *s, uint8_t reg, uint32_t value)
             s->fsel[index] = fsel;
         }
     }
+    qemu_mutex_unlock(&s->lock);
 
     /* SD controller selection (48-53) */
     if (s->sd_fsel != 0
@@ -120,11 +340,14 @@ static void gpset(BCM2835GpioState *s,
     for (i = 0; i < count; i++) {
         if ((changes & cur) && (gpfsel_is_out(s, start + i))) {
             qemu_set_irq(s->out[start + i], 1);
+            bcm2835_gpio_notify(s, start + i, 1);
         }
         cur <<= 1;
     }
 
+    qemu_mutex_lock(&s->lock);
     *lev |= val;
+    qemu_mutex_unlock(&s->lock);
 }
 
 static void gpclr(BCM2835GpioState *s,
@@ -137,18 +360,19 @@ static void gpclr(BCM2835GpioState *s,
     for (i = 0; i < count; i++) {
         if ((changes & cur) && (gpfsel_is_out(s, start + i))) {
             qemu_set_irq(s->out[start + i], 0);
+            bcm2835_gpio_notify(s, start + i, 0);
         }
         cur <<= 1;
     }
 
+    qemu_mutex_lock(&s->lock);
     *lev &= ~val;
+    qemu_mutex_unlock(&s->lock);
 }
 
-static uint64_t bcm2835_gpio_read(void *opaque, hwaddr offset,
-        unsigned size)
+/* Call with s->lock held */
+static uint64_t bcm2835_gpio_read_locked(BCM2835GpioState *s, hwaddr offset)
 {
-    BCM2835GpioState *s = (BCM2835GpioState *)opaque;
-
     switch (offset) {
     case GPFSEL0:
     case GPFSEL1:
@@ -166,23 +390,30 @@ static uint64_t bcm2835_gpio_read(void *opaque, hwaddr offset,
         /* Write Only */
         return 0;
     case GPLEV0:
-        return s->lev0;
+        return bcm2835_gpio_levels(s);
     case GPLEV1:
-        return s->lev1;
+        return bcm2835_gpio_levels(s) >> 32;
     case GPEDS0:
     case GPEDS1:
+        return extract64(s->eds, (offset - GPEDS0) * 8, 32);
     case GPREN0:
     case GPREN1:
+        return extract64(s->ren, (offset - GPREN0) * 8, 32);
     case GPFEN0:
     case GPFEN1:
+        return extract64(s->fen, (offset - GPFEN0) * 8, 32);
     case GPHEN0:
     case GPHEN1:
+        return extract64(s->hen, (offset - GPHEN0) * 8, 32);
     case GPLEN0:
     case GPLEN1:
+        return extract64(s->len, (offset - GPLEN0) * 8, 32);
     case GPAREN0:
     case GPAREN1:
+        return extract64(s->aren, (offset - GPAREN0) * 8, 32);
     case GPAFEN0:
     case GPAFEN1:
+        return extract64(s->afen, (offset - GPAFEN0) * 8, 32);
     case GPPUD:
     case GPPUDCLK0:
     case GPPUDCLK1:
@@ -197,10 +428,43 @@ static uint64_t bcm2835_gpio_read(void *opaque, hwaddr offset,
     return 0;
 }
 
+/* Reads have no side effects and never need the iothread lock */
+static uint64_t bcm2835_gpio_read(void *opaque, hwaddr offset,
+        unsigned size)
+{
+    BCM2835GpioState *s = (BCM2835GpioState *)opaque;
+    uint64_t value;
+
+    qemu_mutex_lock(&s->lock);
+    value = bcm2835_gpio_read_locked(s, offset);
+    qemu_mutex_unlock(&s->lock);
+
+    return value;
+}
+
+/* Update the bank (0 or 1, as a byte offset of 0 or 4) of a detect enable */
+static void bcm2835_gpio_set_detect(BCM2835GpioState *s, uint64_t *reg,
+                                    hwaddr bank, uint64_t value)
+{
+    qemu_mutex_lock(&s->lock);
+    *reg = deposit64(*reg, bank * 8, 32, value) & BCM2835_GPIO_PIN_MASK;
+    qemu_mutex_unlock(&s->lock);
+}
+
 static void bcm2835_gpio_write(void *opaque, hwaddr offset,
         uint64_t value, unsigned size)
 {
     BCM2835GpioState *s = (BCM2835GpioState *)opaque;
+    bool locked;
+
+    /*
+     * Output pins, the SD bus and the interrupt lines are still covered
+     * by the iothread lock.
+     */
+    locked = qemu_mutex_iothread_locked();
+    if (!locked) {
+        qemu_mutex_lock_iothread();
+    }
 
     switch (offset) {
     case GPFSEL0:
@@ -229,18 +493,35 @@ static void bcm2835_gpio_write(void *opaque, hwaddr offset,
         break;
     case GPEDS0:
     case GPEDS1:
+        /* write 1 to clear; a level detector that still matches re-fires */
+        qemu_mutex_lock(&s->lock);
+        s->eds &= ~((value & 0xffffffffULL) << ((offset - GPEDS0) * 8));
+        qemu_mutex_unlock(&s->lock);
+        break;
     case GPREN0:
     case GPREN1:
+        bcm2835_gpio_set_detect(s, &s->ren, offset - GPREN0, value);
+        break;
     case GPFEN0:
     case GPFEN1:
+        bcm2835_gpio_set_detect(s, &s->fen, offset - GPFEN0, value);
+        break;
     case GPHEN0:
     case GPHEN1:
+        bcm2835_gpio_set_detect(s, &s->hen, offset - GPHEN0, value);
+        break;
     case GPLEN0:
     case GPLEN1:
+        bcm2835_gpio_set_detect(s, &s->len, offset - GPLEN0, value);
+        break;
     case GPAREN0:
     case GPAREN1:
+        bcm2835_gpio_set_detect(s, &s->aren, offset - GPAREN0, value);
+        break;
     case GPAFEN0:
     case GPAFEN1:
+        bcm2835_gpio_set_detect(s, &s->afen, offset - GPAFEN0, value);
+        break;
     case GPPUD:
     case GPPUDCLK0:
     case GPPUDCLK1:
@@ -249,11 +530,16 @@ static void bcm2835_gpio_write(void *opaque, hwaddr offset,
     default:
         goto err_out;
     }
-    return;
+    bcm2835_gpio_update(s);
+    goto out;
 
 err_out:
     qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset %"HWADDR_PRIx"\n",
             __func__, offset);
+out:
+    if (!locked) {
+        qemu_mutex_unlock_iothread();
+    }
 }
 
 static void bcm2835_gpio_reset(DeviceState *dev)
@@ -270,8 +556,21 @@ static void bcm2835_gpio_reset(DeviceState *dev)
     /* SDHCI is selected by default */
     sdbus_reparent_card(&s->sdbus, s->sdbus_sdhci);
 
+    qemu_mutex_lock(&s->lock);
     s->lev0 = 0;
     s->lev1 = 0;
+
+    /* in_lev is driven from outside and survives a reset */
+    s->eds = 0;
+    s->ren = 0;
+    s->fen = 0;
+    s->hen = 0;
+    s->len = 0;
+    s->aren = 0;
+    s->afen = 0;
+    s->level = bcm2835_gpio_levels(s);
+    qemu_mutex_unlock(&s->lock);
+    bcm2835_gpio_update_irq(s);
 }
 
 static const MemoryRegionOps bcm2835_gpio_ops = {
@@ -282,13 +581,22 @@ static const MemoryRegionOps bcm2835_gpio_ops = {
 
 static const VMStateDescription vmstate_bcm2835_gpio = {
     .name = "bcm2835_gpio",
-    .version_id = 1,
+    .version_id = 2,
     .minimum_version_id = 1,
     .fields = (VMStateField[]) {
         VMSTATE_UINT8_ARRAY(fsel, BCM2835GpioState, 54),
         VMSTATE_UINT32(lev0, BCM2835GpioState),
         VMSTATE_UINT32(lev1, BCM2835GpioState),
         VMSTATE_UINT8(sd_fsel, BCM2835GpioState),
+        VMSTATE_UINT64_V(in_lev, BCM2835GpioState, 2),
+        VMSTATE_UINT64_V(level, BCM2835GpioState, 2),
+        VMSTATE_UINT64_V(eds, BCM2835GpioState, 2),
+        VMSTATE_UINT64_V(ren, BCM2835GpioState, 2),
+        VMSTATE_UINT64_V(fen, BCM2835GpioState, 2),
+        VMSTATE_UINT64_V(hen, BCM2835GpioState, 2),
+        VMSTATE_UINT64_V(len, BCM2835GpioState, 2),
+        VMSTATE_UINT64_V(aren, BCM2835GpioState, 2),
+        VMSTATE_UINT64_V(afen, BCM2835GpioState, 2),
         VMSTATE_END_OF_LIST()
     }
 };
@@ -298,14 +606,29 @@ static void bcm2835_gpio_init(Object *obj)
     BCM2835GpioState *s = BCM2835_GPIO(obj);
     DeviceState *dev = DEVICE(obj);
     SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
+    int i;
 
     qbus_create_inplace(&s->sdbus, sizeof(s->sdbus),
                         TYPE_SD_BUS, DEVICE(s), "sd-bus");
 
     memory_region_init_io(&s->iomem, obj,
             &bcm2835_gpio_ops, s, "bcm2835_gpio", 0x1000);
+    memory_region_clear_global_locking(&s->iomem);
     sysbus_init_mmio(sbd, &s->iomem);
     qdev_init_gpio_out(dev, s->out, 54);
+    qdev_init_gpio_in(dev, bcm2835_gpio_set_input, BCM2835_GPIO_NUM_PINS);
+    for (i = 0; i < BCM2835_GPIO_NUM_IRQS; i++) {
+        sysbus_init_irq(sbd, &s->irq[i]);
+    }
+    QTAILQ_INIT(&s->inject_queue);
+    qemu_mutex_init(&s->lock);
+}
+
+static void bcm2835_gpio_finalize(Object *obj)
+{
+    BCM2835GpioState *s = BCM2835_GPIO(obj);
+
+    qemu_mutex_destroy(&s->lock);
 }
 
 static void bcm2835_gpio_realize(DeviceState *dev, Error **errp)
@@ -329,8 +652,17 @@ static void bcm2835_gpio_realize(DeviceState *dev, Error **errp)
         return;
     }
     s->sdbus_sdhost = SD_BUS(obj);
+
+    s->inject_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, bcm2835_gpio_inject, s);
+    qemu_chr_fe_set_handlers(&s->chr, bcm2835_gpio_can_receive,
+                             bcm2835_gpio_receive, NULL, NULL, s, NULL, true);
 }
 
+static Property bcm2835_gpio_properties[] = {
+    DEFINE_PROP_CHR("chardev", BCM2835GpioState, chr),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void bcm2835_gpio_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
@@ -338,6 +670,7 @@ static void bcm2835_gpio_class_init(ObjectClass *klass, void *data)
     dc->vmsd = &vmstate_bcm2835_gpio;
     dc->realize = &bcm2835_gpio_realize;
     dc->reset = &bcm2835_gpio_reset;
+    dc->props = bcm2835_gpio_properties;
 }
 
 static const TypeInfo bcm2835_gpio_info = {
@@ -345,6 +678,7 @@ static const TypeInfo bcm2835_gpio_info = {
     .parent        = TYPE_SYS_BUS_DEVICE,
     .instance_size = sizeof(BCM2835GpioState),
     .instance_init = bcm2835_gpio_init,
+    .instance_finalize = bcm2835_gpio_finalize,
     .class_init    = bcm2835_gpio_class_init,
 };
 
@@ -0,0 +1,343 @@
+/*
+ * BCM2835 (Raspberry Pi) Broadcom Serial Controller (BSC) I2C master
+ *
+ * The FIFO is moved to and from the bus a whole FIFO at a time from a
+ * bottom half, so a transfer costs a few MMIO exits per 16 bytes rather
+ * than one per byte. Bus timing (DIV, DEL, CLKT) is stored but not
+ * modelled, and clock stretching timeouts never fire.
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/main-loop.h"
+#include "qemu/module.h"
+#include "hw/irq.h"
+#include "hw/i2c/bcm2835_i2c.h"
+#include "migration/vmstate.h"
+#include "trace.h"
+
+#define BSC_C           0x00
+#define BSC_S           0x04
+#define BSC_DLEN        0x08
+#define BSC_A           0x0c
+#define BSC_FIFO        0x10
+#define BSC_DIV         0x14
+#define BSC_DEL         0x18
+#define BSC_CLKT        0x1c
+
+#define BSC_C_I2CEN     (1 << 15)
+#define BSC_C_INTR      (1 << 10)
+#define BSC_C_INTT      (1 << 9)
+#define BSC_C_INTD      (1 << 8)
+#define BSC_C_ST        (1 << 7)
+#define BSC_C_CLEAR     (3 << 4)
+#define BSC_C_READ      (1 << 0)
+#define BSC_C_MASK      (BSC_C_I2CEN | BSC_C_INTR | BSC_C_INTT | BSC_C_INTD | \
+                         BSC_C_READ)
+
+#define BSC_S_CLKT      (1 << 9)
+#define BSC_S_ERR       (1 << 8)
+#define BSC_S_RXF       (1 << 7)
+#define BSC_S_TXE       (1 << 6)
+#define BSC_S_RXD       (1 << 5)
+#define BSC_S_TXD       (1 << 4)
+#define BSC_S_RXR       (1 << 3)
+#define BSC_S_TXW       (1 << 2)
+#define BSC_S_DONE      (1 << 1)
+#define BSC_S_TA        (1 << 0)
+/* status bits held in s->s; the rest are derived from the FIFO level */
+#define BSC_S_STORED    (BSC_S_CLKT | BSC_S_ERR | BSC_S_DONE | BSC_S_TA)
+#define BSC_S_W1C       (BSC_S_CLKT | BSC_S_ERR | BSC_S_DONE)
+
+static bool bcm2835_i2c_reading(BCM2835I2CState *s)
+{
+    return s->c & BSC_C_READ;
+}
+
+static uint32_t bcm2835_i2c_status(BCM2835I2CState *s)
+{
+    uint32_t used = fifo8_num_used(&s->fifo);
+    uint32_t st = s->s & BSC_S_STORED;
+
+    st |= fifo8_is_full(&s->fifo) ? BSC_S_RXF : BSC_S_TXD;
+    st |= fifo8_is_empty(&s->fifo) ? BSC_S_TXE : BSC_S_RXD;
+
+    if (st & BSC_S_TA) {
+        if (bcm2835_i2c_reading(s)) {
+            /* needs reading: three quarters full */
+            if (used >= BCM2835_I2C_FIFO_SIZE * 3 / 4) {
+                st |= BSC_S_RXR;
+            }
+        } else if (used < BCM2835_I2C_FIFO_SIZE / 4 && s->remaining > used) {
+            /* needs writing: under a quarter full and more to come */
+            st |= BSC_S_TXW;
+        }
+    }
+
+    return st;
+}
+
+static void bcm2835_i2c_update_irq(BCM2835I2CState *s)
+{
+    uint32_t st = bcm2835_i2c_status(s);
+    bool level = ((s->c & BSC_C_INTR) && (st & BSC_S_RXR))
+                 || ((s->c & BSC_C_INTT) && (st & BSC_S_TXW))
+                 || ((s->c & BSC_C_INTD) && (st & BSC_S_DONE));
+
+    qemu_set_irq(s->irq, level);
+}
+
+static void bcm2835_i2c_finish(BCM2835I2CState *s, uint32_t status)
+{
+    if (s->started) {
+        i2c_end_transfer(s->bus);
+        s->started = false;
+    }
+    s->s &= ~BSC_S_TA;
+    s->s |= BSC_S_DONE | status;
+    trace_bcm2835_i2c_done(s->a, s->dlen - s->remaining, status);
+}
+
+/* Run the active transfer as far as the FIFO allows */
+static void bcm2835_i2c_bh(void *opaque)
+{
+    BCM2835I2CState *s = opaque;
+
+    if (!(s->s & BSC_S_TA)) {
+        return;
+    }
+
+    if (!s->started) {
+        if (i2c_start_transfer(s->bus, s->a, bcm2835_i2c_reading(s))) {
+            /* nobody acknowledged the address */
+            bcm2835_i2c_finish(s, BSC_S_ERR);
+            goto out;
+        }
+        s->started = true;
+    }
+
+    if (bcm2835_i2c_reading(s)) {
+        while (s->remaining && !fifo8_is_full(&s->fifo)) {
+            fifo8_push(&s->fifo, i2c_recv(s->bus));
+            s->remaining--;
+        }
+    } else {
+        while (s->remaining && !fifo8_is_empty(&s->fifo)) {
+            if (i2c_send(s->bus, fifo8_pop(&s->fifo))) {
+                bcm2835_i2c_finish(s, BSC_S_ERR);
+                goto out;
+            }
+            s->remaining--;
+        }
+    }
+
+    if (s->remaining == 0) {
+        bcm2835_i2c_finish(s, 0);
+    }
+
+out:
+    bcm2835_i2c_update_irq(s);
+}
+
+static uint64_t bcm2835_i2c_read(void *opaque, hwaddr offset, unsigned size)
+{
+    BCM2835I2CState *s = opaque;
+    uint32_t res = 0;
+
+    switch (offset) {
+    case BSC_C:
+        res = s->c;
+        break;
+    case BSC_S:
+        res = bcm2835_i2c_status(s);
+        break;
+    case BSC_DLEN:
+        res = (s->s & BSC_S_TA) ? s->remaining : s->dlen;
+        break;
+    case BSC_A:
+        res = s->a;
+        break;
+    case BSC_FIFO:
+        if (!fifo8_is_empty(&s->fifo)) {
+            res = fifo8_pop(&s->fifo);
+            if ((s->s & BSC_S_TA) && s->remaining) {
+                qemu_bh_schedule(s->bh);
+            }
+            bcm2835_i2c_update_irq(s);
+        }
+        break;
+    case BSC_DIV:
+        res = s->div;
+        break;
+    case BSC_DEL:
+        res = s->del;
+        break;
+    case BSC_CLKT:
+        res = s->clkt;
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        break;
+    }
+
+    return res;
+}
+
+static void bcm2835_i2c_write(void *opaque, hwaddr offset, uint64_t value,
+                              unsigned size)
+{
+    BCM2835I2CState *s = opaque;
+
+    switch (offset) {
+    case BSC_C:
+        s->c = value & BSC_C_MASK;
+        if (value & BSC_C_CLEAR) {
+            fifo8_reset(&s->fifo);
+        }
+        if (!(s->c & BSC_C_I2CEN)) {
+            if (s->s & BSC_S_TA) {
+                /* disabling the controller aborts the transfer */
+                bcm2835_i2c_finish(s, 0);
+            }
+        } else if (value & BSC_C_ST) {
+            s->remaining = s->dlen;
+            s->s |= BSC_S_TA;
+            s->s &= ~BSC_S_DONE;
+            if (s->started &&
+                i2c_start_transfer(s->bus, s->a, bcm2835_i2c_reading(s))) {
+                /* restarted while active: the repeated start was NAKed */
+                bcm2835_i2c_finish(s, BSC_S_ERR);
+            } else {
+                qemu_bh_schedule(s->bh);
+            }
+        }
+        break;
+    case BSC_S:
+        s->s &= ~(value & BSC_S_W1C);
+        break;
+    case BSC_DLEN:
+        s->dlen = value & 0xffff;
+        break;
+    case BSC_A:
+        s->a = value & 0x7f;
+        break;
+    case BSC_FIFO:
+        if (fifo8_is_full(&s->fifo)) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: FIFO overrun\n", __func__);
+            break;
+        }
+        fifo8_push(&s->fifo, value);
+        if ((s->s & BSC_S_TA) && !bcm2835_i2c_reading(s)) {
+            qemu_bh_schedule(s->bh);
+        }
+        break;
+    case BSC_DIV:
+        s->div = value & 0xffff;
+        break;
+    case BSC_DEL:
+        s->del = value;
+        break;
+    case BSC_CLKT:
+        s->clkt = value & 0xffff;
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return;
+    }
+
+    bcm2835_i2c_update_irq(s);
+}
+
+static const MemoryRegionOps bcm2835_i2c_ops = {
+    .read = bcm2835_i2c_read,
+    .write = bcm2835_i2c_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static const VMStateDescription vmstate_bcm2835_i2c = {
+    .name = TYPE_BCM2835_I2C,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(c, BCM2835I2CState),
+        VMSTATE_UINT32(s, BCM2835I2CState),
+        VMSTATE_UINT32(dlen, BCM2835I2CState),
+        VMSTATE_UINT32(a, BCM2835I2CState),
+        VMSTATE_UINT32(div, BCM2835I2CState),
+        VMSTATE_UINT32(del, BCM2835I2CState),
+        VMSTATE_UINT32(clkt, BCM2835I2CState),
+        VMSTATE_UINT32(remaining, BCM2835I2CState),
+        VMSTATE_BOOL(started, BCM2835I2CState),
+        VMSTATE_FIFO8(fifo, BCM2835I2CState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void bcm2835_i2c_reset(DeviceState *dev)
+{
+    BCM2835I2CState *s = BCM2835_I2C(dev);
+
+    if (s->started) {
+        i2c_end_transfer(s->bus);
+    }
+    fifo8_reset(&s->fifo);
+    s->c = 0;
+    s->s = 0;
+    s->dlen = 0;
+    s->a = 0;
+    s->div = 0x5dc;
+    s->del = 0x00300030;
+    s->clkt = 0x40;
+    s->remaining = 0;
+    s->started = false;
+    qemu_set_irq(s->irq, 0);
+}
+
+static void bcm2835_i2c_init(Object *obj)
+{
+    BCM2835I2CState *s = BCM2835_I2C(obj);
+
+    memory_region_init_io(&s->iomem, obj, &bcm2835_i2c_ops, s,
+                          TYPE_BCM2835_I2C, 0x20);
+    sysbus_init_mmio(SYS_BUS_DEVICE(s), &s->iomem);
+    sysbus_init_irq(SYS_BUS_DEVICE(s), &s->irq);
+}
+
+static void bcm2835_i2c_realize(DeviceState *dev, Error **errp)
+{
+    BCM2835I2CState *s = BCM2835_I2C(dev);
+
+    s->bus = i2c_init_bus(dev, NULL);
+    fifo8_create(&s->fifo, BCM2835_I2C_FIFO_SIZE);
+    s->bh = qemu_bh_new(bcm2835_i2c_bh, s);
+}
+
+static void bcm2835_i2c_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = bcm2835_i2c_realize;
+    dc->reset = bcm2835_i2c_reset;
+    dc->vmsd = &vmstate_bcm2835_i2c;
+}
+
+static TypeInfo bcm2835_i2c_info = {
+    .name          = TYPE_BCM2835_I2C,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(BCM2835I2CState),
+    .class_init    = bcm2835_i2c_class_init,
+    .instance_init = bcm2835_i2c_init,
+};
+
+static void bcm2835_i2c_register_types(void)
+{
+    type_register_static(&bcm2835_i2c_info);
+}
+
+type_init(bcm2835_i2c_register_types)
@@ -157,8 +157,11 @@ static inline bool gic_irq_signaling_enabled(GICState *s, int cpu, bool virt,
 }
 
 /* TODO: Many places that call this routine could be optimized.  */
-/* Update interrupt status after enabled or pending bits have been changed.  */
-static inline void gic_update_internal(GICState *s, bool virt)
+/* Update interrupt status after enabled or pending bits have been changed.
+ * Only the CPU interfaces in @cpu_mask are recomputed.
+ */
+static inline void gic_update_internal(GICState *s, bool virt,
+                                       unsigned cpu_mask)
 {
     int best_irq;
     int best_prio;
@@ -169,6 +172,9 @@ static inline void gic_update_internal(GICState *s, bool virt)
     qemu_irq *fiq_lines = virt ? s->parent_vfiq : s->parent_fiq;
 
     for (cpu = 0; cpu < s->num_cpu; cpu++) {
+        if (!(cpu_mask & (1 << cpu))) {
+            continue;
+        }
         cpu_iface = virt ? (cpu + GIC_NCPU) : cpu;
 
         s->current_pending[cpu_iface] = 1023;
@@ -223,7 +229,7 @@ static inline void gic_update_internal(GICState *s, bool virt)
 
 static void gic_update(GICState *s)
 {
-    gic_update_internal(s, false);
+    gic_update_internal(s, false, ALL_CPU_MASK);
 }
 
 /* Return true if this LR is empty, i.e. the corresponding bit
@@ -343,7 +349,7 @@ static void gic_update_maintenance(GICState *s)
 
 static void gic_update_virt(GICState *s)
 {
-    gic_update_internal(s, true);
+    gic_update_internal(s, true, ALL_CPU_MASK);
     gic_update_maintenance(s);
 }
 
@@ -413,7 +419,10 @@ static void gic_set_irq(void *opaque, int irq, int level)
     }
     trace_gic_set_irq(irq, level, cm, target);
 
-    gic_update(s);
+    /* A line change can only alter the best pending interrupt of the CPUs
+     * it targets, so a PPI such as a timer tick only rescans its own CPU.
+     */
+    gic_update_internal(s, false, target);
 }
 
 static uint16_t gic_get_current_pending_irq(GICState *s, int cpu,
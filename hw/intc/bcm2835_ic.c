@@ -33,33 +33,105 @@
 #define IRQ_DISABLE_2           0x20 /* Interrupt disable register 2 */
 #define IRQ_DISABLE_BASIC       0x24 /* Base interrupt disable register */
 
-/* Update interrupts.  */
+/*
+ * Bits 10-20 of IRQ_PENDING_BASIC duplicate the pending state of selected
+ * GPU IRQs; the entry of the other GPU IRQs is 0.
+ */
+static const uint8_t irq_dup_bit[GPU_IRQS] = {
+    [7] = 10, [9] = 11, [10] = 12, [18] = 13, [19] = 14, [53] = 15,
+    [54] = 16, [55] = 17, [56] = 18, [57] = 19, [62] = 20,
+};
+
+static bool bcm2835_ic_fiq_level(BCM2835ICState *s)
+{
+    if (!s->fiq_enable) {
+        return false;
+    }
+    if (s->fiq_select >= GPU_IRQS) {
+        /* ARM IRQ */
+        return extract32(s->arm_irq_level, s->fiq_select - GPU_IRQS, 1);
+    }
+    return extract64(s->gpu_irq_level, s->fiq_select, 1);
+}
+
+/*
+ * Drive both outputs whatever their cached level.  The GPU inputs of
+ * bcm2836_control are neither reset nor migrated, so they must be
+ * brought in line after a reset or a migration.
+ */
+static void bcm2835_ic_drive_outputs(BCM2835ICState *s)
+{
+    s->fiq_out = bcm2835_ic_fiq_level(s);
+    qemu_set_irq(s->fiq, s->fiq_out);
+    s->irq_out = s->basic_pending != 0;
+    qemu_set_irq(s->irq, s->irq_out);
+}
+
+/* Drive the outputs, if their level changed.  */
 static void bcm2835_ic_update(BCM2835ICState *s)
 {
-    bool set = false;
-
-    if (s->fiq_enable) {
-        if (s->fiq_select >= GPU_IRQS) {
-            /* ARM IRQ */
-            set = extract32(s->arm_irq_level, s->fiq_select - GPU_IRQS, 1);
-        } else {
-            set = extract64(s->gpu_irq_level, s->fiq_select, 1);
-        }
+    bool set = bcm2835_ic_fiq_level(s);
+
+    if (set != s->fiq_out) {
+        s->fiq_out = set;
+        qemu_set_irq(s->fiq, set);
+    }
+
+    /* IRQ_PENDING_BASIC summarizes all the enabled sources */
+    set = s->basic_pending != 0;
+    if (set != s->irq_out) {
+        s->irq_out = set;
+        qemu_set_irq(s->irq, set);
     }
-    qemu_set_irq(s->fiq, set);
+}
+
+/* Recompute the pending summaries, after a change of the enables.  */
+static void bcm2835_ic_update_pending(BCM2835ICState *s)
+{
+    uint32_t res;
+    int i;
+
+    s->gpu_pending = s->gpu_irq_level & s->gpu_irq_enable;
 
-    set = (s->gpu_irq_level & s->gpu_irq_enable)
-        || (s->arm_irq_level & s->arm_irq_enable);
-    qemu_set_irq(s->irq, set);
+    /* bits 0-7: ARM irqs */
+    res = s->arm_irq_level & s->arm_irq_enable;
 
+    /* bits 8 & 9: pending registers 1 & 2 */
+    res |= (((uint32_t)s->gpu_pending) != 0) << 8;
+    res |= ((s->gpu_pending >> 32) != 0) << 9;
+
+    /* bits 10-20: selected GPU IRQs */
+    for (i = 0; i < GPU_IRQS; i++) {
+        if (irq_dup_bit[i]) {
+            res |= extract64(s->gpu_pending, i, 1) << irq_dup_bit[i];
+        }
+    }
+    s->basic_pending = res;
 }
 
 static void bcm2835_ic_set_gpu_irq(void *opaque, int irq, int level)
 {
     BCM2835ICState *s = opaque;
+    uint64_t bit = 1ULL << irq;
+    uint32_t word;
 
     assert(irq >= 0 && irq < 64);
-    s->gpu_irq_level = deposit64(s->gpu_irq_level, irq, 1, level != 0);
+    if (!!(s->gpu_irq_level & bit) == (level != 0)) {
+        return;
+    }
+    s->gpu_irq_level ^= bit;
+
+    if (s->gpu_irq_enable & bit) {
+        s->gpu_pending ^= bit;
+
+        /* bit 8 or 9: pending register 1 or 2 */
+        word = irq < 32 ? (uint32_t)s->gpu_pending : s->gpu_pending >> 32;
+        s->basic_pending = deposit32(s->basic_pending, 8 + irq / 32, 1,
+                                     word != 0);
+        if (irq_dup_bit[irq]) {
+            s->basic_pending ^= 1U << irq_dup_bit[irq];
+        }
+    }
     bcm2835_ic_update(s);
 }
 
@@ -68,38 +140,30 @@ static void bcm2835_ic_set_arm_irq(void *opaque, int irq, int level)
     BCM2835ICState *s = opaque;
 
     assert(irq >= 0 && irq < 8);
-    s->arm_irq_level = deposit32(s->arm_irq_level, irq, 1, level != 0);
+    if (extract32(s->arm_irq_level, irq, 1) == (level != 0)) {
+        return;
+    }
+    s->arm_irq_level ^= 1 << irq;
+    s->basic_pending = deposit32(s->basic_pending, irq, 1,
+                                 extract32(s->arm_irq_level &
+                                           s->arm_irq_enable, irq, 1));
     bcm2835_ic_update(s);
 }
 
-static const int irq_dups[] = { 7, 9, 10, 18, 19, 53, 54, 55, 56, 57, 62 };
-
 static uint64_t bcm2835_ic_read(void *opaque, hwaddr offset, unsigned size)
 {
     BCM2835ICState *s = opaque;
     uint32_t res = 0;
-    uint64_t gpu_pending = s->gpu_irq_level & s->gpu_irq_enable;
-    int i;
 
     switch (offset) {
     case IRQ_PENDING_BASIC:
-        /* bits 0-7: ARM irqs */
-        res = s->arm_irq_level & s->arm_irq_enable;
-
-        /* bits 8 & 9: pending registers 1 & 2 */
-        res |= (((uint32_t)gpu_pending) != 0) << 8;
-        res |= ((gpu_pending >> 32) != 0) << 9;
-
-        /* bits 10-20: selected GPU IRQs */
-        for (i = 0; i < ARRAY_SIZE(irq_dups); i++) {
-            res |= extract64(gpu_pending, irq_dups[i], 1) << (i + 10);
-        }
+        res = s->basic_pending;
         break;
     case IRQ_PENDING_1:
-        res = gpu_pending;
+        res = s->gpu_pending;
         break;
     case IRQ_PENDING_2:
-        res = gpu_pending >> 32;
+        res = s->gpu_pending >> 32;
         break;
     case FIQ_CONTROL:
         res = (s->fiq_enable << 7) | s->fiq_select;
@@ -164,6 +228,9 @@ static void bcm2835_ic_write(void *opaque, hwaddr offset, uint64_t val,
                       __func__, offset);
         return;
     }
+    if (offset != FIQ_CONTROL) {
+        bcm2835_ic_update_pending(s);
+    }
     bcm2835_ic_update(s);
 }
 
@@ -183,6 +250,8 @@ static void bcm2835_ic_reset(DeviceState *d)
     s->arm_irq_enable = 0;
     s->fiq_enable = false;
     s->fiq_select = 0;
+    bcm2835_ic_update_pending(s);
+    bcm2835_ic_drive_outputs(s);
 }
 
 static void bcm2835_ic_init(Object *obj)
@@ -202,10 +271,20 @@ static void bcm2835_ic_init(Object *obj)
     sysbus_init_irq(SYS_BUS_DEVICE(s), &s->fiq);
 }
 
+static int bcm2835_ic_post_load(void *opaque, int version_id)
+{
+    BCM2835ICState *s = opaque;
+
+    bcm2835_ic_update_pending(s);
+    bcm2835_ic_drive_outputs(s);
+    return 0;
+}
+
 static const VMStateDescription vmstate_bcm2835_ic = {
     .name = TYPE_BCM2835_IC,
     .version_id = 1,
     .minimum_version_id = 1,
+    .post_load = bcm2835_ic_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT64(gpu_irq_level, BCM2835ICState),
         VMSTATE_UINT64(gpu_irq_enable, BCM2835ICState),
@@ -20,6 +20,7 @@
 #include "hw/irq.h"
 #include "migration/vmstate.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "qemu/module.h"
 
 #define REG_GPU_ROUTE           0x0c
@@ -72,25 +73,25 @@ static void deliver_local(BCM2836ControlState *s, uint8_t core, uint8_t irq,
     }
 }
 
-/* Update interrupts.  */
-static void bcm2836_control_update(BCM2836ControlState *s)
+/* Update the interrupt state of a single core.  */
+static void bcm2836_control_update_core(BCM2836ControlState *s, int core)
 {
-    int i, j;
+    int j;
+
+    assert(core >= 0 && core < BCM2836_NCORES);
 
     /* reset pending IRQs/FIQs */
-    for (i = 0; i < BCM2836_NCORES; i++) {
-        s->irqsrc[i] = s->fiqsrc[i] = 0;
-    }
+    s->irqsrc[core] = s->fiqsrc[core] = 0;
 
     /* apply routing logic, update status regs */
-    if (s->gpu_irq) {
-        assert(s->route_gpu_irq < BCM2836_NCORES);
-        s->irqsrc[s->route_gpu_irq] |= (uint32_t)1 << IRQ_GPU;
+    assert(s->route_gpu_irq < BCM2836_NCORES);
+    if (s->gpu_irq && s->route_gpu_irq == core) {
+        s->irqsrc[core] |= (uint32_t)1 << IRQ_GPU;
     }
 
-    if (s->gpu_fiq) {
-        assert(s->route_gpu_fiq < BCM2836_NCORES);
-        s->fiqsrc[s->route_gpu_fiq] |= (uint32_t)1 << IRQ_GPU;
+    assert(s->route_gpu_fiq < BCM2836_NCORES);
+    if (s->gpu_fiq && s->route_gpu_fiq == core) {
+        s->fiqsrc[core] |= (uint32_t)1 << IRQ_GPU;
     }
 
     /*
@@ -99,39 +100,47 @@ static void bcm2836_control_update(BCM2836ControlState *s)
      * interrupts handled below.
      */
     if ((s->local_timer_control & LOCALTIMER_INTENABLE) &&
-        (s->local_timer_control & LOCALTIMER_INTFLAG)) {
+        (s->local_timer_control & LOCALTIMER_INTFLAG) &&
+        (s->route_localtimer & 3) == core) {
         if (s->route_localtimer & 4) {
-            s->fiqsrc[(s->route_localtimer & 3)] |= (uint32_t)1 << IRQ_TIMER;
+            s->fiqsrc[core] |= (uint32_t)1 << IRQ_TIMER;
         } else {
-            s->irqsrc[(s->route_localtimer & 3)] |= (uint32_t)1 << IRQ_TIMER;
+            s->irqsrc[core] |= (uint32_t)1 << IRQ_TIMER;
         }
     }
 
-    for (i = 0; i < BCM2836_NCORES; i++) {
-        /* handle local timer interrupts for this core */
-        if (s->timerirqs[i]) {
-            assert(s->timerirqs[i] < (1 << (IRQ_CNTVIRQ + 1))); /* sane mask? */
-            for (j = 0; j <= IRQ_CNTVIRQ; j++) {
-                if ((s->timerirqs[i] & (1 << j)) != 0) {
-                    /* local interrupt j is set */
-                    deliver_local(s, i, j, s->timercontrol[i], j);
-                }
+    /* handle local timer interrupts for this core */
+    if (s->timerirqs[core]) {
+        assert(s->timerirqs[core] < (1 << (IRQ_CNTVIRQ + 1))); /* sane mask? */
+        for (j = 0; j <= IRQ_CNTVIRQ; j++) {
+            if ((s->timerirqs[core] & (1 << j)) != 0) {
+                /* local interrupt j is set */
+                deliver_local(s, core, j, s->timercontrol[core], j);
             }
         }
+    }
 
-        /* handle mailboxes for this core */
-        for (j = 0; j < BCM2836_MBPERCORE; j++) {
-            if (s->mailboxes[i * BCM2836_MBPERCORE + j] != 0) {
-                /* mailbox j is set */
-                deliver_local(s, i, j + IRQ_MAILBOX0, s->mailboxcontrol[i], j);
-            }
+    /* handle mailboxes for this core */
+    for (j = 0; j < BCM2836_MBPERCORE; j++) {
+        if (atomic_read(&s->mailboxes[core * BCM2836_MBPERCORE + j]) != 0) {
+            /* mailbox j is set */
+            deliver_local(s, core, j + IRQ_MAILBOX0,
+                          s->mailboxcontrol[core], j);
         }
     }
 
     /* call set_irq appropriately for each output */
+    qemu_set_irq(s->irq[core], s->irqsrc[core] != 0);
+    qemu_set_irq(s->fiq[core], s->fiqsrc[core] != 0);
+}
+
+/* Update interrupts for all cores, after a change of routing.  */
+static void bcm2836_control_update(BCM2836ControlState *s)
+{
+    int i;
+
     for (i = 0; i < BCM2836_NCORES; i++) {
-        qemu_set_irq(s->irq[i], s->irqsrc[i] != 0);
-        qemu_set_irq(s->fiq[i], s->fiqsrc[i] != 0);
+        bcm2836_control_update_core(s, i);
     }
 }
 
@@ -145,7 +154,7 @@ static void bcm2836_control_set_local_irq(void *opaque, int core, int local_irq,
 
     s->timerirqs[core] = deposit32(s->timerirqs[core], local_irq, 1, !!level);
 
-    bcm2836_control_update(s);
+    bcm2836_control_update_core(s, core);
 }
 
 /* XXX: the following wrapper functions are a kludgy workaround,
@@ -179,7 +188,7 @@ static void bcm2836_control_set_gpu_irq(void *opaque, int irq, int level)
 
     s->gpu_irq = level;
 
-    bcm2836_control_update(s);
+    bcm2836_control_update_core(s, s->route_gpu_irq);
 }
 
 static void bcm2836_control_set_gpu_fiq(void *opaque, int irq, int level)
@@ -188,7 +197,7 @@ static void bcm2836_control_set_gpu_fiq(void *opaque, int irq, int level)
 
     s->gpu_fiq = level;
 
-    bcm2836_control_update(s);
+    bcm2836_control_update_core(s, s->route_gpu_fiq);
 }
 
 static void bcm2836_control_local_timer_set_next(void *opaque)
@@ -211,7 +220,7 @@ static void bcm2836_control_local_timer_tick(void *opaque)
     bcm2836_control_local_timer_set_next(s);
 
     s->local_timer_control |= LOCALTIMER_INTFLAG;
-    bcm2836_control_update(s);
+    bcm2836_control_update_core(s, s->route_localtimer & 3);
 }
 
 static void bcm2836_control_local_timer_control(void *opaque, uint32_t val)
@@ -261,8 +270,6 @@ static uint64_t bcm2836_control_read(void *opaque, hwaddr offset, unsigned size)
         return s->irqsrc[(offset - REG_IRQSRC) >> 2];
     } else if (offset >= REG_FIQSRC && offset < REG_MBOX0_WR) {
         return s->fiqsrc[(offset - REG_FIQSRC) >> 2];
-    } else if (offset >= REG_MBOX0_RDCLR && offset < REG_LIMIT) {
-        return s->mailboxes[(offset - REG_MBOX0_RDCLR) >> 2];
     } else {
         qemu_log_mask(LOG_UNIMP, "%s: Unsupported offset 0x%"HWADDR_PRIx"\n",
                       __func__, offset);
@@ -274,6 +281,7 @@ static void bcm2836_control_write(void *opaque, hwaddr offset,
                                   uint64_t val, unsigned size)
 {
     BCM2836ControlState *s = opaque;
+    int core = -1; /* the only core affected, or -1 for all of them */
 
     if (offset == REG_GPU_ROUTE) {
         s->route_gpu_irq = val & 0x3;
@@ -282,16 +290,16 @@ static void bcm2836_control_write(void *opaque, hwaddr offset,
         s->route_localtimer = val & 7;
     } else if (offset == REG_LOCALTIMERCONTROL) {
         bcm2836_control_local_timer_control(s, val);
+        core = s->route_localtimer & 3;
     } else if (offset == REG_LOCALTIMERACK) {
         bcm2836_control_local_timer_ack(s, val);
+        core = s->route_localtimer & 3;
     } else if (offset >= REG_TIMERCONTROL && offset < REG_MBOXCONTROL) {
-        s->timercontrol[(offset - REG_TIMERCONTROL) >> 2] = val & 0xff;
+        core = (offset - REG_TIMERCONTROL) >> 2;
+        s->timercontrol[core] = val & 0xff;
     } else if (offset >= REG_MBOXCONTROL && offset < REG_IRQSRC) {
-        s->mailboxcontrol[(offset - REG_MBOXCONTROL) >> 2] = val & 0xff;
-    } else if (offset >= REG_MBOX0_WR && offset < REG_MBOX0_RDCLR) {
-        s->mailboxes[(offset - REG_MBOX0_WR) >> 2] |= val;
-    } else if (offset >= REG_MBOX0_RDCLR && offset < REG_LIMIT) {
-        s->mailboxes[(offset - REG_MBOX0_RDCLR) >> 2] &= ~val;
+        core = (offset - REG_MBOXCONTROL) >> 2;
+        s->mailboxcontrol[core] = val & 0xff;
     } else {
         qemu_log_mask(LOG_UNIMP, "%s: Unsupported offset 0x%"HWADDR_PRIx
                                  " value 0x%"PRIx64"\n",
@@ -299,7 +307,11 @@ static void bcm2836_control_write(void *opaque, hwaddr offset,
         return;
     }
 
-    bcm2836_control_update(s);
+    if (core < 0) {
+        bcm2836_control_update(s);
+    } else {
+        bcm2836_control_update_core(s, core);
+    }
 }
 
 static const MemoryRegionOps bcm2836_control_ops = {
@@ -310,6 +322,71 @@ static const MemoryRegionOps bcm2836_control_ops = {
     .valid.max_access_size = 4,
 };
 
+/*
+ * The mailboxes carry the guest's inter-processor interrupts, so they are
+ * accessed without taking the iothread lock.  The mailbox words are
+ * updated atomically; the lock is only needed when a mailbox becomes set
+ * or cleared, to re-evaluate the interrupt lines of the core it belongs
+ * to (which reads the mailboxes again, so the last update always sees
+ * the final state).
+ */
+static uint64_t bcm2836_control_mbox_read(void *opaque, hwaddr offset,
+                                          unsigned size)
+{
+    BCM2836ControlState *s = opaque;
+
+    offset += REG_MBOX0_WR;
+    if (offset >= REG_MBOX0_RDCLR) {
+        return atomic_read(&s->mailboxes[(offset - REG_MBOX0_RDCLR) >> 2]);
+    }
+
+    qemu_log_mask(LOG_UNIMP, "%s: Unsupported offset 0x%"HWADDR_PRIx"\n",
+                  __func__, offset);
+    return 0;
+}
+
+static void bcm2836_control_mbox_write(void *opaque, hwaddr offset,
+                                       uint64_t val, unsigned size)
+{
+    BCM2836ControlState *s = opaque;
+    uint32_t oldval, newval;
+    bool locked;
+    int n;
+
+    offset += REG_MBOX0_WR;
+    if (offset < REG_MBOX0_RDCLR) {
+        n = (offset - REG_MBOX0_WR) >> 2;
+        oldval = atomic_fetch_or(&s->mailboxes[n], (uint32_t)val);
+        newval = oldval | val;
+    } else {
+        n = (offset - REG_MBOX0_RDCLR) >> 2;
+        oldval = atomic_fetch_and(&s->mailboxes[n], ~(uint32_t)val);
+        newval = oldval & ~val;
+    }
+
+    if (!oldval == !newval) {
+        /* No change to the mailbox's interrupt request */
+        return;
+    }
+
+    locked = qemu_mutex_iothread_locked();
+    if (!locked) {
+        qemu_mutex_lock_iothread();
+    }
+    bcm2836_control_update_core(s, n / BCM2836_MBPERCORE);
+    if (!locked) {
+        qemu_mutex_unlock_iothread();
+    }
+}
+
+static const MemoryRegionOps bcm2836_control_mbox_ops = {
+    .read = bcm2836_control_mbox_read,
+    .write = bcm2836_control_mbox_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
 static void bcm2836_control_reset(DeviceState *d)
 {
     BCM2836ControlState *s = BCM2836_CONTROL(d);
@@ -336,8 +413,15 @@ static void bcm2836_control_init(Object *obj)
     BCM2836ControlState *s = BCM2836_CONTROL(obj);
     DeviceState *dev = DEVICE(obj);
 
-    memory_region_init_io(&s->iomem, obj, &bcm2836_control_ops, s,
-                          TYPE_BCM2836_CONTROL, REG_LIMIT);
+    memory_region_init(&s->iomem, obj, TYPE_BCM2836_CONTROL, REG_LIMIT);
+    memory_region_init_io(&s->regs_iomem, obj, &bcm2836_control_ops, s,
+                          TYPE_BCM2836_CONTROL "-regs", REG_MBOX0_WR);
+    memory_region_add_subregion(&s->iomem, 0, &s->regs_iomem);
+    memory_region_init_io(&s->mbox_iomem, obj, &bcm2836_control_mbox_ops, s,
+                          TYPE_BCM2836_CONTROL "-mbox",
+                          REG_LIMIT - REG_MBOX0_WR);
+    memory_region_clear_global_locking(&s->mbox_iomem);
+    memory_region_add_subregion(&s->iomem, REG_MBOX0_WR, &s->mbox_iomem);
     sysbus_init_mmio(SYS_BUS_DEVICE(s), &s->iomem);
 
     /* inputs from each CPU core */
@@ -0,0 +1,470 @@
+/*
+ * BCM2835 (Raspberry Pi) clock manager (CPRMAN) and PLL analogue (A2W)
+ *
+ * The registers are kept as written, and rates are derived from them on
+ * demand: oscillator -> PLL (A2W NDIV/FRAC/PDIV) -> PLL channel divider
+ * -> clock generator (CM source mux and DIVI/DIVF). PLLs lock as soon as
+ * they leave reset and power-down, and generators report BUSY exactly
+ * while enabled, so drivers polling either never wait. Only the PLLs,
+ * channels and generators behind firmware clocks and the PCM clock are
+ * given meaning; the rest of the block is plain storage.
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "hw/misc/bcm2835_cprman.h"
+#include "hw/qdev-properties.h"
+#include "migration/vmstate.h"
+
+/* Every write to either block must carry the password in the top byte */
+#define CM_PASSWORD             0x5a000000
+#define CM_PASSWORD_MASK        0xff000000
+
+#define CM_CTL_SRC_MASK         0xf
+#define CM_CTL_ENAB             (1 << 4)
+#define CM_CTL_KILL             (1 << 5)
+#define CM_CTL_BUSY             (1 << 7)
+#define CM_CTL_MASH_SHIFT       9
+#define CM_CTL_MASH_MASK        (3 << CM_CTL_MASH_SHIFT)
+#define CM_DIV_FRAC_BITS        12
+#define CM_DIV_MASK             0xffffff
+
+#define CM_PLL_ANARST           (1 << 8)
+#define CM_LOCK                 0x114
+
+#define A2W_PLL_CTRL_NDIV_MASK  0x3ff
+#define A2W_PLL_CTRL_PDIV_SHIFT 12
+#define A2W_PLL_CTRL_PDIV_LEN   3
+#define A2W_PLL_CTRL_PWRDN      (1 << 16)
+#define A2W_PLL_FRAC_BITS       20
+#define A2W_PLL_FRAC_MASK       0xfffff
+#define A2W_PLL_FRAC_OFFSET     0x100
+#define A2W_PLL_CHAN_DIV_MASK   0xff
+#define A2W_PLL_CHAN_DISABLE    (1 << 8)
+
+/* Rate of the BCM2835 SDRAM clock, which has no generator of its own */
+#define BCM2835_SDRAM_FREQ      400000000
+
+enum {
+    PLLA, PLLB, PLLC, PLLD, PLLH, NUM_PLLS
+};
+
+static const struct {
+    hwaddr cm;          /* CM_PLLx */
+    hwaddr a2w;         /* A2W_PLLx_CTRL */
+    uint32_t lock;      /* CM_LOCK.FLOCKx */
+} bcm2835_plls[NUM_PLLS] = {
+    [PLLA] = { 0x104, 0x1100, 1 << 8 },
+    [PLLB] = { 0x170, 0x11e0, 1 << 9 },
+    [PLLC] = { 0x108, 0x1120, 1 << 10 },
+    [PLLD] = { 0x10c, 0x1140, 1 << 11 },
+    [PLLH] = { 0x110, 0x1160, 1 << 12 },
+};
+
+/* Clock generator inputs: ground, the oscillator, then PLL channels */
+enum {
+    SRC_GND, SRC_XOSC,
+    SRC_PLLA_CORE, SRC_PLLA_PER, SRC_PLLB_ARM, SRC_PLLC_CORE0,
+    SRC_PLLC_CORE1, SRC_PLLC_CORE2, SRC_PLLC_PER, SRC_PLLD_CORE,
+    SRC_PLLD_PER, SRC_PLLH_AUX,
+    NUM_SRCS
+};
+
+#define SRC_FIRST_CHAN SRC_PLLA_CORE
+
+static const struct {
+    hwaddr a2w;         /* A2W_PLLx_<channel> */
+    int pll;
+} bcm2835_pll_chans[NUM_SRCS - SRC_FIRST_CHAN] = {
+    [SRC_PLLA_CORE - SRC_FIRST_CHAN] = { 0x1400, PLLA },
+    [SRC_PLLA_PER - SRC_FIRST_CHAN] = { 0x1500, PLLA },
+    [SRC_PLLB_ARM - SRC_FIRST_CHAN] = { 0x13e0, PLLB },
+    [SRC_PLLC_CORE0 - SRC_FIRST_CHAN] = { 0x1620, PLLC },
+    [SRC_PLLC_CORE1 - SRC_FIRST_CHAN] = { 0x1420, PLLC },
+    [SRC_PLLC_CORE2 - SRC_FIRST_CHAN] = { 0x1320, PLLC },
+    [SRC_PLLC_PER - SRC_FIRST_CHAN] = { 0x1520, PLLC },
+    [SRC_PLLD_CORE - SRC_FIRST_CHAN] = { 0x1440, PLLD },
+    [SRC_PLLD_PER - SRC_FIRST_CHAN] = { 0x1540, PLLD },
+    [SRC_PLLH_AUX - SRC_FIRST_CHAN] = { 0x1360, PLLH },
+};
+
+/* CM_CTL.SRC muxes; unlisted inputs are grounded or test clocks */
+static const uint8_t bcm2835_per_parents[16] = {
+    SRC_GND, SRC_XOSC, SRC_GND, SRC_GND,
+    SRC_PLLA_PER, SRC_PLLC_PER, SRC_PLLD_PER, SRC_PLLH_AUX,
+};
+
+static const uint8_t bcm2835_vpu_parents[16] = {
+    SRC_GND, SRC_XOSC, SRC_GND, SRC_GND,
+    SRC_PLLA_CORE, SRC_PLLC_CORE0, SRC_PLLD_CORE, SRC_PLLH_AUX,
+    SRC_PLLC_CORE1, SRC_PLLC_CORE2,
+};
+
+enum {
+    GEN_VPU, GEN_V3D, GEN_ISP, GEN_H264, GEN_UART, GEN_EMMC, GEN_EMMC2,
+    GEN_PWM, GEN_DPI, GEN_PCM, NUM_GENS
+};
+
+static const struct {
+    hwaddr ctl;         /* CM_<gen>CTL, with CM_<gen>DIV after it */
+    const uint8_t *parents;
+    /* as left by the firmware: CTL.SRC and rate, or 0 if stopped */
+    unsigned reset_src;
+    uint64_t reset_rate;
+} bcm2835_gens[NUM_GENS] = {
+    [GEN_VPU] = { 0x008, bcm2835_vpu_parents, 5, 250000000 },
+    [GEN_V3D] = { 0x038, bcm2835_vpu_parents, 5, 250000000 },
+    [GEN_ISP] = { 0x030, bcm2835_vpu_parents, 5, 250000000 },
+    [GEN_H264] = { 0x028, bcm2835_vpu_parents, 5, 250000000 },
+    [GEN_UART] = { 0x0f0, bcm2835_per_parents, 6, 48000000 },
+    [GEN_EMMC] = { 0x1c0, bcm2835_per_parents, 6, 50000000 },
+    [GEN_EMMC2] = { 0x1d0, bcm2835_per_parents, 6, 100000000 },
+    [GEN_PWM] = { 0x0a0, bcm2835_per_parents, 6, 0 },
+    [GEN_DPI] = { 0x068, bcm2835_per_parents, 6, 0 },
+    [GEN_PCM] = { 0x098, bcm2835_per_parents, 6, 0 },
+};
+
+static uint32_t *cprman_reg(BCM2835CprmanState *s, hwaddr offset)
+{
+    return &s->regs[offset >> 2];
+}
+
+static bool bcm2835_pll_locked(BCM2835CprmanState *s, int pll)
+{
+    return !(*cprman_reg(s, bcm2835_plls[pll].a2w) & A2W_PLL_CTRL_PWRDN)
+           && !(*cprman_reg(s, bcm2835_plls[pll].cm) & CM_PLL_ANARST);
+}
+
+static uint64_t bcm2835_pll_rate(BCM2835CprmanState *s, int pll)
+{
+    uint32_t ctrl = *cprman_reg(s, bcm2835_plls[pll].a2w);
+    uint32_t frac = *cprman_reg(s, bcm2835_plls[pll].a2w +
+                                   A2W_PLL_FRAC_OFFSET);
+    unsigned pdiv = extract32(ctrl, A2W_PLL_CTRL_PDIV_SHIFT,
+                              A2W_PLL_CTRL_PDIV_LEN);
+    uint64_t mult;
+
+    if (!bcm2835_pll_locked(s, pll) || pdiv == 0) {
+        return 0;
+    }
+
+    mult = ((uint64_t)(ctrl & A2W_PLL_CTRL_NDIV_MASK) << A2W_PLL_FRAC_BITS)
+           | (frac & A2W_PLL_FRAC_MASK);
+    return (s->xosc_freq * mult >> A2W_PLL_FRAC_BITS) / pdiv;
+}
+
+static void bcm2835_pll_program(BCM2835CprmanState *s, int pll,
+                                uint64_t rate)
+{
+    uint64_t mult = (rate << A2W_PLL_FRAC_BITS) / s->xosc_freq;
+    uint32_t ndiv = MIN(mult >> A2W_PLL_FRAC_BITS, A2W_PLL_CTRL_NDIV_MASK);
+
+    *cprman_reg(s, bcm2835_plls[pll].a2w) =
+        ndiv | (1 << A2W_PLL_CTRL_PDIV_SHIFT);
+    *cprman_reg(s, bcm2835_plls[pll].a2w + A2W_PLL_FRAC_OFFSET) =
+        mult & A2W_PLL_FRAC_MASK;
+    *cprman_reg(s, bcm2835_plls[pll].cm) &= ~CM_PLL_ANARST;
+}
+
+static uint32_t *bcm2835_chan_reg(BCM2835CprmanState *s, unsigned src)
+{
+    return cprman_reg(s, bcm2835_pll_chans[src - SRC_FIRST_CHAN].a2w);
+}
+
+static unsigned bcm2835_chan_div(BCM2835CprmanState *s, unsigned src)
+{
+    return (*bcm2835_chan_reg(s, src) & A2W_PLL_CHAN_DIV_MASK) ?: 256;
+}
+
+static uint64_t bcm2835_src_rate(BCM2835CprmanState *s, unsigned src)
+{
+    switch (src) {
+    case SRC_GND:
+        return 0;
+    case SRC_XOSC:
+        return s->xosc_freq;
+    default:
+        if (*bcm2835_chan_reg(s, src) & A2W_PLL_CHAN_DISABLE) {
+            return 0;
+        }
+        return bcm2835_pll_rate(s, bcm2835_pll_chans[src - SRC_FIRST_CHAN].pll)
+               / bcm2835_chan_div(s, src);
+    }
+}
+
+static bool bcm2835_gen_running(uint32_t ctl)
+{
+    return (ctl & CM_CTL_ENAB) && !(ctl & CM_CTL_KILL);
+}
+
+static uint64_t bcm2835_gen_rate(BCM2835CprmanState *s, int gen)
+{
+    uint32_t ctl = *cprman_reg(s, bcm2835_gens[gen].ctl);
+    uint32_t div = *cprman_reg(s, bcm2835_gens[gen].ctl + 4) & CM_DIV_MASK;
+    uint64_t parent;
+
+    if (!bcm2835_gen_running(ctl)) {
+        return 0;
+    }
+    if (!(ctl & CM_CTL_MASH_MASK)) {
+        /* without MASH noise shaping the fraction is ignored */
+        div &= ~((1 << CM_DIV_FRAC_BITS) - 1);
+    }
+    if (div >> CM_DIV_FRAC_BITS == 0) {
+        return 0;
+    }
+
+    parent = bcm2835_src_rate(s, bcm2835_gens[gen].parents[ctl &
+                                                           CM_CTL_SRC_MASK]);
+    return (parent << CM_DIV_FRAC_BITS) / div;
+}
+
+/* Run generator @gen from mux input @src as close to @rate as it gets */
+static void bcm2835_gen_program(BCM2835CprmanState *s, int gen,
+                                unsigned src, uint64_t rate)
+{
+    uint64_t parent = bcm2835_src_rate(s, bcm2835_gens[gen].parents[src]);
+    uint32_t *ctl = cprman_reg(s, bcm2835_gens[gen].ctl);
+    uint32_t *div = cprman_reg(s, bcm2835_gens[gen].ctl + 4);
+    uint64_t d;
+
+    if (rate == 0 || parent == 0) {
+        *ctl = src;
+        return;
+    }
+
+    d = ((parent << CM_DIV_FRAC_BITS) + rate / 2) / rate;
+    d = MAX(MIN(d, CM_DIV_MASK), 1 << CM_DIV_FRAC_BITS);
+    *div = d;
+    *ctl = src | CM_CTL_ENAB;
+    if (d & ((1 << CM_DIV_FRAC_BITS) - 1)) {
+        *ctl |= 1 << CM_CTL_MASH_SHIFT;
+    }
+}
+
+static int bcm2835_fw_clk_gen(uint32_t id)
+{
+    switch (id) {
+    case BCM2835_FW_CLK_EMMC:
+        return GEN_EMMC;
+    case BCM2835_FW_CLK_UART:
+        return GEN_UART;
+    case BCM2835_FW_CLK_CORE:
+        return GEN_VPU;
+    case BCM2835_FW_CLK_V3D:
+        return GEN_V3D;
+    case BCM2835_FW_CLK_H264:
+        return GEN_H264;
+    case BCM2835_FW_CLK_ISP:
+        return GEN_ISP;
+    case BCM2835_FW_CLK_PIXEL:
+        return GEN_DPI;
+    case BCM2835_FW_CLK_PWM:
+        return GEN_PWM;
+    case BCM2835_FW_CLK_EMMC2:
+        return GEN_EMMC2;
+    default:
+        return -1;
+    }
+}
+
+uint64_t bcm2835_cprman_get_fw_rate(BCM2835CprmanState *s, uint32_t id)
+{
+    int gen = bcm2835_fw_clk_gen(id);
+
+    if (gen >= 0) {
+        return bcm2835_gen_rate(s, gen);
+    }
+
+    switch (id) {
+    case BCM2835_FW_CLK_ARM:
+        return bcm2835_src_rate(s, SRC_PLLB_ARM);
+    case BCM2835_FW_CLK_SDRAM:
+        return BCM2835_SDRAM_FREQ;
+    default:
+        return 0;
+    }
+}
+
+uint64_t bcm2835_cprman_get_pcm_rate(BCM2835CprmanState *s)
+{
+    return bcm2835_gen_rate(s, GEN_PCM);
+}
+
+uint64_t bcm2835_cprman_set_fw_rate(BCM2835CprmanState *s, uint32_t id,
+                                    uint64_t rate)
+{
+    int gen = bcm2835_fw_clk_gen(id);
+    uint32_t ctl;
+
+    if (gen >= 0) {
+        ctl = *cprman_reg(s, bcm2835_gens[gen].ctl);
+        bcm2835_gen_program(s, gen, bcm2835_gen_running(ctl)
+                                    ? ctl & CM_CTL_SRC_MASK
+                                    : bcm2835_gens[gen].reset_src, rate);
+    } else if (id == BCM2835_FW_CLK_ARM && rate) {
+        /* retune PLLB under the ARM channel's fixed divider */
+        bcm2835_pll_program(s, PLLB, rate * bcm2835_chan_div(s,
+                                                             SRC_PLLB_ARM));
+    }
+
+    return bcm2835_cprman_get_fw_rate(s, id);
+}
+
+static uint64_t bcm2835_cprman_read(void *opaque, hwaddr offset,
+                                    unsigned size)
+{
+    BCM2835CprmanState *s = opaque;
+    uint32_t res = *cprman_reg(s, offset);
+    int i;
+
+    if (offset == CM_LOCK) {
+        for (i = 0; i < NUM_PLLS; i++) {
+            if (bcm2835_pll_locked(s, i)) {
+                res |= bcm2835_plls[i].lock;
+            }
+        }
+        return res;
+    }
+
+    for (i = 0; i < NUM_GENS; i++) {
+        if (offset == bcm2835_gens[i].ctl && bcm2835_gen_running(res)) {
+            res |= CM_CTL_BUSY;
+        }
+    }
+
+    return res;
+}
+
+static void bcm2835_cprman_write(void *opaque, hwaddr offset,
+                                 uint64_t value, unsigned size)
+{
+    BCM2835CprmanState *s = opaque;
+
+    if ((value & CM_PASSWORD_MASK) != CM_PASSWORD) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: write to 0x%" HWADDR_PRIx " without password\n",
+                      __func__, offset);
+        return;
+    }
+
+    value &= ~CM_PASSWORD_MASK;
+    if (offset == CM_LOCK) {
+        /* read only */
+        return;
+    }
+    if (offset < 0x1000) {
+        /* BUSY is derived; on other registers bit 7 doesn't exist */
+        value &= ~CM_CTL_BUSY;
+    }
+    *cprman_reg(s, offset) = value;
+}
+
+static const MemoryRegionOps bcm2835_cprman_ops = {
+    .read = bcm2835_cprman_read,
+    .write = bcm2835_cprman_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static const VMStateDescription vmstate_bcm2835_cprman = {
+    .name = TYPE_BCM2835_CPRMAN,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, BCM2835CprmanState,
+                             BCM2835_CPRMAN_SIZE / 4),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+/* Leave the clocks the way the firmware does before starting the ARM */
+static void bcm2835_cprman_reset(DeviceState *dev)
+{
+    BCM2835CprmanState *s = BCM2835_CPRMAN(dev);
+    unsigned src;
+    int i;
+
+    memset(s->regs, 0, sizeof(s->regs));
+
+    for (i = 0; i < NUM_PLLS; i++) {
+        *cprman_reg(s, bcm2835_plls[i].a2w) = A2W_PLL_CTRL_PWRDN;
+        *cprman_reg(s, bcm2835_plls[i].cm) = CM_PLL_ANARST;
+    }
+    for (src = SRC_FIRST_CHAN; src < NUM_SRCS; src++) {
+        *bcm2835_chan_reg(s, src) = A2W_PLL_CHAN_DISABLE;
+    }
+
+    bcm2835_pll_program(s, PLLB, 2ULL * s->arm_freq);
+    *bcm2835_chan_reg(s, SRC_PLLB_ARM) = 2;
+
+    bcm2835_pll_program(s, PLLC, 2000000000ULL);
+    *bcm2835_chan_reg(s, SRC_PLLC_CORE0) = 2;
+    *bcm2835_chan_reg(s, SRC_PLLC_CORE1) = 2;
+    *bcm2835_chan_reg(s, SRC_PLLC_CORE2) = 2;
+    *bcm2835_chan_reg(s, SRC_PLLC_PER) = 4;
+
+    bcm2835_pll_program(s, PLLD, 2000000000ULL);
+    *bcm2835_chan_reg(s, SRC_PLLD_CORE) = 4;
+    *bcm2835_chan_reg(s, SRC_PLLD_PER) = 4;
+
+    for (i = 0; i < NUM_GENS; i++) {
+        bcm2835_gen_program(s, i, bcm2835_gens[i].reset_src,
+                            bcm2835_gens[i].reset_rate);
+    }
+}
+
+static void bcm2835_cprman_init(Object *obj)
+{
+    BCM2835CprmanState *s = BCM2835_CPRMAN(obj);
+
+    memory_region_init_io(&s->iomem, obj, &bcm2835_cprman_ops, s,
+                          TYPE_BCM2835_CPRMAN, BCM2835_CPRMAN_SIZE);
+    sysbus_init_mmio(SYS_BUS_DEVICE(s), &s->iomem);
+}
+
+static void bcm2835_cprman_realize(DeviceState *dev, Error **errp)
+{
+    BCM2835CprmanState *s = BCM2835_CPRMAN(dev);
+
+    if (s->xosc_freq == 0) {
+        error_setg(errp, "%s: xosc-freq must be non-zero", __func__);
+        return;
+    }
+}
+
+static Property bcm2835_cprman_props[] = {
+    DEFINE_PROP_UINT32("xosc-freq", BCM2835CprmanState, xosc_freq, 19200000),
+    DEFINE_PROP_UINT32("arm-freq", BCM2835CprmanState, arm_freq, 700000000),
+    DEFINE_PROP_END_OF_LIST()
+};
+
+static void bcm2835_cprman_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = bcm2835_cprman_realize;
+    dc->reset = bcm2835_cprman_reset;
+    dc->vmsd = &vmstate_bcm2835_cprman;
+    dc->props = bcm2835_cprman_props;
+}
+
+static TypeInfo bcm2835_cprman_info = {
+    .name          = TYPE_BCM2835_CPRMAN,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(BCM2835CprmanState),
+    .class_init    = bcm2835_cprman_class_init,
+    .instance_init = bcm2835_cprman_init,
+};
+
+static void bcm2835_cprman_register_types(void)
+{
+    type_register_static(&bcm2835_cprman_info);
+}
+
+type_init(bcm2835_cprman_register_types)
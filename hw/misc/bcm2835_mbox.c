@@ -14,6 +14,7 @@
 #include "hw/misc/bcm2835_mbox.h"
 #include "migration/vmstate.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "qemu/module.h"
 
 #define MAIL0_PEEK   0x90
@@ -90,6 +91,10 @@ static void mbox_push(BCM2835Mbox *mb, uint32_t val)
     mbox_update_status(mb);
 }
 
+/*
+ * Call with the iothread lock held, but not s->lock: reading from a child
+ * can call back into bcm2835_mbox_set_irq().
+ */
 static void bcm2835_mbox_update(BCM2835MboxState *s)
 {
     uint32_t value;
@@ -105,7 +110,9 @@ static void bcm2835_mbox_update(BCM2835MboxState *s)
         while (s->available[n] && !(s->mbox[0].status & ARM_MS_FULL)) {
             value = ldl_le_phys(&s->mbox_as, n << MBOX_AS_CHAN_SHIFT);
             assert(value != MBOX_INVALID_DATA); /* Pending interrupt but no data */
+            qemu_mutex_lock(&s->lock);
             mbox_push(&s->mbox[0], value);
+            qemu_mutex_unlock(&s->lock);
         }
     }
 
@@ -116,6 +123,7 @@ static void bcm2835_mbox_update(BCM2835MboxState *s)
 
     /* Update ARM IRQ status */
     set = false;
+    qemu_mutex_lock(&s->lock);
     s->mbox[0].config &= ~ARM_MC_IHAVEDATAIRQPEND;
     if (!(s->mbox[0].status & ARM_MS_EMPTY)) {
         s->mbox[0].config |= ARM_MC_IHAVEDATAIRQPEND;
@@ -123,6 +131,7 @@ static void bcm2835_mbox_update(BCM2835MboxState *s)
             set = true;
         }
     }
+    qemu_mutex_unlock(&s->lock);
     qemu_set_irq(s->arm_irq, set);
 }
 
@@ -144,18 +153,38 @@ static uint64_t bcm2835_mbox_read(void *opaque, hwaddr offset, unsigned size)
 {
     BCM2835MboxState *s = opaque;
     uint32_t res = 0;
+    bool locked;
 
     offset &= 0xff;
 
     switch (offset) {
     case 0x80 ... 0x8c: /* MAIL0_READ */
+        /* Refilling the mailbox talks to the children and raises IRQs */
+        locked = qemu_mutex_iothread_locked();
+        if (!locked) {
+            qemu_mutex_lock_iothread();
+        }
+        qemu_mutex_lock(&s->lock);
         if (s->mbox[0].status & ARM_MS_EMPTY) {
             res = MBOX_INVALID_DATA;
+            qemu_mutex_unlock(&s->lock);
         } else {
             res = mbox_pull(&s->mbox[0], 0);
+            qemu_mutex_unlock(&s->lock);
+            /* Refill from any pending responses now there is space */
+            bcm2835_mbox_update(s);
         }
+        if (!locked) {
+            qemu_mutex_unlock_iothread();
+        }
+        return res;
+
+    default:
         break;
+    }
 
+    qemu_mutex_lock(&s->lock);
+    switch (offset) {
     case MAIL0_PEEK:
         res = s->mbox[0].reg[0];
         break;
@@ -178,11 +207,13 @@ static uint64_t bcm2835_mbox_read(void *opaque, hwaddr offset, unsigned size)
     default:
         qemu_log_mask(LOG_UNIMP, "%s: Unsupported offset 0x%"HWADDR_PRIx"\n",
                       __func__, offset);
-        return 0;
+        break;
     }
+    qemu_mutex_unlock(&s->lock);
 
-    bcm2835_mbox_update(s);
-
+    /* The other registers have no read side effects, so polling
+     * MAIL0_STATUS does not need to recompute the mailbox state.
+     */
     return res;
 }
 
@@ -192,16 +223,24 @@ static void bcm2835_mbox_write(void *opaque, hwaddr offset,
     BCM2835MboxState *s = opaque;
     hwaddr childaddr;
     uint8_t ch;
+    bool locked;
 
     offset &= 0xff;
 
+    locked = qemu_mutex_iothread_locked();
+    if (!locked) {
+        qemu_mutex_lock_iothread();
+    }
+
     switch (offset) {
     case MAIL0_SENDER:
         break;
 
     case MAIL0_CONFIG:
+        qemu_mutex_lock(&s->lock);
         s->mbox[0].config &= ~ARM_MC_IHAVEDATAIRQEN;
         s->mbox[0].config |= value & ARM_MC_IHAVEDATAIRQEN;
+        qemu_mutex_unlock(&s->lock);
         break;
 
     case 0xa0 ... 0xac: /* MAIL1_WRITE */
@@ -214,7 +253,9 @@ static void bcm2835_mbox_write(void *opaque, hwaddr offset,
                 childaddr = ch << MBOX_AS_CHAN_SHIFT;
                 if (ldl_le_phys(&s->mbox_as, childaddr + MBOX_AS_PENDING)) {
                     /* Child busy, push delayed. Push it in the arm->vc mbox */
+                    qemu_mutex_lock(&s->lock);
                     mbox_push(&s->mbox[1], value);
+                    qemu_mutex_unlock(&s->lock);
                 } else {
                     /* Push it directly to the child device */
                     stl_le_phys(&s->mbox_as, childaddr, value);
@@ -231,10 +272,15 @@ static void bcm2835_mbox_write(void *opaque, hwaddr offset,
         qemu_log_mask(LOG_UNIMP, "%s: Unsupported offset 0x%"HWADDR_PRIx
                                  " value 0x%"PRIx64"\n",
                       __func__, offset, value);
-        return;
+        goto out;
     }
 
     bcm2835_mbox_update(s);
+
+out:
+    if (!locked) {
+        qemu_mutex_unlock_iothread();
+    }
 }
 
 static const MemoryRegionOps bcm2835_mbox_ops = {
@@ -279,9 +325,18 @@ static void bcm2835_mbox_init(Object *obj)
 
     memory_region_init_io(&s->iomem, obj, &bcm2835_mbox_ops, s,
                           TYPE_BCM2835_MBOX, 0x400);
+    memory_region_clear_global_locking(&s->iomem);
     sysbus_init_mmio(SYS_BUS_DEVICE(s), &s->iomem);
     sysbus_init_irq(SYS_BUS_DEVICE(s), &s->arm_irq);
     qdev_init_gpio_in(DEVICE(s), bcm2835_mbox_set_irq, MBOX_CHAN_COUNT);
+    qemu_mutex_init(&s->lock);
+}
+
+static void bcm2835_mbox_finalize(Object *obj)
+{
+    BCM2835MboxState *s = BCM2835_MBOX(obj);
+
+    qemu_mutex_destroy(&s->lock);
 }
 
 static void bcm2835_mbox_reset(DeviceState *dev)
@@ -289,8 +344,10 @@ static void bcm2835_mbox_reset(DeviceState *dev)
     BCM2835MboxState *s = BCM2835_MBOX(dev);
     int n;
 
+    qemu_mutex_lock(&s->lock);
     mbox_reset(&s->mbox[0]);
     mbox_reset(&s->mbox[1]);
+    qemu_mutex_unlock(&s->lock);
     s->mbox_irq_disabled = false;
     for (n = 0; n < MBOX_CHAN_COUNT; n++) {
         s->available[n] = false;
@@ -330,6 +387,7 @@ static TypeInfo bcm2835_mbox_info = {
     .instance_size = sizeof(BCM2835MboxState),
     .class_init    = bcm2835_mbox_class_init,
     .instance_init = bcm2835_mbox_init,
+    .instance_finalize = bcm2835_mbox_finalize,
 };
 
 static void bcm2835_mbox_register_types(void)
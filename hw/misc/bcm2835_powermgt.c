@@ -0,0 +1,191 @@
+/*
+ * BCM2835 (Raspberry Pi) power management block: watchdog and reset
+ *
+ * Only the watchdog is modelled. The guest reboots by arming it with a
+ * few ticks and a full-reset configuration in RSTC; when it expires we
+ * request a system reset, so a reboot is handled inside the running
+ * process. The firmware convention of requesting a halt by setting RSTS
+ * partition bits to 63 (0x555) before the reset is turned into a
+ * shutdown. The power domain registers are plain storage.
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "hw/misc/bcm2835_powermgt.h"
+#include "migration/vmstate.h"
+#include "sysemu/runstate.h"
+#include "trace.h"
+
+#define PM_PASSWORD             0x5a000000
+#define PM_PASSWORD_MASK        0xff000000
+
+#define PM_RSTC                 0x1c
+#define PM_RSTS                 0x20
+#define PM_WDOG                 0x24
+
+#define PM_RSTC_WRCFG_MASK      0x00000030
+#define PM_RSTC_WRCFG_FULL_RESET 0x00000020
+#define PM_RSTS_HALT            0x00000555
+#define PM_WDOG_TIME_MASK       0x000fffff
+
+/* The watchdog counts down at 65536 ticks per second */
+#define PM_WDOG_TICK_SHIFT      16
+
+static bool bcm2835_powermgt_armed(BCM2835PowerMgtState *s)
+{
+    return (s->rstc & PM_RSTC_WRCFG_MASK) == PM_RSTC_WRCFG_FULL_RESET;
+}
+
+static void bcm2835_powermgt_rearm(BCM2835PowerMgtState *s)
+{
+    int64_t ns;
+
+    if (!bcm2835_powermgt_armed(s)) {
+        timer_del(s->wdog_timer);
+        return;
+    }
+
+    ns = muldiv64(s->wdog, NANOSECONDS_PER_SECOND, 1 << PM_WDOG_TICK_SHIFT);
+    timer_mod(s->wdog_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + ns);
+}
+
+static void bcm2835_powermgt_expire(void *opaque)
+{
+    BCM2835PowerMgtState *s = opaque;
+    bool halt = (s->rsts & PM_RSTS_HALT) == PM_RSTS_HALT;
+
+    trace_bcm2835_powermgt_expire(s->rsts, halt);
+    if (halt) {
+        qemu_system_shutdown_request(SHUTDOWN_CAUSE_GUEST_SHUTDOWN);
+    } else {
+        qemu_system_reset_request(SHUTDOWN_CAUSE_GUEST_RESET);
+    }
+}
+
+static uint64_t bcm2835_powermgt_read(void *opaque, hwaddr offset,
+                                      unsigned size)
+{
+    BCM2835PowerMgtState *s = opaque;
+    int64_t left;
+
+    switch (offset) {
+    case PM_RSTC:
+        return s->rstc;
+    case PM_RSTS:
+        return s->rsts;
+    case PM_WDOG:
+        if (!timer_pending(s->wdog_timer)) {
+            return s->wdog;
+        }
+        left = timer_expire_time_ns(s->wdog_timer) -
+               qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+        return muldiv64(MAX(left, 0), 1 << PM_WDOG_TICK_SHIFT,
+                        NANOSECONDS_PER_SECOND);
+    default:
+        return s->regs[offset >> 2];
+    }
+}
+
+static void bcm2835_powermgt_write(void *opaque, hwaddr offset,
+                                   uint64_t value, unsigned size)
+{
+    BCM2835PowerMgtState *s = opaque;
+
+    if ((value & PM_PASSWORD_MASK) != PM_PASSWORD) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: write to 0x%" HWADDR_PRIx " without password\n",
+                      __func__, offset);
+        return;
+    }
+    value &= ~PM_PASSWORD_MASK;
+
+    switch (offset) {
+    case PM_RSTC:
+        s->rstc = value;
+        bcm2835_powermgt_rearm(s);
+        break;
+    case PM_RSTS:
+        s->rsts = value;
+        break;
+    case PM_WDOG:
+        s->wdog = value & PM_WDOG_TIME_MASK;
+        if (timer_pending(s->wdog_timer)) {
+            bcm2835_powermgt_rearm(s);
+        }
+        break;
+    default:
+        s->regs[offset >> 2] = value;
+        break;
+    }
+}
+
+static const MemoryRegionOps bcm2835_powermgt_ops = {
+    .read = bcm2835_powermgt_read,
+    .write = bcm2835_powermgt_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static const VMStateDescription vmstate_bcm2835_powermgt = {
+    .name = TYPE_BCM2835_POWERMGT,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(rstc, BCM2835PowerMgtState),
+        VMSTATE_UINT32(rsts, BCM2835PowerMgtState),
+        VMSTATE_UINT32(wdog, BCM2835PowerMgtState),
+        VMSTATE_UINT32_ARRAY(regs, BCM2835PowerMgtState,
+                             BCM2835_POWERMGT_SIZE / 4),
+        VMSTATE_TIMER_PTR(wdog_timer, BCM2835PowerMgtState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void bcm2835_powermgt_reset(DeviceState *dev)
+{
+    BCM2835PowerMgtState *s = BCM2835_POWERMGT(dev);
+
+    timer_del(s->wdog_timer);
+    s->rstc = 0;
+    s->rsts = 0;
+    s->wdog = 0;
+    memset(s->regs, 0, sizeof(s->regs));
+}
+
+static void bcm2835_powermgt_init(Object *obj)
+{
+    BCM2835PowerMgtState *s = BCM2835_POWERMGT(obj);
+
+    memory_region_init_io(&s->iomem, obj, &bcm2835_powermgt_ops, s,
+                          TYPE_BCM2835_POWERMGT, BCM2835_POWERMGT_SIZE);
+    sysbus_init_mmio(SYS_BUS_DEVICE(s), &s->iomem);
+    s->wdog_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                 bcm2835_powermgt_expire, s);
+}
+
+static void bcm2835_powermgt_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->reset = bcm2835_powermgt_reset;
+    dc->vmsd = &vmstate_bcm2835_powermgt;
+}
+
+static TypeInfo bcm2835_powermgt_info = {
+    .name          = TYPE_BCM2835_POWERMGT,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(BCM2835PowerMgtState),
+    .class_init    = bcm2835_powermgt_class_init,
+    .instance_init = bcm2835_powermgt_init,
+};
+
+static void bcm2835_powermgt_register_types(void)
+{
+    type_register_static(&bcm2835_powermgt_info);
+}
+
+type_init(bcm2835_powermgt_register_types)
@@ -13,301 +13,514 @@
 #include "sysemu/dma.h"
 #include "qemu/log.h"
 #include "qemu/module.h"
+#include "qemu/units.h"
+#include "trace.h"
 
 /* https://github.com/raspberrypi/firmware/wiki/Mailbox-property-interface */
 
-static void bcm2835_property_mbox_push(BCM2835PropertyState *s, uint32_t value)
-{
-    uint32_t tag;
-    uint32_t bufsize;
-    uint32_t tot_len;
-    size_t resplen;
-    uint32_t tmp;
-    int n;
-    uint32_t offset, length, color;
+/* Largest request buffer we are prepared to process */
+#define PROPERTY_MAX_BUF_LEN    (64 * KiB)
 
+/* State carried across the tags of one property request */
+typedef struct BCM2835PropertyRequest {
     /*
-     * Copy the current state of the framebuffer config; we will update
-     * this copy as we process tags and then ask the framebuffer to use
-     * it at the end.
+     * Copy of the current framebuffer config; we update this copy as we
+     * process tags and then ask the framebuffer to use it at the end.
      */
-    BCM2835FBConfig fbconfig = s->fbdev->config;
-    bool fbconfig_updated = false;
+    BCM2835FBConfig fbconfig;
+    bool fbconfig_updated;
+} BCM2835PropertyRequest;
 
-    value &= ~0xf;
+typedef struct BCM2835PropertyTag BCM2835PropertyTag;
 
-    s->addr = value;
+/*
+ * A tag handler processes the value buffer @data of tag @t in place;
+ * @len is the number of bytes of the request buffer available from @data
+ * onwards.  It returns the length of the response.
+ */
+typedef size_t BCM2835PropertyTagFn(BCM2835PropertyState *s,
+                                    BCM2835PropertyRequest *req,
+                                    const BCM2835PropertyTag *t,
+                                    uint8_t *data, size_t len);
 
-    tot_len = ldl_le_phys(&s->dma_as, value);
+struct BCM2835PropertyTag {
+    uint32_t tag;
+    const char *name;
+    /* NULL for tags that are acknowledged without doing anything */
+    BCM2835PropertyTagFn *fn;
+    /* Bytes of value buffer the handler touches, and the response length */
+    size_t len;
+};
 
-    /* @(addr + 4) : Buffer response code */
-    value = s->addr + 8;
-    while (value + 8 <= s->addr + tot_len) {
-        tag = ldl_le_phys(&s->dma_as, value);
-        bufsize = ldl_le_phys(&s->dma_as, value + 4);
-        /* @(value + 8) : Request/response indicator */
-        resplen = 0;
-        switch (tag) {
-        case 0x00000000: /* End tag */
-            break;
-        case 0x00000001: /* Get firmware revision */
-            stl_le_phys(&s->dma_as, value + 12, 346337);
-            resplen = 4;
-            break;
-        case 0x00010001: /* Get board model */
-            qemu_log_mask(LOG_UNIMP,
-                          "bcm2835_property: 0x%08x get board model NYI\n",
-                          tag);
-            /* FIXME returning uninitialized memory */
-            resplen = 4;
-            break;
-        case 0x00010002: /* Get board revision */
-            stl_le_phys(&s->dma_as, value + 12, s->board_rev);
-            resplen = 4;
-            break;
-        case 0x00010003: /* Get board MAC address */
-            resplen = sizeof(s->macaddr.a);
-            dma_memory_write(&s->dma_as, value + 12, s->macaddr.a, resplen);
-            break;
-        case 0x00010004: /* Get board serial */
-            qemu_log_mask(LOG_UNIMP,
-                          "bcm2835_property: 0x%08x get board serial NYI\n",
-                          tag);
-            /* FIXME returning uninitialized memory */
-            resplen = 8;
-            break;
-        case 0x00010005: /* Get ARM memory */
-            /* base */
-            stl_le_phys(&s->dma_as, value + 12, 0);
-            /* size */
-            stl_le_phys(&s->dma_as, value + 16, s->fbdev->vcram_base);
-            resplen = 8;
-            break;
-        case 0x00010006: /* Get VC memory */
-            /* base */
-            stl_le_phys(&s->dma_as, value + 12, s->fbdev->vcram_base);
-            /* size */
-            stl_le_phys(&s->dma_as, value + 16, s->fbdev->vcram_size);
-            resplen = 8;
-            break;
-        case 0x00028001: /* Set power state */
-            /* Assume that whatever device they asked for exists,
-             * and we'll just claim we set it to the desired state
-             */
-            tmp = ldl_le_phys(&s->dma_as, value + 16);
-            stl_le_phys(&s->dma_as, value + 16, (tmp & 1));
-            resplen = 8;
-            break;
+/* Board */
 
-        /* Clocks */
+static size_t prop_get_fw_revision(BCM2835PropertyState *s,
+                                   BCM2835PropertyRequest *req,
+                                   const BCM2835PropertyTag *t,
+                                   uint8_t *data, size_t len)
+{
+    stl_le_p(data, 346337);
+    return 4;
+}
 
-        case 0x00030001: /* Get clock state */
-            stl_le_phys(&s->dma_as, value + 16, 0x1);
-            resplen = 8;
-            break;
+static size_t prop_get_board_rev(BCM2835PropertyState *s,
+                                 BCM2835PropertyRequest *req,
+                                 const BCM2835PropertyTag *t,
+                                 uint8_t *data, size_t len)
+{
+    stl_le_p(data, s->board_rev);
+    return 4;
+}
 
-        case 0x00038001: /* Set clock state */
-            qemu_log_mask(LOG_UNIMP,
-                          "bcm2835_property: 0x%08x set clock state NYI\n",
-                          tag);
-            resplen = 8;
-            break;
+static size_t prop_get_board_mac(BCM2835PropertyState *s,
+                                 BCM2835PropertyRequest *req,
+                                 const BCM2835PropertyTag *t,
+                                 uint8_t *data, size_t len)
+{
+    memcpy(data, s->macaddr.a, sizeof(s->macaddr.a));
+    return sizeof(s->macaddr.a);
+}
 
-        case 0x00030002: /* Get clock rate */
-        case 0x00030004: /* Get max clock rate */
-        case 0x00030007: /* Get min clock rate */
-            switch (ldl_le_phys(&s->dma_as, value + 12)) {
-            case 1: /* EMMC */
-                stl_le_phys(&s->dma_as, value + 16, 50000000);
-                break;
-            case 2: /* UART */
-                stl_le_phys(&s->dma_as, value + 16, 3000000);
-                break;
-            default:
-                stl_le_phys(&s->dma_as, value + 16, 700000000);
-                break;
-            }
-            resplen = 8;
-            break;
+static size_t prop_get_arm_memory(BCM2835PropertyState *s,
+                                  BCM2835PropertyRequest *req,
+                                  const BCM2835PropertyTag *t,
+                                  uint8_t *data, size_t len)
+{
+    /* base */
+    stl_le_p(data, 0);
+    /* size */
+    stl_le_p(data + 4, s->fbdev->vcram_base);
+    return 8;
+}
 
-        case 0x00030030: /* Get domain state */
-            qemu_log_mask(LOG_UNIMP,
-                          "bcm2835_property: 0x%08x get domain state NYI\n",
-                          tag);
-            /* FIXME returning uninitialized memory */
-            resplen = 8;
-            break;
+static size_t prop_get_vc_memory(BCM2835PropertyState *s,
+                                 BCM2835PropertyRequest *req,
+                                 const BCM2835PropertyTag *t,
+                                 uint8_t *data, size_t len)
+{
+    /* base */
+    stl_le_p(data, s->fbdev->vcram_base);
+    /* size */
+    stl_le_p(data + 4, s->fbdev->vcram_size);
+    return 8;
+}
 
-        case 0x00038002: /* Set clock rate */
-        case 0x00038004: /* Set max clock rate */
-        case 0x00038007: /* Set min clock rate */
-            qemu_log_mask(LOG_UNIMP,
-                          "bcm2835_property: 0x%08x set clock rate NYI\n",
-                          tag);
-            resplen = 8;
-            break;
+static size_t prop_set_power_state(BCM2835PropertyState *s,
+                                   BCM2835PropertyRequest *req,
+                                   const BCM2835PropertyTag *t,
+                                   uint8_t *data, size_t len)
+{
+    /* Assume that whatever device they asked for exists,
+     * and we'll just claim we set it to the desired state
+     */
+    stl_le_p(data + 4, ldl_le_p(data + 4) & 1);
+    return 8;
+}
 
-        /* Temperature */
+/* Clocks */
 
-        case 0x00030006: /* Get temperature */
-            stl_le_phys(&s->dma_as, value + 16, 25000);
-            resplen = 8;
-            break;
+static size_t prop_get_clock_state(BCM2835PropertyState *s,
+                                   BCM2835PropertyRequest *req,
+                                   const BCM2835PropertyTag *t,
+                                   uint8_t *data, size_t len)
+{
+    uint32_t id = ldl_le_p(data);
 
-        case 0x0003000A: /* Get max temperature */
-            stl_le_phys(&s->dma_as, value + 16, 99000);
-            resplen = 8;
-            break;
+    /* bit 0: on; bit 1: doesn't exist */
+    if (bcm2835_cprman_get_fw_rate(s->cprman, id)) {
+        stl_le_p(data + 4, 0x1);
+    } else {
+        stl_le_p(data + 4, id == BCM2835_FW_CLK_PWM ? 0x0 : 0x2);
+    }
+    return 8;
+}
 
-        /* Frame buffer */
+static size_t prop_get_clock_rate(BCM2835PropertyState *s,
+                                  BCM2835PropertyRequest *req,
+                                  const BCM2835PropertyTag *t,
+                                  uint8_t *data, size_t len)
+{
+    stl_le_p(data + 4, bcm2835_cprman_get_fw_rate(s->cprman, ldl_le_p(data)));
+    return 8;
+}
 
-        case 0x00040001: /* Allocate buffer */
-            stl_le_phys(&s->dma_as, value + 12, fbconfig.base);
-            stl_le_phys(&s->dma_as, value + 16,
-                        bcm2835_fb_get_size(&fbconfig));
-            resplen = 8;
-            break;
-        case 0x00048001: /* Release buffer */
-            resplen = 0;
-            break;
-        case 0x00040002: /* Blank screen */
-            resplen = 4;
-            break;
-        case 0x00044003: /* Test physical display width/height */
-        case 0x00044004: /* Test virtual display width/height */
-            resplen = 8;
-            break;
-        case 0x00048003: /* Set physical display width/height */
-            fbconfig.xres = ldl_le_phys(&s->dma_as, value + 12);
-            fbconfig.yres = ldl_le_phys(&s->dma_as, value + 16);
-            bcm2835_fb_validate_config(&fbconfig);
-            fbconfig_updated = true;
-            /* fall through */
-        case 0x00040003: /* Get physical display width/height */
-            stl_le_phys(&s->dma_as, value + 12, fbconfig.xres);
-            stl_le_phys(&s->dma_as, value + 16, fbconfig.yres);
-            resplen = 8;
-            break;
-        case 0x00048004: /* Set virtual display width/height */
-            fbconfig.xres_virtual = ldl_le_phys(&s->dma_as, value + 12);
-            fbconfig.yres_virtual = ldl_le_phys(&s->dma_as, value + 16);
-            bcm2835_fb_validate_config(&fbconfig);
-            fbconfig_updated = true;
-            /* fall through */
-        case 0x00040004: /* Get virtual display width/height */
-            stl_le_phys(&s->dma_as, value + 12, fbconfig.xres_virtual);
-            stl_le_phys(&s->dma_as, value + 16, fbconfig.yres_virtual);
-            resplen = 8;
-            break;
-        case 0x00044005: /* Test depth */
-            resplen = 4;
-            break;
-        case 0x00048005: /* Set depth */
-            fbconfig.bpp = ldl_le_phys(&s->dma_as, value + 12);
-            bcm2835_fb_validate_config(&fbconfig);
-            fbconfig_updated = true;
-            /* fall through */
-        case 0x00040005: /* Get depth */
-            stl_le_phys(&s->dma_as, value + 12, fbconfig.bpp);
-            resplen = 4;
-            break;
-        case 0x00044006: /* Test pixel order */
-            resplen = 4;
-            break;
-        case 0x00048006: /* Set pixel order */
-            fbconfig.pixo = ldl_le_phys(&s->dma_as, value + 12);
-            bcm2835_fb_validate_config(&fbconfig);
-            fbconfig_updated = true;
-            /* fall through */
-        case 0x00040006: /* Get pixel order */
-            stl_le_phys(&s->dma_as, value + 12, fbconfig.pixo);
-            resplen = 4;
-            break;
-        case 0x00044007: /* Test pixel alpha */
-            resplen = 4;
-            break;
-        case 0x00048007: /* Set alpha */
-            fbconfig.alpha = ldl_le_phys(&s->dma_as, value + 12);
-            bcm2835_fb_validate_config(&fbconfig);
-            fbconfig_updated = true;
-            /* fall through */
-        case 0x00040007: /* Get alpha */
-            stl_le_phys(&s->dma_as, value + 12, fbconfig.alpha);
-            resplen = 4;
-            break;
-        case 0x00040008: /* Get pitch */
-            stl_le_phys(&s->dma_as, value + 12,
-                        bcm2835_fb_get_pitch(&fbconfig));
-            resplen = 4;
-            break;
-        case 0x00044009: /* Test virtual offset */
-            resplen = 8;
-            break;
-        case 0x00048009: /* Set virtual offset */
-            fbconfig.xoffset = ldl_le_phys(&s->dma_as, value + 12);
-            fbconfig.yoffset = ldl_le_phys(&s->dma_as, value + 16);
-            bcm2835_fb_validate_config(&fbconfig);
-            fbconfig_updated = true;
-            /* fall through */
-        case 0x00040009: /* Get virtual offset */
-            stl_le_phys(&s->dma_as, value + 12, fbconfig.xoffset);
-            stl_le_phys(&s->dma_as, value + 16, fbconfig.yoffset);
-            resplen = 8;
-            break;
-        case 0x0004000a: /* Get/Test/Set overscan */
-        case 0x0004400a:
-        case 0x0004800a:
-            stl_le_phys(&s->dma_as, value + 12, 0);
-            stl_le_phys(&s->dma_as, value + 16, 0);
-            stl_le_phys(&s->dma_as, value + 20, 0);
-            stl_le_phys(&s->dma_as, value + 24, 0);
-            resplen = 16;
-            break;
-        case 0x0004800b: /* Set palette */
-            offset = ldl_le_phys(&s->dma_as, value + 12);
-            length = ldl_le_phys(&s->dma_as, value + 16);
-            n = 0;
-            while (n < length - offset) {
-                color = ldl_le_phys(&s->dma_as, value + 20 + (n << 2));
-                stl_le_phys(&s->dma_as,
-                            s->fbdev->vcram_base + ((offset + n) << 2), color);
-                n++;
-            }
-            stl_le_phys(&s->dma_as, value + 12, 0);
-            resplen = 4;
-            break;
+static size_t prop_set_clock_rate(BCM2835PropertyState *s,
+                                  BCM2835PropertyRequest *req,
+                                  const BCM2835PropertyTag *t,
+                                  uint8_t *data, size_t len)
+{
+    /* the skip-turbo word that may follow is irrelevant here */
+    stl_le_p(data + 4, bcm2835_cprman_set_fw_rate(s->cprman, ldl_le_p(data),
+                                                  ldl_le_p(data + 4)));
+    return 8;
+}
 
-        case 0x00060001: /* Get DMA channels */
-            /* channels 2-5 */
-            stl_le_phys(&s->dma_as, value + 12, 0x003C);
-            resplen = 4;
-            break;
+/* Temperature */
+
+static size_t prop_get_temperature(BCM2835PropertyState *s,
+                                   BCM2835PropertyRequest *req,
+                                   const BCM2835PropertyTag *t,
+                                   uint8_t *data, size_t len)
+{
+    stl_le_p(data + 4, s->thermal->temperature);
+    return 8;
+}
+
+static size_t prop_get_max_temperature(BCM2835PropertyState *s,
+                                       BCM2835PropertyRequest *req,
+                                       const BCM2835PropertyTag *t,
+                                       uint8_t *data, size_t len)
+{
+    stl_le_p(data + 4, 99000);
+    return 8;
+}
+
+/* Frame buffer */
+
+static size_t prop_fb_allocate(BCM2835PropertyState *s,
+                               BCM2835PropertyRequest *req,
+                               const BCM2835PropertyTag *t,
+                               uint8_t *data, size_t len)
+{
+    stl_le_p(data, req->fbconfig.base);
+    stl_le_p(data + 4, bcm2835_fb_get_size(&req->fbconfig));
+    return 8;
+}
+
+static size_t prop_fb_get_physical(BCM2835PropertyState *s,
+                                   BCM2835PropertyRequest *req,
+                                   const BCM2835PropertyTag *t,
+                                   uint8_t *data, size_t len)
+{
+    stl_le_p(data, req->fbconfig.xres);
+    stl_le_p(data + 4, req->fbconfig.yres);
+    return 8;
+}
+
+static size_t prop_fb_set_physical(BCM2835PropertyState *s,
+                                   BCM2835PropertyRequest *req,
+                                   const BCM2835PropertyTag *t,
+                                   uint8_t *data, size_t len)
+{
+    req->fbconfig.xres = ldl_le_p(data);
+    req->fbconfig.yres = ldl_le_p(data + 4);
+    bcm2835_fb_validate_config(&req->fbconfig);
+    req->fbconfig_updated = true;
+    return prop_fb_get_physical(s, req, t, data, len);
+}
 
-        case 0x00050001: /* Get command line */
-            resplen = 0;
+static size_t prop_fb_get_virtual(BCM2835PropertyState *s,
+                                  BCM2835PropertyRequest *req,
+                                  const BCM2835PropertyTag *t,
+                                  uint8_t *data, size_t len)
+{
+    stl_le_p(data, req->fbconfig.xres_virtual);
+    stl_le_p(data + 4, req->fbconfig.yres_virtual);
+    return 8;
+}
+
+static size_t prop_fb_set_virtual(BCM2835PropertyState *s,
+                                  BCM2835PropertyRequest *req,
+                                  const BCM2835PropertyTag *t,
+                                  uint8_t *data, size_t len)
+{
+    req->fbconfig.xres_virtual = ldl_le_p(data);
+    req->fbconfig.yres_virtual = ldl_le_p(data + 4);
+    bcm2835_fb_validate_config(&req->fbconfig);
+    req->fbconfig_updated = true;
+    return prop_fb_get_virtual(s, req, t, data, len);
+}
+
+static size_t prop_fb_get_depth(BCM2835PropertyState *s,
+                                BCM2835PropertyRequest *req,
+                                const BCM2835PropertyTag *t,
+                                uint8_t *data, size_t len)
+{
+    stl_le_p(data, req->fbconfig.bpp);
+    return 4;
+}
+
+static size_t prop_fb_set_depth(BCM2835PropertyState *s,
+                                BCM2835PropertyRequest *req,
+                                const BCM2835PropertyTag *t,
+                                uint8_t *data, size_t len)
+{
+    req->fbconfig.bpp = ldl_le_p(data);
+    bcm2835_fb_validate_config(&req->fbconfig);
+    req->fbconfig_updated = true;
+    return prop_fb_get_depth(s, req, t, data, len);
+}
+
+static size_t prop_fb_get_pixo(BCM2835PropertyState *s,
+                               BCM2835PropertyRequest *req,
+                               const BCM2835PropertyTag *t,
+                               uint8_t *data, size_t len)
+{
+    stl_le_p(data, req->fbconfig.pixo);
+    return 4;
+}
+
+static size_t prop_fb_set_pixo(BCM2835PropertyState *s,
+                               BCM2835PropertyRequest *req,
+                               const BCM2835PropertyTag *t,
+                               uint8_t *data, size_t len)
+{
+    req->fbconfig.pixo = ldl_le_p(data);
+    bcm2835_fb_validate_config(&req->fbconfig);
+    req->fbconfig_updated = true;
+    return prop_fb_get_pixo(s, req, t, data, len);
+}
+
+static size_t prop_fb_get_alpha(BCM2835PropertyState *s,
+                                BCM2835PropertyRequest *req,
+                                const BCM2835PropertyTag *t,
+                                uint8_t *data, size_t len)
+{
+    stl_le_p(data, req->fbconfig.alpha);
+    return 4;
+}
+
+static size_t prop_fb_set_alpha(BCM2835PropertyState *s,
+                                BCM2835PropertyRequest *req,
+                                const BCM2835PropertyTag *t,
+                                uint8_t *data, size_t len)
+{
+    req->fbconfig.alpha = ldl_le_p(data);
+    bcm2835_fb_validate_config(&req->fbconfig);
+    req->fbconfig_updated = true;
+    return prop_fb_get_alpha(s, req, t, data, len);
+}
+
+static size_t prop_fb_get_pitch(BCM2835PropertyState *s,
+                                BCM2835PropertyRequest *req,
+                                const BCM2835PropertyTag *t,
+                                uint8_t *data, size_t len)
+{
+    stl_le_p(data, bcm2835_fb_get_pitch(&req->fbconfig));
+    return 4;
+}
+
+static size_t prop_fb_get_offset(BCM2835PropertyState *s,
+                                 BCM2835PropertyRequest *req,
+                                 const BCM2835PropertyTag *t,
+                                 uint8_t *data, size_t len)
+{
+    stl_le_p(data, req->fbconfig.xoffset);
+    stl_le_p(data + 4, req->fbconfig.yoffset);
+    return 8;
+}
+
+static size_t prop_fb_set_offset(BCM2835PropertyState *s,
+                                 BCM2835PropertyRequest *req,
+                                 const BCM2835PropertyTag *t,
+                                 uint8_t *data, size_t len)
+{
+    req->fbconfig.xoffset = ldl_le_p(data);
+    req->fbconfig.yoffset = ldl_le_p(data + 4);
+    bcm2835_fb_validate_config(&req->fbconfig);
+    req->fbconfig_updated = true;
+    return prop_fb_get_offset(s, req, t, data, len);
+}
+
+static size_t prop_fb_overscan(BCM2835PropertyState *s,
+                               BCM2835PropertyRequest *req,
+                               const BCM2835PropertyTag *t,
+                               uint8_t *data, size_t len)
+{
+    memset(data, 0, 16);
+    return 16;
+}
+
+static size_t prop_fb_set_palette(BCM2835PropertyState *s,
+                                  BCM2835PropertyRequest *req,
+                                  const BCM2835PropertyTag *t,
+                                  uint8_t *data, size_t len)
+{
+    uint32_t offset = ldl_le_p(data);
+    uint32_t length = ldl_le_p(data + 4);
+    uint32_t count = length > offset ? length - offset : 0;
+
+    if (offset > 255 || count > 256 - offset || 8 + count * 4 > len) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "bcm2835_property: bad palette range %u+%u\n",
+                      offset, count);
+        stl_le_p(data, 1);
+        return 4;
+    }
+
+    /* The palette lives at the start of video RAM, in the same layout */
+    dma_memory_write(&s->dma_as, s->fbdev->vcram_base + (offset << 2),
+                     data + 8, count << 2);
+    stl_le_p(data, 0);
+    return 4;
+}
+
+/* DMA */
+
+static size_t prop_get_dma_channels(BCM2835PropertyState *s,
+                                    BCM2835PropertyRequest *req,
+                                    const BCM2835PropertyTag *t,
+                                    uint8_t *data, size_t len)
+{
+    /* channels 2-5 */
+    stl_le_p(data, 0x003C);
+    return 4;
+}
+
+/* Tags we acknowledge without implementing them */
+static size_t prop_unimp(BCM2835PropertyState *s,
+                         BCM2835PropertyRequest *req,
+                         const BCM2835PropertyTag *t,
+                         uint8_t *data, size_t len)
+{
+    qemu_log_mask(LOG_UNIMP, "bcm2835_property: 0x%08x %s NYI\n",
+                  t->tag, t->name);
+    return t->len;
+}
+
+/* Sorted by tag, for bsearch() */
+static const BCM2835PropertyTag bcm2835_property_tags[] = {
+    { 0x00000001, "get firmware revision", prop_get_fw_revision, 4 },
+    /* FIXME returning uninitialized memory */
+    { 0x00010001, "get board model", prop_unimp, 4 },
+    { 0x00010002, "get board revision", prop_get_board_rev, 4 },
+    { 0x00010003, "get board MAC address", prop_get_board_mac, 6 },
+    /* FIXME returning uninitialized memory */
+    { 0x00010004, "get board serial", prop_unimp, 8 },
+    { 0x00010005, "get ARM memory", prop_get_arm_memory, 8 },
+    { 0x00010006, "get VC memory", prop_get_vc_memory, 8 },
+    { 0x00028001, "set power state", prop_set_power_state, 8 },
+    { 0x00030001, "get clock state", prop_get_clock_state, 8 },
+    { 0x00030002, "get clock rate", prop_get_clock_rate, 8 },
+    { 0x00030004, "get max clock rate", prop_get_clock_rate, 8 },
+    { 0x00030006, "get temperature", prop_get_temperature, 8 },
+    { 0x00030007, "get min clock rate", prop_get_clock_rate, 8 },
+    { 0x0003000a, "get max temperature", prop_get_max_temperature, 8 },
+    /* FIXME returning uninitialized memory */
+    { 0x00030030, "get domain state", prop_unimp, 8 },
+    { 0x00038001, "set clock state", prop_unimp, 8 },
+    { 0x00038002, "set clock rate", prop_set_clock_rate, 8 },
+    { 0x00038004, "set max clock rate", prop_unimp, 8 },
+    { 0x00038007, "set min clock rate", prop_unimp, 8 },
+    { 0x00040001, "allocate buffer", prop_fb_allocate, 8 },
+    { 0x00040002, "blank screen", NULL, 4 },
+    { 0x00040003, "get physical display size", prop_fb_get_physical, 8 },
+    { 0x00040004, "get virtual display size", prop_fb_get_virtual, 8 },
+    { 0x00040005, "get depth", prop_fb_get_depth, 4 },
+    { 0x00040006, "get pixel order", prop_fb_get_pixo, 4 },
+    { 0x00040007, "get alpha mode", prop_fb_get_alpha, 4 },
+    { 0x00040008, "get pitch", prop_fb_get_pitch, 4 },
+    { 0x00040009, "get virtual offset", prop_fb_get_offset, 8 },
+    { 0x0004000a, "get overscan", prop_fb_overscan, 16 },
+    { 0x00044003, "test physical display size", NULL, 8 },
+    { 0x00044004, "test virtual display size", NULL, 8 },
+    { 0x00044005, "test depth", NULL, 4 },
+    { 0x00044006, "test pixel order", NULL, 4 },
+    { 0x00044007, "test alpha mode", NULL, 4 },
+    { 0x00044009, "test virtual offset", NULL, 8 },
+    { 0x0004400a, "test overscan", prop_fb_overscan, 16 },
+    { 0x00048001, "release buffer", NULL, 0 },
+    { 0x00048003, "set physical display size", prop_fb_set_physical, 8 },
+    { 0x00048004, "set virtual display size", prop_fb_set_virtual, 8 },
+    { 0x00048005, "set depth", prop_fb_set_depth, 4 },
+    { 0x00048006, "set pixel order", prop_fb_set_pixo, 4 },
+    { 0x00048007, "set alpha mode", prop_fb_set_alpha, 4 },
+    { 0x00048009, "set virtual offset", prop_fb_set_offset, 8 },
+    { 0x0004800a, "set overscan", prop_fb_overscan, 16 },
+    { 0x0004800b, "set palette", prop_fb_set_palette, 8 },
+    { 0x00050001, "get command line", NULL, 0 },
+    { 0x00060001, "get DMA channels", prop_get_dma_channels, 4 },
+};
+
+static int bcm2835_property_tag_cmp(const void *key, const void *elem)
+{
+    uint32_t tag = *(const uint32_t *)key;
+    const BCM2835PropertyTag *t = elem;
+
+    return tag < t->tag ? -1 : tag > t->tag;
+}
+
+static void bcm2835_property_mbox_push(BCM2835PropertyState *s, uint32_t value)
+{
+    BCM2835PropertyRequest req = {
+        .fbconfig = s->fbdev->config,
+    };
+    const BCM2835PropertyTag *t;
+    uint32_t tag;
+    uint32_t bufsize;
+    uint32_t tot_len;
+    uint32_t pos;
+    size_t resplen;
+    uint8_t *buf;
+    unsigned idx;
+
+    value &= ~0xf;
+
+    s->addr = value;
+
+    tot_len = ldl_le_phys(&s->dma_as, value);
+    trace_bcm2835_property_request(value, tot_len);
+    if (tot_len > PROPERTY_MAX_BUF_LEN) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "bcm2835_property: request of %u bytes truncated\n",
+                      tot_len);
+        tot_len = PROPERTY_MAX_BUF_LEN;
+    }
+    tot_len &= ~3;
+    if (tot_len < 8) {
+        return;
+    }
+
+    /* Process the whole request in a local copy, and write it back once */
+    buf = g_malloc(tot_len);
+    dma_memory_read(&s->dma_as, value, buf, tot_len);
+
+    /* @(addr + 4) : Buffer response code */
+    pos = 8;
+    while (pos + 12 <= tot_len) {
+        tag = ldl_le_p(buf + pos);
+        bufsize = ldl_le_p(buf + pos + 4);
+        /* @(pos + 8) : Request/response indicator */
+        if (tag == 0) { /* End tag */
             break;
+        }
 
-        default:
+        resplen = 0;
+        t = bsearch(&tag, bcm2835_property_tags,
+                    ARRAY_SIZE(bcm2835_property_tags),
+                    sizeof(bcm2835_property_tags[0]),
+                    bcm2835_property_tag_cmp);
+        if (!t) {
             qemu_log_mask(LOG_UNIMP,
                           "bcm2835_property: unhandled tag 0x%08x\n", tag);
-            break;
+        } else if (t->len > tot_len - pos - 12) {
+            qemu_log_mask(LOG_GUEST_ERROR,
+                          "bcm2835_property: tag 0x%08x overruns buffer\n",
+                          tag);
+        } else {
+            idx = t - bcm2835_property_tags;
+            s->tag_count[idx]++;
+            trace_bcm2835_property_tag(tag, t->name, s->tag_count[idx]);
+            resplen = t->fn ? t->fn(s, &req, t, buf + pos + 12,
+                                    tot_len - pos - 12) : t->len;
         }
 
-        if (tag == 0) {
+        stl_le_p(buf + pos + 8, (1 << 31) | resplen);
+        if (bufsize > tot_len - pos - 12) {
             break;
         }
-
-        stl_le_phys(&s->dma_as, value + 8, (1 << 31) | resplen);
-        value += bufsize + 12;
+        pos += bufsize + 12;
     }
 
+    /* Buffer response code */
+    stl_le_p(buf + 4, (1 << 31));
+    dma_memory_write(&s->dma_as, s->addr, buf, tot_len);
+    g_free(buf);
+
     /* Reconfigure framebuffer if required */
-    if (fbconfig_updated) {
-        bcm2835_fb_reconfigure(s->fbdev, &fbconfig);
+    if (req.fbconfig_updated) {
+        bcm2835_fb_reconfigure(s->fbdev, &req.fbconfig);
     }
-
-    /* Buffer response code */
-    stl_le_phys(&s->dma_as, s->addr + 4, (1 << 31));
 }
 
 static uint64_t bcm2835_property_read(void *opaque, hwaddr offset,
@@ -409,6 +622,24 @@ static void bcm2835_property_realize(DeviceState *dev, Error **errp)
 
     s->fbdev = BCM2835_FB(obj);
 
+    obj = object_property_get_link(OBJECT(dev), "cprman", &err);
+    if (obj == NULL) {
+        error_setg(errp, "%s: required cprman link not found: %s",
+                   __func__, error_get_pretty(err));
+        return;
+    }
+
+    s->cprman = BCM2835_CPRMAN(obj);
+
+    obj = object_property_get_link(OBJECT(dev), "thermal", &err);
+    if (obj == NULL) {
+        error_setg(errp, "%s: required thermal link not found: %s",
+                   __func__, error_get_pretty(err));
+        return;
+    }
+
+    s->thermal = BCM2835_THERMAL(obj);
+
     obj = object_property_get_link(OBJECT(dev), "dma-mr", &err);
     if (obj == NULL) {
         error_setg(errp, "%s: required dma-mr link not found: %s",
@@ -419,6 +650,8 @@ static void bcm2835_property_realize(DeviceState *dev, Error **errp)
     s->dma_mr = MEMORY_REGION(obj);
     address_space_init(&s->dma_as, s->dma_mr, TYPE_BCM2835_PROPERTY "-memory");
 
+    s->tag_count = g_new0(uint64_t, ARRAY_SIZE(bcm2835_property_tags));
+
     /* TODO: connect to MAC address of USB NIC device, once we emulate it */
     qemu_macaddr_default_if_unset(&s->macaddr);
 
@@ -14,23 +14,55 @@
 #include "hw/misc/bcm2835_rng.h"
 #include "migration/vmstate.h"
 
-static uint32_t get_random_bytes(void)
+/*
+ * Top up the ring with fresh host entropy, in at most two large reads.
+ * Call with s->lock held.
+ */
+static void bcm2835_rng_refill(BCM2835RngState *s)
+{
+    unsigned tail = (s->ring_head + s->ring_count) % BCM2835_RNG_RING_WORDS;
+    unsigned n;
+
+    while (s->ring_count < BCM2835_RNG_RING_WORDS) {
+        n = MIN(BCM2835_RNG_RING_WORDS - s->ring_count,
+                BCM2835_RNG_RING_WORDS - tail);
+        /*
+         * On failure we don't want to return the guest a non-random
+         * value in case they're really using it for cryptographic
+         * purposes, so the best we can do is die here.
+         * This shouldn't happen unless something's broken.
+         */
+        qemu_guest_getrandom_nofail(&s->ring[tail], n * sizeof(uint32_t));
+        s->ring_count += n;
+        tail = 0;
+    }
+}
+
+/*
+ * Call with s->lock held.
+ *
+ * The ring is refilled from the read path only, so that with -seed or
+ * record/replay what the guest sees doesn't depend on the main loop.
+ * Realize and post_load fill it, and it is refilled as soon as the last
+ * word is taken, so it is never empty here.
+ */
+static uint32_t get_random_bytes(BCM2835RngState *s)
 {
     uint32_t res;
 
-    /*
-     * On failure we don't want to return the guest a non-random
-     * value in case they're really using it for cryptographic
-     * purposes, so the best we can do is die here.
-     * This shouldn't happen unless something's broken.
-     * In theory we could implement this device's full FIFO
-     * and interrupt semantics and then just stop filling the
-     * FIFO. That's a lot of work, though, so we assume any
-     * errors are systematic problems and trust that if we didn't
-     * fail as the guest inited then we won't fail later on
-     * mid-run.
-     */
-    qemu_guest_getrandom_nofail(&res, sizeof(res));
+    assert(s->ring_count);
+    res = s->ring[s->ring_head];
+    s->ring_head = (s->ring_head + 1) % BCM2835_RNG_RING_WORDS;
+    s->ring_count--;
+
+    if (s->ring_count == 0) {
+        /*
+         * Keep the status register from ever showing an empty fifo;
+         * restarting at the front makes this a single read.
+         */
+        s->ring_head = 0;
+        bcm2835_rng_refill(s);
+    }
     return res;
 }
 
@@ -42,15 +74,17 @@ static uint64_t bcm2835_rng_read(void *opaque, hwaddr offset,
 
     assert(size == 4);
 
+    qemu_mutex_lock(&s->lock);
     switch (offset) {
     case 0x0:    /* rng_ctrl */
         res = s->rng_ctrl;
         break;
     case 0x4:    /* rng_status */
-        res = s->rng_status | (1 << 24);
+        /* bits [31..24] count the words the guest may read back to back */
+        res = s->rng_status | (MIN(s->ring_count, 0xff) << 24);
         break;
     case 0x8:    /* rng_data */
-        res = get_random_bytes();
+        res = get_random_bytes(s);
         break;
 
     default:
@@ -60,6 +94,7 @@ static uint64_t bcm2835_rng_read(void *opaque, hwaddr offset,
         res = 0;
         break;
     }
+    qemu_mutex_unlock(&s->lock);
 
     return res;
 }
@@ -71,6 +106,7 @@ static void bcm2835_rng_write(void *opaque, hwaddr offset,
 
     assert(size == 4);
 
+    qemu_mutex_lock(&s->lock);
     switch (offset) {
     case 0x0:    /* rng_ctrl */
         s->rng_ctrl = value;
@@ -87,6 +123,7 @@ static void bcm2835_rng_write(void *opaque, hwaddr offset,
                       (int)offset);
         break;
     }
+    qemu_mutex_unlock(&s->lock);
 }
 
 static const MemoryRegionOps bcm2835_rng_ops = {
@@ -95,10 +132,22 @@ static const MemoryRegionOps bcm2835_rng_ops = {
     .endianness = DEVICE_NATIVE_ENDIAN,
 };
 
+/* The ring is not migrated: the destination draws its own entropy */
+static int bcm2835_rng_post_load(void *opaque, int version_id)
+{
+    BCM2835RngState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    bcm2835_rng_refill(s);
+    qemu_mutex_unlock(&s->lock);
+    return 0;
+}
+
 static const VMStateDescription vmstate_bcm2835_rng = {
     .name = TYPE_BCM2835_RNG,
     .version_id = 1,
     .minimum_version_id = 1,
+    .post_load = bcm2835_rng_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32(rng_ctrl, BCM2835RngState),
         VMSTATE_UINT32(rng_status, BCM2835RngState),
@@ -112,21 +161,40 @@ static void bcm2835_rng_init(Object *obj)
 
     memory_region_init_io(&s->iomem, obj, &bcm2835_rng_ops, s,
                           TYPE_BCM2835_RNG, 0x10);
+    memory_region_clear_global_locking(&s->iomem);
     sysbus_init_mmio(SYS_BUS_DEVICE(s), &s->iomem);
+    qemu_mutex_init(&s->lock);
+}
+
+static void bcm2835_rng_finalize(Object *obj)
+{
+    BCM2835RngState *s = BCM2835_RNG(obj);
+
+    qemu_mutex_destroy(&s->lock);
+}
+
+static void bcm2835_rng_realize(DeviceState *dev, Error **errp)
+{
+    BCM2835RngState *s = BCM2835_RNG(dev);
+
+    bcm2835_rng_refill(s);
 }
 
 static void bcm2835_rng_reset(DeviceState *dev)
 {
     BCM2835RngState *s = BCM2835_RNG(dev);
 
+    qemu_mutex_lock(&s->lock);
     s->rng_ctrl = 0;
     s->rng_status = 0;
+    qemu_mutex_unlock(&s->lock);
 }
 
 static void bcm2835_rng_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
 
+    dc->realize = bcm2835_rng_realize;
     dc->reset = bcm2835_rng_reset;
     dc->vmsd = &vmstate_bcm2835_rng;
 }
@@ -137,6 +205,7 @@ static TypeInfo bcm2835_rng_info = {
     .instance_size = sizeof(BCM2835RngState),
     .class_init    = bcm2835_rng_class_init,
     .instance_init = bcm2835_rng_init,
+    .instance_finalize = bcm2835_rng_finalize,
 };
 
 static void bcm2835_rng_register_types(void)
@@ -0,0 +1,158 @@
+/*
+ * BCM2835 (Raspberry Pi) SoC temperature sensor
+ *
+ * The die temperature is a QOM property ("temperature", in millidegrees
+ * Celsius) that can be changed at run time with qom-set; the sensor
+ * converts it back through the same linear fit the Linux driver uses.
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/visitor.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "hw/misc/bcm2835_thermal.h"
+#include "migration/vmstate.h"
+
+#define TSENSCTL            0x00
+#define TSENSSTAT           0x04
+
+#define TSENSSTAT_VALID     (1 << 10)
+#define TSENSSTAT_DATA_MASK 0x3ff
+
+/* temperature = OFFSET + SLOPE * ADC, in millidegrees */
+#define THERMAL_OFFSET_MC   407000
+#define THERMAL_SLOPE_MC    (-538)
+
+static uint32_t bcm2835_thermal_adc(BCM2835ThermalState *s)
+{
+    int32_t adc = (s->temperature - THERMAL_OFFSET_MC) / THERMAL_SLOPE_MC;
+
+    return MAX(MIN(adc, TSENSSTAT_DATA_MASK), 0);
+}
+
+static uint64_t bcm2835_thermal_read(void *opaque, hwaddr offset,
+                                     unsigned size)
+{
+    BCM2835ThermalState *s = opaque;
+
+    switch (offset) {
+    case TSENSCTL:
+        return s->ctl;
+    case TSENSSTAT:
+        return TSENSSTAT_VALID | bcm2835_thermal_adc(s);
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return 0;
+    }
+}
+
+static void bcm2835_thermal_write(void *opaque, hwaddr offset,
+                                  uint64_t value, unsigned size)
+{
+    BCM2835ThermalState *s = opaque;
+
+    switch (offset) {
+    case TSENSCTL:
+        s->ctl = value;
+        break;
+    case TSENSSTAT:
+        /* read only */
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        break;
+    }
+}
+
+static const MemoryRegionOps bcm2835_thermal_ops = {
+    .read = bcm2835_thermal_read,
+    .write = bcm2835_thermal_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static void bcm2835_thermal_get_temperature(Object *obj, Visitor *v,
+                                            const char *name, void *opaque,
+                                            Error **errp)
+{
+    BCM2835ThermalState *s = BCM2835_THERMAL(obj);
+
+    visit_type_int32(v, name, &s->temperature, errp);
+}
+
+static void bcm2835_thermal_set_temperature(Object *obj, Visitor *v,
+                                            const char *name, void *opaque,
+                                            Error **errp)
+{
+    BCM2835ThermalState *s = BCM2835_THERMAL(obj);
+    Error *local_err = NULL;
+    int32_t temp;
+
+    visit_type_int32(v, name, &temp, &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return;
+    }
+    s->temperature = temp;
+}
+
+static const VMStateDescription vmstate_bcm2835_thermal = {
+    .name = TYPE_BCM2835_THERMAL,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(ctl, BCM2835ThermalState),
+        VMSTATE_INT32(temperature, BCM2835ThermalState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void bcm2835_thermal_reset(DeviceState *dev)
+{
+    BCM2835ThermalState *s = BCM2835_THERMAL(dev);
+
+    s->ctl = 0;
+}
+
+static void bcm2835_thermal_init(Object *obj)
+{
+    BCM2835ThermalState *s = BCM2835_THERMAL(obj);
+
+    memory_region_init_io(&s->iomem, obj, &bcm2835_thermal_ops, s,
+                          TYPE_BCM2835_THERMAL, 0x8);
+    sysbus_init_mmio(SYS_BUS_DEVICE(s), &s->iomem);
+
+    s->temperature = 25000;
+    object_property_add(obj, "temperature", "int32",
+                        bcm2835_thermal_get_temperature,
+                        bcm2835_thermal_set_temperature, NULL, NULL, NULL);
+}
+
+static void bcm2835_thermal_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->reset = bcm2835_thermal_reset;
+    dc->vmsd = &vmstate_bcm2835_thermal;
+}
+
+static TypeInfo bcm2835_thermal_info = {
+    .name          = TYPE_BCM2835_THERMAL,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(BCM2835ThermalState),
+    .class_init    = bcm2835_thermal_class_init,
+    .instance_init = bcm2835_thermal_init,
+};
+
+static void bcm2835_thermal_register_types(void)
+{
+    type_register_static(&bcm2835_thermal_info);
+}
+
+type_init(bcm2835_thermal_register_types)
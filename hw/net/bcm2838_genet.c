@@ -0,0 +1,947 @@
+/*
+ * BCM2838 (BCM2711) GENET v5 Gigabit Ethernet controller
+ *
+ * GENET keeps its buffer descriptors in on-chip memory inside the register
+ * window: 256 descriptors are shared by the RX and TX DMA engines' 17 rings
+ * each (16 priority rings plus the default ring 16). Rings are driven by
+ * free-running 16-bit producer/consumer indexes. The UniMAC MDIO controller
+ * talks to an emulated BCM54213PE RGMII PHY.
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "qemu/main-loop.h"
+#include "hw/irq.h"
+#include "hw/net/bcm2838_genet.h"
+#include "hw/net/mii.h"
+#include "hw/qdev-properties.h"
+#include "migration/vmstate.h"
+#include "net/checksum.h"
+#include "net/eth.h"
+#include "sysemu/dma.h"
+#include "trace.h"
+#include <zlib.h>
+
+#define R(s, off) ((s)->regs[(off) >> 2])
+
+#define GENET_SYS_REV_CTRL              0x0000
+#define GENET_SYS_REV_V5                0x06000000
+
+#define GENET_INTRL2_0                  0x0200
+#define GENET_INTRL2_1                  0x0240
+#define GENET_INTRL2_CPU_STAT           0x00
+#define GENET_INTRL2_CPU_SET            0x04
+#define GENET_INTRL2_CPU_CLEAR          0x08
+#define GENET_INTRL2_CPU_MASK_STATUS    0x0c
+#define GENET_INTRL2_CPU_MASK_SET       0x10
+#define GENET_INTRL2_CPU_MASK_CLEAR     0x14
+
+#define GENET_IRQ0_RXDMA_MBDONE         BIT(13)
+#define GENET_IRQ0_RXDMA_PDONE          BIT(14)
+#define GENET_IRQ0_TXDMA_MBDONE         BIT(16)
+#define GENET_IRQ0_TXDMA_PDONE          BIT(17)
+#define GENET_IRQ0_MDIO_DONE            BIT(23)
+#define GENET_IRQ0_MDIO_ERROR           BIT(24)
+#define GENET_IRQ1_RX_SHIFT             16
+
+#define GENET_RBUF_CTRL                 0x0300
+#define GENET_RBUF_64B_EN               BIT(0)
+#define GENET_RBUF_ALIGN_2B             BIT(1)
+#define GENET_TBUF_CTRL                 0x0600
+#define GENET_TBUF_64B_EN               BIT(0)
+
+#define GENET_UMAC_CMD                  0x0808
+#define GENET_CMD_TX_EN                 BIT(0)
+#define GENET_CMD_RX_EN                 BIT(1)
+#define GENET_CMD_PROMISC               BIT(4)
+#define GENET_CMD_CRC_FWD               BIT(6)
+#define GENET_CMD_LCL_LOOP_EN           BIT(15)
+#define GENET_UMAC_MAC0                 0x080c
+#define GENET_UMAC_MAC1                 0x0810
+#define GENET_UMAC_MDIO_CMD             0x0e14
+#define GENET_MDIO_START_BUSY           BIT(29)
+#define GENET_MDIO_READ_FAIL            BIT(28)
+#define GENET_MDIO_RD                   BIT(27)
+#define GENET_MDIO_WR                   BIT(26)
+#define GENET_MDIO_PMD(x)               extract32(x, 21, 5)
+#define GENET_MDIO_REG(x)               extract32(x, 16, 5)
+#define GENET_UMAC_MDF_CTRL             0x0e50
+#define GENET_UMAC_MDF_ADDR             0x0e54
+#define GENET_MAX_MDF_FILTER            17
+
+#define GENET_RDMA                      0x2000
+#define GENET_TDMA                      0x4000
+#define GENET_DMA_DESC_WORDS            3
+#define GENET_DMA_DESC_SIZE             (GENET_DMA_DESC_WORDS * 4)
+#define GENET_DMA_TOTAL_DESC            256
+#define GENET_DMA_RINGS                 (GENET_DMA_TOTAL_DESC * \
+                                         GENET_DMA_DESC_SIZE)
+#define GENET_DMA_RING_SIZE             0x40
+#define GENET_DMA_DEFAULT_RING          16
+#define GENET_DMA_REGS                  (GENET_DMA_RINGS + \
+                                         BCM2838_GENET_NUM_RINGS * \
+                                         GENET_DMA_RING_SIZE)
+
+/*
+ * Per-ring registers: the RX write/TX read pointers (in descriptor words)
+ * and RX producer/TX consumer indexes are owned by the device.
+ */
+#define GENET_DMA_RING_PTR              0x00
+#define GENET_DMA_RING_HW_INDEX         0x08
+#define GENET_DMA_RING_SW_INDEX         0x0c
+#define GENET_DMA_RING_BUF_SIZE         0x10
+#define GENET_DMA_RING_START_ADDR       0x14
+#define GENET_DMA_RING_END_ADDR         0x1c
+#define GENET_DMA_INDEX_MASK            0xffff
+
+#define GENET_DMA_RING_CFG              0x00
+#define GENET_DMA_CTRL                  0x04
+#define GENET_DMA_EN                    BIT(0)
+#define GENET_DMA_RING_EN(ring)         BIT((ring) + 1)
+#define GENET_DMA_STATUS                0x08
+#define GENET_DMA_DISABLED              BIT(0)
+#define GENET_DMA_PRIORITY_0            0x30
+
+/* Buffer descriptor layout */
+#define GENET_DESC_LENGTH_STATUS        0x00
+#define GENET_DESC_ADDRESS_LO           0x04
+#define GENET_DESC_ADDRESS_HI           0x08
+#define GENET_DESC_SOP                  BIT(13)
+#define GENET_DESC_EOP                  BIT(14)
+#define GENET_DESC_LEN_SHIFT            16
+
+/* 64-byte status block prepended to frames when RBUF/TBUF_64B_EN is set */
+#define GENET_STATUS_BLOCK_SIZE         64
+#define GENET_TSB_TX_CSUM_INFO          48
+#define GENET_TX_CSUM_LV                BIT(31)
+#define GENET_TX_CSUM_PROTO_UDP         BIT(15)
+
+#define GENET_MIN_FRAME                 60
+#define GENET_TX_BUDGET                 256
+
+#define GENET_PHY_BMSR_BASE     (MII_BMSR_100TX_FD | MII_BMSR_100TX_HD | \
+                                 MII_BMSR_10T_FD | MII_BMSR_10T_HD | \
+                                 MII_BMSR_EXTSTAT | MII_BMSR_MFPS | \
+                                 MII_BMSR_AUTONEG | MII_BMSR_EXTCAP)
+
+static void bcm2838_genet_update_irq(BCM2838GenetState *s)
+{
+    int n;
+
+    for (n = 0; n < ARRAY_SIZE(s->intr); n++) {
+        qemu_set_irq(s->irq[n], !!(s->intr[n].stat & ~s->intr[n].mask));
+    }
+}
+
+static void bcm2838_genet_ring_irq(BCM2838GenetState *s, int ring, bool tx)
+{
+    if (ring == GENET_DMA_DEFAULT_RING) {
+        s->intr[0].stat |= tx
+            ? GENET_IRQ0_TXDMA_MBDONE | GENET_IRQ0_TXDMA_PDONE
+            : GENET_IRQ0_RXDMA_MBDONE | GENET_IRQ0_RXDMA_PDONE;
+    } else {
+        s->intr[1].stat |= BIT(tx ? ring : ring + GENET_IRQ1_RX_SHIFT);
+    }
+    bcm2838_genet_update_irq(s);
+}
+
+/* PHY */
+
+static void bcm2838_genet_phy_update_link(BCM2838GenetState *s)
+{
+    uint16_t *regs = s->phy_regs;
+
+    if (qemu_get_queue(s->nic)->link_down) {
+        regs[MII_BMSR] = GENET_PHY_BMSR_BASE;
+        regs[MII_ANLPAR] = 0;
+        regs[MII_STAT1000] = 0;
+    } else {
+        regs[MII_BMSR] = GENET_PHY_BMSR_BASE | MII_BMSR_AN_COMP
+                         | MII_BMSR_LINK_ST;
+        regs[MII_ANLPAR] = MII_ANLPAR_ACK | MII_ANLPAR_PAUSE | MII_ANLPAR_TXFD
+                           | MII_ANLPAR_TX | MII_ANLPAR_10FD | MII_ANLPAR_10
+                           | MII_ANLPAR_CSMACD;
+        regs[MII_STAT1000] = MII_STAT1000_FULL | MII_STAT1000_HALF;
+    }
+}
+
+static void bcm2838_genet_phy_reset(BCM2838GenetState *s)
+{
+    uint16_t *regs = s->phy_regs;
+
+    memset(regs, 0, sizeof(s->phy_regs));
+    regs[MII_BMCR] = MII_BMCR_AUTOEN | MII_BMCR_FD | MII_BMCR_SPEED1000;
+    regs[MII_PHYID1] = BCM54213PE_PHYID1;
+    regs[MII_PHYID2] = BCM54213PE_PHYID2;
+    regs[MII_ANAR] = MII_ANAR_PAUSE_ASYM | MII_ANAR_PAUSE | MII_ANAR_TXFD
+                     | MII_ANAR_TX | MII_ANAR_10FD | MII_ANAR_10
+                     | MII_ANAR_CSMACD;
+    regs[MII_CTRL1000] = MII_CTRL1000_FULL | MII_CTRL1000_HALF;
+    regs[MII_EXTSTAT] = 0x3000; /* 1000BASE-T full and half duplex */
+    bcm2838_genet_phy_update_link(s);
+}
+
+static void bcm2838_genet_phy_write(BCM2838GenetState *s, int reg,
+                                    uint16_t val)
+{
+    switch (reg) {
+    case MII_BMCR:
+        if (val & MII_BMCR_RESET) {
+            bcm2838_genet_phy_reset(s);
+        } else {
+            /* Autonegotiation completes instantly */
+            s->phy_regs[reg] = val & ~MII_BMCR_ANRESTART;
+        }
+        break;
+    case MII_BMSR:
+    case MII_PHYID1:
+    case MII_PHYID2:
+    case MII_ANLPAR:
+    case MII_STAT1000:
+    case MII_EXTSTAT:
+        break;
+    default:
+        /* Broadcom shadow and expansion registers just hold their value */
+        s->phy_regs[reg] = val;
+        break;
+    }
+}
+
+static void bcm2838_genet_set_link(NetClientState *nc)
+{
+    bcm2838_genet_phy_update_link(BCM2838_GENET(qemu_get_nic_opaque(nc)));
+}
+
+static void bcm2838_genet_mdio_cmd(BCM2838GenetState *s, uint32_t val)
+{
+    int phy = GENET_MDIO_PMD(val);
+    int reg = GENET_MDIO_REG(val);
+
+    if (!(val & GENET_MDIO_START_BUSY)) {
+        R(s, GENET_UMAC_MDIO_CMD) = val;
+        return;
+    }
+
+    val &= ~(GENET_MDIO_START_BUSY | GENET_MDIO_READ_FAIL);
+    if (phy != s->phy_addr) {
+        if (val & GENET_MDIO_RD) {
+            val |= GENET_MDIO_READ_FAIL | 0xffff;
+        }
+    } else if (val & GENET_MDIO_RD) {
+        val = deposit32(val, 0, 16, s->phy_regs[reg]);
+        trace_bcm2838_genet_mdio_read(reg, s->phy_regs[reg]);
+    } else if (val & GENET_MDIO_WR) {
+        trace_bcm2838_genet_mdio_write(reg, val & 0xffff);
+        bcm2838_genet_phy_write(s, reg, val & 0xffff);
+    }
+
+    R(s, GENET_UMAC_MDIO_CMD) = val;
+    s->intr[0].stat |= GENET_IRQ0_MDIO_DONE;
+    bcm2838_genet_update_irq(s);
+}
+
+/* DMA rings */
+
+static uint32_t *bcm2838_genet_ring_reg(BCM2838GenetState *s, hwaddr dma,
+                                        int ring, hwaddr reg)
+{
+    return &R(s, dma + GENET_DMA_RINGS + ring * GENET_DMA_RING_SIZE + reg);
+}
+
+static bool bcm2838_genet_ring_enabled(BCM2838GenetState *s, hwaddr dma,
+                                       int ring)
+{
+    uint32_t ctrl = R(s, dma + GENET_DMA_REGS + GENET_DMA_CTRL);
+
+    return (ctrl & GENET_DMA_EN) && (ctrl & GENET_DMA_RING_EN(ring));
+}
+
+/* Returns the ring's length in descriptors, or 0 if it is misprogrammed */
+static unsigned bcm2838_genet_ring_size(BCM2838GenetState *s, hwaddr dma,
+                                        int ring)
+{
+    uint32_t buf_size = *bcm2838_genet_ring_reg(s, dma, ring,
+                                                GENET_DMA_RING_BUF_SIZE);
+    uint32_t start = *bcm2838_genet_ring_reg(s, dma, ring,
+                                             GENET_DMA_RING_START_ADDR);
+    uint32_t end = *bcm2838_genet_ring_reg(s, dma, ring,
+                                           GENET_DMA_RING_END_ADDR);
+
+    if ((buf_size >> 16) == 0 || start > end ||
+        end >= GENET_DMA_TOTAL_DESC * GENET_DMA_DESC_WORDS) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: bad geometry for ring %d: start %u end %u\n",
+                      __func__, ring, start, end);
+        return 0;
+    }
+    return buf_size >> 16;
+}
+
+/* Step a ring pointer to the next descriptor, wrapping at END_ADDR */
+static uint32_t bcm2838_genet_ring_next(BCM2838GenetState *s, hwaddr dma,
+                                        int ring, uint32_t ptr)
+{
+    uint32_t start = *bcm2838_genet_ring_reg(s, dma, ring,
+                                             GENET_DMA_RING_START_ADDR);
+    uint32_t end = *bcm2838_genet_ring_reg(s, dma, ring,
+                                           GENET_DMA_RING_END_ADDR);
+
+    ptr += GENET_DMA_DESC_WORDS;
+    return ptr < start || ptr > end ? start : ptr;
+}
+
+static hwaddr bcm2838_genet_desc(BCM2838GenetState *s, hwaddr dma, int ring,
+                                 uint32_t ptr)
+{
+    uint32_t start = *bcm2838_genet_ring_reg(s, dma, ring,
+                                             GENET_DMA_RING_START_ADDR);
+    uint32_t end = *bcm2838_genet_ring_reg(s, dma, ring,
+                                           GENET_DMA_RING_END_ADDR);
+
+    if (ptr < start || ptr > end) {
+        ptr = start;
+    }
+    return dma + (ptr / GENET_DMA_DESC_WORDS) * GENET_DMA_DESC_SIZE;
+}
+
+static dma_addr_t bcm2838_genet_desc_addr(BCM2838GenetState *s, hwaddr desc)
+{
+    return deposit64(R(s, desc + GENET_DESC_ADDRESS_LO), 32, 8,
+                     R(s, desc + GENET_DESC_ADDRESS_HI));
+}
+
+/* Receive */
+
+static int bcm2838_genet_rx_ring(BCM2838GenetState *s)
+{
+    int ring;
+
+    /* Everything lands on the default ring unless only priority rings run */
+    if (bcm2838_genet_ring_enabled(s, GENET_RDMA, GENET_DMA_DEFAULT_RING)) {
+        return GENET_DMA_DEFAULT_RING;
+    }
+    for (ring = 0; ring < GENET_DMA_DEFAULT_RING; ring++) {
+        if (bcm2838_genet_ring_enabled(s, GENET_RDMA, ring)) {
+            return ring;
+        }
+    }
+    return -1;
+}
+
+static unsigned bcm2838_genet_rx_free(BCM2838GenetState *s, int ring,
+                                      unsigned size)
+{
+    uint32_t prod = *bcm2838_genet_ring_reg(s, GENET_RDMA, ring,
+                                            GENET_DMA_RING_HW_INDEX);
+    uint32_t cons = *bcm2838_genet_ring_reg(s, GENET_RDMA, ring,
+                                            GENET_DMA_RING_SW_INDEX);
+    unsigned used = (prod - cons) & GENET_DMA_INDEX_MASK;
+
+    return used < size ? size - used : 0;
+}
+
+static void bcm2838_genet_rx_discard(BCM2838GenetState *s, int ring)
+{
+    uint32_t *prod = bcm2838_genet_ring_reg(s, GENET_RDMA, ring,
+                                            GENET_DMA_RING_HW_INDEX);
+
+    if ((*prod >> 16) != 0xffff) {
+        *prod += 1 << 16;
+    }
+}
+
+static bool bcm2838_genet_filter(BCM2838GenetState *s, const uint8_t *buf)
+{
+    uint32_t mdf = R(s, GENET_UMAC_MDF_CTRL);
+    uint8_t addr[ETH_ALEN];
+    int n;
+
+    if (R(s, GENET_UMAC_CMD) & GENET_CMD_PROMISC) {
+        return true;
+    }
+
+    if (!mdf) {
+        stl_be_p(addr, R(s, GENET_UMAC_MAC0));
+        stw_be_p(addr + 4, R(s, GENET_UMAC_MAC1));
+        return (buf[0] & 1) || !memcmp(buf, addr, ETH_ALEN);
+    }
+
+    /* Entry n is enabled by bit (16 - n), as programmed by bcmgenet */
+    for (n = 0; n < GENET_MAX_MDF_FILTER; n++) {
+        if (!(mdf & BIT(GENET_MAX_MDF_FILTER - 1 - n))) {
+            continue;
+        }
+        stw_be_p(addr, R(s, GENET_UMAC_MDF_ADDR + n * 8));
+        stl_be_p(addr + 2, R(s, GENET_UMAC_MDF_ADDR + n * 8 + 4));
+        if (!memcmp(buf, addr, ETH_ALEN)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int bcm2838_genet_can_receive(NetClientState *nc)
+{
+    BCM2838GenetState *s = BCM2838_GENET(qemu_get_nic_opaque(nc));
+    unsigned size;
+    int ring;
+
+    /* Frames arriving with reception off are dropped, not held back */
+    if (!(R(s, GENET_UMAC_CMD) & GENET_CMD_RX_EN)) {
+        return 1;
+    }
+    ring = bcm2838_genet_rx_ring(s);
+    if (ring < 0 || !(size = bcm2838_genet_ring_size(s, GENET_RDMA, ring))) {
+        return 1;
+    }
+    return bcm2838_genet_rx_free(s, ring, size) > 0;
+}
+
+static ssize_t bcm2838_genet_do_receive(BCM2838GenetState *s,
+                                        const uint8_t *buf, size_t len)
+{
+    static const uint8_t zeroes[GENET_MIN_FRAME];
+    uint8_t status[GENET_STATUS_BLOCK_SIZE + 2] = { 0 };
+    uint32_t rbuf_ctrl = R(s, GENET_RBUF_CTRL);
+    uint32_t *prod, *ptr;
+    unsigned size, hdr = 0, pad, total, buf_len;
+    uint32_t length_status, crc;
+    hwaddr desc;
+    dma_addr_t addr;
+    int ring;
+
+    if (!(R(s, GENET_UMAC_CMD) & GENET_CMD_RX_EN) || len < ETH_ALEN) {
+        return len;
+    }
+
+    ring = bcm2838_genet_rx_ring(s);
+    if (ring < 0 || !(size = bcm2838_genet_ring_size(s, GENET_RDMA, ring))) {
+        return len;
+    }
+
+    if (!bcm2838_genet_filter(s, buf)) {
+        return len;
+    }
+
+    if (!bcm2838_genet_rx_free(s, ring, size)) {
+        return 0;
+    }
+
+    if (rbuf_ctrl & GENET_RBUF_64B_EN) {
+        hdr += GENET_STATUS_BLOCK_SIZE;
+    }
+    if (rbuf_ctrl & GENET_RBUF_ALIGN_2B) {
+        hdr += 2;
+    }
+    pad = len < GENET_MIN_FRAME ? GENET_MIN_FRAME - len : 0;
+    total = hdr + len + pad;
+    if (R(s, GENET_UMAC_CMD) & GENET_CMD_CRC_FWD) {
+        total += 4;
+    }
+
+    prod = bcm2838_genet_ring_reg(s, GENET_RDMA, ring,
+                                  GENET_DMA_RING_HW_INDEX);
+    buf_len = *bcm2838_genet_ring_reg(s, GENET_RDMA, ring,
+                                      GENET_DMA_RING_BUF_SIZE) & 0xffff;
+    if (total > buf_len) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: %u byte frame does not fit %u byte buffer\n",
+                      __func__, total, buf_len);
+        bcm2838_genet_rx_discard(s, ring);
+        return len;
+    }
+
+    ptr = bcm2838_genet_ring_reg(s, GENET_RDMA, ring, GENET_DMA_RING_PTR);
+    desc = bcm2838_genet_desc(s, GENET_RDMA, ring, *ptr);
+    *ptr = bcm2838_genet_ring_next(s, GENET_RDMA, ring, *ptr);
+    addr = bcm2838_genet_desc_addr(s, desc);
+    length_status = total << GENET_DESC_LEN_SHIFT | GENET_DESC_SOP
+                    | GENET_DESC_EOP;
+
+    if (rbuf_ctrl & GENET_RBUF_64B_EN) {
+        stl_le_p(status, length_status);
+    }
+    dma_memory_write(&s->dma_as, addr, status, hdr);
+    addr += hdr;
+    dma_memory_write(&s->dma_as, addr, buf, len);
+    addr += len;
+    dma_memory_write(&s->dma_as, addr, zeroes, pad);
+    addr += pad;
+    if (R(s, GENET_UMAC_CMD) & GENET_CMD_CRC_FWD) {
+        crc = crc32(0, buf, len);
+        crc = crc32(crc, zeroes, pad);
+        stl_le_p(status, crc);
+        dma_memory_write(&s->dma_as, addr, status, 4);
+    }
+
+    R(s, desc + GENET_DESC_LENGTH_STATUS) = length_status;
+    *prod = (*prod & ~GENET_DMA_INDEX_MASK)
+            | ((*prod + 1) & GENET_DMA_INDEX_MASK);
+    trace_bcm2838_genet_rx(ring, len);
+
+    bcm2838_genet_ring_irq(s, ring, false);
+    return len;
+}
+
+static ssize_t bcm2838_genet_receive(NetClientState *nc, const uint8_t *buf,
+                                     size_t len)
+{
+    return bcm2838_genet_do_receive(BCM2838_GENET(qemu_get_nic_opaque(nc)),
+                                    buf, len);
+}
+
+static void bcm2838_genet_rx_kick(BCM2838GenetState *s)
+{
+    if (bcm2838_genet_can_receive(qemu_get_queue(s->nic))) {
+        qemu_flush_queued_packets(qemu_get_queue(s->nic));
+    }
+}
+
+/* Transmit */
+
+static void bcm2838_genet_tx_csum(const uint8_t *tsb, uint8_t *frame,
+                                  size_t len)
+{
+    uint32_t info = ldl_le_p(tsb + GENET_TSB_TX_CSUM_INFO);
+    unsigned start = extract32(info, 16, 15);
+    unsigned offset = extract32(info, 0, 15);
+    uint16_t csum;
+
+    if (!(info & GENET_TX_CSUM_LV)) {
+        return;
+    }
+    if (start >= len || offset + 2 > len) {
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad checksum offsets 0x%08x\n",
+                      __func__, info);
+        return;
+    }
+
+    /* The guest seeded the field with the pseudo-header sum */
+    csum = net_checksum_finish(net_checksum_add(len - start, frame + start));
+    if ((info & GENET_TX_CSUM_PROTO_UDP) && !csum) {
+        csum = 0xffff;
+    }
+    stw_be_p(frame + offset, csum);
+}
+
+static void bcm2838_genet_tx_sent(NetClientState *nc, ssize_t len)
+{
+    BCM2838GenetState *s = BCM2838_GENET(qemu_get_nic_opaque(nc));
+
+    s->tx_waiting = false;
+    qemu_bh_schedule(s->tx_bh);
+}
+
+static void bcm2838_genet_tx_frame(BCM2838GenetState *s, size_t len)
+{
+    uint8_t *frame = s->frame;
+
+    if (R(s, GENET_TBUF_CTRL) & GENET_TBUF_64B_EN) {
+        if (len < GENET_STATUS_BLOCK_SIZE) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: frame shorter than its "
+                          "status block\n", __func__);
+            return;
+        }
+        frame += GENET_STATUS_BLOCK_SIZE;
+        len -= GENET_STATUS_BLOCK_SIZE;
+        bcm2838_genet_tx_csum(s->frame, frame, len);
+    }
+
+    if (R(s, GENET_UMAC_CMD) & GENET_CMD_LCL_LOOP_EN) {
+        bcm2838_genet_do_receive(s, frame, len);
+        return;
+    }
+
+    if (!qemu_send_packet_async(qemu_get_queue(s->nic), frame, len,
+                                bcm2838_genet_tx_sent)) {
+        s->tx_waiting = true;
+    }
+}
+
+/*
+ * Send every complete frame queued on a ring, up to the budget. Frames
+ * are handed to the net layer asynchronously; if the peer queues one we
+ * stop until bcm2838_genet_tx_sent() restarts us.
+ */
+static bool bcm2838_genet_tx_ring(BCM2838GenetState *s, int ring,
+                                  int *budget)
+{
+    uint32_t *cons = bcm2838_genet_ring_reg(s, GENET_TDMA, ring,
+                                            GENET_DMA_RING_HW_INDEX);
+    uint32_t *ptr = bcm2838_genet_ring_reg(s, GENET_TDMA, ring,
+                                           GENET_DMA_RING_PTR);
+    uint32_t prod = *bcm2838_genet_ring_reg(s, GENET_TDMA, ring,
+                                            GENET_DMA_RING_SW_INDEX)
+                    & GENET_DMA_INDEX_MASK;
+    uint32_t length_status = 0, next;
+    unsigned size, n, i;
+    bool sent = false;
+    size_t len, blen;
+    hwaddr desc;
+
+    size = bcm2838_genet_ring_size(s, GENET_TDMA, ring);
+    if (!size) {
+        return false;
+    }
+
+    while (*budget > 0 && !s->tx_waiting &&
+           (*cons & GENET_DMA_INDEX_MASK) != prod) {
+        i = *cons & GENET_DMA_INDEX_MASK;
+        next = *ptr;
+        len = 0;
+
+        for (n = 0; n < size && ((i + n) & GENET_DMA_INDEX_MASK) != prod;) {
+            desc = bcm2838_genet_desc(s, GENET_TDMA, ring, next);
+            next = bcm2838_genet_ring_next(s, GENET_TDMA, ring, next);
+            length_status = R(s, desc + GENET_DESC_LENGTH_STATUS);
+            blen = length_status >> GENET_DESC_LEN_SHIFT;
+
+            if (n == 0 && !(length_status & GENET_DESC_SOP)) {
+                qemu_log_mask(LOG_GUEST_ERROR, "%s: ring %d descriptor "
+                              "without SOP\n", __func__, ring);
+            }
+            if (len + blen > sizeof(s->frame)) {
+                qemu_log_mask(LOG_GUEST_ERROR, "%s: frame too long\n",
+                              __func__);
+                blen = sizeof(s->frame) - len;
+            }
+            dma_memory_read(&s->dma_as, bcm2838_genet_desc_addr(s, desc),
+                            s->frame + len, blen);
+            len += blen;
+            n++;
+            if (length_status & GENET_DESC_EOP) {
+                break;
+            }
+        }
+
+        /* Wait for the rest of a frame the guest is still queueing */
+        if (!(length_status & GENET_DESC_EOP) && n < size) {
+            break;
+        }
+
+        *cons = (*cons & ~GENET_DMA_INDEX_MASK)
+                | ((i + n) & GENET_DMA_INDEX_MASK);
+        *ptr = next;
+        trace_bcm2838_genet_tx(ring, len);
+        bcm2838_genet_tx_frame(s, len);
+        (*budget)--;
+        sent = true;
+    }
+
+    return sent;
+}
+
+static unsigned bcm2838_genet_tx_priority(BCM2838GenetState *s, int ring)
+{
+    uint32_t prio = R(s, GENET_TDMA + GENET_DMA_REGS + GENET_DMA_PRIORITY_0
+                         + (ring / 6) * 4);
+
+    return extract32(prio, (ring % 6) * 5, 5);
+}
+
+static void bcm2838_genet_tx_bh(void *opaque)
+{
+    BCM2838GenetState *s = opaque;
+    int order[BCM2838_GENET_NUM_RINGS];
+    int budget = GENET_TX_BUDGET;
+    int ring, n, i;
+
+    if (!(R(s, GENET_UMAC_CMD) & GENET_CMD_TX_EN) || s->tx_waiting) {
+        return;
+    }
+
+    /* Service rings in strict priority order, lowest value first */
+    for (n = 0, ring = 0; ring < BCM2838_GENET_NUM_RINGS; ring++) {
+        if (!bcm2838_genet_ring_enabled(s, GENET_TDMA, ring)) {
+            continue;
+        }
+        for (i = n++; i > 0 &&
+             bcm2838_genet_tx_priority(s, order[i - 1]) >
+             bcm2838_genet_tx_priority(s, ring); i--) {
+            order[i] = order[i - 1];
+        }
+        order[i] = ring;
+    }
+
+    for (i = 0; i < n && budget > 0 && !s->tx_waiting; i++) {
+        if (bcm2838_genet_tx_ring(s, order[i], &budget)) {
+            bcm2838_genet_ring_irq(s, order[i], true);
+        }
+    }
+
+    if (budget == 0) {
+        qemu_bh_schedule(s->tx_bh);
+    }
+}
+
+/* Register interface */
+
+static bool bcm2838_genet_is_dma_ring_reg(hwaddr addr, hwaddr dma,
+                                          int *ring, hwaddr *reg)
+{
+    if (addr < dma + GENET_DMA_RINGS || addr >= dma + GENET_DMA_REGS) {
+        return false;
+    }
+    *ring = (addr - dma - GENET_DMA_RINGS) / GENET_DMA_RING_SIZE;
+    *reg = (addr - dma - GENET_DMA_RINGS) % GENET_DMA_RING_SIZE;
+    return true;
+}
+
+static uint64_t bcm2838_genet_read(void *opaque, hwaddr addr, unsigned size)
+{
+    BCM2838GenetState *s = BCM2838_GENET(opaque);
+    BCM2838GenetIntr *intr;
+
+    switch (addr) {
+    case GENET_SYS_REV_CTRL:
+        return GENET_SYS_REV_V5;
+    case GENET_INTRL2_0 + GENET_INTRL2_CPU_STAT:
+    case GENET_INTRL2_1 + GENET_INTRL2_CPU_STAT:
+        intr = &s->intr[addr >= GENET_INTRL2_1];
+        return intr->stat;
+    case GENET_INTRL2_0 + GENET_INTRL2_CPU_MASK_STATUS:
+    case GENET_INTRL2_1 + GENET_INTRL2_CPU_MASK_STATUS:
+        intr = &s->intr[addr >= GENET_INTRL2_1];
+        return intr->mask;
+    case GENET_INTRL2_0 + GENET_INTRL2_CPU_SET:
+    case GENET_INTRL2_0 + GENET_INTRL2_CPU_CLEAR:
+    case GENET_INTRL2_0 + GENET_INTRL2_CPU_MASK_SET:
+    case GENET_INTRL2_0 + GENET_INTRL2_CPU_MASK_CLEAR:
+    case GENET_INTRL2_1 + GENET_INTRL2_CPU_SET:
+    case GENET_INTRL2_1 + GENET_INTRL2_CPU_CLEAR:
+    case GENET_INTRL2_1 + GENET_INTRL2_CPU_MASK_SET:
+    case GENET_INTRL2_1 + GENET_INTRL2_CPU_MASK_CLEAR:
+        return 0;
+    case GENET_RDMA + GENET_DMA_REGS + GENET_DMA_STATUS:
+    case GENET_TDMA + GENET_DMA_REGS + GENET_DMA_STATUS:
+        /* The engines stop immediately once disabled */
+        return R(s, addr - GENET_DMA_STATUS + GENET_DMA_CTRL) & GENET_DMA_EN
+               ? 0 : GENET_DMA_DISABLED;
+    default:
+        return R(s, addr);
+    }
+}
+
+static void bcm2838_genet_write(void *opaque, hwaddr addr, uint64_t value,
+                                unsigned size)
+{
+    BCM2838GenetState *s = BCM2838_GENET(opaque);
+    BCM2838GenetIntr *intr;
+    hwaddr reg;
+    int ring;
+
+    switch (addr) {
+    case GENET_SYS_REV_CTRL:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: write to read-only register\n",
+                      __func__);
+        return;
+    case GENET_INTRL2_0 + GENET_INTRL2_CPU_STAT:
+    case GENET_INTRL2_0 + GENET_INTRL2_CPU_MASK_STATUS:
+    case GENET_INTRL2_1 + GENET_INTRL2_CPU_STAT:
+    case GENET_INTRL2_1 + GENET_INTRL2_CPU_MASK_STATUS:
+        return;
+    case GENET_INTRL2_0 + GENET_INTRL2_CPU_SET:
+    case GENET_INTRL2_1 + GENET_INTRL2_CPU_SET:
+        intr = &s->intr[addr >= GENET_INTRL2_1];
+        intr->stat |= value;
+        bcm2838_genet_update_irq(s);
+        return;
+    case GENET_INTRL2_0 + GENET_INTRL2_CPU_CLEAR:
+    case GENET_INTRL2_1 + GENET_INTRL2_CPU_CLEAR:
+        intr = &s->intr[addr >= GENET_INTRL2_1];
+        intr->stat &= ~value;
+        bcm2838_genet_update_irq(s);
+        return;
+    case GENET_INTRL2_0 + GENET_INTRL2_CPU_MASK_SET:
+    case GENET_INTRL2_1 + GENET_INTRL2_CPU_MASK_SET:
+        intr = &s->intr[addr >= GENET_INTRL2_1];
+        intr->mask |= value;
+        bcm2838_genet_update_irq(s);
+        return;
+    case GENET_INTRL2_0 + GENET_INTRL2_CPU_MASK_CLEAR:
+    case GENET_INTRL2_1 + GENET_INTRL2_CPU_MASK_CLEAR:
+        intr = &s->intr[addr >= GENET_INTRL2_1];
+        intr->mask &= ~value;
+        bcm2838_genet_update_irq(s);
+        return;
+    case GENET_UMAC_MDIO_CMD:
+        bcm2838_genet_mdio_cmd(s, value);
+        return;
+    case GENET_RDMA + GENET_DMA_REGS + GENET_DMA_STATUS:
+    case GENET_TDMA + GENET_DMA_REGS + GENET_DMA_STATUS:
+        return;
+    case GENET_UMAC_CMD:
+    case GENET_RDMA + GENET_DMA_REGS + GENET_DMA_CTRL:
+    case GENET_TDMA + GENET_DMA_REGS + GENET_DMA_CTRL:
+        R(s, addr) = value;
+        bcm2838_genet_rx_kick(s);
+        qemu_bh_schedule(s->tx_bh);
+        return;
+    }
+
+    R(s, addr) = value;
+
+    if (bcm2838_genet_is_dma_ring_reg(addr, GENET_RDMA, &ring, &reg) &&
+        reg == GENET_DMA_RING_SW_INDEX) {
+        /* The guest returned RX buffers: deliver anything held back */
+        bcm2838_genet_rx_kick(s);
+    } else if (bcm2838_genet_is_dma_ring_reg(addr, GENET_TDMA, &ring, &reg) &&
+               reg == GENET_DMA_RING_SW_INDEX) {
+        qemu_bh_schedule(s->tx_bh);
+    }
+}
+
+static const MemoryRegionOps bcm2838_genet_ops = {
+    .read = bcm2838_genet_read,
+    .write = bcm2838_genet_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static void bcm2838_genet_reset(DeviceState *dev)
+{
+    BCM2838GenetState *s = BCM2838_GENET(dev);
+    const uint8_t *mac = s->conf.macaddr.a;
+    int n;
+
+    memset(s->regs, 0, sizeof(s->regs));
+    R(s, GENET_UMAC_MAC0) = ldl_be_p(mac);
+    R(s, GENET_UMAC_MAC1) = lduw_be_p(mac + 4);
+
+    for (n = 0; n < ARRAY_SIZE(s->intr); n++) {
+        s->intr[n].stat = 0;
+        s->intr[n].mask = UINT32_MAX;
+    }
+    s->tx_waiting = false;
+
+    bcm2838_genet_phy_reset(s);
+    bcm2838_genet_update_irq(s);
+}
+
+static void bcm2838_genet_cleanup(NetClientState *nc)
+{
+    BCM2838GenetState *s = BCM2838_GENET(qemu_get_nic_opaque(nc));
+
+    s->nic = NULL;
+}
+
+static NetClientInfo net_bcm2838_genet_info = {
+    .type = NET_CLIENT_DRIVER_NIC,
+    .size = sizeof(NICState),
+    .can_receive = bcm2838_genet_can_receive,
+    .receive = bcm2838_genet_receive,
+    .cleanup = bcm2838_genet_cleanup,
+    .link_status_changed = bcm2838_genet_set_link,
+};
+
+static void bcm2838_genet_init(Object *obj)
+{
+    BCM2838GenetState *s = BCM2838_GENET(obj);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
+    int n;
+
+    memory_region_init_io(&s->iomem, obj, &bcm2838_genet_ops, s,
+                          TYPE_BCM2838_GENET, BCM2838_GENET_MMIO_SIZE);
+    sysbus_init_mmio(sbd, &s->iomem);
+    for (n = 0; n < ARRAY_SIZE(s->irq); n++) {
+        sysbus_init_irq(sbd, &s->irq[n]);
+    }
+}
+
+static void bcm2838_genet_realize(DeviceState *dev, Error **errp)
+{
+    BCM2838GenetState *s = BCM2838_GENET(dev);
+    Error *err = NULL;
+    Object *obj;
+
+    obj = object_property_get_link(OBJECT(dev), "dma-mr", &err);
+    if (obj == NULL) {
+        error_setg(errp, "%s: required dma-mr link not found: %s",
+                   __func__, error_get_pretty(err));
+        return;
+    }
+
+    s->dma_mr = MEMORY_REGION(obj);
+    address_space_init(&s->dma_as, s->dma_mr, TYPE_BCM2838_GENET "-memory");
+
+    s->tx_bh = qemu_bh_new(bcm2838_genet_tx_bh, s);
+
+    qemu_macaddr_default_if_unset(&s->conf.macaddr);
+    s->nic = qemu_new_nic(&net_bcm2838_genet_info, &s->conf,
+                          object_get_typename(OBJECT(dev)), dev->id, s);
+    qemu_format_nic_info_str(qemu_get_queue(s->nic), s->conf.macaddr.a);
+}
+
+static int bcm2838_genet_post_load(void *opaque, int version_id)
+{
+    BCM2838GenetState *s = opaque;
+
+    s->tx_waiting = false;
+    bcm2838_genet_update_irq(s);
+    qemu_bh_schedule(s->tx_bh);
+    return 0;
+}
+
+static const VMStateDescription vmstate_bcm2838_genet_intr = {
+    .name = TYPE_BCM2838_GENET "-intr",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(stat, BCM2838GenetIntr),
+        VMSTATE_UINT32(mask, BCM2838GenetIntr),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_bcm2838_genet = {
+    .name = TYPE_BCM2838_GENET,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = bcm2838_genet_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(regs, BCM2838GenetState,
+                             BCM2838_GENET_MMIO_SIZE / 4),
+        VMSTATE_STRUCT_ARRAY(intr, BCM2838GenetState, 2, 1,
+                             vmstate_bcm2838_genet_intr, BCM2838GenetIntr),
+        VMSTATE_UINT16_ARRAY(phy_regs, BCM2838GenetState, 32),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property bcm2838_genet_properties[] = {
+    DEFINE_PROP_UINT32("phy-addr", BCM2838GenetState, phy_addr, 1),
+    DEFINE_NIC_PROPERTIES(BCM2838GenetState, conf),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void bcm2838_genet_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->desc = "BCM2838 GENET Gigabit Ethernet";
+    dc->realize = bcm2838_genet_realize;
+    dc->reset = bcm2838_genet_reset;
+    dc->vmsd = &vmstate_bcm2838_genet;
+    dc->props = bcm2838_genet_properties;
+    set_bit(DEVICE_CATEGORY_NETWORK, dc->categories);
+}
+
+static TypeInfo bcm2838_genet_info = {
+    .name          = TYPE_BCM2838_GENET,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(BCM2838GenetState),
+    .class_init    = bcm2838_genet_class_init,
+    .instance_init = bcm2838_genet_init,
+};
+
+static void bcm2838_genet_register_types(void)
+{
+    type_register_static(&bcm2838_genet_info);
+}
+
+type_init(bcm2838_genet_register_types)
@@ -18,6 +18,7 @@
 #include "hw/virtio/virtio.h"
 #include "net/net.h"
 #include "net/checksum.h"
+#include "net/eth.h"
 #include "net/tap.h"
 #include "qemu/error-report.h"
 #include "qemu/timer.h"
@@ -47,6 +48,9 @@
 #define VIRTIO_NET_RX_QUEUE_MIN_SIZE VIRTIO_NET_RX_QUEUE_DEFAULT_SIZE
 #define VIRTIO_NET_TX_QUEUE_MIN_SIZE VIRTIO_NET_TX_QUEUE_DEFAULT_SIZE
 
+/* TX elements popped from the ring at a time */
+#define VIRTIO_NET_TX_BATCH 32
+
 #define VIRTIO_NET_IP4_ADDR_SIZE   8        /* ipv4 saddr + daddr */
 
 #define VIRTIO_NET_TCP_FLAG         0x3F
@@ -62,6 +66,16 @@
 #define VIRTIO_NET_IP6_ADDR_SIZE   32      /* ipv6 saddr + daddr */
 #define VIRTIO_NET_MAX_IP6_PAYLOAD VIRTIO_NET_MAX_TCP_PAYLOAD
 
+#define VIRTIO_NET_RSS_SUPPORTED_HASHES (VIRTIO_NET_RSS_HASH_TYPE_IPv4 | \
+                                         VIRTIO_NET_RSS_HASH_TYPE_TCPv4 | \
+                                         VIRTIO_NET_RSS_HASH_TYPE_UDPv4 | \
+                                         VIRTIO_NET_RSS_HASH_TYPE_IPv6 | \
+                                         VIRTIO_NET_RSS_HASH_TYPE_TCPv6 | \
+                                         VIRTIO_NET_RSS_HASH_TYPE_UDPv6 | \
+                                         VIRTIO_NET_RSS_HASH_TYPE_IP_EX | \
+                                         VIRTIO_NET_RSS_HASH_TYPE_TCP_EX | \
+                                         VIRTIO_NET_RSS_HASH_TYPE_UDP_EX)
+
 /* Purge coalesced packets timer interval, This value affects the performance
    a lot, and should be tuned carefully, '300000'(300us) is the recommended
    value to pass the WHQL test, '50000' can gain 2x netperf throughput with
@@ -99,6 +113,8 @@ static VirtIOFeature feature_sizes[] = {
      .end = virtio_endof(struct virtio_net_config, mtu)},
     {.flags = 1ULL << VIRTIO_NET_F_SPEED_DUPLEX,
      .end = virtio_endof(struct virtio_net_config, duplex)},
+    {.flags = (1ULL << VIRTIO_NET_F_RSS) | (1ULL << VIRTIO_NET_F_HASH_REPORT),
+     .end = virtio_endof(struct virtio_net_config, supported_hash_types)},
     {}
 };
 
@@ -129,6 +145,11 @@ static void virtio_net_get_config(VirtIODevice *vdev, uint8_t *config)
     memcpy(netcfg.mac, n->mac, ETH_ALEN);
     virtio_stl_p(vdev, &netcfg.speed, n->net_conf.speed);
     netcfg.duplex = n->net_conf.duplex;
+    netcfg.rss_max_key_size = VIRTIO_NET_RSS_MAX_KEY_SIZE;
+    virtio_stw_p(vdev, &netcfg.rss_max_indirection_table_length,
+                 VIRTIO_NET_RSS_MAX_TABLE_LEN);
+    virtio_stl_p(vdev, &netcfg.supported_hash_types,
+                 VIRTIO_NET_RSS_SUPPORTED_HASHES);
     memcpy(config, &netcfg, n->config_size);
 }
 
@@ -487,6 +508,8 @@ static RxFilterInfo *virtio_net_query_rxfilter(NetClientState *nc)
     return info;
 }
 
+static void virtio_net_disable_rss(VirtIONet *n);
+
 static void virtio_net_reset(VirtIODevice *vdev)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
@@ -514,6 +537,7 @@ static void virtio_net_reset(VirtIODevice *vdev)
     memcpy(&n->mac[0], &n->nic->conf->macaddr, sizeof(n->mac));
     qemu_format_nic_info_str(qemu_get_queue(n->nic), n->mac);
     memset(n->vlans, 0, MAX_VLAN >> 3);
+    virtio_net_disable_rss(n);
 
     /* Flush any async TX */
     for (i = 0;  i < n->max_queues; i++) {
@@ -552,7 +576,7 @@ static int peer_has_ufo(VirtIONet *n)
 }
 
 static void virtio_net_set_mrg_rx_bufs(VirtIONet *n, int mergeable_rx_bufs,
-                                       int version_1)
+                                       int version_1, int hash_report)
 {
     int i;
     NetClientState *nc;
@@ -560,7 +584,10 @@ static void virtio_net_set_mrg_rx_bufs(VirtIONet *n, int mergeable_rx_bufs,
     n->mergeable_rx_bufs = mergeable_rx_bufs;
 
     if (version_1) {
-        n->guest_hdr_len = sizeof(struct virtio_net_hdr_mrg_rxbuf);
+        n->guest_hdr_len = hash_report ?
+            sizeof(struct virtio_net_hdr_v1_hash) :
+            sizeof(struct virtio_net_hdr_mrg_rxbuf);
+        n->rss_data.populate_hash = !!hash_report;
     } else {
         n->guest_hdr_len = n->mergeable_rx_bufs ?
             sizeof(struct virtio_net_hdr_mrg_rxbuf) :
@@ -688,10 +715,19 @@ static uint64_t virtio_net_get_features(VirtIODevice *vdev, uint64_t features,
         virtio_clear_feature(&features, VIRTIO_NET_F_HOST_UFO);
     }
 
+    /* Both are configured through the control virtqueue */
+    if (!virtio_has_feature(features, VIRTIO_NET_F_CTRL_VQ)) {
+        virtio_clear_feature(&features, VIRTIO_NET_F_RSS);
+        virtio_clear_feature(&features, VIRTIO_NET_F_HASH_REPORT);
+    }
+
     if (!get_vhost_net(nc->peer)) {
         return features;
     }
 
+    /* RSS runs in virtio_net_receive_rcu(), which vhost bypasses */
+    virtio_clear_feature(&features, VIRTIO_NET_F_RSS);
+    virtio_clear_feature(&features, VIRTIO_NET_F_HASH_REPORT);
     features = vhost_net_get_features(get_vhost_net(nc->peer), features);
     vdev->backend_features = features;
 
@@ -763,7 +799,9 @@ static void virtio_net_set_features(VirtIODevice *vdev, uint64_t features)
                                virtio_has_feature(features,
                                                   VIRTIO_NET_F_MRG_RXBUF),
                                virtio_has_feature(features,
-                                                  VIRTIO_F_VERSION_1));
+                                                  VIRTIO_F_VERSION_1),
+                               virtio_has_feature(features,
+                                                  VIRTIO_NET_F_HASH_REPORT));
 
     n->rsc4_enabled = virtio_has_feature(features, VIRTIO_NET_F_RSC_EXT) &&
         virtio_has_feature(features, VIRTIO_NET_F_GUEST_TSO4);
@@ -1011,6 +1049,312 @@ static int virtio_net_handle_announce(VirtIONet *n, uint8_t cmd,
     }
 }
 
+/* RSS */
+
+/* The hash report fields that follow struct virtio_net_hdr_v1 */
+typedef struct VirtioNetHashReport {
+    uint32_t hash_value;
+    uint16_t hash_report;
+    uint16_t padding;
+} QEMU_PACKED VirtioNetHashReport;
+
+static void virtio_net_disable_rss(VirtIONet *n)
+{
+    if (n->rss_data.enabled) {
+        trace_virtio_net_rss_disable();
+    }
+    n->rss_data.enabled = false;
+}
+
+/*
+ * Precompute the Toeplitz hash of every byte value at every offset of
+ * the hash input: the XOR of the 32-bit key windows that start at the
+ * byte's set bits.  Hashing a packet then takes one lookup per input
+ * byte instead of a loop over every input bit.
+ */
+static void virtio_net_rss_build_toeplitz(VirtioNetRssData *rss)
+{
+    uint8_t key[VIRTIO_NET_RSS_MAX_KEY_SIZE + sizeof(uint64_t)] = { 0 };
+    unsigned int i, j, v;
+
+    memcpy(key, rss->key, VIRTIO_NET_RSS_MAX_KEY_SIZE);
+    if (!rss->toeplitz) {
+        rss->toeplitz = g_malloc(sizeof(*rss->toeplitz) *
+                                 VIRTIO_NET_RSS_MAX_INPUT_LEN);
+    }
+
+    for (i = 0; i < VIRTIO_NET_RSS_MAX_INPUT_LEN; i++) {
+        uint64_t window = ldq_be_p(&key[i]);
+        uint32_t bit_hash[8];
+
+        /* Key window for bit j of byte i, most significant bit first */
+        for (j = 0; j < 8; j++) {
+            bit_hash[j] = (window << j) >> 32;
+        }
+
+        rss->toeplitz[i][0] = 0;
+        for (v = 1; v < 256; v++) {
+            rss->toeplitz[i][v] = rss->toeplitz[i][v & (v - 1)] ^
+                                  bit_hash[7 - ctz32(v)];
+        }
+    }
+}
+
+static uint32_t virtio_net_toeplitz(VirtioNetRssData *rss,
+                                    const uint8_t *input, size_t len)
+{
+    uint32_t hash = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= rss->toeplitz[i][input[i]];
+    }
+    return hash;
+}
+
+/*
+ * Pick the most specific hash type that the guest enabled for the packet
+ * and build its hash input.  Returns the VIRTIO_NET_HASH_REPORT_ value,
+ * VIRTIO_NET_HASH_REPORT_NONE if no enabled type applies.
+ */
+static uint8_t virtio_net_rss_input(VirtIONet *n, const uint8_t *buf,
+                                    size_t size, uint8_t *input, size_t *len)
+{
+    uint32_t types = n->rss_data.hash_types;
+    struct iovec iov = { .iov_base = (void *)buf, .iov_len = size };
+    bool isip4, isip6, isudp, istcp;
+    size_t l3hdr_off, l4hdr_off, l5hdr_off;
+    eth_ip6_hdr_info ip6hdr_info;
+    eth_ip4_hdr_info ip4hdr_info;
+    eth_l4_hdr_info l4hdr_info;
+    bool ports = true;
+    uint8_t report;
+
+    eth_get_protocols(&iov, 1, &isip4, &isip6, &isudp, &istcp,
+                      &l3hdr_off, &l4hdr_off, &l5hdr_off,
+                      &ip6hdr_info, &ip4hdr_info, &l4hdr_info);
+
+    if (isip4) {
+        if (istcp && (types & VIRTIO_NET_RSS_HASH_TYPE_TCPv4)) {
+            report = VIRTIO_NET_HASH_REPORT_TCPv4;
+        } else if (isudp && (types & VIRTIO_NET_RSS_HASH_TYPE_UDPv4)) {
+            report = VIRTIO_NET_HASH_REPORT_UDPv4;
+        } else if (types & VIRTIO_NET_RSS_HASH_TYPE_IPv4) {
+            report = VIRTIO_NET_HASH_REPORT_IPv4;
+            ports = false;
+        } else {
+            return VIRTIO_NET_HASH_REPORT_NONE;
+        }
+        memcpy(input, &ip4hdr_info.ip4_hdr.ip_src, sizeof(uint32_t));
+        memcpy(input + 4, &ip4hdr_info.ip4_hdr.ip_dst, sizeof(uint32_t));
+        *len = 8;
+    } else if (isip6) {
+        const struct in6_address *src = &ip6hdr_info.ip6_hdr.ip6_src;
+        const struct in6_address *dst = &ip6hdr_info.ip6_hdr.ip6_dst;
+        bool ex;
+
+        if (istcp && (types & (VIRTIO_NET_RSS_HASH_TYPE_TCPv6 |
+                               VIRTIO_NET_RSS_HASH_TYPE_TCP_EX))) {
+            ex = types & VIRTIO_NET_RSS_HASH_TYPE_TCP_EX;
+            report = ex ? VIRTIO_NET_HASH_REPORT_TCPv6_EX :
+                          VIRTIO_NET_HASH_REPORT_TCPv6;
+        } else if (isudp && (types & (VIRTIO_NET_RSS_HASH_TYPE_UDPv6 |
+                                      VIRTIO_NET_RSS_HASH_TYPE_UDP_EX))) {
+            ex = types & VIRTIO_NET_RSS_HASH_TYPE_UDP_EX;
+            report = ex ? VIRTIO_NET_HASH_REPORT_UDPv6_EX :
+                          VIRTIO_NET_HASH_REPORT_UDPv6;
+        } else if (types & (VIRTIO_NET_RSS_HASH_TYPE_IPv6 |
+                            VIRTIO_NET_RSS_HASH_TYPE_IP_EX)) {
+            ex = types & VIRTIO_NET_RSS_HASH_TYPE_IP_EX;
+            report = ex ? VIRTIO_NET_HASH_REPORT_IPv6_EX :
+                          VIRTIO_NET_HASH_REPORT_IPv6;
+            ports = false;
+        } else {
+            return VIRTIO_NET_HASH_REPORT_NONE;
+        }
+
+        /* Home address and routing header destination replace the header's */
+        if (ex && ip6hdr_info.rss_ex_src_valid) {
+            src = &ip6hdr_info.rss_ex_src;
+        }
+        if (ex && ip6hdr_info.rss_ex_dst_valid) {
+            dst = &ip6hdr_info.rss_ex_dst;
+        }
+        memcpy(input, src, sizeof(*src));
+        memcpy(input + 16, dst, sizeof(*dst));
+        *len = 32;
+    } else {
+        return VIRTIO_NET_HASH_REPORT_NONE;
+    }
+
+    if (ports) {
+        /* Source and destination port open both TCP and UDP headers */
+        memcpy(input + *len, &l4hdr_info.hdr, 2 * sizeof(uint16_t));
+        *len += 2 * sizeof(uint16_t);
+    }
+    return report;
+}
+
+/*
+ * Hash a packet received on nc per the guest's RSS configuration and fill
+ * in its hash report.  Returns the queue the packet should go to, or -1
+ * to keep it on nc.
+ */
+static int virtio_net_process_rss(VirtIONet *n, NetClientState *nc,
+                                  const uint8_t *buf, size_t size,
+                                  VirtioNetHashReport *hr)
+{
+    VirtioNetRssData *rss = &n->rss_data;
+    uint8_t input[VIRTIO_NET_RSS_MAX_INPUT_LEN];
+    uint8_t report = VIRTIO_NET_HASH_REPORT_NONE;
+    uint32_t hash = 0;
+    uint16_t index;
+    size_t len;
+
+    if (size > n->host_hdr_len) {
+        report = virtio_net_rss_input(n, buf + n->host_hdr_len,
+                                      size - n->host_hdr_len, input, &len);
+    }
+
+    if (report == VIRTIO_NET_HASH_REPORT_NONE) {
+        index = rss->default_queue;
+    } else {
+        hash = virtio_net_toeplitz(rss, input, len);
+        index = rss->indirections_table[hash & (rss->indirections_len - 1)];
+    }
+
+    hr->hash_value = cpu_to_le32(hash);
+    hr->hash_report = cpu_to_le16(report);
+    hr->padding = 0;
+
+    if (!rss->redirect || index == nc->queue_index ||
+        index >= n->curr_queues) {
+        return -1;
+    }
+    return index;
+}
+
+/*
+ * Parse VIRTIO_NET_CTRL_MQ_RSS_CONFIG, or with !do_rss the layout
+ * compatible VIRTIO_NET_CTRL_MQ_HASH_CONFIG.  Returns the number of queue
+ * pairs to use, 0 if the command is invalid.
+ */
+static uint16_t virtio_net_handle_rss(VirtIONet *n, struct iovec *iov,
+                                      unsigned int iov_cnt, bool do_rss)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    VirtioNetRssData *rss = &n->rss_data;
+    struct virtio_net_rss_config cfg;
+    uint16_t table[VIRTIO_NET_RSS_MAX_TABLE_LEN];
+    struct {
+        uint16_t max_tx_vq;
+        uint8_t key_len;
+    } QEMU_PACKED tail;
+    uint32_t hash_types, len, value = 0;
+    uint16_t default_queue, queues;
+    const char *msg;
+    size_t offset, s;
+    unsigned int i;
+
+    if (!virtio_vdev_has_feature(vdev, do_rss ? VIRTIO_NET_F_RSS :
+                                                VIRTIO_NET_F_HASH_REPORT)) {
+        msg = "feature not negotiated";
+        goto error;
+    }
+
+    offset = offsetof(struct virtio_net_rss_config, indirection_table);
+    s = iov_to_buf(iov, iov_cnt, 0, &cfg, offset);
+    if (s != offset) {
+        msg = "short command buffer";
+        value = s;
+        goto error;
+    }
+    hash_types = virtio_ldl_p(vdev, &cfg.hash_types);
+
+    /* The hash configuration has reserved fields in place of these */
+    len = do_rss ? virtio_lduw_p(vdev, &cfg.indirection_table_mask) + 1 : 1;
+    if (!is_power_of_2(len) || len > VIRTIO_NET_RSS_MAX_TABLE_LEN) {
+        msg = "invalid indirection table size";
+        value = len;
+        goto error;
+    }
+    default_queue = do_rss ? virtio_lduw_p(vdev, &cfg.unclassified_queue) : 0;
+    if (default_queue >= n->max_queues) {
+        msg = "invalid unclassified queue";
+        value = default_queue;
+        goto error;
+    }
+
+    s = iov_to_buf(iov, iov_cnt, offset, table, len * sizeof(table[0]));
+    if (s != len * sizeof(table[0])) {
+        msg = "short indirection table";
+        value = s;
+        goto error;
+    }
+    offset += s;
+    for (i = 0; i < len; i++) {
+        table[i] = do_rss ? virtio_lduw_p(vdev, &table[i]) : 0;
+        if (table[i] >= n->max_queues) {
+            msg = "invalid queue in indirection table";
+            value = table[i];
+            goto error;
+        }
+    }
+
+    s = iov_to_buf(iov, iov_cnt, offset, &tail, sizeof(tail));
+    if (s != sizeof(tail)) {
+        msg = "short command buffer";
+        value = s;
+        goto error;
+    }
+    offset += s;
+    queues = do_rss ? virtio_lduw_p(vdev, &tail.max_tx_vq) : n->curr_queues;
+    if (queues == 0 || queues > n->max_queues) {
+        msg = "invalid number of queues";
+        value = queues;
+        goto error;
+    }
+    if (tail.key_len > VIRTIO_NET_RSS_MAX_KEY_SIZE) {
+        msg = "invalid key size";
+        value = tail.key_len;
+        goto error;
+    }
+
+    hash_types &= VIRTIO_NET_RSS_SUPPORTED_HASHES;
+    if (!hash_types) {
+        virtio_net_disable_rss(n);
+        return queues;
+    }
+    if (!tail.key_len) {
+        msg = "no key provided";
+        goto error;
+    }
+
+    memset(rss->key, 0, sizeof(rss->key));
+    s = iov_to_buf(iov, iov_cnt, offset, rss->key, tail.key_len);
+    if (s != tail.key_len) {
+        msg = "short key";
+        value = s;
+        goto error;
+    }
+
+    memcpy(rss->indirections_table, table, len * sizeof(table[0]));
+    rss->indirections_len = len;
+    rss->hash_types = hash_types;
+    rss->default_queue = default_queue;
+    rss->redirect = do_rss;
+    rss->enabled = true;
+    virtio_net_rss_build_toeplitz(rss);
+    trace_virtio_net_rss_enable(hash_types, len, tail.key_len);
+
+    return queues;
+
+error:
+    trace_virtio_net_rss_error(msg, value);
+    virtio_net_disable_rss(n);
+    return 0;
+}
+
 static int virtio_net_handle_mq(VirtIONet *n, uint8_t cmd,
                                 struct iovec *iov, unsigned int iov_cnt)
 {
@@ -1019,21 +1363,33 @@ static int virtio_net_handle_mq(VirtIONet *n, uint8_t cmd,
     size_t s;
     uint16_t queues;
 
-    s = iov_to_buf(iov, iov_cnt, 0, &mq, sizeof(mq));
-    if (s != sizeof(mq)) {
-        return VIRTIO_NET_ERR;
+    /* Each of these commands replaces the previous steering configuration */
+    virtio_net_disable_rss(n);
+
+    if (cmd == VIRTIO_NET_CTRL_MQ_HASH_CONFIG) {
+        queues = virtio_net_handle_rss(n, iov, iov_cnt, false);
+        return queues ? VIRTIO_NET_OK : VIRTIO_NET_ERR;
     }
 
-    if (cmd != VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET) {
+    if (cmd == VIRTIO_NET_CTRL_MQ_RSS_CONFIG) {
+        queues = virtio_net_handle_rss(n, iov, iov_cnt, true);
+    } else if (cmd == VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET) {
+        s = iov_to_buf(iov, iov_cnt, 0, &mq, sizeof(mq));
+        if (s != sizeof(mq)) {
+            return VIRTIO_NET_ERR;
+        }
+        queues = virtio_lduw_p(vdev, &mq.virtqueue_pairs);
+    } else {
         return VIRTIO_NET_ERR;
     }
 
-    queues = virtio_lduw_p(vdev, &mq.virtqueue_pairs);
-
+    /* RSS may also just spread hashes over a single queue pair */
     if (queues < VIRTIO_NET_CTRL_MQ_VQ_PAIRS_MIN ||
         queues > VIRTIO_NET_CTRL_MQ_VQ_PAIRS_MAX ||
         queues > n->max_queues ||
-        !n->multiqueue) {
+        (!n->multiqueue &&
+         (cmd == VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET || queues > 1))) {
+        virtio_net_disable_rss(n);
         return VIRTIO_NET_ERR;
     }
 
@@ -1105,6 +1461,15 @@ static void virtio_net_handle_rx(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
     int queue_index = vq2q(virtio_get_queue_index(vq));
+    int i;
+
+    if (n->rss_data.enabled && n->rss_data.redirect) {
+        /* Packets that RSS steers to this queue wait on the one they came in */
+        for (i = 0; i < n->curr_queues; i++) {
+            qemu_flush_queued_packets(qemu_get_subqueue(n->nic, i));
+        }
+        return;
+    }
 
     qemu_flush_queued_packets(qemu_get_subqueue(n->nic, queue_index));
 }
@@ -1266,10 +1631,11 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
                                       size_t size)
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
-    VirtIONetQueue *q = virtio_net_get_subqueue(nc);
+    VirtIONetQueue *q;
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
     struct iovec mhdr_sg[VIRTQUEUE_MAX_SIZE];
     struct virtio_net_hdr_mrg_rxbuf mhdr;
+    VirtioNetHashReport hash_report = { 0 };
     unsigned mhdr_cnt = 0;
     size_t offset, i, guest_offset;
 
@@ -1277,6 +1643,21 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
         return -1;
     }
 
+    /* Only hash if the guest wants the hash or has queues to spread over */
+    if (n->rss_data.enabled &&
+        (n->rss_data.populate_hash ||
+         (n->rss_data.redirect && n->curr_queues > 1))) {
+        int index = virtio_net_process_rss(n, nc, buf, size, &hash_report);
+
+        if (index >= 0) {
+            nc = qemu_get_subqueue(n->nic, index);
+            if (!virtio_net_can_receive(nc)) {
+                return -1;
+            }
+        }
+    }
+    q = virtio_net_get_subqueue(nc);
+
     /* hdr_len refers to the header we supply to the guest */
     if (!virtio_net_has_buffers(q, size + n->guest_hdr_len - n->host_hdr_len)) {
         return 0;
@@ -1327,6 +1708,12 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
             }
 
             receive_header(n, sg, elem->in_num, buf, size);
+            if (n->rss_data.populate_hash) {
+                iov_from_buf(sg, elem->in_num,
+                             offsetof(struct virtio_net_hdr_v1_hash,
+                                      hash_value),
+                             &hash_report, sizeof(hash_report));
+            }
             offset = n->host_hdr_len;
             total += n->guest_hdr_len;
             guest_offset = n->guest_hdr_len;
@@ -1361,7 +1748,11 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
     }
 
     virtqueue_flush(q->rx_vq, i);
-    virtio_notify(vdev, q->rx_vq);
+    if (q->rx_batch) {
+        q->rx_notify_pending = true;
+    } else {
+        virtio_notify(vdev, q->rx_vq);
+    }
 
     return size;
 }
@@ -1983,6 +2374,27 @@ static ssize_t virtio_net_receive(NetClientState *nc, const uint8_t *buf,
     }
 }
 
+static void virtio_net_receive_batch_begin(NetClientState *nc)
+{
+    virtio_net_get_subqueue(nc)->rx_batch++;
+}
+
+/* One interrupt for all the packets received in the batch */
+static void virtio_net_receive_batch_end(NetClientState *nc)
+{
+    VirtIONetQueue *q = virtio_net_get_subqueue(nc);
+
+    assert(q->rx_batch);
+    if (--q->rx_batch || !q->rx_notify_pending) {
+        return;
+    }
+
+    q->rx_notify_pending = false;
+    rcu_read_lock();
+    virtio_notify(VIRTIO_DEVICE(q->n), q->rx_vq);
+    rcu_read_unlock();
+}
+
 static int32_t virtio_net_flush_tx(VirtIONetQueue *q);
 
 static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
@@ -1994,7 +2406,7 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
     virtqueue_push(q->tx_vq, q->async_tx.elem, 0);
     virtio_notify(vdev, q->tx_vq);
 
-    g_free(q->async_tx.elem);
+    virtqueue_free_element(q->tx_vq, q->async_tx.elem);
     q->async_tx.elem = NULL;
 
     virtio_queue_set_notification(q->tx_vq, 1);
@@ -2002,13 +2414,91 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
 }
 
 /* TX */
+
+/*
+ * Send one element.  Returns 0 once it is completed, -EBUSY if the
+ * backend took it asynchronously, or -EINVAL if it was malformed.
+ */
+static int virtio_net_tx_one(VirtIONetQueue *q, VirtQueueElement *elem)
+{
+    VirtIONet *n = q->n;
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    int queue_index = vq2q(virtio_get_queue_index(q->tx_vq));
+    ssize_t ret;
+    unsigned int out_num;
+    struct iovec sg[VIRTQUEUE_MAX_SIZE], sg2[VIRTQUEUE_MAX_SIZE + 1], *out_sg;
+    /* Large enough for any guest_hdr_len */
+    struct virtio_net_hdr_v1_hash mhdr;
+
+    out_num = elem->out_num;
+    out_sg = elem->out_sg;
+    if (out_num < 1) {
+        virtio_error(vdev, "virtio-net header not in first element");
+        virtqueue_detach_element(q->tx_vq, elem, 0);
+        virtqueue_free_element(q->tx_vq, elem);
+        return -EINVAL;
+    }
+
+    if (n->has_vnet_hdr) {
+        if (iov_to_buf(out_sg, out_num, 0, &mhdr, n->guest_hdr_len) <
+            n->guest_hdr_len) {
+            virtio_error(vdev, "virtio-net header incorrect");
+            virtqueue_detach_element(q->tx_vq, elem, 0);
+            virtqueue_free_element(q->tx_vq, elem);
+            return -EINVAL;
+        }
+        if (n->needs_vnet_hdr_swap) {
+            virtio_net_hdr_swap(vdev, (void *) &mhdr);
+            sg2[0].iov_base = &mhdr;
+            sg2[0].iov_len = n->guest_hdr_len;
+            out_num = iov_copy(&sg2[1], ARRAY_SIZE(sg2) - 1,
+                               out_sg, out_num,
+                               n->guest_hdr_len, -1);
+            if (out_num == VIRTQUEUE_MAX_SIZE) {
+                goto drop;
+            }
+            out_num += 1;
+            out_sg = sg2;
+        }
+    }
+    /*
+     * If host wants to see the guest header as is, we can
+     * pass it on unchanged. Otherwise, copy just the parts
+     * that host is interested in.
+     */
+    assert(n->host_hdr_len <= n->guest_hdr_len);
+    if (n->host_hdr_len != n->guest_hdr_len) {
+        unsigned sg_num = iov_copy(sg, ARRAY_SIZE(sg),
+                                   out_sg, out_num,
+                                   0, n->host_hdr_len);
+        sg_num += iov_copy(sg + sg_num, ARRAY_SIZE(sg) - sg_num,
+                         out_sg, out_num,
+                         n->guest_hdr_len, -1);
+        out_num = sg_num;
+        out_sg = sg;
+    }
+
+    ret = qemu_sendv_packet_async(qemu_get_subqueue(n->nic, queue_index),
+                                  out_sg, out_num, virtio_net_tx_complete);
+    if (ret == 0) {
+        virtio_queue_set_notification(q->tx_vq, 0);
+        q->async_tx.elem = elem;
+        return -EBUSY;
+    }
+
+drop:
+    virtqueue_push(q->tx_vq, elem, 0);
+    virtio_notify(vdev, q->tx_vq);
+    virtqueue_free_element(q->tx_vq, elem);
+    return 0;
+}
+
 static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
 {
     VirtIONet *n = q->n;
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
-    VirtQueueElement *elem;
+    VirtQueueElement *batch[VIRTIO_NET_TX_BATCH];
     int32_t num_packets = 0;
-    int queue_index = vq2q(virtio_get_queue_index(q->tx_vq));
     if (!(vdev->status & VIRTIO_CONFIG_S_DRIVER_OK)) {
         return num_packets;
     }
@@ -2018,80 +2508,31 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
         return num_packets;
     }
 
-    for (;;) {
-        ssize_t ret;
-        unsigned int out_num;
-        struct iovec sg[VIRTQUEUE_MAX_SIZE], sg2[VIRTQUEUE_MAX_SIZE + 1], *out_sg;
-        struct virtio_net_hdr_mrg_rxbuf mhdr;
+    while (num_packets < n->tx_burst) {
+        unsigned int i, count;
 
-        elem = virtqueue_pop(q->tx_vq, sizeof(VirtQueueElement));
-        if (!elem) {
+        count = virtqueue_pop_batch(q->tx_vq, sizeof(VirtQueueElement),
+                                    (void **)batch,
+                                    MIN(VIRTIO_NET_TX_BATCH,
+                                        n->tx_burst - num_packets));
+        if (!count) {
             break;
         }
 
-        out_num = elem->out_num;
-        out_sg = elem->out_sg;
-        if (out_num < 1) {
-            virtio_error(vdev, "virtio-net header not in first element");
-            virtqueue_detach_element(q->tx_vq, elem, 0);
-            g_free(elem);
-            return -EINVAL;
-        }
+        for (i = 0; i < count; i++) {
+            int ret = virtio_net_tx_one(q, batch[i]);
 
-        if (n->has_vnet_hdr) {
-            if (iov_to_buf(out_sg, out_num, 0, &mhdr, n->guest_hdr_len) <
-                n->guest_hdr_len) {
-                virtio_error(vdev, "virtio-net header incorrect");
-                virtqueue_detach_element(q->tx_vq, elem, 0);
-                g_free(elem);
-                return -EINVAL;
-            }
-            if (n->needs_vnet_hdr_swap) {
-                virtio_net_hdr_swap(vdev, (void *) &mhdr);
-                sg2[0].iov_base = &mhdr;
-                sg2[0].iov_len = n->guest_hdr_len;
-                out_num = iov_copy(&sg2[1], ARRAY_SIZE(sg2) - 1,
-                                   out_sg, out_num,
-                                   n->guest_hdr_len, -1);
-                if (out_num == VIRTQUEUE_MAX_SIZE) {
-                    goto drop;
+            if (ret < 0) {
+                /* Give back what was popped but not sent, newest first */
+                while (count > i + 1) {
+                    VirtQueueElement *elem = batch[--count];
+
+                    virtqueue_unpop(q->tx_vq, elem, 0);
+                    virtqueue_free_element(q->tx_vq, elem);
                 }
-                out_num += 1;
-                out_sg = sg2;
+                return ret;
             }
-        }
-        /*
-         * If host wants to see the guest header as is, we can
-         * pass it on unchanged. Otherwise, copy just the parts
-         * that host is interested in.
-         */
-        assert(n->host_hdr_len <= n->guest_hdr_len);
-        if (n->host_hdr_len != n->guest_hdr_len) {
-            unsigned sg_num = iov_copy(sg, ARRAY_SIZE(sg),
-                                       out_sg, out_num,
-                                       0, n->host_hdr_len);
-            sg_num += iov_copy(sg + sg_num, ARRAY_SIZE(sg) - sg_num,
-                             out_sg, out_num,
-                             n->guest_hdr_len, -1);
-            out_num = sg_num;
-            out_sg = sg;
-        }
-
-        ret = qemu_sendv_packet_async(qemu_get_subqueue(n->nic, queue_index),
-                                      out_sg, out_num, virtio_net_tx_complete);
-        if (ret == 0) {
-            virtio_queue_set_notification(q->tx_vq, 0);
-            q->async_tx.elem = elem;
-            return -EBUSY;
-        }
-
-drop:
-        virtqueue_push(q->tx_vq, elem, 0);
-        virtio_notify(vdev, q->tx_vq);
-        g_free(elem);
-
-        if (++num_packets >= n->tx_burst) {
-            break;
+            num_packets++;
         }
     }
     return num_packets;
@@ -2322,7 +2763,9 @@ static int virtio_net_post_load_device(void *opaque, int version_id)
     trace_virtio_net_post_load_device();
     virtio_net_set_mrg_rx_bufs(n, n->mergeable_rx_bufs,
                                virtio_vdev_has_feature(vdev,
-                                                       VIRTIO_F_VERSION_1));
+                                                       VIRTIO_F_VERSION_1),
+                               virtio_vdev_has_feature(vdev,
+                                                  VIRTIO_NET_F_HASH_REPORT));
 
     /* MAC_TABLE_ENTRIES may be different from the saved image */
     if (n->mac_table.in_use > MAC_TABLE_ENTRIES) {
@@ -2528,6 +2971,52 @@ static const VMStateDescription vmstate_virtio_net_has_vnet = {
     },
 };
 
+static bool virtio_net_rss_needed(void *opaque)
+{
+    return VIRTIO_NET(opaque)->rss_data.enabled;
+}
+
+static int virtio_net_rss_post_load(void *opaque, int version_id)
+{
+    VirtIONet *n = opaque;
+    VirtioNetRssData *rss = &n->rss_data;
+    int i;
+
+    if (!is_power_of_2(rss->indirections_len) ||
+        rss->indirections_len > VIRTIO_NET_RSS_MAX_TABLE_LEN ||
+        rss->default_queue >= n->max_queues) {
+        return -EINVAL;
+    }
+    for (i = 0; i < rss->indirections_len; i++) {
+        if (rss->indirections_table[i] >= n->max_queues) {
+            return -EINVAL;
+        }
+    }
+
+    virtio_net_rss_build_toeplitz(rss);
+    return 0;
+}
+
+static const VMStateDescription vmstate_virtio_net_rss = {
+    .name = "virtio-net-device/rss",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = virtio_net_rss_needed,
+    .post_load = virtio_net_rss_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_BOOL(rss_data.enabled, VirtIONet),
+        VMSTATE_BOOL(rss_data.redirect, VirtIONet),
+        VMSTATE_UINT32(rss_data.hash_types, VirtIONet),
+        VMSTATE_UINT16(rss_data.indirections_len, VirtIONet),
+        VMSTATE_UINT16(rss_data.default_queue, VirtIONet),
+        VMSTATE_UINT8_ARRAY(rss_data.key, VirtIONet,
+                            VIRTIO_NET_RSS_MAX_KEY_SIZE),
+        VMSTATE_UINT16_ARRAY(rss_data.indirections_table, VirtIONet,
+                             VIRTIO_NET_RSS_MAX_TABLE_LEN),
+        VMSTATE_END_OF_LIST()
+    },
+};
+
 static const VMStateDescription vmstate_virtio_net_device = {
     .name = "virtio-net-device",
     .version_id = VIRTIO_NET_VM_VERSION,
@@ -2578,6 +3067,10 @@ static const VMStateDescription vmstate_virtio_net_device = {
                             has_ctrl_guest_offloads),
         VMSTATE_END_OF_LIST()
    },
+    .subsections = (const VMStateDescription * []) {
+        &vmstate_virtio_net_rss,
+        NULL
+    }
 };
 
 static NetClientInfo net_virtio_info = {
@@ -2585,6 +3078,8 @@ static NetClientInfo net_virtio_info = {
     .size = sizeof(NICState),
     .can_receive = virtio_net_can_receive,
     .receive = virtio_net_receive,
+    .receive_batch_begin = virtio_net_receive_batch_begin,
+    .receive_batch_end = virtio_net_receive_batch_end,
     .link_status_changed = virtio_net_set_link_status,
     .query_rx_filter = virtio_net_query_rxfilter,
     .announce = virtio_net_announce,
@@ -2751,7 +3246,7 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
 
     n->vqs[0].tx_waiting = 0;
     n->tx_burst = n->net_conf.txburst;
-    virtio_net_set_mrg_rx_bufs(n, 0, 0);
+    virtio_net_set_mrg_rx_bufs(n, 0, 0, 0);
     n->promisc = 1; /* for compatibility */
 
     n->mac_table.macs = g_malloc0(MAC_TABLE_ENTRIES * ETH_ALEN);
@@ -2791,6 +3286,7 @@ static void virtio_net_device_unrealize(DeviceState *dev, Error **errp)
     g_free(n->vqs);
     qemu_del_nic(n->nic);
     virtio_net_rsc_cleanup(n);
+    g_free(n->rss_data.toeplitz);
     virtio_cleanup(vdev);
 }
 
@@ -2871,6 +3367,10 @@ static Property virtio_net_properties[] = {
     DEFINE_PROP_BIT64("ctrl_guest_offloads", VirtIONet, host_features,
                     VIRTIO_NET_F_CTRL_GUEST_OFFLOADS, true),
     DEFINE_PROP_BIT64("mq", VirtIONet, host_features, VIRTIO_NET_F_MQ, false),
+    DEFINE_PROP_BIT64("rss", VirtIONet, host_features,
+                    VIRTIO_NET_F_RSS, false),
+    DEFINE_PROP_BIT64("hash", VirtIONet, host_features,
+                    VIRTIO_NET_F_HASH_REPORT, false),
     DEFINE_PROP_BIT64("guest_rsc_ext", VirtIONet, host_features,
                     VIRTIO_NET_F_RSC_EXT, false),
     DEFINE_PROP_UINT32("rsc_interval", VirtIONet, rsc_timeout,
@@ -0,0 +1,660 @@
+/*
+ * BCM2838 (BCM2711) PCIe root complex emulation
+ *
+ * The Raspberry Pi 4 PCIe block is a Broadcom STB controller: the root
+ * port's own config space sits at the bottom of the register window,
+ * downstream config space is reached through an index/data pair, and
+ * the CPU sees PCI memory through up to four programmable outbound
+ * windows. MSIs are written by endpoints to a single target address and
+ * collected in an INTR2 status register that raises one interrupt.
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "qemu/units.h"
+#include "exec/address-spaces.h"
+#include "hw/pci/pci_bridge.h"
+#include "hw/pci/pci_host.h"
+#include "hw/pci/pci_ids.h"
+#include "hw/pci/pcie_port.h"
+#include "migration/vmstate.h"
+#include "hw/irq.h"
+#include "hw/pci-host/bcm2838_pcie.h"
+
+/* Root port config space is mapped directly at offset 0 */
+#define BCM2838_PCIE_RC_CFG_SIZE                0x1000
+#define BCM2838_PCIE_CAP_REGS                   0xac
+
+#define BCM2838_PCIE_RC_DL_MDIO_ADDR            0x1100
+#define BCM2838_PCIE_RC_DL_MDIO_WR_DATA         0x1104
+#define BCM2838_PCIE_RC_DL_MDIO_RD_DATA         0x1108
+#define BCM2838_PCIE_MDIO_DATA_DONE             BIT(31)
+
+#define BCM2838_PCIE_MISC_MISC_CTRL             0x4008
+#define BCM2838_PCIE_MISC_MEM_WIN_LO(n)         (0x400c + (n) * 8)
+#define BCM2838_PCIE_MISC_MEM_WIN_HI(n)         (0x4010 + (n) * 8)
+#define BCM2838_PCIE_MISC_RC_BAR2_CONFIG_LO     0x4034
+#define BCM2838_PCIE_MISC_RC_BAR2_CONFIG_HI     0x4038
+#define BCM2838_PCIE_MISC_MSI_BAR_CONFIG_LO     0x4044
+#define BCM2838_PCIE_MISC_MSI_BAR_CONFIG_HI     0x4048
+#define BCM2838_PCIE_MISC_MSI_DATA_CONFIG       0x404c
+#define BCM2838_PCIE_MISC_EOI_CTRL              0x4060
+#define BCM2838_PCIE_MISC_PCIE_STATUS           0x4068
+#define BCM2838_PCIE_STATUS_PHYLINKUP           BIT(4)
+#define BCM2838_PCIE_STATUS_DL_ACTIVE           BIT(5)
+#define BCM2838_PCIE_STATUS_PORT_RC             BIT(7)
+#define BCM2838_PCIE_MISC_REVISION              0x406c
+#define BCM2838_PCIE_MISC_MEM_WIN_BASE_LIMIT(n) (0x4070 + (n) * 4)
+#define BCM2838_PCIE_MISC_MEM_WIN_BASE_HI(n)    (0x4080 + (n) * 8)
+#define BCM2838_PCIE_MISC_MEM_WIN_LIMIT_HI(n)   (0x4084 + (n) * 8)
+#define BCM2838_PCIE_MISC_HARD_PCIE_HARD_DEBUG  0x4204
+
+#define BCM2838_PCIE_MSI_INTR2_BASE             0x4500
+#define BCM2838_PCIE_MSI_INTR2_SIZE             0x18
+#define BCM2838_PCIE_INTR2_STATUS               0x00
+#define BCM2838_PCIE_INTR2_SET                  0x04
+#define BCM2838_PCIE_INTR2_CLR                  0x08
+#define BCM2838_PCIE_INTR2_MASK_STATUS          0x0c
+#define BCM2838_PCIE_INTR2_MASK_SET             0x10
+#define BCM2838_PCIE_INTR2_MASK_CLR             0x14
+
+#define BCM2838_PCIE_EXT_CFG_DATA               0x8000
+#define BCM2838_PCIE_EXT_CFG_INDEX              0x9000
+#define BCM2838_PCIE_EXT_CFG_BUS(x)             extract32(x, 20, 8)
+#define BCM2838_PCIE_EXT_CFG_DEVFN(x)           extract32(x, 12, 8)
+#define BCM2838_PCIE_RGR1_SW_INIT_1             0x9210
+
+#define BCM2838_PCIE_REVISION                   0x304
+
+static void bcm2838_pcie_update_msi_irq(BCM2838PCIEHostState *s)
+{
+    qemu_set_irq(s->msi_irq, !!(s->msi_status & ~s->msi_mask));
+}
+
+static void bcm2838_pcie_msi_write(void *opaque, hwaddr addr,
+                                   uint64_t val, unsigned len)
+{
+    BCM2838PCIEHostState *s = BCM2838_PCIE_HOST(opaque);
+    uint16_t mask = s->msi_data_config >> 16;
+    uint16_t match = s->msi_data_config;
+    uint16_t data = val;
+
+    if ((data & mask) != (match & mask)) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "%s: MSI data 0x%04x does not match 0x%08x\n",
+                      __func__, data, s->msi_data_config);
+        return;
+    }
+
+    s->msi_status |= BIT(data & ~mask & 0x1f);
+    bcm2838_pcie_update_msi_irq(s);
+}
+
+static const MemoryRegionOps bcm2838_pcie_msi_ops = {
+    .write = bcm2838_pcie_msi_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid = {
+        .min_access_size = 2,
+        .max_access_size = 4,
+    },
+};
+
+static void bcm2838_pcie_update_msi_mapping(BCM2838PCIEHostState *s)
+{
+    hwaddr base = deposit64(s->msi_bar_lo & ~3, 32, 32, s->msi_bar_hi);
+
+    memory_region_transaction_begin();
+    memory_region_set_address(&s->pci.msi, base);
+    memory_region_set_enabled(&s->pci.msi, s->msi_bar_lo & 1);
+    memory_region_transaction_commit();
+}
+
+/*
+ * RC_BAR2 maps a PCI bus address range onto CPU memory starting at 0.
+ * The size field uses the same encoding as brcm_pcie_encode_ibar_size()
+ * in Linux. Until the guest programs it we let inbound accesses through
+ * with an identity mapping, so firmware-less boots still work.
+ */
+static void bcm2838_pcie_update_inbound(BCM2838PCIEHostState *s)
+{
+    uint64_t offset = deposit64(s->rc_bar2_lo & ~0xfff, 32, 32,
+                                s->rc_bar2_hi);
+    unsigned enc = extract32(s->rc_bar2_lo, 0, 5);
+    uint64_t size = UINT64_MAX;
+
+    if (enc >= 0x1c) {
+        size = 1ULL << (enc - 0x1c + 12);
+    } else if (enc >= 1 && enc <= 0x14) {
+        size = 1ULL << (enc + 15);
+    } else {
+        offset = 0;
+    }
+
+    memory_region_transaction_begin();
+    memory_region_set_size(&s->pci.inbound, size);
+    memory_region_set_address(&s->pci.inbound, offset);
+    memory_region_transaction_commit();
+}
+
+static void bcm2838_pcie_update_window(BCM2838PCIEHostState *s, int n)
+{
+    BCM2838PCIEWindow *w = &s->windows[n];
+    uint64_t base_mb = extract32(w->base_limit, 4, 12)
+                       | (uint64_t)(w->base_hi & 0xff) << 12;
+    uint64_t limit_mb = extract32(w->base_limit, 20, 12)
+                        | (uint64_t)(w->limit_hi & 0xff) << 12;
+    bool enabled = (w->base_limit || w->base_hi || w->limit_hi)
+                   && limit_mb >= base_mb;
+
+    memory_region_transaction_begin();
+    memory_region_set_enabled(&w->mem, false);
+    if (enabled) {
+        memory_region_set_size(&w->mem, (limit_mb - base_mb + 1) * MiB);
+        memory_region_set_alias_offset(&w->mem,
+                                       deposit64(w->pcie_lo, 32, 32,
+                                                 w->pcie_hi));
+        memory_region_set_address(&w->mem, base_mb * MiB);
+        memory_region_set_enabled(&w->mem, true);
+    }
+    memory_region_transaction_commit();
+}
+
+static PCIDevice *bcm2838_pcie_ext_cfg_device(BCM2838PCIEHostState *s)
+{
+    PCIHostState *pci = PCI_HOST_BRIDGE(s);
+    uint8_t bus = BCM2838_PCIE_EXT_CFG_BUS(s->ext_cfg_index);
+
+    /* Bus 0 only holds the root port, which is accessed directly */
+    if (bus == 0) {
+        return NULL;
+    }
+
+    return pci_find_device(pci->bus, bus,
+                           BCM2838_PCIE_EXT_CFG_DEVFN(s->ext_cfg_index));
+}
+
+static uint64_t bcm2838_pcie_mmio_read(void *opaque, hwaddr addr,
+                                       unsigned int size)
+{
+    BCM2838PCIEHostState *s = BCM2838_PCIE_HOST(opaque);
+    PCIDevice *device;
+    int n;
+
+    if (addr < BCM2838_PCIE_RC_CFG_SIZE) {
+        device = PCI_DEVICE(&s->root);
+        return pci_host_config_read_common(device, addr,
+                                           pci_config_size(device), size);
+    }
+
+    if (addr >= BCM2838_PCIE_EXT_CFG_DATA &&
+        addr < BCM2838_PCIE_EXT_CFG_DATA + PCIE_CONFIG_SPACE_SIZE) {
+        device = bcm2838_pcie_ext_cfg_device(s);
+        if (!device) {
+            return MAKE_64BIT_MASK(0, size * 8);
+        }
+        return pci_host_config_read_common(device,
+                                           addr - BCM2838_PCIE_EXT_CFG_DATA,
+                                           pci_config_size(device), size);
+    }
+
+    for (n = 0; n < BCM2838_PCIE_NUM_WINDOWS; n++) {
+        if (addr == BCM2838_PCIE_MISC_MEM_WIN_LO(n)) {
+            return s->windows[n].pcie_lo;
+        } else if (addr == BCM2838_PCIE_MISC_MEM_WIN_HI(n)) {
+            return s->windows[n].pcie_hi;
+        } else if (addr == BCM2838_PCIE_MISC_MEM_WIN_BASE_LIMIT(n)) {
+            return s->windows[n].base_limit;
+        } else if (addr == BCM2838_PCIE_MISC_MEM_WIN_BASE_HI(n)) {
+            return s->windows[n].base_hi;
+        } else if (addr == BCM2838_PCIE_MISC_MEM_WIN_LIMIT_HI(n)) {
+            return s->windows[n].limit_hi;
+        }
+    }
+
+    switch (addr) {
+    case BCM2838_PCIE_RC_DL_MDIO_ADDR:
+    case BCM2838_PCIE_RC_DL_MDIO_WR_DATA:
+        return 0;
+    case BCM2838_PCIE_RC_DL_MDIO_RD_DATA:
+        /* SerDes PHY accesses complete immediately */
+        return BCM2838_PCIE_MDIO_DATA_DONE;
+    case BCM2838_PCIE_MISC_MISC_CTRL:
+        return s->misc_ctrl;
+    case BCM2838_PCIE_MISC_RC_BAR2_CONFIG_LO:
+        return s->rc_bar2_lo;
+    case BCM2838_PCIE_MISC_RC_BAR2_CONFIG_HI:
+        return s->rc_bar2_hi;
+    case BCM2838_PCIE_MISC_MSI_BAR_CONFIG_LO:
+        return s->msi_bar_lo;
+    case BCM2838_PCIE_MISC_MSI_BAR_CONFIG_HI:
+        return s->msi_bar_hi;
+    case BCM2838_PCIE_MISC_MSI_DATA_CONFIG:
+        return s->msi_data_config;
+    case BCM2838_PCIE_MISC_EOI_CTRL:
+        return 0;
+    case BCM2838_PCIE_MISC_PCIE_STATUS:
+        /* The link is always up, in root complex mode */
+        return BCM2838_PCIE_STATUS_PORT_RC | BCM2838_PCIE_STATUS_DL_ACTIVE
+               | BCM2838_PCIE_STATUS_PHYLINKUP;
+    case BCM2838_PCIE_MISC_REVISION:
+        return BCM2838_PCIE_REVISION;
+    case BCM2838_PCIE_MISC_HARD_PCIE_HARD_DEBUG:
+        return s->hard_debug;
+    case BCM2838_PCIE_MSI_INTR2_BASE + BCM2838_PCIE_INTR2_STATUS:
+        return s->msi_status;
+    case BCM2838_PCIE_MSI_INTR2_BASE + BCM2838_PCIE_INTR2_MASK_STATUS:
+        return s->msi_mask;
+    case BCM2838_PCIE_MSI_INTR2_BASE + BCM2838_PCIE_INTR2_SET:
+    case BCM2838_PCIE_MSI_INTR2_BASE + BCM2838_PCIE_INTR2_CLR:
+    case BCM2838_PCIE_MSI_INTR2_BASE + BCM2838_PCIE_INTR2_MASK_SET:
+    case BCM2838_PCIE_MSI_INTR2_BASE + BCM2838_PCIE_INTR2_MASK_CLR:
+        return 0;
+    case BCM2838_PCIE_EXT_CFG_INDEX:
+        return s->ext_cfg_index;
+    case BCM2838_PCIE_RGR1_SW_INIT_1:
+        return s->sw_init;
+    default:
+        qemu_log_mask(LOG_UNIMP, "%s: unimplemented register 0x%"
+                      HWADDR_PRIx "\n", __func__, addr);
+        return 0;
+    }
+}
+
+static void bcm2838_pcie_mmio_write(void *opaque, hwaddr addr,
+                                    uint64_t val, unsigned int size)
+{
+    BCM2838PCIEHostState *s = BCM2838_PCIE_HOST(opaque);
+    PCIDevice *device;
+    int n;
+
+    if (addr < BCM2838_PCIE_RC_CFG_SIZE) {
+        device = PCI_DEVICE(&s->root);
+        pci_host_config_write_common(device, addr, pci_config_size(device),
+                                     val, size);
+        return;
+    }
+
+    if (addr >= BCM2838_PCIE_EXT_CFG_DATA &&
+        addr < BCM2838_PCIE_EXT_CFG_DATA + PCIE_CONFIG_SPACE_SIZE) {
+        device = bcm2838_pcie_ext_cfg_device(s);
+        if (device) {
+            pci_host_config_write_common(device,
+                                         addr - BCM2838_PCIE_EXT_CFG_DATA,
+                                         pci_config_size(device), val, size);
+        }
+        return;
+    }
+
+    for (n = 0; n < BCM2838_PCIE_NUM_WINDOWS; n++) {
+        if (addr == BCM2838_PCIE_MISC_MEM_WIN_LO(n)) {
+            s->windows[n].pcie_lo = val;
+        } else if (addr == BCM2838_PCIE_MISC_MEM_WIN_HI(n)) {
+            s->windows[n].pcie_hi = val;
+        } else if (addr == BCM2838_PCIE_MISC_MEM_WIN_BASE_LIMIT(n)) {
+            s->windows[n].base_limit = val;
+        } else if (addr == BCM2838_PCIE_MISC_MEM_WIN_BASE_HI(n)) {
+            s->windows[n].base_hi = val;
+        } else if (addr == BCM2838_PCIE_MISC_MEM_WIN_LIMIT_HI(n)) {
+            s->windows[n].limit_hi = val;
+        } else {
+            continue;
+        }
+        bcm2838_pcie_update_window(s, n);
+        return;
+    }
+
+    switch (addr) {
+    case BCM2838_PCIE_RC_DL_MDIO_ADDR:
+    case BCM2838_PCIE_RC_DL_MDIO_WR_DATA:
+    case BCM2838_PCIE_RC_DL_MDIO_RD_DATA:
+    case BCM2838_PCIE_MISC_EOI_CTRL:
+        break;
+    case BCM2838_PCIE_MISC_MISC_CTRL:
+        s->misc_ctrl = val;
+        break;
+    case BCM2838_PCIE_MISC_RC_BAR2_CONFIG_LO:
+        s->rc_bar2_lo = val;
+        bcm2838_pcie_update_inbound(s);
+        break;
+    case BCM2838_PCIE_MISC_RC_BAR2_CONFIG_HI:
+        s->rc_bar2_hi = val;
+        bcm2838_pcie_update_inbound(s);
+        break;
+    case BCM2838_PCIE_MISC_MSI_BAR_CONFIG_LO:
+        s->msi_bar_lo = val;
+        bcm2838_pcie_update_msi_mapping(s);
+        break;
+    case BCM2838_PCIE_MISC_MSI_BAR_CONFIG_HI:
+        s->msi_bar_hi = val;
+        bcm2838_pcie_update_msi_mapping(s);
+        break;
+    case BCM2838_PCIE_MISC_MSI_DATA_CONFIG:
+        s->msi_data_config = val;
+        break;
+    case BCM2838_PCIE_MISC_PCIE_STATUS:
+    case BCM2838_PCIE_MISC_REVISION:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: write to read-only register 0x%"
+                      HWADDR_PRIx "\n", __func__, addr);
+        break;
+    case BCM2838_PCIE_MISC_HARD_PCIE_HARD_DEBUG:
+        s->hard_debug = val;
+        break;
+    case BCM2838_PCIE_MSI_INTR2_BASE + BCM2838_PCIE_INTR2_STATUS:
+    case BCM2838_PCIE_MSI_INTR2_BASE + BCM2838_PCIE_INTR2_MASK_STATUS:
+        break;
+    case BCM2838_PCIE_MSI_INTR2_BASE + BCM2838_PCIE_INTR2_SET:
+        s->msi_status |= val;
+        bcm2838_pcie_update_msi_irq(s);
+        break;
+    case BCM2838_PCIE_MSI_INTR2_BASE + BCM2838_PCIE_INTR2_CLR:
+        s->msi_status &= ~val;
+        bcm2838_pcie_update_msi_irq(s);
+        break;
+    case BCM2838_PCIE_MSI_INTR2_BASE + BCM2838_PCIE_INTR2_MASK_SET:
+        s->msi_mask |= val;
+        bcm2838_pcie_update_msi_irq(s);
+        break;
+    case BCM2838_PCIE_MSI_INTR2_BASE + BCM2838_PCIE_INTR2_MASK_CLR:
+        s->msi_mask &= ~val;
+        bcm2838_pcie_update_msi_irq(s);
+        break;
+    case BCM2838_PCIE_EXT_CFG_INDEX:
+        s->ext_cfg_index = val;
+        break;
+    case BCM2838_PCIE_RGR1_SW_INIT_1:
+        s->sw_init = val;
+        break;
+    default:
+        qemu_log_mask(LOG_UNIMP, "%s: unimplemented register 0x%"
+                      HWADDR_PRIx "\n", __func__, addr);
+        break;
+    }
+}
+
+static const MemoryRegionOps bcm2838_pcie_mmio_ops = {
+    .read = bcm2838_pcie_mmio_read,
+    .write = bcm2838_pcie_mmio_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid = {
+        .min_access_size = 1,
+        .max_access_size = 4,
+    },
+    .impl = {
+        .min_access_size = 1,
+        .max_access_size = 4,
+        .unaligned = false,
+    },
+};
+
+static void bcm2838_pcie_root_realize(PCIDevice *dev, Error **errp)
+{
+    PCIBridge *br = PCI_BRIDGE(dev);
+    Error *err = NULL;
+
+    br->bus_name = "pcie.1";
+
+    pci_set_word(dev->config + PCI_COMMAND,
+                 PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER);
+
+    pci_config_set_interrupt_pin(dev->config, 1);
+    pci_bridge_initfn(dev, TYPE_PCIE_BUS);
+
+    pcie_port_init_reg(dev);
+
+    /* Linux reads the link capabilities at this fixed offset */
+    pcie_cap_init(dev, BCM2838_PCIE_CAP_REGS, PCI_EXP_TYPE_ROOT_PORT, 0,
+                  &err);
+    if (err) {
+        error_propagate(errp, err);
+        pci_bridge_exitfn(dev);
+    }
+}
+
+static const VMStateDescription vmstate_bcm2838_pcie_root = {
+    .name = TYPE_BCM2838_PCIE_ROOT,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_PCI_DEVICE(parent_obj, PCIBridge),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void bcm2838_pcie_root_class_init(ObjectClass *klass, void *data)
+{
+    PCIDeviceClass *k = PCI_DEVICE_CLASS(klass);
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    set_bit(DEVICE_CATEGORY_BRIDGE, dc->categories);
+
+    k->vendor_id = PCI_VENDOR_ID_BROADCOM;
+    k->device_id = PCI_DEVICE_ID_BROADCOM_BCM2711;
+    k->revision = 0x10;
+    k->class_id = PCI_CLASS_BRIDGE_PCI;
+    k->is_bridge = true;
+    k->exit = pci_bridge_exitfn;
+    k->realize = bcm2838_pcie_root_realize;
+    k->config_write = pci_bridge_write_config;
+
+    dc->reset = pci_bridge_reset;
+    /* Only usable as part of the host bridge */
+    dc->user_creatable = false;
+    dc->vmsd = &vmstate_bcm2838_pcie_root;
+}
+
+static void bcm2838_pcie_set_irq(void *opaque, int irq_num, int level)
+{
+    BCM2838PCIEHostState *s = BCM2838_PCIE_HOST(opaque);
+
+    qemu_set_irq(s->pci.irqs[irq_num], level);
+}
+
+static const char *
+bcm2838_pcie_host_root_bus_path(PCIHostState *host_bridge, PCIBus *rootbus)
+{
+    return "0000:00";
+}
+
+static AddressSpace *bcm2838_pcie_host_set_iommu(PCIBus *bus, void *opaque,
+                                                 int devfn)
+{
+    BCM2838PCIEHostState *s = BCM2838_PCIE_HOST(opaque);
+
+    return &s->pci.address_space;
+}
+
+static void bcm2838_pcie_host_update_mappings(BCM2838PCIEHostState *s)
+{
+    int n;
+
+    for (n = 0; n < BCM2838_PCIE_NUM_WINDOWS; n++) {
+        bcm2838_pcie_update_window(s, n);
+    }
+    bcm2838_pcie_update_inbound(s);
+    bcm2838_pcie_update_msi_mapping(s);
+}
+
+static void bcm2838_pcie_host_reset(DeviceState *dev)
+{
+    BCM2838PCIEHostState *s = BCM2838_PCIE_HOST(dev);
+
+    memset(s->windows, 0, sizeof(s->windows[0]) * BCM2838_PCIE_NUM_WINDOWS);
+    s->ext_cfg_index = 0;
+    s->misc_ctrl = 0;
+    s->rc_bar2_lo = 0;
+    s->rc_bar2_hi = 0;
+    s->msi_bar_lo = 0;
+    s->msi_bar_hi = 0;
+    s->msi_data_config = 0;
+    s->msi_status = 0;
+    s->msi_mask = UINT32_MAX;
+    s->hard_debug = 0;
+    s->sw_init = 0;
+
+    bcm2838_pcie_host_update_mappings(s);
+    bcm2838_pcie_update_msi_irq(s);
+}
+
+static void bcm2838_pcie_host_realize(DeviceState *dev, Error **errp)
+{
+    PCIHostState *pci = PCI_HOST_BRIDGE(dev);
+    BCM2838PCIEHostState *s = BCM2838_PCIE_HOST(dev);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(dev);
+    char *name;
+    int n;
+
+    for (n = 0; n < BCM2838_PCIE_NUM_IRQS; n++) {
+        sysbus_init_irq(sbd, &s->pci.irqs[n]);
+    }
+    sysbus_init_irq(sbd, &s->msi_irq);
+
+    memory_region_init_io(&s->mmio, OBJECT(s), &bcm2838_pcie_mmio_ops, s,
+                          "bcm2838-pcie-regs", BCM2838_PCIE_MMIO_SIZE);
+    sysbus_init_mmio(sbd, &s->mmio);
+
+    memory_region_init(&s->pci.io, OBJECT(s), "bcm2838-pcie-pio", 16);
+    memory_region_init(&s->pci.memory, OBJECT(s), "bcm2838-pcie-memory",
+                       UINT64_MAX);
+
+    pci->bus = pci_register_root_bus(dev, "pcie",
+                                     bcm2838_pcie_set_irq,
+                                     pci_swizzle_map_irq_fn,
+                                     s,
+                                     &s->pci.memory,
+                                     &s->pci.io,
+                                     0, BCM2838_PCIE_NUM_IRQS,
+                                     TYPE_PCIE_BUS);
+
+    /* Bus master accesses: peer-to-peer first, then RC_BAR2 to RAM */
+    memory_region_init(&s->pci.address_space_root, OBJECT(s),
+                       "bcm2838-pcie-bus-address-space-root", UINT64_MAX);
+    memory_region_add_subregion(&s->pci.address_space_root,
+                                0x0, &s->pci.memory);
+    memory_region_init_alias(&s->pci.inbound, OBJECT(s),
+                             "bcm2838-pcie-inbound", get_system_memory(),
+                             0, UINT64_MAX);
+    memory_region_add_subregion_overlap(&s->pci.address_space_root, 0x0,
+                                        &s->pci.inbound, -1);
+    memory_region_init_io(&s->pci.msi, OBJECT(s), &bcm2838_pcie_msi_ops, s,
+                          "bcm2838-pcie-msi", 0x4);
+    memory_region_add_subregion_overlap(&s->pci.address_space_root, 0x0,
+                                        &s->pci.msi, 1);
+    memory_region_set_enabled(&s->pci.msi, false);
+    address_space_init(&s->pci.address_space, &s->pci.address_space_root,
+                       "bcm2838-pcie-bus-address-space");
+    pci_setup_iommu(pci->bus, bcm2838_pcie_host_set_iommu, s);
+
+    /* CPU -> PCI windows, placed and enabled by the guest */
+    for (n = 0; n < BCM2838_PCIE_NUM_WINDOWS; n++) {
+        name = g_strdup_printf("bcm2838-pcie-win%d", n);
+        memory_region_init_alias(&s->windows[n].mem, OBJECT(s), name,
+                                 &s->pci.memory, 0, 4);
+        memory_region_add_subregion(get_system_memory(), 0,
+                                    &s->windows[n].mem);
+        memory_region_set_enabled(&s->windows[n].mem, false);
+        g_free(name);
+    }
+
+    qdev_set_parent_bus(DEVICE(&s->root), BUS(pci->bus));
+    qdev_init_nofail(DEVICE(&s->root));
+}
+
+static int bcm2838_pcie_host_post_load(void *opaque, int version_id)
+{
+    BCM2838PCIEHostState *s = BCM2838_PCIE_HOST(opaque);
+
+    bcm2838_pcie_host_update_mappings(s);
+    return 0;
+}
+
+static const VMStateDescription vmstate_bcm2838_pcie_window = {
+    .name = "bcm2838-pcie-window",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(pcie_lo, BCM2838PCIEWindow),
+        VMSTATE_UINT32(pcie_hi, BCM2838PCIEWindow),
+        VMSTATE_UINT32(base_limit, BCM2838PCIEWindow),
+        VMSTATE_UINT32(base_hi, BCM2838PCIEWindow),
+        VMSTATE_UINT32(limit_hi, BCM2838PCIEWindow),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_bcm2838_pcie_host = {
+    .name = TYPE_BCM2838_PCIE_HOST,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = bcm2838_pcie_host_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_STRUCT_ARRAY(windows, BCM2838PCIEHostState,
+                             BCM2838_PCIE_NUM_WINDOWS, 1,
+                             vmstate_bcm2838_pcie_window, BCM2838PCIEWindow),
+        VMSTATE_UINT32(ext_cfg_index, BCM2838PCIEHostState),
+        VMSTATE_UINT32(misc_ctrl, BCM2838PCIEHostState),
+        VMSTATE_UINT32(rc_bar2_lo, BCM2838PCIEHostState),
+        VMSTATE_UINT32(rc_bar2_hi, BCM2838PCIEHostState),
+        VMSTATE_UINT32(msi_bar_lo, BCM2838PCIEHostState),
+        VMSTATE_UINT32(msi_bar_hi, BCM2838PCIEHostState),
+        VMSTATE_UINT32(msi_data_config, BCM2838PCIEHostState),
+        VMSTATE_UINT32(msi_status, BCM2838PCIEHostState),
+        VMSTATE_UINT32(msi_mask, BCM2838PCIEHostState),
+        VMSTATE_UINT32(hard_debug, BCM2838PCIEHostState),
+        VMSTATE_UINT32(sw_init, BCM2838PCIEHostState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void bcm2838_pcie_host_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+    PCIHostBridgeClass *hc = PCI_HOST_BRIDGE_CLASS(klass);
+
+    hc->root_bus_path = bcm2838_pcie_host_root_bus_path;
+    dc->realize = bcm2838_pcie_host_realize;
+    dc->reset = bcm2838_pcie_host_reset;
+    set_bit(DEVICE_CATEGORY_BRIDGE, dc->categories);
+    dc->fw_name = "pci";
+    dc->vmsd = &vmstate_bcm2838_pcie_host;
+}
+
+static void bcm2838_pcie_host_init(Object *obj)
+{
+    BCM2838PCIEHostState *s = BCM2838_PCIE_HOST(obj);
+    BCM2838PCIERootState *root = &s->root;
+
+    object_initialize_child(obj, "root", root, sizeof(*root),
+                            TYPE_BCM2838_PCIE_ROOT, &error_abort, NULL);
+    qdev_prop_set_int32(DEVICE(root), "addr", PCI_DEVFN(0, 0));
+    qdev_prop_set_bit(DEVICE(root), "multifunction", false);
+}
+
+static const TypeInfo bcm2838_pcie_root_info = {
+    .name = TYPE_BCM2838_PCIE_ROOT,
+    .parent = TYPE_PCI_BRIDGE,
+    .instance_size = sizeof(BCM2838PCIERootState),
+    .class_init = bcm2838_pcie_root_class_init,
+    .interfaces = (InterfaceInfo[]) {
+        { INTERFACE_PCIE_DEVICE },
+        { }
+    },
+};
+
+static const TypeInfo bcm2838_pcie_host_info = {
+    .name       = TYPE_BCM2838_PCIE_HOST,
+    .parent     = TYPE_PCI_HOST_BRIDGE,
+    .instance_size = sizeof(BCM2838PCIEHostState),
+    .instance_init = bcm2838_pcie_host_init,
+    .class_init = bcm2838_pcie_host_class_init,
+};
+
+static void bcm2838_pcie_register(void)
+{
+    type_register_static(&bcm2838_pcie_root_info);
+    type_register_static(&bcm2838_pcie_host_info);
+}
+type_init(bcm2838_pcie_register)
@@ -37,7 +37,7 @@
 #define SDEDM  0x34 /* Emergency Debug Mode            - 13 R/W */
 #define SDHCFG 0x38 /* Host configuration              -  2 R/W */
 #define SDHBCT 0x3c /* Host byte count (debug)         - 32 R/W */
-#define SDDATA 0x40 /* Data to/from SD card            - 32 R/W */
+#define SDDATA BCM2835_SDHOST_DATA_OFFSET /* Data to/from SD card - 32 R/W */
 #define SDHBLC 0x50 /* Host block count (SDIO/SDHC)    -  9 R/W */
 
 #define SDCMD_NEW_FLAG                  0x8000
@@ -107,6 +107,20 @@ static void bcm2835_sdhost_update_irq(BCM2835SDHostState *s)
     qemu_set_irq(s->irq, !!irq);
 }
 
+/* DREQ asks for data while the FIFO has some to read or room to write */
+static void bcm2835_sdhost_update_dreq(BCM2835SDHostState *s)
+{
+    bool level = false;
+
+    if (s->cmd & SDCMD_READ_CMD) {
+        level = s->fifo_len > 0;
+    } else if (s->cmd & SDCMD_WRITE_CMD) {
+        level = s->fifo_len < BCM2835_SDHOST_FIFO_LEN &&
+                s->datacnt > s->fifo_len * 4;
+    }
+    qemu_set_irq(s->dreq, level);
+}
+
 static void bcm2835_sdhost_send_command(BCM2835SDHostState *s)
 {
     SDRequest request;
@@ -179,7 +193,8 @@ static uint32_t bcm2835_sdhost_fifo_pop(BCM2835SDHostState *s)
 
 static void bcm2835_sdhost_fifo_run(BCM2835SDHostState *s)
 {
-    uint32_t value = 0;
+    uint8_t buf[BCM2835_SDHOST_FIFO_LEN * 4];
+    uint32_t len;
     int n;
     int is_read;
     int is_write;
@@ -187,44 +202,37 @@ static void bcm2835_sdhost_fifo_run(BCM2835SDHostState *s)
     is_read = (s->cmd & SDCMD_READ_CMD) != 0;
     is_write = (s->cmd & SDCMD_WRITE_CMD) != 0;
     if (s->datacnt != 0 && (is_write || sdbus_data_ready(&s->sdbus))) {
-        if (is_read) {
-            n = 0;
-            while (s->datacnt && s->fifo_len < BCM2835_SDHOST_FIFO_LEN) {
-                value |= (uint32_t)sdbus_read_data(&s->sdbus) << (n * 8);
-                s->datacnt--;
-                n++;
-                if (n == 4) {
-                    bcm2835_sdhost_fifo_push(s, value);
-                    s->status |= SDHSTS_DATA_FLAG;
-                    if (s->config & SDHCFG_DATA_IRPT_EN) {
-                        s->status |= SDHSTS_SDIO_IRPT;
-                    }
-                    n = 0;
-                    value = 0;
+        if (is_read && !(sdbus_get_dat_lines(&s->sdbus) & 1)) {
+            /* Card still fetching the block; resumed from busy_end() */
+        } else if (is_read) {
+            /* Fill all free FIFO words from the card in one go */
+            len = MIN(s->datacnt,
+                      (BCM2835_SDHOST_FIFO_LEN - s->fifo_len) * 4);
+            if (len) {
+                memset(buf, 0, sizeof(buf));
+                sdbus_read_block(&s->sdbus, buf, len);
+                s->datacnt -= len;
+                for (n = 0; n < len; n += 4) {
+                    bcm2835_sdhost_fifo_push(s, ldl_le_p(&buf[n]));
                 }
-            }
-            if (n != 0) {
-                bcm2835_sdhost_fifo_push(s, value);
                 s->status |= SDHSTS_DATA_FLAG;
                 if (s->config & SDHCFG_DATA_IRPT_EN) {
                     s->status |= SDHSTS_SDIO_IRPT;
                 }
             }
         } else if (is_write) { /* write */
-            n = 0;
-            while (s->datacnt > 0 && (s->fifo_len > 0 || n > 0)) {
-                if (n == 0) {
-                    value = bcm2835_sdhost_fifo_pop(s);
-                    s->status |= SDHSTS_DATA_FLAG;
-                    if (s->config & SDHCFG_DATA_IRPT_EN) {
-                        s->status |= SDHSTS_SDIO_IRPT;
-                    }
-                    n = 4;
+            /* Drain as many FIFO words as the transfer still needs */
+            len = MIN(s->datacnt, s->fifo_len * 4);
+            if (len) {
+                for (n = 0; n < len; n += 4) {
+                    stl_le_p(&buf[n], bcm2835_sdhost_fifo_pop(s));
                 }
-                n--;
-                s->datacnt--;
-                sdbus_write_data(&s->sdbus, value & 0xff);
-                value >>= 8;
+                s->status |= SDHSTS_DATA_FLAG;
+                if (s->config & SDHCFG_DATA_IRPT_EN) {
+                    s->status |= SDHSTS_SDIO_IRPT;
+                }
+                s->datacnt -= len;
+                sdbus_write_block(&s->sdbus, buf, len);
             }
         }
         if (s->datacnt == 0) {
@@ -247,12 +255,94 @@ static void bcm2835_sdhost_fifo_run(BCM2835SDHostState *s)
     }
 
     bcm2835_sdhost_update_irq(s);
+    bcm2835_sdhost_update_dreq(s);
 
     s->edm &= ~(0x1f << 4);
     s->edm |= ((s->fifo_len & 0x1f) << 4);
     trace_bcm2835_sdhost_edm_change("fifo run", s->edm);
 }
 
+/* Bytes of the data phase left before the end of the current block */
+static uint32_t bcm2835_sdhost_block_left(BCM2835SDHostState *s)
+{
+    if (!s->hbct) {
+        return s->datacnt;
+    }
+    return s->datacnt % s->hbct ? s->datacnt % s->hbct
+                                : MIN(s->datacnt, s->hbct);
+}
+
+/*
+ * DMA burst through the FIFO, registered with bcm2835_dma_set_fifo().
+ * Words already in the FIFO go first; once it is empty, the data moves
+ * between the card and guest memory directly, a block at most at a time,
+ * and with the same status updates as when it went through the FIFO.
+ */
+uint32_t bcm2835_sdhost_dma_fifo(void *opaque, uint8_t *buf, uint32_t len,
+                                 bool to_fifo)
+{
+    BCM2835SDHostState *s = opaque;
+    uint32_t n, done = 0;
+
+    if (!to_fifo && (s->cmd & SDCMD_READ_CMD)) {
+        while (done < len) {
+            if (s->fifo_len) {
+                stl_le_p(buf + done, bcm2835_sdhost_fifo_pop(s));
+                done += 4;
+                continue;
+            }
+            n = MIN(len - done, bcm2835_sdhost_block_left(s)) & ~3;
+            if (!n || !sdbus_data_ready(&s->sdbus) ||
+                !(sdbus_get_dat_lines(&s->sdbus) & 1)) {
+                break;
+            }
+            sdbus_read_block(&s->sdbus, buf + done, n);
+            s->datacnt -= n;
+            done += n;
+            s->status |= SDHSTS_DATA_FLAG;
+            if (s->config & SDHCFG_DATA_IRPT_EN) {
+                s->status |= SDHSTS_SDIO_IRPT;
+            }
+        }
+    } else if (to_fifo && (s->cmd & SDCMD_WRITE_CMD)) {
+        while (done < len) {
+            if (s->fifo_len) {
+                /* top up the words the guest queued, and send them on */
+                if (s->datacnt <= s->fifo_len * 4) {
+                    break;
+                }
+                bcm2835_sdhost_fifo_push(s, ldl_le_p(buf + done));
+                done += 4;
+                bcm2835_sdhost_fifo_run(s);
+                continue;
+            }
+            n = MIN(len - done, bcm2835_sdhost_block_left(s)) & ~3;
+            if (!n) {
+                break;
+            }
+            s->datacnt -= n;
+            done += n;
+            sdbus_write_block(&s->sdbus, buf + done - n, n);
+            if (s->hbct && s->datacnt % s->hbct == 0 &&
+                (s->config & SDHCFG_BLOCK_IRPT_EN)) {
+                s->status |= SDHSTS_BLOCK_IRPT;
+            }
+            s->status |= SDHSTS_DATA_FLAG;
+            if (s->config & SDHCFG_DATA_IRPT_EN) {
+                s->status |= SDHSTS_SDIO_IRPT;
+            }
+        }
+    }
+
+    if (done && s->datacnt == 0) {
+        s->edm &= ~SDEDM_FSM_MASK;
+        s->edm |= SDEDM_FSM_DATAMODE;
+        trace_bcm2835_sdhost_edm_change("datacnt 0", s->edm);
+    }
+    bcm2835_sdhost_fifo_run(s);
+    return done;
+}
+
 static uint64_t bcm2835_sdhost_read(void *opaque, hwaddr offset,
     unsigned size)
 {
@@ -408,6 +498,7 @@ static void bcm2835_sdhost_init(Object *obj)
                           TYPE_BCM2835_SDHOST, 0x1000);
     sysbus_init_mmio(SYS_BUS_DEVICE(s), &s->iomem);
     sysbus_init_irq(SYS_BUS_DEVICE(s), &s->irq);
+    qdev_init_gpio_out_named(DEVICE(s), &s->dreq, BCM2835_SDHOST_DREQ, 1);
 }
 
 static void bcm2835_sdhost_reset(DeviceState *dev)
@@ -442,10 +533,25 @@ static TypeInfo bcm2835_sdhost_info = {
     .instance_init = bcm2835_sdhost_init,
 };
 
+static void bcm2835_sdhost_busy_end(DeviceState *dev)
+{
+    BCM2835SDHostState *s = BCM2835_SDHOST(dev);
+
+    bcm2835_sdhost_fifo_run(s);
+}
+
+static void bcm2835_sdhost_bus_class_init(ObjectClass *klass, void *data)
+{
+    SDBusClass *sbc = SD_BUS_CLASS(klass);
+
+    sbc->busy_end = bcm2835_sdhost_busy_end;
+}
+
 static const TypeInfo bcm2835_sdhost_bus_info = {
     .name = TYPE_BCM2835_SDHOST_BUS,
     .parent = TYPE_SD_BUS,
     .instance_size = sizeof(SDBus),
+    .class_init = bcm2835_sdhost_bus_class_init,
 };
 
 static void bcm2835_sdhost_register_types(void)
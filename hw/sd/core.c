@@ -129,6 +129,46 @@ uint8_t sdbus_read_data(SDBus *sdbus)
     return value;
 }
 
+void sdbus_write_block(SDBus *sdbus, const uint8_t *buf, size_t length)
+{
+    SDState *card = get_card(sdbus);
+    size_t i;
+
+    trace_sdbus_write_block(sdbus_name(sdbus), length);
+    if (card) {
+        SDCardClass *sc = SD_CARD_GET_CLASS(card);
+
+        if (sc->write_block) {
+            sc->write_block(card, buf, length);
+            return;
+        }
+        for (i = 0; i < length; i++) {
+            sc->write_data(card, buf[i]);
+        }
+    }
+}
+
+void sdbus_read_block(SDBus *sdbus, uint8_t *buf, size_t length)
+{
+    SDState *card = get_card(sdbus);
+    size_t i;
+
+    trace_sdbus_read_block(sdbus_name(sdbus), length);
+    if (card) {
+        SDCardClass *sc = SD_CARD_GET_CLASS(card);
+
+        if (sc->read_block) {
+            sc->read_block(card, buf, length);
+            return;
+        }
+        for (i = 0; i < length; i++) {
+            buf[i] = sc->read_data(card);
+        }
+    } else {
+        memset(buf, 0, length);
+    }
+}
+
 bool sdbus_data_ready(SDBus *sdbus)
 {
     SDState *card = get_card(sdbus);
@@ -188,6 +228,17 @@ void sdbus_set_readonly(SDBus *sdbus, bool readonly)
     }
 }
 
+void sdbus_busy_end(SDBus *sdbus)
+{
+    SDBusClass *sbc = SD_BUS_GET_CLASS(sdbus);
+    BusState *qbus = BUS(sdbus);
+
+    trace_sdbus_busy_end(sdbus_name(sdbus));
+    if (sbc->busy_end) {
+        sbc->busy_end(qbus->parent);
+    }
+}
+
 void sdbus_reparent_card(SDBus *from, SDBus *to)
 {
     SDState *card = get_card(from);
@@ -120,6 +120,16 @@ struct SDState {
     uint64_t data_start;
     uint32_t data_offset;
     uint8_t data[512];
+    /* Asynchronous backend I/O; DAT0 is held low while a request runs */
+    BlockAIOCB *aiocb;
+    QEMUIOVector qiov;
+    bool aio_draining;
+    uint8_t *aio_buf;       /* write-behind window being flushed */
+    /* Readahead (CMD17/18) or write-behind (CMD24/25) window */
+    uint8_t *win_buf;
+    uint64_t win_start;
+    uint32_t win_len;
+    bool win_write;
     qemu_irq readonly_cb;
     qemu_irq inserted_cb;
     QEMUTimer *ocr_power_timer;
@@ -172,7 +182,10 @@ static const char *sd_response_name(sd_rsp_type_t rsp)
 
 static uint8_t sd_get_dat_lines(SDState *sd)
 {
-    return sd->enable ? sd->dat_lines : 0;
+    if (!sd->enable) {
+        return 0;
+    }
+    return sd->aiocb ? sd->dat_lines & ~1 : sd->dat_lines;
 }
 
 static bool sd_get_cmd_line(SDState *sd)
@@ -530,6 +543,177 @@ static void sd_response_r7_make(SDState *sd, uint8_t *response)
     stl_be_p(response, sd->vhs);
 }
 
+/* Readahead / write-behind window for multiple block transfers */
+#define SD_WINDOW_SIZE          (64 * KiB)
+
+/* Wait for the backend request in flight, if any, to complete */
+static void sd_aio_wait(SDState *sd)
+{
+    if (sd->aiocb) {
+        sd->aio_draining = true;
+        blk_drain(sd->blk);
+        sd->aio_draining = false;
+        assert(!sd->aiocb);
+    }
+}
+
+static void sd_aio_complete(SDState *sd)
+{
+    BusState *bus = qdev_get_parent_bus(DEVICE(sd));
+
+    sd->aiocb = NULL;
+    /* Nobody needs telling when we are waiting for it ourselves */
+    if (bus && !sd->aio_draining) {
+        sdbus_busy_end(SD_BUS(bus));
+    }
+}
+
+static void sd_blk_read_cb(void *opaque, int ret)
+{
+    SDState *sd = opaque;
+
+    if (ret < 0) {
+        fprintf(stderr, "sd_blk_read: read error on host side\n");
+        sd->win_len = 0;
+    }
+    sd_aio_complete(sd);
+}
+
+/*
+ * Start reading up to @nblocks blocks from @addr (0: as many as fit) into
+ * the window, ahead of the host draining them one by one.
+ */
+static void sd_blk_readahead(SDState *sd, uint64_t addr, uint32_t io_len,
+                             uint32_t nblocks)
+{
+    uint64_t len;
+
+    assert(!sd->aiocb);
+    sd->win_write = false;
+    sd->win_len = 0;
+    if (!sd->blk || addr + io_len > sd->size) {
+        return;
+    }
+
+    if (nblocks == 0 || nblocks > SD_WINDOW_SIZE / io_len) {
+        nblocks = SD_WINDOW_SIZE / io_len;
+    }
+    len = MIN((uint64_t)nblocks * io_len,
+              QEMU_ALIGN_DOWN(sd->size - addr, io_len));
+
+    trace_sdcard_read_block(addr, len);
+    sd->win_start = addr;
+    sd->win_len = len;
+    qemu_iovec_init_buf(&sd->qiov, sd->win_buf, len);
+    sd->aiocb = blk_aio_preadv(sd->blk, addr, &sd->qiov, 0,
+                               sd_blk_read_cb, sd);
+}
+
+static void sd_blk_read(SDState *sd, uint64_t addr, uint32_t len)
+{
+    uint64_t win_end;
+
+    sd_aio_wait(sd);
+    win_end = sd->win_start + sd->win_len;
+    if (!sd->win_write && addr >= sd->win_start && addr + len <= win_end) {
+        memcpy(sd->data, sd->win_buf + (addr - sd->win_start), len);
+        /* Window drained: fetch the next one while this block goes out */
+        if (addr + len == win_end && sd->current_cmd == 18 &&
+            sd->multi_blk_cnt != 1) {
+            sd_blk_readahead(sd, win_end, len,
+                             sd->multi_blk_cnt ? sd->multi_blk_cnt - 1 : 0);
+        }
+        return;
+    }
+
+    trace_sdcard_read_block(addr, len);
+    if (!sd->blk || blk_pread(sd->blk, addr, sd->data, len) < 0) {
+        fprintf(stderr, "sd_blk_read: read error on host side\n");
+    }
+}
+
+static void sd_blk_write_cb(void *opaque, int ret)
+{
+    SDState *sd = opaque;
+
+    if (ret < 0) {
+        fprintf(stderr, "sd_blk_write: write error on host side\n");
+    }
+    /* Bzzzzzzztt .... Operation complete.  */
+    if (sd->state == sd_programming_state) {
+        sd->state = sd_transfer_state;
+    }
+    sd_aio_complete(sd);
+}
+
+/* Write the gathered write-behind window out to the backend */
+static void sd_blk_flush(SDState *sd)
+{
+    uint8_t *buf;
+
+    if (!sd->win_write || !sd->win_len) {
+        return;
+    }
+    sd_aio_wait(sd);
+
+    trace_sdcard_write_block(sd->win_start, sd->win_len);
+    /* Gather the next blocks into the other buffer meanwhile */
+    buf = sd->aio_buf;
+    sd->aio_buf = sd->win_buf;
+    sd->win_buf = buf;
+    qemu_iovec_init_buf(&sd->qiov, sd->aio_buf, sd->win_len);
+    sd->aiocb = blk_aio_pwritev(sd->blk, sd->win_start, &sd->qiov, 0,
+                                sd_blk_write_cb, sd);
+    sd->win_start += sd->win_len;
+    sd->win_len = 0;
+}
+
+/*
+ * Add data[] to the write-behind window.  The window goes out when it is
+ * full, at the end of the transfer, or before any other command.
+ */
+static void sd_blk_write(SDState *sd, uint64_t addr, uint32_t len)
+{
+    if (!sd->blk) {
+        fprintf(stderr, "sd_blk_write: write error on host side\n");
+        return;
+    }
+
+    if (!sd->win_write || addr != sd->win_start + sd->win_len ||
+        sd->win_len + len > SD_WINDOW_SIZE) {
+        sd_blk_flush(sd);
+        if (!sd->win_write) {
+            /* Don't gather over a readahead still in flight */
+            sd_aio_wait(sd);
+        }
+        sd->win_write = true;
+        sd->win_start = addr;
+        sd->win_len = 0;
+    }
+
+    memcpy(sd->win_buf + sd->win_len, sd->data, len);
+    sd->win_len += len;
+
+    if (sd->current_cmd == 24 || sd->multi_blk_cnt == 1 ||
+        sd->win_len + len > SD_WINDOW_SIZE) {
+        sd_blk_flush(sd);
+    }
+}
+
+/* Settle the window before a command that may depend on the backend */
+static void sd_blk_sync(SDState *sd)
+{
+    sd_blk_flush(sd);
+    sd_aio_wait(sd);
+    sd->win_write = false;
+    sd->win_len = 0;
+}
+
+static uint32_t sd_io_len(SDState *sd)
+{
+    return (sd->ocr & (1 << 30)) ? 512 : sd->blk_len;
+}
+
 static inline uint64_t sd_addr_to_wpnum(uint64_t addr)
 {
     return addr >> (HWBLOCK_SHIFT + SECTOR_SHIFT + WPGROUP_SHIFT);
@@ -542,6 +726,7 @@ static void sd_reset(DeviceState *dev)
     uint64_t sect;
 
     trace_sdcard_reset();
+    sd_blk_sync(sd);
     if (sd->blk) {
         blk_get_geometry(sd->blk, &sect);
     } else {
@@ -654,11 +839,24 @@ static int sd_vmstate_pre_load(void *opaque)
     return 0;
 }
 
+static int sd_vmstate_pre_save(void *opaque)
+{
+    SDState *sd = opaque;
+
+    /* Write back and finish any backend request, so that it lands in the
+     * card state; the window itself is not migrated.
+     */
+    sd_blk_sync(sd);
+
+    return 0;
+}
+
 static const VMStateDescription sd_vmstate = {
     .name = "sd-card",
     .version_id = 1,
     .minimum_version_id = 1,
     .pre_load = sd_vmstate_pre_load,
+    .pre_save = sd_vmstate_pre_save,
     .fields = (VMStateField[]) {
         VMSTATE_UINT32(mode, SDState),
         VMSTATE_INT32(state, SDState),
@@ -1090,9 +1288,9 @@ static sd_rsp_type_t sd_normal_command(SDState *sd, SDRequest req)
             return sd_r1b;
 
         case sd_receivingdata_state:
-            sd->state = sd_programming_state;
-            /* Bzzzzzzztt .... Operation complete.  */
-            sd->state = sd_transfer_state;
+            /* Busy until the write-behind window has been written */
+            sd_blk_flush(sd);
+            sd->state = sd->aiocb ? sd_programming_state : sd_transfer_state;
             return sd_r1b;
 
         default:
@@ -1154,8 +1352,11 @@ static sd_rsp_type_t sd_normal_command(SDState *sd, SDRequest req)
             sd->data_start = addr;
             sd->data_offset = 0;
 
-            if (sd->data_start + sd->blk_len > sd->size)
+            if (sd->data_start + sd->blk_len > sd->size) {
                 sd->card_status |= ADDRESS_ERROR;
+            } else {
+                sd_blk_readahead(sd, sd->data_start, sd_io_len(sd), 1);
+            }
             return sd_r1;
 
         default:
@@ -1170,8 +1371,12 @@ static sd_rsp_type_t sd_normal_command(SDState *sd, SDRequest req)
             sd->data_start = addr;
             sd->data_offset = 0;
 
-            if (sd->data_start + sd->blk_len > sd->size)
+            if (sd->data_start + sd->blk_len > sd->size) {
                 sd->card_status |= ADDRESS_ERROR;
+            } else {
+                sd_blk_readahead(sd, sd->data_start, sd_io_len(sd),
+                                 sd->multi_blk_cnt);
+            }
             return sd_r1;
 
         default:
@@ -1649,6 +1854,11 @@ int sd_do_command(SDState *sd, SDRequest *req,
         return 0;
     }
 
+    /* Only SEND_STATUS and STOP_TRANSMISSION may overlap backend I/O */
+    if ((req->cmd != 12 && req->cmd != 13) || sd->expecting_acmd) {
+        sd_blk_sync(sd);
+    }
+
     if (sd_req_crc_validate(req)) {
         sd->card_status |= COM_CRC_ERROR;
         rtype = sd_illegal;
@@ -1748,27 +1958,54 @@ send_response:
     return rsplen;
 }
 
-static void sd_blk_read(SDState *sd, uint64_t addr, uint32_t len)
+#define BLK_READ_BLOCK(a, len)	sd_blk_read(sd, a, len)
+#define BLK_WRITE_BLOCK(a, len)	sd_blk_write(sd, a, len)
+#define APP_READ_BLOCK(a, len)	memset(sd->data, 0xec, len)
+#define APP_WRITE_BLOCK(a, len)
+
+/* Check the address of a CMD25 block as its first byte arrives */
+static bool sd_write_block_start(SDState *sd)
 {
-    trace_sdcard_read_block(addr, len);
-    if (!sd->blk || blk_pread(sd->blk, addr, sd->data, len) < 0) {
-        fprintf(stderr, "sd_blk_read: read error on host side\n");
+    if (sd->current_cmd != 25 || sd->data_offset != 0) {
+        return true;
     }
+    if (sd->data_start + sd->blk_len > sd->size) {
+        sd->card_status |= ADDRESS_ERROR;
+        return false;
+    }
+    if (sd_wp_addr(sd, sd->data_start)) {
+        sd->card_status |= WP_VIOLATION;
+        return false;
+    }
+    return true;
 }
 
-static void sd_blk_write(SDState *sd, uint64_t addr, uint32_t len)
+/* Commit a fully received CMD24/CMD25 data block */
+static void sd_write_block_complete(SDState *sd)
 {
-    trace_sdcard_write_block(addr, len);
-    if (!sd->blk || blk_pwrite(sd->blk, addr, sd->data, len, 0) < 0) {
-        fprintf(stderr, "sd_blk_write: write error on host side\n");
+    /* TODO: Check CRC before committing */
+    sd->state = sd_programming_state;
+    BLK_WRITE_BLOCK(sd->data_start, sd->data_offset);
+    sd->blk_written++;
+    sd->csd[14] |= 0x40;
+
+    /* Stay in programming state until the backend write completes */
+    if (!sd->aiocb) {
+        sd->state = sd_transfer_state;
+    }
+    if (sd->current_cmd == 25) {
+        sd->data_start += sd->blk_len;
+        sd->data_offset = 0;
+        if (sd->multi_blk_cnt != 0) {
+            if (--sd->multi_blk_cnt == 0) {
+                /* Stop! */
+                return;
+            }
+        }
+        sd->state = sd_receivingdata_state;
     }
 }
 
-#define BLK_READ_BLOCK(a, len)	sd_blk_read(sd, a, len)
-#define BLK_WRITE_BLOCK(a, len)	sd_blk_write(sd, a, len)
-#define APP_READ_BLOCK(a, len)	memset(sd->data, 0xec, len)
-#define APP_WRITE_BLOCK(a, len)
-
 void sd_write_data(SDState *sd, uint8_t value)
 {
     int i;
@@ -1790,50 +2027,13 @@ void sd_write_data(SDState *sd, uint8_t value)
                             sd->current_cmd, value);
     switch (sd->current_cmd) {
     case 24:	/* CMD24:  WRITE_SINGLE_BLOCK */
-        sd->data[sd->data_offset ++] = value;
-        if (sd->data_offset >= sd->blk_len) {
-            /* TODO: Check CRC before committing */
-            sd->state = sd_programming_state;
-            BLK_WRITE_BLOCK(sd->data_start, sd->data_offset);
-            sd->blk_written ++;
-            sd->csd[14] |= 0x40;
-            /* Bzzzzzzztt .... Operation complete.  */
-            sd->state = sd_transfer_state;
-        }
-        break;
-
     case 25:	/* CMD25:  WRITE_MULTIPLE_BLOCK */
-        if (sd->data_offset == 0) {
-            /* Start of the block - let's check the address is valid */
-            if (sd->data_start + sd->blk_len > sd->size) {
-                sd->card_status |= ADDRESS_ERROR;
-                break;
-            }
-            if (sd_wp_addr(sd, sd->data_start)) {
-                sd->card_status |= WP_VIOLATION;
-                break;
-            }
+        if (!sd_write_block_start(sd)) {
+            break;
         }
         sd->data[sd->data_offset++] = value;
         if (sd->data_offset >= sd->blk_len) {
-            /* TODO: Check CRC before committing */
-            sd->state = sd_programming_state;
-            BLK_WRITE_BLOCK(sd->data_start, sd->data_offset);
-            sd->blk_written++;
-            sd->data_start += sd->blk_len;
-            sd->data_offset = 0;
-            sd->csd[14] |= 0x40;
-
-            /* Bzzzzzzztt .... Operation complete.  */
-            if (sd->multi_blk_cnt != 0) {
-                if (--sd->multi_blk_cnt == 0) {
-                    /* Stop! */
-                    sd->state = sd_transfer_state;
-                    break;
-                }
-            }
-
-            sd->state = sd_receivingdata_state;
+            sd_write_block_complete(sd);
         }
         break;
 
@@ -1905,6 +2105,55 @@ void sd_write_data(SDState *sd, uint8_t value)
     }
 }
 
+/*
+ * Fast path for sd_write_block(): copy host data straight into the current
+ * CMD24/CMD25 block.  Returns the number of bytes consumed, or 0 if the
+ * card state has to be handled byte by byte.
+ */
+static size_t sd_write_block_chunk(SDState *sd, const uint8_t *buf,
+                                   size_t length)
+{
+    size_t n;
+
+    if (!sd->blk || !blk_is_inserted(sd->blk) || !sd->enable ||
+        sd->state != sd_receivingdata_state ||
+        (sd->card_status & (ADDRESS_ERROR | WP_VIOLATION))) {
+        return 0;
+    }
+    if (sd->current_cmd != 24 && sd->current_cmd != 25) {
+        return 0;
+    }
+    if (!sd_write_block_start(sd)) {
+        return 0;
+    }
+
+    n = MIN(length, sd->blk_len - sd->data_offset);
+    trace_sdcard_write_block_data(sd->proto_name,
+                                  sd_acmd_name(sd->current_cmd),
+                                  sd->current_cmd, n);
+    memcpy(sd->data + sd->data_offset, buf, n);
+    sd->data_offset += n;
+    if (sd->data_offset >= sd->blk_len) {
+        sd_write_block_complete(sd);
+    }
+    return n;
+}
+
+void sd_write_block(SDState *sd, const uint8_t *buf, size_t length)
+{
+    size_t n;
+
+    while (length) {
+        n = sd_write_block_chunk(sd, buf, length);
+        if (!n) {
+            sd_write_data(sd, *buf);
+            n = 1;
+        }
+        buf += n;
+        length -= n;
+    }
+}
+
 #define SD_TUNING_BLOCK_SIZE    64
 
 static const uint8_t sd_tuning_block_pattern[SD_TUNING_BLOCK_SIZE] = {
@@ -1919,6 +2168,39 @@ static const uint8_t sd_tuning_block_pattern[SD_TUNING_BLOCK_SIZE] = {
     0xbb, 0xff, 0xf7, 0xff,         0xf7, 0x7f, 0x7b, 0xde,
 };
 
+/* Fetch the next CMD17/CMD18 block from the backend as its first byte goes */
+static bool sd_read_block_start(SDState *sd, int io_len)
+{
+    if (sd->data_offset != 0) {
+        return true;
+    }
+    if (sd->current_cmd == 18 && sd->data_start + io_len > sd->size) {
+        sd->card_status |= ADDRESS_ERROR;
+        return false;
+    }
+    BLK_READ_BLOCK(sd->data_start, io_len);
+    return true;
+}
+
+/* Advance past a fully sent CMD17/CMD18 data block */
+static void sd_read_block_complete(SDState *sd, int io_len)
+{
+    if (sd->current_cmd == 17) {
+        sd->state = sd_transfer_state;
+        return;
+    }
+
+    sd->data_start += io_len;
+    sd->data_offset = 0;
+
+    if (sd->multi_blk_cnt != 0) {
+        if (--sd->multi_blk_cnt == 0) {
+            /* Stop! */
+            sd->state = sd_transfer_state;
+        }
+    }
+}
+
 uint8_t sd_read_data(SDState *sd)
 {
     /* TODO: Append CRCs */
@@ -1937,7 +2219,7 @@ uint8_t sd_read_data(SDState *sd)
     if (sd->card_status & (ADDRESS_ERROR | WP_VIOLATION))
         return 0x00;
 
-    io_len = (sd->ocr & (1 << 30)) ? 512 : sd->blk_len;
+    io_len = sd_io_len(sd);
 
     trace_sdcard_read_data(sd->proto_name,
                            sd_acmd_name(sd->current_cmd),
@@ -1966,35 +2248,14 @@ uint8_t sd_read_data(SDState *sd)
         break;
 
     case 17:	/* CMD17:  READ_SINGLE_BLOCK */
-        if (sd->data_offset == 0)
-            BLK_READ_BLOCK(sd->data_start, io_len);
-        ret = sd->data[sd->data_offset ++];
-
-        if (sd->data_offset >= io_len)
-            sd->state = sd_transfer_state;
-        break;
-
     case 18:	/* CMD18:  READ_MULTIPLE_BLOCK */
-        if (sd->data_offset == 0) {
-            if (sd->data_start + io_len > sd->size) {
-                sd->card_status |= ADDRESS_ERROR;
-                return 0x00;
-            }
-            BLK_READ_BLOCK(sd->data_start, io_len);
+        if (!sd_read_block_start(sd, io_len)) {
+            return 0x00;
         }
         ret = sd->data[sd->data_offset ++];
 
         if (sd->data_offset >= io_len) {
-            sd->data_start += io_len;
-            sd->data_offset = 0;
-
-            if (sd->multi_blk_cnt != 0) {
-                if (--sd->multi_blk_cnt == 0) {
-                    /* Stop! */
-                    sd->state = sd_transfer_state;
-                    break;
-                }
-            }
+            sd_read_block_complete(sd, io_len);
         }
         break;
 
@@ -2043,6 +2304,57 @@ uint8_t sd_read_data(SDState *sd)
     return ret;
 }
 
+/*
+ * Fast path for sd_read_block(): copy out of the current CMD17/CMD18 block.
+ * Returns the number of bytes produced, or 0 if the card state has to be
+ * handled byte by byte.
+ */
+static size_t sd_read_block_chunk(SDState *sd, uint8_t *buf, size_t length)
+{
+    size_t n;
+    int io_len;
+
+    if (!sd->blk || !blk_is_inserted(sd->blk) || !sd->enable ||
+        sd->state != sd_sendingdata_state ||
+        (sd->card_status & (ADDRESS_ERROR | WP_VIOLATION))) {
+        return 0;
+    }
+    if (sd->current_cmd != 17 && sd->current_cmd != 18) {
+        return 0;
+    }
+
+    io_len = sd_io_len(sd);
+    if (!sd_read_block_start(sd, io_len)) {
+        return 0;
+    }
+
+    n = MIN(length, io_len - sd->data_offset);
+    trace_sdcard_read_data(sd->proto_name,
+                           sd_acmd_name(sd->current_cmd),
+                           sd->current_cmd, n);
+    memcpy(buf, sd->data + sd->data_offset, n);
+    sd->data_offset += n;
+    if (sd->data_offset >= io_len) {
+        sd_read_block_complete(sd, io_len);
+    }
+    return n;
+}
+
+void sd_read_block(SDState *sd, uint8_t *buf, size_t length)
+{
+    size_t n;
+
+    while (length) {
+        n = sd_read_block_chunk(sd, buf, length);
+        if (!n) {
+            *buf = sd_read_data(sd);
+            n = 1;
+        }
+        buf += n;
+        length -= n;
+    }
+}
+
 bool sd_data_ready(SDState *sd)
 {
     return sd->state == sd_sendingdata_state;
@@ -2098,6 +2410,9 @@ static void sd_realize(DeviceState *dev, Error **errp)
         }
         blk_set_dev_ops(sd->blk, &sd_block_ops, sd);
     }
+
+    sd->win_buf = blk_blockalign(sd->blk, SD_WINDOW_SIZE);
+    sd->aio_buf = blk_blockalign(sd->blk, SD_WINDOW_SIZE);
 }
 
 static Property sd_properties[] = {
@@ -2130,6 +2445,8 @@ static void sd_class_init(ObjectClass *klass, void *data)
     sc->do_command = sd_do_command;
     sc->write_data = sd_write_data;
     sc->read_data = sd_read_data;
+    sc->write_block = sd_write_block;
+    sc->read_block = sd_read_block;
     sc->data_ready = sd_data_ready;
     sc->enable = sd_enable;
     sc->get_inserted = sd_get_inserted;
@@ -0,0 +1,344 @@
+/*
+ * BCM2835 (Raspberry Pi) SPI0 master
+ *
+ * Data written to the TX FIFO is shifted out a whole FIFO at a time from a
+ * bottom half, and the status, interrupt and DREQ lines are updated once
+ * per batch. In DMA mode (CS.DMAEN) the FIFO is accessed a 32-bit word at
+ * a time, and while TA is clear the first word written loads DLEN and the
+ * low byte of CS, as the Linux driver expects. The serial clock, LoSSI and
+ * bidirectional modes are not modelled.
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/main-loop.h"
+#include "qemu/module.h"
+#include "hw/irq.h"
+#include "hw/ssi/bcm2835_spi.h"
+#include "migration/vmstate.h"
+
+#define SPI_CS          0x00
+#define SPI_FIFO        0x04
+#define SPI_CLK         0x08
+#define SPI_DLEN        0x0c
+#define SPI_LTOH        0x10
+#define SPI_DC          0x14
+
+#define SPI_CS_RXF      (1 << 20)
+#define SPI_CS_RXR      (1 << 19)
+#define SPI_CS_TXD      (1 << 18)
+#define SPI_CS_RXD      (1 << 17)
+#define SPI_CS_DONE     (1 << 16)
+#define SPI_CS_REN      (1 << 12)
+#define SPI_CS_INTR     (1 << 10)
+#define SPI_CS_INTD     (1 << 9)
+#define SPI_CS_DMAEN    (1 << 8)
+#define SPI_CS_TA       (1 << 7)
+#define SPI_CS_CSPOL    (1 << 6)
+#define SPI_CS_CLEAR_RX (1 << 5)
+#define SPI_CS_CLEAR_TX (1 << 4)
+#define SPI_CS_CSPOLN(n) (1 << (21 + (n)))
+#define SPI_CS_CS_MASK  3
+/* everything except the read-only status bits and CLEAR */
+#define SPI_CS_WMASK    0x03e0ffcf
+
+static bool bcm2835_spi_counted(BCM2835SPIState *s)
+{
+    return (s->cs & SPI_CS_DMAEN) && s->dlen != 0;
+}
+
+static uint32_t bcm2835_spi_status(BCM2835SPIState *s)
+{
+    uint32_t st = s->cs;
+
+    if (fifo8_is_full(&s->rx_fifo)) {
+        st |= SPI_CS_RXF;
+    }
+    if (fifo8_num_used(&s->rx_fifo) >= BCM2835_SPI_FIFO_SIZE * 3 / 4
+        && (s->cs & SPI_CS_TA)) {
+        st |= SPI_CS_RXR;
+    }
+    if (!fifo8_is_full(&s->tx_fifo)) {
+        st |= SPI_CS_TXD;
+    }
+    if (!fifo8_is_empty(&s->rx_fifo)) {
+        st |= SPI_CS_RXD;
+    }
+    if ((s->cs & SPI_CS_TA) && fifo8_is_empty(&s->tx_fifo)
+        && (!bcm2835_spi_counted(s) || s->remaining == 0)) {
+        st |= SPI_CS_DONE;
+    }
+
+    return st;
+}
+
+static void bcm2835_spi_update(BCM2835SPIState *s)
+{
+    uint32_t st = bcm2835_spi_status(s);
+    bool dma = s->cs & SPI_CS_DMAEN;
+    bool tx_room = fifo8_num_free(&s->tx_fifo) >= 4;
+
+    qemu_set_irq(s->irq, ((st & SPI_CS_INTR) && (st & SPI_CS_RXR))
+                         || ((st & SPI_CS_INTD) && (st & SPI_CS_DONE)));
+
+    if (bcm2835_spi_counted(s) && (s->cs & SPI_CS_TA)) {
+        tx_room = tx_room && s->remaining > fifo8_num_used(&s->tx_fifo);
+    }
+    qemu_set_irq(s->dreq_tx, dma && tx_room);
+    qemu_set_irq(s->dreq_rx, dma && (fifo8_num_used(&s->rx_fifo) >= 4
+                                     || ((st & SPI_CS_DONE)
+                                         && !fifo8_is_empty(&s->rx_fifo))));
+}
+
+static void bcm2835_spi_update_cs_lines(BCM2835SPIState *s)
+{
+    unsigned sel = s->cs & SPI_CS_CS_MASK;
+    int n;
+
+    for (n = 0; n < BCM2835_SPI_NUM_CS; n++) {
+        bool active = (s->cs & SPI_CS_TA) && sel == n;
+        bool high = s->cs & SPI_CS_CSPOLN(n);
+
+        qemu_set_irq(s->cs_lines[n], active ? high : !high);
+    }
+}
+
+/* Shift out as much of the TX FIFO as the RX FIFO has room for */
+static void bcm2835_spi_bh(void *opaque)
+{
+    BCM2835SPIState *s = opaque;
+    bool counted = bcm2835_spi_counted(s);
+    uint8_t rx;
+
+    while ((s->cs & SPI_CS_TA) && !fifo8_is_empty(&s->tx_fifo)
+           && !fifo8_is_full(&s->rx_fifo)) {
+        if (counted && s->remaining == 0) {
+            break;
+        }
+        rx = ssi_transfer(s->bus, fifo8_pop(&s->tx_fifo));
+        fifo8_push(&s->rx_fifo, rx);
+        if (counted) {
+            s->remaining--;
+        }
+    }
+
+    bcm2835_spi_update(s);
+}
+
+static void bcm2835_spi_write_cs(BCM2835SPIState *s, uint32_t value)
+{
+    bool was_active = s->cs & SPI_CS_TA;
+
+    if (value & SPI_CS_CLEAR_TX) {
+        fifo8_reset(&s->tx_fifo);
+    }
+    if (value & SPI_CS_CLEAR_RX) {
+        fifo8_reset(&s->rx_fifo);
+    }
+    s->cs = value & SPI_CS_WMASK;
+
+    if (!was_active && (s->cs & SPI_CS_TA)) {
+        s->remaining = s->dlen;
+    }
+    bcm2835_spi_update_cs_lines(s);
+    if (s->cs & SPI_CS_TA) {
+        qemu_bh_schedule(s->bh);
+    }
+}
+
+static uint64_t bcm2835_spi_read(void *opaque, hwaddr offset, unsigned size)
+{
+    BCM2835SPIState *s = opaque;
+    uint32_t res = 0;
+    int n;
+
+    switch (offset) {
+    case SPI_CS:
+        res = bcm2835_spi_status(s);
+        break;
+    case SPI_FIFO:
+        /* DMA mode reads are packed little-endian words */
+        for (n = 0; n < ((s->cs & SPI_CS_DMAEN) ? 4 : 1); n++) {
+            if (fifo8_is_empty(&s->rx_fifo)) {
+                break;
+            }
+            res |= fifo8_pop(&s->rx_fifo) << (n * 8);
+        }
+        if (!fifo8_is_empty(&s->tx_fifo)) {
+            qemu_bh_schedule(s->bh);
+        }
+        bcm2835_spi_update(s);
+        break;
+    case SPI_CLK:
+        res = s->clk;
+        break;
+    case SPI_DLEN:
+        res = bcm2835_spi_counted(s) && (s->cs & SPI_CS_TA) ? s->remaining
+                                                             : s->dlen;
+        break;
+    case SPI_LTOH:
+        res = s->ltoh;
+        break;
+    case SPI_DC:
+        res = s->dc;
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        break;
+    }
+
+    return res;
+}
+
+static void bcm2835_spi_write(void *opaque, hwaddr offset, uint64_t value,
+                              unsigned size)
+{
+    BCM2835SPIState *s = opaque;
+    unsigned n, count;
+
+    switch (offset) {
+    case SPI_CS:
+        bcm2835_spi_write_cs(s, value);
+        break;
+    case SPI_FIFO:
+        if (!(s->cs & SPI_CS_DMAEN)) {
+            count = 1;
+        } else if (!(s->cs & SPI_CS_TA)) {
+            /* DMA mode with TA clear: the word sets up the transfer */
+            s->dlen = value >> 16;
+            bcm2835_spi_write_cs(s, (s->cs & ~0xff) | (value & 0xff));
+            break;
+        } else if (bcm2835_spi_counted(s)) {
+            /* don't queue the padding at the end of the last word */
+            count = MIN(4, s->remaining - MIN(s->remaining,
+                                              fifo8_num_used(&s->tx_fifo)));
+        } else {
+            count = 4;
+        }
+        if (fifo8_num_free(&s->tx_fifo) < count) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: TX FIFO overrun\n", __func__);
+            count = fifo8_num_free(&s->tx_fifo);
+        }
+        for (n = 0; n < count; n++) {
+            fifo8_push(&s->tx_fifo, value >> (n * 8));
+        }
+        if (s->cs & SPI_CS_TA) {
+            qemu_bh_schedule(s->bh);
+        }
+        break;
+    case SPI_CLK:
+        s->clk = value & 0xffff;
+        break;
+    case SPI_DLEN:
+        s->dlen = value & 0xffff;
+        break;
+    case SPI_LTOH:
+        s->ltoh = value & 0xf;
+        break;
+    case SPI_DC:
+        s->dc = value;
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return;
+    }
+
+    bcm2835_spi_update(s);
+}
+
+static const MemoryRegionOps bcm2835_spi_ops = {
+    .read = bcm2835_spi_read,
+    .write = bcm2835_spi_write,
+    .endianness = DEVICE_NATIVE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static const VMStateDescription vmstate_bcm2835_spi = {
+    .name = TYPE_BCM2835_SPI,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(cs, BCM2835SPIState),
+        VMSTATE_UINT32(clk, BCM2835SPIState),
+        VMSTATE_UINT32(dlen, BCM2835SPIState),
+        VMSTATE_UINT32(ltoh, BCM2835SPIState),
+        VMSTATE_UINT32(dc, BCM2835SPIState),
+        VMSTATE_UINT32(remaining, BCM2835SPIState),
+        VMSTATE_FIFO8(tx_fifo, BCM2835SPIState),
+        VMSTATE_FIFO8(rx_fifo, BCM2835SPIState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void bcm2835_spi_reset(DeviceState *dev)
+{
+    BCM2835SPIState *s = BCM2835_SPI(dev);
+
+    fifo8_reset(&s->tx_fifo);
+    fifo8_reset(&s->rx_fifo);
+    s->cs = SPI_CS_REN;
+    s->clk = 0;
+    s->dlen = 0;
+    s->ltoh = 1;
+    s->dc = 0x30201020;
+    s->remaining = 0;
+
+    bcm2835_spi_update_cs_lines(s);
+    bcm2835_spi_update(s);
+}
+
+static void bcm2835_spi_init(Object *obj)
+{
+    BCM2835SPIState *s = BCM2835_SPI(obj);
+    SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
+    int n;
+
+    memory_region_init_io(&s->iomem, obj, &bcm2835_spi_ops, s,
+                          TYPE_BCM2835_SPI, 0x18);
+    sysbus_init_mmio(sbd, &s->iomem);
+    sysbus_init_irq(sbd, &s->irq);
+    for (n = 0; n < BCM2835_SPI_NUM_CS; n++) {
+        sysbus_init_irq(sbd, &s->cs_lines[n]);
+    }
+    qdev_init_gpio_out_named(DEVICE(obj), &s->dreq_tx, BCM2835_SPI_DREQ_TX, 1);
+    qdev_init_gpio_out_named(DEVICE(obj), &s->dreq_rx, BCM2835_SPI_DREQ_RX, 1);
+}
+
+static void bcm2835_spi_realize(DeviceState *dev, Error **errp)
+{
+    BCM2835SPIState *s = BCM2835_SPI(dev);
+
+    s->bus = ssi_create_bus(dev, NULL);
+    fifo8_create(&s->tx_fifo, BCM2835_SPI_FIFO_SIZE);
+    fifo8_create(&s->rx_fifo, BCM2835_SPI_FIFO_SIZE);
+    s->bh = qemu_bh_new(bcm2835_spi_bh, s);
+}
+
+static void bcm2835_spi_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = bcm2835_spi_realize;
+    dc->reset = bcm2835_spi_reset;
+    dc->vmsd = &vmstate_bcm2835_spi;
+}
+
+static TypeInfo bcm2835_spi_info = {
+    .name          = TYPE_BCM2835_SPI,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(BCM2835SPIState),
+    .class_init    = bcm2835_spi_class_init,
+    .instance_init = bcm2835_spi_init,
+};
+
+static void bcm2835_spi_register_types(void)
+{
+    type_register_static(&bcm2835_spi_info);
+}
+
+type_init(bcm2835_spi_register_types)
@@ -0,0 +1,258 @@
+/*
+ * BCM2835 SYS timer emulation
+ *
+ * Datasheet: BCM2835 ARM Peripherals (C6357-M-1398)
+ * https://www.raspberrypi.org/app/uploads/2012/02/BCM2835-ARM-Peripherals.pdf
+ *
+ * A free-running 64-bit counter at 1MHz, and four 32-bit compare registers
+ * matched against its low word, each with its own interrupt line.
+ *
+ * The counter is never stored: it is derived from QEMU_CLOCK_VIRTUAL when
+ * read, and a single QEMUTimer is armed for the nearest compare match.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "qemu/main-loop.h"
+#include "qemu/module.h"
+#include "hw/timer/bcm2835_systmr.h"
+#include "migration/vmstate.h"
+#include "trace.h"
+
+#define SYSTMR_CS   0x00 /* Control/Status */
+#define SYSTMR_CLO  0x04 /* Counter Lower 32 bits */
+#define SYSTMR_CHI  0x08 /* Counter Higher 32 bits */
+#define SYSTMR_C0   0x0c /* Compare 0 */
+#define SYSTMR_C3   0x18 /* Compare 3 */
+
+static uint64_t bcm2835_systmr_count(void)
+{
+    return qemu_clock_get_us(QEMU_CLOCK_VIRTUAL);
+}
+
+static void bcm2835_systmr_update_irq(BCM2835SystemTimerState *s)
+{
+    int n;
+
+    for (n = 0; n < BCM2835_SYSTIMER_COUNT; n++) {
+        qemu_set_irq(s->irq[n], !!(s->status & (1 << n)));
+    }
+}
+
+/*
+ * Arm the timer for the channel(s) matching soonest.  Channels with a match
+ * already pending are left out: a further match would not change anything
+ * the guest can see, so an idle guest costs no host wakeups at all.
+ */
+static void bcm2835_systmr_rearm(BCM2835SystemTimerState *s)
+{
+    uint64_t now = bcm2835_systmr_count();
+    uint64_t delta, next = UINT64_MAX;
+    int n;
+
+    s->armed = 0;
+    for (n = 0; n < BCM2835_SYSTIMER_COUNT; n++) {
+        if (s->status & (1 << n)) {
+            continue;
+        }
+        delta = (uint32_t)(s->compare[n] - (uint32_t)now);
+        if (delta == 0) {
+            /* Just missed it: the next match is a full wrap away */
+            delta = 1ULL << 32;
+        }
+        if (delta < next) {
+            next = delta;
+            s->armed = 1 << n;
+        } else if (delta == next) {
+            s->armed |= 1 << n;
+        }
+    }
+
+    if (s->armed) {
+        trace_bcm2835_systmr_rearm(s->armed, next);
+        timer_mod(s->timer, (now + next) * SCALE_US);
+    } else {
+        timer_del(s->timer);
+    }
+}
+
+static void bcm2835_systmr_expire(void *opaque)
+{
+    BCM2835SystemTimerState *s = opaque;
+
+    trace_bcm2835_systmr_irq(s->armed);
+    qemu_mutex_lock(&s->lock);
+    s->status |= s->armed;
+    qemu_mutex_unlock(&s->lock);
+    bcm2835_systmr_update_irq(s);
+    bcm2835_systmr_rearm(s);
+}
+
+static uint64_t bcm2835_systmr_read(void *opaque, hwaddr offset,
+                                    unsigned size)
+{
+    BCM2835SystemTimerState *s = opaque;
+    uint64_t r = 0;
+
+    /* The counter needs no lock, the rest is only ever read under s->lock */
+    switch (offset) {
+    case SYSTMR_CS:
+        qemu_mutex_lock(&s->lock);
+        r = s->status;
+        qemu_mutex_unlock(&s->lock);
+        break;
+    case SYSTMR_CLO:
+        r = (uint32_t)bcm2835_systmr_count();
+        break;
+    case SYSTMR_CHI:
+        r = bcm2835_systmr_count() >> 32;
+        break;
+    case SYSTMR_C0 ... SYSTMR_C3:
+        qemu_mutex_lock(&s->lock);
+        r = s->compare[(offset - SYSTMR_C0) >> 2];
+        qemu_mutex_unlock(&s->lock);
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        break;
+    }
+    trace_bcm2835_systmr_read(offset, r);
+
+    return r;
+}
+
+static void bcm2835_systmr_write(void *opaque, hwaddr offset,
+                                 uint64_t value, unsigned size)
+{
+    BCM2835SystemTimerState *s = opaque;
+    bool locked;
+
+    trace_bcm2835_systmr_write(offset, value);
+    switch (offset) {
+    case SYSTMR_CS:
+    case SYSTMR_C0 ... SYSTMR_C3:
+        break;
+    case SYSTMR_CLO:
+    case SYSTMR_CHI:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: read-only offset 0x%" HWADDR_PRIx
+                      "\n", __func__, offset);
+        return;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        return;
+    }
+
+    /* Interrupt lines and the timer are still covered by the iothread lock */
+    locked = qemu_mutex_iothread_locked();
+    if (!locked) {
+        qemu_mutex_lock_iothread();
+    }
+
+    qemu_mutex_lock(&s->lock);
+    if (offset == SYSTMR_CS) {
+        /* Write 1 to clear a match */
+        s->status &= ~value;
+    } else {
+        s->compare[(offset - SYSTMR_C0) >> 2] = value;
+    }
+    qemu_mutex_unlock(&s->lock);
+
+    if (offset == SYSTMR_CS) {
+        bcm2835_systmr_update_irq(s);
+    }
+    bcm2835_systmr_rearm(s);
+
+    if (!locked) {
+        qemu_mutex_unlock_iothread();
+    }
+}
+
+static const MemoryRegionOps bcm2835_systmr_ops = {
+    .read = bcm2835_systmr_read,
+    .write = bcm2835_systmr_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .impl = {
+        .min_access_size = 4,
+        .max_access_size = 4,
+    },
+};
+
+static void bcm2835_systmr_reset(DeviceState *dev)
+{
+    BCM2835SystemTimerState *s = BCM2835_SYSTIMER(dev);
+
+    qemu_mutex_lock(&s->lock);
+    s->status = 0;
+    memset(s->compare, 0, sizeof(s->compare));
+    qemu_mutex_unlock(&s->lock);
+    bcm2835_systmr_update_irq(s);
+    bcm2835_systmr_rearm(s);
+}
+
+static void bcm2835_systmr_init(Object *obj)
+{
+    BCM2835SystemTimerState *s = BCM2835_SYSTIMER(obj);
+    int n;
+
+    memory_region_init_io(&s->iomem, obj, &bcm2835_systmr_ops, s,
+                          TYPE_BCM2835_SYSTIMER, 0x20);
+    memory_region_clear_global_locking(&s->iomem);
+    sysbus_init_mmio(SYS_BUS_DEVICE(obj), &s->iomem);
+    for (n = 0; n < BCM2835_SYSTIMER_COUNT; n++) {
+        sysbus_init_irq(SYS_BUS_DEVICE(obj), &s->irq[n]);
+    }
+
+    qemu_mutex_init(&s->lock);
+    s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, bcm2835_systmr_expire, s);
+}
+
+static void bcm2835_systmr_finalize(Object *obj)
+{
+    BCM2835SystemTimerState *s = BCM2835_SYSTIMER(obj);
+
+    timer_free(s->timer);
+    qemu_mutex_destroy(&s->lock);
+}
+
+static const VMStateDescription bcm2835_systmr_vmstate = {
+    .name = TYPE_BCM2835_SYSTIMER,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(status, BCM2835SystemTimerState),
+        VMSTATE_UINT32_ARRAY(compare, BCM2835SystemTimerState,
+                             BCM2835_SYSTIMER_COUNT),
+        VMSTATE_UINT32(armed, BCM2835SystemTimerState),
+        VMSTATE_TIMER_PTR(timer, BCM2835SystemTimerState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void bcm2835_systmr_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->reset = bcm2835_systmr_reset;
+    dc->vmsd = &bcm2835_systmr_vmstate;
+}
+
+static const TypeInfo bcm2835_systmr_info = {
+    .name = TYPE_BCM2835_SYSTIMER,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(BCM2835SystemTimerState),
+    .instance_init = bcm2835_systmr_init,
+    .instance_finalize = bcm2835_systmr_finalize,
+    .class_init = bcm2835_systmr_class_init,
+};
+
+static void bcm2835_systmr_register_types(void)
+{
+    type_register_static(&bcm2835_systmr_info);
+}
+
+type_init(bcm2835_systmr_register_types)
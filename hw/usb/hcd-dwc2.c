@@ -0,0 +1,775 @@
+/*
+ * QEMU model of the Synopsys DesignWare USB 2.0 OTG controller (DWC2)
+ *
+ * Only host mode with internal (buffer) DMA is modelled, which is what
+ * Linux and the other Raspberry Pi guests use:
+ *
+ *  - A host channel transfer is handed to the USB device as a single
+ *    USBPacket covering the whole HCTSIZ transfer, with the guest buffer
+ *    mapped straight into the packet, rather than one max-packet-size
+ *    transaction at a time.
+ *  - Control and bulk channels run as soon as they are enabled. When the
+ *    device NAKs them the channel stays enabled and is retried at the
+ *    next frame boundary, or earlier if the device wakes the endpoint,
+ *    just like the core's own NAK handling in DMA mode.
+ *  - Interrupt and isochronous channels are deferred to the next frame
+ *    boundary, so all periodic work is batched per (1ms) frame.
+ *  - The frame timer is only armed while something needs it (SOF
+ *    interrupts or retries); HFNUM is derived from the virtual clock.
+ *
+ * Slave mode FIFOs, device mode and descriptor DMA are neither modelled
+ * nor advertised in GHWCFG. Split transactions are run as plain ones;
+ * QEMU has no high speed hubs, so guests never need them.
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "hw/irq.h"
+#include "hw/usb/hcd-dwc2.h"
+#include "migration/vmstate.h"
+#include "qemu/log.h"
+#include "qemu/module.h"
+#include "qemu/timer.h"
+#include "trace.h"
+
+#define DWC2_FRAME_NS           (NANOSECONDS_PER_SECOND / 1000)
+
+/* Values read from a BCM2835 */
+#define DWC2_GSNPSID_VAL        0x4f54280a
+#define DWC2_GHWCFG1_VAL        0x00000000
+#define DWC2_GHWCFG2_VAL        0x228ddd50 /* 8 channels, internal DMA */
+#define DWC2_GHWCFG3_VAL        0x0ff000e8
+#define DWC2_GHWCFG4_VAL        0x1ff00020 /* no descriptor DMA */
+
+#define GREG(s, r)              ((s)->glbreg[(r) >> 2])
+#define FREG(s, r)              ((s)->fszreg[((r) - HPTXFSIZ) >> 2])
+#define HREG(s, r)              ((s)->hreg0[((r) - HCFG) >> 2])
+#define CREG(s, r)              ((s)->hreg1[((r) - HCCHAR_BASE) >> 2])
+
+static void dwc2_update_irq(DWC2State *s)
+{
+    uint32_t haint = 0;
+    bool level;
+    int n;
+
+    for (n = 0; n < DWC2_NB_CHAN; n++) {
+        if (CREG(s, HCINT(n)) & CREG(s, HCINTMSK(n))) {
+            haint |= 1 << n;
+        }
+    }
+    HREG(s, HAINT) = haint;
+
+    if (haint & HREG(s, HAINTMSK)) {
+        GREG(s, GINTSTS) |= GINTSTS_HCHINT;
+    } else {
+        GREG(s, GINTSTS) &= ~GINTSTS_HCHINT;
+    }
+    if (HREG(s, HPRT0) & HPRT0_CHG_MASK) {
+        GREG(s, GINTSTS) |= GINTSTS_PRTINT;
+    } else {
+        GREG(s, GINTSTS) &= ~GINTSTS_PRTINT;
+    }
+
+    level = (GREG(s, GAHBCFG) & GAHBCFG_GLBL_INTR_EN) &&
+            (GREG(s, GINTSTS) & GREG(s, GINTMSK));
+    trace_usb_dwc2_irq(GREG(s, GINTSTS), GREG(s, GINTMSK), level);
+    qemu_set_irq(s->irq, level);
+}
+
+static bool dwc2_port_enabled(DWC2State *s)
+{
+    return (HREG(s, HPRT0) & HPRT0_ENA) && s->uport.dev;
+}
+
+static uint32_t dwc2_frame_number(DWC2State *s)
+{
+    int64_t uframe_ns = DWC2_FRAME_NS / s->frame_step;
+    int64_t elapsed = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - s->frame_epoch;
+
+    return (elapsed / uframe_ns) & HFNUM_MAX_FRNUM;
+}
+
+static uint32_t dwc2_frame_remaining(DWC2State *s)
+{
+    int64_t uframe_ns = DWC2_FRAME_NS / s->frame_step;
+    int64_t elapsed = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - s->frame_epoch;
+    uint32_t frint = HREG(s, HFIR) & HFIR_FRINT_MASK;
+
+    return frint - muldiv64(elapsed % uframe_ns, frint, uframe_ns);
+}
+
+/* Arm the frame timer for the next boundary, if anything is waiting on it */
+static void dwc2_sched_frame(DWC2State *s)
+{
+    bool needed = GREG(s, GINTMSK) & GINTSTS_SOF;
+    int64_t now, next;
+    int n;
+
+    for (n = 0; n < DWC2_NB_CHAN && !needed; n++) {
+        needed = s->chan[n].needs_retry;
+    }
+
+    if (!needed || !dwc2_port_enabled(s)) {
+        timer_del(s->frame_timer);
+        return;
+    }
+
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    next = now - (now - s->frame_epoch) % DWC2_FRAME_NS + DWC2_FRAME_NS;
+    timer_mod(s->frame_timer, next);
+}
+
+static void dwc2_chan_halt(DWC2State *s, int n, uint32_t hcint)
+{
+    s->chan[n].needs_retry = false;
+    CREG(s, HCCHAR(n)) &= ~(HCCHAR_CHENA | HCCHAR_CHDIS);
+    CREG(s, HCINT(n)) |= hcint | HCINTMSK_CHHLTD;
+    trace_usb_dwc2_chan_halt(n, CREG(s, HCINT(n)));
+}
+
+static bool dwc2_chan_periodic(DWC2State *s, int n)
+{
+    uint32_t eptype = (CREG(s, HCCHAR(n)) & HCCHAR_EPTYPE_MASK) >>
+                      HCCHAR_EPTYPE_SHIFT;
+
+    return eptype == EPTYPE_INTR || eptype == EPTYPE_ISOC;
+}
+
+/* Account a finished USBPacket against the channel registers */
+static void dwc2_chan_complete(DWC2State *s, int n)
+{
+    DWC2Channel *c = &s->chan[n];
+    USBPacket *p = &c->packet;
+    uint32_t hcchar = CREG(s, HCCHAR(n));
+    uint32_t tsiz = CREG(s, HCTSIZ(n));
+    uint32_t mps = MAX(hcchar & HCCHAR_MPS_MASK, 1);
+    uint32_t xfersize = tsiz & TSIZ_XFERSIZE_MASK;
+    uint32_t pktcnt = (tsiz & TSIZ_PKTCNT_MASK) >> TSIZ_PKTCNT_SHIFT;
+    uint32_t pid = (tsiz & TSIZ_SC_MC_PID_MASK) >> TSIZ_SC_MC_PID_SHIFT;
+    uint32_t actual, pkts;
+
+    usb_packet_unmap(p, &c->sgl);
+    qemu_sglist_destroy(&c->sgl);
+
+    trace_usb_dwc2_chan_complete(n, p->status, p->actual_length);
+
+    switch (p->status) {
+    case USB_RET_SUCCESS:
+        actual = MIN(p->actual_length, xfersize);
+        if (actual < c->len || actual % mps) {
+            pkts = actual / mps + 1; /* short packet ends the transfer */
+        } else {
+            pkts = MAX(actual / mps, 1);
+        }
+        pkts = MIN(pkts, pktcnt);
+
+        xfersize -= actual;
+        pktcnt -= pkts;
+        if (pid == TSIZ_SC_MC_PID_SETUP &&
+            p->pid == USB_TOKEN_SETUP) {
+            pid = TSIZ_SC_MC_PID_DATA1;
+        } else if (pkts & 1) {
+            pid = pid == TSIZ_SC_MC_PID_DATA0 ? TSIZ_SC_MC_PID_DATA1
+                                              : TSIZ_SC_MC_PID_DATA0;
+        }
+        CREG(s, HCTSIZ(n)) = (tsiz & TSIZ_DOPNG) |
+                             (pid << TSIZ_SC_MC_PID_SHIFT) |
+                             (pktcnt << TSIZ_PKTCNT_SHIFT) | xfersize;
+        CREG(s, HCDMA(n)) += actual;
+        dwc2_chan_halt(s, n, HCINTMSK_XFERCOMPL | HCINTMSK_ACK);
+        break;
+
+    case USB_RET_NAK:
+        if (dwc2_chan_periodic(s, n)) {
+            dwc2_chan_halt(s, n, HCINTMSK_NAK);
+        } else {
+            /* the core retries non-periodic NAKs itself in DMA mode */
+            c->needs_retry = true;
+        }
+        break;
+
+    case USB_RET_STALL:
+        dwc2_chan_halt(s, n, HCINTMSK_STALL);
+        break;
+
+    case USB_RET_BABBLE:
+        dwc2_chan_halt(s, n, HCINTMSK_BBLERR);
+        break;
+
+    default:
+        dwc2_chan_halt(s, n, HCINTMSK_XACTERR);
+        break;
+    }
+
+    dwc2_update_irq(s);
+    dwc2_sched_frame(s);
+}
+
+/* Start the transfer programmed into channel n */
+static void dwc2_chan_run(DWC2State *s, int n)
+{
+    DWC2Channel *c = &s->chan[n];
+    uint32_t hcchar = CREG(s, HCCHAR(n));
+    uint32_t tsiz = CREG(s, HCTSIZ(n));
+    uint32_t devaddr = (hcchar & HCCHAR_DEVADDR_MASK) >> HCCHAR_DEVADDR_SHIFT;
+    uint32_t epnum = (hcchar & HCCHAR_EPNUM_MASK) >> HCCHAR_EPNUM_SHIFT;
+    uint32_t eptype = (hcchar & HCCHAR_EPTYPE_MASK) >> HCCHAR_EPTYPE_SHIFT;
+    uint32_t mps = hcchar & HCCHAR_MPS_MASK;
+    uint32_t pid = (tsiz & TSIZ_SC_MC_PID_MASK) >> TSIZ_SC_MC_PID_SHIFT;
+    uint32_t pktcnt = (tsiz & TSIZ_PKTCNT_MASK) >> TSIZ_PKTCNT_SHIFT;
+    uint32_t len = tsiz & TSIZ_XFERSIZE_MASK;
+    USBDevice *dev;
+    USBEndpoint *ep;
+    int token;
+
+    c->needs_retry = false;
+    if (!(hcchar & HCCHAR_CHENA) || usb_packet_is_inflight(&c->packet)) {
+        return;
+    }
+
+    if (!(GREG(s, GAHBCFG) & GAHBCFG_DMA_EN)) {
+        qemu_log_mask(LOG_UNIMP, "%s: slave mode transfers are not "
+                      "supported\n", __func__);
+        dwc2_chan_halt(s, n, HCINTMSK_AHBERR);
+        dwc2_update_irq(s);
+        return;
+    }
+    if (CREG(s, HCSPLT(n)) & HCSPLT_SPLTENA) {
+        qemu_log_mask(LOG_UNIMP, "%s: split transactions are not "
+                      "supported, treating as a plain transfer\n", __func__);
+    }
+
+    dev = dwc2_port_enabled(s) ? usb_find_device(&s->uport, devaddr) : NULL;
+    if (dev == NULL) {
+        dwc2_chan_halt(s, n, HCINTMSK_XACTERR);
+        dwc2_update_irq(s);
+        return;
+    }
+
+    if (eptype == EPTYPE_CONTROL && pid == TSIZ_SC_MC_PID_SETUP) {
+        token = USB_TOKEN_SETUP;
+    } else if (hcchar & HCCHAR_EPDIR) {
+        token = USB_TOKEN_IN;
+        len = MIN(len, pktcnt * mps);
+    } else {
+        token = USB_TOKEN_OUT;
+    }
+    ep = usb_ep_get(dev, token, epnum);
+
+    trace_usb_dwc2_chan_run(n, devaddr, epnum, token, eptype, len);
+
+    c->len = len;
+    qemu_sglist_init(&c->sgl, DEVICE(s), 1, &s->dma_as);
+    if (len) {
+        qemu_sglist_add(&c->sgl, CREG(s, HCDMA(n)), len);
+    }
+    usb_packet_setup(&c->packet, token, ep, 0, n, false, true);
+    if (usb_packet_map(&c->packet, &c->sgl)) {
+        qemu_sglist_destroy(&c->sgl);
+        dwc2_chan_halt(s, n, HCINTMSK_AHBERR);
+        dwc2_update_irq(s);
+        return;
+    }
+
+    usb_handle_packet(dev, &c->packet);
+    if (c->packet.status != USB_RET_ASYNC) {
+        dwc2_chan_complete(s, n);
+    }
+}
+
+static void dwc2_chan_cancel(DWC2State *s, int n)
+{
+    DWC2Channel *c = &s->chan[n];
+
+    c->needs_retry = false;
+    if (usb_packet_is_inflight(&c->packet)) {
+        usb_cancel_packet(&c->packet);
+        usb_packet_unmap(&c->packet, &c->sgl);
+        qemu_sglist_destroy(&c->sgl);
+    }
+}
+
+static void dwc2_frame_boundary(void *opaque)
+{
+    DWC2State *s = opaque;
+    int n;
+
+    GREG(s, GINTSTS) |= GINTSTS_SOF;
+    trace_usb_dwc2_frame(dwc2_frame_number(s));
+
+    for (n = 0; n < DWC2_NB_CHAN; n++) {
+        if (s->chan[n].needs_retry) {
+            dwc2_chan_run(s, n);
+        }
+    }
+
+    dwc2_update_irq(s);
+    dwc2_sched_frame(s);
+}
+
+static void dwc2_hcchar_write(DWC2State *s, int n, uint32_t value)
+{
+    uint32_t old = CREG(s, HCCHAR(n));
+
+    if ((value & HCCHAR_CHDIS) && (old & HCCHAR_CHENA)) {
+        /* halt request: drop whatever is in flight */
+        dwc2_chan_cancel(s, n);
+        CREG(s, HCCHAR(n)) = value;
+        dwc2_chan_halt(s, n, 0);
+        dwc2_update_irq(s);
+        dwc2_sched_frame(s);
+        return;
+    }
+
+    CREG(s, HCCHAR(n)) = value & ~HCCHAR_CHDIS;
+    if ((value & HCCHAR_CHENA) && !(old & HCCHAR_CHENA)) {
+        if (dwc2_chan_periodic(s, n)) {
+            s->chan[n].needs_retry = true;
+            dwc2_sched_frame(s);
+        } else {
+            dwc2_chan_run(s, n);
+        }
+    }
+}
+
+static void dwc2_hprt0_write(DWC2State *s, uint32_t value)
+{
+    uint32_t old = HREG(s, HPRT0);
+    uint32_t hprt0 = old;
+
+    hprt0 &= ~(value & HPRT0_CHG_MASK);
+    if (value & HPRT0_ENA) {
+        hprt0 &= ~HPRT0_ENA; /* write 1 to disable */
+    }
+
+    hprt0 &= ~(HPRT0_PWR | HPRT0_RST | HPRT0_SUSP | HPRT0_RES |
+               HPRT0_TSTCTL_MASK);
+    hprt0 |= value & (HPRT0_PWR | HPRT0_RST | HPRT0_SUSP | HPRT0_RES |
+                      HPRT0_TSTCTL_MASK);
+    if (!(hprt0 & HPRT0_PWR)) {
+        hprt0 &= ~(HPRT0_ENA | HPRT0_SUSP);
+    }
+
+    /* End of port reset: enable the port and restart the frame counter */
+    if ((old & HPRT0_RST) && !(hprt0 & HPRT0_RST) &&
+        (hprt0 & HPRT0_CONNSTS) && s->uport.dev) {
+        usb_port_reset(&s->uport);
+        hprt0 |= HPRT0_ENA | HPRT0_ENACHG;
+        s->frame_epoch = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    }
+
+    trace_usb_dwc2_hprt0(old, hprt0);
+    HREG(s, HPRT0) = hprt0;
+    dwc2_update_irq(s);
+    dwc2_sched_frame(s);
+}
+
+static void dwc2_port_connect(DWC2State *s)
+{
+    uint32_t spd;
+
+    HREG(s, HPRT0) &= ~HPRT0_SPD_MASK;
+    if (s->uport.dev == NULL || !s->uport.dev->attached) {
+        return;
+    }
+
+    switch (s->uport.dev->speed) {
+    case USB_SPEED_LOW:
+        spd = HPRT0_SPD_LOW_SPEED;
+        s->frame_step = 1;
+        break;
+    case USB_SPEED_FULL:
+        spd = HPRT0_SPD_FULL_SPEED;
+        s->frame_step = 1;
+        break;
+    default:
+        spd = HPRT0_SPD_HIGH_SPEED;
+        s->frame_step = 8;
+        break;
+    }
+    HREG(s, HPRT0) |= HPRT0_CONNSTS | HPRT0_CONNDET |
+                      (spd << HPRT0_SPD_SHIFT);
+}
+
+static void dwc2_reset_regs(DWC2State *s)
+{
+    int n;
+
+    for (n = 0; n < DWC2_NB_CHAN; n++) {
+        dwc2_chan_cancel(s, n);
+    }
+    timer_del(s->frame_timer);
+
+    memset(s->glbreg, 0, sizeof(s->glbreg));
+    memset(s->fszreg, 0, sizeof(s->fszreg));
+    memset(s->hreg0, 0, sizeof(s->hreg0));
+    memset(s->hreg1, 0, sizeof(s->hreg1));
+    memset(s->pcgreg, 0, sizeof(s->pcgreg));
+
+    GREG(s, GUSBCFG) = 5 << 10; /* USBTRDTIM */
+    GREG(s, GRSTCTL) = GRSTCTL_AHBIDLE;
+    GREG(s, GINTSTS) = GINTSTS_CURMODE_HOST | GINTSTS_PTXFEMP |
+                       GINTSTS_NPTXFEMP;
+    GREG(s, GRXFSIZ) = 0x1000;
+    GREG(s, GNPTXFSIZ) = 0x01001000;
+    GREG(s, GNPTXSTS) = 0x00080100;
+    GREG(s, GSNPSID) = DWC2_GSNPSID_VAL;
+    GREG(s, GHWCFG1) = DWC2_GHWCFG1_VAL;
+    GREG(s, GHWCFG2) = DWC2_GHWCFG2_VAL;
+    GREG(s, GHWCFG3) = DWC2_GHWCFG3_VAL;
+    GREG(s, GHWCFG4) = DWC2_GHWCFG4_VAL;
+    FREG(s, HPTXFSIZ) = 0x02002000;
+    HREG(s, HFIR) = 60000; /* 1ms of 60MHz PHY clock */
+    HREG(s, HPTXSTS) = 0x00080100;
+
+    s->frame_step = 8;
+    s->frame_epoch = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    dwc2_port_connect(s);
+    dwc2_update_irq(s);
+}
+
+static uint64_t dwc2_read(void *opaque, hwaddr offset, unsigned size)
+{
+    DWC2State *s = opaque;
+    uint32_t res;
+
+    switch (offset) {
+    case 0 ... DWC2_GLBREG_SIZE - 1:
+        res = GREG(s, offset);
+        break;
+    case HPTXFSIZ ... HPTXFSIZ + DWC2_FSZREG_SIZE - 1:
+        res = FREG(s, offset);
+        break;
+    case HCFG ... HCFG + DWC2_HREG0_SIZE - 1:
+        if (offset == HFNUM) {
+            res = (dwc2_frame_remaining(s) << HFNUM_FRREM_SHIFT) |
+                  dwc2_frame_number(s);
+        } else {
+            res = HREG(s, offset);
+        }
+        break;
+    case HCCHAR_BASE ... HCCHAR_BASE + DWC2_NB_CHAN * DWC2_HCREG_SIZE - 1:
+        res = CREG(s, offset);
+        break;
+    case PCGCTL ... PCGCTL + DWC2_PCGREG_SIZE - 1:
+        res = s->pcgreg[(offset - PCGCTL) >> 2];
+        break;
+    case DWC2_FIFO_BASE ... DWC2_MMIO_SIZE - 1:
+        qemu_log_mask(LOG_UNIMP, "%s: slave mode FIFO access at 0x%"
+                      HWADDR_PRIx "\n", __func__, offset);
+        res = 0;
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx "\n",
+                      __func__, offset);
+        res = 0;
+        break;
+    }
+
+    trace_usb_dwc2_read(offset, res);
+    return res;
+}
+
+static void dwc2_write(void *opaque, hwaddr offset, uint64_t value,
+                       unsigned size)
+{
+    DWC2State *s = opaque;
+    uint32_t *creg;
+    int n;
+
+    trace_usb_dwc2_write(offset, value);
+
+    switch (offset) {
+    case GOTGINT:
+        GREG(s, GOTGINT) &= ~value;
+        break;
+    case GAHBCFG:
+    case GINTMSK:
+        GREG(s, offset) = value;
+        dwc2_update_irq(s);
+        dwc2_sched_frame(s);
+        break;
+    case GUSBCFG:
+        if (value & GUSBCFG_FORCEDEVMODE) {
+            qemu_log_mask(LOG_UNIMP, "%s: device mode is not supported\n",
+                          __func__);
+        }
+        GREG(s, GUSBCFG) = value;
+        break;
+    case GRSTCTL:
+        if (value & GRSTCTL_CSFTRST) {
+            dwc2_reset_regs(s);
+        }
+        if (value & GRSTCTL_FRMCNTRRST) {
+            s->frame_epoch = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+        }
+        /* every reset and flush completes immediately */
+        GREG(s, GRSTCTL) = GRSTCTL_AHBIDLE;
+        break;
+    case GINTSTS:
+        GREG(s, GINTSTS) &= ~(value & ~GINTSTS_RO_MASK);
+        dwc2_update_irq(s);
+        break;
+    case GOTGCTL:
+    case GRXFSIZ:
+    case GNPTXFSIZ:
+    case GI2CCTL:
+    case GPVNDCTL:
+    case GGPIO:
+    case GUID:
+    case GLPMCFG:
+    case GPWRDN:
+    case GDFIFOCFG:
+    case GADPCTL:
+    case GREFCLK:
+    case GINTMSK2:
+        GREG(s, offset) = value;
+        break;
+    case HPTXFSIZ ... HPTXFSIZ + DWC2_FSZREG_SIZE - 1:
+        FREG(s, offset) = value;
+        break;
+    case HCFG:
+    case HFIR:
+    case HFLBADDR:
+        HREG(s, offset) = value;
+        break;
+    case HAINTMSK:
+        HREG(s, HAINTMSK) = value & ((1 << DWC2_NB_CHAN) - 1);
+        dwc2_update_irq(s);
+        break;
+    case HPRT0:
+        dwc2_hprt0_write(s, value);
+        break;
+    case HCCHAR_BASE ... HCCHAR_BASE + DWC2_NB_CHAN * DWC2_HCREG_SIZE - 1:
+        n = (offset - HCCHAR_BASE) / DWC2_HCREG_SIZE;
+        creg = &CREG(s, offset);
+        if (offset == HCCHAR(n)) {
+            dwc2_hcchar_write(s, n, value);
+        } else if (offset == HCINT(n)) {
+            *creg &= ~value;
+            dwc2_update_irq(s);
+        } else if (offset == HCINTMSK(n)) {
+            *creg = value & ~HCINTMSK_RESERVED14_31;
+            dwc2_update_irq(s);
+        } else {
+            *creg = value;
+        }
+        break;
+    case PCGCTL ... PCGCTL + DWC2_PCGREG_SIZE - 1:
+        s->pcgreg[(offset - PCGCTL) >> 2] = value;
+        break;
+    case DWC2_FIFO_BASE ... DWC2_MMIO_SIZE - 1:
+        qemu_log_mask(LOG_UNIMP, "%s: slave mode FIFO access at 0x%"
+                      HWADDR_PRIx "\n", __func__, offset);
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: Bad offset 0x%" HWADDR_PRIx
+                      " (or read-only register)\n", __func__, offset);
+        break;
+    }
+}
+
+static const MemoryRegionOps dwc2_mmio_ops = {
+    .read = dwc2_read,
+    .write = dwc2_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid.min_access_size = 4,
+    .valid.max_access_size = 4,
+};
+
+static void dwc2_attach(USBPort *port)
+{
+    DWC2State *s = port->opaque;
+
+    trace_usb_dwc2_attach(port->dev->speed);
+    dwc2_port_connect(s);
+    dwc2_update_irq(s);
+}
+
+static void dwc2_detach(USBPort *port)
+{
+    DWC2State *s = port->opaque;
+    uint32_t hprt0 = HREG(s, HPRT0);
+    int n;
+
+    trace_usb_dwc2_detach();
+    for (n = 0; n < DWC2_NB_CHAN; n++) {
+        dwc2_chan_cancel(s, n);
+    }
+
+    if (hprt0 & HPRT0_ENA) {
+        hprt0 |= HPRT0_ENACHG;
+    }
+    hprt0 &= ~(HPRT0_CONNSTS | HPRT0_ENA | HPRT0_SUSP | HPRT0_SPD_MASK);
+    HREG(s, HPRT0) = hprt0 | HPRT0_CONNDET;
+    GREG(s, GINTSTS) |= GINTSTS_DISCONNINT;
+    dwc2_update_irq(s);
+    dwc2_sched_frame(s);
+}
+
+static void dwc2_child_detach(USBPort *port, USBDevice *child)
+{
+    DWC2State *s = port->opaque;
+    int n;
+
+    for (n = 0; n < DWC2_NB_CHAN; n++) {
+        USBPacket *p = &s->chan[n].packet;
+
+        if (usb_packet_is_inflight(p) && p->ep->dev == child) {
+            dwc2_chan_cancel(s, n);
+        }
+    }
+}
+
+static void dwc2_wakeup(USBPort *port)
+{
+    DWC2State *s = port->opaque;
+
+    if (HREG(s, HPRT0) & HPRT0_SUSP) {
+        HREG(s, HPRT0) |= HPRT0_RES;
+        GREG(s, GINTSTS) |= GINTSTS_WKUPINT;
+        dwc2_update_irq(s);
+    }
+}
+
+static void dwc2_async_complete(USBPort *port, USBPacket *p)
+{
+    DWC2State *s = port->opaque;
+    DWC2Channel *c = container_of(p, DWC2Channel, packet);
+
+    dwc2_chan_complete(s, c - s->chan);
+}
+
+/* The device has data for a NAKed endpoint: retry without waiting a frame */
+static void dwc2_wakeup_endpoint(USBBus *bus, USBEndpoint *ep,
+                                 unsigned int stream)
+{
+    DWC2State *s = container_of(bus, DWC2State, bus);
+    int n;
+
+    for (n = 0; n < DWC2_NB_CHAN; n++) {
+        DWC2Channel *c = &s->chan[n];
+
+        if (c->needs_retry && c->packet.ep == ep &&
+            !dwc2_chan_periodic(s, n)) {
+            dwc2_chan_run(s, n);
+        }
+    }
+    dwc2_sched_frame(s);
+}
+
+static USBPortOps dwc2_port_ops = {
+    .attach = dwc2_attach,
+    .detach = dwc2_detach,
+    .child_detach = dwc2_child_detach,
+    .wakeup = dwc2_wakeup,
+    .complete = dwc2_async_complete,
+};
+
+static USBBusOps dwc2_bus_ops = {
+    .wakeup_endpoint = dwc2_wakeup_endpoint,
+};
+
+static void dwc2_reset(DeviceState *dev)
+{
+    dwc2_reset_regs(DWC2_USB(dev));
+}
+
+static int dwc2_post_load(void *opaque, int version_id)
+{
+    DWC2State *s = opaque;
+    int n;
+
+    /* Transfers in flight on the source are simply issued again */
+    for (n = 0; n < DWC2_NB_CHAN; n++) {
+        if (CREG(s, HCCHAR(n)) & HCCHAR_CHENA) {
+            s->chan[n].needs_retry = true;
+        }
+    }
+    dwc2_sched_frame(s);
+    return 0;
+}
+
+static const VMStateDescription vmstate_dwc2 = {
+    .name = TYPE_DWC2_USB,
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .post_load = dwc2_post_load,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32_ARRAY(glbreg, DWC2State, DWC2_GLBREG_SIZE / 4),
+        VMSTATE_UINT32_ARRAY(fszreg, DWC2State, DWC2_FSZREG_SIZE / 4),
+        VMSTATE_UINT32_ARRAY(hreg0, DWC2State, DWC2_HREG0_SIZE / 4),
+        VMSTATE_UINT32_ARRAY(hreg1, DWC2State,
+                             DWC2_NB_CHAN * DWC2_HCREG_SIZE / 4),
+        VMSTATE_UINT32_ARRAY(pcgreg, DWC2State, DWC2_PCGREG_SIZE / 4),
+        VMSTATE_INT64(frame_epoch, DWC2State),
+        VMSTATE_UINT32(frame_step, DWC2State),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void dwc2_init(Object *obj)
+{
+    SysBusDevice *sbd = SYS_BUS_DEVICE(obj);
+    DWC2State *s = DWC2_USB(obj);
+
+    memory_region_init_io(&s->iomem, obj, &dwc2_mmio_ops, s, TYPE_DWC2_USB,
+                          DWC2_MMIO_SIZE);
+    sysbus_init_mmio(sbd, &s->iomem);
+    sysbus_init_irq(sbd, &s->irq);
+}
+
+static void dwc2_realize(DeviceState *dev, Error **errp)
+{
+    DWC2State *s = DWC2_USB(dev);
+    Error *err = NULL;
+    Object *obj;
+    int n;
+
+    obj = object_property_get_link(OBJECT(dev), "dma-mr", &err);
+    if (obj == NULL) {
+        error_setg(errp, "%s: required dma-mr link not found: %s",
+                   __func__, error_get_pretty(err));
+        return;
+    }
+
+    s->dma_mr = MEMORY_REGION(obj);
+    address_space_init(&s->dma_as, s->dma_mr, "dwc2-dma");
+
+    usb_bus_new(&s->bus, sizeof(s->bus), &dwc2_bus_ops, dev);
+    usb_register_port(&s->bus, &s->uport, s, 0, &dwc2_port_ops,
+                      USB_SPEED_MASK_LOW | USB_SPEED_MASK_FULL |
+                      USB_SPEED_MASK_HIGH);
+
+    for (n = 0; n < DWC2_NB_CHAN; n++) {
+        usb_packet_init(&s->chan[n].packet);
+    }
+    s->frame_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, dwc2_frame_boundary, s);
+}
+
+static void dwc2_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = dwc2_realize;
+    dc->reset = dwc2_reset;
+    dc->vmsd = &vmstate_dwc2;
+    set_bit(DEVICE_CATEGORY_USB, dc->categories);
+}
+
+static const TypeInfo dwc2_usb_info = {
+    .name          = TYPE_DWC2_USB,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(DWC2State),
+    .instance_init = dwc2_init,
+    .class_init    = dwc2_class_init,
+};
+
+static void dwc2_usb_register_types(void)
+{
+    type_register_static(&dwc2_usb_info);
+}
+
+type_init(dwc2_usb_register_types)
@@ -0,0 +1,54 @@
+/*
+ * QEMU model of the Synopsys DesignWare USB 2.0 OTG controller (DWC2),
+ * host mode only, as found on the BCM2835/6/7.
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#ifndef HW_USB_HCD_DWC2_H
+#define HW_USB_HCD_DWC2_H
+
+#include "hw/sysbus.h"
+#include "hw/usb.h"
+#include "hw/usb/dwc2-regs.h"
+#include "sysemu/dma.h"
+
+#define TYPE_DWC2_USB "dwc2-usb"
+#define DWC2_USB(obj) OBJECT_CHECK(DWC2State, (obj), TYPE_DWC2_USB)
+
+#define DWC2_NB_CHAN            8
+
+typedef struct DWC2Channel {
+    USBPacket packet;
+    QEMUSGList sgl;
+    uint32_t len;      /* bytes handed to the device for the packet */
+    bool needs_retry;  /* NAKed or periodic, retried at the next frame */
+} DWC2Channel;
+
+typedef struct DWC2State {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    USBBus bus;
+    USBPort uport;
+    qemu_irq irq;
+    MemoryRegion iomem;
+    MemoryRegion *dma_mr;
+    AddressSpace dma_as;
+    QEMUTimer *frame_timer;
+
+    uint32_t glbreg[DWC2_GLBREG_SIZE / 4];
+    uint32_t fszreg[DWC2_FSZREG_SIZE / 4];
+    uint32_t hreg0[DWC2_HREG0_SIZE / 4];
+    uint32_t hreg1[DWC2_NB_CHAN * DWC2_HCREG_SIZE / 4];
+    uint32_t pcgreg[DWC2_PCGREG_SIZE / 4];
+
+    /* Virtual clock time of frame 0, HFNUM is derived from it */
+    int64_t frame_epoch;
+    uint32_t frame_step;   /* 8 microframes per frame at high speed */
+
+    DWC2Channel chan[DWC2_NB_CHAN];
+} DWC2State;
+
+#endif /* HW_USB_HCD_DWC2_H */
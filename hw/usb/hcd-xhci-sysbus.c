@@ -0,0 +1,128 @@
+/*
+ * USB xHCI controller emulation, sysbus front end
+ *
+ * For SoCs with a memory-mapped xHCI such as the BCM2711. There is no
+ * MSI: a single interrupter drives one wired interrupt line.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/module.h"
+#include "hw/irq.h"
+#include "hw/qdev-properties.h"
+#include "migration/vmstate.h"
+#include "hcd-xhci-sysbus.h"
+
+static void xhci_sysbus_intr_level(XHCIState *xhci, bool level)
+{
+    XHCISysbusState *s = container_of(xhci, XHCISysbusState, xhci);
+
+    qemu_set_irq(s->irq, level);
+}
+
+static void xhci_sysbus_intr_notify(XHCIState *xhci, int v)
+{
+    XHCISysbusState *s = container_of(xhci, XHCISysbusState, xhci);
+
+    if (v == 0) {
+        qemu_irq_raise(s->irq);
+    }
+}
+
+static void xhci_sysbus_reset(DeviceState *dev)
+{
+    XHCISysbusState *s = XHCI_SYSBUS(dev);
+
+    xhci_reset(&s->xhci);
+}
+
+static void xhci_sysbus_realize(DeviceState *dev, Error **errp)
+{
+    XHCISysbusState *s = XHCI_SYSBUS(dev);
+    Error *err = NULL;
+
+    if (s->dma_mr) {
+        address_space_init(&s->dma_as, s->dma_mr, "xhci-dma");
+        s->xhci.as = &s->dma_as;
+    } else {
+        s->xhci.as = &address_space_memory;
+    }
+    s->xhci.intr_level = xhci_sysbus_intr_level;
+    s->xhci.intr_notify = xhci_sysbus_intr_notify;
+
+    usb_xhci_realize(&s->xhci, dev, &err);
+    if (err) {
+        error_propagate(errp, err);
+        return;
+    }
+    sysbus_init_mmio(SYS_BUS_DEVICE(dev), &s->xhci.mem);
+}
+
+static void xhci_sysbus_unrealize(DeviceState *dev, Error **errp)
+{
+    XHCISysbusState *s = XHCI_SYSBUS(dev);
+
+    usb_xhci_unrealize(&s->xhci, dev);
+}
+
+static void xhci_sysbus_instance_init(Object *obj)
+{
+    XHCISysbusState *s = XHCI_SYSBUS(obj);
+
+    sysbus_init_irq(SYS_BUS_DEVICE(obj), &s->irq);
+
+    s->xhci.numintrs = 1;
+    s->xhci.flags |= 1 << XHCI_FLAG_SS_FIRST;
+}
+
+static const VMStateDescription vmstate_xhci_sysbus = {
+    .name = TYPE_XHCI_SYSBUS,
+    .version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_STRUCT(xhci, XHCISysbusState, 1, vmstate_xhci, XHCIState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static Property xhci_sysbus_properties[] = {
+    DEFINE_PROP_BIT("streams", XHCISysbusState, xhci.flags,
+                    XHCI_FLAG_ENABLE_STREAMS, true),
+    DEFINE_PROP_UINT32("p2", XHCISysbusState, xhci.numports_2, 1),
+    DEFINE_PROP_UINT32("p3", XHCISysbusState, xhci.numports_3, 1),
+    DEFINE_PROP_UINT32("slots", XHCISysbusState, xhci.numslots, MAXSLOTS),
+    DEFINE_PROP_LINK("dma", XHCISysbusState, dma_mr, TYPE_MEMORY_REGION,
+                     MemoryRegion *),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void xhci_sysbus_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = xhci_sysbus_realize;
+    dc->unrealize = xhci_sysbus_unrealize;
+    dc->reset = xhci_sysbus_reset;
+    dc->vmsd = &vmstate_xhci_sysbus;
+    dc->props = xhci_sysbus_properties;
+    set_bit(DEVICE_CATEGORY_USB, dc->categories);
+}
+
+static const TypeInfo xhci_sysbus_info = {
+    .name          = TYPE_XHCI_SYSBUS,
+    .parent        = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(XHCISysbusState),
+    .instance_init = xhci_sysbus_instance_init,
+    .class_init    = xhci_sysbus_class_init,
+};
+
+static void xhci_sysbus_register_types(void)
+{
+    type_register_static(&xhci_sysbus_info);
+}
+
+type_init(xhci_sysbus_register_types)
@@ -22,12 +22,8 @@
 #ifndef HW_USB_HCD_XHCI_H
 #define HW_USB_HCD_XHCI_H
 
-#define TYPE_XHCI "base-xhci"
-#define TYPE_NEC_XHCI "nec-usb-xhci"
-#define TYPE_QEMU_XHCI "qemu-xhci"
-
-#define XHCI(obj) \
-    OBJECT_CHECK(XHCIState, (obj), TYPE_XHCI)
+#include "hw/usb.h"
+#include "sysemu/dma.h"
 
 #define MAXPORTS_2 15
 #define MAXPORTS_3 15
@@ -39,6 +35,9 @@
 /* Very pessimistic, let's hope it's enough for all cases */
 #define EV_QUEUE (((3 * 24) + 16) * MAXSLOTS)
 
+/* Size of the register window; must be power of 2 */
+#define XHCI_LEN_REGS 0x4000
+
 typedef struct XHCIState XHCIState;
 typedef struct XHCIStreamContext XHCIStreamContext;
 typedef struct XHCIEPContext XHCIEPContext;
@@ -182,10 +181,20 @@ typedef struct XHCIInterrupter {
 
 } XHCIInterrupter;
 
+/*
+ * The controller core, embedded in a PCI or sysbus front end which fills
+ * in the DMA address space and the interrupt delivery callbacks.
+ */
 struct XHCIState {
-    /*< private >*/
-    PCIDevice parent_obj;
-    /*< public >*/
+    DeviceState *hostOpaque;
+    AddressSpace *as;
+
+    /* set the level of the legacy (interrupter 0) interrupt line */
+    void (*intr_level)(XHCIState *xhci, bool level);
+    /* interrupter v has a new event pending */
+    void (*intr_notify)(XHCIState *xhci, int v);
+    /* optional: interrupter v was enabled or disabled by the guest */
+    void (*intr_enable)(XHCIState *xhci, int v, bool enable);
 
     USBBus bus;
     MemoryRegion mem;
@@ -201,8 +210,6 @@ struct XHCIState {
     uint32_t numslots;
     uint32_t flags;
     uint32_t max_pstreams_mask;
-    OnOffAuto msi;
-    OnOffAuto msix;
 
     /* Operational Registers */
     uint32_t usbcmd;
@@ -229,4 +236,10 @@ struct XHCIState {
     bool nec_quirks;
 };
 
+extern const VMStateDescription vmstate_xhci;
+
+void usb_xhci_realize(XHCIState *xhci, DeviceState *dev, Error **errp);
+void usb_xhci_unrealize(XHCIState *xhci, DeviceState *dev);
+void xhci_reset(XHCIState *xhci);
+
 #endif
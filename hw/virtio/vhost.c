@@ -1444,6 +1444,11 @@ uint64_t vhost_get_features(struct vhost_dev *hdev, const int *feature_bits,
         }
         bit++;
     }
+    /*
+     * vhost_virtqueue_start() only hands the backend split ring state
+     * (no wrap counters), so packed rings stay in QEMU.
+     */
+    features &= ~(1ULL << VIRTIO_F_RING_PACKED);
     return features;
 }
 
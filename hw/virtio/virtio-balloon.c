@@ -380,6 +380,58 @@ static void virtio_balloon_handle_output(VirtIODevice *vdev, VirtQueue *vq)
     }
 }
 
+/*
+ * The guest reports runs of free pages, each in an in_sg entry, and gets
+ * them back once the host has dropped them.  Discarding zeroes the pages,
+ * so nothing is dropped while the balloon is inhibited, e.g. by VFIO.
+ * The whole batch is completed with a single interrupt.
+ */
+static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
+{
+    VirtQueueElement *elem;
+    bool inhibited = qemu_balloon_is_inhibited();
+    bool pushed = false;
+
+    while ((elem = virtqueue_pop(vq, sizeof(VirtQueueElement)))) {
+        unsigned int i;
+
+        for (i = 0; !inhibited && i < elem->in_num; i++) {
+            void *addr = elem->in_sg[i].iov_base;
+            size_t size = elem->in_sg[i].iov_len;
+            ram_addr_t rb_offset;
+            RAMBlock *rb;
+
+            /*
+             * Anything but RAM was mapped through a bounce buffer, that
+             * does not belong to any RAMBlock.
+             */
+            rb = qemu_ram_block_from_host(addr, false, &rb_offset);
+            if (!rb) {
+                trace_virtio_balloon_bad_addr(elem->in_addr[i]);
+                continue;
+            }
+
+            /* Only whole host pages can be dropped */
+            if (!QEMU_IS_ALIGNED(rb_offset | size, qemu_ram_pagesize(rb)) ||
+                rb_offset + size > qemu_ram_get_used_length(rb)) {
+                continue;
+            }
+
+            trace_virtio_balloon_handle_report(elem->in_addr[i], size);
+            /* errors were reported, and leave the pages in place */
+            ram_block_discard_range(rb, rb_offset, size);
+        }
+
+        virtqueue_push(vq, elem, 0);
+        g_free(elem);
+        pushed = true;
+    }
+
+    if (pushed) {
+        virtio_notify(vdev, vq);
+    }
+}
+
 static void virtio_balloon_receive_stats(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIOBalloon *s = VIRTIO_BALLOON(vdev);
@@ -816,6 +868,12 @@ static void virtio_balloon_device_realize(DeviceState *dev, Error **errp)
             virtio_error(vdev, "iothread is missing");
         }
     }
+
+    if (virtio_has_feature(s->host_features, VIRTIO_BALLOON_F_REPORTING)) {
+        s->reporting_vq = virtio_add_queue(vdev, 32,
+                                           virtio_balloon_handle_report);
+    }
+
     reset_stats(s);
 }
 
@@ -909,6 +967,8 @@ static Property virtio_balloon_properties[] = {
                     VIRTIO_BALLOON_F_DEFLATE_ON_OOM, false),
     DEFINE_PROP_BIT("free-page-hint", VirtIOBalloon, host_features,
                     VIRTIO_BALLOON_F_FREE_PAGE_HINT, false),
+    DEFINE_PROP_BIT("free-page-reporting", VirtIOBalloon, host_features,
+                    VIRTIO_BALLOON_F_REPORTING, false),
     /* QEMU 4.0 accidentally changed the config size even when free-page-hint
      * is disabled, resulting in QEMU 3.1 migration incompatibility.  This
      * property retains this quirk for QEMU 4.1 machine types.
@@ -18,6 +18,7 @@
 #include "qemu/event_notifier.h"
 #include "qemu/thread.h"
 #include "qemu/timer.h"
+#include "qemu/stats64.h"
 
 typedef struct BlockAIOCB BlockAIOCB;
 typedef void BlockCompletionFunc(void *opaque, int ret);
@@ -49,6 +50,13 @@ typedef void IOHandler(void *opaque);
 struct Coroutine;
 struct ThreadPool;
 struct LinuxAioState;
+struct LuringState;
+
+/*
+ * Buckets of AioContext.poll_wait_hist: bucket i counts waits shorter than
+ * 4^i microseconds (and at least 4^(i-1)); the last bucket counts the rest.
+ */
+#define AIO_POLL_WAIT_HIST_BUCKETS 8
 
 struct AioContext {
     GSource source;
@@ -122,6 +130,13 @@ struct AioContext {
      */
     struct LinuxAioState *linux_aio;
 #endif
+#ifdef CONFIG_LINUX_IO_URING
+    /*
+     * State for Linux io_uring.  Uses aio_context_acquire/release for
+     * locking.
+     */
+    struct LuringState *linux_io_uring;
+#endif
 
     /* TimerLists for calling timers - one per clock type.  Has its own
      * locking.
@@ -142,6 +157,16 @@ struct AioContext {
     /* Are we in polling mode or monitoring file descriptors? */
     bool poll_started;
 
+    /*
+     * Polling statistics, only collected while polling is enabled.  A hit
+     * is an aio_poll() that busy polling satisfied, a miss one that had to
+     * block after polling.  poll_wait_hist counts how long aio_poll()
+     * waited for an event, see AIO_POLL_WAIT_HIST_BUCKETS.
+     */
+    Stat64 poll_hits;
+    Stat64 poll_misses;
+    Stat64 poll_wait_hist[AIO_POLL_WAIT_HIST_BUCKETS];
+
     /* epoll(7) state used when built with CONFIG_EPOLL */
     int epollfd;
     bool epoll_enabled;
@@ -386,6 +411,12 @@ struct LinuxAioState *aio_setup_linux_aio(AioContext *ctx, Error **errp);
 /* Return the LinuxAioState bound to this AioContext */
 struct LinuxAioState *aio_get_linux_aio(AioContext *ctx);
 
+/* Setup the LuringState bound to this AioContext */
+struct LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp);
+
+/* Return the LuringState bound to this AioContext */
+struct LuringState *aio_get_linux_io_uring(AioContext *ctx);
+
 /**
  * aio_timer_new_with_attrs:
  * @ctx: the aio context
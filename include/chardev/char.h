@@ -35,6 +35,8 @@ typedef enum {
 } QEMUChrEvent;
 
 #define CHR_READ_BUF_LEN 4096
+/* Output held back at most by the flush-ms option */
+#define CHR_OUT_BUF_LEN 4096
 
 typedef enum {
     /* Whether the chardev peer is able to close and
@@ -68,6 +70,12 @@ struct Chardev {
     GSource *gsource;
     GMainContext *gcontext;
     DECLARE_BITMAP(features, QEMU_CHAR_FEATURE_LAST);
+
+    /* Output coalescing (flush-ms), protected by chr_write_lock */
+    guint flush_ms;
+    uint8_t *outbuf;
+    int outbuf_len;
+    GSource *flush_source;
 };
 
 /**
@@ -223,6 +231,8 @@ QemuOpts *qemu_chr_parse_compat(const char *label, const char *filename,
                                 bool permit_mux_mon);
 int qemu_chr_write(Chardev *s, const uint8_t *buf, int len, bool write_all);
 #define qemu_chr_write_all(s, buf, len) qemu_chr_write(s, buf, len, true)
+/* Write out the output that flush-ms is holding back, as far as possible */
+void qemu_chr_flush(Chardev *s);
 int qemu_chr_wait_connected(Chardev *chr, Error **errp);
 
 #define TYPE_CHARDEV "chardev"
@@ -0,0 +1,70 @@
+/*
+ * File-backed ring buffer chardev: file layout
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef CHARDEV_RINGBUF_FILE_H
+#define CHARDEV_RINGBUF_FILE_H
+
+/* Log readers include this file without qemu/osdep.h */
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * With "-chardev ringbuf,path=FILE" the ring buffer's storage is FILE
+ * itself, so a log reader can follow the chardev output by mapping FILE
+ * read-only.  QEMU never blocks on such readers, and does not know about
+ * them: a reader that falls behind by more than @size bytes loses data.
+ *
+ * FILE is sized once, when the chardev is opened: a RingbufFileHeader,
+ * padding up to @data_offset, then @size bytes of data, @size being a
+ * power of two.  Integers are in the byte order of the host running
+ * QEMU.  A reader must wait for @magic to read RINGBUF_FILE_MAGIC, which
+ * QEMU only stores after the rest of the header.
+ *
+ * Byte pos of the output (counted from 0 since the chardev was opened)
+ * is at ringbuf_file_data(hdr)[ringbuf_file_index(hdr, pos)].  @written
+ * is the number of bytes output so far, and @writing is raised to the
+ * value @written will have once a write is complete, before that write
+ * overwrites anything.  Both count modulo 2^32, like pos, because every
+ * host can load a 32-bit value in one access.  To read from pos:
+ *
+ *     end = atomic_load_acquire(&hdr->written);
+ *     ... copy bytes pos to end - 1 ...
+ *     atomic_thread_fence(memory_order_acquire);
+ *     lost = atomic_load(&hdr->writing) - hdr->size - pos;
+ *
+ * If lost, taken as a signed 32-bit value, is positive, the first lost
+ * bytes of the copy were overwritten while it was made (or before) and
+ * must be thrown away.
+ */
+
+#define RINGBUF_FILE_MAGIC      0x474e4952554d4551ULL /* "QEMURING" (LE) */
+#define RINGBUF_FILE_VERSION    1
+/* Largest @size, so that the counters can tell lost bytes from new ones */
+#define RINGBUF_FILE_MAX_SIZE   (1u << 30)
+
+typedef struct RingbufFileHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t data_offset;
+    uint32_t size;
+    uint32_t written;
+    uint32_t writing;
+    uint32_t reserved;
+} RingbufFileHeader;
+
+static inline const uint8_t *ringbuf_file_data(const RingbufFileHeader *hdr)
+{
+    return (const uint8_t *)hdr + hdr->data_offset;
+}
+
+static inline size_t ringbuf_file_index(const RingbufFileHeader *hdr,
+                                        uint32_t pos)
+{
+    return pos & (hdr->size - 1);
+}
+
+#endif
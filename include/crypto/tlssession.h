@@ -304,6 +304,30 @@ qcrypto_tls_session_get_handshake_status(QCryptoTLSSession *sess);
 int qcrypto_tls_session_get_key_size(QCryptoTLSSession *sess,
                                      Error **errp);
 
+/**
+ * qcrypto_tls_session_enable_ktls:
+ * @sess: the TLS session object
+ * @fd: the TCP socket that carries the session
+ * @read: whether to offload receiving rather than sending
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Install the record keys of one direction of the session
+ * into the kernel TLS layer of @fd (Linux only). From then on
+ * the records of that direction must be sent or received as
+ * plain data on @fd, not with qcrypto_tls_session_write() or
+ * qcrypto_tls_session_read().
+ *
+ * This must be called once the handshake is complete. Only
+ * TLS 1.2 and 1.3 sessions using AES-GCM can be offloaded.
+ * On failure the session is unchanged and may still be used.
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int qcrypto_tls_session_enable_ktls(QCryptoTLSSession *sess,
+                                    int fd,
+                                    bool read,
+                                    Error **errp);
+
 /**
  * qcrypto_tls_session_get_peer_name:
  * @sess: the TLS session object
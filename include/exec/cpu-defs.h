@@ -82,6 +82,9 @@ typedef uint64_t target_ulong;
 /* use a fully associative victim tlb of 8 entries */
 #define CPU_VTLB_SIZE 8
 
+/* number of separately tracked large page regions per mmu_idx */
+#define CPU_TLB_LARGE_PAGES 4
+
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
 #else
@@ -152,15 +155,23 @@ typedef struct CPUIOTLBEntry {
  * Data elements that are per MMU mode, minus the bits accessed by
  * the TCG fast path.
  */
+/*
+ * A region covering one or more large pages allocated into the tlb.
+ * The region is matched if (addr & mask) == addr; it is unused when
+ * both are -1.
+ */
+typedef struct CPUTLBLargePage {
+    target_ulong addr;
+    target_ulong mask;
+} CPUTLBLargePage;
+
 typedef struct CPUTLBDesc {
     /*
-     * Describe a region covering all of the large pages allocated
-     * into the tlb.  When any page within this region is flushed,
-     * we must flush the entire tlb.  The region is matched if
-     * (addr & large_page_mask) == large_page_addr.
+     * Describe regions covering all of the large pages allocated
+     * into the tlb.  When any page within a region is flushed,
+     * we must flush every entry within that region.
      */
-    target_ulong large_page_addr;
-    target_ulong large_page_mask;
+    CPUTLBLargePage large_page[CPU_TLB_LARGE_PAGES];
     /* host time (in ns) at the beginning of the time window */
     int64_t window_begin_ns;
     /* maximum number of entries observed in the window */
@@ -206,6 +217,14 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    /*
+     * Incremented by every flush on behalf of this CPU, including the
+     * ones caused by memory map changes.  Targets can use it to tell
+     * whether data they cached alongside the TLB (page table walks, host
+     * pointers to page tables) may still be used.  Only the CPU itself
+     * reads and writes it.
+     */
+    uint64_t flush_gen;
 } CPUTLBCommon;
 
 /*
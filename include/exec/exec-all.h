@@ -67,6 +67,10 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
                               target_ulong pc, target_ulong cs_base,
                               uint32_t flags,
                               int cflags);
+#ifdef CONFIG_USER_ONLY
+void tb_bench(CPUState *cpu, target_ulong start, target_ulong end,
+              int passes);
+#endif
 
 void QEMU_NORETURN cpu_loop_exit(CPUState *cpu);
 void QEMU_NORETURN cpu_loop_exit_restore(CPUState *cpu, uintptr_t pc);
@@ -195,6 +199,32 @@ void tlb_flush_page_by_mmuidx_all_cpus(CPUState *cpu, target_ulong addr,
  */
 void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *cpu, target_ulong addr,
                                               uint16_t idxmap);
+/**
+ * tlb_flush_range_by_mmuidx:
+ * @cpu: CPU whose TLB should be flushed
+ * @addr: virtual address of the start of the range
+ * @len: length of the range in bytes
+ * @idxmap: bitmap of MMU indexes to flush
+ *
+ * Flush every page overlapping [@addr, @addr + @len) from the TLB of
+ * the specified CPU, for the specified MMU indexes, as one piece of work.
+ */
+void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
+                               target_ulong len, uint16_t idxmap);
+/**
+ * tlb_flush_range_by_mmuidx_all_cpus_synced:
+ * @cpu: Originating CPU of the flush
+ * @addr: virtual address of the start of the range
+ * @len: length of the range in bytes
+ * @idxmap: bitmap of MMU indexes to flush
+ *
+ * Like tlb_flush_page_by_mmuidx_all_cpus_synced, but for every page
+ * overlapping the range, at the cost of a single synchronisation point.
+ */
+void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *cpu,
+                                               target_ulong addr,
+                                               target_ulong len,
+                                               uint16_t idxmap);
 /**
  * tlb_flush_by_mmuidx:
  * @cpu: CPU whose TLB should be flushed
@@ -205,6 +235,19 @@ void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *cpu, target_ulong addr,
  * MMU indexes.
  */
 void tlb_flush_by_mmuidx(CPUState *cpu, uint16_t idxmap);
+/**
+ * tlb_flush_by_mmuidx_filtered:
+ * @cpu: CPU whose TLB should be flushed; must be the current CPU
+ * @idxmap: bitmap of MMU indexes to flush
+ * @keep: returns true for entries to leave in place, given the
+ *        attributes the target filled them in with
+ *
+ * Flush the entries of the specified MMU indexes for which @keep returns
+ * false, e.g. all but the global ones on an address space switch. The
+ * jump cache is cleared as for a full flush.
+ */
+void tlb_flush_by_mmuidx_filtered(CPUState *cpu, uint16_t idxmap,
+                                  bool (*keep)(MemTxAttrs attrs));
 /**
  * tlb_flush_by_mmuidx_all_cpus:
  * @cpu: Originating CPU of the flush
@@ -291,6 +334,11 @@ static inline void tlb_flush_page_by_mmuidx(CPUState *cpu,
 static inline void tlb_flush_by_mmuidx(CPUState *cpu, uint16_t idxmap)
 {
 }
+static inline void tlb_flush_by_mmuidx_filtered(CPUState *cpu,
+                                                uint16_t idxmap,
+                                                bool (*keep)(MemTxAttrs attrs))
+{
+}
 static inline void tlb_flush_page_by_mmuidx_all_cpus(CPUState *cpu,
                                                      target_ulong addr,
                                                      uint16_t idxmap)
@@ -301,6 +349,16 @@ static inline void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *cpu,
                                                             uint16_t idxmap)
 {
 }
+static inline void tlb_flush_range_by_mmuidx(CPUState *cpu, target_ulong addr,
+                                             target_ulong len, uint16_t idxmap)
+{
+}
+static inline void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *cpu,
+                                                             target_ulong addr,
+                                                             target_ulong len,
+                                                             uint16_t idxmap)
+{
+}
 static inline void tlb_flush_by_mmuidx_all_cpus(CPUState *cpu, uint16_t idxmap)
 {
 }
@@ -366,6 +424,10 @@ struct TranslationBlock {
     /* Per-vCPU dynamic tracing state used to generate this TB */
     uint32_t trace_vcpu_dstate;
 
+    /* Executions and host ticks spent, counted while tb_profile is on */
+    uint64_t exec_count;
+    uint64_t exec_ticks;
+
     struct tb_tc tc;
 
     /* original tb when cflags has CF_NOCACHE */
@@ -435,6 +497,10 @@ void tb_invalidate_phys_range(target_ulong start, target_ulong end);
 void tb_invalidate_phys_addr(AddressSpace *as, hwaddr addr, MemTxAttrs attrs);
 #endif
 void tb_flush(CPUState *cpu);
+/* Set by "jit-profile on": count TB executions, unchained */
+extern bool tb_profile;
+void tb_profile_set(CPUState *cpu, bool on);
+void tb_profile_reset(void);
 void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr);
 TranslationBlock *tb_htable_lookup(CPUState *cpu, target_ulong pc,
                                    target_ulong cs_base, uint32_t flags,
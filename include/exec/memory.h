@@ -384,6 +384,7 @@ struct MemoryRegion {
     bool ram_device;
     bool enabled;
     bool warning_printed; /* For reservations */
+    bool aliased; /* Target of an alias, may appear in several trees */
     uint8_t vga_logging_count;
     MemoryRegion *alias;
     hwaddr alias_offset;
@@ -458,6 +459,10 @@ struct AddressSpace {
     struct MemoryRegionIoeventfd *ioeventfds;
     QTAILQ_HEAD(, MemoryListener) listeners;
     QTAILQ_ENTRY(AddressSpace) address_spaces_link;
+
+    /* Outstanding address_space_map() bounce buffers.  */
+    QLIST_HEAD(, BounceBuffer) bounce_buffers;
+    size_t bounce_buffer_size;
 };
 
 typedef struct AddressSpaceDispatch AddressSpaceDispatch;
@@ -1733,6 +1738,24 @@ void memory_global_dirty_log_stop(void);
 
 void mtree_info(bool flatview, bool dispatch_tree, bool owner);
 
+/* Set by "mmio-stats on": count dispatched accesses per region and offset */
+extern bool mmio_stats_enabled;
+
+/**
+ * mmio_stats_set: start or stop counting MMIO accesses
+ *
+ * Counters are kept across mmio_stats_set(false); see mmio_stats_reset().
+ * Query them with x-query-mmio-hotspots or "info mmio-hotspots".
+ *
+ * @on: whether to count accesses
+ */
+void mmio_stats_set(bool on);
+
+/**
+ * mmio_stats_reset: drop all MMIO access counters
+ */
+void mmio_stats_reset(void);
+
 /**
  * memory_region_dispatch_read: perform a read directly to the specified
  * MemoryRegion.
@@ -2062,6 +2085,8 @@ bool address_space_access_valid(AddressSpace *as, hwaddr addr, hwaddr len,
  *
  * May map a subset of the requested range, given by and returned in @plen.
  * May return %NULL if resources needed to perform the mapping are exhausted.
+ * Regions that are not RAM are accessed through a bounce buffer; each
+ * #AddressSpace has a limited amount of those.
  * Use only for reads OR writes - not for read-modify-write operations.
  * Use cpu_register_map_client() to know when retrying the map operation is
  * likely to succeed.
@@ -0,0 +1,56 @@
+/*
+ * TCG plugin support, generation of the instrumentation
+ *
+ * Include this only from the files that emit TCG code.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef QEMU_PLUGIN_GEN_H
+#define QEMU_PLUGIN_GEN_H
+
+#include "qemu/plugin.h"
+#include "tcg/tcg.h"
+
+struct DisasContextBase;
+
+#ifdef CONFIG_PLUGIN
+
+bool plugin_gen_tb_start(CPUState *cpu, const TranslationBlock *tb);
+void plugin_gen_tb_end(CPUState *cpu);
+void plugin_gen_insn_start(CPUState *cpu, const struct DisasContextBase *db);
+void plugin_gen_insn_end(CPUState *cpu, const struct DisasContextBase *db);
+
+TCGv plugin_prep_mem_callbacks(TCGv addr);
+void plugin_gen_mem_callbacks(TCGv addr, uint8_t info);
+
+#else /* !CONFIG_PLUGIN */
+
+static inline
+bool plugin_gen_tb_start(CPUState *cpu, const TranslationBlock *tb)
+{
+    return false;
+}
+
+static inline void plugin_gen_tb_end(CPUState *cpu)
+{ }
+
+static inline
+void plugin_gen_insn_start(CPUState *cpu, const struct DisasContextBase *db)
+{ }
+
+static inline
+void plugin_gen_insn_end(CPUState *cpu, const struct DisasContextBase *db)
+{ }
+
+static inline TCGv plugin_prep_mem_callbacks(TCGv addr)
+{
+    return addr;
+}
+
+static inline void plugin_gen_mem_callbacks(TCGv addr, uint8_t info)
+{ }
+
+#endif /* CONFIG_PLUGIN */
+
+#endif /* QEMU_PLUGIN_GEN_H */
@@ -540,8 +540,22 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
         }
     } else {
         ram_addr_t offset = rb->offset;
+        unsigned long * const *src;
+
+        src = atomic_rcu_read(
+                &ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION])->blocks;
 
         for (addr = 0; addr < length; addr += TARGET_PAGE_SIZE) {
+            unsigned long page = (start + addr + offset) >> TARGET_PAGE_BITS;
+            unsigned long bit = page % DIRTY_MEMORY_BLOCK_SIZE;
+
+            /* Skip the rest of a clean word without the per-page lookups */
+            if (!atomic_read(&src[page / DIRTY_MEMORY_BLOCK_SIZE]
+                                 [BIT_WORD(bit)])) {
+                addr += (BITS_PER_LONG - 1 - bit % BITS_PER_LONG)
+                        << TARGET_PAGE_BITS;
+                continue;
+            }
             if (cpu_physical_memory_test_and_clear_dirty(
                         start + addr + offset,
                         TARGET_PAGE_SIZE,
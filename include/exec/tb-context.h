@@ -35,6 +35,8 @@ struct TBContext {
 
     /* statistics */
     unsigned tb_flush_count;
+    /* bumped by each reclaim or flush, so that stale reclaims are skipped */
+    unsigned tb_reclaim_count;
 };
 
 extern TBContext tb_ctx;
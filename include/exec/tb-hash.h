@@ -59,6 +59,15 @@ static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
 
 #endif /* CONFIG_SOFTMMU */
 
+/*
+ * First slot of the set @pc maps to. The ways of a set are adjacent
+ * slots, so a set never straddles the slots of two pages.
+ */
+static inline unsigned int tb_jmp_cache_set_func(target_ulong pc)
+{
+    return tb_jmp_cache_hash_func(pc) & ~(TB_JMP_CACHE_WAYS - 1);
+}
+
 static inline
 uint32_t tb_hash_func(tb_page_addr_t phys_pc, target_ulong pc, uint32_t flags,
                       uint32_t cf_mask, uint32_t trace_vcpu_dstate)
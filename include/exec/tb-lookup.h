@@ -16,6 +16,20 @@
 #include "exec/exec-all.h"
 #include "exec/tb-hash.h"
 
+/*
+ * Make @tb the most recently used entry of its jump cache set, pushing
+ * the others down one way; the last way falls out.
+ */
+static inline void tb_jmp_cache_insert(CPUState *cpu, unsigned int set,
+                                       unsigned int way, TranslationBlock *tb)
+{
+    for (; way > 0; way--) {
+        atomic_set(&cpu->tb_jmp_cache[set + way],
+                   atomic_read(&cpu->tb_jmp_cache[set + way - 1]));
+    }
+    atomic_set(&cpu->tb_jmp_cache[set], tb);
+}
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *
 tb_lookup__cpu_state(CPUState *cpu, target_ulong *pc, target_ulong *cs_base,
@@ -23,28 +37,36 @@ tb_lookup__cpu_state(CPUState *cpu, target_ulong *pc, target_ulong *cs_base,
 {
     CPUArchState *env = (CPUArchState *)cpu->env_ptr;
     TranslationBlock *tb;
-    uint32_t hash;
+    unsigned int set, way;
 
     cpu_get_tb_cpu_state(env, pc, cs_base, flags);
-    hash = tb_jmp_cache_hash_func(*pc);
-    tb = atomic_rcu_read(&cpu->tb_jmp_cache[hash]);
+    set = tb_jmp_cache_set_func(*pc);
 
     cf_mask &= ~CF_CLUSTER_MASK;
     cf_mask |= cpu->cluster_index << CF_CLUSTER_SHIFT;
 
-    if (likely(tb &&
-               tb->pc == *pc &&
-               tb->cs_base == *cs_base &&
-               tb->flags == *flags &&
-               tb->trace_vcpu_dstate == *cpu->trace_dstate &&
-               (tb_cflags(tb) & (CF_HASH_MASK | CF_INVALID)) == cf_mask)) {
-        return tb;
+    for (way = 0; way < TB_JMP_CACHE_WAYS; way++) {
+        tb = atomic_rcu_read(&cpu->tb_jmp_cache[set + way]);
+        if (likely(tb &&
+                   tb->pc == *pc &&
+                   tb->cs_base == *cs_base &&
+                   tb->flags == *flags &&
+                   tb->trace_vcpu_dstate == *cpu->trace_dstate &&
+                   (tb_cflags(tb) & (CF_HASH_MASK | CF_INVALID)) == cf_mask)) {
+            atomic_set(&cpu->tb_jmp_cache_hits, cpu->tb_jmp_cache_hits + 1);
+            if (way) {
+                tb_jmp_cache_insert(cpu, set, way, tb);
+            }
+            return tb;
+        }
     }
+    atomic_set(&cpu->tb_jmp_cache_misses, cpu->tb_jmp_cache_misses + 1);
     tb = tb_htable_lookup(cpu, *pc, *cs_base, *flags, cf_mask);
     if (tb == NULL) {
+        atomic_set(&cpu->tb_htable_misses, cpu->tb_htable_misses + 1);
         return NULL;
     }
-    atomic_set(&cpu->tb_jmp_cache[hash], tb);
+    tb_jmp_cache_insert(cpu, set, TB_JMP_CACHE_WAYS - 1, tb);
     return tb;
 }
 
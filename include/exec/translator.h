@@ -142,4 +142,23 @@ void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
 
 void translator_loop_temp_check(DisasContextBase *db);
 
+/**
+ * translator_follow_branch:
+ * @db: Disassembly context.
+ * @dest: Target of an unconditional direct branch.
+ * @insn_size: Size of the instructions following @dest.
+ *
+ * Try to continue translating at @dest instead of ending the TB with a
+ * jump there, so that the code on both sides of the branch is optimized
+ * together and the goto_tb exit and the entry of the next TB are saved.
+ * The caller must already know that it could chain the jump with
+ * goto_tb; this then only accepts forward branches within the page of
+ * the TB, outside of single-stepping and I/O or icount translations.
+ *
+ * Returns true if translation goes on at @dest, in which case the
+ * caller must not emit the jump.
+ */
+bool translator_follow_branch(DisasContextBase *db, target_ulong dest,
+                              int insn_size);
+
 #endif /* EXEC__TRANSLATOR_H */
@@ -12,18 +12,29 @@
 #define BCM2835_PERIPHERALS_H
 
 #include "hw/sysbus.h"
+#include "hw/audio/bcm2835_i2s.h"
 #include "hw/char/pl011.h"
 #include "hw/char/bcm2835_aux.h"
 #include "hw/display/bcm2835_fb.h"
+#include "hw/display/bcm2835_hvs.h"
 #include "hw/dma/bcm2835_dma.h"
 #include "hw/intc/bcm2835_ic.h"
 #include "hw/misc/bcm2835_property.h"
 #include "hw/misc/bcm2835_rng.h"
 #include "hw/misc/bcm2835_mbox.h"
+#include "hw/misc/bcm2835_cprman.h"
+#include "hw/misc/bcm2835_thermal.h"
+#include "hw/misc/bcm2835_powermgt.h"
 #include "hw/sd/sdhci.h"
 #include "hw/sd/bcm2835_sdhost.h"
 #include "hw/gpio/bcm2835_gpio.h"
+#include "hw/i2c/bcm2835_i2c.h"
+#include "hw/ssi/bcm2835_spi.h"
+#include "hw/timer/bcm2835_systmr.h"
+#include "hw/usb/hcd-dwc2.h"
+#include "hw/usb/hcd-xhci-sysbus.h"
 #include "hw/misc/unimp.h"
+#include "hw/or-irq.h"
 
 #define TYPE_BCM2835_PERIPHERALS "bcm2835-peripherals"
 #define BCM2835_PERIPHERALS(obj) \
@@ -36,36 +47,47 @@ typedef struct BCM2835PeripheralState {
 
     MemoryRegion peri_mr, peri_mr_alias, gpu_bus_mr, mbox_mr;
     MemoryRegion ram_alias[4];
+    MemoryRegion dma4_bus_mr, dma4_ram_alias, dma4_peri_alias;
+    MemoryRegion vcram_mr;
     qemu_irq irq, fiq;
 
-    UnimplementedDeviceState pm;
-    UnimplementedDeviceState cprman;
-    UnimplementedDeviceState a2w;
+    BCM2835PowerMgtState pm;
+    BCM2835CprmanState cprman;
+    BCM2835SystemTimerState systmr;
     PL011State uart0;
     UnimplementedDeviceState uartu[6];
     BCM2835AuxState aux;
     BCM2835FBState fb;
+    BCM2835HVSState hvs;
     BCM2835DMAState dma;
     BCM2835ICState ic;
     BCM2835PropertyState property;
     BCM2835RngState rng;
+    BCM2835ThermalState thermal;
     BCM2835MboxState mboxes;
     SDHCIState sdhci;
+    SDHCIState emmc2;
     BCM2835SDHostState sdhost;
     BCM2835GpioState gpio;
-    UnimplementedDeviceState i2s;
-    UnimplementedDeviceState spi[7];
-    UnimplementedDeviceState i2c[7];
+    BCM2835I2SState i2s;
+    BCM2835SPIState spi[7]; /* spi[1] and spi[2] live in the aux block */
+    BCM2835I2CState i2c[7];
+    qemu_or_irq spi_irq_orgate, i2c_irq_orgate;
     UnimplementedDeviceState otp;
     UnimplementedDeviceState dbus;
     UnimplementedDeviceState ave0;
     UnimplementedDeviceState bscsl;
     UnimplementedDeviceState smi;
-    UnimplementedDeviceState dwc2;
-    UnimplementedDeviceState xhci;
+    DWC2State dwc2;
+    XHCISysbusState xhci;
+    UnimplementedDeviceState xhci_unimp;
     UnimplementedDeviceState argon;
     UnimplementedDeviceState v3d;
     UnimplementedDeviceState sdramc;
+
+    bool enable_emmc2;
+    bool enable_xhci;
+    bool vcram_memfd;
 } BCM2835PeripheralState;
 
 #endif /* BCM2835_PERIPHERALS_H */
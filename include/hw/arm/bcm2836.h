@@ -14,12 +14,30 @@
 #include "hw/arm/bcm2835_peripherals.h"
 #include "hw/intc/bcm2836_control.h"
 #include "hw/intc/arm_gic.h"
+#include "hw/or-irq.h"
+#include "hw/core/split-irq.h"
+#include "hw/pci-host/bcm2838_pcie.h"
+#include "hw/net/bcm2838_genet.h"
 #include "target/arm/cpu.h"
 
 #define TYPE_BCM283X "bcm283x"
 #define BCM283X(obj) OBJECT_CHECK(BCM283XState, (obj), TYPE_BCM283X)
 
+/* Cores wired to the ARM control block */
 #define BCM283X_NCPUS 4
+/* bcm2838 can be given extra cores behind its GICv2 */
+#define BCM283X_MAX_CPUS GIC_NCPU
+
+/*
+ * Optional virtio-mmio transports. They are not part of the real SoCs:
+ * QEMU puts them in an unused part of the peripheral window and routes
+ * them to GPU interrupts nothing else raises, or to spare GIC SPIs.
+ */
+#define BCM283X_VIRTIO_MMIO_NUM      4
+#define BCM283X_VIRTIO_MMIO_OFFSET   0xd00000
+#define BCM283X_VIRTIO_MMIO_SIZE     0x200
+#define BCM283X_VIRTIO_MMIO_GPU_IRQ  4 /* INTERRUPT_CODEC0 onwards */
+#define BCM2838_VIRTIO_MMIO_SPI      224
 
 /* These type names are for specific SoCs; other than instantiating
  * them, code using these devices should always handle them via the
@@ -35,12 +53,23 @@ typedef struct BCM283XState {
     /*< public >*/
 
     char *cpu_type;
+    uint32_t num_cpus;
     uint32_t enabled_cpus;
+    bool virtio_mmio;
+    /* Where the virtio-mmio transports ended up, for the device tree */
+    hwaddr virtio_mmio_base;
+    bool virtio_mmio_on_gic;
 
-    ARMCPU cpus[BCM283X_NCPUS];
+    ARMCPU cpus[BCM283X_MAX_CPUS];
     GICState gic;
+    /* bcm2838: CPU irq/fiq are driven by both the GIC and the control block */
+    qemu_or_irq irq_orgate[BCM283X_MAX_CPUS];
+    qemu_or_irq fiq_orgate[BCM283X_MAX_CPUS];
+    SplitIRQ gtimer_splitter[BCM283X_MAX_CPUS][NUM_GTIMERS];
     BCM2836ControlState control;
     BCM2835PeripheralState peripherals;
+    BCM2838PCIEHostState pcie;
+    BCM2838GenetState genet;
 } BCM283XState;
 
 typedef struct BCM283XInfo BCM283XInfo;
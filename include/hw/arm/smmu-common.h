@@ -93,6 +93,18 @@ typedef struct SMMUIOTLBKey {
     uint16_t asid;
 } SMMUIOTLBKey;
 
+typedef struct SMMUTLBEntry {
+    IOMMUTLBEntry entry;
+    SMMUIOTLBKey key;
+    QTAILQ_ENTRY(SMMUTLBEntry) lru;         /* most recently used first */
+    QLIST_ENTRY(SMMUTLBEntry) asid_next;
+} SMMUTLBEntry;
+
+/* The IOTLB entries of one ASID, so that they go with a single lookup */
+typedef struct SMMUIOTLBAsid {
+    QLIST_HEAD(, SMMUTLBEntry) entries;
+} SMMUIOTLBAsid;
+
 typedef struct SMMUState {
     /* <private> */
     SysBusDevice  dev;
@@ -102,6 +114,11 @@ typedef struct SMMUState {
     GHashTable *smmu_pcibus_by_busptr;
     GHashTable *configs; /* cache for configuration data */
     GHashTable *iotlb;
+    GHashTable *iotlb_asids;
+    QTAILQ_HEAD(, SMMUTLBEntry) iotlb_lru;
+    uint32_t iotlb_size;       /* maximum number of entries */
+    uint64_t iotlb_hits;
+    uint64_t iotlb_misses;
     SMMUPciBus *smmu_pcibus_by_bus_num[SMMU_PCI_BUS_MAX];
     PCIBus *pci_bus;
     QLIST_HEAD(, SMMUDevice) devices_with_notifiers;
@@ -153,9 +170,24 @@ IOMMUMemoryRegion *smmu_iommu_mr(SMMUState *s, uint32_t sid);
 
 #define SMMU_IOTLB_MAX_SIZE 256
 
+/*
+ * Return the cached translation of the page at @iova (aligned to the
+ * granule) in @asid, or NULL.  The entry stays valid until the next
+ * insertion or invalidation.
+ */
+IOMMUTLBEntry *smmu_iotlb_lookup(SMMUState *s, uint16_t asid, dma_addr_t iova);
+/* Cache a copy of @entry, evicting the least recently used one if full */
+void smmu_iotlb_insert(SMMUState *s, uint16_t asid, IOMMUTLBEntry *entry);
+
 void smmu_iotlb_inv_all(SMMUState *s);
 void smmu_iotlb_inv_asid(SMMUState *s, uint16_t asid);
 void smmu_iotlb_inv_iova(SMMUState *s, uint16_t asid, dma_addr_t iova);
+/*
+ * Invalidate the entries translating any of [@iova, @iova + @size - 1],
+ * in @asid or, if @asid is negative, in all ASIDs
+ */
+void smmu_iotlb_inv_range(SMMUState *s, int asid, dma_addr_t iova,
+                          uint64_t size);
 
 /* Unmap the range of all the notifiers registered to any IOMMU mr */
 void smmu_inv_notifiers_all(SMMUState *s);
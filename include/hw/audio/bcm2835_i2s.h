@@ -0,0 +1,61 @@
+/*
+ * BCM2835 (Raspberry Pi) PCM/I2S audio interface
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#ifndef BCM2835_I2S_H
+#define BCM2835_I2S_H
+
+#include "hw/sysbus.h"
+#include "hw/misc/bcm2835_cprman.h"
+#include "audio/audio.h"
+
+#define TYPE_BCM2835_I2S "bcm2835-i2s"
+#define BCM2835_I2S(obj) \
+    OBJECT_CHECK(BCM2835I2SState, (obj), TYPE_BCM2835_I2S)
+
+#define BCM2835_I2S_FIFO_SIZE   64
+/* Words queued for playback, the last BCM2835_I2S_FIFO_SIZE being the FIFO */
+#define BCM2835_I2S_RING_SIZE   2048
+
+/* Named GPIO outputs for the DMA request lines */
+#define BCM2835_I2S_DREQ_TX     "dreq-tx"
+#define BCM2835_I2S_DREQ_RX     "dreq-rx"
+
+typedef struct {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion iomem;
+    qemu_irq irq;
+    qemu_irq dreq_tx, dreq_rx;
+    BCM2835CprmanState *cprman;
+    QEMUSoundCard card;
+    SWVoiceOut *voice;
+    uint32_t freq;      /* sample rate when PCM_CLK comes from the codec */
+
+    /* frame layout the voice was opened for */
+    int channels;
+    int width;          /* bits per sample */
+    bool packed;        /* both 16-bit samples in one FIFO word */
+
+    uint32_t cs;
+    uint32_t mode;
+    uint32_t rxc;
+    uint32_t txc;
+    uint32_t dreq;
+    uint32_t inten;
+    uint32_t intstc;
+    uint32_t gray;
+
+    /*
+     * TX words, written at @head by the FIFO register and read at @tail
+     * by the audio callback; both count words and wrap around.
+     */
+    uint32_t ring[BCM2835_I2S_RING_SIZE];
+    uint32_t head, tail;
+} BCM2835I2SState;
+
+#endif
@@ -15,6 +15,7 @@
 #define BCM2835_AUX(obj) OBJECT_CHECK(BCM2835AuxState, (obj), TYPE_BCM2835_AUX)
 
 #define BCM2835_AUX_RX_FIFO_LEN 8
+#define BCM2835_AUX_TX_BATCH    256 /* characters buffered before a flush */
 
 typedef struct {
     /*< private >*/
@@ -24,6 +25,10 @@ typedef struct {
     MemoryRegion iomem;
     CharBackend chr;
     qemu_irq irq;
+    QEMUBH *tx_bh;
+
+    uint8_t tx_buf[BCM2835_AUX_TX_BATCH];
+    int tx_count;
 
     uint8_t read_fifo[BCM2835_AUX_RX_FIFO_LEN];
     uint8_t read_pos, read_count;
@@ -25,6 +25,9 @@
 /* This shares the same struct (and cast macro) as the base pl011 device */
 #define TYPE_PL011_LUMINARY "pl011_luminary"
 
+/* Characters buffered before the transmit path is flushed to the chardev */
+#define PL011_TX_BATCH 256
+
 typedef struct PL011State {
     SysBusDevice parent_obj;
 
@@ -48,6 +51,9 @@ typedef struct PL011State {
     CharBackend chr;
     qemu_irq irq[6];
     const unsigned char *id;
+    QEMUBH *tx_bh;
+    uint8_t tx_buf[PL011_TX_BATCH];
+    int tx_count;
 } PL011State;
 
 static inline DeviceState *pl011_create(hwaddr addr,
@@ -26,6 +26,7 @@
 #include "exec/memattrs.h"
 #include "qapi/qapi-types-run-state.h"
 #include "qemu/bitmap.h"
+#include "qemu/plugin.h"
 #include "qemu/rcu_queue.h"
 #include "qemu/queue.h"
 #include "qemu/thread.h"
@@ -274,6 +275,8 @@ struct hax_vcpu_state;
 
 #define TB_JMP_CACHE_BITS 12
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
+/* Entries per set; a set is that many adjacent tb_jmp_cache slots */
+#define TB_JMP_CACHE_WAYS 2
 
 /* work queue */
 
@@ -345,6 +348,7 @@ struct qemu_work_item;
  * @trace_dstate_delayed: Delayed changes to trace_dstate (includes all changes
  *                        to @trace_dstate).
  * @trace_dstate: Dynamic tracing state of events for this vCPU (bitmask).
+ * @plugin_scoreboards: This vCPU's elements of the plugin scoreboards.
  * @ignore_memory_transaction_failures: Cached copy of the MachineState
  *    flag of the same name: allows the board to suppress calling of the
  *    CPU do_transaction_failed hook function.
@@ -395,6 +399,10 @@ struct CPUState {
 
     /* Accessed in parallel; all accesses must be atomic */
     struct TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];
+    /* Lookup statistics; only written by the vCPU thread itself */
+    size_t tb_jmp_cache_hits;
+    size_t tb_jmp_cache_misses;
+    size_t tb_htable_misses;
 
     struct GDBRegisterState *gdb_regs;
     int gdb_num_regs;
@@ -429,6 +437,11 @@ struct CPUState {
     DECLARE_BITMAP(trace_dstate_delayed, CPU_TRACE_DSTATE_MAX_EVENTS);
     DECLARE_BITMAP(trace_dstate, CPU_TRACE_DSTATE_MAX_EVENTS);
 
+#ifdef CONFIG_PLUGIN
+    /* Read by the inline ops of the translated code */
+    void *plugin_scoreboards[QEMU_PLUGIN_MAX_SCOREBOARDS];
+#endif
+
     /* TODO Move common fields from CPUArchState here. */
     int cpu_index;
     int cluster_index;
@@ -443,6 +456,18 @@ struct CPUState {
      * autoconverge
      */
     bool throttle_thread_scheduled;
+    /* Used instead of the global percentage after cpu_throttle_set_vcpu */
+    int throttle_percentage;
+
+    /* Guest pages first written by this vcpu while dirty logging is on.
+     * Only TCG counts them, in the notdirty write path.
+     */
+    uint32_t dirty_pages;
+    /* Read by migration: dirty_pages at the last sync, and the dirty rate
+     * in bytes per second since the sync before
+     */
+    uint32_t dirty_pages_prev;
+    uint64_t dirty_rate;
 
     bool ignore_memory_transaction_failures;
 
@@ -848,10 +873,31 @@ bool cpu_throttle_active(void);
  *
  * Returns the vcpu throttle percentage. See cpu_throttle_set for details.
  *
- * Returns: The throttle percentage in range 1 to 99.
+ * Returns: The throttle percentage in range 1 to 99.  With per-vcpu
+ * throttling, this is the highest percentage of all vcpus.
  */
 int cpu_throttle_get_percentage(void);
 
+/**
+ * cpu_throttle_set_vcpu:
+ * @cpu: The vcpu to throttle.
+ * @new_throttle_pct: Percent of sleep time. Valid range is 0 to 99.
+ *
+ * Like cpu_throttle_set, but only for @cpu: the other vcpus keep their
+ * own percentage, which is the global one if they were throttled with
+ * cpu_throttle_set before.  A percentage of 0 stops throttling @cpu.
+ * cpu_throttle_set switches back to throttling all vcpus alike.
+ */
+void cpu_throttle_set_vcpu(CPUState *cpu, int new_throttle_pct);
+
+/**
+ * cpu_throttle_get_vcpu_percentage:
+ * @cpu: The vcpu to query.
+ *
+ * Returns: The throttle percentage of @cpu, in range 0 to 99.
+ */
+int cpu_throttle_get_vcpu_percentage(CPUState *cpu);
+
 #ifndef CONFIG_USER_ONLY
 
 typedef void (*CPUInterruptHandler)(CPUState *, int);
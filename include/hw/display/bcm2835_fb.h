@@ -13,6 +13,7 @@
 
 #include "hw/sysbus.h"
 #include "ui/console.h"
+#include "ui/pixel-conv.h"
 
 #define TYPE_BCM2835_FB "bcm2835-fb"
 #define BCM2835_FB(obj) OBJECT_CHECK(BCM2835FBState, (obj), TYPE_BCM2835_FB)
@@ -41,11 +42,18 @@ typedef struct {
     AddressSpace dma_as;
     MemoryRegion iomem;
     MemoryRegionSection fbsection;
+    /* Visible window within fbsection, for page flipping */
+    hwaddr scanout_offset;
+    uint32_t scanout_xoffset;
     QemuConsole *con;
     qemu_irq mbox_irq;
 
     bool lock, invalidate, pending;
 
+    /* Line converter and 8bpp palette, set up by each refresh */
+    PixelConvFunc *conv;
+    uint32_t palette[256];
+
     BCM2835FBConfig config;
     BCM2835FBConfig initial_config;
 } BCM2835FBState;
@@ -0,0 +1,46 @@
+/*
+ * BCM2835 (Raspberry Pi) Hardware Video Scaler (HVS)
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#ifndef BCM2835_HVS_H
+#define BCM2835_HVS_H
+
+#include "hw/sysbus.h"
+#include "ui/console.h"
+
+#define TYPE_BCM2835_HVS "bcm2835-hvs"
+#define BCM2835_HVS(obj) OBJECT_CHECK(BCM2835HVSState, (obj), TYPE_BCM2835_HVS)
+
+#define BCM2835_HVS_CHANNELS    3
+
+/* Register space; the display list memory follows it */
+#define BCM2835_HVS_REGS_SIZE   0x2000
+#define BCM2838_HVS_REGS_SIZE   0x4000
+#define BCM2835_HVS_DLIST_SIZE  0x4000
+
+typedef struct {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion iomem;
+    MemoryRegion *dma_mr;
+    AddressSpace dma_as;
+    QemuConsole *con;
+
+    /* bcm2838 (HVS5) register and display list layout */
+    bool hvs5;
+    bool invalidate;
+
+    uint32_t regs[BCM2838_HVS_REGS_SIZE / 4];
+    uint32_t dlist[BCM2835_HVS_DLIST_SIZE / 4];
+    uint32_t frame_count[BCM2835_HVS_CHANNELS];
+
+    /* Composition scratch: one source line and one output line */
+    uint8_t *src_line;
+    uint32_t *out_line;
+} BCM2835HVSState;
+
+#endif
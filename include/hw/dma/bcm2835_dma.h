@@ -18,7 +18,14 @@ typedef struct {
     uint32_t stride;
     uint32_t nextconbk;
     uint32_t debug;
+    uint32_t srci;    /* DMA4 only: source info and address bits 39:32 */
+    uint32_t dsti;    /* DMA4 only: dest info and address bits 39:32 */
 
+    uint32_t xlength; /* row length of the loaded CB, for 2D mode */
+    bool cb_loaded;   /* registers hold a CB that has not yet completed */
+
+    bool dma4;        /* BCM2711 DMA4 register layout and address space */
+    AddressSpace *as;
     qemu_irq irq;
 } BCM2835DMAChan;
 
@@ -28,6 +35,28 @@ typedef struct {
 
 #define BCM2835_DMA_NCHANS 16
 
+/* Named GPIO input for peripheral DREQ lines, indexed by PERMAP */
+#define BCM2835_DMA_DREQ "dreq"
+#define BCM2835_DMA_NDREQ 32
+
+/*
+ * A peripheral whose data register is a FIFO can let the channels paced by
+ * its DREQ move a burst at a time through it, rather than one register
+ * access per word.  The function moves up to @len bytes, a multiple of 4,
+ * between @buf and the FIFO (into the FIFO if @to_fifo is set), and
+ * returns how many it moved.  It stops early when the FIFO runs full or
+ * empty, and updates DREQ as register accesses would.
+ */
+typedef uint32_t BCM2835DMAFifoFn(void *opaque, uint8_t *buf, uint32_t len,
+                                  bool to_fifo);
+
+typedef struct {
+    MemoryRegion *mr;   /* the data register, as reached by the channels */
+    hwaddr offset;
+    BCM2835DMAFifoFn *fn;
+    void *opaque;
+} BCM2835DMAFifo;
+
 typedef struct {
     /*< private >*/
     SysBusDevice busdev;
@@ -36,10 +65,20 @@ typedef struct {
     MemoryRegion iomem0, iomem15;
     MemoryRegion *dma_mr;
     AddressSpace dma_as;
+    MemoryRegion *dma4_mr;
+    AddressSpace dma4_as;
+    QEMUBH *bh;
 
     BCM2835DMAChan chan[BCM2835_DMA_NCHANS];
     uint32_t int_status;
     uint32_t enable;
+    uint32_t dreq;
+    uint32_t dma4_chans;
+    BCM2835DMAFifo fifo[BCM2835_DMA_NDREQ];
 } BCM2835DMAState;
 
+void bcm2835_dma_set_fifo(BCM2835DMAState *s, unsigned permap,
+                          MemoryRegion *mr, hwaddr offset,
+                          BCM2835DMAFifoFn *fn, void *opaque);
+
 #endif
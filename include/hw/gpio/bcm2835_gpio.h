@@ -16,6 +16,21 @@
 
 #include "hw/sd/sd.h"
 #include "hw/sysbus.h"
+#include "chardev/char-fe.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+
+#define BCM2835_GPIO_NUM_PINS   54
+#define BCM2835_GPIO_NUM_IRQS   4   /* one per pin group, and "any" */
+
+/* An externally injected pin transition, pending until its time comes */
+typedef struct BCM2835GpioEvent {
+    int64_t when;       /* QEMU_CLOCK_VIRTUAL, ns */
+    uint8_t pin;
+    bool level;
+    QTAILQ_ENTRY(BCM2835GpioEvent) next;
+} BCM2835GpioEvent;
 
 typedef struct BCM2835GpioState {
     SysBusDevice parent_obj;
@@ -27,10 +42,32 @@ typedef struct BCM2835GpioState {
     SDBus *sdbus_sdhci;
     SDBus *sdbus_sdhost;
 
+    /*
+     * MMIO reads run without the iothread lock.  The pin state below is
+     * written with both the iothread lock and @lock held, so holding
+     * either is enough to read it.
+     */
+    QemuMutex lock;
     uint8_t fsel[54];
     uint32_t lev0, lev1;
-    uint8_t sd_fsel;
     qemu_irq out[54];
+
+    /* Event detection; one bit per pin */
+    uint64_t in_lev;    /* levels driven onto the input pins */
+    uint64_t level;     /* last pin levels seen by the edge detectors */
+    uint64_t eds, ren, fen, hen, len, aren, afen;
+    qemu_irq irq[BCM2835_GPIO_NUM_IRQS];
+
+    /* Everything below is protected by the iothread lock only */
+    uint8_t sd_fsel;
+
+    /* Side channel for external simulators */
+    CharBackend chr;
+    char line[64];
+    int line_len;
+    QEMUTimer *inject_timer;
+    QTAILQ_HEAD(, BCM2835GpioEvent) inject_queue;
+    unsigned inject_count;
 } BCM2835GpioState;
 
 #define TYPE_BCM2835_GPIO "bcm2835_gpio"
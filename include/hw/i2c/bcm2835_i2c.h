@@ -0,0 +1,43 @@
+/*
+ * BCM2835 (Raspberry Pi) Broadcom Serial Controller (BSC) I2C master
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#ifndef BCM2835_I2C_H
+#define BCM2835_I2C_H
+
+#include "hw/sysbus.h"
+#include "hw/i2c/i2c.h"
+#include "qemu/fifo8.h"
+
+#define TYPE_BCM2835_I2C "bcm2835-i2c"
+#define BCM2835_I2C(obj) \
+    OBJECT_CHECK(BCM2835I2CState, (obj), TYPE_BCM2835_I2C)
+
+#define BCM2835_I2C_FIFO_SIZE   16
+
+typedef struct {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion iomem;
+    I2CBus *bus;
+    qemu_irq irq;
+    QEMUBH *bh;
+    Fifo8 fifo;
+
+    uint32_t c;
+    uint32_t s;
+    uint32_t dlen;
+    uint32_t a;
+    uint32_t div;
+    uint32_t del;
+    uint32_t clkt;
+
+    uint32_t remaining; /* bytes left in the active transfer */
+    bool started;       /* addressed the slave for the active transfer */
+} BCM2835I2CState;
+
+#endif
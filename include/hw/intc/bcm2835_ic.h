@@ -28,6 +28,11 @@ typedef struct BCM2835ICState {
     uint8_t arm_irq_level, arm_irq_enable;
     bool fiq_enable;
     uint8_t fiq_select;
+
+    /* Derived from the above, updated as the sources change */
+    uint64_t gpu_pending;       /* gpu_irq_level & gpu_irq_enable */
+    uint32_t basic_pending;     /* IRQ_PENDING_BASIC */
+    bool irq_out, fiq_out;      /* current levels of irq and fiq */
 } BCM2835ICState;
 
 #endif
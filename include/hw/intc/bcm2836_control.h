@@ -30,6 +30,8 @@ typedef struct BCM2836ControlState {
     SysBusDevice busdev;
     /*< public >*/
     MemoryRegion iomem;
+    MemoryRegion regs_iomem;
+    MemoryRegion mbox_iomem; /* accessed without the iothread lock */
 
     /* mailbox state */
     uint32_t mailboxes[BCM2836_NCORES * BCM2836_MBPERCORE];
@@ -0,0 +1,54 @@
+/*
+ * BCM2835 (Raspberry Pi) clock manager (CPRMAN) and PLL analogue (A2W)
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#ifndef BCM2835_CPRMAN_H
+#define BCM2835_CPRMAN_H
+
+#include "hw/sysbus.h"
+
+#define TYPE_BCM2835_CPRMAN "bcm2835-cprman"
+#define BCM2835_CPRMAN(obj) \
+        OBJECT_CHECK(BCM2835CprmanState, (obj), TYPE_BCM2835_CPRMAN)
+
+/* The clock manager proper, followed by A2W at 0x1000 */
+#define BCM2835_CPRMAN_SIZE     0x2000
+
+/* Clock IDs of the firmware mailbox property interface */
+#define BCM2835_FW_CLK_EMMC     1
+#define BCM2835_FW_CLK_UART     2
+#define BCM2835_FW_CLK_ARM      3
+#define BCM2835_FW_CLK_CORE     4
+#define BCM2835_FW_CLK_V3D      5
+#define BCM2835_FW_CLK_H264     6
+#define BCM2835_FW_CLK_ISP      7
+#define BCM2835_FW_CLK_SDRAM    8
+#define BCM2835_FW_CLK_PIXEL    9
+#define BCM2835_FW_CLK_PWM      10
+#define BCM2835_FW_CLK_EMMC2    12
+
+typedef struct {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion iomem;
+    uint32_t regs[BCM2835_CPRMAN_SIZE / 4];
+
+    uint32_t xosc_freq;
+    uint32_t arm_freq;      /* ARM clock the firmware leaves us with */
+} BCM2835CprmanState;
+
+/* Current rate in Hz of a firmware clock, or 0 if it is off or unknown */
+uint64_t bcm2835_cprman_get_fw_rate(BCM2835CprmanState *s, uint32_t id);
+/* Reprogram a firmware clock as close to @rate as it goes; returns the
+ * rate it ended up at.
+ */
+uint64_t bcm2835_cprman_set_fw_rate(BCM2835CprmanState *s, uint32_t id,
+                                    uint64_t rate);
+/* Current rate in Hz of PCM_CLK as the PCM/I2S block sees it, or 0 if off */
+uint64_t bcm2835_cprman_get_pcm_rate(BCM2835CprmanState *s);
+
+#endif
@@ -8,6 +8,7 @@
 
 #include "bcm2835_mbox_defs.h"
 #include "hw/sysbus.h"
+#include "qemu/thread.h"
 
 #define TYPE_BCM2835_MBOX "bcm2835-mbox"
 #define BCM2835_MBOX(obj) \
@@ -29,8 +30,16 @@ typedef struct {
     MemoryRegion iomem;
     qemu_irq arm_irq;
 
+    /* Protected by the iothread lock */
     bool mbox_irq_disabled;
     bool available[MBOX_CHAN_COUNT];
+
+    /*
+     * Registers without read side effects are read without the iothread
+     * lock.  @mbox is written with both the iothread lock and @lock held,
+     * so holding either is enough to read it.
+     */
+    QemuMutex lock;
     BCM2835Mbox mbox[2];
 } BCM2835MboxState;
 
@@ -0,0 +1,34 @@
+/*
+ * BCM2835 (Raspberry Pi) power management block: watchdog and reset
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#ifndef BCM2835_POWERMGT_H
+#define BCM2835_POWERMGT_H
+
+#include "hw/sysbus.h"
+#include "qemu/timer.h"
+
+#define TYPE_BCM2835_POWERMGT "bcm2835-powermgt"
+#define BCM2835_POWERMGT(obj) \
+        OBJECT_CHECK(BCM2835PowerMgtState, (obj), TYPE_BCM2835_POWERMGT)
+
+#define BCM2835_POWERMGT_SIZE   0x1000
+
+typedef struct {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion iomem;
+    QEMUTimer *wdog_timer;
+
+    uint32_t rstc;
+    uint32_t rsts;
+    uint32_t wdog;
+    /* power domain and other registers, kept as written */
+    uint32_t regs[BCM2835_POWERMGT_SIZE / 4];
+} BCM2835PowerMgtState;
+
+#endif
@@ -9,6 +9,8 @@
 #include "hw/sysbus.h"
 #include "net/net.h"
 #include "hw/display/bcm2835_fb.h"
+#include "hw/misc/bcm2835_cprman.h"
+#include "hw/misc/bcm2835_thermal.h"
 
 #define TYPE_BCM2835_PROPERTY "bcm2835-property"
 #define BCM2835_PROPERTY(obj) \
@@ -24,11 +26,16 @@ typedef struct {
     MemoryRegion iomem;
     qemu_irq mbox_irq;
     BCM2835FBState *fbdev;
+    BCM2835CprmanState *cprman;
+    BCM2835ThermalState *thermal;
 
     MACAddr macaddr;
     uint32_t board_rev;
     uint32_t addr;
     bool pending;
+
+    /* Number of requests seen for each tag, for tracing */
+    uint64_t *tag_count;
 } BCM2835PropertyState;
 
 #endif
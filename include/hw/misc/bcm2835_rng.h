@@ -16,12 +16,25 @@
 #define BCM2835_RNG(obj) \
         OBJECT_CHECK(BCM2835RngState, (obj), TYPE_BCM2835_RNG)
 
+/* Host entropy buffered ahead of the guest, in 32-bit words */
+#define BCM2835_RNG_RING_WORDS 1024
+
 typedef struct {
     SysBusDevice busdev;
     MemoryRegion iomem;
 
+    /*
+     * Protects everything below.  The device has no interrupt, so its
+     * registers are accessed without the iothread lock.
+     */
+    QemuMutex lock;
+
     uint32_t rng_ctrl;
     uint32_t rng_status;
+
+    uint32_t ring[BCM2835_RNG_RING_WORDS];
+    unsigned ring_head;     /* next word handed to the guest */
+    unsigned ring_count;    /* words of unread entropy */
 } BCM2835RngState;
 
 #endif
@@ -0,0 +1,26 @@
+/*
+ * BCM2835 (Raspberry Pi) SoC temperature sensor
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#ifndef BCM2835_THERMAL_H
+#define BCM2835_THERMAL_H
+
+#include "hw/sysbus.h"
+
+#define TYPE_BCM2835_THERMAL "bcm2835-thermal"
+#define BCM2835_THERMAL(obj) \
+        OBJECT_CHECK(BCM2835ThermalState, (obj), TYPE_BCM2835_THERMAL)
+
+typedef struct {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion iomem;
+    uint32_t ctl;
+    int32_t temperature;    /* millidegrees Celsius */
+} BCM2835ThermalState;
+
+#endif
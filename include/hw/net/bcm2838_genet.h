@@ -0,0 +1,51 @@
+/*
+ * BCM2838 (BCM2711) GENET v5 Gigabit Ethernet controller
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#ifndef BCM2838_GENET_H
+#define BCM2838_GENET_H
+
+#include "hw/sysbus.h"
+#include "net/net.h"
+
+#define TYPE_BCM2838_GENET "bcm2838-genet"
+#define BCM2838_GENET(obj) \
+        OBJECT_CHECK(BCM2838GenetState, (obj), TYPE_BCM2838_GENET)
+
+#define BCM2838_GENET_MMIO_SIZE     0x10000
+#define BCM2838_GENET_NUM_RINGS     17 /* 16 priority rings + default ring */
+#define BCM2838_GENET_MAX_FRAME     10240
+
+/* Two-level interrupt controllers, one per output line */
+typedef struct BCM2838GenetIntr {
+    uint32_t stat;
+    uint32_t mask;
+} BCM2838GenetIntr;
+
+typedef struct BCM2838GenetState {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion iomem;
+    MemoryRegion *dma_mr;
+    AddressSpace dma_as;
+    NICState *nic;
+    NICConf conf;
+    QEMUBH *tx_bh;
+    qemu_irq irq[2];
+
+    /* Plain storage backing the register window, descriptors included */
+    uint32_t regs[BCM2838_GENET_MMIO_SIZE / 4];
+    BCM2838GenetIntr intr[2];
+
+    uint16_t phy_regs[32];
+    uint32_t phy_addr;
+
+    bool tx_waiting;
+    uint8_t frame[BCM2838_GENET_MAX_FRAME];
+} BCM2838GenetState;
+
+#endif /* BCM2838_GENET_H */
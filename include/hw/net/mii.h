@@ -112,4 +112,8 @@
 #define DP83848_PHYID1      0x2000
 #define DP83848_PHYID2      0x5c90
 
+/* Broadcom BCM54213PE */
+#define BCM54213PE_PHYID1   0x600d
+#define BCM54213PE_PHYID2   0x84a2
+
 #endif /* MII_H */
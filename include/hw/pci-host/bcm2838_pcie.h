@@ -0,0 +1,79 @@
+/*
+ * BCM2838 (BCM2711) PCIe root complex emulation
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#ifndef BCM2838_PCIE_H
+#define BCM2838_PCIE_H
+
+#include "hw/sysbus.h"
+#include "hw/pci/pci.h"
+#include "hw/pci/pci_bus.h"
+#include "hw/pci/pcie_host.h"
+#include "hw/pci/pci_bridge.h"
+
+#define TYPE_BCM2838_PCIE_HOST "bcm2838-pcie-host"
+#define BCM2838_PCIE_HOST(obj) \
+     OBJECT_CHECK(BCM2838PCIEHostState, (obj), TYPE_BCM2838_PCIE_HOST)
+
+#define TYPE_BCM2838_PCIE_ROOT "bcm2838-pcie-root"
+#define BCM2838_PCIE_ROOT(obj) \
+     OBJECT_CHECK(BCM2838PCIERootState, (obj), TYPE_BCM2838_PCIE_ROOT)
+
+#define BCM2838_PCIE_NUM_WINDOWS    4
+#define BCM2838_PCIE_NUM_IRQS       4 /* INTA..INTD */
+#define BCM2838_PCIE_MMIO_SIZE      0x10000
+
+typedef struct BCM2838PCIERootState {
+    PCIBridge parent_obj;
+} BCM2838PCIERootState;
+
+/* CPU -> PCI outbound memory window */
+typedef struct BCM2838PCIEWindow {
+    MemoryRegion mem;
+
+    uint32_t pcie_lo;
+    uint32_t pcie_hi;
+    uint32_t base_limit;
+    uint32_t base_hi;
+    uint32_t limit_hi;
+} BCM2838PCIEWindow;
+
+typedef struct BCM2838PCIEHostState {
+    PCIHostState parent_obj;
+
+    BCM2838PCIERootState root;
+
+    struct {
+        AddressSpace address_space;
+        MemoryRegion address_space_root;
+
+        MemoryRegion memory;
+        MemoryRegion io;
+
+        MemoryRegion inbound; /* RC_BAR2: PCI -> CPU memory */
+        MemoryRegion msi;
+
+        qemu_irq     irqs[BCM2838_PCIE_NUM_IRQS];
+    } pci;
+
+    MemoryRegion mmio;
+    qemu_irq msi_irq;
+
+    BCM2838PCIEWindow windows[BCM2838_PCIE_NUM_WINDOWS];
+
+    uint32_t ext_cfg_index;
+    uint32_t misc_ctrl;
+    uint32_t rc_bar2_lo;
+    uint32_t rc_bar2_hi;
+    uint32_t msi_bar_lo;
+    uint32_t msi_bar_hi;
+    uint32_t msi_data_config;
+    uint32_t msi_status;
+    uint32_t msi_mask;
+    uint32_t hard_debug;
+    uint32_t sw_init;
+} BCM2838PCIEHostState;
+
+#endif /* BCM2838_PCIE_H */
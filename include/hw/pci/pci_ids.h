@@ -271,6 +271,9 @@
 
 #define PCI_VENDOR_ID_SYNOPSYS           0x16C3
 
+#define PCI_VENDOR_ID_BROADCOM           0x14e4
+#define PCI_DEVICE_ID_BROADCOM_BCM2711   0x2711
+
 #define PCI_VENDOR_ID_NVIDIA             0x10de
 
 #endif
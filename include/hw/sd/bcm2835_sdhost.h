@@ -23,6 +23,12 @@
 
 #define BCM2835_SDHOST_FIFO_LEN 16
 
+/* Offset of the data FIFO register, the target of DMA */
+#define BCM2835_SDHOST_DATA_OFFSET 0x40
+
+/* Named GPIO output for the DMA request line */
+#define BCM2835_SDHOST_DREQ "dreq"
+
 typedef struct {
     SysBusDevice busdev;
     SDBus sdbus;
@@ -43,6 +49,10 @@ typedef struct {
     uint32_t datacnt;
 
     qemu_irq irq;
+    qemu_irq dreq;
 } BCM2835SDHostState;
 
+uint32_t bcm2835_sdhost_dma_fifo(void *opaque, uint8_t *buf, uint32_t len,
+                                 bool to_fifo);
+
 #endif
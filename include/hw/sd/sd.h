@@ -106,6 +106,8 @@ typedef struct {
     int (*do_command)(SDState *sd, SDRequest *req, uint8_t *response);
     void (*write_data)(SDState *sd, uint8_t value);
     uint8_t (*read_data)(SDState *sd);
+    void (*write_block)(SDState *sd, const uint8_t *buf, size_t length);
+    void (*read_block)(SDState *sd, uint8_t *buf, size_t length);
     bool (*data_ready)(SDState *sd);
     void (*set_voltage)(SDState *sd, uint16_t millivolts);
     uint8_t (*get_dat_lines)(SDState *sd);
@@ -134,6 +136,10 @@ typedef struct {
      */
     void (*set_inserted)(DeviceState *dev, bool inserted);
     void (*set_readonly)(DeviceState *dev, bool readonly);
+    /* Called by the SD device when it stops holding DAT0 low (busy), e.g.
+     * because a data block it was fetching from its backend is now ready
+     */
+    void (*busy_end)(DeviceState *dev);
 } SDBusClass;
 
 /* Legacy functions to be used only by non-qdevified callers */
@@ -142,6 +148,8 @@ int sd_do_command(SDState *sd, SDRequest *req,
                   uint8_t *response);
 void sd_write_data(SDState *sd, uint8_t value);
 uint8_t sd_read_data(SDState *sd);
+void sd_write_block(SDState *sd, const uint8_t *buf, size_t length);
+void sd_read_block(SDState *sd, uint8_t *buf, size_t length);
 void sd_set_cb(SDState *sd, qemu_irq readonly, qemu_irq insert);
 bool sd_data_ready(SDState *sd);
 /* sd_enable should not be used -- it is only used on the nseries boards,
@@ -162,6 +170,26 @@ bool sdbus_get_cmd_line(SDBus *sdbus);
 int sdbus_do_command(SDBus *sd, SDRequest *req, uint8_t *response);
 void sdbus_write_data(SDBus *sd, uint8_t value);
 uint8_t sdbus_read_data(SDBus *sd);
+/**
+ * sdbus_write_block: Send a run of data bytes to the card
+ * @sd: bus to write to
+ * @buf: data to send
+ * @length: number of bytes
+ *
+ * Equivalent to @length calls to sdbus_write_data(), but lets the card
+ * copy whole data blocks at once.
+ */
+void sdbus_write_block(SDBus *sd, const uint8_t *buf, size_t length);
+/**
+ * sdbus_read_block: Receive a run of data bytes from the card
+ * @sd: bus to read from
+ * @buf: buffer to fill
+ * @length: number of bytes
+ *
+ * Equivalent to @length calls to sdbus_read_data(), but lets the card
+ * copy whole data blocks at once.
+ */
+void sdbus_read_block(SDBus *sd, uint8_t *buf, size_t length);
 bool sdbus_data_ready(SDBus *sd);
 bool sdbus_get_inserted(SDBus *sd);
 bool sdbus_get_readonly(SDBus *sd);
@@ -180,5 +208,6 @@ void sdbus_reparent_card(SDBus *from, SDBus *to);
 /* Functions to be used by SD devices to report back to qdevified controllers */
 void sdbus_set_inserted(SDBus *sd, bool inserted);
 void sdbus_set_readonly(SDBus *sd, bool inserted);
+void sdbus_busy_end(SDBus *sd);
 
 #endif /* HW_SD_H */
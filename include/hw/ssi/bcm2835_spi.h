@@ -0,0 +1,48 @@
+/*
+ * BCM2835 (Raspberry Pi) SPI0 master
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#ifndef BCM2835_SPI_H
+#define BCM2835_SPI_H
+
+#include "hw/sysbus.h"
+#include "hw/ssi/ssi.h"
+#include "qemu/fifo8.h"
+
+#define TYPE_BCM2835_SPI "bcm2835-spi"
+#define BCM2835_SPI(obj) \
+    OBJECT_CHECK(BCM2835SPIState, (obj), TYPE_BCM2835_SPI)
+
+#define BCM2835_SPI_FIFO_SIZE   64
+#define BCM2835_SPI_NUM_CS      3
+
+/* Named GPIO outputs for the DMA request lines */
+#define BCM2835_SPI_DREQ_TX     "dreq-tx"
+#define BCM2835_SPI_DREQ_RX     "dreq-rx"
+
+typedef struct {
+    /*< private >*/
+    SysBusDevice parent_obj;
+    /*< public >*/
+
+    MemoryRegion iomem;
+    SSIBus *bus;
+    qemu_irq irq;
+    qemu_irq cs_lines[BCM2835_SPI_NUM_CS];
+    qemu_irq dreq_tx, dreq_rx;
+    QEMUBH *bh;
+    Fifo8 tx_fifo;
+    Fifo8 rx_fifo;
+
+    uint32_t cs;
+    uint32_t clk;
+    uint32_t dlen;
+    uint32_t ltoh;
+    uint32_t dc;
+
+    uint32_t remaining; /* DMA mode: bytes left before DONE */
+} BCM2835SPIState;
+
+#endif
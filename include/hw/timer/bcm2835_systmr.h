@@ -0,0 +1,44 @@
+/*
+ * BCM2835 SYS timer emulation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef BCM2835_SYSTIMER_H
+#define BCM2835_SYSTIMER_H
+
+#include "hw/sysbus.h"
+#include "hw/irq.h"
+#include "qemu/timer.h"
+#include "qemu/thread.h"
+
+#define TYPE_BCM2835_SYSTIMER "bcm2835-sys-timer"
+#define BCM2835_SYSTIMER(obj) \
+        OBJECT_CHECK(BCM2835SystemTimerState, (obj), TYPE_BCM2835_SYSTIMER)
+
+#define BCM2835_SYSTIMER_COUNT 4
+
+typedef struct {
+    /*< private >*/
+    SysBusDevice parent_obj;
+
+    /*< public >*/
+    MemoryRegion iomem;
+    qemu_irq irq[BCM2835_SYSTIMER_COUNT];
+
+    /* Only the nearest compare match is ever armed */
+    QEMUTimer *timer;
+    uint32_t armed;         /* channels matching at the timer deadline */
+
+    /*
+     * MMIO reads run without the iothread lock.  The registers below are
+     * written with both the iothread lock and @lock held, so holding
+     * either is enough to read them.
+     */
+    QemuMutex lock;
+    uint32_t status;
+    uint32_t compare[BCM2835_SYSTIMER_COUNT];
+} BCM2835SystemTimerState;
+
+#endif
@@ -0,0 +1,195 @@
+/*
+ * Synopsys DesignWare Core for USB OTG (DWC2) register definitions
+ *
+ * Only the host-mode subset used by the QEMU model is listed here.
+ *
+ * This code is licensed under the GNU GPLv2 and later.
+ */
+
+#ifndef HW_USB_DWC2_REGS_H
+#define HW_USB_DWC2_REGS_H
+
+/* Core global registers */
+#define GOTGCTL                 0x000
+#define GOTGCTL_BSESVLD         (1 << 19)
+#define GOTGCTL_ASESVLD         (1 << 18)
+#define GOTGCTL_CONID_B         (1 << 16)
+
+#define GOTGINT                 0x004
+
+#define GAHBCFG                 0x008
+#define GAHBCFG_DMA_EN          (1 << 5)
+#define GAHBCFG_GLBL_INTR_EN    (1 << 0)
+
+#define GUSBCFG                 0x00c
+#define GUSBCFG_FORCEDEVMODE    (1 << 30)
+#define GUSBCFG_FORCEHOSTMODE   (1 << 29)
+
+#define GRSTCTL                 0x010
+#define GRSTCTL_AHBIDLE         (1u << 31)
+#define GRSTCTL_DMAREQ          (1 << 30)
+#define GRSTCTL_TXFFLSH         (1 << 5)
+#define GRSTCTL_RXFFLSH         (1 << 4)
+#define GRSTCTL_FRMCNTRRST      (1 << 2)
+#define GRSTCTL_HSFTRST         (1 << 1)
+#define GRSTCTL_CSFTRST         (1 << 0)
+
+#define GINTSTS                 0x014
+#define GINTMSK                 0x018
+#define GINTSTS_WKUPINT         (1u << 31)
+#define GINTSTS_SESSREQINT      (1 << 30)
+#define GINTSTS_DISCONNINT      (1 << 29)
+#define GINTSTS_CONIDSTSCHNG    (1 << 28)
+#define GINTSTS_PTXFEMP         (1 << 26)
+#define GINTSTS_HCHINT          (1 << 25)
+#define GINTSTS_PRTINT          (1 << 24)
+#define GINTSTS_NPTXFEMP        (1 << 5)
+#define GINTSTS_RXFLVL          (1 << 4)
+#define GINTSTS_SOF             (1 << 3)
+#define GINTSTS_OTGINT          (1 << 2)
+#define GINTSTS_MODEMIS         (1 << 1)
+#define GINTSTS_CURMODE_HOST    (1 << 0)
+/* bits that reflect other state and cannot be cleared by writing them */
+#define GINTSTS_RO_MASK         (GINTSTS_PTXFEMP | GINTSTS_HCHINT | \
+                                 GINTSTS_PRTINT | GINTSTS_NPTXFEMP | \
+                                 GINTSTS_RXFLVL | GINTSTS_OTGINT | \
+                                 GINTSTS_CURMODE_HOST)
+
+#define GRXSTSR                 0x01c
+#define GRXSTSP                 0x020
+#define GRXFSIZ                 0x024
+#define GNPTXFSIZ               0x028
+#define GNPTXSTS                0x02c
+#define GI2CCTL                 0x030
+#define GPVNDCTL                0x034
+#define GGPIO                   0x038
+#define GUID                    0x03c
+#define GSNPSID                 0x040
+#define GHWCFG1                 0x044
+#define GHWCFG2                 0x048
+#define GHWCFG3                 0x04c
+#define GHWCFG4                 0x050
+#define GLPMCFG                 0x054
+#define GPWRDN                  0x058
+#define GDFIFOCFG               0x05c
+#define GADPCTL                 0x060
+#define GREFCLK                 0x064
+#define GINTMSK2                0x068
+#define GINTSTS2                0x06c
+#define DWC2_GLBREG_SIZE        0x070
+
+/* Periodic and device TX FIFO sizes */
+#define HPTXFSIZ                0x100
+#define DWC2_FSZREG_SIZE        0x040
+
+/* Host mode registers */
+#define HCFG                    0x400
+#define HCFG_FSLSSUPP           (1 << 2)
+#define HCFG_FSLSPCLKSEL_MASK   (3 << 0)
+
+#define HFIR                    0x404
+#define HFIR_FRINT_MASK         0xffff
+
+#define HFNUM                   0x408
+#define HFNUM_FRREM_SHIFT       16
+#define HFNUM_FRNUM_MASK        0xffff
+#define HFNUM_MAX_FRNUM         0x3fff
+
+#define HPTXSTS                 0x410
+#define HAINT                   0x414
+#define HAINTMSK                0x418
+#define HFLBADDR                0x41c
+
+#define HPRT0                   0x440
+#define HPRT0_SPD_SHIFT         17
+#define HPRT0_SPD_MASK          (3 << HPRT0_SPD_SHIFT)
+#define HPRT0_SPD_HIGH_SPEED    0
+#define HPRT0_SPD_FULL_SPEED    1
+#define HPRT0_SPD_LOW_SPEED     2
+#define HPRT0_TSTCTL_MASK       (0xf << 13)
+#define HPRT0_PWR               (1 << 12)
+#define HPRT0_LNSTS_MASK        (3 << 10)
+#define HPRT0_RST               (1 << 8)
+#define HPRT0_SUSP              (1 << 7)
+#define HPRT0_RES               (1 << 6)
+#define HPRT0_OVRCURRCHG        (1 << 5)
+#define HPRT0_OVRCURRACT        (1 << 4)
+#define HPRT0_ENACHG            (1 << 3)
+#define HPRT0_ENA               (1 << 2)
+#define HPRT0_CONNDET           (1 << 1)
+#define HPRT0_CONNSTS           (1 << 0)
+/* write-1-to-clear change bits, any of which raises GINTSTS.PRTINT */
+#define HPRT0_CHG_MASK          (HPRT0_OVRCURRCHG | HPRT0_ENACHG | \
+                                 HPRT0_CONNDET)
+#define DWC2_HREG0_SIZE         0x100
+
+/* Host channel registers, one 0x20 byte block per channel at 0x500 */
+#define HCCHAR_BASE             0x500
+#define HCCHAR(n)               (HCCHAR_BASE + (n) * 0x20)
+#define HCSPLT(n)               (0x504 + (n) * 0x20)
+#define HCINT(n)                (0x508 + (n) * 0x20)
+#define HCINTMSK(n)             (0x50c + (n) * 0x20)
+#define HCTSIZ(n)               (0x510 + (n) * 0x20)
+#define HCDMA(n)                (0x514 + (n) * 0x20)
+#define HCDMAB(n)               (0x51c + (n) * 0x20)
+#define DWC2_HCREG_SIZE         0x20
+
+#define HCCHAR_CHENA            (1u << 31)
+#define HCCHAR_CHDIS            (1 << 30)
+#define HCCHAR_ODDFRM           (1 << 29)
+#define HCCHAR_DEVADDR_SHIFT    22
+#define HCCHAR_DEVADDR_MASK     (0x7f << HCCHAR_DEVADDR_SHIFT)
+#define HCCHAR_MC_SHIFT         20
+#define HCCHAR_MC_MASK          (3 << HCCHAR_MC_SHIFT)
+#define HCCHAR_EPTYPE_SHIFT     18
+#define HCCHAR_EPTYPE_MASK      (3 << HCCHAR_EPTYPE_SHIFT)
+#define HCCHAR_LSPDDEV          (1 << 17)
+#define HCCHAR_EPDIR            (1 << 15)
+#define HCCHAR_EPNUM_SHIFT      11
+#define HCCHAR_EPNUM_MASK       (0xf << HCCHAR_EPNUM_SHIFT)
+#define HCCHAR_MPS_MASK         0x7ff
+
+#define EPTYPE_CONTROL          0
+#define EPTYPE_ISOC             1
+#define EPTYPE_BULK             2
+#define EPTYPE_INTR             3
+
+#define HCSPLT_SPLTENA          (1u << 31)
+
+#define HCINTMSK_RESERVED14_31  0xffffc000
+#define HCINTMSK_FRM_LIST_ROLL  (1 << 13)
+#define HCINTMSK_XCS_XACT       (1 << 12)
+#define HCINTMSK_BNA            (1 << 11)
+#define HCINTMSK_DATATGLERR     (1 << 10)
+#define HCINTMSK_FRMOVRUN       (1 << 9)
+#define HCINTMSK_BBLERR         (1 << 8)
+#define HCINTMSK_XACTERR        (1 << 7)
+#define HCINTMSK_NYET           (1 << 6)
+#define HCINTMSK_ACK            (1 << 5)
+#define HCINTMSK_NAK            (1 << 4)
+#define HCINTMSK_STALL          (1 << 3)
+#define HCINTMSK_AHBERR         (1 << 2)
+#define HCINTMSK_CHHLTD         (1 << 1)
+#define HCINTMSK_XFERCOMPL      (1 << 0)
+
+#define TSIZ_DOPNG              (1u << 31)
+#define TSIZ_SC_MC_PID_SHIFT    29
+#define TSIZ_SC_MC_PID_MASK     (3 << TSIZ_SC_MC_PID_SHIFT)
+#define TSIZ_SC_MC_PID_DATA0    0
+#define TSIZ_SC_MC_PID_DATA2    1
+#define TSIZ_SC_MC_PID_DATA1    2
+#define TSIZ_SC_MC_PID_MDATA    3
+#define TSIZ_SC_MC_PID_SETUP    3
+#define TSIZ_PKTCNT_SHIFT       19
+#define TSIZ_PKTCNT_MASK        (0x3ff << TSIZ_PKTCNT_SHIFT)
+#define TSIZ_XFERSIZE_MASK      0x7ffff
+
+/* Power and clock gating */
+#define PCGCTL                  0xe00
+#define DWC2_PCGREG_SIZE        0x008
+
+/* Slave mode data FIFOs; unused since the model only supports DMA */
+#define DWC2_FIFO_BASE          0x1000
+#define DWC2_MMIO_SIZE          0x11000
+
+#endif /* HW_USB_DWC2_REGS_H */
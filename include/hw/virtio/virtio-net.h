@@ -124,6 +124,27 @@ typedef struct VirtioNetRscChain {
 /* Maximum packet size we can receive from tap device: header + 64k */
 #define VIRTIO_NET_MAX_BUFSIZE (sizeof(struct virtio_net_hdr) + (64 * KiB))
 
+#define VIRTIO_NET_RSS_MAX_KEY_SIZE     40
+#define VIRTIO_NET_RSS_MAX_TABLE_LEN    128
+/* Longest hash input: IPv6 source and destination addresses and ports */
+#define VIRTIO_NET_RSS_MAX_INPUT_LEN    36
+
+typedef struct VirtioNetRssData {
+    bool enabled;
+    bool redirect;          /* steer packets to queues, not just hash them */
+    bool populate_hash;     /* guest header has room for the hash report */
+    uint32_t hash_types;
+    uint8_t key[VIRTIO_NET_RSS_MAX_KEY_SIZE];
+    uint16_t indirections_table[VIRTIO_NET_RSS_MAX_TABLE_LEN];
+    uint16_t indirections_len;
+    uint16_t default_queue;
+    /*
+     * Toeplitz hash of each byte value at each input offset, derived
+     * from key, so that hashing costs one lookup per input byte.
+     */
+    uint32_t (*toeplitz)[256];
+} VirtioNetRssData;
+
 typedef struct VirtIONetQueue {
     VirtQueue *rx_vq;
     VirtQueue *tx_vq;
@@ -133,6 +154,9 @@ typedef struct VirtIONetQueue {
     struct {
         VirtQueueElement *elem;
     } async_tx;
+    /* Nesting depth of receive batches; RX notifies wait for the end */
+    unsigned int rx_batch;
+    bool rx_notify_pending;
     struct VirtIONet *n;
 } VirtIONetQueue;
 
@@ -185,6 +209,7 @@ struct VirtIONet {
     AnnounceTimer announce_timer;
     bool needs_vnet_hdr_swap;
     bool mtu_bypass_backend;
+    VirtioNetRssData rss_data;
 };
 
 void virtio_net_set_netclient_name(VirtIONet *n, const char *name,
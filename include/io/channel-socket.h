@@ -48,6 +48,9 @@ struct QIOChannelSocket {
     socklen_t localAddrLen;
     struct sockaddr_storage remoteAddr;
     socklen_t remoteAddrLen;
+    /* Zero-copy sends issued, and those the kernel reported complete */
+    uint64_t zero_copy_queued;
+    uint64_t zero_copy_sent;
 };
 
 
@@ -261,4 +264,53 @@ qio_channel_socket_accept(QIOChannelSocket *ioc,
                           Error **errp);
 
 
+/**
+ * qio_channel_socket_set_zero_copy:
+ * @ioc: the socket channel object
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Enable zero-copy sends (MSG_ZEROCOPY) on the socket, so that
+ * qio_channel_socket_writev_zero_copy_all() can be used.  This
+ * is only supported for TCP sockets on Linux.
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int qio_channel_socket_set_zero_copy(QIOChannelSocket *ioc,
+                                     Error **errp);
+
+
+/**
+ * qio_channel_socket_writev_zero_copy_all:
+ * @ioc: the socket channel object
+ * @iov: the array of memory regions to write data from
+ * @niov: the length of the @iov array
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Write all the data in @iov like qio_channel_writev_all(), but
+ * let the kernel send it straight from the caller's memory rather
+ * than copying it first.  The memory must not be freed or reused
+ * for other data until qio_channel_socket_flush() has returned.
+ *
+ * Returns: 0 if all bytes were queued, -1 on error
+ */
+int qio_channel_socket_writev_zero_copy_all(QIOChannelSocket *ioc,
+                                            const struct iovec *iov,
+                                            size_t niov,
+                                            Error **errp);
+
+
+/**
+ * qio_channel_socket_flush:
+ * @ioc: the socket channel object
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Wait until the kernel has finished with the memory of every
+ * zero-copy send issued on @ioc so far.
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int qio_channel_socket_flush(QIOChannelSocket *ioc,
+                             Error **errp);
+
+
 #endif /* QIO_CHANNEL_SOCKET_H */
@@ -42,6 +42,11 @@ typedef struct QIOChannelTLS QIOChannelTLS;
  *
  * This channel object is capable of running as either a
  * TLS server or TLS client.
+ *
+ * If the credentials have the "ktls" property set and the
+ * master channel is a socket, the record encryption moves
+ * to the kernel once the handshake is complete, and the
+ * payload is then sent and received as plain socket I/O.
  */
 
 struct QIOChannelTLS {
@@ -49,6 +54,13 @@ struct QIOChannelTLS {
     QIOChannel *master;
     QCryptoTLSSession *session;
     QIOChannelShutdown shutdown;
+    bool ktls;
+    bool ktls_tx;
+    bool ktls_rx;
+    /* Post-handshake message being dropped with ktls_rx */
+    unsigned char ktls_hs[4];
+    size_t ktls_hs_len;
+    size_t ktls_hs_skip;
 };
 
 /**
@@ -60,6 +60,7 @@ typedef int (SetVnetBE)(NetClientState *, bool);
 typedef struct SocketReadState SocketReadState;
 typedef void (SocketReadStateFinalize)(SocketReadState *rs);
 typedef void (NetAnnounce)(NetClientState *);
+typedef void (NetReceiveBatch)(NetClientState *);
 
 typedef struct NetClientInfo {
     NetClientDriver type;
@@ -81,6 +82,13 @@ typedef struct NetClientInfo {
     SetVnetLE *set_vnet_le;
     SetVnetBE *set_vnet_be;
     NetAnnounce *announce;
+    /*
+     * Optional: the packets delivered between receive_batch_begin and
+     * receive_batch_end come in one go, e.g. so that a NIC can raise one
+     * interrupt for all of them.  Calls may nest.
+     */
+    NetReceiveBatch *receive_batch_begin;
+    NetReceiveBatch *receive_batch_end;
 } NetClientInfo;
 
 struct NetClientState {
@@ -151,6 +159,8 @@ ssize_t qemu_send_packet(NetClientState *nc, const uint8_t *buf, int size);
 ssize_t qemu_send_packet_raw(NetClientState *nc, const uint8_t *buf, int size);
 ssize_t qemu_send_packet_async(NetClientState *nc, const uint8_t *buf,
                                int size, NetPacketSent *sent_cb);
+void qemu_send_packet_batch_begin(NetClientState *nc);
+void qemu_send_packet_batch_end(NetClientState *nc);
 void qemu_purge_queued_packets(NetClientState *nc);
 void qemu_flush_queued_packets(NetClientState *nc);
 void qemu_flush_or_purge_queued_packets(NetClientState *nc, bool purge);
@@ -203,7 +213,7 @@ void net_cleanup(void);
 void hmp_host_net_add(Monitor *mon, const QDict *qdict);
 void hmp_host_net_remove(Monitor *mon, const QDict *qdict);
 void netdev_add(QemuOpts *opts, Error **errp);
-void qmp_netdev_add(QDict *qdict, QObject **ret, Error **errp);
+void qmp_netdev_add(QDict *qdict, Visitor *ret_v, Error **errp);
 
 int net_hub_id_for_client(NetClientState *nc, int *id);
 NetClientState *net_hub_port_find(int hub_id);
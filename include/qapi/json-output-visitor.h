@@ -0,0 +1,41 @@
+/*
+ * JSON Output Visitor
+ *
+ * Copyright (C) 2012-2016 Red Hat, Inc.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.1 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ *
+ */
+
+#ifndef JSON_OUTPUT_VISITOR_H
+#define JSON_OUTPUT_VISITOR_H
+
+#include "qapi/visitor.h"
+#include "qapi/qmp/qstring.h"
+
+typedef struct JSONOutputVisitor JSONOutputVisitor;
+
+/**
+ * Create a JSON output visitor for @result
+ *
+ * A JSON output visitor visit formats a QAPI object as JSON text,
+ * appending it to a QString as the walk proceeds.  No QObject is
+ * built, except for the values of 'any' members, which are already
+ * QObjects.  The text is the same that qobject_to_json(), or
+ * qobject_to_json_pretty() if @pretty, would produce for the QObject
+ * a QObject output visitor builds, except that the members of a struct
+ * appear in the order they are visited instead of QDict hash order.
+ *
+ * Use visit_complete(@v, @result) to get the text; the caller then
+ * owns it and should use qobject_unref() when done with it.
+ *
+ * Note that some of the formats produced are not valid JSON, for
+ * example a number that is Inf or NaN.
+ *
+ * For now, a JSON output visitor can only be used once, to visit a
+ * single QAPI object.
+ */
+Visitor *json_output_visitor_new(bool pretty, QString **result);
+
+#endif
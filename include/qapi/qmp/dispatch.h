@@ -16,7 +16,12 @@
 
 #include "qemu/queue.h"
 
-typedef void (QmpCommandFunc)(QDict *, QObject **, Error **);
+/*
+ * A command visits its reply as the member "return" of the response
+ * struct with the Visitor it is passed, unless it fails or has
+ * QCO_NO_SUCCESS_RESP.
+ */
+typedef void (QmpCommandFunc)(QDict *, Visitor *, Error **);
 
 typedef enum QmpCommandOptions
 {
@@ -49,6 +54,8 @@ bool qmp_has_success_response(const QmpCommand *cmd);
 QDict *qmp_error_response(Error *err);
 QDict *qmp_dispatch(QmpCommandList *cmds, QObject *request,
                     bool allow_oob);
+QString *qmp_dispatch_json(QmpCommandList *cmds, QObject *request,
+                           bool allow_oob, bool pretty);
 bool qmp_is_oob(const QDict *dict);
 
 typedef void (*qmp_cmd_callback_fn)(QmpCommand *cmd, void *opaque);
@@ -28,4 +28,12 @@ QDict *qdict_from_jsonf_nofail(const char *string, ...)
 QString *qobject_to_json(const QObject *obj);
 QString *qobject_to_json_pretty(const QObject *obj);
 
+/*
+ * Append @obj, or @s as a JSON string, to @str.  @indent is the nesting
+ * level @obj is printed at when @pretty.
+ */
+void qobject_append_json(QString *str, const QObject *obj, bool pretty,
+                         int indent);
+void json_append_quoted(QString *str, const char *s);
+
 #endif /* QJSON_H */
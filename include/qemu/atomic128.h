@@ -53,6 +53,27 @@ static inline Int128 atomic16_cmpxchg(Int128 *ptr, Int128 cmp, Int128 new)
     return __sync_val_compare_and_swap_16(ptr, cmp, new);
 }
 # define HAVE_CMPXCHG128 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_ATOMICS)
+/*
+ * With ARMv8.1 LSE, a single CASPAL does not fail spuriously under
+ * contention the way an LDAXP/STLXP loop can.  It needs its operands
+ * in consecutive even/odd register pairs.
+ */
+static inline Int128 atomic16_cmpxchg(Int128 *ptr, Int128 cmp, Int128 new)
+{
+    register uint64_t oldl asm("x0") = int128_getlo(cmp);
+    register uint64_t oldh asm("x1") = int128_gethi(cmp);
+    register uint64_t newl asm("x2") = int128_getlo(new);
+    register uint64_t newh asm("x3") = int128_gethi(new);
+
+    asm("caspal %[oldl], %[oldh], %[newl], %[newh], %[mem]"
+        : [mem] "+Q"(*ptr), [oldl] "+r"(oldl), [oldh] "+r"(oldh)
+        : [newl] "r"(newl), [newh] "r"(newh)
+        : "memory");
+
+    return int128_make128(oldl, oldh);
+}
+# define HAVE_CMPXCHG128 1
 #elif defined(__aarch64__)
 /* Through gcc 8, aarch64 has no support for 128-bit at all.  */
 static inline Int128 atomic16_cmpxchg(Int128 *ptr, Int128 cmp, Int128 new)
@@ -122,6 +122,21 @@ bool qemu_in_coroutine(void);
  */
 bool qemu_coroutine_entered(Coroutine *co);
 
+/**
+ * Grow the coroutine pools by @additional_pool_size coroutines
+ *
+ * Devices that can have many requests in flight, each in its own coroutine,
+ * call this when they are realized so that their coroutines are recycled
+ * rather than freed and allocated again.  Undo with
+ * qemu_coroutine_decrease_pool_batch_size().
+ */
+void qemu_coroutine_increase_pool_batch_size(unsigned int additional_pool_size);
+
+/**
+ * Shrink the coroutine pools by @removing_pool_size coroutines
+ */
+void qemu_coroutine_decrease_pool_batch_size(unsigned int removing_pool_size);
+
 /**
  * Provides a mutex that can be used to synchronise coroutines
  */
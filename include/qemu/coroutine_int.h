@@ -28,7 +28,16 @@
 #include "qemu/queue.h"
 #include "qemu/coroutine.h"
 
+/*
+ * Block layer coroutines rarely need more than a few tens of KiB; builds
+ * that run many of them in parallel can use smaller stacks, see
+ * --with-coroutine-stack-size and --enable-debug-stack-usage.
+ */
+#ifdef CONFIG_COROUTINE_STACK_SIZE
+#define COROUTINE_STACK_SIZE CONFIG_COROUTINE_STACK_SIZE
+#else
 #define COROUTINE_STACK_SIZE (1 << 20)
+#endif
 
 typedef enum {
     COROUTINE_YIELD = 1,
@@ -0,0 +1,35 @@
+/*
+ * host-cpuinfo.h: Features of the x86 host, probed once at startup.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_HOST_CPUINFO_H
+#define QEMU_HOST_CPUINFO_H
+
+/* Set once the probe has run, so that a probed host_cpuinfo is never 0 */
+#define CPUINFO_ALWAYS      (1u << 0)
+#define CPUINFO_SSE2        (1u << 1)
+#define CPUINFO_SSE4        (1u << 2)
+#define CPUINFO_AES         (1u << 3)
+#define CPUINFO_PCLMUL      (1u << 4)
+/* Only reported when the OS also saves the YMM, resp. opmask and ZMM state */
+#define CPUINFO_AVX2        (1u << 5)
+#define CPUINFO_AVX512F     (1u << 6)
+#define CPUINFO_AVX512BW    (1u << 7)
+
+extern unsigned host_cpuinfo;
+
+/**
+ * host_cpuinfo_init:
+ *
+ * Probe the host CPU on the first call and return its CPUINFO_* bits
+ * from then on.  The probe itself runs as a constructor, but since the
+ * order of constructors is unspecified, other constructors must call
+ * this function instead of reading @host_cpuinfo.  On hosts without
+ * <cpuid.h> only CPUINFO_ALWAYS is set.
+ */
+unsigned host_cpuinfo_init(void);
+
+#endif
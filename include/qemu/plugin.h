@@ -0,0 +1,148 @@
+/*
+ * QEMU TCG plugin support, the interface to the rest of QEMU
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef QEMU_PLUGIN_H
+#define QEMU_PLUGIN_H
+
+#include "qemu/config-file.h"
+#include "qemu/qemu-plugin.h"
+#include "qemu/error-report.h"
+#include "qemu/queue.h"
+#include "qemu/option.h"
+
+/* the scoreboards a plugin session may have, see CPUState */
+#define QEMU_PLUGIN_MAX_SCOREBOARDS 16
+
+/*
+ * Option parsing/processing.
+ * Note that we can load an arbitrary number of plugins.
+ */
+struct qemu_plugin_desc;
+typedef QTAILQ_HEAD(, qemu_plugin_desc) QemuPluginList;
+
+#ifdef CONFIG_PLUGIN
+extern QemuOptsList qemu_plugin_opts;
+
+static inline void qemu_plugin_add_opts(void)
+{
+    qemu_add_opts(&qemu_plugin_opts);
+}
+
+void qemu_plugin_opt_parse(const char *optarg, QemuPluginList *head);
+int qemu_plugin_load_list(QemuPluginList *head);
+#else /* !CONFIG_PLUGIN */
+static inline void qemu_plugin_add_opts(void)
+{ }
+
+static inline void qemu_plugin_opt_parse(const char *optarg,
+                                         QemuPluginList *head)
+{
+    error_report("plugin interface not enabled in this build");
+    exit(1);
+}
+
+static inline int qemu_plugin_load_list(QemuPluginList *head)
+{
+    return 0;
+}
+#endif /* !CONFIG_PLUGIN */
+
+/*
+ * Events that a plugin may register to
+ */
+enum qemu_plugin_event {
+    QEMU_PLUGIN_EV_VCPU_INIT,
+    QEMU_PLUGIN_EV_VCPU_EXIT,
+    QEMU_PLUGIN_EV_VCPU_TB_TRANS,
+    QEMU_PLUGIN_EV_ATEXIT,
+    QEMU_PLUGIN_EV_MAX,
+};
+
+struct qemu_plugin_scoreboard {
+    int slot;                   /* in CPUState.plugin_scoreboards */
+    size_t element_size;
+    GPtrArray *data;            /* the elements, by vCPU index */
+};
+
+enum plugin_dyn_cb_type {
+    PLUGIN_CB_REGULAR,
+    PLUGIN_CB_INLINE,
+};
+
+/*
+ * A callback or inline op that the translator inserts in the block, the
+ * instruction or after the memory access that it was registered for
+ */
+struct qemu_plugin_dyn_cb {
+    enum plugin_dyn_cb_type type;
+    enum qemu_plugin_mem_rw rw;
+    union {
+        /* PLUGIN_CB_REGULAR */
+        struct {
+            union {
+                qemu_plugin_vcpu_udata_cb_t f;
+                qemu_plugin_vcpu_mem_cb_t f_mem;
+            };
+            void *userdata;
+        } regular;
+        /* PLUGIN_CB_INLINE */
+        struct {
+            enum qemu_plugin_op op;
+            /* the target is @ptr, or the entry of a scoreboard */
+            void *ptr;
+            struct qemu_plugin_scoreboard *score;
+            size_t offset;
+            uint64_t imm;
+        } inline_op;
+    };
+};
+
+/* A guest memory access of an instruction, in the generated code */
+struct qemu_plugin_mem_op {
+    struct TCGOp *op;           /* the qemu_ld/st op */
+    struct TCGTemp *addr;       /* a copy of the address */
+    qemu_plugin_meminfo_t info;
+};
+
+struct qemu_plugin_insn {
+    GByteArray *data;
+    uint64_t vaddr;
+    struct TCGOp *start;        /* the insn_start op */
+    GArray *exec_cbs;
+    GArray *mem_cbs;
+    GArray *mem_ops;
+};
+
+struct qemu_plugin_tb {
+    GPtrArray *insns;           /* allocated, n_insns of them in use */
+    size_t n_insns;
+    uint64_t vaddr;
+    struct TCGOp *start;        /* last op before the first instruction */
+    GArray *exec_cbs;
+};
+
+#ifdef CONFIG_PLUGIN
+
+void qemu_plugin_vcpu_init_hook(CPUState *cpu);
+void qemu_plugin_vcpu_exit_hook(CPUState *cpu);
+void qemu_plugin_tb_trans_cb(CPUState *cpu, struct qemu_plugin_tb *tb);
+bool qemu_plugin_tb_trans_enabled(void);
+void qemu_plugin_atexit_cb(void);
+
+#else /* !CONFIG_PLUGIN */
+
+static inline void qemu_plugin_vcpu_init_hook(CPUState *cpu)
+{ }
+
+static inline void qemu_plugin_vcpu_exit_hook(CPUState *cpu)
+{ }
+
+static inline void qemu_plugin_atexit_cb(void)
+{ }
+
+#endif /* !CONFIG_PLUGIN */
+
+#endif /* QEMU_PLUGIN_H */
@@ -25,6 +25,9 @@ struct qht {
  * @head_buckets: number of head buckets
  * @used_head_buckets: number of non-empty head buckets
  * @entries: total number of entries
+ * @pending_buckets: number of head buckets of the previous map that an
+ *                   ongoing resize has not yet migrated. Their entries are
+ *                   included in @entries, but not in @chain and @occupancy.
  * @chain: frequency distribution representing the number of buckets in each
  *         chain, excluding empty chains.
  * @occupancy: frequency distribution representing chain occupancy rate.
@@ -38,6 +41,7 @@ struct qht_stats {
     size_t head_buckets;
     size_t used_head_buckets;
     size_t entries;
+    size_t pending_buckets;
     struct qdist chain;
     struct qdist occupancy;
 };
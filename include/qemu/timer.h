@@ -86,7 +86,8 @@ struct QEMUTimer {
     QEMUTimerList *timer_list;
     QEMUTimerCB *cb;
     void *opaque;
-    QEMUTimer *next;
+    int64_t seq;                /* breaks ties between equal expire times */
+    int heap_index;             /* position in the timer list's heap */
     int attributes;
     int scale;
 };
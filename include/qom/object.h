@@ -380,6 +380,10 @@ typedef void (ObjectUnparent)(Object *obj);
 typedef void (ObjectFree)(void *obj);
 
 #define OBJECT_CLASS_CAST_CACHE 4
+#define OBJECT_CLASS_DYNAMIC_CAST_CACHE 8
+
+typedef struct ObjectCastCacheEntry ObjectCastCacheEntry;
+typedef struct ObjectPropertyTable ObjectPropertyTable;
 
 /**
  * ObjectClass:
@@ -399,6 +403,10 @@ struct ObjectClass
     ObjectUnparent *unparent;
 
     GHashTable *properties;
+
+    /* see object_class_dynamic_cast() and object_class_property_find() */
+    ObjectCastCacheEntry *dynamic_cast_cache[OBJECT_CLASS_DYNAMIC_CAST_CACHE];
+    ObjectPropertyTable *properties_flat;
 };
 
 /**
@@ -193,6 +193,8 @@ void qemu_sglist_init(QEMUSGList *qsg, DeviceState *dev, int alloc_hint,
                       AddressSpace *as);
 void qemu_sglist_add(QEMUSGList *qsg, dma_addr_t base, dma_addr_t len);
 void qemu_sglist_destroy(QEMUSGList *qsg);
+size_t dma_memory_map_sg(QEMUSGList *sg, int *index, dma_addr_t *offset,
+                         QEMUIOVector *qiov, DMADirection dir);
 #endif
 
 typedef BlockAIOCB *DMAIOFunc(int64_t offset, QEMUIOVector *iov,
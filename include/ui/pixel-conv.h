@@ -0,0 +1,63 @@
+/*
+ * Framebuffer line conversion to x8r8g8b8
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef UI_PIXEL_CONV_H
+#define UI_PIXEL_CONV_H
+
+/*
+ * Source pixel formats, named from the most significant bits of the
+ * pixel value down: PIXEL_CONV_RGB565 has red in bits 15-11.  Padding
+ * bits (the X in XRGB) are ignored, as is the intensity bit of 16-bit
+ * 5551 framebuffers.  PIXEL_CONV_PAL8 indexes the palette passed to the
+ * conversion function, which is already in the destination format.
+ */
+typedef enum PixelConvFormat {
+    PIXEL_CONV_PAL8,
+    PIXEL_CONV_RGB444,          /* 16 bits, top 4 unused */
+    PIXEL_CONV_RGB555,          /* 16 bits, top bit unused */
+    PIXEL_CONV_RGB565,
+    PIXEL_CONV_RGB888,          /* 3 bytes per pixel */
+    PIXEL_CONV_XRGB8888,
+    PIXEL_CONV__MAX,
+} PixelConvFormat;
+
+/* Swap red and blue: PIXEL_CONV_RGB565 becomes BGR565, and so on */
+#define PIXEL_CONV_BGR          1
+/* Each pixel value is stored big-endian (otherwise little-endian) */
+#define PIXEL_CONV_BE           2
+/*
+ * The line is made of big-endian 32-bit words, each holding pixels from
+ * the least significant bits up.  This is how ARM "big-endian byte,
+ * big-endian pixel" LCD controllers see memory: for 8 and 16 bits per
+ * pixel it also reverses the order of the pixels within each word.
+ * Not available for PIXEL_CONV_RGB888.
+ */
+#define PIXEL_CONV_BE32         4
+
+/*
+ * Convert @width pixels from @src to host-endian x8r8g8b8 pixels at
+ * @dst, the format of a 32 bits per pixel DisplaySurface.  @palette is
+ * only used for PIXEL_CONV_PAL8.
+ */
+typedef void PixelConvFunc(uint32_t *dst, const uint8_t *src, int width,
+                           const uint32_t *palette);
+
+/*
+ * Return the converter for @format with @flags (a PIXEL_CONV_BGR,
+ * PIXEL_CONV_BE, PIXEL_CONV_BE32 mask), or NULL if the combination is
+ * not supported.  The converter uses the best vector instructions that
+ * the host CPU supports.
+ */
+PixelConvFunc *pixel_conv_get(PixelConvFormat format, unsigned flags);
+
+/*
+ * For tests: switch pixel_conv_get() to the next less preferred set of
+ * converters, returning false once the plain C set is in use.
+ */
+bool test_pixel_conv_next_accel(void);
+
+#endif
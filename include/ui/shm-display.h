@@ -0,0 +1,89 @@
+/*
+ * Shared memory display sink: file layout
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef UI_SHM_DISPLAY_H
+#define UI_SHM_DISPLAY_H
+
+/* Consumers build this header on its own, outside of QEMU */
+#include <stdint.h>
+
+/*
+ * "-display shm,path=FILE" publishes the guest display in FILE, which
+ * other processes can mmap() to grab frames without a copy and without
+ * asking QEMU anything.  All fields are in host byte order.
+ *
+ * The file starts with a ShmDisplayHeader, followed by the frame buffers
+ * of the @nr_slots slots.  Each frame is @width x @height pixels of
+ * @format (always PIXMAN_x8r8g8b8), @stride bytes per line, at @offset
+ * bytes from the start of the file.  When the display grows, a slot that
+ * is too small for the next frame gets a new buffer at the end of the
+ * file, and only that slot's @offset changes: the buffers of the other
+ * slots never move.  The file only grows; when @size changes, map it
+ * again.  @magic is set last, once the header is valid.  Counters are
+ * 32 bits wide so that they can be read atomically on any host, and
+ * wrap around.
+ *
+ * Frames are written round robin into the slots.  @frame counts the
+ * frames published so far, and @latest is the slot that holds the last
+ * one.  Each slot is protected by a sequence counter: @seq is odd while
+ * QEMU writes the slot, and twice the number of the frame it holds
+ * otherwise.  To read a frame:
+ *
+ *     do {
+ *         slot = &hdr->slots[atomic_load(&hdr->latest)];
+ *         seq = atomic_load_acquire(&slot->seq);
+ *         ... use slot->width, slot->height, the pixels, slot->rects ...
+ *         atomic_thread_fence(memory_order_acquire);
+ *     } while ((seq & 1) || atomic_load(&slot->seq) != seq);
+ *
+ * A slot is only overwritten once @nr_slots - 1 newer frames have been
+ * published, which gives consumers time to finish with the latest one.
+ *
+ * @rects lists what changed since the previous frame (frame number
+ * seq / 2 - 1).  When there are more than SHM_DISPLAY_MAX_RECTS
+ * changes, some are merged into their bounding box.  A consumer that
+ * skipped frames can use every skipped frame's rects, as long as it
+ * still finds them in the slots (their @seq), or else has to treat the
+ * whole frame as changed.
+ */
+
+#define SHM_DISPLAY_MAGIC       0x444d4853554d4551ULL /* "QEMUSHMD" (LE) */
+#define SHM_DISPLAY_VERSION     1
+#define SHM_DISPLAY_MAX_SLOTS   8
+#define SHM_DISPLAY_MAX_RECTS   16
+
+typedef struct ShmDisplayRect {
+    uint32_t x;
+    uint32_t y;
+    uint32_t w;
+    uint32_t h;
+} ShmDisplayRect;
+
+typedef struct ShmDisplaySlot {
+    uint32_t seq;
+    uint32_t nr_rects;
+    uint64_t offset;
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t reserved;
+    ShmDisplayRect rects[SHM_DISPLAY_MAX_RECTS];
+} ShmDisplaySlot;
+
+typedef struct ShmDisplayHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t format;
+    uint64_t size;
+    uint32_t frame;
+    uint32_t nr_slots;
+    uint32_t latest;
+    uint32_t reserved;
+    ShmDisplaySlot slots[SHM_DISPLAY_MAX_SLOTS];
+} ShmDisplayHeader;
+
+#endif
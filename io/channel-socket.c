@@ -26,6 +26,15 @@
 #include "io/channel-watch.h"
 #include "trace.h"
 #include "qapi/clone-visitor.h"
+#include "qemu/iov.h"
+
+#ifdef CONFIG_LINUX
+#include <linux/errqueue.h>
+
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+#define QEMU_MSG_ZEROCOPY
+#endif
+#endif
 
 #define SOCKET_MAX_FDS 16
 
@@ -658,6 +667,142 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
 }
 #endif /* WIN32 */
 
+#ifdef QEMU_MSG_ZEROCOPY
+int qio_channel_socket_set_zero_copy(QIOChannelSocket *ioc,
+                                     Error **errp)
+{
+    int v = 1;
+
+    if (setsockopt(ioc->fd, SOL_SOCKET, SO_ZEROCOPY, &v, sizeof(v)) < 0) {
+        error_setg_errno(errp, errno, "Unable to enable zero-copy sends");
+        return -1;
+    }
+    return 0;
+}
+
+int qio_channel_socket_writev_zero_copy_all(QIOChannelSocket *ioc,
+                                            const struct iovec *iov,
+                                            size_t niov,
+                                            Error **errp)
+{
+    int ret = -1;
+    struct iovec *local_iov = g_new(struct iovec, niov);
+    struct iovec *local_iov_head = local_iov;
+    unsigned int nlocal_iov = niov;
+
+    nlocal_iov = iov_copy(local_iov, nlocal_iov,
+                          iov, niov,
+                          0, iov_size(iov, niov));
+
+    while (nlocal_iov > 0) {
+        struct msghdr msg = {
+            .msg_iov = local_iov,
+            .msg_iovlen = nlocal_iov,
+        };
+        ssize_t len = sendmsg(ioc->fd, &msg, MSG_ZEROCOPY);
+
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                qio_channel_wait(QIO_CHANNEL(ioc), G_IO_OUT);
+                continue;
+            }
+            if (errno == ENOBUFS &&
+                ioc->zero_copy_sent < ioc->zero_copy_queued) {
+                /* Too much memory is pinned by earlier sends, reap them */
+                if (qio_channel_socket_flush(ioc, errp) < 0) {
+                    goto cleanup;
+                }
+                continue;
+            }
+            error_setg_errno(errp, errno, "Unable to write to socket");
+            goto cleanup;
+        }
+
+        ioc->zero_copy_queued++;
+        iov_discard_front(&local_iov, &nlocal_iov, len);
+    }
+
+    ret = 0;
+ cleanup:
+    g_free(local_iov_head);
+    return ret;
+}
+
+int qio_channel_socket_flush(QIOChannelSocket *ioc,
+                             Error **errp)
+{
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+
+    while (ioc->zero_copy_sent < ioc->zero_copy_queued) {
+        struct msghdr msg = {
+            .msg_control = control,
+            .msg_controllen = sizeof(control),
+        };
+        struct sock_extended_err *serr;
+        struct cmsghdr *cm;
+
+        /* Reading the error queue never blocks */
+        if (recvmsg(ioc->fd, &msg, MSG_ERRQUEUE) < 0) {
+            if (errno == EAGAIN) {
+                /* New completions are signalled as an error condition */
+                qio_channel_wait(QIO_CHANNEL(ioc), G_IO_ERR);
+                continue;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            error_setg_errno(errp, errno,
+                             "Unable to read socket error queue");
+            return -1;
+        }
+
+        cm = CMSG_FIRSTHDR(&msg);
+        if (!cm ||
+            !((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+              (cm->cmsg_level == SOL_IPV6 &&
+               cm->cmsg_type == IPV6_RECVERR))) {
+            error_setg(errp, "Unexpected message in socket error queue");
+            return -1;
+        }
+
+        serr = (struct sock_extended_err *)CMSG_DATA(cm);
+        if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr->ee_errno) {
+            error_setg_errno(errp, serr->ee_errno, "Zero-copy send failed");
+            return -1;
+        }
+
+        /* ee_info to ee_data is the range of sends that completed */
+        ioc->zero_copy_sent += serr->ee_data - serr->ee_info + 1;
+    }
+    return 0;
+}
+#else /* !QEMU_MSG_ZEROCOPY */
+int qio_channel_socket_set_zero_copy(QIOChannelSocket *ioc,
+                                     Error **errp)
+{
+    error_setg(errp, "Zero-copy sends are not supported on this host");
+    return -1;
+}
+
+int qio_channel_socket_writev_zero_copy_all(QIOChannelSocket *ioc,
+                                            const struct iovec *iov,
+                                            size_t niov,
+                                            Error **errp)
+{
+    error_setg(errp, "Zero-copy sends are not supported on this host");
+    return -1;
+}
+
+int qio_channel_socket_flush(QIOChannelSocket *ioc,
+                             Error **errp)
+{
+    return 0;
+}
+#endif /* QEMU_MSG_ZEROCOPY */
+
 static int
 qio_channel_socket_set_blocking(QIOChannel *ioc,
                                 bool enabled,
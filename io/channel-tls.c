@@ -21,9 +21,24 @@
 #include "qemu/osdep.h"
 #include "qapi/error.h"
 #include "qemu/module.h"
+#include "qemu/iov.h"
 #include "io/channel-tls.h"
+#include "io/channel-socket.h"
 #include "trace.h"
 
+#ifdef CONFIG_KTLS
+#include <linux/tls.h>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+#define TLS_RECORD_ALERT     21
+#define TLS_RECORD_HANDSHAKE 22
+
+#define TLS_HANDSHAKE_NEW_SESSION_TICKET 4
+#endif
+
 
 static ssize_t qio_channel_tls_write_handler(const char *buf,
                                              size_t len,
@@ -73,6 +88,7 @@ qio_channel_tls_new_server(QIOChannel *master,
     ioc = QIO_CHANNEL_TLS(object_new(TYPE_QIO_CHANNEL_TLS));
 
     ioc->master = master;
+    ioc->ktls = creds->ktls;
     object_ref(OBJECT(master));
 
     ioc->session = qcrypto_tls_session_new(
@@ -112,6 +128,7 @@ qio_channel_tls_new_client(QIOChannel *master,
     ioc = QIO_CHANNEL(tioc);
 
     tioc->master = master;
+    tioc->ktls = creds->ktls;
     if (qio_channel_has_feature(master, QIO_CHANNEL_FEATURE_SHUTDOWN)) {
         qio_channel_set_feature(ioc, QIO_CHANNEL_FEATURE_SHUTDOWN);
     }
@@ -151,6 +168,39 @@ static gboolean qio_channel_tls_handshake_io(QIOChannel *ioc,
                                              GIOCondition condition,
                                              gpointer user_data);
 
+/*
+ * Hand the record encryption over to the kernel.  This is best
+ * effort: the session keeps going through gnutls if it cannot be
+ * offloaded, for instance because of the cipher or of an older kernel.
+ *
+ * Receiving is offloaded first, and sending only if that worked:
+ * gnutls must not process incoming records, such as a TLS 1.3
+ * KeyUpdate, that change the keys of an offloaded sending side.
+ */
+static void qio_channel_tls_enable_ktls(QIOChannelTLS *ioc)
+{
+    Error *err = NULL;
+    int fd;
+
+    if (!ioc->ktls ||
+        !object_dynamic_cast(OBJECT(ioc->master), TYPE_QIO_CHANNEL_SOCKET)) {
+        return;
+    }
+    fd = QIO_CHANNEL_SOCKET(ioc->master)->fd;
+
+    if (qcrypto_tls_session_enable_ktls(ioc->session, fd, true, &err) == 0) {
+        ioc->ktls_rx = true;
+        if (qcrypto_tls_session_enable_ktls(ioc->session, fd,
+                                            false, &err) == 0) {
+            ioc->ktls_tx = true;
+        }
+    }
+    trace_qio_channel_tls_ktls(ioc, ioc->ktls_tx, ioc->ktls_rx);
+    if (err) {
+        warn_report_err(err);
+    }
+}
+
 static void qio_channel_tls_handshake_task(QIOChannelTLS *ioc,
                                            QIOTask *task,
                                            GMainContext *context)
@@ -174,6 +224,7 @@ static void qio_channel_tls_handshake_task(QIOChannelTLS *ioc,
             qio_task_set_error(task, err);
         } else {
             trace_qio_channel_tls_credentials_allow(ioc);
+            qio_channel_tls_enable_ktls(ioc);
         }
         qio_task_complete(task);
     } else {
@@ -254,6 +305,121 @@ static void qio_channel_tls_finalize(Object *obj)
 }
 
 
+#ifdef CONFIG_KTLS
+/*
+ * Go through the @len bytes of a handshake record read into @iov.
+ * The messages may span several reads, so the parsing state lives
+ * in @tioc.  Session tickets are of no use here and dropped; any
+ * other message, such as a TLS 1.3 KeyUpdate, would need gnutls,
+ * which no longer sees the records, and is an error.
+ */
+static int qio_channel_tls_ktls_handshake(QIOChannelTLS *tioc,
+                                          const struct iovec *iov,
+                                          size_t niov,
+                                          size_t len,
+                                          Error **errp)
+{
+    size_t off = 0, n;
+
+    while (off < len) {
+        if (tioc->ktls_hs_skip) {
+            n = MIN(tioc->ktls_hs_skip, len - off);
+            tioc->ktls_hs_skip -= n;
+            off += n;
+            continue;
+        }
+
+        /* A 1 byte type and a 24 bit length head each message */
+        n = MIN(sizeof(tioc->ktls_hs) - tioc->ktls_hs_len, len - off);
+        iov_to_buf(iov, niov, off, tioc->ktls_hs + tioc->ktls_hs_len, n);
+        tioc->ktls_hs_len += n;
+        off += n;
+        if (tioc->ktls_hs_len < sizeof(tioc->ktls_hs)) {
+            continue;
+        }
+        if (tioc->ktls_hs[0] != TLS_HANDSHAKE_NEW_SESSION_TICKET) {
+            error_setg(errp, "Unsupported TLS post-handshake message %u",
+                       tioc->ktls_hs[0]);
+            return -1;
+        }
+        tioc->ktls_hs_skip = (tioc->ktls_hs[1] << 16) |
+                             (tioc->ktls_hs[2] << 8) | tioc->ktls_hs[3];
+        tioc->ktls_hs_len = 0;
+    }
+    return 0;
+}
+
+/*
+ * The kernel only decrypts the records; those that are not payload
+ * come with their type in a control message.
+ */
+static ssize_t qio_channel_tls_ktls_readv(QIOChannelTLS *tioc,
+                                          const struct iovec *iov,
+                                          size_t niov,
+                                          Error **errp)
+{
+    int fd = QIO_CHANNEL_SOCKET(tioc->master)->fd;
+    char control[CMSG_SPACE(sizeof(unsigned char))];
+    struct cmsghdr *cmsg;
+    unsigned char alert[2];
+    ssize_t ret;
+
+ retry:
+    {
+        struct msghdr msg = {
+            .msg_iov = (struct iovec *)iov,
+            .msg_iovlen = niov,
+            .msg_control = control,
+            .msg_controllen = sizeof(control),
+        };
+
+        ret = recvmsg(fd, &msg, 0);
+        if (ret < 0) {
+            if (errno == EAGAIN) {
+                return QIO_CHANNEL_ERR_BLOCK;
+            }
+            if (errno == EINTR) {
+                goto retry;
+            }
+            error_setg_errno(errp, errno, "Cannot read from TLS channel");
+            return -1;
+        }
+        cmsg = CMSG_FIRSTHDR(&msg);
+    }
+
+    if (cmsg && cmsg->cmsg_level == SOL_TLS &&
+        cmsg->cmsg_type == TLS_GET_RECORD_TYPE &&
+        *CMSG_DATA(cmsg) == TLS_RECORD_HANDSHAKE) {
+        if (qio_channel_tls_ktls_handshake(tioc, iov, niov, ret, errp) < 0) {
+            return -1;
+        }
+        goto retry;
+    }
+    if (tioc->ktls_hs_len || tioc->ktls_hs_skip) {
+        error_setg(errp, "Truncated TLS post-handshake message");
+        return -1;
+    }
+
+    if (!cmsg || cmsg->cmsg_level != SOL_TLS ||
+        cmsg->cmsg_type != TLS_GET_RECORD_TYPE) {
+        return ret;
+    }
+    switch (*CMSG_DATA(cmsg)) {
+    case TLS_RECORD_ALERT:
+        /* close_notify is a clean end of file, anything else an error */
+        if (iov_to_buf(iov, niov, 0, alert, sizeof(alert)) == sizeof(alert) &&
+            alert[1] == 0) {
+            return 0;
+        }
+        error_setg(errp, "TLS alert received");
+        return -1;
+    default:
+        return ret;
+    }
+}
+#endif
+
+
 static ssize_t qio_channel_tls_readv(QIOChannel *ioc,
                                      const struct iovec *iov,
                                      size_t niov,
@@ -265,6 +431,12 @@ static ssize_t qio_channel_tls_readv(QIOChannel *ioc,
     size_t i;
     ssize_t got = 0;
 
+#ifdef CONFIG_KTLS
+    if (tioc->ktls_rx) {
+        return qio_channel_tls_ktls_readv(tioc, iov, niov, errp);
+    }
+#endif
+
     for (i = 0 ; i < niov ; i++) {
         ssize_t ret = qcrypto_tls_session_read(tioc->session,
                                                iov[i].iov_base,
@@ -305,6 +477,10 @@ static ssize_t qio_channel_tls_writev(QIOChannel *ioc,
     size_t i;
     ssize_t done = 0;
 
+    if (tioc->ktls_tx) {
+        return qio_channel_writev(tioc->master, iov, niov, errp);
+    }
+
     for (i = 0 ; i < niov ; i++) {
         ssize_t ret = qcrypto_tls_session_write(tioc->session,
                                                 iov[i].iov_base,
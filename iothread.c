@@ -335,6 +335,21 @@ static int query_one_iothread(Object *object, void *opaque)
     info->poll_max_ns = iothread->poll_max_ns;
     info->poll_grow = iothread->poll_grow;
     info->poll_shrink = iothread->poll_shrink;
+    if (iothread->ctx) {
+        AioContext *ctx = iothread->ctx;
+        uint64List **next = &info->poll_wait_histogram;
+        int i;
+
+        info->poll_hits = stat64_get(&ctx->poll_hits);
+        info->poll_misses = stat64_get(&ctx->poll_misses);
+        for (i = AIO_POLL_WAIT_HIST_BUCKETS - 1; i >= 0; i--) {
+            uint64List *bin = g_new0(uint64List, 1);
+
+            bin->value = stat64_get(&ctx->poll_wait_hist[i]);
+            bin->next = *next;
+            *next = bin;
+        }
+    }
 
     elem = g_new0(IOThreadInfoList, 1);
     elem->value = info;
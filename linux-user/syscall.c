@@ -110,6 +110,7 @@
 
 #include "qemu.h"
 #include "qemu/guest-random.h"
+#include "qemu/plugin.h"
 #include "qapi/error.h"
 #include "fd-trans.h"
 
@@ -7267,6 +7268,8 @@ static abi_long do_syscall1(void *cpu_env, int num, abi_long arg1,
                 sys_futex(g2h(ts->child_tidptr), FUTEX_WAKE, INT_MAX,
                           NULL, NULL, 0);
             }
+            /* the CPU is freed without being unrealized */
+            qemu_plugin_vcpu_exit_hook(cpu);
             thread_cpu = NULL;
             object_unref(OBJECT(cpu));
             g_free(ts);
@@ -11947,6 +11950,128 @@ static abi_long do_syscall1(void *cpu_env, int num, abi_long arg1,
     return ret;
 }
 
+/*
+ * Syscall fast path.  When the guest has the syscall ABI of the host
+ * (same architecture and byte order), syscalls that only take integers
+ * and at most one plain buffer need no conversion: they go to the host
+ * as they are, without the strace and big switch of do_syscall1().
+ * The buffer is still checked against the guest mappings, which also
+ * makes pages holding translated code writable again.
+ */
+#if ((defined(TARGET_AARCH64) && defined(__aarch64__)) || \
+     (defined(TARGET_ARM) && !defined(TARGET_AARCH64) && \
+      defined(__arm__) && defined(__ARM_EABI__))) && \
+    defined(TARGET_WORDS_BIGENDIAN) == defined(HOST_WORDS_BIGENDIAN) && \
+    !defined(DEBUG_REMAP)
+#define SYSCALL_FAST_PATH
+
+typedef struct SyscallFast {
+    bool valid;
+    bool fd;            /* arg1 is an fd, which must not be translated */
+    uint8_t buf;        /* argument pointing to a guest buffer, or 0 */
+    uint8_t len;        /* argument with the size of the buffer, or 0 */
+    uint8_t size;       /* otherwise, the size of the buffer */
+    uint8_t type;       /* VERIFY_READ or VERIFY_WRITE */
+    int host_nr;
+} SyscallFast;
+
+#define SYSCALL_FAST(name, ...) \
+    [TARGET_NR_##name] = { .valid = true, .host_nr = __NR_##name, __VA_ARGS__ }
+
+static const SyscallFast syscall_fast[] = {
+    SYSCALL_FAST(read, .fd = true, .buf = 2, .len = 3, .type = VERIFY_WRITE),
+    SYSCALL_FAST(write, .fd = true, .buf = 2, .len = 3, .type = VERIFY_READ),
+    SYSCALL_FAST(pread64, .fd = true, .buf = 2, .len = 3,
+                 .type = VERIFY_WRITE),
+    SYSCALL_FAST(pwrite64, .fd = true, .buf = 2, .len = 3,
+                 .type = VERIFY_READ),
+    SYSCALL_FAST(lseek),
+    SYSCALL_FAST(fsync),
+    SYSCALL_FAST(fdatasync),
+    SYSCALL_FAST(getpid),
+    SYSCALL_FAST(getppid),
+    SYSCALL_FAST(gettid),
+    SYSCALL_FAST(sched_yield),
+    SYSCALL_FAST(clock_gettime, .buf = 2, .size = sizeof(struct timespec),
+                 .type = VERIFY_WRITE),
+};
+
+#if defined(TARGET_NR_futex) && defined(__NR_futex)
+/* The futex operations that do_futex() passes through unchanged */
+static bool do_futex_fast(abi_long *args, abi_long *ret)
+{
+    struct timespec *pts = NULL;
+    int op = args[1];
+
+#ifdef FUTEX_CMD_MASK
+    switch (op & FUTEX_CMD_MASK) {
+#else
+    switch (op) {
+#endif
+    case FUTEX_WAIT:
+    case FUTEX_WAIT_BITSET:
+        if (args[3]) {
+            if (!access_ok(VERIFY_READ, args[3], sizeof(struct timespec))) {
+                *ret = -TARGET_EFAULT;
+                return true;
+            }
+            pts = g2h(args[3]);
+        }
+        *ret = get_errno(safe_futex(g2h(args[0]), op, args[2], pts,
+                                    NULL, args[5]));
+        return true;
+    case FUTEX_WAKE:
+        *ret = get_errno(safe_futex(g2h(args[0]), op, args[2], NULL,
+                                    NULL, 0));
+        return true;
+    default:
+        return false;
+    }
+}
+#endif
+
+/* Return false if syscall @num has to take the normal path */
+static bool do_syscall_fast(void *cpu_env, int num, abi_long *args,
+                            abi_long *ret)
+{
+    const SyscallFast *f;
+
+#ifndef TARGET_AARCH64
+    if (!((CPUARMState *)cpu_env)->eabi) {
+        return false;
+    }
+#endif
+#if defined(TARGET_NR_futex) && defined(__NR_futex)
+    if (num == TARGET_NR_futex) {
+        return do_futex_fast(args, ret);
+    }
+#endif
+    if (num < 0 || num >= ARRAY_SIZE(syscall_fast) ||
+        !syscall_fast[num].valid) {
+        return false;
+    }
+    f = &syscall_fast[num];
+
+    if (f->fd && (fd_trans_target_to_host_data(args[0]) ||
+                  fd_trans_host_to_target_data(args[0]))) {
+        return false;
+    }
+    if (f->buf) {
+        abi_ulong addr = args[f->buf - 1];
+        abi_ulong len = f->len ? args[f->len - 1] : f->size;
+
+        if (!access_ok(f->type, addr, len)) {
+            *ret = -TARGET_EFAULT;
+            return true;
+        }
+        args[f->buf - 1] = (abi_long)(uintptr_t)g2h(addr);
+    }
+    *ret = get_errno(safe_syscall(f->host_nr, args[0], args[1], args[2],
+                                  args[3], args[4], args[5]));
+    return true;
+}
+#endif
+
 abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
                     abi_long arg2, abi_long arg3, abi_long arg4,
                     abi_long arg5, abi_long arg6, abi_long arg7,
@@ -11972,6 +12097,17 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
     trace_guest_user_syscall(cpu, num, arg1, arg2, arg3, arg4,
                              arg5, arg6, arg7, arg8);
 
+#ifdef SYSCALL_FAST_PATH
+    if (likely(!do_strace)) {
+        abi_long args[6] = { arg1, arg2, arg3, arg4, arg5, arg6 };
+
+        if (do_syscall_fast(cpu_env, num, args, &ret)) {
+            trace_guest_user_syscall_ret(cpu, num, ret);
+            return ret;
+        }
+    }
+#endif
+
     if (unlikely(do_strace)) {
         print_syscall(num, arg1, arg2, arg3, arg4, arg5, arg6);
         ret = do_syscall1(cpu_env, num, arg1, arg2, arg3, arg4,
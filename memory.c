@@ -19,10 +19,16 @@
 #include "exec/memory.h"
 #include "exec/address-spaces.h"
 #include "qapi/visitor.h"
+#include "qapi/qmp/qerror.h"
 #include "qemu/bitops.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
 #include "qemu/qemu-print.h"
+#include "qemu/qht.h"
+#include "qemu/rcu.h"
+#include "qemu/stats64.h"
+#include "qemu/timer.h"
+#include "qemu/xxhash.h"
 #include "qom/object.h"
 #include "trace-root.h"
 
@@ -34,12 +40,18 @@
 #include "sysemu/accel.h"
 #include "hw/boards.h"
 #include "migration/vmstate.h"
+#include "qapi/qapi-commands-misc.h"
 
 //#define DEBUG_UNASSIGNED
 
 static unsigned memory_region_transaction_depth;
 static bool memory_region_update_pending;
 static bool ioeventfd_update_pending;
+/* Trees whose flat views must be regenerated at the end of the current
+ * transaction, identified by their topmost container.  If
+ * memory_region_update_all is set, every flat view is regenerated.  */
+static GHashTable *memory_region_update_roots;
+static bool memory_region_update_all;
 bool global_dirty_log;
 
 static QTAILQ_HEAD(, MemoryListener) memory_listeners
@@ -568,6 +580,19 @@ static MemTxResult access_with_adjusted_size(hwaddr addr,
     return r;
 }
 
+/* True if a @size byte access can be passed to the MemoryRegionOps
+ * callback as is, without splitting or widening it.  This is the common
+ * case for device registers, so skip access_with_adjusted_size() then.
+ */
+static inline bool memory_region_access_direct(MemoryRegion *mr,
+                                               unsigned size)
+{
+    unsigned min = mr->ops->impl.min_access_size ? : 1;
+    unsigned max = mr->ops->impl.max_access_size ? : 4;
+
+    return size >= min && size <= max;
+}
+
 static AddressSpace *memory_region_to_address_space(MemoryRegion *mr)
 {
     AddressSpace *as;
@@ -985,26 +1010,82 @@ static void flatviews_init(void)
     }
 }
 
+static MemoryRegion *memory_region_topmost(MemoryRegion *mr)
+{
+    while (mr->container) {
+        mr = mr->container;
+    }
+    return mr;
+}
+
+/*
+ * Note that the tree containing @mr changed, or that everything did if
+ * @mr is NULL.  A region that is the target of an alias can show up in
+ * other trees too, so changes at or below one dirty all the flat views.
+ */
+static void memory_region_update_mark(MemoryRegion *mr)
+{
+    memory_region_update_pending = true;
+    for (; mr; mr = mr->container) {
+        if (mr->aliased) {
+            break;
+        }
+        if (!mr->container) {
+            if (!memory_region_update_roots) {
+                memory_region_update_roots = g_hash_table_new(NULL, NULL);
+            }
+            g_hash_table_add(memory_region_update_roots, mr);
+            return;
+        }
+    }
+    memory_region_update_all = true;
+}
+
+static bool memory_region_update_needed(MemoryRegion *mr)
+{
+    return memory_region_update_all ||
+           (memory_region_update_roots &&
+            g_hash_table_contains(memory_region_update_roots,
+                                  memory_region_topmost(mr)));
+}
+
 static void flatviews_reset(void)
 {
+    GHashTable *old_views = flat_views;
     AddressSpace *as;
 
-    if (flat_views) {
-        g_hash_table_unref(flat_views);
-        flat_views = NULL;
-    }
+    flat_views = NULL;
     flatviews_init();
 
-    /* Render unique FVs */
+    /* Render unique FVs, keeping those of the trees that did not change */
     QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
         MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
+        FlatView *view;
 
         if (g_hash_table_lookup(flat_views, physmr)) {
             continue;
         }
 
+        if (old_views && !memory_region_update_needed(as->root) &&
+            !memory_region_update_needed(physmr)) {
+            view = g_hash_table_lookup(old_views, physmr);
+            if (view) {
+                flatview_ref(view);
+                g_hash_table_replace(flat_views, physmr, view);
+                continue;
+            }
+        }
+
         generate_memory_topology(physmr);
     }
+
+    if (old_views) {
+        g_hash_table_unref(old_views);
+    }
+    if (memory_region_update_roots) {
+        g_hash_table_remove_all(memory_region_update_roots);
+    }
+    memory_region_update_all = false;
 }
 
 static void address_space_set_flatview(AddressSpace *as)
@@ -1411,6 +1492,187 @@ bool memory_region_access_valid(MemoryRegion *mr,
     return true;
 }
 
+/*
+ * MMIO access statistics, one entry per region and offset.  Entries are
+ * inserted by the accessing thread and removed by a reset or when their
+ * region is finalized, so that a new region allocated at the same address
+ * does not inherit them.  They are freed after an RCU grace period; the
+ * region name is copied since a reader may still see the entry then.
+ */
+typedef struct MMIOStatsEntry {
+    struct rcu_head rcu;
+    MemoryRegion *mr;
+    hwaddr offset;
+    char *name;
+    Stat64 reads;
+    Stat64 writes;
+    Stat64 ns;
+} MMIOStatsEntry;
+
+#define MMIO_STATS_INITIAL_SIZE 256
+
+bool mmio_stats_enabled;
+static struct qht mmio_stats_ht;
+static bool mmio_stats_initialized;
+
+static uint32_t mmio_stats_hash(MemoryRegion *mr, hwaddr offset)
+{
+    return qemu_xxhash4((uint64_t)(uintptr_t)mr, offset);
+}
+
+static bool mmio_stats_cmp(const void *ap, const void *bp)
+{
+    const MMIOStatsEntry *a = ap;
+    const MMIOStatsEntry *b = bp;
+
+    return a->mr == b->mr && a->offset == b->offset;
+}
+
+static void mmio_stats_account(MemoryRegion *mr, hwaddr offset,
+                               bool is_write, int64_t ns)
+{
+    MMIOStatsEntry orig = { .mr = mr, .offset = offset };
+    uint32_t hash = mmio_stats_hash(mr, offset);
+    MMIOStatsEntry *e;
+    void *existing = NULL;
+
+    rcu_read_lock();
+    e = qht_lookup(&mmio_stats_ht, &orig, hash);
+    if (unlikely(e == NULL)) {
+        e = g_new0(MMIOStatsEntry, 1);
+        e->mr = mr;
+        e->offset = offset;
+        e->name = g_strdup(memory_region_name(mr));
+        if (!qht_insert(&mmio_stats_ht, e, hash, &existing)) {
+            g_free(e->name);
+            g_free(e);
+            e = existing;
+        }
+    }
+    stat64_add(is_write ? &e->writes : &e->reads, 1);
+    stat64_add(&e->ns, ns);
+    rcu_read_unlock();
+}
+
+void mmio_stats_set(bool on)
+{
+    if (on && !mmio_stats_initialized) {
+        qht_init(&mmio_stats_ht, mmio_stats_cmp, MMIO_STATS_INITIAL_SIZE,
+                 QHT_MODE_AUTO_RESIZE);
+        mmio_stats_initialized = true;
+    }
+    atomic_mb_set(&mmio_stats_enabled, on);
+}
+
+static void mmio_stats_entry_free(MMIOStatsEntry *e)
+{
+    g_free(e->name);
+    g_free(e);
+}
+
+/* @up is the region whose entries are removed, or NULL for all of them */
+static bool mmio_stats_remove_iter(void *p, uint32_t h, void *up)
+{
+    MMIOStatsEntry *e = p;
+
+    if (up && e->mr != up) {
+        return false;
+    }
+    call_rcu(e, mmio_stats_entry_free, rcu);
+    return true;
+}
+
+void mmio_stats_reset(void)
+{
+    if (mmio_stats_initialized) {
+        qht_iter_remove(&mmio_stats_ht, mmio_stats_remove_iter, NULL);
+    }
+}
+
+static void mmio_stats_forget(MemoryRegion *mr)
+{
+    if (mmio_stats_initialized) {
+        qht_iter_remove(&mmio_stats_ht, mmio_stats_remove_iter, mr);
+    }
+}
+
+static void mmio_stats_collect_iter(void *p, uint32_t h, void *up)
+{
+    g_ptr_array_add(up, p);
+}
+
+static gint mmio_stats_cmp_count(gconstpointer ap, gconstpointer bp)
+{
+    const MMIOStatsEntry *a = *(MMIOStatsEntry *const *)ap;
+    const MMIOStatsEntry *b = *(MMIOStatsEntry *const *)bp;
+    uint64_t na = stat64_get(&a->reads) + stat64_get(&a->writes);
+    uint64_t nb = stat64_get(&b->reads) + stat64_get(&b->writes);
+
+    return na < nb ? 1 : na > nb ? -1 : 0;
+}
+
+static gint mmio_stats_cmp_time(gconstpointer ap, gconstpointer bp)
+{
+    const MMIOStatsEntry *a = *(MMIOStatsEntry *const *)ap;
+    const MMIOStatsEntry *b = *(MMIOStatsEntry *const *)bp;
+    uint64_t na = stat64_get(&a->ns);
+    uint64_t nb = stat64_get(&b->ns);
+
+    return na < nb ? 1 : na > nb ? -1 : 0;
+}
+
+MmioHotspotInfo *qmp_x_query_mmio_hotspots(bool has_max, int64_t max,
+                                           bool has_by_time, bool by_time,
+                                           bool has_reset, bool reset,
+                                           Error **errp)
+{
+    MmioHotspotInfo *info;
+    MmioHotspotList **tail;
+    GPtrArray *entries;
+    guint i;
+
+    if (!has_max) {
+        max = 20;
+    } else if (max <= 0) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "max",
+                   "a positive number");
+        return NULL;
+    }
+
+    info = g_new0(MmioHotspotInfo, 1);
+    tail = &info->hotspots;
+    info->enabled = atomic_read(&mmio_stats_enabled);
+    if (!mmio_stats_initialized) {
+        return info;
+    }
+
+    rcu_read_lock();
+    entries = g_ptr_array_new();
+    qht_iter(&mmio_stats_ht, mmio_stats_collect_iter, entries);
+    g_ptr_array_sort(entries, has_by_time && by_time ? mmio_stats_cmp_time
+                                                     : mmio_stats_cmp_count);
+    for (i = 0; i < entries->len && i < max; i++) {
+        MMIOStatsEntry *e = g_ptr_array_index(entries, i);
+        MmioHotspotList *elem = g_new0(MmioHotspotList, 1);
+
+        elem->value = g_new0(MmioHotspot, 1);
+        elem->value->region = g_strdup(e->name);
+        elem->value->offset = e->offset;
+        elem->value->reads = stat64_get(&e->reads);
+        elem->value->writes = stat64_get(&e->writes);
+        elem->value->time_ns = stat64_get(&e->ns);
+        *tail = elem;
+        tail = &elem->next;
+    }
+    g_ptr_array_free(entries, true);
+    rcu_read_unlock();
+
+    if (has_reset && reset) {
+        mmio_stats_reset();
+    }
+    return info;
+}
+
 static MemTxResult memory_region_dispatch_read1(MemoryRegion *mr,
                                                 hwaddr addr,
                                                 uint64_t *pval,
@@ -1419,6 +1681,17 @@ static MemTxResult memory_region_dispatch_read1(MemoryRegion *mr,
 {
     *pval = 0;
 
+    if (memory_region_access_direct(mr, size)) {
+        uint64_t mask = MAKE_64BIT_MASK(0, size * 8);
+
+        if (mr->ops->read) {
+            return memory_region_read_accessor(mr, addr, pval, size,
+                                               0, mask, attrs);
+        }
+        return memory_region_read_with_attrs_accessor(mr, addr, pval, size,
+                                                      0, mask, attrs);
+    }
+
     if (mr->ops->read) {
         return access_with_adjusted_size(addr, pval, size,
                                          mr->ops->impl.min_access_size,
@@ -1448,7 +1721,14 @@ MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
         return MEMTX_DECODE_ERROR;
     }
 
-    r = memory_region_dispatch_read1(mr, addr, pval, size, attrs);
+    if (unlikely(atomic_read(&mmio_stats_enabled))) {
+        int64_t t = get_clock();
+
+        r = memory_region_dispatch_read1(mr, addr, pval, size, attrs);
+        mmio_stats_account(mr, addr, false, get_clock() - t);
+    } else {
+        r = memory_region_dispatch_read1(mr, addr, pval, size, attrs);
+    }
     adjust_endianness(mr, pval, op);
     return r;
 }
@@ -1479,26 +1759,28 @@ static bool memory_region_dispatch_write_eventfds(MemoryRegion *mr,
     return false;
 }
 
-MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
-                                         hwaddr addr,
-                                         uint64_t data,
-                                         MemOp op,
-                                         MemTxAttrs attrs)
+static MemTxResult memory_region_dispatch_write1(MemoryRegion *mr,
+                                                 hwaddr addr,
+                                                 uint64_t data,
+                                                 unsigned size,
+                                                 MemTxAttrs attrs)
 {
-    unsigned size = memop_size(op);
-
-    if (!memory_region_access_valid(mr, addr, size, true, attrs)) {
-        unassigned_mem_write(mr, addr, data, size);
-        return MEMTX_DECODE_ERROR;
-    }
-
-    adjust_endianness(mr, &data, op);
-
     if ((!kvm_eventfds_enabled()) &&
         memory_region_dispatch_write_eventfds(mr, addr, data, size, attrs)) {
         return MEMTX_OK;
     }
 
+    if (memory_region_access_direct(mr, size)) {
+        uint64_t mask = MAKE_64BIT_MASK(0, size * 8);
+
+        if (mr->ops->write) {
+            return memory_region_write_accessor(mr, addr, &data, size,
+                                                0, mask, attrs);
+        }
+        return memory_region_write_with_attrs_accessor(mr, addr, &data, size,
+                                                       0, mask, attrs);
+    }
+
     if (mr->ops->write) {
         return access_with_adjusted_size(addr, &data, size,
                                          mr->ops->impl.min_access_size,
@@ -1515,6 +1797,33 @@ MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
     }
 }
 
+MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
+                                         hwaddr addr,
+                                         uint64_t data,
+                                         MemOp op,
+                                         MemTxAttrs attrs)
+{
+    unsigned size = memop_size(op);
+    MemTxResult r;
+    int64_t t;
+
+    if (!memory_region_access_valid(mr, addr, size, true, attrs)) {
+        unassigned_mem_write(mr, addr, data, size);
+        return MEMTX_DECODE_ERROR;
+    }
+
+    adjust_endianness(mr, &data, op);
+
+    if (likely(!atomic_read(&mmio_stats_enabled))) {
+        return memory_region_dispatch_write1(mr, addr, data, size, attrs);
+    }
+
+    t = get_clock();
+    r = memory_region_dispatch_write1(mr, addr, data, size, attrs);
+    mmio_stats_account(mr, addr, true, get_clock() - t);
+    return r;
+}
+
 void memory_region_init_io(MemoryRegion *mr,
                            Object *owner,
                            const MemoryRegionOps *ops,
@@ -1679,6 +1988,7 @@ void memory_region_init_alias(MemoryRegion *mr,
     memory_region_init(mr, owner, name, size);
     mr->alias = orig;
     mr->alias_offset = offset;
+    orig->aliased = true;
 }
 
 void memory_region_init_rom_nomigrate(MemoryRegion *mr,
@@ -1767,6 +2077,7 @@ static void memory_region_finalize(Object *obj)
 
     mr->destructor(mr);
     memory_region_clear_coalescing(mr);
+    mmio_stats_forget(mr);
     g_free((char *)mr->name);
     g_free(mr->ioeventfds);
 }
@@ -2022,7 +2333,9 @@ void memory_region_set_log(MemoryRegion *mr, bool log, unsigned client)
 
     memory_region_transaction_begin();
     mr->dirty_log_mask = (mr->dirty_log_mask & ~mask) | (log * mask);
-    memory_region_update_pending |= mr->enabled;
+    if (mr->enabled) {
+        memory_region_update_mark(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2140,7 +2453,9 @@ void memory_region_set_readonly(MemoryRegion *mr, bool readonly)
     if (mr->readonly != readonly) {
         memory_region_transaction_begin();
         mr->readonly = readonly;
-        memory_region_update_pending |= mr->enabled;
+        if (mr->enabled) {
+            memory_region_update_mark(mr);
+        }
         memory_region_transaction_commit();
     }
 }
@@ -2150,7 +2465,9 @@ void memory_region_set_nonvolatile(MemoryRegion *mr, bool nonvolatile)
     if (mr->nonvolatile != nonvolatile) {
         memory_region_transaction_begin();
         mr->nonvolatile = nonvolatile;
-        memory_region_update_pending |= mr->enabled;
+        if (mr->enabled) {
+            memory_region_update_mark(mr);
+        }
         memory_region_transaction_commit();
     }
 }
@@ -2160,7 +2477,9 @@ void memory_region_rom_device_set_romd(MemoryRegion *mr, bool romd_mode)
     if (mr->romd_mode != romd_mode) {
         memory_region_transaction_begin();
         mr->romd_mode = romd_mode;
-        memory_region_update_pending |= mr->enabled;
+        if (mr->enabled) {
+            memory_region_update_mark(mr);
+        }
         memory_region_transaction_commit();
     }
 }
@@ -2401,7 +2720,9 @@ static void memory_region_update_container_subregions(MemoryRegion *subregion)
     }
     QTAILQ_INSERT_TAIL(&mr->subregions, subregion, subregions_link);
 done:
-    memory_region_update_pending |= mr->enabled && subregion->enabled;
+    if (mr->enabled && subregion->enabled) {
+        memory_region_update_mark(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2440,7 +2761,9 @@ void memory_region_del_subregion(MemoryRegion *mr,
     subregion->container = NULL;
     QTAILQ_REMOVE(&mr->subregions, subregion, subregions_link);
     memory_region_unref(subregion);
-    memory_region_update_pending |= mr->enabled && subregion->enabled;
+    if (mr->enabled && subregion->enabled) {
+        memory_region_update_mark(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2451,7 +2774,7 @@ void memory_region_set_enabled(MemoryRegion *mr, bool enabled)
     }
     memory_region_transaction_begin();
     mr->enabled = enabled;
-    memory_region_update_pending = true;
+    memory_region_update_mark(mr);
     memory_region_transaction_commit();
 }
 
@@ -2467,7 +2790,7 @@ void memory_region_set_size(MemoryRegion *mr, uint64_t size)
     }
     memory_region_transaction_begin();
     mr->size = s;
-    memory_region_update_pending = true;
+    memory_region_update_mark(mr);
     memory_region_transaction_commit();
 }
 
@@ -2504,7 +2827,9 @@ void memory_region_set_alias_offset(MemoryRegion *mr, hwaddr offset)
 
     memory_region_transaction_begin();
     mr->alias_offset = offset;
-    memory_region_update_pending |= mr->enabled;
+    if (mr->enabled) {
+        memory_region_update_mark(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2633,7 +2958,7 @@ void memory_global_dirty_log_start(void)
 
     /* Refresh DIRTY_MEMORY_MIGRATION bit.  */
     memory_region_transaction_begin();
-    memory_region_update_pending = true;
+    memory_region_update_mark(NULL);
     memory_region_transaction_commit();
 }
 
@@ -2643,7 +2968,7 @@ static void memory_global_dirty_log_do_stop(void)
 
     /* Refresh DIRTY_MEMORY_MIGRATION bit.  */
     memory_region_transaction_begin();
-    memory_region_update_pending = true;
+    memory_region_update_mark(NULL);
     memory_region_transaction_commit();
 
     MEMORY_LISTENER_CALL_GLOBAL(log_global_stop, Reverse);
@@ -2793,6 +3118,8 @@ void address_space_init(AddressSpace *as, MemoryRegion *root, const char *name)
     as->ioeventfd_nb = 0;
     as->ioeventfds = NULL;
     QTAILQ_INIT(&as->listeners);
+    QLIST_INIT(&as->bounce_buffers);
+    as->bounce_buffer_size = 0;
     QTAILQ_INSERT_TAIL(&address_spaces, as, address_spaces_link);
     as->name = g_strdup(name ? name : "anonymous");
     address_space_update_topology(as);
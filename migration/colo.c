@@ -16,6 +16,7 @@
 #include "qapi/qapi-commands-migration.h"
 #include "qemu-file-channel.h"
 #include "migration.h"
+#include "ram.h"
 #include "qemu-file.h"
 #include "savevm.h"
 #include "migration/colo.h"
@@ -820,6 +821,8 @@ void *colo_process_incoming_thread(void *opaque)
         }
 
         qemu_mutex_lock_iothread();
+        /* The RAM cache was flushed while the device state came in */
+        colo_flush_ram_cache_wait();
         vmstate_loading = true;
         ret = qemu_load_device_state(fb);
         if (ret < 0) {
@@ -873,6 +876,7 @@ void *colo_process_incoming_thread(void *opaque)
 
 out:
     vmstate_loading = false;
+    colo_flush_ram_cache_wait();
     /* Throw the unreported error message after exited from loop */
     if (local_err) {
         error_report_err(local_err);
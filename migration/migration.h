@@ -292,12 +292,16 @@ bool migrate_dirty_bitmaps(void);
 bool migrate_ignore_shared(void);
 
 bool migrate_auto_converge(void);
+bool migrate_vcpu_throttle(void);
 bool migrate_use_multifd(void);
+bool migrate_use_multifd_zero_page(void);
+bool migrate_use_zero_copy_send(void);
 bool migrate_pause_before_switchover(void);
 int migrate_multifd_channels(void);
 
 int migrate_use_xbzrle(void);
 int64_t migrate_xbzrle_cache_size(void);
+uint32_t migrate_postcopy_prefetch_pages(void);
 bool migrate_colo_enabled(void);
 
 bool migrate_use_block(void);
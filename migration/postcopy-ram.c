@@ -92,6 +92,9 @@ int postcopy_notify(enum PostcopyNotifyReason reason, Error **errp)
 #include <sys/eventfd.h>
 #include <linux/userfaultfd.h>
 
+/* Fault latency buckets: <1ms, then powers of two up to >= 2^14 ms */
+#define POSTCOPY_LATENCY_BUCKETS 16
+
 typedef struct PostcopyBlocktimeContext {
     /* time when page fault initiated per vCPU */
     uint32_t *page_fault_vcpu_time;
@@ -100,6 +103,8 @@ typedef struct PostcopyBlocktimeContext {
     uint32_t total_blocktime;
     /* blocktime per vCPU */
     uint32_t *vcpu_blocktime;
+    /* number of vCPU faults per latency bucket */
+    uint64_t latency_histogram[POSTCOPY_LATENCY_BUCKETS];
     /* point in time when last page fault was initiated */
     uint32_t last_begin;
     /* number of vCPU are suspended */
@@ -159,6 +164,21 @@ static uint32List *get_vcpu_blocktime_list(PostcopyBlocktimeContext *ctx)
     return list;
 }
 
+static uint64List *get_latency_histogram_list(PostcopyBlocktimeContext *ctx)
+{
+    uint64List *list = NULL, *entry = NULL;
+    int i;
+
+    for (i = POSTCOPY_LATENCY_BUCKETS - 1; i >= 0; i--) {
+        entry = g_new0(uint64List, 1);
+        entry->value = ctx->latency_histogram[i];
+        entry->next = list;
+        list = entry;
+    }
+
+    return list;
+}
+
 /*
  * This function just populates MigrationInfo from postcopy's
  * blocktime context. It will not populate MigrationInfo,
@@ -179,6 +199,8 @@ void fill_destination_postcopy_migration_info(MigrationInfo *info)
     info->postcopy_blocktime = bc->total_blocktime;
     info->has_postcopy_vcpu_blocktime = true;
     info->postcopy_vcpu_blocktime = get_vcpu_blocktime_list(bc);
+    info->has_postcopy_latency_histogram = true;
+    info->postcopy_latency_histogram = get_latency_histogram_list(bc);
 }
 
 static uint32_t get_postcopy_total_blocktime(void)
@@ -684,6 +706,34 @@ int postcopy_wake_shared(struct PostCopyFD *pcfd,
     return ret;
 }
 
+/*
+ * Ask the source for the host page at @start in @rb, followed by up to
+ * postcopy-prefetch-pages host pages that have not been received yet.
+ * Guests often touch memory sequentially, so this saves a round trip
+ * for each of the pages that would otherwise fault next.
+ */
+static int postcopy_request_page(MigrationIncomingState *mis, RAMBlock *rb,
+                                 ram_addr_t start)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+    uint32_t prefetch = migrate_postcopy_prefetch_pages();
+    ram_addr_t end = start + pagesize;
+
+    while (prefetch-- && end + pagesize <= qemu_ram_get_used_length(rb) &&
+           !ramblock_recv_bitmap_test_byte_offset(rb, end)) {
+        end += pagesize;
+    }
+
+    trace_postcopy_request_page(qemu_ram_get_idstr(rb), start, end - start);
+    if (rb != mis->last_rb) {
+        mis->last_rb = rb;
+        return migrate_send_rp_req_pages(mis, qemu_ram_get_idstr(rb),
+                                         start, end - start);
+    }
+    /* Save some space */
+    return migrate_send_rp_req_pages(mis, NULL, start, end - start);
+}
+
 /*
  * Callback from shared fault handlers to ask for a page,
  * the page must be specified by a RAMBlock and an offset in that rb
@@ -703,14 +753,7 @@ int postcopy_request_shared_page(struct PostCopyFD *pcfd, RAMBlock *rb,
                                         qemu_ram_get_idstr(rb), rb_offset);
         return postcopy_wake_shared(pcfd, client_addr, rb);
     }
-    if (rb != mis->last_rb) {
-        mis->last_rb = rb;
-        migrate_send_rp_req_pages(mis, qemu_ram_get_idstr(rb),
-                                  aligned_rbo, pagesize);
-    } else {
-        /* Save some space */
-        migrate_send_rp_req_pages(mis, NULL, aligned_rbo, pagesize);
-    }
+    postcopy_request_page(mis, rb, aligned_rbo);
     return 0;
 }
 
@@ -847,6 +890,8 @@ static void mark_postcopy_blocktime_end(uintptr_t addr)
         }
         /* continue cycle, due to one page could affect several vCPUs */
         dc->vcpu_blocktime[i] += vcpu_blocktime;
+        dc->latency_histogram[MIN(64 - clz64(vcpu_blocktime),
+                                  POSTCOPY_LATENCY_BUCKETS - 1)]++;
     }
 
     atomic_sub(&dc->smp_cpus_down, affected_cpu);
@@ -1003,19 +1048,7 @@ retry:
              * Send the request to the source - we want to request one
              * of our host page sizes (which is >= TPS)
              */
-            if (rb != mis->last_rb) {
-                mis->last_rb = rb;
-                ret = migrate_send_rp_req_pages(mis,
-                                                qemu_ram_get_idstr(rb),
-                                                rb_offset,
-                                                qemu_ram_pagesize(rb));
-            } else {
-                /* Save some space */
-                ret = migrate_send_rp_req_pages(mis,
-                                                NULL,
-                                                rb_offset,
-                                                qemu_ram_pagesize(rb));
-            }
+            ret = postcopy_request_page(mis, rb, rb_offset);
 
             if (ret) {
                 /* May be network failure, try to wait for recovery */
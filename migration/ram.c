@@ -57,6 +57,7 @@
 #include "qemu/uuid.h"
 #include "savevm.h"
 #include "qemu/iov.h"
+#include "io/channel-socket.h"
 
 /***********************************************************/
 /* ram save/restore */
@@ -351,6 +352,11 @@ struct RAMState {
     /* Queue of outstanding page requests from the destination */
     QemuMutex src_page_req_mutex;
     QSIMPLEQ_HEAD(, RAMSrcPageRequest) src_page_requests;
+    /*
+     * Pages requested beyond the faulting host page, served once
+     * src_page_requests is empty.  Protected by src_page_req_mutex.
+     */
+    QSIMPLEQ_HEAD(, RAMSrcPageRequest) src_prefetch_requests;
 };
 typedef struct RAMState RAMState;
 
@@ -605,7 +611,10 @@ typedef struct {
     /* size of the next packet that contains pages */
     uint32_t next_packet_size;
     uint64_t packet_num;
-    uint64_t unused[4];    /* Reserved for future use */
+    /* number of zero pages, listed in offset[] after the normal ones */
+    uint32_t zero_pages;
+    uint32_t unused32;     /* Reserved for future use */
+    uint64_t unused[3];    /* Reserved for future use */
     char ramblock[256];
     uint64_t offset[];
 } __attribute__((packed)) MultiFDPacket_t;
@@ -656,11 +665,15 @@ typedef struct {
     uint32_t next_packet_size;
     /* global number of generated multifd packets */
     uint64_t packet_num;
+    /* zero pages found that the main thread has not accounted yet */
+    uint64_t zero_pages;
     /* thread local variables */
     /* packets sent through this channel */
     uint64_t num_packets;
     /* pages sent through this channel */
     uint64_t num_pages;
+    /* offsets of the zero pages in the current packet */
+    ram_addr_t *zero;
     /* syncs main thread and channels */
     QemuSemaphore sem_sync;
 }  MultiFDSendParams;
@@ -698,6 +711,10 @@ typedef struct {
     uint64_t num_packets;
     /* pages sent through this channel */
     uint64_t num_pages;
+    /* number of zero pages in the current packet */
+    uint32_t zero_used;
+    /* pointer to each zero page in the current packet */
+    void **zero;
     /* syncs main thread and channels */
     QemuSemaphore sem_sync;
 } MultiFDRecvParams;
@@ -801,6 +818,7 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
     packet->pages_used = cpu_to_be32(p->pages->used);
     packet->next_packet_size = cpu_to_be32(p->next_packet_size);
     packet->packet_num = cpu_to_be64(p->packet_num);
+    packet->zero_pages = 0;
 
     if (p->pages->block) {
         strncpy(packet->ramblock, p->pages->block->idstr, 256);
@@ -816,6 +834,7 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
     MultiFDPacket_t *packet = p->packet;
     uint32_t pages_max = MULTIFD_PACKET_SIZE / qemu_target_page_size();
     RAMBlock *block;
+    uint32_t zero_used;
     int i;
 
     packet->magic = be32_to_cpu(packet->magic);
@@ -854,20 +873,25 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
     if (packet->pages_alloc > p->pages->allocated) {
         multifd_pages_clear(p->pages);
         p->pages = multifd_pages_init(packet->pages_alloc);
+        p->zero = g_renew(void *, p->zero, packet->pages_alloc);
     }
 
     p->pages->used = be32_to_cpu(packet->pages_used);
-    if (p->pages->used > packet->pages_alloc) {
+    zero_used = be32_to_cpu(packet->zero_pages);
+    if (p->pages->used > packet->pages_alloc ||
+        zero_used > packet->pages_alloc - p->pages->used) {
         error_setg(errp, "multifd: received packet "
-                   "with %d pages and expected maximum pages are %d",
-                   p->pages->used, packet->pages_alloc) ;
+                   "with %d pages and %d zero pages and expected maximum "
+                   "pages are %d", p->pages->used, zero_used,
+                   packet->pages_alloc);
         return -1;
     }
+    p->zero_used = zero_used;
 
     p->next_packet_size = be32_to_cpu(packet->next_packet_size);
     p->packet_num = be64_to_cpu(packet->packet_num);
 
-    if (p->pages->used) {
+    if (p->pages->used || p->zero_used) {
         /* make sure that ramblock is 0 terminated */
         packet->ramblock[255] = 0;
         block = qemu_ram_block_by_name(packet->ramblock);
@@ -891,6 +915,18 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         p->pages->iov[i].iov_len = TARGET_PAGE_SIZE;
     }
 
+    for (i = 0; i < p->zero_used; i++) {
+        ram_addr_t offset = be64_to_cpu(packet->offset[p->pages->used + i]);
+
+        if (offset > (block->used_length - TARGET_PAGE_SIZE)) {
+            error_setg(errp, "multifd: offset too long " RAM_ADDR_FMT
+                       " (max " RAM_ADDR_FMT ")",
+                       offset, block->max_length);
+            return -1;
+        }
+        p->zero[i] = block->host + offset;
+    }
+
     return 0;
 }
 
@@ -1044,6 +1080,8 @@ void multifd_save_cleanup(void)
         p->name = NULL;
         multifd_pages_clear(p->pages);
         p->pages = NULL;
+        g_free(p->zero);
+        p->zero = NULL;
         p->packet_len = 0;
         g_free(p->packet);
         p->packet = NULL;
@@ -1057,6 +1095,53 @@ void multifd_save_cleanup(void)
     multifd_send_state = NULL;
 }
 
+/*
+ * Pages are accounted as normal pages when they are queued.  Fix up the
+ * counters for the ones that the channel threads found to be zero and did
+ * not send.  This assumes that p->mutex is held.
+ */
+static void multifd_account_zero_pages(RAMState *rs, MultiFDSendParams *p)
+{
+    uint64_t unsent = p->zero_pages * TARGET_PAGE_SIZE;
+
+    ram_counters.normal -= p->zero_pages;
+    ram_counters.duplicate += p->zero_pages;
+    qemu_file_update_transfer(rs->f, -unsent);
+    ram_counters.multifd_bytes -= unsent;
+    ram_counters.transferred -= unsent;
+    p->zero_pages = 0;
+}
+
+/*
+ * Find the zero pages among the first @used pages of @p.  They are moved
+ * to the end of the packet's offset list, so that the receiver can clear
+ * them instead of reading them from the channel.  Returns the number of
+ * zero pages.
+ */
+static uint32_t multifd_send_zero_pages(MultiFDSendParams *p, uint32_t used)
+{
+    MultiFDPacket_t *packet = p->packet;
+    MultiFDPages_t *pages = p->pages;
+    uint32_t normal = 0, zero = 0, i;
+
+    for (i = 0; i < used; i++) {
+        if (buffer_is_zero(pages->iov[i].iov_base, pages->iov[i].iov_len)) {
+            p->zero[zero++] = pages->offset[i];
+        } else {
+            pages->iov[normal] = pages->iov[i];
+            packet->offset[normal++] = cpu_to_be64(pages->offset[i]);
+        }
+    }
+    for (i = 0; i < zero; i++) {
+        packet->offset[normal + i] = cpu_to_be64(p->zero[i]);
+    }
+
+    packet->pages_used = cpu_to_be32(normal);
+    packet->zero_pages = cpu_to_be32(zero);
+    packet->next_packet_size = cpu_to_be32(normal * qemu_target_page_size());
+    return zero;
+}
+
 static void multifd_send_sync_main(RAMState *rs)
 {
     int i;
@@ -1098,6 +1183,13 @@ static void multifd_send_sync_main(RAMState *rs)
         trace_multifd_send_sync_main_wait(p->id);
         qemu_sem_wait(&p->sem_sync);
     }
+    for (i = 0; i < migrate_multifd_channels(); i++) {
+        MultiFDSendParams *p = &multifd_send_state->params[i];
+
+        qemu_mutex_lock(&p->mutex);
+        multifd_account_zero_pages(rs, p);
+        qemu_mutex_unlock(&p->mutex);
+    }
     trace_multifd_send_sync_main(multifd_send_state->packet_num);
 }
 
@@ -1124,6 +1216,7 @@ static void *multifd_send_thread(void *opaque)
         if (p->pending_job) {
             uint32_t used = p->pages->used;
             uint64_t packet_num = p->packet_num;
+            uint32_t zero = 0;
             flags = p->flags;
 
             p->next_packet_size = used * qemu_target_page_size();
@@ -1134,8 +1227,17 @@ static void *multifd_send_thread(void *opaque)
             p->pages->used = 0;
             qemu_mutex_unlock(&p->mutex);
 
+            /*
+             * The main thread does not touch the pages or the packet
+             * until pending_job goes down, so scan them without the lock.
+             */
+            if (used && migrate_use_multifd_zero_page()) {
+                zero = multifd_send_zero_pages(p, used);
+                used -= zero;
+            }
+
             trace_multifd_send(p->id, packet_num, used, flags,
-                               p->next_packet_size);
+                               used * qemu_target_page_size());
 
             ret = qio_channel_write_all(p->c, (void *)p->packet,
                                         p->packet_len, &local_err);
@@ -1143,7 +1245,15 @@ static void *multifd_send_thread(void *opaque)
                 break;
             }
 
-            if (used) {
+            if (used && migrate_use_zero_copy_send()) {
+                /* Guest RAM stays mapped, so the pages need no copy */
+                ret = qio_channel_socket_writev_zero_copy_all(
+                    QIO_CHANNEL_SOCKET(p->c), p->pages->iov, used,
+                    &local_err);
+                if (ret != 0) {
+                    break;
+                }
+            } else if (used) {
                 ret = qio_channel_writev_all(p->c, p->pages->iov,
                                              used, &local_err);
                 if (ret != 0) {
@@ -1152,10 +1262,19 @@ static void *multifd_send_thread(void *opaque)
             }
 
             qemu_mutex_lock(&p->mutex);
+            p->zero_pages += zero;
             p->pending_job--;
             qemu_mutex_unlock(&p->mutex);
 
             if (flags & MULTIFD_FLAG_SYNC) {
+                /* Everything sent so far must be out before a sync point */
+                if (migrate_use_zero_copy_send()) {
+                    ret = qio_channel_socket_flush(QIO_CHANNEL_SOCKET(p->c),
+                                                   &local_err);
+                    if (ret != 0) {
+                        break;
+                    }
+                }
                 qemu_sem_post(&p->sem_sync);
             }
             qemu_sem_post(&multifd_send_state->channels_ready);
@@ -1207,6 +1326,14 @@ static void multifd_new_send_channel_async(QIOTask *task, gpointer opaque)
         multifd_save_cleanup();
     } else {
         p->c = QIO_CHANNEL(sioc);
+        if (migrate_use_zero_copy_send() &&
+            qio_channel_socket_set_zero_copy(QIO_CHANNEL_SOCKET(sioc),
+                                             &local_err) < 0) {
+            migrate_set_error(migrate_get_current(), local_err);
+            error_free(local_err);
+            multifd_save_cleanup();
+            return;
+        }
         qio_channel_set_delay(p->c, false);
         p->running = true;
         qemu_thread_create(&p->thread, p->name, multifd_send_thread, p,
@@ -1239,6 +1366,7 @@ int multifd_save_setup(void)
         p->pending_job = 0;
         p->id = i;
         p->pages = multifd_pages_init(page_count);
+        p->zero = g_new0(ram_addr_t, page_count);
         p->packet_len = sizeof(MultiFDPacket_t)
                       + sizeof(ram_addr_t) * page_count;
         p->packet = g_malloc0(p->packet_len);
@@ -1317,6 +1445,8 @@ int multifd_load_cleanup(Error **errp)
         p->name = NULL;
         multifd_pages_clear(p->pages);
         p->pages = NULL;
+        g_free(p->zero);
+        p->zero = NULL;
         p->packet_len = 0;
         g_free(p->packet);
         p->packet = NULL;
@@ -1367,8 +1497,9 @@ static void *multifd_recv_thread(void *opaque)
     rcu_register_thread();
 
     while (true) {
-        uint32_t used;
+        uint32_t used, zero_used;
         uint32_t flags;
+        int i;
 
         if (p->quit) {
             break;
@@ -1391,11 +1522,12 @@ static void *multifd_recv_thread(void *opaque)
         }
 
         used = p->pages->used;
+        zero_used = p->zero_used;
         flags = p->flags;
         trace_multifd_recv(p->id, p->packet_num, used, flags,
                            p->next_packet_size);
         p->num_packets++;
-        p->num_pages += used;
+        p->num_pages += used + zero_used;
         qemu_mutex_unlock(&p->mutex);
 
         if (used) {
@@ -1406,6 +1538,10 @@ static void *multifd_recv_thread(void *opaque)
             }
         }
 
+        for (i = 0; i < zero_used; i++) {
+            ram_handle_compressed(p->zero[i], 0, TARGET_PAGE_SIZE);
+        }
+
         if (flags & MULTIFD_FLAG_SYNC) {
             qemu_sem_post(&multifd_recv_state->sem_sync);
             qemu_sem_wait(&p->sem_sync);
@@ -1448,6 +1584,7 @@ int multifd_load_setup(void)
         p->quit = false;
         p->id = i;
         p->pages = multifd_pages_init(page_count);
+        p->zero = g_new0(void *, page_count);
         p->packet_len = sizeof(MultiFDPacket_t)
                       + sizeof(ram_addr_t) * page_count;
         p->packet = g_malloc0(p->packet_len);
@@ -1570,6 +1707,87 @@ static void mig_throttle_guest_down(void)
     }
 }
 
+/**
+ * mig_throttle_vcpus_down: throttle down the vCPUs that dirty the most
+ *
+ * @budget: dirty rate in bytes per second that the migration keeps up with
+ *
+ * Each vCPU gets an equal share of @budget.  Only the vCPUs that dirty
+ * memory faster than their share are throttled, starting at
+ * cpu_throttle_initial and going up by cpu_throttle_increment, so that
+ * the vCPUs that seldom write keep running at full speed.
+ *
+ * Returns: false if no vCPU is over its share, e.g. because devices dirty
+ * the memory or because the accelerator does not attribute the dirty
+ * pages to vCPUs.  The caller then throttles all vCPUs alike.
+ */
+static bool mig_throttle_vcpus_down(uint64_t budget)
+{
+    MigrationState *s = migrate_get_current();
+    uint64_t pct_initial = s->parameters.cpu_throttle_initial;
+    uint64_t pct_increment = s->parameters.cpu_throttle_increment;
+    int pct_max = s->parameters.max_cpu_throttle;
+    bool throttled = false;
+    uint64_t share;
+    CPUState *cpu;
+    int nr_vcpus = 0;
+
+    CPU_FOREACH(cpu) {
+        nr_vcpus++;
+    }
+    share = budget / MAX(nr_vcpus, 1);
+
+    CPU_FOREACH(cpu) {
+        int pct = cpu_throttle_get_vcpu_percentage(cpu);
+
+        if (cpu->dirty_rate <= share) {
+            continue;
+        }
+        pct = pct ? MIN(pct + pct_increment, pct_max) : pct_initial;
+        trace_migration_throttle_vcpu(cpu->cpu_index, cpu->dirty_rate, pct);
+        cpu_throttle_set_vcpu(cpu, pct);
+        throttled = true;
+    }
+    return throttled;
+}
+
+/*
+ * Compute the dirty rate of each vCPU over the last @period_ms, from the
+ * pages that TCG counted in the notdirty write path.  Without TCG the
+ * rates stay at 0.
+ */
+static void migration_update_vcpu_dirty_rates(int64_t period_ms)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        uint32_t pages = atomic_read(&cpu->dirty_pages);
+
+        cpu->dirty_rate = (uint64_t)(pages - cpu->dirty_pages_prev) *
+                          TARGET_PAGE_SIZE * 1000 / period_ms;
+        cpu->dirty_pages_prev = pages;
+    }
+}
+
+void ram_fill_vcpu_dirty_info(MigrationInfo *info)
+{
+    uint64List **rate = &info->vcpu_dirty_rate;
+    intList **pct = &info->vcpu_throttle_percentage;
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        *rate = g_new0(uint64List, 1);
+        (*rate)->value = cpu->dirty_rate;
+        rate = &(*rate)->next;
+
+        *pct = g_new0(intList, 1);
+        (*pct)->value = cpu_throttle_get_vcpu_percentage(cpu);
+        pct = &(*pct)->next;
+    }
+    info->has_vcpu_dirty_rate = true;
+    info->has_vcpu_throttle_percentage = true;
+}
+
 /**
  * xbzrle_cache_zero_page: insert a zero page in the XBZRLE cache
  *
@@ -1758,12 +1976,102 @@ static inline bool migration_bitmap_clear_dirty(RAMState *rs,
     return ret;
 }
 
+/* Maximum number of threads that sync the dirty bitmap of one RAMBlock */
+#define RAMBLOCK_SYNC_MAX_THREADS 8
+
+typedef struct {
+    QemuThread thread;
+    RAMBlock *rb;
+    ram_addr_t start;
+    ram_addr_t length;
+    uint64_t num_dirty;
+    uint64_t real_dirty;
+} RAMBlockSyncShard;
+
+static void ramblock_sync_shard(RAMBlockSyncShard *shard)
+{
+    shard->num_dirty =
+        cpu_physical_memory_sync_dirty_bitmap(shard->rb, shard->start,
+                                              shard->length,
+                                              &shard->real_dirty);
+}
+
+static void *ramblock_sync_shard_thread(void *opaque)
+{
+    /*
+     * The caller stays in its RCU critical section until this thread is
+     * joined, so the dirty memory blocks cannot go away under us.
+     */
+    ramblock_sync_shard(opaque);
+    return NULL;
+}
+
+/*
+ * Return how many shards to split the bitmap sync of @rb into.  Shards
+ * are made of whole clear_bmap chunks, so that each takes the word-wise
+ * path of cpu_physical_memory_sync_dirty_bitmap() and they never share a
+ * word of the bitmaps.
+ */
+static int ramblock_sync_nr_shards(RAMBlock *rb, ram_addr_t *shard_len)
+{
+    ram_addr_t chunk = (ram_addr_t)1 << (rb->clear_bmap_shift +
+                                         TARGET_PAGE_BITS);
+    ram_addr_t word = (ram_addr_t)BITS_PER_LONG << TARGET_PAGE_BITS;
+    int nr_shards;
+
+    if (!rb->clear_bmap || (rb->offset & (word - 1)) ||
+        (rb->used_length & (word - 1))) {
+        return 1;
+    }
+
+    nr_shards = MIN(MIN(rb->used_length / chunk, RAMBLOCK_SYNC_MAX_THREADS),
+                    g_get_num_processors());
+    if (nr_shards < 2) {
+        return 1;
+    }
+
+    *shard_len = ROUND_UP(DIV_ROUND_UP(rb->used_length, nr_shards), chunk);
+    return DIV_ROUND_UP(rb->used_length, *shard_len);
+}
+
 /* Called with RCU critical section */
 static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
 {
-    rs->migration_dirty_pages +=
-        cpu_physical_memory_sync_dirty_bitmap(rb, 0, rb->used_length,
-                                              &rs->num_dirty_pages_period);
+    RAMBlockSyncShard *shards;
+    ram_addr_t shard_len = rb->used_length;
+    int nr_shards = ramblock_sync_nr_shards(rb, &shard_len);
+    int i;
+
+    if (nr_shards == 1) {
+        rs->migration_dirty_pages +=
+            cpu_physical_memory_sync_dirty_bitmap(rb, 0, rb->used_length,
+                                                  &rs->num_dirty_pages_period);
+        return;
+    }
+
+    /* Large blocks take a long time to sync, so split them across threads */
+    shards = g_new0(RAMBlockSyncShard, nr_shards);
+    for (i = 0; i < nr_shards; i++) {
+        shards[i].rb = rb;
+        shards[i].start = i * shard_len;
+        shards[i].length = MIN(shard_len, rb->used_length - shards[i].start);
+        if (i > 0) {
+            qemu_thread_create(&shards[i].thread, "dirty-sync",
+                               ramblock_sync_shard_thread, &shards[i],
+                               QEMU_THREAD_JOINABLE);
+        }
+    }
+    ramblock_sync_shard(&shards[0]);
+
+    for (i = 0; i < nr_shards; i++) {
+        if (i > 0) {
+            qemu_thread_join(&shards[i].thread);
+        }
+        rs->migration_dirty_pages += shards[i].num_dirty;
+        rs->num_dirty_pages_period += shards[i].real_dirty;
+    }
+    trace_ramblock_sync_dirty_bitmap_sharded(rb->idstr, nr_shards);
+    g_free(shards);
 }
 
 /**
@@ -1864,7 +2172,10 @@ static void migration_bitmap_sync(RAMState *rs)
 
     /* more than 1 second = 1000 millisecons */
     if (end_time > rs->time_last_bitmap_sync + 1000) {
+        int64_t period_ms = end_time - rs->time_last_bitmap_sync;
+
         bytes_xfer_now = ram_counters.transferred;
+        migration_update_vcpu_dirty_rates(period_ms);
 
         /* During block migration the auto-converge logic incorrectly detects
          * that ram migration makes no progress. Avoid this by disabling the
@@ -1881,7 +2192,12 @@ static void migration_bitmap_sync(RAMState *rs)
                 (++rs->dirty_rate_high_cnt >= 2)) {
                     trace_migration_throttle();
                     rs->dirty_rate_high_cnt = 0;
-                    mig_throttle_guest_down();
+                    if (!migrate_vcpu_throttle() ||
+                        !mig_throttle_vcpus_down((bytes_xfer_now -
+                                                  rs->bytes_xfer_prev) / 2 *
+                                                 1000 / period_ms)) {
+                        mig_throttle_guest_down();
+                    }
             }
         }
 
@@ -2290,16 +2606,23 @@ static bool find_dirty_block(RAMState *rs, PageSearchStatus *pss, bool *again)
  */
 static RAMBlock *unqueue_page(RAMState *rs, ram_addr_t *offset)
 {
+    struct RAMSrcPageRequest *entry;
     RAMBlock *block = NULL;
+    bool prefetch;
 
-    if (QSIMPLEQ_EMPTY_ATOMIC(&rs->src_page_requests)) {
+    if (QSIMPLEQ_EMPTY_ATOMIC(&rs->src_page_requests) &&
+        QSIMPLEQ_EMPTY_ATOMIC(&rs->src_prefetch_requests)) {
         return NULL;
     }
 
     qemu_mutex_lock(&rs->src_page_req_mutex);
-    if (!QSIMPLEQ_EMPTY(&rs->src_page_requests)) {
-        struct RAMSrcPageRequest *entry =
-                                QSIMPLEQ_FIRST(&rs->src_page_requests);
+    /* Pages a vCPU is blocked on go before the prefetched ones */
+    entry = QSIMPLEQ_FIRST(&rs->src_page_requests);
+    prefetch = !entry;
+    if (prefetch) {
+        entry = QSIMPLEQ_FIRST(&rs->src_prefetch_requests);
+    }
+    if (entry) {
         block = entry->rb;
         *offset = entry->offset;
 
@@ -2308,9 +2631,13 @@ static RAMBlock *unqueue_page(RAMState *rs, ram_addr_t *offset)
             entry->offset += TARGET_PAGE_SIZE;
         } else {
             memory_region_unref(block->mr);
-            QSIMPLEQ_REMOVE_HEAD(&rs->src_page_requests, next_req);
+            if (prefetch) {
+                QSIMPLEQ_REMOVE_HEAD(&rs->src_prefetch_requests, next_req);
+            } else {
+                QSIMPLEQ_REMOVE_HEAD(&rs->src_page_requests, next_req);
+                migration_consume_urgent_request();
+            }
             g_free(entry);
-            migration_consume_urgent_request();
         }
     }
     qemu_mutex_unlock(&rs->src_page_req_mutex);
@@ -2404,13 +2731,21 @@ static void migration_page_queue_free(RAMState *rs)
         QSIMPLEQ_REMOVE_HEAD(&rs->src_page_requests, next_req);
         g_free(mspr);
     }
+    QSIMPLEQ_FOREACH_SAFE(mspr, &rs->src_prefetch_requests, next_req,
+                          next_mspr) {
+        memory_region_unref(mspr->rb->mr);
+        QSIMPLEQ_REMOVE_HEAD(&rs->src_prefetch_requests, next_req);
+        g_free(mspr);
+    }
     rcu_read_unlock();
 }
 
 /**
  * ram_save_queue_pages: queue the page for transmission
  *
- * A request from postcopy destination for example.
+ * A request from postcopy destination for example.  Only its first host
+ * page is sent urgently; the rest of the range is a prefetch and is
+ * queued behind the pages that other faults are waiting for.
  *
  * Returns zero on success or negative on error
  *
@@ -2421,8 +2756,10 @@ static void migration_page_queue_free(RAMState *rs)
  */
 int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len)
 {
+    struct RAMSrcPageRequest *new_entry;
     RAMBlock *ramblock;
     RAMState *rs = ram_state;
+    ram_addr_t urgent_len;
 
     ram_counters.postcopy_requests++;
     rcu_read_lock();
@@ -2456,16 +2793,25 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len)
         goto err;
     }
 
-    struct RAMSrcPageRequest *new_entry =
-        g_malloc0(sizeof(struct RAMSrcPageRequest));
+    urgent_len = MIN(len, qemu_ram_pagesize(ramblock));
+    new_entry = g_new0(struct RAMSrcPageRequest, 1);
     new_entry->rb = ramblock;
     new_entry->offset = start;
-    new_entry->len = len;
+    new_entry->len = urgent_len;
 
     memory_region_ref(ramblock->mr);
     qemu_mutex_lock(&rs->src_page_req_mutex);
     QSIMPLEQ_INSERT_TAIL(&rs->src_page_requests, new_entry, next_req);
     migration_make_urgent_request();
+    if (len > urgent_len) {
+        new_entry = g_new0(struct RAMSrcPageRequest, 1);
+        new_entry->rb = ramblock;
+        new_entry->offset = start + urgent_len;
+        new_entry->len = len - urgent_len;
+
+        memory_region_ref(ramblock->mr);
+        QSIMPLEQ_INSERT_TAIL(&rs->src_prefetch_requests, new_entry, next_req);
+    }
     qemu_mutex_unlock(&rs->src_page_req_mutex);
     rcu_read_unlock();
 
@@ -2552,6 +2898,12 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
         return 1;
     }
 
+    /* The multifd channels look for zero pages themselves */
+    if (migrate_use_multifd_zero_page() && migrate_use_multifd() &&
+        !save_page_use_compression(rs) && !migration_in_postcopy()) {
+        return ram_save_multifd_page(rs, block, offset);
+    }
+
     res = save_zero_page(rs, block, offset);
     if (res > 0) {
         /* Must let xbzrle know, otherwise a previous (now 0'd) cached
@@ -3236,6 +3588,7 @@ static int ram_state_init(RAMState **rsp)
     qemu_mutex_init(&(*rsp)->bitmap_mutex);
     qemu_mutex_init(&(*rsp)->src_page_req_mutex);
     QSIMPLEQ_INIT(&(*rsp)->src_page_requests);
+    QSIMPLEQ_INIT(&(*rsp)->src_prefetch_requests);
 
     /*
      * Count the total number of pages used by ram blocks not including any
@@ -3955,6 +4308,160 @@ static void decompress_data_with_multi_threads(QEMUFile *f,
     qemu_mutex_unlock(&decomp_done_lock);
 }
 
+/*
+ * The secondary flushes the pages that the PVM sent or that the SVM
+ * dirtied from the RAM cache into the SVM's memory at each checkpoint.
+ * The flush threads share the work COLO_FLUSH_CHUNK pages at a time, and
+ * run while the colo thread receives the device state of the checkpoint;
+ * colo_flush_ram_cache_wait() waits for them before it is loaded.
+ */
+#define COLO_FLUSH_MAX_THREADS 8
+/* A multiple of BITS_PER_LONG, so that the threads clear distinct words */
+#define COLO_FLUSH_CHUNK (BITS_PER_LONG * 64)
+
+static struct {
+    QemuThread *threads;
+    int nr_threads;
+    QemuMutex lock;
+    QemuCond work_cond;
+    QemuCond done_cond;
+    bool quit;
+    /* Bumped when a flush starts */
+    unsigned int gen;
+    /* Threads that did not finish the current flush */
+    int busy;
+    /* Set by colo_flush_ram_cache, cleared by colo_flush_ram_cache_wait */
+    bool pending;
+    /* Next chunk to flush */
+    RAMBlock *block;
+    unsigned long page;
+    uint64_t flushed;
+} colo_flush;
+
+/* Flush the dirty pages of [@start, @end), a run of pages at a time */
+static uint64_t colo_flush_range(RAMBlock *block, unsigned long start,
+                                 unsigned long end)
+{
+    unsigned long *bmap = block->bmap;
+    unsigned long first, last;
+    uint64_t pages = 0;
+
+    for (first = find_next_bit(bmap, end, start); first < end;
+         first = find_next_bit(bmap, end, last)) {
+        last = find_next_zero_bit(bmap, end, first);
+        bitmap_clear(bmap, first, last - first);
+        memcpy(block->host + (first << TARGET_PAGE_BITS),
+               block->colo_cache + (first << TARGET_PAGE_BITS),
+               (last - first) << TARGET_PAGE_BITS);
+        pages += last - first;
+    }
+    return pages;
+}
+
+/* Called with colo_flush.lock held */
+static bool colo_flush_next_chunk(RAMBlock **block, unsigned long *start,
+                                  unsigned long *end)
+{
+    RAMBlock *rb;
+
+    for (rb = colo_flush.block; rb; rb = QLIST_NEXT_RCU(rb, next)) {
+        unsigned long pages = rb->used_length >> TARGET_PAGE_BITS;
+
+        if (!ramblock_is_ignored(rb) && colo_flush.page < pages) {
+            *block = rb;
+            *start = colo_flush.page;
+            *end = MIN(*start + COLO_FLUSH_CHUNK, pages);
+            colo_flush.block = rb;
+            colo_flush.page = *end;
+            return true;
+        }
+        colo_flush.page = 0;
+    }
+    colo_flush.block = NULL;
+    return false;
+}
+
+/*
+ * The RAMBlocks stay around while the threads walk them, because the colo
+ * thread keeps its RCU read lock from the start of the flush to the end of
+ * colo_flush_ram_cache_wait().
+ */
+static void *colo_flush_thread(void *opaque)
+{
+    unsigned int gen = 0;
+
+    qemu_mutex_lock(&colo_flush.lock);
+    for (;;) {
+        RAMBlock *block;
+        unsigned long start, end;
+        uint64_t pages = 0;
+
+        while (!colo_flush.quit && colo_flush.gen == gen) {
+            qemu_cond_wait(&colo_flush.work_cond, &colo_flush.lock);
+        }
+        if (colo_flush.quit) {
+            break;
+        }
+        gen = colo_flush.gen;
+
+        while (colo_flush_next_chunk(&block, &start, &end)) {
+            qemu_mutex_unlock(&colo_flush.lock);
+            pages += colo_flush_range(block, start, end);
+            qemu_mutex_lock(&colo_flush.lock);
+        }
+        colo_flush.flushed += pages;
+        if (!--colo_flush.busy) {
+            qemu_cond_signal(&colo_flush.done_cond);
+        }
+    }
+    qemu_mutex_unlock(&colo_flush.lock);
+    return NULL;
+}
+
+static void colo_flush_threads_setup(void)
+{
+    int host_cpus = g_get_num_processors();
+    int i;
+
+    if (colo_flush.threads) {
+        return;
+    }
+    colo_flush.nr_threads = MAX(1, MIN(host_cpus, COLO_FLUSH_MAX_THREADS));
+    colo_flush.threads = g_new0(QemuThread, colo_flush.nr_threads);
+    colo_flush.quit = false;
+    qemu_mutex_init(&colo_flush.lock);
+    qemu_cond_init(&colo_flush.work_cond);
+    qemu_cond_init(&colo_flush.done_cond);
+    for (i = 0; i < colo_flush.nr_threads; i++) {
+        qemu_thread_create(colo_flush.threads + i, "colo-flush",
+                           colo_flush_thread, NULL, QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void colo_flush_threads_cleanup(void)
+{
+    int i;
+
+    if (!colo_flush.threads) {
+        return;
+    }
+    colo_flush_ram_cache_wait();
+
+    qemu_mutex_lock(&colo_flush.lock);
+    colo_flush.quit = true;
+    qemu_cond_broadcast(&colo_flush.work_cond);
+    qemu_mutex_unlock(&colo_flush.lock);
+    for (i = 0; i < colo_flush.nr_threads; i++) {
+        qemu_thread_join(colo_flush.threads + i);
+    }
+    qemu_cond_destroy(&colo_flush.done_cond);
+    qemu_cond_destroy(&colo_flush.work_cond);
+    qemu_mutex_destroy(&colo_flush.lock);
+    g_free(colo_flush.threads);
+    colo_flush.threads = NULL;
+    colo_flush.nr_threads = 0;
+}
+
 /*
  * colo cache: this is for secondary VM, we cache the whole
  * memory of the secondary VM, it is need to hold the global lock
@@ -3997,6 +4504,7 @@ int colo_init_ram_cache(void)
     ram_state->migration_dirty_pages = 0;
     qemu_mutex_init(&ram_state->bitmap_mutex);
     memory_global_dirty_log_start();
+    colo_flush_threads_setup();
 
     return 0;
 
@@ -4018,6 +4526,7 @@ void colo_release_ram_cache(void)
 {
     RAMBlock *block;
 
+    colo_flush_threads_cleanup();
     memory_global_dirty_log_stop();
     RAMBLOCK_FOREACH_NOT_IGNORED(block) {
         g_free(block->bmap);
@@ -4262,13 +4771,13 @@ static bool postcopy_is_running(void)
 /*
  * Flush content of RAM cache into SVM's memory.
  * Only flush the pages that be dirtied by PVM or SVM or both.
+ *
+ * The flush threads do the copy; the SVM's memory is only up to date
+ * once colo_flush_ram_cache_wait() returns.
  */
 static void colo_flush_ram_cache(void)
 {
     RAMBlock *block = NULL;
-    void *dst_host;
-    void *src_host;
-    unsigned long offset = 0;
 
     memory_global_dirty_log_sync();
     rcu_read_lock();
@@ -4278,24 +4787,39 @@ static void colo_flush_ram_cache(void)
     rcu_read_unlock();
 
     trace_colo_flush_ram_cache_begin(ram_state->migration_dirty_pages);
-    rcu_read_lock();
-    block = QLIST_FIRST_RCU(&ram_list.blocks);
+    if (!ram_state->migration_dirty_pages) {
+        trace_colo_flush_ram_cache_end();
+        return;
+    }
 
-    while (block) {
-        offset = migration_bitmap_find_dirty(ram_state, block, offset);
+    /* Released by colo_flush_ram_cache_wait() */
+    rcu_read_lock();
+    qemu_mutex_lock(&colo_flush.lock);
+    colo_flush.block = QLIST_FIRST_RCU(&ram_list.blocks);
+    colo_flush.page = 0;
+    colo_flush.flushed = 0;
+    colo_flush.busy = colo_flush.nr_threads;
+    colo_flush.pending = true;
+    colo_flush.gen++;
+    qemu_cond_broadcast(&colo_flush.work_cond);
+    qemu_mutex_unlock(&colo_flush.lock);
+}
 
-        if (offset << TARGET_PAGE_BITS >= block->used_length) {
-            offset = 0;
-            block = QLIST_NEXT_RCU(block, next);
-        } else {
-            migration_bitmap_clear_dirty(ram_state, block, offset);
-            dst_host = block->host + (offset << TARGET_PAGE_BITS);
-            src_host = block->colo_cache + (offset << TARGET_PAGE_BITS);
-            memcpy(dst_host, src_host, TARGET_PAGE_SIZE);
-        }
+void colo_flush_ram_cache_wait(void)
+{
+    if (!colo_flush.pending) {
+        return;
     }
 
+    qemu_mutex_lock(&colo_flush.lock);
+    while (colo_flush.busy) {
+        qemu_cond_wait(&colo_flush.done_cond, &colo_flush.lock);
+    }
+    colo_flush.pending = false;
+    ram_state->migration_dirty_pages -= colo_flush.flushed;
+    qemu_mutex_unlock(&colo_flush.lock);
     rcu_read_unlock();
+
     trace_colo_flush_ram_cache_end();
 }
 
@@ -4488,6 +5012,11 @@ static int ram_load(QEMUFile *f, void *opaque, int version_id)
         return -EINVAL;
     }
 
+    /* The pages must not land in the RAM cache while it is flushed */
+    if (migration_incoming_in_colo_state()) {
+        colo_flush_ram_cache_wait();
+    }
+
     /*
      * This RCU critical section can be very long running.
      * When RCU reclaims in the code start to become numerous,
@@ -40,6 +40,7 @@ extern CompressionStats compression_counters;
 int xbzrle_cache_resize(int64_t new_size, Error **errp);
 uint64_t ram_bytes_remaining(void);
 uint64_t ram_bytes_total(void);
+void ram_fill_vcpu_dirty_info(MigrationInfo *info);
 
 int multifd_save_setup(void);
 void multifd_save_cleanup(void);
@@ -73,5 +74,6 @@ int ram_dirty_bitmap_reload(MigrationState *s, RAMBlock *rb);
 /* ram cache */
 int colo_init_ram_cache(void);
 void colo_release_ram_cache(void);
+void colo_flush_ram_cache_wait(void);
 
 #endif
@@ -269,6 +269,7 @@ static bool should_validate_capability(int capability)
     /* Validate only new capabilities to keep compatibility. */
     switch (capability) {
     case MIGRATION_CAPABILITY_X_IGNORE_SHARED:
+    case MIGRATION_CAPABILITY_X_MULTIFD_ZERO_PAGE:
         return true;
     default:
         return false;
@@ -2188,6 +2189,7 @@ qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis)
     uint32_t instance_id, version_id, section_id;
     SaveStateEntry *se;
     char idstr[256];
+    int64_t start_time = 0;
     int ret;
 
     /* Read section start */
@@ -2234,6 +2236,9 @@ qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis)
         return -EINVAL;
     }
 
+    if (trace_event_get_state_backends(TRACE_QEMU_LOADVM_STATE_SECTION_TIME)) {
+        start_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    }
     ret = vmstate_load(f, se);
     if (ret < 0) {
         error_report("error while loading state for instance 0x%x of"
@@ -2243,6 +2248,10 @@ qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis)
     if (!check_section_footer(f, se)) {
         return -EINVAL;
     }
+    if (trace_event_get_state_backends(TRACE_QEMU_LOADVM_STATE_SECTION_TIME)) {
+        trace_qemu_loadvm_state_section_time(section_id, idstr, instance_id,
+                qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start_time);
+    }
 
     return 0;
 }
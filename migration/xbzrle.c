@@ -12,6 +12,7 @@
  */
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/host-utils.h"
 #include "xbzrle.h"
 
 /*
@@ -24,8 +25,8 @@
 
   length = uleb128 encoded integer
  */
-int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                         uint8_t *dst, int dlen)
+static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
+                                    int slen, uint8_t *dst, int dlen)
 {
     uint32_t zrun_len = 0, nzrun_len = 0;
     int d = 0, i = 0;
@@ -126,6 +127,162 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
     return d;
 }
 
+#if defined(CONFIG_AVX512BW_OPT) || defined(__aarch64__)
+/*
+ * Encoder for the vectorized variants.  @scan returns the offset of the
+ * first byte at or after @i where old_buf and new_buf are equal (@same)
+ * or differ (!@same), or @slen if there is none.  The output is the same
+ * as xbzrle_encode_buffer_int's.
+ */
+static inline int xbzrle_encode_runs(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen,
+                                     int (*scan)(const uint8_t *old_buf,
+                                                 const uint8_t *new_buf,
+                                                 int i, int slen, bool same))
+{
+    int d = 0, i = 0;
+
+    while (i < slen) {
+        int zrun_len, nzrun_len;
+
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        zrun_len = scan(old_buf, new_buf, i, slen, false) - i;
+        i += zrun_len;
+
+        /* buffer unchanged */
+        if (zrun_len == slen) {
+            return 0;
+        }
+
+        /* skip last zero run */
+        if (i == slen) {
+            return d;
+        }
+
+        d += uleb128_encode_small(dst + d, zrun_len);
+
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        nzrun_len = scan(old_buf, new_buf, i, slen, true) - i;
+        d += uleb128_encode_small(dst + d, nzrun_len);
+
+        /* overflow */
+        if (d + nzrun_len > dlen) {
+            return -1;
+        }
+        memcpy(dst + d, new_buf + i, nzrun_len);
+        d += nzrun_len;
+        i += nzrun_len;
+    }
+
+    return d;
+}
+#endif
+
+#ifdef CONFIG_AVX512BW_OPT
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+#include <immintrin.h>
+
+/* Compare 64 bytes at a time; masked loads handle the tail.  */
+static inline int xbzrle_scan_avx512(const uint8_t *old_buf,
+                                     const uint8_t *new_buf,
+                                     int i, int slen, bool same)
+{
+    while (i < slen) {
+        __mmask64 k = slen - i >= 64 ? ~0ULL : (1ULL << (slen - i)) - 1;
+        __m512i a = _mm512_maskz_loadu_epi8(k, old_buf + i);
+        __m512i b = _mm512_maskz_loadu_epi8(k, new_buf + i);
+        __mmask64 m = same ? _mm512_mask_cmpeq_epi8_mask(k, a, b)
+                           : _mm512_mask_cmpneq_epi8_mask(k, a, b);
+
+        if (m) {
+            return i + ctz64(m);
+        }
+        i += 64;
+    }
+    return slen;
+}
+
+static int xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf,
+                                       int slen, uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_runs(old_buf, new_buf, slen, dst, dlen,
+                              xbzrle_scan_avx512);
+}
+#pragma GCC pop_options
+
+#include "qemu/host-cpuinfo.h"
+
+static int (*xbzrle_encode_accel)(uint8_t *, uint8_t *, int, uint8_t *, int) =
+    xbzrle_encode_buffer_int;
+
+static void __attribute__((constructor)) init_xbzrle_accel(void)
+{
+    unsigned info = host_cpuinfo_init();
+
+    if ((info & CPUINFO_AVX512F) && (info & CPUINFO_AVX512BW)) {
+        xbzrle_encode_accel = xbzrle_encode_buffer_avx512;
+    }
+}
+
+#define select_xbzrle_encode xbzrle_encode_accel
+
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+
+/* Compare 16 bytes at a time; Advanced SIMD is always available.  */
+static inline int xbzrle_scan_neon(const uint8_t *old_buf,
+                                   const uint8_t *new_buf,
+                                   int i, int slen, bool same)
+{
+    for (; i + 16 <= slen; i += 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(old_buf + i), vld1q_u8(new_buf + i));
+        /* Narrow to one nibble per byte, all ones where the bytes match */
+        uint64_t m = vget_lane_u64(vreinterpret_u64_u8(
+                         vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+
+        if (!same) {
+            m = ~m;
+        }
+        if (m) {
+            return i + ctz64(m) / 4;
+        }
+    }
+    for (; i < slen; i++) {
+        if ((old_buf[i] == new_buf[i]) == same) {
+            return i;
+        }
+    }
+    return slen;
+}
+
+static int xbzrle_encode_buffer_neon(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_runs(old_buf, new_buf, slen, dst, dlen,
+                              xbzrle_scan_neon);
+}
+
+#define select_xbzrle_encode xbzrle_encode_buffer_neon
+
+#else
+#define select_xbzrle_encode xbzrle_encode_buffer_int
+#endif
+
+int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                         uint8_t *dst, int dlen)
+{
+    return select_xbzrle_encode(old_buf, new_buf, slen, dst, dlen);
+}
+
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen)
 {
     int i = 0, d = 0;
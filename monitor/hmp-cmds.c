@@ -50,6 +50,7 @@
 #include "qemu-io.h"
 #include "qemu/cutils.h"
 #include "qemu/error-report.h"
+#include "exec/memory.h"
 #include "exec/ramlist.h"
 #include "hw/intc/intc.h"
 #include "hw/rdma/rdma.h"
@@ -342,6 +343,18 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
         g_free(str);
         visit_free(v);
     }
+
+    if (info->has_postcopy_latency_histogram) {
+        Visitor *v;
+        char *str;
+        v = string_output_visitor_new(false, &str);
+        visit_type_uint64List(v, NULL, &info->postcopy_latency_histogram,
+                              NULL);
+        visit_complete(v, &str);
+        monitor_printf(mon, "postcopy latency histogram: %s\n", str);
+        g_free(str);
+        visit_free(v);
+    }
     if (info->has_socket_address) {
         SocketAddressList *addr;
 
@@ -454,6 +467,9 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "%s: %" PRIu64 "\n",
             MigrationParameter_str(MIGRATION_PARAMETER_MAX_POSTCOPY_BANDWIDTH),
             params->max_postcopy_bandwidth);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_POSTCOPY_PREFETCH_PAGES),
+            params->postcopy_prefetch_pages);
         monitor_printf(mon, " %s: '%s'\n",
             MigrationParameter_str(MIGRATION_PARAMETER_TLS_AUTHZ),
             params->has_tls_authz ? params->tls_authz : "");
@@ -1176,6 +1192,63 @@ void hmp_sync_profile(Monitor *mon, const QDict *qdict)
     }
 }
 
+void hmp_mmio_stats(Monitor *mon, const QDict *qdict)
+{
+    const char *op = qdict_get_try_str(qdict, "op");
+
+    if (op == NULL) {
+        bool on = atomic_read(&mmio_stats_enabled);
+
+        monitor_printf(mon, "mmio-stats is %s\n", on ? "on" : "off");
+        return;
+    }
+    if (!strcmp(op, "on")) {
+        mmio_stats_set(true);
+    } else if (!strcmp(op, "off")) {
+        mmio_stats_set(false);
+    } else if (!strcmp(op, "reset")) {
+        mmio_stats_reset();
+    } else {
+        Error *err = NULL;
+
+        error_setg(&err, QERR_INVALID_PARAMETER, op);
+        hmp_handle_error(mon, &err);
+    }
+}
+
+void hmp_info_mmio_hotspots(Monitor *mon, const QDict *qdict)
+{
+    int64_t max = qdict_get_try_int(qdict, "max", 20);
+    bool by_time = qdict_get_try_bool(qdict, "time", false);
+    Error *err = NULL;
+    MmioHotspotInfo *info;
+    MmioHotspotList *l;
+    MmioHotspot *h;
+
+    info = qmp_x_query_mmio_hotspots(true, max, true, by_time, false, false,
+                                     &err);
+    if (err) {
+        hmp_handle_error(mon, &err);
+        return;
+    }
+    if (!info->enabled) {
+        monitor_printf(mon, "mmio-stats is off\n");
+    }
+    if (info->hotspots) {
+        monitor_printf(mon, "%-32s %10s %12s %12s %12s %8s\n", "Region",
+                       "Offset", "Reads", "Writes", "Time (us)", "Avg (ns)");
+    }
+    for (l = info->hotspots; l; l = l->next) {
+        h = l->value;
+        monitor_printf(mon, "%-32s %#10" PRIx64 " %12" PRIu64 " %12" PRIu64
+                       " %12" PRIu64 " %8" PRIu64 "\n",
+                       h->region, h->offset, h->reads, h->writes,
+                       h->time_ns / 1000,
+                       h->time_ns / MAX(h->reads + h->writes, 1));
+    }
+    qapi_free_MmioHotspotInfo(info);
+}
+
 void hmp_system_reset(Monitor *mon, const QDict *qdict)
 {
     qmp_system_reset(NULL);
@@ -1840,6 +1913,10 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_max_postcopy_bandwidth = true;
         visit_type_size(v, param, &p->max_postcopy_bandwidth, &err);
         break;
+    case MIGRATION_PARAMETER_POSTCOPY_PREFETCH_PAGES:
+        p->has_postcopy_prefetch_pages = true;
+        visit_type_uint32(v, param, &p->postcopy_prefetch_pages, &err);
+        break;
     case MIGRATION_PARAMETER_ANNOUNCE_INITIAL:
         p->has_announce_initial = true;
         visit_type_size(v, param, &p->announce_initial, &err);
@@ -2584,6 +2661,7 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
     IOThreadInfoList *info_list = qmp_query_iothreads(NULL);
     IOThreadInfoList *info;
     IOThreadInfo *value;
+    uint64List *hist;
 
     for (info = info_list; info; info = info->next) {
         value = info->value;
@@ -2592,6 +2670,14 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "  poll-max-ns=%" PRId64 "\n", value->poll_max_ns);
         monitor_printf(mon, "  poll-grow=%" PRId64 "\n", value->poll_grow);
         monitor_printf(mon, "  poll-shrink=%" PRId64 "\n", value->poll_shrink);
+        monitor_printf(mon, "  poll-hits=%" PRIu64 "\n", value->poll_hits);
+        monitor_printf(mon, "  poll-misses=%" PRIu64 "\n", value->poll_misses);
+        monitor_printf(mon, "  poll-wait-histogram=");
+        for (hist = value->poll_wait_histogram; hist; hist = hist->next) {
+            monitor_printf(mon, "%" PRIu64 "%s", hist->value,
+                           hist->next ? "," : "");
+        }
+        monitor_printf(mon, "\n");
     }
 
     qapi_free_IOThreadInfoList(info_list);
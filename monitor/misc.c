@@ -54,6 +54,7 @@
 #include "qapi/qmp/qdict.h"
 #include "qapi/qmp/qerror.h"
 #include "qapi/qmp/qstring.h"
+#include "qapi/visitor.h"
 #include "qom/object_interfaces.h"
 #include "trace/control.h"
 #include "monitor/hmp-target.h"
@@ -63,8 +64,10 @@
 #endif
 #include "exec/memory.h"
 #include "exec/exec-all.h"
+#include "exec/tb-context.h"
 #include "qemu/option.h"
 #include "qemu/thread.h"
+#include "qemu/rcu.h"
 #include "block/qapi.h"
 #include "qapi/qapi-commands.h"
 #include "qapi/qapi-emit-events.h"
@@ -291,10 +294,13 @@ EventInfoList *qmp_query_events(Error **errp)
  * we do it in test-qobject-input-visitor.c, just to make sure
  * qapi-gen.py's output actually conforms to the schema.
  */
-static void qmp_query_qmp_schema(QDict *qdict, QObject **ret_data,
+static void qmp_query_qmp_schema(QDict *qdict, Visitor *ret_v,
                                  Error **errp)
 {
-    *ret_data = qobject_from_qlit(&qmp_schema_qlit);
+    QObject *schema = qobject_from_qlit(&qmp_schema_qlit);
+
+    visit_type_any(ret_v, "return", &schema, errp);
+    qobject_unref(schema);
 }
 
 static void monitor_init_qmp_commands(void)
@@ -474,8 +480,72 @@ static void hmp_info_opcount(Monitor *mon, const QDict *qdict)
 {
     dump_opcount_info();
 }
+
+static void hmp_info_jit_profile(Monitor *mon, const QDict *qdict)
+{
+    if (!tcg_enabled()) {
+        error_report("JIT information is only available with accel=tcg");
+        return;
+    }
+
+    dump_tb_profile(qdict_get_try_int(qdict, "max", 20));
+}
+
+static void hmp_jit_profile(Monitor *mon, const QDict *qdict)
+{
+    const char *op = qdict_get_try_str(qdict, "op");
+
+    if (!tcg_enabled()) {
+        error_report("JIT profiling is only available with accel=tcg");
+        return;
+    }
+    if (op == NULL) {
+        monitor_printf(mon, "jit-profile is %s\n", tb_profile ? "on" : "off");
+        return;
+    }
+    if (!strcmp(op, "on")) {
+        tb_profile_set(first_cpu, true);
+    } else if (!strcmp(op, "off")) {
+        tb_profile_set(first_cpu, false);
+    } else if (!strcmp(op, "reset")) {
+        tb_profile_reset();
+    } else {
+        Error *err = NULL;
+
+        error_setg(&err, QERR_INVALID_PARAMETER, op);
+        hmp_handle_error(mon, &err);
+    }
+}
 #endif
 
+JitHtableInfo *qmp_x_query_jit_htable(Error **errp)
+{
+#ifdef CONFIG_TCG
+    JitHtableInfo *info;
+    struct qht_stats hst;
+
+    if (tcg_enabled()) {
+        rcu_read_lock();
+        qht_statistics_init(&tb_ctx.htable, &hst);
+        rcu_read_unlock();
+        info = g_new0(JitHtableInfo, 1);
+        info->head_buckets = hst.head_buckets;
+        info->used_head_buckets = hst.used_head_buckets;
+        info->entries = hst.entries;
+        info->pending_buckets = hst.pending_buckets;
+        /* qdist_avg() is NaN for an empty distribution */
+        if (hst.used_head_buckets) {
+            info->avg_chain = qdist_avg(&hst.chain);
+            info->avg_occupancy = qdist_avg(&hst.occupancy);
+        }
+        qht_statistics_destroy(&hst);
+        return info;
+    }
+#endif
+    error_setg(errp, "JIT information is only available with accel=tcg");
+    return NULL;
+}
+
 static void hmp_info_sync_profile(Monitor *mon, const QDict *qdict)
 {
     int64_t max = qdict_get_try_int(qdict, "max", 10);
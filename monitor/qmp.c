@@ -28,6 +28,8 @@
 #include "monitor-internal.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-misc.h"
+#include "qapi/qapi-visit-misc.h"
+#include "qapi/qobject-output-visitor.h"
 #include "qapi/qmp/qdict.h"
 #include "qapi/qmp/qjson.h"
 #include "qapi/qmp/qlist.h"
@@ -82,6 +84,15 @@ static void monitor_qmp_cleanup_queues(MonitorQMP *mon)
     qemu_mutex_unlock(&mon->qmp_queue_lock);
 }
 
+/* Emit @json, which is consumed, as one line of output to @mon */
+static void qmp_send_json(MonitorQMP *mon, QString *json)
+{
+    qstring_append_chr(json, '\n');
+    monitor_puts(&mon->common, qstring_get_str(json));
+
+    qobject_unref(json);
+}
+
 void qmp_send_response(MonitorQMP *mon, const QDict *rsp)
 {
     const QObject *data = QOBJECT(rsp);
@@ -90,10 +101,7 @@ void qmp_send_response(MonitorQMP *mon, const QDict *rsp)
     json = mon->pretty ? qobject_to_json_pretty(data) : qobject_to_json(data);
     assert(json != NULL);
 
-    qstring_append_chr(json, '\n');
-    monitor_puts(&mon->common, qstring_get_str(json));
-
-    qobject_unref(json);
+    qmp_send_json(mon, json);
 }
 
 /*
@@ -111,26 +119,36 @@ static void monitor_qmp_respond(MonitorQMP *mon, QDict *rsp)
 static void monitor_qmp_dispatch(MonitorQMP *mon, QObject *req)
 {
     Monitor *old_mon;
+    QString *json;
     QDict *rsp;
     QDict *error;
 
     old_mon = cur_mon;
     cur_mon = &mon->common;
 
+    if (mon->commands != &qmp_cap_negotiation_commands) {
+        /* Format the reply straight to JSON, without building a QDict */
+        json = qmp_dispatch_json(mon->commands, req, qmp_oob_enabled(mon),
+                                 mon->pretty);
+        cur_mon = old_mon;
+        if (json) {
+            qmp_send_json(mon, json);
+        }
+        return;
+    }
+
     rsp = qmp_dispatch(mon->commands, req, qmp_oob_enabled(mon));
 
     cur_mon = old_mon;
 
-    if (mon->commands == &qmp_cap_negotiation_commands) {
-        error = qdict_get_qdict(rsp, "error");
-        if (error
-            && !g_strcmp0(qdict_get_try_str(error, "class"),
-                    QapiErrorClass_str(ERROR_CLASS_COMMAND_NOT_FOUND))) {
-            /* Provide a more useful error message */
-            qdict_del(error, "desc");
-            qdict_put_str(error, "desc", "Expecting capabilities negotiation"
-                          " with 'qmp_capabilities'");
-        }
+    error = qdict_get_qdict(rsp, "error");
+    if (error
+        && !g_strcmp0(qdict_get_try_str(error, "class"),
+                QapiErrorClass_str(ERROR_CLASS_COMMAND_NOT_FOUND))) {
+        /* Provide a more useful error message */
+        qdict_del(error, "desc");
+        qdict_put_str(error, "desc", "Expecting capabilities negotiation"
+                      " with 'qmp_capabilities'");
     }
 
     monitor_qmp_respond(mon, rsp);
@@ -295,10 +313,16 @@ static void monitor_qmp_read(void *opaque, const uint8_t *buf, int size)
 static QDict *qmp_greeting(MonitorQMP *mon)
 {
     QList *cap_list = qlist_new();
+    VersionInfo *info = qmp_query_version(NULL);
     QObject *ver = NULL;
     QMPCapability cap;
+    Visitor *v;
 
-    qmp_marshal_query_version(NULL, &ver, NULL);
+    v = qobject_output_visitor_new(&ver);
+    visit_type_VersionInfo(v, NULL, &info, &error_abort);
+    visit_complete(v, &ver);
+    visit_free(v);
+    qapi_free_VersionInfo(info);
 
     for (cap = 0; cap < QMP_CAPABILITY__MAX; cap++) {
         if (mon->capab_offered[cap]) {
@@ -208,12 +208,13 @@ Connection *connection_get(GHashTable *connection_track_table,
         if (g_hash_table_size(connection_track_table) > HASHTABLE_MAX_SIZE) {
             trace_colo_proxy_main("colo proxy connection hashtable full,"
                                   " clear it");
-            connection_hashtable_reset(connection_track_table);
             /*
-             * clear the conn_list
+             * The hash table owns the connections and destroys them; the
+             * entries in conn_list only need to be dropped.
              */
-            while (!g_queue_is_empty(conn_list)) {
-                connection_destroy(g_queue_pop_head(conn_list));
+            connection_hashtable_reset(connection_track_table);
+            if (conn_list) {
+                g_queue_clear(conn_list);
             }
         }
 
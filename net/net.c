@@ -596,6 +596,8 @@ void qemu_purge_queued_packets(NetClientState *nc)
 
 void qemu_flush_or_purge_queued_packets(NetClientState *nc, bool purge)
 {
+    bool flushed;
+
     nc->receive_disabled = 0;
 
     if (nc->peer && nc->peer->info->type == NET_CLIENT_DRIVER_HUBPORT) {
@@ -603,7 +605,14 @@ void qemu_flush_or_purge_queued_packets(NetClientState *nc, bool purge)
             qemu_notify_event();
         }
     }
-    if (qemu_net_queue_flush(nc->incoming_queue)) {
+    if (nc->info->receive_batch_begin) {
+        nc->info->receive_batch_begin(nc);
+    }
+    flushed = qemu_net_queue_flush(nc->incoming_queue);
+    if (nc->info->receive_batch_end) {
+        nc->info->receive_batch_end(nc);
+    }
+    if (flushed) {
         /* We emptied the queue successfully, signal to the IO thread to repoll
          * the file descriptor (for tap, for example).
          */
@@ -619,6 +628,28 @@ void qemu_flush_queued_packets(NetClientState *nc)
     qemu_flush_or_purge_queued_packets(nc, false);
 }
 
+/*
+ * Bracket a run of packets that @sender sends back to back, so that the
+ * receiver can handle them as a batch.
+ */
+void qemu_send_packet_batch_begin(NetClientState *sender)
+{
+    NetClientState *peer = sender->peer;
+
+    if (peer && peer->info->receive_batch_begin) {
+        peer->info->receive_batch_begin(peer);
+    }
+}
+
+void qemu_send_packet_batch_end(NetClientState *sender)
+{
+    NetClientState *peer = sender->peer;
+
+    if (peer && peer->info->receive_batch_end) {
+        peer->info->receive_batch_end(peer);
+    }
+}
+
 static ssize_t qemu_send_packet_async_with_flags(NetClientState *sender,
                                                  unsigned flags,
                                                  const uint8_t *buf, int size,
@@ -952,6 +983,9 @@ static int (* const net_client_init_fun[NET_CLIENT_DRIVER__MAX])(
 #ifdef CONFIG_NETMAP
         [NET_CLIENT_DRIVER_NETMAP]    = net_init_netmap,
 #endif
+#ifdef CONFIG_AF_XDP
+        [NET_CLIENT_DRIVER_AF_XDP]    = net_init_af_xdp,
+#endif
 #ifdef CONFIG_NET_BRIDGE
         [NET_CLIENT_DRIVER_BRIDGE]    = net_init_bridge,
 #endif
@@ -1085,6 +1119,9 @@ static void show_netdevs(void)
 #ifdef CONFIG_NETMAP
         "netmap",
 #endif
+#ifdef CONFIG_AF_XDP
+        "af-xdp",
+#endif
 #ifdef CONFIG_POSIX
         "vhost-user",
 #endif
@@ -1173,7 +1210,7 @@ void netdev_add(QemuOpts *opts, Error **errp)
     net_client_init(opts, true, errp);
 }
 
-void qmp_netdev_add(QDict *qdict, QObject **ret, Error **errp)
+void qmp_netdev_add(QDict *qdict, Visitor *ret_v, Error **errp)
 {
     Error *local_err = NULL;
     QemuOptsList *opts_list;
@@ -1195,6 +1232,9 @@ void qmp_netdev_add(QDict *qdict, QObject **ret, Error **errp)
         goto out;
     }
 
+    visit_start_struct(ret_v, "return", NULL, 0, &error_abort);
+    visit_end_struct(ret_v, NULL);
+
 out:
     error_propagate(errp, local_err);
 }
@@ -32,6 +32,8 @@
 #include <sys/wait.h>
 #endif
 #include "net/net.h"
+#include "net/eth.h"
+#include "net/checksum.h"
 #include "clients.h"
 #include "hub.h"
 #include "monitor/monitor.h"
@@ -46,6 +48,7 @@
 #include "util.h"
 #include "migration/register.h"
 #include "migration/qemu-file-types.h"
+#include "standard-headers/linux/virtio_net.h"
 
 static int get_str_sep(char *buf, int buf_size, const char **pp, int sep)
 {
@@ -94,6 +97,10 @@ typedef struct SlirpState {
     gchar *smb_dir;
 #endif
     GSList *fwd;
+    /* virtio-net header offloads, see net_slirp_receive_offload() */
+    bool offload;
+    int vnet_hdr_len;
+    bool guest_csum;
 } SlirpState;
 
 static struct slirp_config_str *slirp_configs;
@@ -115,19 +122,218 @@ static ssize_t net_slirp_send_packet(const void *pkt, size_t pkt_len,
                                      void *opaque)
 {
     SlirpState *s = opaque;
+    struct virtio_net_hdr_mrg_rxbuf hdr = { };
+    struct iovec iov[2];
+    ssize_t ret;
 
-    return qemu_send_packet(&s->nc, pkt, pkt_len);
+    if (!s->vnet_hdr_len) {
+        return qemu_send_packet(&s->nc, pkt, pkt_len);
+    }
+
+    /* slirp computes full checksums on everything it sends */
+    if (s->guest_csum) {
+        hdr.hdr.flags = VIRTIO_NET_HDR_F_DATA_VALID;
+    }
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = s->vnet_hdr_len;
+    iov[1].iov_base = (void *)pkt;
+    iov[1].iov_len = pkt_len;
+
+    ret = qemu_sendv_packet(&s->nc, iov, 2);
+    return ret > 0 ? ret - s->vnet_hdr_len : ret;
+}
+
+/*
+ * Finish a checksum that the guest left to the host.  The checksum
+ * field already holds the sum of the pseudo header.
+ */
+static void net_slirp_complete_csum(uint8_t *buf, size_t size,
+                                    const struct virtio_net_hdr *hdr)
+{
+    uint32_t sum;
+
+    if (hdr->csum_start + hdr->csum_offset + sizeof(uint16_t) > size) {
+        return;
+    }
+
+    sum = net_checksum_add(size - hdr->csum_start, buf + hdr->csum_start);
+    stw_be_p(buf + hdr->csum_start + hdr->csum_offset,
+             net_checksum_finish_nozero(sum));
+}
+
+/*
+ * Cut a TCP super-frame into segments of gso_size bytes of payload, fix
+ * up the IP and TCP headers of each and hand them to slirp.
+ */
+static void net_slirp_input_tso(SlirpState *s,
+                                const struct virtio_net_hdr *hdr,
+                                const uint8_t *buf, size_t size)
+{
+    struct iovec iov = { .iov_base = (void *)buf, .iov_len = size };
+    bool isip4, isip6, isudp, istcp;
+    size_t l3off, l4off, l5off, off, len;
+    eth_ip6_hdr_info ip6info;
+    eth_ip4_hdr_info ip4info;
+    eth_l4_hdr_info l4info;
+    struct tcp_header *tcp;
+    uint32_t seq, sum, cso;
+    uint16_t flags, ip_id;
+    uint8_t *seg;
+    int n;
+
+    eth_get_protocols(&iov, 1, &isip4, &isip6, &isudp, &istcp,
+                      &l3off, &l4off, &l5off, &ip6info, &ip4info, &l4info);
+    if (!istcp || !hdr->gso_size || l5off >= size) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "slirp: dropping malformed TSO frame\n");
+        return;
+    }
+
+    seq = be32_to_cpu(l4info.hdr.tcp.th_seq);
+    flags = be16_to_cpu(l4info.hdr.tcp.th_offset_flags);
+    ip_id = isip4 ? be16_to_cpu(ip4info.ip4_hdr.ip_id) : 0;
+
+    seg = g_malloc(l5off + hdr->gso_size);
+    memcpy(seg, buf, l5off);
+    tcp = (struct tcp_header *)(seg + l4off);
+
+    for (off = l5off, n = 0; off < size; off += len, n++) {
+        uint16_t seg_flags = flags;
+
+        len = MIN(hdr->gso_size, size - off);
+        memcpy(seg + l5off, buf + off, len);
+
+        /* FIN and PSH go to the last segment, CWR only to the first */
+        if (off + len < size) {
+            seg_flags &= ~(TCP_FLAG_FIN | TCP_FLAG_PSH);
+        }
+        if (n) {
+            seg_flags &= ~TCP_FLAG_CWR;
+        }
+        tcp->th_offset_flags = cpu_to_be16(seg_flags);
+        tcp->th_seq = cpu_to_be32(seq + (off - l5off));
+        tcp->th_sum = 0;
+
+        if (isip4) {
+            struct ip_header *ip = (struct ip_header *)(seg + l3off);
+
+            ip->ip_len = cpu_to_be16(l5off - l3off + len);
+            ip->ip_id = cpu_to_be16(ip_id + n);
+            eth_fix_ip4_checksum(ip, l4off - l3off);
+            sum = eth_calc_ip4_pseudo_hdr_csum(ip, l5off - l4off + len, &cso);
+        } else {
+            struct ip6_header *ip6 = (struct ip6_header *)(seg + l3off);
+
+            ip6->ip6_ctlun.ip6_un1.ip6_un1_plen =
+                cpu_to_be16(l5off - l3off - sizeof(*ip6) + len);
+            sum = eth_calc_ip6_pseudo_hdr_csum(ip6, l5off - l4off + len,
+                                               IP_PROTO_TCP, &cso);
+        }
+        sum += net_checksum_add(l5off - l4off + len, seg + l4off);
+        tcp->th_sum = cpu_to_be16(net_checksum_finish(sum));
+
+        slirp_input(s->slirp, seg, l5off + len);
+    }
+
+    g_free(seg);
+}
+
+/*
+ * With offload=on the NIC prepends a virtio-net header to each frame.
+ * slirp itself knows nothing of offloads, so the segmentation and the
+ * checksums that the guest skipped are done here; that is still much
+ * cheaper than having the guest do them and pushing every segment
+ * through the NIC separately.
+ */
+static void net_slirp_receive_offload(SlirpState *s, const uint8_t *buf,
+                                      size_t size)
+{
+    struct virtio_net_hdr hdr;
+    uint8_t *pkt;
+
+    if (size < s->vnet_hdr_len) {
+        return;
+    }
+    memcpy(&hdr, buf, sizeof(hdr));
+    buf += s->vnet_hdr_len;
+    size -= s->vnet_hdr_len;
+
+    switch (hdr.gso_type & ~VIRTIO_NET_HDR_GSO_ECN) {
+    case VIRTIO_NET_HDR_GSO_NONE:
+        break;
+    case VIRTIO_NET_HDR_GSO_TCPV4:
+    case VIRTIO_NET_HDR_GSO_TCPV6:
+        net_slirp_input_tso(s, &hdr, buf, size);
+        return;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "slirp: unsupported GSO type %d\n",
+                      hdr.gso_type);
+        return;
+    }
+
+    if (!(hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)) {
+        slirp_input(s->slirp, buf, size);
+        return;
+    }
+
+    pkt = g_memdup(buf, size);
+    net_slirp_complete_csum(pkt, size, &hdr);
+    slirp_input(s->slirp, pkt, size);
+    g_free(pkt);
 }
 
 static ssize_t net_slirp_receive(NetClientState *nc, const uint8_t *buf, size_t size)
 {
     SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
 
-    slirp_input(s->slirp, buf, size);
+    if (s->vnet_hdr_len) {
+        net_slirp_receive_offload(s, buf, size);
+    } else {
+        slirp_input(s->slirp, buf, size);
+    }
 
     return size;
 }
 
+static bool net_slirp_has_vnet_hdr(NetClientState *nc)
+{
+    SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
+
+    return s->offload;
+}
+
+static bool net_slirp_has_vnet_hdr_len(NetClientState *nc, int len)
+{
+    return net_slirp_has_vnet_hdr(nc) &&
+           (len == sizeof(struct virtio_net_hdr) ||
+            len == sizeof(struct virtio_net_hdr_mrg_rxbuf));
+}
+
+static void net_slirp_using_vnet_hdr(NetClientState *nc, bool enable)
+{
+    SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
+
+    assert(!enable || s->offload);
+    s->vnet_hdr_len = enable ? sizeof(struct virtio_net_hdr) : 0;
+}
+
+static void net_slirp_set_vnet_hdr_len(NetClientState *nc, int len)
+{
+    SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
+
+    assert(net_slirp_has_vnet_hdr_len(nc, len));
+    s->vnet_hdr_len = len;
+}
+
+static void net_slirp_set_offload(NetClientState *nc, int csum, int tso4,
+                                  int tso6, int ecn, int ufo)
+{
+    SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
+
+    /* slirp never sends super-frames, only the checksum flag matters */
+    s->guest_csum = csum;
+}
+
 static void slirp_smb_exit(Notifier *n, void *data)
 {
     SlirpState *s = container_of(n, SlirpState, exit_notifier);
@@ -162,6 +368,11 @@ static NetClientInfo net_slirp_info = {
     .size = sizeof(SlirpState),
     .receive = net_slirp_receive,
     .cleanup = net_slirp_cleanup,
+    .has_vnet_hdr = net_slirp_has_vnet_hdr,
+    .has_vnet_hdr_len = net_slirp_has_vnet_hdr_len,
+    .using_vnet_hdr = net_slirp_using_vnet_hdr,
+    .set_offload = net_slirp_set_offload,
+    .set_vnet_hdr_len = net_slirp_set_vnet_hdr_len,
 };
 
 static void net_slirp_guest_error(const char *msg, void *opaque)
@@ -298,8 +509,11 @@ static void net_slirp_poll_notify(Notifier *notifier, void *data)
         break;
     case MAIN_LOOP_POLL_OK:
     case MAIN_LOOP_POLL_ERR:
+        /* Let the NIC notify the guest once for everything slirp sends */
+        qemu_send_packet_batch_begin(&s->nc);
         slirp_pollfds_poll(s->slirp, poll->state == MAIN_LOOP_POLL_ERR,
                            net_slirp_get_revents, poll->pollfds);
+        qemu_send_packet_batch_end(&s->nc);
         break;
     default:
         g_assert_not_reached();
@@ -357,7 +571,7 @@ static int net_slirp_init(NetClientState *peer, const char *model,
                           const char *smb_export, const char *vsmbserver,
                           const char **dnssearch, const char *vdomainname,
                           const char *tftp_server_name,
-                          Error **errp)
+                          bool offload, Error **errp)
 {
     /* default settings according to historic slirp */
     struct in_addr net  = { .s_addr = htonl(0x0a000200) }; /* 10.0.2.0 */
@@ -558,6 +772,7 @@ static int net_slirp_init(NetClientState *peer, const char *model,
              restricted ? "on" : "off");
 
     s = DO_UPCAST(SlirpState, nc, nc);
+    s->offload = offload;
 
     s->slirp = slirp_init(restricted, ipv4, net, mask, host,
                           ipv6, ip6_prefix, vprefix6_len, ip6_host,
@@ -1120,7 +1335,8 @@ int net_init_slirp(const Netdev *netdev, const char *name,
                          user->bootfile, user->dhcpstart,
                          user->dns, user->ipv6_dns, user->smb,
                          user->smbserver, dnssearch, user->domainname,
-                         user->tftp_server_name, errp);
+                         user->tftp_server_name,
+                         user->has_offload && user->offload, errp);
 
     while (slirp_configs) {
         config = slirp_configs;
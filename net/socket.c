@@ -193,24 +193,34 @@ static void net_socket_send(void *opaque)
     }
 }
 
+/* Datagrams read per net_socket_send_dgram() call, as in tap_send() */
+#define NET_SOCKET_DGRAM_BATCH 50
+
 static void net_socket_send_dgram(void *opaque)
 {
     NetSocketState *s = opaque;
     int size;
+    int packets;
 
-    size = qemu_recv(s->fd, s->rs.buf, sizeof(s->rs.buf), 0);
-    if (size < 0)
-        return;
-    if (size == 0) {
-        /* end of connection */
-        net_socket_read_poll(s, false);
-        net_socket_write_poll(s, false);
-        return;
-    }
-    if (qemu_send_packet_async(&s->nc, s->rs.buf, size,
-                               net_socket_send_completed) == 0) {
-        net_socket_read_poll(s, false);
+    qemu_send_packet_batch_begin(&s->nc);
+    for (packets = 0; packets < NET_SOCKET_DGRAM_BATCH; packets++) {
+        size = qemu_recv(s->fd, s->rs.buf, sizeof(s->rs.buf), 0);
+        if (size < 0) {
+            break;
+        }
+        if (size == 0) {
+            /* end of connection */
+            net_socket_read_poll(s, false);
+            net_socket_write_poll(s, false);
+            break;
+        }
+        if (qemu_send_packet_async(&s->nc, s->rs.buf, size,
+                                   net_socket_send_completed) == 0) {
+            net_socket_read_poll(s, false);
+            break;
+        }
     }
+    qemu_send_packet_batch_end(&s->nc);
 }
 
 static int net_socket_mcast_create(struct sockaddr_in *mcastaddr,
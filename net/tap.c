@@ -187,6 +187,7 @@ static void tap_send(void *opaque)
     int size;
     int packets = 0;
 
+    qemu_send_packet_batch_begin(&s->nc);
     while (true) {
         uint8_t *buf = s->buf;
 
@@ -219,6 +220,7 @@ static void tap_send(void *opaque)
             break;
         }
     }
+    qemu_send_packet_batch_end(&s->nc);
 }
 
 static bool tap_has_ufo(NetClientState *nc)
@@ -0,0 +1,278 @@
+/*
+ * QEMU Plugin Core code
+ *
+ * This is the code that keeps track of the loaded plugins, of their
+ * callbacks and of the per-vCPU scoreboards, and that runs the callbacks
+ * of the events that do not come from translated code.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/rcu.h"
+#include "qemu/rcu_queue.h"
+#include "qemu/plugin.h"
+#include "hw/core/cpu.h"
+#include "exec/exec-all.h"
+#include "plugin.h"
+
+struct qemu_plugin_state plugin;
+
+struct qemu_plugin_ctx *plugin_id_to_ctx_locked(qemu_plugin_id_t id)
+{
+    struct qemu_plugin_ctx *ctx;
+
+    QTAILQ_FOREACH(ctx, &plugin.ctxs, entry) {
+        if (ctx->id == id) {
+            return ctx;
+        }
+    }
+    error_report("plugin: invalid plugin id %" PRIu64, id);
+    abort();
+}
+
+/* Registering the same event again replaces the callback */
+void plugin_register_cb(qemu_plugin_id_t id, enum qemu_plugin_event ev,
+                        void *func, void *udata)
+{
+    struct qemu_plugin_ctx *ctx;
+    struct qemu_plugin_cb *cb;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    ctx = plugin_id_to_ctx_locked(id);
+    cb = ctx->callbacks[ev];
+    if (cb) {
+        atomic_set(&cb->f.generic, func);
+        atomic_set(&cb->udata, udata);
+    } else {
+        cb = g_new0(struct qemu_plugin_cb, 1);
+        cb->ctx = ctx;
+        cb->f.generic = func;
+        cb->udata = udata;
+        ctx->callbacks[ev] = cb;
+        QLIST_INSERT_HEAD_RCU(&plugin.cb_lists[ev], cb, entry);
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+}
+
+void plugin_register_dyn_cb(GArray **arr, struct qemu_plugin_dyn_cb *cb)
+{
+    if (*arr == NULL) {
+        *arr = g_array_new(false, false, sizeof(struct qemu_plugin_dyn_cb));
+    }
+    g_array_append_val(*arr, *cb);
+}
+
+static void plugin_vcpu_cb__simple(CPUState *cpu, enum qemu_plugin_event ev)
+{
+    struct qemu_plugin_cb *cb;
+
+    rcu_read_lock();
+    QLIST_FOREACH_RCU(cb, &plugin.cb_lists[ev], entry) {
+        qemu_plugin_vcpu_simple_cb_t func = atomic_read(&cb->f.vcpu_simple);
+
+        func(cb->ctx->id, cpu->cpu_index);
+    }
+    rcu_read_unlock();
+}
+
+/*
+ * Scoreboards
+ *
+ * Each vCPU has its element of every scoreboard in its CPUState, where
+ * the inline ops find it with a single load.  The elements are kept by
+ * vCPU index in the scoreboard, so that they outlive the vCPU: an index
+ * reused by a later vCPU, as linux-user does for threads, adds up to the
+ * same element.
+ */
+static void *scoreboard_element_locked(struct qemu_plugin_scoreboard *score,
+                                       unsigned int vcpu_index)
+{
+    void *elem;
+
+    if (vcpu_index >= score->data->len) {
+        g_ptr_array_set_size(score->data, vcpu_index + 1);
+    }
+    elem = g_ptr_array_index(score->data, vcpu_index);
+    if (!elem) {
+        elem = g_malloc0(score->element_size);
+        g_ptr_array_index(score->data, vcpu_index) = elem;
+    }
+    return elem;
+}
+
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size)
+{
+    struct qemu_plugin_scoreboard *score = NULL;
+    CPUState *cpu;
+    int i;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    for (i = 0; i < QEMU_PLUGIN_MAX_SCOREBOARDS; i++) {
+        if (!plugin.scoreboards[i]) {
+            break;
+        }
+    }
+    if (i < QEMU_PLUGIN_MAX_SCOREBOARDS) {
+        score = g_new0(struct qemu_plugin_scoreboard, 1);
+        score->slot = i;
+        score->element_size = ROUND_UP(MAX(element_size, 1), 8);
+        score->data = g_ptr_array_new_with_free_func(g_free);
+
+        rcu_read_lock();
+        CPU_FOREACH(cpu) {
+            atomic_set(&cpu->plugin_scoreboards[i],
+                       scoreboard_element_locked(score, cpu->cpu_index));
+        }
+        rcu_read_unlock();
+        plugin.scoreboards[i] = score;
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+    return score;
+}
+
+static void plugin_scoreboard_release(CPUState *unused, run_on_cpu_data arg)
+{
+    struct qemu_plugin_scoreboard *score = arg.host_ptr;
+    CPUState *cpu;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    rcu_read_lock();
+    CPU_FOREACH(cpu) {
+        atomic_set(&cpu->plugin_scoreboards[score->slot], NULL);
+    }
+    rcu_read_unlock();
+    plugin.scoreboards[score->slot] = NULL;
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    g_ptr_array_free(score->data, true);
+    g_free(score);
+}
+
+/*
+ * Translated blocks may still hold inline ops that load the slot and
+ * update the elements, and other vCPUs may be running them.  So flush the
+ * translations first, and only release the slot and the elements from
+ * safe work queued after the flush, once no vCPU runs the old code.
+ * Until then the slot is not reused, so that no stale block can update
+ * another scoreboard.
+ */
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
+{
+    CPUState *cpu = current_cpu ? current_cpu : first_cpu;
+
+    if (!cpu) {
+        /* no vCPU yet, hence no translated code either */
+        plugin_scoreboard_release(NULL, RUN_ON_CPU_HOST_PTR(score));
+        return;
+    }
+    tb_flush(cpu);
+    async_safe_run_on_cpu(cpu, plugin_scoreboard_release,
+                          RUN_ON_CPU_HOST_PTR(score));
+}
+
+void *plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                             unsigned int vcpu_index)
+{
+    void *elem;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    elem = scoreboard_element_locked(score, vcpu_index);
+    qemu_rec_mutex_unlock(&plugin.lock);
+    return elem;
+}
+
+uint64_t plugin_scoreboard_u64_sum(struct qemu_plugin_scoreboard *score,
+                                   size_t offset)
+{
+    uint64_t sum = 0;
+    guint i;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    for (i = 0; i < score->data->len; i++) {
+        uint8_t *elem = g_ptr_array_index(score->data, i);
+
+        if (elem) {
+            sum += atomic_read__nocheck((uint64_t *)(elem + offset));
+        }
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+    return sum;
+}
+
+void qemu_plugin_vcpu_init_hook(CPUState *cpu)
+{
+    int i;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    for (i = 0; i < QEMU_PLUGIN_MAX_SCOREBOARDS; i++) {
+        if (plugin.scoreboards[i]) {
+            cpu->plugin_scoreboards[i] =
+                scoreboard_element_locked(plugin.scoreboards[i],
+                                          cpu->cpu_index);
+        }
+    }
+    if (cpu->cpu_index >= plugin.num_vcpus) {
+        atomic_set(&plugin.num_vcpus, cpu->cpu_index + 1);
+    }
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_INIT);
+}
+
+void qemu_plugin_vcpu_exit_hook(CPUState *cpu)
+{
+    plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_EXIT);
+}
+
+bool qemu_plugin_tb_trans_enabled(void)
+{
+    return !QLIST_EMPTY_RCU(&plugin.cb_lists[QEMU_PLUGIN_EV_VCPU_TB_TRANS]);
+}
+
+void qemu_plugin_tb_trans_cb(CPUState *cpu, struct qemu_plugin_tb *tb)
+{
+    struct qemu_plugin_cb *cb;
+    enum qemu_plugin_event ev = QEMU_PLUGIN_EV_VCPU_TB_TRANS;
+
+    rcu_read_lock();
+    QLIST_FOREACH_RCU(cb, &plugin.cb_lists[ev], entry) {
+        qemu_plugin_vcpu_tb_trans_cb_t func;
+
+        func = atomic_read(&cb->f.vcpu_tb_trans);
+        func(cb->ctx->id, tb);
+    }
+    rcu_read_unlock();
+}
+
+/*
+ * Run the exit callbacks once: from atexit() in the system emulators, and
+ * explicitly from linux-user, which leaves with _exit().
+ */
+void qemu_plugin_atexit_cb(void)
+{
+    struct qemu_plugin_cb *cb;
+
+    if (atomic_xchg(&plugin.exited, true)) {
+        return;
+    }
+    rcu_read_lock();
+    QLIST_FOREACH_RCU(cb, &plugin.cb_lists[QEMU_PLUGIN_EV_ATEXIT], entry) {
+        qemu_plugin_udata_cb_t func = atomic_read(&cb->f.udata);
+
+        func(cb->ctx->id, atomic_read(&cb->udata));
+    }
+    rcu_read_unlock();
+}
+
+static void __attribute__((__constructor__)) plugin_init(void)
+{
+    int i;
+
+    for (i = 0; i < QEMU_PLUGIN_EV_MAX; i++) {
+        QLIST_INIT(&plugin.cb_lists[i]);
+    }
+    qemu_rec_mutex_init(&plugin.lock);
+    QTAILQ_INIT(&plugin.ctxs);
+}
@@ -0,0 +1,204 @@
+/*
+ * QEMU Plugin Core Loader Code
+ *
+ * This is the code responsible for parsing the -plugin options and for
+ * loading the plugins.  Plugins are only loaded at startup, before any
+ * vCPU is created, and stay loaded until QEMU exits.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/config-file.h"
+#include "qapi/error.h"
+#include "qemu/option.h"
+#include "qemu/plugin.h"
+#ifndef CONFIG_USER_ONLY
+#include "hw/boards.h"
+#endif
+#include "plugin.h"
+
+QemuOptsList qemu_plugin_opts = {
+    .name = "plugin",
+    .implied_opt_name = "file",
+    .head = QTAILQ_HEAD_INITIALIZER(qemu_plugin_opts.head),
+    .desc = {
+        /* parsed by plugin_add(), as "arg" may be repeated */
+        { /* end of list */ }
+    },
+};
+
+typedef int (*qemu_plugin_install_func_t)(qemu_plugin_id_t,
+                                          const qemu_info_t *, int, char **);
+
+struct qemu_plugin_desc {
+    char *path;
+    char **argv;
+    QTAILQ_ENTRY(qemu_plugin_desc) entry;
+    int argc;
+};
+
+struct qemu_plugin_parse_arg {
+    QemuPluginList *head;
+    struct qemu_plugin_desc *curr;
+};
+
+static int plugin_add(void *opaque, const char *name, const char *value,
+                      Error **errp)
+{
+    struct qemu_plugin_parse_arg *arg = opaque;
+    struct qemu_plugin_desc *p;
+
+    if (strcmp(name, "file") == 0) {
+        if (strcmp(value, "") == 0) {
+            error_setg(errp, "requires a non-empty argument");
+            return 1;
+        }
+        p = g_new0(struct qemu_plugin_desc, 1);
+        p->path = g_strdup(value);
+        QTAILQ_INSERT_TAIL(arg->head, p, entry);
+        arg->curr = p;
+    } else if (strcmp(name, "arg") == 0) {
+        if (arg->curr == NULL) {
+            error_setg(errp, "missing earlier '-plugin file=' option");
+            return 1;
+        }
+        p = arg->curr;
+        p->argc++;
+        p->argv = g_realloc_n(p->argv, p->argc, sizeof(char *));
+        p->argv[p->argc - 1] = g_strdup(value);
+    } else {
+        error_setg(errp, "-plugin: unexpected parameter '%s'", name);
+        return 1;
+    }
+    return 0;
+}
+
+void qemu_plugin_opt_parse(const char *optarg, QemuPluginList *head)
+{
+    struct qemu_plugin_parse_arg arg;
+    QemuOpts *opts;
+
+    opts = qemu_opts_parse_noisily(qemu_find_opts("plugin"), optarg, true);
+    if (opts == NULL) {
+        exit(1);
+    }
+    arg.head = head;
+    arg.curr = NULL;
+    qemu_opt_foreach(opts, plugin_add, &arg, &error_fatal);
+    qemu_opts_del(opts);
+}
+
+static int plugin_load(struct qemu_plugin_desc *desc, const qemu_info_t *info)
+{
+    qemu_plugin_install_func_t install;
+    struct qemu_plugin_ctx *ctx;
+    gpointer sym;
+    int version;
+    int rc;
+
+    ctx = g_new0(struct qemu_plugin_ctx, 1);
+
+    ctx->handle = g_module_open(desc->path, G_MODULE_BIND_LOCAL);
+    if (ctx->handle == NULL) {
+        error_report("%s: %s", __func__, g_module_error());
+        goto err_dlopen;
+    }
+
+    if (!g_module_symbol(ctx->handle, "qemu_plugin_install", &sym)) {
+        error_report("%s: %s", __func__, g_module_error());
+        goto err_symbol;
+    }
+    install = (qemu_plugin_install_func_t) sym;
+
+    if (!g_module_symbol(ctx->handle, "qemu_plugin_version", &sym)) {
+        error_report("TCG plugin %s does not declare API version %s",
+                     desc->path, g_module_error());
+        goto err_symbol;
+    }
+    version = *(int *)sym;
+    if (version < QEMU_PLUGIN_MIN_VERSION ||
+        version > QEMU_PLUGIN_VERSION) {
+        error_report("TCG plugin %s requires API version %d, but this "
+                     "QEMU supports versions %d to %d", desc->path,
+                     version, QEMU_PLUGIN_MIN_VERSION, QEMU_PLUGIN_VERSION);
+        goto err_symbol;
+    }
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    ctx->id = ++plugin.last_id;
+    QTAILQ_INSERT_TAIL(&plugin.ctxs, ctx, entry);
+    rc = install(ctx->id, info, desc->argc, desc->argv);
+    qemu_rec_mutex_unlock(&plugin.lock);
+    if (rc) {
+        /*
+         * Keep the plugin loaded: it may have registered callbacks before
+         * failing, and QEMU exits anyway.
+         */
+        error_report("%s: plugin %s returned error code %d",
+                     __func__, desc->path, rc);
+    }
+    return rc;
+
+ err_symbol:
+    g_module_close(ctx->handle);
+ err_dlopen:
+    g_free(ctx);
+    return 1;
+}
+
+/* call after having removed @desc from the list */
+static void plugin_desc_free(struct qemu_plugin_desc *desc)
+{
+    int i;
+
+    for (i = 0; i < desc->argc; i++) {
+        g_free(desc->argv[i]);
+    }
+    g_free(desc->argv);
+    g_free(desc->path);
+    g_free(desc);
+}
+
+/**
+ * qemu_plugin_load_list - load a list of plugins
+ * @head: head of the list of descriptors of the plugins to be loaded
+ *
+ * Returns 0 if all plugins in the list are installed, !0 otherwise.
+ *
+ * Note: the descriptor of each successfully installed plugin is removed
+ * from the list given by @head and then freed.
+ */
+int qemu_plugin_load_list(QemuPluginList *head)
+{
+    struct qemu_plugin_desc *desc, *next;
+    qemu_info_t info = {
+        .target_name = TARGET_NAME,
+        .version.min = QEMU_PLUGIN_MIN_VERSION,
+        .version.cur = QEMU_PLUGIN_VERSION,
+    };
+
+#ifndef CONFIG_USER_ONLY
+    info.system_emulation = true;
+    info.system.smp_vcpus = current_machine->smp.cpus;
+    info.system.max_vcpus = current_machine->smp.max_cpus;
+#endif
+
+    QTAILQ_FOREACH_SAFE(desc, head, entry, next) {
+        int err;
+
+        err = plugin_load(desc, &info);
+        if (err) {
+            return err;
+        }
+        QTAILQ_REMOVE(head, desc, entry);
+        /* the plugin had to copy what it needs out of argv */
+        plugin_desc_free(desc);
+    }
+    if (!QTAILQ_EMPTY(&plugin.ctxs)) {
+        atexit(qemu_plugin_atexit_cb);
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * Plugin Shared Internal Functions
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef PLUGIN_INTERNAL_H
+#define PLUGIN_INTERNAL_H
+
+#include <gmodule.h>
+#include "qemu/plugin.h"
+#include "qemu/thread.h"
+
+#define QEMU_PLUGIN_MIN_VERSION 1
+
+union qemu_plugin_cb_sig {
+    qemu_plugin_udata_cb_t           udata;
+    qemu_plugin_vcpu_simple_cb_t     vcpu_simple;
+    qemu_plugin_vcpu_tb_trans_cb_t   vcpu_tb_trans;
+    void *generic;
+};
+
+struct qemu_plugin_cb {
+    struct qemu_plugin_ctx *ctx;
+    union qemu_plugin_cb_sig f;
+    void *udata;
+    QLIST_ENTRY(qemu_plugin_cb) entry;
+};
+
+struct qemu_plugin_ctx {
+    GModule *handle;
+    qemu_plugin_id_t id;
+    struct qemu_plugin_cb *callbacks[QEMU_PLUGIN_EV_MAX];
+    QTAILQ_ENTRY(qemu_plugin_ctx) entry;
+};
+
+struct qemu_plugin_state {
+    QTAILQ_HEAD(, qemu_plugin_ctx) ctxs;
+    QLIST_HEAD(, qemu_plugin_cb) cb_lists[QEMU_PLUGIN_EV_MAX];
+    struct qemu_plugin_scoreboard *scoreboards[QEMU_PLUGIN_MAX_SCOREBOARDS];
+    qemu_plugin_id_t last_id;
+    int num_vcpus;
+    bool exited;
+    /*
+     * Protects the lists and the scoreboards.  The callback lists are
+     * also walked under RCU, so that the hot paths take no lock.
+     */
+    QemuRecMutex lock;
+};
+
+extern struct qemu_plugin_state plugin;
+
+struct qemu_plugin_ctx *plugin_id_to_ctx_locked(qemu_plugin_id_t id);
+
+void plugin_register_cb(qemu_plugin_id_t id, enum qemu_plugin_event ev,
+                        void *func, void *udata);
+
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size);
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
+void *plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                             unsigned int vcpu_index);
+uint64_t plugin_scoreboard_u64_sum(struct qemu_plugin_scoreboard *score,
+                                   size_t offset);
+
+void plugin_register_dyn_cb(GArray **arr, struct qemu_plugin_dyn_cb *cb);
+
+#endif /* PLUGIN_INTERNAL_H */
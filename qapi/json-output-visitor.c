@@ -0,0 +1,233 @@
+/*
+ * JSON Output Visitor
+ *
+ * Copyright (C) 2012-2016 Red Hat, Inc.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.1 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ *
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/json-output-visitor.h"
+#include "qapi/visitor-impl.h"
+#include "qapi/qmp/qjson.h"
+#include "qapi/qmp/qnum.h"
+
+struct JSONOutputVisitor {
+    Visitor visitor;
+    QString *str;       /* Text formatted so far */
+    bool pretty;
+    bool comma;         /* Next value in current container needs a comma */
+    int depth;          /* Number of unfinished containers */
+    QString **result;   /* User's storage location for result */
+};
+
+static JSONOutputVisitor *to_jov(Visitor *v)
+{
+    return container_of(v, JSONOutputVisitor, visitor);
+}
+
+static void json_output_indent(JSONOutputVisitor *jov)
+{
+    int i;
+
+    qstring_append(jov->str, "\n");
+    for (i = 0; i < jov->depth; i++) {
+        qstring_append(jov->str, "    ");
+    }
+}
+
+/*
+ * Emit what comes before a value: the separator from the previous
+ * value in the same container, and the member name inside a struct.
+ */
+static void json_output_prefix(JSONOutputVisitor *jov, const char *name)
+{
+    if (!jov->depth) {
+        /* Don't allow reuse of visitor on more than one root */
+        assert(!qstring_get_length(jov->str));
+        return;
+    }
+
+    if (jov->comma) {
+        qstring_append(jov->str, jov->pretty ? "," : ", ");
+    }
+    if (jov->pretty) {
+        json_output_indent(jov);
+    }
+    if (name) {
+        json_append_quoted(jov->str, name);
+        qstring_append(jov->str, ": ");
+    }
+    jov->comma = true;
+}
+
+static void json_output_start(JSONOutputVisitor *jov, const char *name,
+                              const char *bracket)
+{
+    json_output_prefix(jov, name);
+    qstring_append(jov->str, bracket);
+    jov->depth++;
+    jov->comma = false;
+}
+
+static void json_output_end(JSONOutputVisitor *jov, const char *bracket)
+{
+    assert(jov->depth);
+    jov->depth--;
+    if (jov->pretty) {
+        json_output_indent(jov);
+    }
+    qstring_append(jov->str, bracket);
+    jov->comma = true;
+}
+
+static void json_output_start_struct(Visitor *v, const char *name,
+                                     void **obj, size_t unused, Error **errp)
+{
+    json_output_start(to_jov(v), name, "{");
+}
+
+static void json_output_end_struct(Visitor *v, void **obj)
+{
+    json_output_end(to_jov(v), "}");
+}
+
+static void json_output_start_list(Visitor *v, const char *name,
+                                   GenericList **listp, size_t size,
+                                   Error **errp)
+{
+    json_output_start(to_jov(v), name, "[");
+}
+
+static GenericList *json_output_next_list(Visitor *v, GenericList *tail,
+                                          size_t size)
+{
+    return tail->next;
+}
+
+static void json_output_end_list(Visitor *v, void **obj)
+{
+    json_output_end(to_jov(v), "]");
+}
+
+static void json_output_type_int64(Visitor *v, const char *name,
+                                   int64_t *obj, Error **errp)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    json_output_prefix(jov, name);
+    qstring_append_int(jov->str, *obj);
+}
+
+static void json_output_type_uint64(Visitor *v, const char *name,
+                                    uint64_t *obj, Error **errp)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+    char buf[32];
+
+    json_output_prefix(jov, name);
+    snprintf(buf, sizeof(buf), "%" PRIu64, *obj);
+    qstring_append(jov->str, buf);
+}
+
+static void json_output_type_bool(Visitor *v, const char *name, bool *obj,
+                                  Error **errp)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    json_output_prefix(jov, name);
+    qstring_append(jov->str, *obj ? "true" : "false");
+}
+
+static void json_output_type_str(Visitor *v, const char *name, char **obj,
+                                 Error **errp)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    json_output_prefix(jov, name);
+    json_append_quoted(jov->str, *obj ? *obj : "");
+}
+
+static void json_output_type_number(Visitor *v, const char *name,
+                                    double *obj, Error **errp)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+    QNum *qn = qnum_from_double(*obj);
+    char *buffer = qnum_to_string(qn);
+
+    json_output_prefix(jov, name);
+    qstring_append(jov->str, buffer);
+    g_free(buffer);
+    qobject_unref(qn);
+}
+
+static void json_output_type_any(Visitor *v, const char *name,
+                                 QObject **obj, Error **errp)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    json_output_prefix(jov, name);
+    qobject_append_json(jov->str, *obj, jov->pretty, jov->depth);
+}
+
+static void json_output_type_null(Visitor *v, const char *name,
+                                  QNull **obj, Error **errp)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    json_output_prefix(jov, name);
+    qstring_append(jov->str, "null");
+}
+
+/* Finish formatting, and return the text.  */
+static void json_output_complete(Visitor *v, void *opaque)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    /* A visit must have occurred, with each start paired with end.  */
+    assert(qstring_get_length(jov->str) && !jov->depth);
+    assert(opaque == jov->result);
+
+    *jov->result = qobject_ref(jov->str);
+    jov->result = NULL;
+}
+
+static void json_output_free(Visitor *v)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    qobject_unref(jov->str);
+    g_free(jov);
+}
+
+Visitor *json_output_visitor_new(bool pretty, QString **result)
+{
+    JSONOutputVisitor *v;
+
+    v = g_malloc0(sizeof(*v));
+
+    v->visitor.type = VISITOR_OUTPUT;
+    v->visitor.start_struct = json_output_start_struct;
+    v->visitor.end_struct = json_output_end_struct;
+    v->visitor.start_list = json_output_start_list;
+    v->visitor.next_list = json_output_next_list;
+    v->visitor.end_list = json_output_end_list;
+    v->visitor.type_int64 = json_output_type_int64;
+    v->visitor.type_uint64 = json_output_type_uint64;
+    v->visitor.type_bool = json_output_type_bool;
+    v->visitor.type_str = json_output_type_str;
+    v->visitor.type_number = json_output_type_number;
+    v->visitor.type_any = json_output_type_any;
+    v->visitor.type_null = json_output_type_null;
+    v->visitor.complete = json_output_complete;
+    v->visitor.free = json_output_free;
+
+    v->str = qstring_new();
+    v->pretty = pretty;
+    *result = NULL;
+    v->result = result;
+
+    return &v->visitor;
+}
@@ -16,6 +16,9 @@
 #include "qapi/qmp/dispatch.h"
 #include "qapi/qmp/qdict.h"
 #include "qapi/qmp/qjson.h"
+#include "qapi/json-output-visitor.h"
+#include "qapi/qobject-output-visitor.h"
+#include "qapi/visitor.h"
 #include "sysemu/runstate.h"
 #include "qapi/qmp/qbool.h"
 
@@ -75,19 +78,23 @@ static QDict *qmp_dispatch_check_obj(const QObject *request, bool allow_oob,
     return dict;
 }
 
-static QObject *do_qmp_dispatch(QmpCommandList *cmds, QObject *request,
-                                bool allow_oob, Error **errp)
+/*
+ * Run @request and visit the response struct, less its "id", with @v.
+ * Return false when there is nothing to send but the error set in @errp,
+ * or nothing at all for commands with QCO_NO_SUCCESS_RESP.
+ */
+static bool do_qmp_dispatch(QmpCommandList *cmds, QObject *request,
+                            bool allow_oob, Visitor *v, Error **errp)
 {
     Error *local_err = NULL;
     bool oob;
     const char *command;
     QDict *args, *dict;
     QmpCommand *cmd;
-    QObject *ret = NULL;
 
     dict = qmp_dispatch_check_obj(request, allow_oob, errp);
     if (!dict) {
-        return NULL;
+        return false;
     }
 
     command = qdict_get_try_str(dict, "execute");
@@ -101,24 +108,24 @@ static QObject *do_qmp_dispatch(QmpCommandList *cmds, QObject *request,
     if (cmd == NULL) {
         error_set(errp, ERROR_CLASS_COMMAND_NOT_FOUND,
                   "The command %s has not been found", command);
-        return NULL;
+        return false;
     }
     if (!cmd->enabled) {
         error_setg(errp, "The command %s has been disabled for this instance",
                    command);
-        return NULL;
+        return false;
     }
     if (oob && !(cmd->options & QCO_ALLOW_OOB)) {
         error_setg(errp, "The command %s does not support OOB",
                    command);
-        return NULL;
+        return false;
     }
 
     if (runstate_check(RUN_STATE_PRECONFIG) &&
         !(cmd->options & QCO_ALLOW_PRECONFIG)) {
         error_setg(errp, "The command '%s' isn't permitted in '%s' state",
                    cmd->name, RunState_str(RUN_STATE_PRECONFIG));
-        return NULL;
+        return false;
     }
 
     if (!qdict_haskey(dict, "arguments")) {
@@ -128,19 +135,47 @@ static QObject *do_qmp_dispatch(QmpCommandList *cmds, QObject *request,
         qobject_ref(args);
     }
 
-    cmd->fn(args, &ret, &local_err);
+    visit_start_struct(v, NULL, NULL, 0, &error_abort);
+    cmd->fn(args, v, &local_err);
+    qobject_unref(args);
+
     if (local_err) {
         error_propagate(errp, local_err);
-    } else if (cmd->options & QCO_NO_SUCCESS_RESP) {
-        g_assert(!ret);
-    } else if (!ret) {
-        /* TODO turn into assertion */
-        ret = QOBJECT(qdict_new());
+        return false;
     }
+    return !(cmd->options & QCO_NO_SUCCESS_RESP);
+}
 
-    qobject_unref(args);
+/*
+ * Visit the response to @request with @v.  Return false when there is
+ * none; the error response is then built from @errp if set.
+ */
+static bool qmp_dispatch_visit(QmpCommandList *cmds, QObject *request,
+                               bool allow_oob, Visitor *v, Error **errp)
+{
+    QDict *dict = qobject_to(QDict, request);
+    QObject *id = dict ? qdict_get(dict, "id") : NULL;
 
-    return ret;
+    if (!do_qmp_dispatch(cmds, request, allow_oob, v, errp)) {
+        return false;
+    }
+    if (id) {
+        visit_type_any(v, "id", &id, &error_abort);
+    }
+    visit_end_struct(v, NULL);
+    return true;
+}
+
+static QDict *qmp_dispatch_error(QObject *request, Error *err)
+{
+    QDict *dict = qobject_to(QDict, request);
+    QObject *id = dict ? qdict_get(dict, "id") : NULL;
+    QDict *rsp = qmp_error_response(err);
+
+    if (id) {
+        qdict_put_obj(rsp, "id", qobject_ref(id));
+    }
+    return rsp;
 }
 
 QDict *qmp_error_response(Error *err)
@@ -167,24 +202,47 @@ QDict *qmp_dispatch(QmpCommandList *cmds, QObject *request,
                     bool allow_oob)
 {
     Error *err = NULL;
-    QDict *dict = qobject_to(QDict, request);
-    QObject *ret, *id = dict ? qdict_get(dict, "id") : NULL;
-    QDict *rsp;
-
-    ret = do_qmp_dispatch(cmds, request, allow_oob, &err);
-    if (err) {
-        rsp = qmp_error_response(err);
-    } else if (ret) {
-        rsp = qdict_new();
-        qdict_put_obj(rsp, "return", ret);
-    } else {
-        /* Can only happen for commands with QCO_NO_SUCCESS_RESP */
-        rsp = NULL;
+    QObject *ret = NULL;
+    QDict *rsp = NULL;
+    Visitor *v;
+
+    v = qobject_output_visitor_new(&ret);
+    if (qmp_dispatch_visit(cmds, request, allow_oob, v, &err)) {
+        visit_complete(v, &ret);
+        rsp = qobject_to(QDict, ret);
+    } else if (err) {
+        rsp = qmp_dispatch_error(request, err);
     }
+    /* else: can only happen for commands with QCO_NO_SUCCESS_RESP */
+    visit_free(v);
 
-    if (rsp && id) {
-        qdict_put_obj(rsp, "id", qobject_ref(id));
+    return rsp;
+}
+
+/*
+ * Like qmp_dispatch(), but return the response as JSON text, formatted
+ * as it is visited rather than built as a QDict first.  The members of
+ * objects the command returns appear in schema order.
+ */
+QString *qmp_dispatch_json(QmpCommandList *cmds, QObject *request,
+                           bool allow_oob, bool pretty)
+{
+    Error *err = NULL;
+    QString *json = NULL;
+    QDict *rsp;
+    Visitor *v;
+
+    v = json_output_visitor_new(pretty, &json);
+    if (qmp_dispatch_visit(cmds, request, allow_oob, v, &err)) {
+        visit_complete(v, &json);
+    } else if (err) {
+        /* Discard any partial output */
+        rsp = qmp_dispatch_error(request, err);
+        json = pretty ? qobject_to_json_pretty(QOBJECT(rsp))
+                      : qobject_to_json(QOBJECT(rsp));
+        qobject_unref(rsp);
     }
+    visit_free(v);
 
-    return rsp;
+    return json;
 }
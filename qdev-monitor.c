@@ -27,6 +27,7 @@
 #include "qapi/qapi-commands-qdev.h"
 #include "qapi/qmp/qdict.h"
 #include "qapi/qmp/qerror.h"
+#include "qapi/visitor.h"
 #include "qemu/config-file.h"
 #include "qemu/error-report.h"
 #include "qemu/help_option.h"
@@ -740,7 +741,7 @@ void hmp_info_qdm(Monitor *mon, const QDict *qdict)
     qdev_print_devinfos(true);
 }
 
-void qmp_device_add(QDict *qdict, QObject **ret_data, Error **errp)
+void qmp_device_add(QDict *qdict, Visitor *ret_v, Error **errp)
 {
     Error *local_err = NULL;
     QemuOpts *opts;
@@ -762,6 +763,12 @@ void qmp_device_add(QDict *qdict, QObject **ret_data, Error **errp)
         return;
     }
     object_unref(OBJECT(dev));
+
+    /* HMP has no reply to fill in */
+    if (ret_v) {
+        visit_start_struct(ret_v, "return", NULL, 0, &error_abort);
+        visit_end_struct(ret_v, NULL);
+    }
 }
 
 static DeviceState *find_device_state(const char *id, Error **errp)
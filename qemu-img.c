@@ -70,6 +70,10 @@ enum {
     OPTION_PREALLOCATION = 265,
     OPTION_SHRINK = 266,
     OPTION_SALVAGE = 267,
+    OPTION_SKIP_UNCHANGED = 268,
+    OPTION_WRITE_RATIO = 269,
+    OPTION_RANDOM = 270,
+    OPTION_WARMUP = 271,
 };
 
 typedef enum OutputFormat {
@@ -1584,6 +1588,7 @@ typedef struct ImgConvertState {
     bool wr_in_order;
     bool copy_range;
     bool salvage;
+    bool skip_unchanged;
     bool quiet;
     int min_sparse;
     int alignment;
@@ -1756,12 +1761,56 @@ static int coroutine_fn convert_co_read(ImgConvertState *s, int64_t sector_num,
 }
 
 
+/*
+ * Compare the data in @buf with what the backing file of the target has
+ * at the same offset, one target cluster at a time.  Returns whether the
+ * first cluster is identical and sets *pnum to the number of sectors, at
+ * most *pnum, that compare the same way.
+ */
+static bool convert_same_as_backing(ImgConvertState *s, int64_t sector_num,
+                                    const uint8_t *buf, const uint8_t *backing,
+                                    int *pnum)
+{
+    size_t granule = MAX(s->cluster_sectors, 1);
+    bool first = false;
+    int i = 0;
+
+    while (i < *pnum) {
+        int chunk = MIN(granule - (sector_num + i) % granule, *pnum - i);
+        bool same = !memcmp(buf + i * BDRV_SECTOR_SIZE,
+                            backing + i * BDRV_SECTOR_SIZE,
+                            chunk * BDRV_SECTOR_SIZE);
+
+        if (i == 0) {
+            first = same;
+        } else if (same != first) {
+            break;
+        }
+        i += chunk;
+    }
+
+    *pnum = i;
+    return first;
+}
+
 static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
                                          int nb_sectors, uint8_t *buf,
                                          enum ImgConvertBlockStatus status)
 {
+    uint8_t *backing_buf = NULL, *backing = NULL;
     int ret;
 
+    if (status == BLK_DATA && s->skip_unchanged) {
+        /* The target is new, so reading it returns the backing file data */
+        backing_buf = blk_blockalign(s->target, nb_sectors * BDRV_SECTOR_SIZE);
+        ret = blk_co_pread(s->target, sector_num << BDRV_SECTOR_BITS,
+                           nb_sectors << BDRV_SECTOR_BITS, backing_buf, 0);
+        if (ret < 0) {
+            goto out;
+        }
+        backing = backing_buf;
+    }
+
     while (nb_sectors > 0) {
         int n = nb_sectors;
         BdrvRequestFlags flags = s->compressed ? BDRV_REQ_WRITE_COMPRESSED : 0;
@@ -1775,6 +1824,13 @@ static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
             break;
 
         case BLK_DATA:
+            /* Leave clusters unallocated whose data the backing file
+             * already has */
+            if (backing &&
+                convert_same_as_backing(s, sector_num, buf, backing, &n)) {
+                break;
+            }
+
             /* If we're told to keep the target fully allocated (-S 0) or there
              * is real non-zero data, we must write it. Otherwise we can treat
              * it as zero sectors.
@@ -1791,7 +1847,7 @@ static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
                 ret = blk_co_pwrite(s->target, sector_num << BDRV_SECTOR_BITS,
                                     n << BDRV_SECTOR_BITS, buf, flags);
                 if (ret < 0) {
-                    return ret;
+                    goto out;
                 }
                 break;
             }
@@ -1807,7 +1863,7 @@ static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
                                        n << BDRV_SECTOR_BITS,
                                        BDRV_REQ_MAY_UNMAP);
             if (ret < 0) {
-                return ret;
+                goto out;
             }
             break;
         }
@@ -1815,9 +1871,15 @@ static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
         sector_num += n;
         nb_sectors -= n;
         buf += n * BDRV_SECTOR_SIZE;
+        if (backing) {
+            backing += n * BDRV_SECTOR_SIZE;
+        }
     }
 
-    return 0;
+    ret = 0;
+out:
+    qemu_vfree(backing_buf);
+    return ret;
 }
 
 static int coroutine_fn convert_co_copy_range(ImgConvertState *s, int64_t sector_num,
@@ -2078,6 +2140,7 @@ static int img_convert(int argc, char **argv)
             {"force-share", no_argument, 0, 'U'},
             {"target-image-opts", no_argument, 0, OPTION_TARGET_IMAGE_OPTS},
             {"salvage", no_argument, 0, OPTION_SALVAGE},
+            {"skip-unchanged", no_argument, 0, OPTION_SKIP_UNCHANGED},
             {0, 0, 0, 0}
         };
         c = getopt_long(argc, argv, ":hf:O:B:Cco:l:S:pt:T:qnm:WU",
@@ -2198,6 +2261,9 @@ static int img_convert(int argc, char **argv)
         case OPTION_SALVAGE:
             s.salvage = true;
             break;
+        case OPTION_SKIP_UNCHANGED:
+            s.skip_unchanged = true;
+            break;
         case OPTION_TARGET_IMAGE_OPTS:
             tgt_image_opts = true;
             break;
@@ -2229,6 +2295,17 @@ static int img_convert(int argc, char **argv)
         goto fail_getopt;
     }
 
+    if (s.copy_range && s.skip_unchanged) {
+        error_report("Cannot enable copy offloading when --skip-unchanged "
+                     "is used");
+        goto fail_getopt;
+    }
+
+    if (skip_create && s.skip_unchanged) {
+        error_report("--skip-unchanged cannot be used with -n");
+        goto fail_getopt;
+    }
+
     if (tgt_image_opts && !skip_create) {
         error_report("--target-image-opts requires use of -n flag");
         goto fail_getopt;
@@ -2379,6 +2456,13 @@ static int img_convert(int argc, char **argv)
         goto out;
     }
 
+    if (s.skip_unchanged && !out_baseimg) {
+        error_report("--skip-unchanged requires a backing file for the "
+                     "target (-B)");
+        ret = -1;
+        goto out;
+    }
+
     /* Check if compression is supported */
     if (s.compressed) {
         bool encryption =
@@ -4076,10 +4160,28 @@ out_no_progress:
     return 0;
 }
 
+/*
+ * Latencies are counted in a log-linear histogram: below
+ * 2^BENCH_LAT_SUB_BITS ns each value has its own bucket, and above that
+ * each power of two is split in 2^BENCH_LAT_SUB_BITS buckets, so that a
+ * percentile is read from the histogram with less than 7% error.
+ */
+#define BENCH_LAT_SUB_BITS 4
+#define BENCH_LAT_BUCKETS  (64 << BENCH_LAT_SUB_BITS)
+
+typedef struct BenchRequest {
+    struct BenchData *b;
+    QEMUIOVector qiov;
+    int64_t start;
+    bool write;
+} BenchRequest;
+
 typedef struct BenchData {
     BlockBackend *blk;
     uint64_t image_size;
-    bool write;
+    int write_ratio;
+    bool random;
+    GRand *rand;
     int bufsize;
     int step;
     int nrreq;
@@ -4087,13 +4189,67 @@ typedef struct BenchData {
     int flush_interval;
     bool drain_on_flush;
     uint8_t *buf;
-    QEMUIOVector *qiov;
+    BenchRequest *reqs;
+    BenchRequest **free_reqs;
+    int nr_free;
 
     int in_flight;
     bool in_flush;
     uint64_t offset;
+
+    /* Statistics of the current pass, not kept while warming up */
+    bool record;
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t lat_max;
+    uint64_t lat_hist[BENCH_LAT_BUCKETS];
 } BenchData;
 
+static int bench_lat_bucket(uint64_t ns)
+{
+    int e;
+
+    if (ns < (1 << BENCH_LAT_SUB_BITS)) {
+        return ns;
+    }
+    e = 63 - clz64(ns);
+    return ((e - BENCH_LAT_SUB_BITS + 1) << BENCH_LAT_SUB_BITS) +
+           ((ns >> (e - BENCH_LAT_SUB_BITS)) &
+            ((1 << BENCH_LAT_SUB_BITS) - 1));
+}
+
+/* The highest latency counted in bucket @idx */
+static uint64_t bench_lat_limit(int idx)
+{
+    uint64_t sub;
+    int e;
+
+    if (idx < (1 << BENCH_LAT_SUB_BITS)) {
+        return idx;
+    }
+    e = (idx >> BENCH_LAT_SUB_BITS) + BENCH_LAT_SUB_BITS - 1;
+    sub = idx & ((1 << BENCH_LAT_SUB_BITS) - 1);
+    return ((((uint64_t)1 << BENCH_LAT_SUB_BITS) + sub + 1)
+            << (e - BENCH_LAT_SUB_BITS)) - 1;
+}
+
+/* The latency below which @permille of the requests completed */
+static uint64_t bench_lat_percentile(BenchData *b, int permille)
+{
+    uint64_t total = b->reads + b->writes;
+    uint64_t rank = (total * permille + 999) / 1000;
+    uint64_t seen = 0;
+    int i;
+
+    for (i = 0; i < BENCH_LAT_BUCKETS; i++) {
+        seen += b->lat_hist[i];
+        if (seen >= rank && seen) {
+            return MIN(bench_lat_limit(i), b->lat_max);
+        }
+    }
+    return b->lat_max;
+}
+
 static void bench_undrained_flush_cb(void *opaque, int ret)
 {
     if (ret < 0) {
@@ -4102,6 +4258,28 @@ static void bench_undrained_flush_cb(void *opaque, int ret)
     }
 }
 
+static void bench_cb(void *opaque, int ret);
+
+static void bench_req_cb(void *opaque, int ret)
+{
+    BenchRequest *req = opaque;
+    BenchData *b = req->b;
+
+    if (b->record && ret >= 0) {
+        uint64_t lat = get_clock() - req->start;
+
+        if (req->write) {
+            b->writes++;
+        } else {
+            b->reads++;
+        }
+        b->lat_hist[bench_lat_bucket(lat)]++;
+        b->lat_max = MAX(b->lat_max, lat);
+    }
+    b->free_reqs[b->nr_free++] = req;
+    bench_cb(b, ret);
+}
+
 static void bench_cb(void *opaque, int ret)
 {
     BenchData *b = opaque;
@@ -4147,7 +4325,20 @@ static void bench_cb(void *opaque, int ret)
     }
 
     while (b->n > b->in_flight && b->in_flight < b->nrreq) {
+        BenchRequest *req = b->free_reqs[--b->nr_free];
         int64_t offset = b->offset;
+
+        if (b->random) {
+            uint64_t nr_blocks = b->image_size / b->bufsize;
+
+            offset = (uint64_t)(g_rand_double(b->rand) * nr_blocks) *
+                     b->bufsize;
+        }
+        req->write = b->write_ratio == 100 ||
+                     (b->write_ratio &&
+                      g_rand_int_range(b->rand, 0, 100) < b->write_ratio);
+        req->start = get_clock();
+
         /* blk_aio_* might look for completed I/Os and kick bench_cb
          * again, so make sure this operation is counted by in_flight
          * and b->offset is ready for the next submission.
@@ -4155,10 +4346,12 @@ static void bench_cb(void *opaque, int ret)
         b->in_flight++;
         b->offset += b->step;
         b->offset %= b->image_size;
-        if (b->write) {
-            acb = blk_aio_pwritev(b->blk, offset, b->qiov, 0, bench_cb, b);
+        if (req->write) {
+            acb = blk_aio_pwritev(b->blk, offset, &req->qiov, 0,
+                                  bench_req_cb, req);
         } else {
-            acb = blk_aio_preadv(b->blk, offset, b->qiov, 0, bench_cb, b);
+            acb = blk_aio_preadv(b->blk, offset, &req->qiov, 0,
+                                 bench_req_cb, req);
         }
         if (!acb) {
             error_report("Failed to issue request");
@@ -4167,6 +4360,89 @@ static void bench_cb(void *opaque, int ret)
     }
 }
 
+/* Run @count requests, @depth of them in parallel */
+static void bench_run(BenchData *b, int depth, int count, bool record)
+{
+    int i;
+
+    b->nrreq = depth;
+    b->n = count;
+    b->record = record;
+    b->reads = 0;
+    b->writes = 0;
+    b->lat_max = 0;
+    memset(b->lat_hist, 0, sizeof(b->lat_hist));
+
+    b->nr_free = 0;
+    for (i = depth - 1; i >= 0; i--) {
+        b->free_reqs[b->nr_free++] = &b->reqs[i];
+    }
+
+    bench_cb(b, 0);
+    while (b->n > 0) {
+        main_loop_wait(false);
+    }
+}
+
+static BenchPassInfo *bench_pass_info(BenchData *b, int depth,
+                                      double seconds)
+{
+    BenchPassInfo *info = g_new0(BenchPassInfo, 1);
+    BenchLatencyBucketList **next = &info->latency_histogram;
+    uint64_t requests = b->reads + b->writes;
+    int i;
+
+    info->depth = depth;
+    info->reads = b->reads;
+    info->writes = b->writes;
+    info->time = seconds;
+    info->iops = seconds ? requests / seconds : 0;
+    info->bandwidth = seconds ? requests * b->bufsize / seconds : 0;
+    info->latency_p50 = bench_lat_percentile(b, 500);
+    info->latency_p99 = bench_lat_percentile(b, 990);
+    info->latency_p999 = bench_lat_percentile(b, 999);
+    info->latency_max = b->lat_max;
+
+    for (i = 0; i < BENCH_LAT_BUCKETS; i++) {
+        if (!b->lat_hist[i]) {
+            continue;
+        }
+        *next = g_new0(BenchLatencyBucketList, 1);
+        (*next)->value = g_new0(BenchLatencyBucket, 1);
+        (*next)->value->limit = bench_lat_limit(i);
+        (*next)->value->count = b->lat_hist[i];
+        next = &(*next)->next;
+    }
+    return info;
+}
+
+static void dump_json_bench(BenchInfo *bench)
+{
+    QString *str;
+    QObject *obj;
+    Visitor *v = qobject_output_visitor_new(&obj);
+
+    visit_type_BenchInfo(v, NULL, &bench, &error_abort);
+    visit_complete(v, &obj);
+    str = qobject_to_json_pretty(obj);
+    assert(str != NULL);
+    printf("%s\n", qstring_get_str(str));
+    qobject_unref(obj);
+    visit_free(v);
+    qobject_unref(str);
+}
+
+static void dump_human_bench(BenchPassInfo *info)
+{
+    printf("Run completed in %3.3f seconds.\n", info->time);
+    printf("%.0f IOPS, %.1f MiB/s (%" PRId64 " reads, %" PRId64
+           " writes)\n", info->iops, info->bandwidth / MiB,
+           info->reads, info->writes);
+    printf("Latency (us): p50 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+           info->latency_p50 / 1000.0, info->latency_p99 / 1000.0,
+           info->latency_p999 / 1000.0, info->latency_max / 1000.0);
+}
+
 static int img_bench(int argc, char **argv)
 {
     int c, ret = 0;
@@ -4174,8 +4450,13 @@ static int img_bench(int argc, char **argv)
     bool quiet = false;
     bool image_opts = false;
     bool is_write = false;
+    int write_ratio = -1;
+    bool random = false;
     int count = 75000;
-    int depth = 64;
+    int warmup = 0;
+    int *depths = NULL;
+    int nr_depths = 0;
+    int max_depth = 0;
     int64_t offset = 0;
     size_t bufsize = 4096;
     int pattern = 0;
@@ -4191,6 +4472,10 @@ static int img_bench(int argc, char **argv)
     int i;
     bool force_share = false;
     size_t buf_size;
+    const char *output = NULL;
+    OutputFormat output_format = OFORMAT_HUMAN;
+    BenchInfo *bench = NULL;
+    BenchPassInfoList **next_pass;
 
     for (;;) {
         static const struct option long_options[] = {
@@ -4200,6 +4485,10 @@ static int img_bench(int argc, char **argv)
             {"pattern", required_argument, 0, OPTION_PATTERN},
             {"no-drain", no_argument, 0, OPTION_NO_DRAIN},
             {"force-share", no_argument, 0, 'U'},
+            {"write-ratio", required_argument, 0, OPTION_WRITE_RATIO},
+            {"random", no_argument, 0, OPTION_RANDOM},
+            {"warmup", required_argument, 0, OPTION_WARMUP},
+            {"output", required_argument, 0, OPTION_OUTPUT},
             {0, 0, 0, 0}
         };
         c = getopt_long(argc, argv, ":hc:d:f:no:qs:S:t:wU", long_options, NULL);
@@ -4230,13 +4519,23 @@ static int img_bench(int argc, char **argv)
         }
         case 'd':
         {
+            char **list = g_strsplit(optarg, ",", 0);
             unsigned long res;
 
-            if (qemu_strtoul(optarg, NULL, 0, &res) < 0 || res > INT_MAX) {
-                error_report("Invalid queue depth specified");
-                return 1;
+            g_free(depths);
+            nr_depths = g_strv_length(list);
+            depths = g_new(int, nr_depths);
+            for (i = 0; i < nr_depths; i++) {
+                if (qemu_strtoul(list[i], NULL, 0, &res) < 0 ||
+                    res == 0 || res > INT_MAX) {
+                    error_report("Invalid queue depth specified");
+                    g_strfreev(list);
+                    g_free(depths);
+                    return 1;
+                }
+                depths[i] = res;
             }
-            depth = res;
+            g_strfreev(list);
             break;
         }
         case 'f':
@@ -4327,6 +4626,34 @@ static int img_bench(int argc, char **argv)
         case OPTION_IMAGE_OPTS:
             image_opts = true;
             break;
+        case OPTION_WRITE_RATIO:
+        {
+            unsigned long res;
+
+            if (qemu_strtoul(optarg, NULL, 0, &res) < 0 || res > 100) {
+                error_report("Invalid write ratio specified");
+                return 1;
+            }
+            write_ratio = res;
+            break;
+        }
+        case OPTION_RANDOM:
+            random = true;
+            break;
+        case OPTION_WARMUP:
+        {
+            unsigned long res;
+
+            if (qemu_strtoul(optarg, NULL, 0, &res) < 0 || res > INT_MAX) {
+                error_report("Invalid warmup request count specified");
+                return 1;
+            }
+            warmup = res;
+            break;
+        }
+        case OPTION_OUTPUT:
+            output = optarg;
+            break;
         }
     }
 
@@ -4335,12 +4662,42 @@ static int img_bench(int argc, char **argv)
     }
     filename = argv[argc - 1];
 
-    if (!is_write && flush_interval) {
+    if (output && !strcmp(output, "json")) {
+        output_format = OFORMAT_JSON;
+    } else if (output && !strcmp(output, "human")) {
+        output_format = OFORMAT_HUMAN;
+    } else if (output) {
+        error_report("--output must be used with human or json as argument.");
+        ret = -1;
+        goto out;
+    }
+
+    if (!depths) {
+        nr_depths = 1;
+        depths = g_new(int, 1);
+        depths[0] = 64;
+    }
+    for (i = 0; i < nr_depths; i++) {
+        max_depth = MAX(max_depth, depths[i]);
+    }
+
+    if (write_ratio < 0) {
+        write_ratio = is_write ? 100 : 0;
+    } else if (is_write) {
+        error_report("-w and --write-ratio are mutually exclusive");
+        ret = -1;
+        goto out;
+    }
+    if (write_ratio) {
+        flags |= BDRV_O_RDWR;
+    }
+
+    if (!write_ratio && flush_interval) {
         error_report("--flush-interval is only available in write tests");
         ret = -1;
         goto out;
     }
-    if (flush_interval && flush_interval < depth) {
+    if (flush_interval && flush_interval < max_depth) {
         error_report("Flush interval can't be smaller than depth");
         ret = -1;
         goto out;
@@ -4358,58 +4715,110 @@ static int img_bench(int argc, char **argv)
         ret = image_size;
         goto out;
     }
+    if (random && image_size < bufsize) {
+        error_report("Image is smaller than the buffer size");
+        ret = -1;
+        goto out;
+    }
 
     data = (BenchData) {
         .blk            = blk,
         .image_size     = image_size,
         .bufsize        = bufsize,
         .step           = step ?: bufsize,
-        .nrreq          = depth,
-        .n              = count,
         .offset         = offset,
-        .write          = is_write,
+        .write_ratio    = write_ratio,
+        .random         = random,
+        .rand           = g_rand_new_with_seed(0),
         .flush_interval = flush_interval,
         .drain_on_flush = drain_on_flush,
     };
-    printf("Sending %d %s requests, %d bytes each, %d in parallel "
-           "(starting at offset %" PRId64 ", step size %d)\n",
-           data.n, data.write ? "write" : "read", data.bufsize, data.nrreq,
-           data.offset, data.step);
-    if (flush_interval) {
-        printf("Sending flush every %d requests\n", flush_interval);
-    }
 
-    buf_size = data.nrreq * data.bufsize;
+    buf_size = max_depth * data.bufsize;
     data.buf = blk_blockalign(blk, buf_size);
-    memset(data.buf, pattern, data.nrreq * data.bufsize);
+    memset(data.buf, pattern, buf_size);
 
     blk_register_buf(blk, data.buf, buf_size);
 
-    data.qiov = g_new(QEMUIOVector, data.nrreq);
-    for (i = 0; i < data.nrreq; i++) {
-        qemu_iovec_init(&data.qiov[i], 1);
-        qemu_iovec_add(&data.qiov[i],
+    data.reqs = g_new0(BenchRequest, max_depth);
+    data.free_reqs = g_new(BenchRequest *, max_depth);
+    for (i = 0; i < max_depth; i++) {
+        data.reqs[i].b = &data;
+        qemu_iovec_init(&data.reqs[i].qiov, 1);
+        qemu_iovec_add(&data.reqs[i].qiov,
                        data.buf + i * data.bufsize, data.bufsize);
     }
 
-    gettimeofday(&t1, NULL);
-    bench_cb(&data, 0);
+    if (warmup) {
+        if (output_format == OFORMAT_HUMAN) {
+            printf("Warming up with %d requests\n", warmup);
+        }
+        bench_run(&data, depths[0], warmup, false);
+    }
 
-    while (data.n > 0) {
-        main_loop_wait(false);
+    bench = g_new0(BenchInfo, 1);
+    next_pass = &bench->passes;
+    for (i = 0; i < nr_depths; i++) {
+        BenchPassInfo *info;
+
+        if (output_format == OFORMAT_HUMAN) {
+            if (write_ratio == 0 || write_ratio == 100) {
+                printf("Sending %d %s requests", count,
+                       write_ratio ? "write" : "read");
+            } else {
+                printf("Sending %d requests (%d%% writes)", count,
+                       write_ratio);
+            }
+            printf(", %d bytes each, %d in parallel ", data.bufsize,
+                   depths[i]);
+            if (random) {
+                printf("(random offsets)\n");
+            } else {
+                printf("(starting at offset %" PRId64 ", step size %d)\n",
+                       data.offset, data.step);
+            }
+            if (flush_interval) {
+                printf("Sending flush every %d requests\n", flush_interval);
+            }
+        }
+
+        gettimeofday(&t1, NULL);
+        bench_run(&data, depths[i], count, true);
+        gettimeofday(&t2, NULL);
+
+        info = bench_pass_info(&data, depths[i],
+                               (t2.tv_sec - t1.tv_sec)
+                               + ((double)(t2.tv_usec - t1.tv_usec) / 1000000));
+        if (output_format == OFORMAT_HUMAN) {
+            dump_human_bench(info);
+        }
+        *next_pass = g_new0(BenchPassInfoList, 1);
+        (*next_pass)->value = info;
+        next_pass = &(*next_pass)->next;
     }
-    gettimeofday(&t2, NULL);
 
-    printf("Run completed in %3.3f seconds.\n",
-           (t2.tv_sec - t1.tv_sec)
-           + ((double)(t2.tv_usec - t1.tv_usec) / 1000000));
+    if (output_format == OFORMAT_JSON) {
+        dump_json_bench(bench);
+    }
 
 out:
+    qapi_free_BenchInfo(bench);
+    if (data.reqs) {
+        for (i = 0; i < max_depth; i++) {
+            qemu_iovec_destroy(&data.reqs[i].qiov);
+        }
+    }
+    g_free(data.reqs);
+    g_free(data.free_reqs);
+    if (data.rand) {
+        g_rand_free(data.rand);
+    }
     if (data.buf) {
         blk_unregister_buf(blk, data.buf);
     }
     qemu_vfree(data.buf);
     blk_unref(blk);
+    g_free(depths);
 
     if (ret) {
         return 1;
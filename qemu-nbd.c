@@ -1172,6 +1172,14 @@ int main(int argc, char **argv)
         fd_size = limit;
     }
 
+    /*
+     * Several clients of a read-only export always see the same data, so
+     * tell them that they may open more than one connection each.
+     */
+    if ((nbdflags & NBD_FLAG_READ_ONLY) && shared > 1) {
+        nbdflags |= NBD_FLAG_CAN_MULTI_CONN;
+    }
+
     export = nbd_export_new(bs, dev_offset, fd_size, export_name,
                             export_description, bitmap, nbdflags,
                             nbd_export_closed, writethrough, NULL,
@@ -118,9 +118,10 @@ Select CPU model (@code{-cpu help} for list and additional feature selection)
 ETEXI
 
 DEF("accel", HAS_ARG, QEMU_OPTION_accel,
-    "-accel [accel=]accelerator[,thread=single|multi]\n"
+    "-accel [accel=]accelerator[,thread=single|multi][,halt-poll-ns=ns]\n"
     "                select accelerator (kvm, xen, hax, hvf, whpx or tcg; use 'help' for a list)\n"
-    "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
+    "                thread=single|multi (enable multi-threaded TCG)\n"
+    "                halt-poll-ns=ns (poll for wake-ups of halted TCG vCPUs)\n", QEMU_ARCH_ALL)
 STEXI
 @item -accel @var{name}[,prop=@var{value}[,...]]
 @findex -accel
@@ -134,6 +135,13 @@ Controls number of TCG threads. When the TCG is multi-threaded there will be one
 thread per vCPU therefor taking advantage of additional host cores. The default
 is to enable multi-threading where both the back-end and front-ends support it and
 no incompatible TCG features have been enabled (e.g. icount/replay).
+@item halt-poll-ns=@var{ns}
+With multi-threaded TCG, lets a halted vCPU poll for up to @var{ns}
+nanoseconds for an interrupt before it goes to sleep, which cuts the
+wake-up latency of IPI-heavy guests at the cost of host CPU time.  The
+polling time adapts to how long the vCPU usually stays halted.  The
+default, 0, disables polling.  With single-threaded TCG the option has no
+effect, and QEMU warns about it.
 @end table
 ETEXI
 
@@ -500,8 +508,9 @@ Valid global options are:
 Identifies the audio backend.
 
 @item timer-period=@var{period}
-Sets the timer @var{period} used by the audio subsystem in microseconds.
-Default is 10000 (10 ms).
+Sets the longest timer @var{period} used by the audio subsystem in
+microseconds.  The timer runs sooner when the playback buffers are about
+to drain, or the capture buffers to fill.  Default is 10000 (10 ms).
 
 @item in|out.fixed-settings=on|off
 Use fixed settings for host audio.  When off, it will change based on
@@ -1021,7 +1030,7 @@ DEF("drive", HAS_ARG, QEMU_OPTION_drive,
     "-drive [file=file][,if=type][,bus=n][,unit=m][,media=d][,index=i]\n"
     "       [,cache=writethrough|writeback|none|directsync|unsafe][,format=f]\n"
     "       [,snapshot=on|off][,rerror=ignore|stop|report]\n"
-    "       [,werror=ignore|stop|report|enospc][,id=name][,aio=threads|native]\n"
+    "       [,werror=ignore|stop|report|enospc][,id=name][,aio=threads|native|io_uring]\n"
     "       [,readonly=on|off][,copy-on-read=on|off]\n"
     "       [,discard=ignore|unmap][,detect-zeroes=on|off|unmap]\n"
     "       [[,bps=b]|[[,bps_rd=r][,bps_wr=w]]]\n"
@@ -1089,7 +1098,8 @@ unsafe       │ on                off            on
 The default mode is @option{cache=writeback}.
 
 @item aio=@var{aio}
-@var{aio} is "threads", or "native" and selects between pthread based disk I/O and native Linux AIO.
+@var{aio} is "threads", "native" or "io_uring" and selects between pthread
+based disk I/O, native Linux AIO and Linux io_uring.
 @item format=@var{format}
 Specify which disk @var{format} will be used rather than detecting
 the format.  Can be used to specify format=raw to avoid interpreting
@@ -1235,6 +1245,7 @@ ETEXI
 DEF("fsdev", HAS_ARG, QEMU_OPTION_fsdev,
     "-fsdev local,id=id,path=path,security_model=mapped-xattr|mapped-file|passthrough|none\n"
     " [,writeout=immediate][,readonly][,fmode=fmode][,dmode=dmode]\n"
+    " [,attr_cache=on|off]\n"
     " [[,throttling.bps-total=b]|[[,throttling.bps-read=r][,throttling.bps-write=w]]]\n"
     " [[,throttling.iops-total=i]|[[,throttling.iops-read=r][,throttling.iops-write=w]]]\n"
     " [[,throttling.bps-total-max=bm]|[[,throttling.bps-read-max=rm][,throttling.bps-write-max=wm]]]\n"
@@ -1247,7 +1258,7 @@ DEF("fsdev", HAS_ARG, QEMU_OPTION_fsdev,
 
 STEXI
 
-@item -fsdev local,id=@var{id},path=@var{path},security_model=@var{security_model} [,writeout=@var{writeout}][,readonly][,fmode=@var{fmode}][,dmode=@var{dmode}] [,throttling.@var{option}=@var{value}[,throttling.@var{option}=@var{value}[,...]]]
+@item -fsdev local,id=@var{id},path=@var{path},security_model=@var{security_model} [,writeout=@var{writeout}][,readonly][,fmode=@var{fmode}][,dmode=@var{dmode}][,attr_cache=on|off] [,throttling.@var{option}=@var{value}[,throttling.@var{option}=@var{value}[,...]]]
 @itemx -fsdev proxy,id=@var{id},socket=@var{socket}[,writeout=@var{writeout}][,readonly]
 @itemx -fsdev proxy,id=@var{id},sock_fd=@var{sock_fd}[,writeout=@var{writeout}][,readonly]
 @itemx -fsdev synth,id=@var{id}[,readonly]
@@ -1300,6 +1311,11 @@ with security models "mapped-xattr" and "mapped-file".
 @item dmode=@var{dmode}
 Specifies the default mode for newly created directories on the host. Works
 only with security models "mapped-xattr" and "mapped-file".
+@item attr_cache=on|off
+Keeps the attributes of files in memory, to answer the stat requests of the
+guest without asking the host.  Changes made from the guest are seen at once,
+changes made on the host shortly after they happen, through inotify.  Only
+available on Linux hosts.  The default is off.
 @item throttling.bps-total=@var{b},throttling.bps-read=@var{r},throttling.bps-write=@var{w}
 Specify bandwidth throttling limits in bytes per second, either for all request
 types or for reads or writes only.
@@ -1492,7 +1508,8 @@ DEF("display", HAS_ARG, QEMU_OPTION_display,
     "-display vnc=<display>[,<optargs>]\n"
     "-display curses[,charset=<encoding>]\n"
     "-display none\n"
-    "-display egl-headless[,rendernode=<file>]"
+    "-display egl-headless[,rendernode=<file>]\n"
+    "-display shm,path=<file>[,slots=<n>]"
     "                select display type\n"
     "The default display is equivalent to\n"
 #if defined(CONFIG_GTK)
@@ -1544,6 +1561,12 @@ this display needs to be paired with either VNC or SPICE displays.
 Start QEMU as a Spice server and launch the default Spice client
 application. The Spice server will redirect the serial consoles and
 QEMU monitors. (Since 4.0)
+@item shm
+Do not display video output, publish the frames of the first graphical
+console in the file @var{path} instead. Other processes can map the file
+and read the frames without copying them; the layout is described in
+@file{include/ui/shm-display.h}. @var{slots} (2 to 8, default 3) frame
+buffers are written round robin.
 @end table
 ETEXI
 
@@ -1625,6 +1648,7 @@ DEF("spice", HAS_ARG, QEMU_OPTION_spice,
     "       [,jpeg-wan-compression=[auto|never|always]]\n"
     "       [,zlib-glz-wan-compression=[auto|never|always]]\n"
     "       [,streaming-video=[off|all|filter]][,disable-copy-paste]\n"
+    "       [,video-codecs=<encoder>:<codec>[;<encoder>:<codec>]]\n"
     "       [,disable-agent-file-xfer][,agent-mouse=[on|off]]\n"
     "       [,playback-compression=[on|off]][,seamless-migration=[on|off]]\n"
     "       [,gl=[on|off]][,rendernode=<file>]\n"
@@ -1710,6 +1734,17 @@ Default is auto.
 @item streaming-video=[off|all|filter]
 Configure video stream detection.  Default is off.
 
+@item video-codecs=<encoder>:<codec>[;<encoder>:<codec>]
+Set the preferred video encoders and codecs for the streams detected with
+@option{streaming-video}, in order of preference; the first one that the
+client supports is used.  For example
+@code{video-codecs=gstreamer:h264;gstreamer:vp8;spice:mjpeg} lets spice
+encode video with the host's GStreamer H.264 encoder (which may be a VAAPI
+or NVENC hardware encoder), falling back to VP8 and to the built-in MJPEG
+encoder.  The bit rate of GStreamer streams adapts to the client's link.
+Regions that are not detected as video are still sent with
+@option{image-compression}.  Needs spice-server 0.13.2 or newer.  (Since 4.2)
+
 @item agent-mouse=[on|off]
 Enable/disable passing mouse events via vdagent.  Default is on.
 
@@ -2120,6 +2155,7 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "         [,restrict=on|off][,hostname=host][,dhcpstart=addr]\n"
     "         [,dns=addr][,ipv6-dns=addr][,dnssearch=domain][,domainname=domain]\n"
     "         [,tftp=dir][,tftp-server-name=name][,bootfile=f][,hostfwd=rule][,guestfwd=rule]"
+    "[,offload=on|off]"
 #ifndef _WIN32
                                              "[,smb=dir[,smbserver=addr]]\n"
 #endif
@@ -2210,6 +2246,15 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                VALE port (created on the fly) called 'name' ('nmname' is name of the \n"
     "                netmap device, defaults to '/dev/netmap')\n"
 #endif
+#ifdef CONFIG_AF_XDP
+    "-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,zero-copy=on|off]\n"
+    "         [,queues=n][,start-queue=m][,busy-budget=b]\n"
+    "                attach to the host network interface 'name' through AF_XDP\n"
+    "                sockets bound to its queues m to m+n-1\n"
+    "                use 'mode' to select the XDP program attach mode\n"
+    "                use 'zero-copy=on' to require zero-copy, 'off' to forbid it\n"
+    "                use 'busy-budget=b' to busy poll the queues with budget b\n"
+#endif
 #ifdef CONFIG_POSIX
     "-netdev vhost-user,id=str,chardev=dev[,vhostforce=on|off]\n"
     "                configure a vhost-user network, backed by a chardev 'dev'\n"
@@ -2230,6 +2275,9 @@ DEF("nic", HAS_ARG, QEMU_OPTION_nic,
 #ifdef CONFIG_NETMAP
     "netmap|"
 #endif
+#ifdef CONFIG_AF_XDP
+    "af-xdp|"
+#endif
 #ifdef CONFIG_POSIX
     "vhost-user|"
 #endif
@@ -2361,6 +2409,14 @@ In BOOTP reply, broadcast @var{name} as the "TFTP server name" (RFC2132 option
 66). This can be used to advise the guest to load boot files or configurations
 from a different server than the host address.
 
+@item offload=on|off
+Exchange virtio-net headers with the guest NIC (default: off). The guest
+then sends TCP super-frames of up to 64 KiB and leaves their checksums to
+QEMU, which segments them before they enter the user mode network stack,
+and packets sent to the guest are marked as already checksummed. This
+cuts the per-packet work in the guest and the number of packets crossing
+the NIC. Only virtio-net makes use of it.
+
 @item bootfile=@var{file}
 When using the user mode network stack, broadcast @var{file} as the BOOTP
 filename. In conjunction with @option{tftp}, this can be used to network boot
@@ -2671,6 +2727,38 @@ qemu -m 512 -object memory-backend-file,id=mem,size=512M,mem-path=/hugetlbfs,sha
      -device virtio-net-pci,netdev=net0
 @end example
 
+@item -netdev af-xdp,id=@var{id},ifname=@var{name}[,mode=native|skb][,zero-copy=on|off][,queues=@var{n}][,start-queue=@var{m}][,busy-budget=@var{b}]
+
+Connect to queues @var{m} to @var{m}+@var{n}-1 (by default, queue 0 only)
+of the host network interface @var{name} through AF_XDP sockets. An XDP
+program redirecting the packets of those queues to the sockets is attached
+to the interface, in native (driver) mode if possible and in generic
+(@option{mode=skb}) mode otherwise. Packets on other queues still go to
+the host network stack, so the NIC must steer the guest's traffic to the
+selected queues (e.g. with @code{ethtool -N}).
+
+With @option{queues=@var{n}}, a multiqueue virtio-net device uses one NIC
+queue for each of its queue pairs. The kernel passes packets between the
+NIC and the socket buffers without copying them if the driver supports it;
+@option{zero-copy=on} makes QEMU fail if it does not, @option{zero-copy=off}
+always copies. With @option{busy-budget=@var{b}}, the NIC queues are busy
+polled with a budget of @var{b} packets instead of waiting for interrupts;
+the interface must then be set up to defer its interrupts
+(@code{napi_defer_hard_irqs} and @code{gro_flush_timeout} in sysfs).
+
+QEMU needs the CAP_NET_ADMIN, CAP_SYS_ADMIN and CAP_NET_RAW capabilities
+(or CAP_BPF on kernels that have it) to set up the sockets and the
+program.
+
+Example:
+@example
+ethtool -L eth0 combined 8
+ethtool -X eth0 context new start 4 equal 4
+ethtool -N eth0 flow-type ether dst 52:54:00:12:34:56 context 1
+qemu-system-x86_64 -netdev af-xdp,id=n0,ifname=eth0,queues=4,start-queue=4 \
+     -device virtio-net-pci,netdev=n0,mac=52:54:00:12:34:56,mq=on,vectors=10
+@end example
+
 @item -netdev hubport,id=@var{id},hubid=@var{hubid}[,netdev=@var{nd}]
 
 Create a hub port on the emulated hub with ID @var{hubid}.
@@ -2720,7 +2808,7 @@ DEF("chardev", HAS_ARG, QEMU_OPTION_chardev,
     "-chardev msmouse,id=id[,mux=on|off][,logfile=PATH][,logappend=on|off]\n"
     "-chardev vc,id=id[[,width=width][,height=height]][[,cols=cols][,rows=rows]]\n"
     "         [,mux=on|off][,logfile=PATH][,logappend=on|off]\n"
-    "-chardev ringbuf,id=id[,size=size][,logfile=PATH][,logappend=on|off]\n"
+    "-chardev ringbuf,id=id[,size=size][,path=path][,logfile=PATH][,logappend=on|off]\n"
     "-chardev file,id=id,path=path[,mux=on|off][,logfile=PATH][,logappend=on|off]\n"
     "-chardev pipe,id=id,path=path[,mux=on|off][,logfile=PATH][,logappend=on|off]\n"
 #ifdef _WIN32
@@ -2831,6 +2919,13 @@ to a file to record all data transmitted via the backend. The @option{logappend}
 option controls whether the log file will be truncated or appended to when
 opened.
 
+Every backend also supports the @option{flush-ms} option. With
+@option{flush-ms=@var{ms}}, output from the front end is collected for up to
+@var{ms} milliseconds (or until 4 KiB are pending) and written to the backend
+in one go, rather than with one system call per chunk the front end sends.
+This makes a guest console that prints one character at a time much cheaper
+over a socket, pty or file, at the cost of that much latency.
+
 @end table
 
 The available backends are:
@@ -2939,11 +3034,18 @@ the console, in pixels.
 @option{cols} and @option{rows} specify that the console be sized to fit a text
 console with the given dimensions.
 
-@item -chardev ringbuf,id=@var{id}[,size=@var{size}]
+@item -chardev ringbuf,id=@var{id}[,size=@var{size}][,path=@var{path}]
 
 Create a ring buffer with fixed size @option{size}.
 @var{size} must be a power of two and defaults to @code{64K}.
 
+With @option{path}, the ring buffer is kept in a file of fixed size that is
+created, or truncated, when QEMU starts.  Other processes can map the file
+and follow the output without QEMU ever waiting for them or for the disk:
+guest writes are copies into memory, and the oldest output is overwritten
+once @var{size} bytes are queued.  The layout is described in
+@file{include/chardev/ringbuf-file.h}.
+
 @item -chardev file,id=@var{id},path=@var{path}
 
 Log all traffic received from the guest to a file.
@@ -4140,6 +4242,23 @@ HXCOMM HX does not support conditional compilation of text.
 @findex -trace
 @include qemu-option-trace.texi
 ETEXI
+DEF("plugin", HAS_ARG, QEMU_OPTION_plugin, \
+    "-plugin [file=]<file>[,arg=<string>]\n"
+    "                load a plugin\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -plugin file=@var{file}[,arg=@var{string}]
+@findex -plugin
+
+Load a plugin.
+
+@table @option
+@item file=@var{file}
+Load the given plugin from a shared library file.
+@item arg=@var{string}
+Argument string passed to the plugin. (Can be given multiple times.)
+@end table
+ETEXI
 
 HXCOMM Internal use
 DEF("qtest", HAS_ARG, QEMU_OPTION_qtest, "", QEMU_ARCH_ALL)
@@ -4393,7 +4512,7 @@ expensive operation that consumes random pool entropy, so it is
 recommended that a persistent set of parameters be generated
 up front and saved.
 
-@item -object tls-creds-x509,id=@var{id},endpoint=@var{endpoint},dir=@var{/path/to/cred/dir},priority=@var{priority},verify-peer=@var{on|off},passwordid=@var{id}
+@item -object tls-creds-x509,id=@var{id},endpoint=@var{endpoint},dir=@var{/path/to/cred/dir},priority=@var{priority},verify-peer=@var{on|off},passwordid=@var{id}[,ktls=@var{on|off}]
 
 Creates a TLS anonymous credentials object, which can be used to provide
 TLS support on network backends. The @option{id} parameter is a unique
@@ -4435,6 +4554,15 @@ applications, they can do this through this parameter. Its format is
 a gnutls priority string as described at
 @url{https://gnutls.org/manual/html_node/Priority-Strings.html}.
 
+If @option{ktls} is enabled (the default is off), the record encryption
+of the TLS sessions that run over a TCP socket is handed over to the
+Linux kernel once the handshake is complete, which saves copies and
+allows NIC offload. It needs TLS 1.2 or 1.3 with an AES-GCM cipher and
+the kernel @code{tls} module; otherwise the session keeps being
+encrypted by gnutls, with a warning. Once offloaded, a session fails
+if the peer sends a TLS 1.3 key update. The option is also accepted by
+@code{tls-creds-anon} and @code{tls-creds-psk}.
+
 @item -object filter-buffer,id=@var{id},netdev=@var{netdevid},interval=@var{t}[,queue=@var{all|rx|tx}][,status=@var{on|off}]
 
 Interval @var{t} can't be 0, this filter batches the packet delivery: all
@@ -26,6 +26,7 @@
 #include "qemu/sockets.h"
 #include "qemu/base64.h"
 #include "qemu/cutils.h"
+#include "stream.h"
 
 #ifdef HAVE_UTMPX
 #include <utmpx.h>
@@ -619,6 +620,100 @@ void qmp_guest_file_flush(int64_t handle, Error **errp)
     }
 }
 
+/*
+ * The stream gets its own descriptor and uses pread()/pwrite() from the
+ * current position, so that it leaves the stdio stream as it found it.
+ */
+static GuestFileStream *guest_file_stream(int64_t handle, bool writing,
+                                          bool has_chunk_size,
+                                          int64_t chunk_size,
+                                          bool has_window, int64_t window,
+                                          bool compress, Error **errp)
+{
+    GuestFileHandle *gfh = guest_file_handle_find(handle, errp);
+    GuestFileStream *stream_data;
+    struct stat st;
+    off_t pos;
+    int fd;
+
+    if (!gfh) {
+        return NULL;
+    }
+
+    if (!has_chunk_size) {
+        chunk_size = QGA_STREAM_CHUNK_DEFAULT;
+    } else if (chunk_size <= 0 || chunk_size > QGA_STREAM_CHUNK_MAX) {
+        error_setg(errp, "value '%" PRId64 "' is invalid for argument "
+                   "chunk-size", chunk_size);
+        return NULL;
+    }
+    if (!has_window) {
+        window = QGA_STREAM_WINDOW_DEFAULT;
+    } else if (window <= 0 || window > QGA_STREAM_WINDOW_MAX) {
+        error_setg(errp, "value '%" PRId64 "' is invalid for argument "
+                   "window", window);
+        return NULL;
+    }
+
+    if (fstat(fileno(gfh->fh), &st) < 0 || !S_ISREG(st.st_mode)) {
+        error_setg(errp, "streams are only supported for regular files");
+        return NULL;
+    }
+
+    /* explicitly flush when switching from writing */
+    if (gfh->state == RW_STATE_WRITING) {
+        if (fflush(gfh->fh) == EOF) {
+            error_setg_errno(errp, errno, "failed to flush file");
+            return NULL;
+        }
+        gfh->state = RW_STATE_NEW;
+    }
+    pos = ftello(gfh->fh);
+    if (pos < 0) {
+        error_setg_errno(errp, errno, "failed to get file position");
+        return NULL;
+    }
+    fd = qemu_dup(fileno(gfh->fh));
+    if (fd < 0) {
+        error_setg_errno(errp, errno, "failed to duplicate file descriptor");
+        return NULL;
+    }
+
+    slog("guest-file-stream-%s, handle: %" PRId64,
+         writing ? "write" : "read", handle);
+    if (!ga_set_stream(ga_state, ga_stream_new(fd, pos, writing, chunk_size,
+                                               window, compress), errp)) {
+        return NULL;
+    }
+
+    stream_data = g_new0(GuestFileStream, 1);
+    stream_data->chunk_size = chunk_size;
+    stream_data->window = window;
+    return stream_data;
+}
+
+GuestFileStream *qmp_guest_file_stream_read(int64_t handle,
+                                            bool has_chunk_size,
+                                            int64_t chunk_size,
+                                            bool has_window, int64_t window,
+                                            bool has_compress, bool compress,
+                                            Error **errp)
+{
+    return guest_file_stream(handle, false, has_chunk_size, chunk_size,
+                             has_window, window, has_compress && compress,
+                             errp);
+}
+
+GuestFileStream *qmp_guest_file_stream_write(int64_t handle,
+                                             bool has_chunk_size,
+                                             int64_t chunk_size,
+                                             bool has_window, int64_t window,
+                                             Error **errp)
+{
+    return guest_file_stream(handle, true, has_chunk_size, chunk_size,
+                             has_window, window, false, errp);
+}
+
 /* linux-specific implementations. avoid this if at all possible. */
 #if defined(__linux__)
 
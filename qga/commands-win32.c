@@ -455,6 +455,27 @@ void qmp_guest_file_flush(int64_t handle, Error **errp)
     }
 }
 
+GuestFileStream *qmp_guest_file_stream_read(int64_t handle,
+                                            bool has_chunk_size,
+                                            int64_t chunk_size,
+                                            bool has_window, int64_t window,
+                                            bool has_compress, bool compress,
+                                            Error **errp)
+{
+    error_setg(errp, QERR_UNSUPPORTED);
+    return NULL;
+}
+
+GuestFileStream *qmp_guest_file_stream_write(int64_t handle,
+                                             bool has_chunk_size,
+                                             int64_t chunk_size,
+                                             bool has_window, int64_t window,
+                                             Error **errp)
+{
+    error_setg(errp, QERR_UNSUPPORTED);
+    return NULL;
+}
+
 #ifdef CONFIG_QGA_NTDDSCSI
 
 static GuestDiskBusType win2qemu[] = {
@@ -1895,6 +1916,7 @@ GList *ga_command_blacklist_init(GList *blacklist)
         "guest-set-vcpus",
         "guest-get-memory-blocks", "guest-set-memory-blocks",
         "guest-get-memory-block-size",
+        "guest-file-stream-read", "guest-file-stream-write",
         NULL};
     char **p = (char **)list_unsupported;
 
@@ -38,6 +38,10 @@ void ga_disable_logging(GAState *s);
 void ga_enable_logging(GAState *s);
 void GCC_FMT_ATTR(1, 2) slog(const gchar *fmt, ...);
 void ga_set_response_delimited(GAState *s);
+#ifndef _WIN32
+typedef struct GAStream GAStream;
+bool ga_set_stream(GAState *s, GAStream *st, Error **errp);
+#endif
 bool ga_is_frozen(GAState *s);
 void ga_set_frozen(GAState *s);
 void ga_unset_frozen(GAState *s);
@@ -28,6 +28,9 @@
 #include "qapi/qmp/qerror.h"
 #include "qapi/error.h"
 #include "channel.h"
+#ifndef _WIN32
+#include "stream.h"
+#endif
 #include "qemu/bswap.h"
 #include "qemu/help_option.h"
 #include "qemu/sockets.h"
@@ -87,6 +90,10 @@ struct GAState {
     HANDLE wakeup_event;
 #endif
     bool delimit_response;
+#ifndef _WIN32
+    GAStream *stream; /* owns the channel until it is over */
+    GQueue held_requests; /* GARequests that arrived behind the stream */
+#endif
     bool frozen;
     GList *blacklist;
     char *state_filepath_isfrozen;
@@ -340,6 +347,79 @@ void ga_set_response_delimited(GAState *s)
     s->delimit_response = true;
 }
 
+#ifndef _WIN32
+typedef struct GARequest {
+    QObject *obj;
+    Error *err;
+} GARequest;
+
+static void process_event(void *opaque, QObject *obj, Error *err);
+
+/*
+ * @st starts once the response of the current command has been sent.
+ * The requests that follow wait for the stream to end, so a second
+ * stream cannot normally be set up while one runs; still, refuse it
+ * rather than trust the client.
+ */
+bool ga_set_stream(GAState *s, GAStream *st, Error **errp)
+{
+    if (s->stream) {
+        error_setg(errp, "a file stream is already in progress");
+        ga_stream_free(st);
+        return false;
+    }
+    s->stream = st;
+    return true;
+}
+
+/* Once the stream is over, answer the requests it held back */
+static void stream_stop(GAState *s)
+{
+    GARequest *req;
+
+    if (s->stream) {
+        ga_stream_free(s->stream);
+        s->stream = NULL;
+    }
+    while (!s->stream && (req = g_queue_pop_head(&s->held_requests))) {
+        process_event(s, req->obj, req->err);
+        g_free(req);
+    }
+}
+
+/* The client went away: nobody is waiting for the held requests */
+static void stream_abort(GAState *s)
+{
+    GARequest *req;
+
+    while ((req = g_queue_pop_head(&s->held_requests))) {
+        qobject_unref(req->obj);
+        error_free(req->err);
+        g_free(req);
+    }
+    stream_stop(s);
+}
+
+static void stream_run(GAState *s)
+{
+    if (s->stream && !ga_stream_run(s->stream, s->channel)) {
+        stream_stop(s);
+    }
+}
+
+static size_t stream_input(GAState *s, const gchar *buf, size_t len)
+{
+    size_t used;
+
+    if (!s->stream) {
+        return 0;
+    }
+    used = ga_stream_input(s->stream, s->channel, (const uint8_t *)buf, len);
+    stream_run(s);
+    return used;
+}
+#endif
+
 static FILE *ga_open_logfile(const char *logfile)
 {
     FILE *f;
@@ -566,6 +646,21 @@ static void process_event(void *opaque, QObject *obj, Error *err)
 
     g_debug("process_event: called");
     assert(!obj != !err);
+#ifndef _WIN32
+    /*
+     * The channel carries the frames of a stream until it is over.  Hold
+     * back the requests pipelined behind the one that started it, so that
+     * their responses do not end up in the middle of the frames.
+     */
+    if (s->stream) {
+        GARequest *req = g_new0(GARequest, 1);
+
+        req->obj = obj;
+        req->err = err;
+        g_queue_push_tail(&s->held_requests, req);
+        return;
+    }
+#endif
     if (err) {
         rsp = qmp_error_response(err);
         goto end;
@@ -581,6 +676,9 @@ end:
     }
     qobject_unref(rsp);
     qobject_unref(obj);
+#ifndef _WIN32
+    stream_run(s);
+#endif
 }
 
 /* false return signals GAChannel to close the current client connection */
@@ -588,7 +686,7 @@ static gboolean channel_event_cb(GIOCondition condition, gpointer data)
 {
     GAState *s = data;
     gchar buf[QGA_READ_COUNT_DEFAULT+1];
-    gsize count;
+    gsize count, used = 0;
     GIOStatus status = ga_channel_read(s->channel, buf, QGA_READ_COUNT_DEFAULT, &count);
     switch (status) {
     case G_IO_STATUS_ERROR:
@@ -596,12 +694,22 @@ static gboolean channel_event_cb(GIOCondition condition, gpointer data)
         stop_agent(s, false);
         return false;
     case G_IO_STATUS_NORMAL:
-        buf[count] = 0;
-        g_debug("read data, count: %d, data: %s", (int)count, buf);
-        json_message_parser_feed(&s->parser, (char *)buf, (int)count);
+#ifndef _WIN32
+        used = stream_input(s, buf, count);
+#endif
+        if (used < count) {
+            buf[count] = 0;
+            g_debug("read data, count: %d, data: %s", (int)(count - used),
+                    buf + used);
+            json_message_parser_feed(&s->parser, buf + used,
+                                     (int)(count - used));
+        }
         break;
     case G_IO_STATUS_EOF:
         g_debug("received EOF");
+#ifndef _WIN32
+        stream_abort(s);
+#endif
         if (!s->virtio) {
             return false;
         }
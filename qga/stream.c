@@ -0,0 +1,290 @@
+/*
+ * QEMU Guest Agent binary file streams
+ *
+ * guest-file-read and guest-file-write carry the data as base64 inside
+ * JSON, which inflates it by a third and costs a JSON round trip per
+ * chunk.  A stream instead takes over the channel once its command has
+ * been answered, and moves the file as length-prefixed binary frames,
+ * with a window of frames in flight so that the host and the agent
+ * work at the same time.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <zlib.h>
+#include "qemu/bswap.h"
+#include "stream.h"
+
+struct GAStream {
+    int fd;
+    off_t offset;
+    bool writing;           /* frames come from the host */
+    bool compress;
+    bool failed;            /* writing: error sent, drain until END */
+    bool eof;               /* reading: END once all frames are acked */
+    char *error;            /* reading: sent instead of END */
+    bool finished;
+    size_t chunk_size;
+    unsigned window;
+    unsigned in_flight;     /* reading: data frames not acknowledged */
+    uint64_t total;
+
+    /* Frames are built, or received, behind QGA_STREAM_HDR_SIZE bytes */
+    uint8_t *buf;
+    uint8_t *zbuf;
+    size_t zbuf_size;
+
+    /* writing: frame being received */
+    uint8_t hdr[QGA_STREAM_HDR_SIZE];
+    size_t hdr_len;
+    size_t frame_len;
+    size_t frame_pos;
+};
+
+GAStream *ga_stream_new(int fd, off_t offset, bool writing,
+                        size_t chunk_size, unsigned window, bool compress)
+{
+    GAStream *st = g_new0(GAStream, 1);
+
+    st->fd = fd;
+    st->offset = offset;
+    st->writing = writing;
+    st->compress = compress;
+    st->chunk_size = chunk_size;
+    st->window = window;
+    st->buf = g_malloc(QGA_STREAM_HDR_SIZE + chunk_size);
+    /* the host may compress any frame it sends */
+    if (compress || writing) {
+        st->zbuf_size = compressBound(chunk_size);
+        st->zbuf = g_malloc(QGA_STREAM_HDR_SIZE + st->zbuf_size);
+    }
+    return st;
+}
+
+void ga_stream_free(GAStream *st)
+{
+    close(st->fd);
+    g_free(st->error);
+    g_free(st->buf);
+    g_free(st->zbuf);
+    g_free(st);
+}
+
+static void stream_send(GAStream *st, GAChannel *c, uint8_t *frame,
+                        uint8_t type, uint8_t flags, size_t len)
+{
+    frame[0] = type;
+    frame[1] = flags;
+    frame[2] = frame[3] = 0;
+    stl_be_p(frame + 4, len);
+    if (ga_channel_write_all(c, (gchar *)frame,
+                             QGA_STREAM_HDR_SIZE + len) != G_IO_STATUS_NORMAL) {
+        /* nobody to talk to any more */
+        st->finished = true;
+    }
+}
+
+static void stream_end(GAStream *st, GAChannel *c)
+{
+    uint8_t frame[QGA_STREAM_HDR_SIZE + 8];
+
+    stq_be_p(frame + QGA_STREAM_HDR_SIZE, st->total);
+    stream_send(st, c, frame, QGA_STREAM_END, 0, 8);
+    st->finished = true;
+}
+
+static void stream_send_error(GAStream *st, GAChannel *c, const char *msg)
+{
+    size_t len = strlen(msg);
+    uint8_t *frame = g_malloc(QGA_STREAM_HDR_SIZE + len);
+
+    slog("guest-file-stream failed: %s", msg);
+    memcpy(frame + QGA_STREAM_HDR_SIZE, msg, len);
+    stream_send(st, c, frame, QGA_STREAM_ERROR, 0, len);
+    g_free(frame);
+}
+
+static void GCC_FMT_ATTR(3, 4) stream_error(GAStream *st, GAChannel *c,
+                                            const char *fmt, ...)
+{
+    va_list ap;
+    char *msg;
+
+    va_start(ap, fmt);
+    msg = g_strdup_vprintf(fmt, ap);
+    va_end(ap);
+    stream_send_error(st, c, msg);
+    g_free(msg);
+}
+
+/* Read the next chunk of the file straight behind a frame header */
+static void stream_send_chunk(GAStream *st, GAChannel *c)
+{
+    uint8_t *data = st->buf + QGA_STREAM_HDR_SIZE;
+    uLongf zlen = st->zbuf_size;
+    ssize_t n;
+
+    do {
+        n = pread(st->fd, data, st->chunk_size, st->offset);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        st->error = g_strdup_printf("failed to read file: %s",
+                                    strerror(errno));
+        st->eof = true;
+        return;
+    }
+    if (n == 0) {
+        st->eof = true;
+        return;
+    }
+    st->offset += n;
+    st->total += n;
+    st->in_flight++;
+
+    if (st->compress &&
+        compress2(st->zbuf + QGA_STREAM_HDR_SIZE, &zlen, data, n,
+                  Z_BEST_SPEED) == Z_OK && zlen < n) {
+        stream_send(st, c, st->zbuf, QGA_STREAM_DATA, QGA_STREAM_F_ZLIB, zlen);
+    } else {
+        stream_send(st, c, st->buf, QGA_STREAM_DATA, 0, n);
+    }
+}
+
+bool ga_stream_run(GAStream *st, GAChannel *c)
+{
+    if (st->writing) {
+        return !st->finished;
+    }
+    while (!st->finished && !st->eof && st->in_flight < st->window) {
+        stream_send_chunk(st, c);
+    }
+    /* wait for the last ACKs, so that none of them is left for JSON */
+    if (!st->finished && st->eof && !st->in_flight) {
+        if (st->error) {
+            stream_send_error(st, c, st->error);
+            st->finished = true;
+        } else {
+            stream_end(st, c);
+        }
+    }
+    return !st->finished;
+}
+
+static size_t stream_input_acks(GAStream *st, GAChannel *c,
+                                const uint8_t *buf, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len && !st->finished; i++) {
+        if (buf[i] == QGA_STREAM_ACK && st->in_flight) {
+            st->in_flight--;
+        } else if (buf[i] == QGA_STREAM_CANCEL) {
+            stream_end(st, c);
+        } else {
+            /* leave the byte to the JSON parser */
+            stream_error(st, c, "unexpected byte 0x%02x", buf[i]);
+            st->finished = true;
+            break;
+        }
+    }
+    ga_stream_run(st, c);
+    return i;
+}
+
+static void stream_write_frame(GAStream *st, GAChannel *c)
+{
+    uint8_t *data = st->buf + QGA_STREAM_HDR_SIZE;
+    uLongf len = st->frame_len;
+    uint8_t ack = QGA_STREAM_ACK;
+    ssize_t n;
+
+    if (!st->failed && (st->hdr[1] & QGA_STREAM_F_ZLIB)) {
+        len = st->chunk_size;
+        if (uncompress(data, &len, st->zbuf + QGA_STREAM_HDR_SIZE,
+                       st->frame_len) != Z_OK) {
+            stream_error(st, c, "invalid compressed frame");
+            st->failed = true;
+        }
+    }
+    while (!st->failed && len) {
+        n = pwrite(st->fd, data, len, st->offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            stream_error(st, c, "failed to write file: %s",
+                         n < 0 ? strerror(errno) : "no space left");
+            st->failed = true;
+            break;
+        }
+        data += n;
+        len -= n;
+        st->offset += n;
+        st->total += n;
+    }
+
+    if (ga_channel_write_all(c, (gchar *)&ack, 1) != G_IO_STATUS_NORMAL) {
+        st->finished = true;
+    }
+}
+
+static size_t stream_input_frames(GAStream *st, GAChannel *c,
+                                  const uint8_t *buf, size_t len)
+{
+    size_t used = 0, n;
+    uint8_t *dst;
+
+    while (used < len && !st->finished) {
+        if (st->hdr_len < QGA_STREAM_HDR_SIZE) {
+            n = MIN(QGA_STREAM_HDR_SIZE - st->hdr_len, len - used);
+            memcpy(st->hdr + st->hdr_len, buf + used, n);
+            st->hdr_len += n;
+            used += n;
+            if (st->hdr_len < QGA_STREAM_HDR_SIZE) {
+                break;
+            }
+
+            st->frame_len = ldl_be_p(st->hdr + 4);
+            st->frame_pos = 0;
+            if (st->hdr[0] == QGA_STREAM_END && st->frame_len == 0) {
+                if (st->failed) {
+                    st->finished = true;
+                } else {
+                    stream_end(st, c);
+                }
+                break;
+            }
+            if (st->hdr[0] != QGA_STREAM_DATA ||
+                (st->hdr[1] & ~QGA_STREAM_F_ZLIB) ||
+                st->frame_len > ((st->hdr[1] & QGA_STREAM_F_ZLIB) ?
+                                 st->zbuf_size : st->chunk_size)) {
+                /* cannot tell where the next frame starts */
+                stream_error(st, c, "invalid frame");
+                st->finished = true;
+                break;
+            }
+        }
+
+        dst = (st->hdr[1] & QGA_STREAM_F_ZLIB) ? st->zbuf : st->buf;
+        n = MIN(st->frame_len - st->frame_pos, len - used);
+        memcpy(dst + QGA_STREAM_HDR_SIZE + st->frame_pos, buf + used, n);
+        st->frame_pos += n;
+        used += n;
+        if (st->frame_pos == st->frame_len) {
+            stream_write_frame(st, c);
+            st->hdr_len = 0;
+        }
+    }
+    return used;
+}
+
+size_t ga_stream_input(GAStream *st, GAChannel *c,
+                       const uint8_t *buf, size_t len)
+{
+    if (st->writing) {
+        return stream_input_frames(st, c, buf, len);
+    }
+    return stream_input_acks(st, c, buf, len);
+}
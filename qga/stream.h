@@ -0,0 +1,36 @@
+/*
+ * QEMU Guest Agent binary file streams
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef QGA_STREAM_H
+#define QGA_STREAM_H
+
+#include "channel.h"
+#include "guest-agent-core.h"
+
+/* Frame format, see guest-file-stream-read in qapi-schema.json */
+#define QGA_STREAM_HDR_SIZE         8
+#define QGA_STREAM_DATA             1
+#define QGA_STREAM_END              2
+#define QGA_STREAM_ERROR            3
+#define QGA_STREAM_F_ZLIB           1
+#define QGA_STREAM_ACK              0x06
+#define QGA_STREAM_CANCEL           0x18
+
+#define QGA_STREAM_CHUNK_DEFAULT    (64 * 1024)
+#define QGA_STREAM_CHUNK_MAX        (4 * 1024 * 1024)
+#define QGA_STREAM_WINDOW_DEFAULT   8
+#define QGA_STREAM_WINDOW_MAX       64
+
+GAStream *ga_stream_new(int fd, off_t offset, bool writing,
+                        size_t chunk_size, unsigned window, bool compress);
+void ga_stream_free(GAStream *st);
+/* Returns false once the stream is over and can be freed */
+bool ga_stream_run(GAStream *st, GAChannel *c);
+/* Returns how many bytes of @buf belong to the stream */
+size_t ga_stream_input(GAStream *st, GAChannel *c,
+                       const uint8_t *buf, size_t len);
+
+#endif
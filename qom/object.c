@@ -30,6 +30,7 @@
 #include "qapi/qmp/qnum.h"
 #include "qapi/qmp/qstring.h"
 #include "qemu/error-report.h"
+#include "qemu/rcu.h"
 
 #define MAX_INTERFACES 32
 
@@ -270,6 +271,33 @@ static void object_property_free(gpointer data)
     g_free(prop);
 }
 
+/*
+ * The properties of a class and of all its ancestors, so that a lookup
+ * is a single hash table lookup instead of one per level of the class
+ * hierarchy.  The tables are built on the first lookup, and rebuilt
+ * after class properties were added anywhere, which is rare once the
+ * classes are initialized.  They are freed with RCU, as lookups can
+ * happen outside the BQL.
+ */
+struct ObjectPropertyTable {
+    struct rcu_head rcu;
+    GHashTable *props;
+    unsigned int gen;
+};
+
+/* Bumped by object_class_property_add(), starts at 1 to never match NULL */
+static unsigned int class_properties_gen = 1;
+
+/*
+ * A result of object_class_dynamic_cast().  The entries are filled
+ * once and never replaced, so that readers need no lock; classes are
+ * never freed.
+ */
+struct ObjectCastCacheEntry {
+    TypeImpl *target_type;
+    ObjectClass *result;
+};
+
 static void type_initialize(TypeImpl *ti)
 {
     TypeImpl *parent;
@@ -305,6 +333,9 @@ static void type_initialize(TypeImpl *ti)
         g_assert(parent->class_size <= ti->class_size);
         memcpy(ti->class, parent->class, parent->class_size);
         ti->class->interfaces = NULL;
+        memset(ti->class->dynamic_cast_cache, 0,
+               sizeof(ti->class->dynamic_cast_cache));
+        ti->class->properties_flat = NULL;
         ti->class->properties = g_hash_table_new_full(
             g_str_hash, g_str_equal, g_free, object_property_free);
 
@@ -806,12 +837,30 @@ out:
     return obj;
 }
 
+static void object_class_dynamic_cast_cache_add(ObjectClass *class,
+                                                TypeImpl *target_type,
+                                                ObjectClass *result)
+{
+    ObjectCastCacheEntry *entry = g_new(ObjectCastCacheEntry, 1);
+    int i;
+
+    entry->target_type = target_type;
+    entry->result = result;
+    for (i = 0; i < OBJECT_CLASS_DYNAMIC_CAST_CACHE; i++) {
+        if (!atomic_cmpxchg(&class->dynamic_cast_cache[i], NULL, entry)) {
+            return;
+        }
+    }
+    g_free(entry);
+}
+
 ObjectClass *object_class_dynamic_cast(ObjectClass *class,
                                        const char *typename)
 {
     ObjectClass *ret = NULL;
     TypeImpl *target_type;
     TypeImpl *type;
+    int i;
 
     if (!class) {
         return NULL;
@@ -829,6 +878,23 @@ ObjectClass *object_class_dynamic_cast(ObjectClass *class,
         return NULL;
     }
 
+    /*
+     * Types are never unregistered, so the cache is keyed on the target
+     * type rather than on the name, which callers may free afterwards.
+     * Failed casts are cached too, they are as frequent.
+     */
+    for (i = 0; i < OBJECT_CLASS_DYNAMIC_CAST_CACHE; i++) {
+        ObjectCastCacheEntry *entry =
+            atomic_rcu_read(&class->dynamic_cast_cache[i]);
+
+        if (!entry) {
+            break;
+        }
+        if (entry->target_type == target_type) {
+            return entry->result;
+        }
+    }
+
     if (type->class->interfaces &&
             type_is_ancestor(target_type, type_interface)) {
         int found = 0;
@@ -851,6 +917,7 @@ ObjectClass *object_class_dynamic_cast(ObjectClass *class,
         ret = class;
     }
 
+    object_class_dynamic_cast_cache_add(class, target_type, ret);
     return ret;
 }
 
@@ -1126,6 +1193,17 @@ object_property_add(Object *obj, const char *name, const char *type,
     return prop;
 }
 
+static ObjectProperty *object_class_property_lookup(ObjectClass *klass,
+                                                    const char *name)
+{
+    ObjectProperty *prop = NULL;
+
+    for (; klass && !prop; klass = object_class_get_parent(klass)) {
+        prop = g_hash_table_lookup(klass->properties, name);
+    }
+    return prop;
+}
+
 ObjectProperty *
 object_class_property_add(ObjectClass *klass,
                           const char *name,
@@ -1138,7 +1216,11 @@ object_class_property_add(ObjectClass *klass,
 {
     ObjectProperty *prop;
 
-    if (object_class_property_find(klass, name, NULL) != NULL) {
+    /*
+     * Not object_class_property_find(): each property that class_init
+     * adds would rebuild the flattened table.
+     */
+    if (object_class_property_lookup(klass, name) != NULL) {
         error_setg(errp, "attempt to add duplicate property '%s'"
                    " to object (type '%s')", name,
                    object_class_get_name(klass));
@@ -1156,6 +1238,7 @@ object_class_property_add(ObjectClass *klass,
     prop->opaque = opaque;
 
     g_hash_table_insert(klass->properties, g_strdup(name), prop);
+    atomic_inc(&class_properties_gen);
 
     return prop;
 }
@@ -1207,21 +1290,58 @@ void object_class_property_iter_init(ObjectPropertyIterator *iter,
     iter->nextclass = object_class_get_parent(klass);
 }
 
-ObjectProperty *object_class_property_find(ObjectClass *klass, const char *name,
-                                           Error **errp)
+static void object_property_table_free(ObjectPropertyTable *table)
 {
-    ObjectProperty *prop;
-    ObjectClass *parent_klass;
+    g_hash_table_unref(table->props);
+    g_free(table);
+}
+
+/* Called within an RCU critical section */
+static ObjectPropertyTable *object_class_property_table(ObjectClass *klass)
+{
+    unsigned int gen = atomic_read(&class_properties_gen);
+    ObjectPropertyTable *table = atomic_rcu_read(&klass->properties_flat);
+    ObjectPropertyTable *old;
+    ObjectClass *k;
 
-    parent_klass = object_class_get_parent(klass);
-    if (parent_klass) {
-        prop = object_class_property_find(parent_klass, name, NULL);
-        if (prop) {
-            return prop;
+    if (table && table->gen == gen) {
+        return table;
+    }
+
+    old = table;
+    table = g_new(ObjectPropertyTable, 1);
+    table->props = g_hash_table_new(g_str_hash, g_str_equal);
+    table->gen = gen;
+    for (k = klass; k; k = object_class_get_parent(k)) {
+        GHashTableIter iter;
+        gpointer key, value;
+
+        /* The keys belong to the class tables, which are never freed */
+        g_hash_table_iter_init(&iter, k->properties);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+            g_hash_table_insert(table->props, key, value);
         }
     }
 
-    prop = g_hash_table_lookup(klass->properties, name);
+    if (atomic_cmpxchg(&klass->properties_flat, old, table) != old) {
+        /* Another thread rebuilt it first, its table is as good */
+        object_property_table_free(table);
+        return atomic_rcu_read(&klass->properties_flat);
+    }
+    if (old) {
+        call_rcu(old, object_property_table_free, rcu);
+    }
+    return table;
+}
+
+ObjectProperty *object_class_property_find(ObjectClass *klass, const char *name,
+                                           Error **errp)
+{
+    ObjectProperty *prop;
+
+    rcu_read_lock();
+    prop = g_hash_table_lookup(object_class_property_table(klass)->props, name);
+    rcu_read_unlock();
     if (!prop) {
         error_setg(errp, "Property '.%s' not found", name);
     }
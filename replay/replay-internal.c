@@ -15,6 +15,7 @@
 #include "replay-internal.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
+#include "qemu/bswap.h"
 
 /* Mutex to protect reading and writing events to the log.
    data_kind and has_unread_data are also protected
@@ -41,6 +42,36 @@ static void replay_read_error(void)
     exit(1);
 }
 
+/*
+ * Multi-byte values are stored big-endian.  Write them with a single
+ * stdio call rather than one putc() (and one FILE lock) per byte.
+ */
+static void replay_put_buf(const void *buf, size_t size)
+{
+    if (replay_file) {
+        if (fwrite(buf, 1, size, replay_file) != size) {
+            replay_write_error();
+        }
+    }
+}
+
+/*
+ * A short read leaves zeroes behind, and stops the VM as the end of the
+ * replay file or a read error does anywhere else.
+ */
+static void replay_get_buf(void *buf, size_t size)
+{
+    size_t done;
+
+    if (replay_file) {
+        done = fread(buf, 1, size, replay_file);
+        if (done != size) {
+            memset((uint8_t *)buf + done, 0, size - done);
+            replay_check_error();
+        }
+    }
+}
+
 void replay_put_byte(uint8_t byte)
 {
     if (replay_file) {
@@ -59,29 +90,33 @@ void replay_put_event(uint8_t event)
 
 void replay_put_word(uint16_t word)
 {
-    replay_put_byte(word >> 8);
-    replay_put_byte(word);
+    uint8_t buf[2];
+
+    stw_be_p(buf, word);
+    replay_put_buf(buf, sizeof(buf));
 }
 
 void replay_put_dword(uint32_t dword)
 {
-    replay_put_word(dword >> 16);
-    replay_put_word(dword);
+    uint8_t buf[4];
+
+    stl_be_p(buf, dword);
+    replay_put_buf(buf, sizeof(buf));
 }
 
 void replay_put_qword(int64_t qword)
 {
-    replay_put_dword(qword >> 32);
-    replay_put_dword(qword);
+    uint8_t buf[8];
+
+    stq_be_p(buf, qword);
+    replay_put_buf(buf, sizeof(buf));
 }
 
 void replay_put_array(const uint8_t *buf, size_t size)
 {
     if (replay_file) {
         replay_put_dword(size);
-        if (fwrite(buf, 1, size, replay_file) != size) {
-            replay_write_error();
-        }
+        replay_put_buf(buf, size);
     }
 }
 
@@ -100,44 +135,33 @@ uint8_t replay_get_byte(void)
 
 uint16_t replay_get_word(void)
 {
-    uint16_t word = 0;
-    if (replay_file) {
-        word = replay_get_byte();
-        word = (word << 8) + replay_get_byte();
-    }
+    uint8_t buf[2] = { 0 };
 
-    return word;
+    replay_get_buf(buf, sizeof(buf));
+    return lduw_be_p(buf);
 }
 
 uint32_t replay_get_dword(void)
 {
-    uint32_t dword = 0;
-    if (replay_file) {
-        dword = replay_get_word();
-        dword = (dword << 16) + replay_get_word();
-    }
+    uint8_t buf[4] = { 0 };
 
-    return dword;
+    replay_get_buf(buf, sizeof(buf));
+    return ldl_be_p(buf);
 }
 
 int64_t replay_get_qword(void)
 {
-    int64_t qword = 0;
-    if (replay_file) {
-        qword = replay_get_dword();
-        qword = (qword << 32) + replay_get_dword();
-    }
+    uint8_t buf[8] = { 0 };
 
-    return qword;
+    replay_get_buf(buf, sizeof(buf));
+    return ldq_be_p(buf);
 }
 
 void replay_get_array(uint8_t *buf, size_t *size)
 {
     if (replay_file) {
         *size = replay_get_dword();
-        if (fread(buf, 1, *size, replay_file) != *size) {
-            replay_read_error();
-        }
+        replay_get_buf(buf, *size);
     }
 }
 
@@ -146,9 +170,7 @@ void replay_get_array_alloc(uint8_t **buf, size_t *size)
     if (replay_file) {
         *size = replay_get_dword();
         *buf = g_malloc(*size);
-        if (fread(*buf, 1, *size, replay_file) != *size) {
-            replay_read_error();
-        }
+        replay_get_buf(*buf, *size);
     }
 }
 
@@ -25,6 +25,7 @@
 #define REPLAY_VERSION              0xe02008
 /* Size of replay log header */
 #define HEADER_SIZE                 (sizeof(uint32_t) + sizeof(uint64_t))
+#define REPLAY_FILE_BUFFER_SIZE     (1 << 20)
 
 ReplayMode replay_mode = REPLAY_MODE_NONE;
 char *replay_snapshot;
@@ -267,6 +268,8 @@ static void replay_enable(const char *fname, int mode)
         fprintf(stderr, "Replay: open %s: %s\n", fname, strerror(errno));
         exit(1);
     }
+    /* Events are small and frequent; batch them into large writes */
+    setvbuf(replay_file, NULL, _IOFBF, REPLAY_FILE_BUFFER_SIZE);
 
     replay_filename = g_strdup(fname);
     replay_mode = mode;
@@ -25,7 +25,7 @@ def gen_command_decl(name, arg_type, boxed, ret_type):
                  params=build_params(arg_type, boxed, 'Error **errp'))
 
 
-def gen_call(name, arg_type, boxed, ret_type):
+def gen_call(name, arg_type, boxed, ret_type, success_response):
     ret = ''
 
     argstr = ''
@@ -54,27 +54,27 @@ def gen_call(name, arg_type, boxed, ret_type):
         goto out;
     }
 
-    qmp_marshal_output_%(c_name)s(retval, ret, &err);
+    qmp_marshal_output_%(c_name)s(retval, ret_v, &err);
 ''',
                      c_name=ret_type.c_name())
+    elif success_response:
+        ret += mcgen('''
+    if (!err) {
+        visit_start_struct(ret_v, "return", NULL, 0, NULL);
+        visit_end_struct(ret_v, NULL);
+    }
+''')
     return ret
 
 
 def gen_marshal_output(ret_type):
     return mcgen('''
 
-static void qmp_marshal_output_%(c_name)s(%(c_type)s ret_in, QObject **ret_out, Error **errp)
+static void qmp_marshal_output_%(c_name)s(%(c_type)s ret_in, Visitor *ret_v, Error **errp)
 {
-    Error *err = NULL;
     Visitor *v;
 
-    v = qobject_output_visitor_new(ret_out);
-    visit_type_%(c_name)s(v, "unused", &ret_in, &err);
-    if (!err) {
-        visit_complete(v, ret_out);
-    }
-    error_propagate(errp, err);
-    visit_free(v);
+    visit_type_%(c_name)s(ret_v, "return", &ret_in, errp);
     v = qapi_dealloc_visitor_new();
     visit_type_%(c_name)s(v, "unused", &ret_in, NULL);
     visit_free(v);
@@ -84,7 +84,7 @@ static void qmp_marshal_output_%(c_name)s(%(c_type)s ret_in, QObject **ret_out,
 
 
 def build_marshal_proto(name):
-    return ('void qmp_marshal_%s(QDict *args, QObject **ret, Error **errp)'
+    return ('void qmp_marshal_%s(QDict *args, Visitor *ret_v, Error **errp)'
             % c_name(name))
 
 
@@ -95,7 +95,7 @@ def gen_marshal_decl(name):
                  proto=build_marshal_proto(name))
 
 
-def gen_marshal(name, arg_type, boxed, ret_type):
+def gen_marshal(name, arg_type, boxed, ret_type, success_response):
     have_args = arg_type and not arg_type.is_empty()
 
     ret = mcgen('''
@@ -153,7 +153,7 @@ def gen_marshal(name, arg_type, boxed, ret_type):
     }
 ''')
 
-    ret += gen_call(name, arg_type, boxed, ret_type)
+    ret += gen_call(name, arg_type, boxed, ret_type, success_response)
 
     ret += mcgen('''
 
@@ -251,7 +251,6 @@ class QAPISchemaGenCommandVisitor(QAPISchemaModularCVisitor):
 #include "qemu/osdep.h"
 #include "qapi/visitor.h"
 #include "qapi/qmp/qdict.h"
-#include "qapi/qobject-output-visitor.h"
 #include "qapi/qobject-input-visitor.h"
 #include "qapi/dealloc-visitor.h"
 #include "qapi/error.h"
@@ -292,7 +291,8 @@ void %(c_prefix)sqmp_init_marshal(QmpCommandList *cmds);
         with ifcontext(ifcond, self._genh, self._genc, self._regy):
             self._genh.add(gen_command_decl(name, arg_type, boxed, ret_type))
             self._genh.add(gen_marshal_decl(name))
-            self._genc.add(gen_marshal(name, arg_type, boxed, ret_type))
+            self._genc.add(gen_marshal(name, arg_type, boxed, ret_type,
+                                       success_response))
             self._regy.add(gen_register_command(name, success_response,
                                                 allow_oob, allow_preconfig))
 
@@ -0,0 +1,76 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Convert a simpletrace log into the Chrome trace event format
+#
+# The output can be loaded into chrome://tracing or Perfetto to get a
+# timeline of the boot phases of a machine.  Every trace event becomes
+# an instant event; *_begin/*_end pairs become duration events and the
+# memory_region_ops_read/write events are folded into per-region counts
+# so that a trace with memory tracing enabled stays loadable.
+#
+# Usage: simpletrace-chrome.py trace-events-all trace-file > boot.json
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+
+from __future__ import print_function
+import json
+import simpletrace
+
+class ChromeTraceConverter(simpletrace.Analyzer):
+    "A simpletrace Analyzer emitting Chrome trace events."
+
+    def begin(self):
+        self.events = []
+        self.mmio = {}
+        self.last_ts = 0
+
+    def _event(self, name, ph, ts, pid, args):
+        ev = {"name": name, "ph": ph, "ts": ts / 1000.0,
+              "pid": pid, "tid": pid, "args": args}
+        if ph == "i":
+            ev["s"] = "p"
+        self.events.append(ev)
+
+    def _mmio(self, kind, mr, size):
+        key = (mr, kind)
+        count, nbytes = self.mmio.get(key, (0, 0))
+        self.mmio[key] = (count + 1, nbytes + size)
+
+    def catchall(self, event, rec):
+        name, ts, pid = event.name, rec[1], rec[2]
+        self.last_ts = max(self.last_ts, ts)
+
+        if name in ("memory_region_ops_read", "memory_region_ops_write"):
+            args = dict(zip([a[1] for a in event.args], rec[3:]))
+            self._mmio(name[len("memory_region_ops_"):], args["mr"],
+                       args["size"])
+            return
+
+        args = {}
+        for i, (_, argname) in enumerate(event.args):
+            val = rec[3 + i]
+            if isinstance(val, bytes):
+                val = val.decode("utf-8", "replace")
+            args[argname] = val
+
+        if name.endswith("_begin"):
+            self._event(name[:-len("_begin")], "B", ts, pid, args)
+        elif name.endswith("_end"):
+            self._event(name[:-len("_end")], "E", ts, pid, args)
+        else:
+            self._event(name, "i", ts, pid, args)
+
+    def end(self):
+        summary = {}
+        for (mr, kind), (count, nbytes) in sorted(self.mmio.items()):
+            summary["%#x %s" % (mr, kind)] = "%d accesses, %d bytes" % \
+                                             (count, nbytes)
+        if summary:
+            self._event("mmio_summary", "i", self.last_ts, 0, summary)
+        print(json.dumps({"traceEvents": self.events,
+                          "displayTimeUnit": "ms"}, indent=1))
+
+if __name__ == '__main__':
+    simpletrace.run(ChromeTraceConverter())
@@ -12,18 +12,26 @@
 from __future__ import print_function
 import struct
 import inspect
+import heapq
+import io
 from tracetool import read_events, Event
 from tracetool.backend.simple import is_string
 
 header_event_id = 0xffffffffffffffff
 header_magic    = 0xf2b177cb0aa429b4
 dropped_event_id = 0xfffffffffffffffe
+dropped_event_id_v5 = 0xfffffffe
+delta_absolute = 0xffffffff
 
 record_type_mapping = 0
 record_type_event = 1
+record_type_chunk = 2
+record_type_round = 3
 
 log_header_fmt = '=QQQ'
 rec_header_fmt = '=QQII'
+chunk_header_fmt = '=IIQ'
+compact_rec_header_fmt = '=III'
 
 def read_header(fobj, hfmt):
     '''Read a trace record header'''
@@ -33,38 +41,59 @@ def read_header(fobj, hfmt):
         return None
     return struct.unpack(hfmt, hdr)
 
+def get_args(edict, idtoname, event_id, rec, fobj):
+    """Deserialize the arguments of a trace record and append them to the
+       tuple rec."""
+    if event_id in (dropped_event_id, dropped_event_id_v5):
+        rec = ("dropped",) + rec
+        (value,) = struct.unpack('=Q', fobj.read(8))
+        return rec + (value,)
+
+    name = idtoname[event_id]
+    rec = (name,) + rec
+    try:
+        event = edict[name]
+    except KeyError as e:
+        import sys
+        sys.stderr.write('%s event is logged but is not declared ' \
+                         'in the trace events file, try using ' \
+                         'trace-events-all instead.\n' % str(e))
+        sys.exit(1)
+
+    for type, name in event.args:
+        if is_string(type):
+            l = fobj.read(4)
+            (len,) = struct.unpack('=L', l)
+            s = fobj.read(len)
+            rec = rec + (s,)
+        else:
+            (value,) = struct.unpack('=Q', fobj.read(8))
+            rec = rec + (value,)
+    return rec
+
 def get_record(edict, idtoname, rechdr, fobj):
     """Deserialize a trace record from a file into a tuple
        (name, timestamp, pid, arg1, ..., arg6)."""
     if rechdr is None:
         return None
-    if rechdr[0] != dropped_event_id:
-        event_id = rechdr[0]
-        name = idtoname[event_id]
-        rec = (name, rechdr[1], rechdr[3])
-        try:
-            event = edict[name]
-        except KeyError as e:
-            import sys
-            sys.stderr.write('%s event is logged but is not declared ' \
-                             'in the trace events file, try using ' \
-                             'trace-events-all instead.\n' % str(e))
-            sys.exit(1)
-
-        for type, name in event.args:
-            if is_string(type):
-                l = fobj.read(4)
-                (len,) = struct.unpack('=L', l)
-                s = fobj.read(len)
-                rec = rec + (s,)
-            else:
-                (value,) = struct.unpack('=Q', fobj.read(8))
-                rec = rec + (value,)
-    else:
-        rec = ("dropped", rechdr[1], rechdr[3])
-        (value,) = struct.unpack('=Q', fobj.read(8))
-        rec = rec + (value,)
-    return rec
+    return get_args(edict, idtoname, rechdr[0], (rechdr[1], rechdr[3]), fobj)
+
+def get_chunk(edict, idtoname, last_timestamp, fobj):
+    """Deserialize the records in a chunk of one thread's trace buffer,
+       yielding record tuples (name, timestamp, pid, arg1, ..., arg6).
+
+    Timestamps are relative to the previous record of the same thread,
+    which is looked up and updated in last_timestamp."""
+    pid, tid, length = read_header(fobj, chunk_header_fmt)
+    chunk = io.BytesIO(fobj.read(length))
+    while chunk.tell() < length:
+        event_id, reclen, delta = read_header(chunk, compact_rec_header_fmt)
+        if delta == delta_absolute:
+            (timestamp,) = struct.unpack('=Q', chunk.read(8))
+        else:
+            timestamp = last_timestamp[(pid, tid)] + delta
+        last_timestamp[(pid, tid)] = timestamp
+        yield get_args(edict, idtoname, event_id, (timestamp, pid), chunk)
 
 def get_mapping(fobj):
     (event_id, ) = struct.unpack('=Q', fobj.read(8))
@@ -91,9 +120,9 @@ def read_trace_header(fobj):
                          (header[1], header_magic))
 
     log_version = header[2]
-    if log_version not in [0, 2, 3, 4]:
+    if log_version not in [0, 2, 3, 4, 5]:
         raise ValueError('Unknown version of tracelog format!')
-    if log_version != 4:
+    if log_version not in [4, 5]:
         raise ValueError('Log format %d not supported with this QEMU release!'
                          % log_version)
 
@@ -102,12 +131,22 @@ def read_trace_records(edict, idtoname, fobj):
 
     Note that `idtoname` is modified if the file contains mapping records.
 
+    The per-thread chunks of a version 5 file are merged into timestamp
+    order.  A writeout round only holds records finished after the previous
+    round started, so when a round begins everything older than the start of
+    the previous one can be yielded.
+
     Args:
         edict (str -> Event): events dict, indexed by name
         idtoname (int -> str): event names dict, indexed by event ID
         fobj (file): input file
 
     """
+    last_timestamp = {}
+    pending = []
+    seq = 0
+    horizon = None
+
     while True:
         t = fobj.read(8)
         if len(t) == 0:
@@ -117,11 +156,24 @@ def read_trace_records(edict, idtoname, fobj):
         if rectype == record_type_mapping:
             event_id, name = get_mapping(fobj)
             idtoname[event_id] = name
+        elif rectype == record_type_chunk:
+            for rec in get_chunk(edict, idtoname, last_timestamp, fobj):
+                # seq keeps the heap stable and off the tuples' contents
+                heapq.heappush(pending, (rec[1], seq, rec))
+                seq += 1
+        elif rectype == record_type_round:
+            (timestamp, ) = struct.unpack('=Q', fobj.read(8))
+            while pending and horizon is not None and pending[0][0] < horizon:
+                yield heapq.heappop(pending)[2]
+            horizon = timestamp
         else:
             rec = read_record(edict, idtoname, fobj)
 
             yield rec
 
+    while pending:
+        yield heapq.heappop(pending)[2]
+
 class Analyzer(object):
     """A trace file analyzer which processes trace records.
 
@@ -0,0 +1,132 @@
+#!/usr/bin/env python
+#
+# Run the AArch64 TLB and memory subsystem benchmark
+#
+# Boots tests/tcg/aarch64/system/tlb-bench (tlb-bench-raspi on the raspi
+# machines) once per benchmark, and adds to the times measured by the
+# guest the wall time of the run and the TLB flushes that QEMU counted,
+# as shown by "info jit".
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or
+# later.  See the COPYING file in the top-level directory.
+#
+
+import os
+import re
+import sys
+import time
+import shutil
+import argparse
+import tempfile
+
+sys.path.append(os.path.join(os.path.dirname(__file__), '..', 'python'))
+from qemu.machine import QEMUMachine
+
+BENCHMARKS = ['tlb-hit', 'tlb-miss', 'tlbi-page', 'tlbi-is',
+              'mmio-read', 'mmio-write', 'smc']
+
+MACHINES = {
+    'virt': {'args': ['-cpu', 'max'], 'uart': 0x09000000},
+    'raspi3': {'args': [], 'uart': 0x3f201000},
+    'raspi4': {'args': [], 'uart': 0xfe201000},
+}
+
+FLUSH_COUNTS = [('full', 'TLB full flushes'),
+                ('partial', 'TLB partial flushes'),
+                ('elided', 'TLB elided flushes')]
+
+
+def wait_for_result(path, bench, timeout):
+    deadline = time.time() + timeout
+    while time.time() < deadline:
+        if os.path.exists(path):
+            with open(path) as f:
+                lines = f.read().splitlines()
+            if 'tlb-bench,done' in lines:
+                break
+            if 'tlb-bench,failed' in lines:
+                raise Exception('%s failed:\n%s' % (bench, '\n'.join(lines)))
+        time.sleep(0.1)
+    else:
+        raise Exception('%s did not finish in %d seconds' % (bench, timeout))
+
+    for line in lines:
+        fields = line.split(',')
+        if len(fields) == 4 and fields[1] == bench:
+            return int(fields[2]), int(fields[3])
+    raise Exception('no result for %s' % bench)
+
+
+def run_bench(args, bench, tmpdir):
+    machine = MACHINES[args.machine]
+    out = os.path.join(tmpdir, 'tlb-bench.out')
+    if os.path.exists(out):
+        os.remove(out)
+    append = 'wait %s iter=%d uart=0x%x' % (bench, args.iter, machine['uart'])
+
+    vm = QEMUMachine(args.qemu, test_dir=tmpdir)
+    vm.set_machine(args.machine)
+    vm.add_args(*machine['args'])
+    if args.smp:
+        vm.add_args('-smp', str(args.smp))
+    vm.add_args('-chardev', 'file,path=%s,id=output' % out,
+                '-semihosting-config',
+                'enable=on,target=native,chardev=output',
+                '-kernel', args.image, '-append', append)
+
+    start = time.time()
+    vm.launch()
+    try:
+        iterations, ns = wait_for_result(out, bench, args.timeout)
+        wall = time.time() - start
+        jit = vm.command('human-monitor-command', command_line='info jit')
+    finally:
+        vm.shutdown()
+
+    result = {'bench': bench, 'iterations': iterations,
+              'ns': float(ns) / iterations, 'wall': wall}
+    for key, label in FLUSH_COUNTS:
+        m = re.search(r'^%s\s+(\d+)' % label, jit, re.MULTILINE)
+        result[key] = int(m.group(1)) if m else -1
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Run the AArch64 TLB and memory subsystem benchmark')
+    parser.add_argument('-M', '--machine', default='virt',
+                        choices=sorted(MACHINES),
+                        help='machine to run on (default: virt)')
+    parser.add_argument('-s', '--smp', type=int,
+                        help='number of CPUs, for tlbi-is')
+    parser.add_argument('-i', '--iter', type=int, default=1,
+                        help='scale the iterations of each benchmark')
+    parser.add_argument('-t', '--timeout', type=int, default=300,
+                        help='seconds to wait for each benchmark')
+    parser.add_argument('qemu', help='qemu-system-aarch64 binary')
+    parser.add_argument('image', help='tlb-bench, or tlb-bench-raspi '
+                        'for the raspi machines')
+    parser.add_argument('bench', nargs='*',
+                        help='benchmarks to run (default: all of %s)' %
+                        ', '.join(BENCHMARKS))
+    args = parser.parse_args()
+    for bench in args.bench:
+        if bench not in BENCHMARKS:
+            parser.error('unknown benchmark %s' % bench)
+
+    tmpdir = tempfile.mkdtemp(prefix='tlb-bench-')
+    try:
+        print('machine,bench,iterations,ns/iter,wall s,'
+              'tlb full,tlb partial,tlb elided')
+        for bench in args.bench or BENCHMARKS:
+            r = run_bench(args, bench, tmpdir)
+            print('%s,%s,%d,%.1f,%.3f,%d,%d,%d' %
+                  (args.machine, bench, r['iterations'], r['ns'], r['wall'],
+                   r['full'], r['partial'], r['elided']))
+            sys.stdout.flush()
+    finally:
+        shutil.rmtree(tmpdir)
+
+
+if __name__ == '__main__':
+    main()
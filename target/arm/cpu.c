@@ -75,10 +75,12 @@ static bool arm_cpu_has_work(CPUState *cs)
     ARMCPU *cpu = ARM_CPU(cs);
 
     return (cpu->power_state != PSCI_OFF)
-        && cs->interrupt_request &
-        (CPU_INTERRUPT_FIQ | CPU_INTERRUPT_HARD
-         | CPU_INTERRUPT_VFIQ | CPU_INTERRUPT_VIRQ
-         | CPU_INTERRUPT_EXITTB);
+        && ((cs->interrupt_request &
+             (CPU_INTERRUPT_FIQ | CPU_INTERRUPT_HARD
+              | CPU_INTERRUPT_VFIQ | CPU_INTERRUPT_VIRQ
+              | CPU_INTERRUPT_EXITTB))
+            || (!cpu->env.halted_in_wfi &&
+                atomic_read(&cpu->env.event_register)));
 }
 
 void arm_register_pre_el_change_hook(ARMCPU *cpu, ARMELChangeHookFn *hook,
@@ -1246,6 +1248,8 @@ static void arm_cpu_realizefn(DeviceState *dev, Error **errp)
                                           arm_gt_htimer_cb, cpu);
     cpu->gt_timer[GTIMER_SEC] = timer_new(QEMU_CLOCK_VIRTUAL, GTIMER_SCALE,
                                           arm_gt_stimer_cb, cpu);
+    cpu->gt_evnt_timer = timer_new(QEMU_CLOCK_VIRTUAL, GTIMER_SCALE,
+                                   arm_gt_evnt_cb, cpu);
 #endif
 
     cpu_exec_realizefn(cs, &local_err);
@@ -2582,6 +2586,7 @@ static Property arm_cpu_properties[] = {
                         mp_affinity, ARM64_AFFINITY_INVALID),
     DEFINE_PROP_INT32("node-id", ARMCPU, node_id, CPU_UNSET_NUMA_NODE_ID),
     DEFINE_PROP_INT32("core-count", ARMCPU, core_count, -1),
+    DEFINE_PROP_UINT32("gt-slack-ns", ARMCPU, gt_slack_ns, 0),
     DEFINE_PROP_END_OF_LIST()
 };
 
@@ -614,6 +614,13 @@ typedef struct CPUARMState {
     uint64_t exclusive_addr;
     uint64_t exclusive_val;
     uint64_t exclusive_high;
+    /* Consecutive store exclusives lost to other CPUs, see exclusive_backoff */
+    uint32_t exclusive_fails;
+
+    /* Event register, set by SEV, SEVL and the generic timer event streams */
+    uint32_t event_register;
+    /* The last halt came from WFI, which events do not end */
+    bool halted_in_wfi;
 
     /* iwMMXt coprocessor state.  */
     struct {
@@ -707,6 +714,44 @@ typedef enum ARMPSCIState {
 
 typedef struct ARMISARegisters ARMISARegisters;
 
+/*
+ * Cache of the LPAE translation tables reached by recent walks, so that
+ * a TLB refill can start at the last level table.  Entries are keyed by
+ * translation regime, base register (and so ASID) and input address,
+ * and are valid until the next TLB flush of the CPU.
+ */
+#define ARM_PTW_CACHE_BITS 4
+
+typedef struct ARMPTWCacheEntry {
+    uint64_t flush_gen;     /* CPUTLBCommon.flush_gen when filled */
+    uint64_t ttbr;          /* base register the walk started from */
+    uint64_t tag;           /* input address bits above the table span */
+    hwaddr table;           /* address of the table */
+    uint8_t *host;          /* the table in host memory, or NULL */
+    uint32_t tableattrs;    /* table attributes gathered on the way */
+    uint8_t mmu_idx;
+    uint8_t select;
+    uint8_t stride;
+    uint8_t level;          /* level of the table, 0 if unused */
+} ARMPTWCacheEntry;
+
+#ifdef TARGET_AARCH64
+/*
+ * Cache of recent QARMA results.  PACIASP and AUTIASP in a function's
+ * prologue and epilogue compute the same PAC, and calls from the same
+ * site with the same stack pointer repeat them.
+ */
+#define ARM_PAC_CACHE_BITS 6
+
+typedef struct ARMPACCacheEntry {
+    uint64_t data;
+    uint64_t modifier;
+    ARMPACKey key;
+    uint64_t pac;
+    bool valid;
+} ARMPACCacheEntry;
+#endif
+
 /**
  * ARMCPU:
  * @env: #CPUARMState
@@ -745,8 +790,23 @@ struct ARMCPU {
 
     DynamicGDBXMLInfo dyn_xml;
 
+    /* Tables at levels 1 to 3 reached by recent page table walks */
+    ARMPTWCacheEntry ptw_cache[3][1 << ARM_PTW_CACHE_BITS];
+
+#ifdef TARGET_AARCH64
+    ARMPACCacheEntry pac_cache[1 << ARM_PAC_CACHE_BITS];
+#endif
+
     /* Timers used by the generic (architected) timer */
     QEMUTimer *gt_timer[NUM_GTIMERS];
+    /*
+     * How much later than programmed (in ns) a generic timer may fire,
+     * rather than re-arming the host timer for a deadline that only moves
+     * a little earlier. 0 means exact.
+     */
+    uint32_t gt_slack_ns;
+    /* Timer for the next event stream event while halted in WFE */
+    QEMUTimer *gt_evnt_timer;
     /*
      * Timer used by the PMU. Its state is restored after migration by
      * pmu_op_finish() - it does not need other handling during migration
@@ -915,6 +975,9 @@ struct ARMCPU {
 
     /* Used to set the maximum vector length the cpu will support.  */
     uint32_t sve_max_vq;
+
+    /* -cpu max: use the IMPDEF pointer authentication algorithm */
+    bool prop_pauth_impdef;
 };
 
 void arm_cpu_post_init(Object *obj);
@@ -3532,6 +3595,11 @@ static inline bool isar_feature_aa64_rndr(const ARMISARegisters *id)
     return FIELD_EX64(id->id_aa64isar0, ID_AA64ISAR0, RNDR) != 0;
 }
 
+static inline bool isar_feature_aa64_tlbirange(const ARMISARegisters *id)
+{
+    return FIELD_EX64(id->id_aa64isar0, ID_AA64ISAR0, TLB) >= 2;
+}
+
 static inline bool isar_feature_aa64_jscvt(const ARMISARegisters *id)
 {
     return FIELD_EX64(id->id_aa64isar1, ID_AA64ISAR1, JSCVT) != 0;
@@ -3545,10 +3613,10 @@ static inline bool isar_feature_aa64_fcma(const ARMISARegisters *id)
 static inline bool isar_feature_aa64_pauth(const ARMISARegisters *id)
 {
     /*
-     * Note that while QEMU will only implement the architected algorithm
-     * QARMA, and thus APA+GPA, the host cpu for kvm may use implementation
-     * defined algorithms, and thus API+GPI, and this predicate controls
-     * migration of the 128-bit keys.
+     * Note that QEMU implements both the architected algorithm QARMA
+     * (APA+GPA) and an implementation defined one (API+GPI), as may the
+     * host cpu for kvm, and this predicate controls migration of the
+     * 128-bit keys.
      */
     return (id->id_aa64isar1 &
             (FIELD_DP64(0, ID_AA64ISAR1, APA, 0xf) |
@@ -3557,6 +3625,15 @@ static inline bool isar_feature_aa64_pauth(const ARMISARegisters *id)
              FIELD_DP64(0, ID_AA64ISAR1, GPI, 0xf))) != 0;
 }
 
+static inline bool isar_feature_aa64_pauth_arch(const ARMISARegisters *id)
+{
+    /*
+     * Return true if pauth is enabled with the architected QARMA algorithm.
+     * QEMU will always set APA+GPA to the same value.
+     */
+    return FIELD_EX64(id->id_aa64isar1, ID_AA64ISAR1, APA) != 0;
+}
+
 static inline bool isar_feature_aa64_sb(const ARMISARegisters *id)
 {
     return FIELD_EX64(id->id_aa64isar1, ID_AA64ISAR1, SB) != 0;
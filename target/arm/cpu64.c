@@ -279,6 +279,31 @@ static void cpu_max_set_sve_vq(Object *obj, Visitor *v, const char *name,
     error_propagate(errp, err);
 }
 
+static bool cpu_max_get_pauth_impdef(Object *obj, Error **errp)
+{
+    ARMCPU *cpu = ARM_CPU(obj);
+
+    return cpu->prop_pauth_impdef;
+}
+
+static void cpu_max_set_pauth_impdef(Object *obj, bool value, Error **errp)
+{
+    ARMCPU *cpu = ARM_CPU(obj);
+    uint64_t t = cpu->isar.id_aa64isar1;
+
+    /*
+     * The IMPDEF algorithm is not QARMA, just a hash of the same inputs,
+     * and much cheaper to emulate.  Advertise it as such, so that the
+     * guest does not expect the architected PACs.
+     */
+    cpu->prop_pauth_impdef = value;
+    t = FIELD_DP64(t, ID_AA64ISAR1, APA, !value);
+    t = FIELD_DP64(t, ID_AA64ISAR1, API, value);
+    t = FIELD_DP64(t, ID_AA64ISAR1, GPA, !value);
+    t = FIELD_DP64(t, ID_AA64ISAR1, GPI, value);
+    cpu->isar.id_aa64isar1 = t;
+}
+
 /* -cpu max: if KVM is enabled, like -cpu host (best possible with this host);
  * otherwise, a CPU with as many features enabled as our emulation supports.
  * The version of '-cpu max' for qemu-system-arm is defined in cpu.c;
@@ -327,6 +352,7 @@ static void aarch64_max_initfn(Object *obj)
         t = FIELD_DP64(t, ID_AA64ISAR0, DP, 1);
         t = FIELD_DP64(t, ID_AA64ISAR0, FHM, 1);
         t = FIELD_DP64(t, ID_AA64ISAR0, TS, 2); /* v8.5-CondM */
+        t = FIELD_DP64(t, ID_AA64ISAR0, TLB, 2); /* ARMv8.4-TLBI range */
         t = FIELD_DP64(t, ID_AA64ISAR0, RNDR, 1);
         cpu->isar.id_aa64isar0 = t;
 
@@ -393,6 +419,9 @@ static void aarch64_max_initfn(Object *obj)
         cpu->sve_max_vq = ARM_MAX_VQ;
         object_property_add(obj, "sve-max-vq", "uint32", cpu_max_get_sve_vq,
                             cpu_max_set_sve_vq, NULL, NULL, &error_fatal);
+        object_property_add_bool(obj, "pauth-impdef",
+                                 cpu_max_get_pauth_impdef,
+                                 cpu_max_set_pauth_impdef, &error_fatal);
     }
 }
 
@@ -29,6 +29,50 @@ union CRYPTO_STATE {
 #define CR_ST_WORD(state, i)   (state.words[i])
 #endif
 
+#ifdef CONFIG_AESNI_OPT
+/*
+ * On x86 hosts with AES-NI, let the host do the rounds.  The AES state
+ * uses the same byte order in a Q register as in an XMM register, and
+ * only little-endian hosts get here, so the vector is used as is.
+ */
+#include "qemu/host-cpuinfo.h"
+
+#pragma GCC push_options
+#pragma GCC target("aes")
+#include <wmmintrin.h>
+
+static void crypto_aese_aesni(void *vd, void *vm, uint32_t decrypt)
+{
+    __m128i st = _mm_xor_si128(_mm_loadu_si128(vd), _mm_loadu_si128(vm));
+
+    /* AESE/AESD are the final round, with the key added up front */
+    if (decrypt) {
+        st = _mm_aesdeclast_si128(st, _mm_setzero_si128());
+    } else {
+        st = _mm_aesenclast_si128(st, _mm_setzero_si128());
+    }
+    _mm_storeu_si128(vd, st);
+}
+
+static void crypto_aesmc_aesni(void *vd, void *vm, uint32_t decrypt)
+{
+    __m128i st = _mm_loadu_si128(vm);
+
+    if (decrypt) {
+        st = _mm_aesimc_si128(st);
+    } else {
+        /*
+         * There is no MixColumns on its own: undo the ShiftRows and
+         * SubBytes that a full encryption round applies before it.
+         */
+        st = _mm_aesdeclast_si128(st, _mm_setzero_si128());
+        st = _mm_aesenc_si128(st, _mm_setzero_si128());
+    }
+    _mm_storeu_si128(vd, st);
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AESNI_OPT */
+
 void HELPER(crypto_aese)(void *vd, void *vm, uint32_t decrypt)
 {
     static uint8_t const * const sbox[2] = { AES_sbox, AES_isbox };
@@ -41,6 +85,13 @@ void HELPER(crypto_aese)(void *vd, void *vm, uint32_t decrypt)
 
     assert(decrypt < 2);
 
+#ifdef CONFIG_AESNI_OPT
+    if (host_cpuinfo & CPUINFO_AES) {
+        crypto_aese_aesni(vd, vm, decrypt);
+        return;
+    }
+#endif
+
     /* xor state vector with round key */
     rk.l[0] ^= st.l[0];
     rk.l[1] ^= st.l[1];
@@ -197,6 +248,13 @@ void HELPER(crypto_aesmc)(void *vd, void *vm, uint32_t decrypt)
 
     assert(decrypt < 2);
 
+#ifdef CONFIG_AESNI_OPT
+    if (host_cpuinfo & CPUINFO_AES) {
+        crypto_aesmc_aesni(vd, vm, decrypt);
+        return;
+    }
+#endif
+
     for (i = 0; i < 16; i += 4) {
         CR_ST_WORD(st, i >> 2) =
             mc[decrypt][CR_ST_BYTE(st, i)] ^
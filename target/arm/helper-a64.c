@@ -210,6 +210,206 @@ uint64_t HELPER(simd_tbl)(CPUARMState *env, uint64_t result, uint64_t indices,
     return result;
 }
 
+/*
+ * AdvSIMD load/store multiple structures with more than one register
+ * per structure (LD2-LD4, ST2-ST4).  Inline these need one qemu_ld/st,
+ * each with its own TLB lookup, per element.  Probe the TLB once and
+ * move the whole block through a host pointer when it lies within a
+ * single page, doing one TLB access per element only when it does not.
+ */
+static void *advsimd_elt_ptr(CPUARMState *env, int reg, int e, int esz)
+{
+    intptr_t off = e << esz;
+#ifdef HOST_WORDS_BIGENDIAN
+    /* See vec_reg_offset() */
+    if (esz < MO_64) {
+        off ^= 8 - (1 << esz);
+    }
+#endif
+    return (uint8_t *)aa64_vfp_qreg(env, reg) + off;
+}
+
+static void advsimd_ld_host(void *elt, void *host, int esz, bool be)
+{
+    switch (esz) {
+    case MO_8:
+        *(uint8_t *)elt = ldub_p(host);
+        break;
+    case MO_16:
+        *(uint16_t *)elt = be ? lduw_be_p(host) : lduw_le_p(host);
+        break;
+    case MO_32:
+        *(uint32_t *)elt = be ? ldl_be_p(host) : ldl_le_p(host);
+        break;
+    default:
+        *(uint64_t *)elt = be ? ldq_be_p(host) : ldq_le_p(host);
+        break;
+    }
+}
+
+static void advsimd_st_host(void *elt, void *host, int esz, bool be)
+{
+    switch (esz) {
+    case MO_8:
+        stb_p(host, *(uint8_t *)elt);
+        break;
+    case MO_16:
+        if (be) {
+            stw_be_p(host, *(uint16_t *)elt);
+        } else {
+            stw_le_p(host, *(uint16_t *)elt);
+        }
+        break;
+    case MO_32:
+        if (be) {
+            stl_be_p(host, *(uint32_t *)elt);
+        } else {
+            stl_le_p(host, *(uint32_t *)elt);
+        }
+        break;
+    default:
+        if (be) {
+            stq_be_p(host, *(uint64_t *)elt);
+        } else {
+            stq_le_p(host, *(uint64_t *)elt);
+        }
+        break;
+    }
+}
+
+#ifdef CONFIG_SOFTMMU
+static void advsimd_ld_tlb(CPUARMState *env, void *elt, target_ulong addr,
+                           TCGMemOpIdx oi, uintptr_t ra)
+{
+    bool be = memop_big_endian(get_memop(oi));
+
+    switch (get_memop(oi) & MO_SIZE) {
+    case MO_8:
+        *(uint8_t *)elt = helper_ret_ldub_mmu(env, addr, oi, ra);
+        break;
+    case MO_16:
+        *(uint16_t *)elt = be ? helper_be_lduw_mmu(env, addr, oi, ra)
+                              : helper_le_lduw_mmu(env, addr, oi, ra);
+        break;
+    case MO_32:
+        *(uint32_t *)elt = be ? helper_be_ldul_mmu(env, addr, oi, ra)
+                              : helper_le_ldul_mmu(env, addr, oi, ra);
+        break;
+    default:
+        *(uint64_t *)elt = be ? helper_be_ldq_mmu(env, addr, oi, ra)
+                              : helper_le_ldq_mmu(env, addr, oi, ra);
+        break;
+    }
+}
+
+static void advsimd_st_tlb(CPUARMState *env, void *elt, target_ulong addr,
+                           TCGMemOpIdx oi, uintptr_t ra)
+{
+    bool be = memop_big_endian(get_memop(oi));
+
+    switch (get_memop(oi) & MO_SIZE) {
+    case MO_8:
+        helper_ret_stb_mmu(env, addr, *(uint8_t *)elt, oi, ra);
+        break;
+    case MO_16:
+        if (be) {
+            helper_be_stw_mmu(env, addr, *(uint16_t *)elt, oi, ra);
+        } else {
+            helper_le_stw_mmu(env, addr, *(uint16_t *)elt, oi, ra);
+        }
+        break;
+    case MO_32:
+        if (be) {
+            helper_be_stl_mmu(env, addr, *(uint32_t *)elt, oi, ra);
+        } else {
+            helper_le_stl_mmu(env, addr, *(uint32_t *)elt, oi, ra);
+        }
+        break;
+    default:
+        if (be) {
+            helper_be_stq_mmu(env, addr, *(uint64_t *)elt, oi, ra);
+        } else {
+            helper_le_stq_mmu(env, addr, *(uint64_t *)elt, oi, ra);
+        }
+        break;
+    }
+}
+#else
+static void advsimd_ld_tlb(CPUARMState *env, void *elt, target_ulong addr,
+                           TCGMemOpIdx oi, uintptr_t ra)
+{
+    advsimd_ld_host(elt, g2h(addr), get_memop(oi) & MO_SIZE,
+                    memop_big_endian(get_memop(oi)));
+}
+
+static void advsimd_st_tlb(CPUARMState *env, void *elt, target_ulong addr,
+                           TCGMemOpIdx oi, uintptr_t ra)
+{
+    advsimd_st_host(elt, g2h(addr), get_memop(oi) & MO_SIZE,
+                    memop_big_endian(get_memop(oi)));
+}
+#endif
+
+static void advsimd_ldst_multi(CPUARMState *env, uint64_t addr,
+                               uint32_t desc, bool is_store, uintptr_t ra)
+{
+    TCGMemOpIdx oi = FIELD_EX32(desc, LDST_MULTI, OI);
+    int rt = FIELD_EX32(desc, LDST_MULTI, RT);
+    int selem = FIELD_EX32(desc, LDST_MULTI, SELEM);
+    int esz = get_memop(oi) & MO_SIZE;
+    bool be = memop_big_endian(get_memop(oi));
+    int elements = (FIELD_EX32(desc, LDST_MULTI, Q) ? 16 : 8) >> esz;
+    uint8_t *host;
+    int e, xs;
+
+#ifdef CONFIG_USER_ONLY
+    host = g2h(addr);
+    set_helper_retaddr(ra);
+#else
+    host = NULL;
+    if ((addr & ~TARGET_PAGE_MASK) + (elements * selem << esz)
+        <= TARGET_PAGE_SIZE) {
+        host = tlb_vaddr_to_host(env, addr,
+                                 is_store ? MMU_DATA_STORE : MMU_DATA_LOAD,
+                                 get_mmuidx(oi));
+    }
+#endif
+
+    for (e = 0; e < elements; e++) {
+        for (xs = 0; xs < selem; xs++) {
+            void *elt = advsimd_elt_ptr(env, (rt + xs) % 32, e, esz);
+
+            if (host) {
+                if (is_store) {
+                    advsimd_st_host(elt, host, esz, be);
+                } else {
+                    advsimd_ld_host(elt, host, esz, be);
+                }
+                host += 1 << esz;
+            } else if (is_store) {
+                advsimd_st_tlb(env, elt, addr, oi, ra);
+            } else {
+                advsimd_ld_tlb(env, elt, addr, oi, ra);
+            }
+            addr += 1 << esz;
+        }
+    }
+
+#ifdef CONFIG_USER_ONLY
+    clear_helper_retaddr();
+#endif
+}
+
+void HELPER(advsimd_ldn)(CPUARMState *env, uint64_t addr, uint32_t desc)
+{
+    advsimd_ldst_multi(env, addr, desc, false, GETPC());
+}
+
+void HELPER(advsimd_stn)(CPUARMState *env, uint64_t addr, uint32_t desc)
+{
+    advsimd_ldst_multi(env, addr, desc, true, GETPC());
+}
+
 /* 64bit/double versions of the neon float compare functions */
 uint64_t HELPER(neon_ceq_f64)(float64 a, float64 b, void *fpstp)
 {
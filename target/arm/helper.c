@@ -25,6 +25,7 @@
 #include "hw/semihosting/semihost.h"
 #include "sysemu/cpus.h"
 #include "sysemu/kvm.h"
+#include "sysemu/tcg.h"
 #include "qemu/range.h"
 #include "qapi/qapi-commands-machine-target.h"
 #include "qapi/error.h"
@@ -2415,6 +2416,7 @@ static uint64_t gt_get_countervalue(CPUARMState *env)
 static void gt_recalc_timer(ARMCPU *cpu, int timeridx)
 {
     ARMGenericTimer *gt = &cpu->env.cp15.c14_timer[timeridx];
+    QEMUTimer *timer = cpu->gt_timer[timeridx];
 
     if (gt->ctl & 1) {
         /* Timer enabled: calculate and set current ISTATUS, irq, and
@@ -2426,6 +2428,7 @@ static void gt_recalc_timer(ARMCPU *cpu, int timeridx)
         /* Note that this must be unsigned 64 bit arithmetic: */
         int istatus = count - offset >= gt->cval;
         uint64_t nexttick;
+        int64_t expire, next_ns;
         int irqstate;
 
         gt->ctl = deposit32(gt->ctl, 2, 1, istatus);
@@ -2448,13 +2451,22 @@ static void gt_recalc_timer(ARMCPU *cpu, int timeridx)
         if (nexttick > INT64_MAX / GTIMER_SCALE) {
             nexttick = INT64_MAX / GTIMER_SCALE;
         }
-        timer_mod(cpu->gt_timer[timeridx], nexttick);
+        /* Guests rewrite CVAL and CTL far more often than the deadline
+         * moves: leave the timer alone if it is already armed for it, or
+         * for a little later than it, within the slack allowed.
+         */
+        next_ns = nexttick * GTIMER_SCALE;
+        expire = timer_expire_time_ns(timer);
+        if (expire == -1 || expire < next_ns ||
+            expire - next_ns > cpu->gt_slack_ns) {
+            timer_mod(timer, nexttick);
+        }
         trace_arm_gt_recalc(timeridx, irqstate, nexttick);
     } else {
         /* Timer disabled: ISTATUS and timer output always clear */
         gt->ctl &= ~4;
         qemu_set_irq(cpu->gt_timer_outputs[timeridx], 0);
-        timer_del(cpu->gt_timer[timeridx]);
+        timer_del(timer);
         trace_arm_gt_recalc_disabled(timeridx);
     }
 }
@@ -2680,6 +2692,50 @@ void arm_gt_stimer_cb(void *opaque)
     gt_recalc_timer(cpu, GTIMER_SEC);
 }
 
+/*
+ * An event stream fires when bit EVNTI of its counter goes from 0 to 1,
+ * or from 1 to 0 if EVNTDIR is set.  Return the first such count after
+ * @count.
+ */
+static uint64_t gt_evnt_next(uint64_t count, uint32_t ctl)
+{
+    uint64_t period = 2ULL << extract32(ctl, 4, 4);
+    uint64_t next = (count & -period) +
+                    (extract32(ctl, 3, 1) ? period : period / 2);
+
+    return next > count ? next : next + period;
+}
+
+int64_t arm_gt_evnt_next(CPUARMState *env)
+{
+    uint64_t count = gt_get_countervalue(env);
+    uint64_t next = UINT64_MAX;
+
+    /* CNTKCTL.EVNTEN: event stream from the virtual counter */
+    if (extract32(env->cp15.c14_cntkctl, 2, 1)) {
+        uint64_t voff = env->cp15.cntvoff_el2;
+
+        next = gt_evnt_next(count - voff, env->cp15.c14_cntkctl) + voff;
+    }
+    /* CNTHCTL.EVNTEN: event stream from the physical counter */
+    if (arm_feature(env, ARM_FEATURE_EL2) &&
+        extract32(env->cp15.cnthctl_el2, 2, 1)) {
+        next = MIN(next, gt_evnt_next(count, env->cp15.cnthctl_el2));
+    }
+
+    if (next == UINT64_MAX) {
+        return -1;
+    }
+    return MIN(next, INT64_MAX / GTIMER_SCALE);
+}
+
+void arm_gt_evnt_cb(void *opaque)
+{
+    ARMCPU *cpu = opaque;
+
+    arm_cpu_send_event(cpu);
+}
+
 static const ARMCPRegInfo generic_timer_cp_reginfo[] = {
     /* Note that CNTFRQ is purely reads-as-written for the benefit
      * of software; writing it doesn't actually change the timer frequency.
@@ -3469,14 +3525,34 @@ static void vmsa_tcr_el1_write(CPUARMState *env, const ARMCPRegInfo *ri,
     tcr->raw_tcr = value;
 }
 
+/*
+ * Only LPAE-format stage 1 walks mark their global translations (in
+ * get_phys_addr_lpae()); everything else is treated as ASID specific.
+ */
+static bool arm_tlb_entry_is_global(MemTxAttrs attrs)
+{
+    return attrs.target_tlb_bit1;
+}
+
 static void vmsa_ttbr_write(CPUARMState *env, const ARMCPRegInfo *ri,
                             uint64_t value)
 {
-    /* If the ASID changes (with a 64-bit write), we must flush the TLB.  */
+    /*
+     * If the ASID changes (with a 64-bit write), we must flush the TLB,
+     * but global translations do not depend on the ASID and can stay.
+     */
     if (cpreg_field_is_64bit(ri) &&
         extract64(raw_read(env, ri) ^ value, 48, 16) != 0) {
         ARMCPU *cpu = env_archcpu(env);
-        tlb_flush(CPU(cpu));
+        tlb_flush_by_mmuidx_filtered(CPU(cpu),
+                                     ARMMMUIdxBit_S12NSE0 |
+                                     ARMMMUIdxBit_S12NSE1 |
+                                     ARMMMUIdxBit_S1E2 |
+                                     ARMMMUIdxBit_S1E3 |
+                                     ARMMMUIdxBit_S1SE0 |
+                                     ARMMMUIdxBit_S1SE1 |
+                                     ARMMMUIdxBit_S2NS,
+                                     arm_tlb_entry_is_global);
     }
     raw_write(env, ri, value);
 }
@@ -5906,6 +5982,356 @@ static const ARMCPRegInfo rndr_reginfo[] = {
       .access = PL0_R, .readfn = rndr_readfn },
     REGINFO_SENTINEL
 };
+
+/*
+ * Decode the operand of a TLBI RVA* op: BaseADDR in [36:0] is in units
+ * of the granule given by TG [47:46], and the range covers
+ * (NUM + 1) << (5 * SCALE + 1) granules with NUM in [43:39] and SCALE
+ * in [45:44]. As for the other TLBI by VA ops we ignore the ASID and
+ * the TTL hint. Returns false for the reserved TG encoding, which
+ * invalidates nothing.
+ */
+static bool tlbi_aa64_get_range(uint64_t value, uint64_t *base,
+                                uint64_t *len)
+{
+    unsigned int page_shift;
+
+    switch (extract64(value, 46, 2)) {
+    case 1:
+        page_shift = 12;
+        break;
+    case 2:
+        page_shift = 14;
+        break;
+    case 3:
+        page_shift = 16;
+        break;
+    default:
+        return false;
+    }
+
+    *base = sextract64(extract64(value, 0, 37) << page_shift,
+                       0, 37 + page_shift);
+    *len = (extract64(value, 39, 5) + 1)
+           << (5 * extract64(value, 44, 2) + 1 + page_shift);
+    return true;
+}
+
+static void tlbi_aa64_rvae1is_write(CPUARMState *env, const ARMCPRegInfo *ri,
+                                    uint64_t value)
+{
+    /*
+     * Invalidate by VA range, EL1&0, Inner Shareable.
+     * Handles all of RVAE1IS, RVAAE1IS, RVALE1IS and RVAALE1IS and their
+     * Outer Shareable forms, for the same reasons as tlbi_aa64_vae1_write.
+     */
+    CPUState *cs = env_cpu(env);
+    uint64_t base, len;
+
+    if (!tlbi_aa64_get_range(value, &base, &len)) {
+        return;
+    }
+
+    if (arm_is_secure_below_el3(env)) {
+        tlb_flush_range_by_mmuidx_all_cpus_synced(cs, base, len,
+                                                  ARMMMUIdxBit_S1SE1 |
+                                                  ARMMMUIdxBit_S1SE0);
+    } else {
+        tlb_flush_range_by_mmuidx_all_cpus_synced(cs, base, len,
+                                                  ARMMMUIdxBit_S12NSE1 |
+                                                  ARMMMUIdxBit_S12NSE0);
+    }
+}
+
+static void tlbi_aa64_rvae1_write(CPUARMState *env, const ARMCPRegInfo *ri,
+                                  uint64_t value)
+{
+    /* Invalidate by VA range, EL1&0: RVAE1, RVAAE1, RVALE1 and RVAALE1 */
+    CPUState *cs = env_cpu(env);
+    uint64_t base, len;
+
+    if (tlb_force_broadcast(env)) {
+        tlbi_aa64_rvae1is_write(env, NULL, value);
+        return;
+    }
+
+    if (!tlbi_aa64_get_range(value, &base, &len)) {
+        return;
+    }
+
+    if (arm_is_secure_below_el3(env)) {
+        tlb_flush_range_by_mmuidx(cs, base, len,
+                                  ARMMMUIdxBit_S1SE1 |
+                                  ARMMMUIdxBit_S1SE0);
+    } else {
+        tlb_flush_range_by_mmuidx(cs, base, len,
+                                  ARMMMUIdxBit_S12NSE1 |
+                                  ARMMMUIdxBit_S12NSE0);
+    }
+}
+
+/*
+ * Invalidate by VA range, EL2 and EL3.  The IS forms also handle the
+ * Outer Shareable ones, and the last-level-only forms flush everything.
+ */
+static void tlbi_aa64_rvae2is_write(CPUARMState *env, const ARMCPRegInfo *ri,
+                                    uint64_t value)
+{
+    uint64_t base, len;
+
+    if (tlbi_aa64_get_range(value, &base, &len)) {
+        tlb_flush_range_by_mmuidx_all_cpus_synced(env_cpu(env), base, len,
+                                                  ARMMMUIdxBit_S1E2);
+    }
+}
+
+static void tlbi_aa64_rvae2_write(CPUARMState *env, const ARMCPRegInfo *ri,
+                                  uint64_t value)
+{
+    uint64_t base, len;
+
+    if (tlbi_aa64_get_range(value, &base, &len)) {
+        tlb_flush_range_by_mmuidx(env_cpu(env), base, len, ARMMMUIdxBit_S1E2);
+    }
+}
+
+static void tlbi_aa64_rvae3is_write(CPUARMState *env, const ARMCPRegInfo *ri,
+                                    uint64_t value)
+{
+    uint64_t base, len;
+
+    if (tlbi_aa64_get_range(value, &base, &len)) {
+        tlb_flush_range_by_mmuidx_all_cpus_synced(env_cpu(env), base, len,
+                                                  ARMMMUIdxBit_S1E3);
+    }
+}
+
+static void tlbi_aa64_rvae3_write(CPUARMState *env, const ARMCPRegInfo *ri,
+                                  uint64_t value)
+{
+    uint64_t base, len;
+
+    if (tlbi_aa64_get_range(value, &base, &len)) {
+        tlb_flush_range_by_mmuidx(env_cpu(env), base, len, ARMMMUIdxBit_S1E3);
+    }
+}
+
+/*
+ * Invalidate by IPA range.  As for IPAS2E1 only the stage 2 entries need
+ * to go; invalidating more than asked is allowed, so flush all of them
+ * rather than decode the range.
+ */
+static void tlbi_aa64_ripas2e1is_write(CPUARMState *env,
+                                       const ARMCPRegInfo *ri, uint64_t value)
+{
+    if (!arm_feature(env, ARM_FEATURE_EL2) || !(env->cp15.scr_el3 & SCR_NS)) {
+        return;
+    }
+    tlb_flush_by_mmuidx_all_cpus_synced(env_cpu(env), ARMMMUIdxBit_S2NS);
+}
+
+static void tlbi_aa64_ripas2e1_write(CPUARMState *env, const ARMCPRegInfo *ri,
+                                     uint64_t value)
+{
+    if (!arm_feature(env, ARM_FEATURE_EL2) || !(env->cp15.scr_el3 & SCR_NS)) {
+        return;
+    }
+    tlb_flush_by_mmuidx(env_cpu(env), ARMMMUIdxBit_S2NS);
+}
+
+/*
+ * ARMv8.4-TLBI: Outer Shareable and range invalidation, at EL1&0, EL2
+ * and EL3.
+ * All our CPUs are in one shareability domain, so the Outer Shareable
+ * ops behave exactly like the Inner Shareable ones.
+ */
+static const ARMCPRegInfo tlbirange_reginfo[] = {
+    { .name = "TLBI_VMALLE1OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 1, .opc2 = 0,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_vmalle1is_write },
+    { .name = "TLBI_VAE1OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 1, .opc2 = 1,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_vae1is_write },
+    { .name = "TLBI_ASIDE1OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 1, .opc2 = 2,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_vmalle1is_write },
+    { .name = "TLBI_VAAE1OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 1, .opc2 = 3,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_vae1is_write },
+    { .name = "TLBI_VALE1OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 1, .opc2 = 5,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_vae1is_write },
+    { .name = "TLBI_VAALE1OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 1, .opc2 = 7,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_vae1is_write },
+    { .name = "TLBI_RVAE1IS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 2, .opc2 = 1,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae1is_write },
+    { .name = "TLBI_RVAAE1IS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 2, .opc2 = 3,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae1is_write },
+    { .name = "TLBI_RVALE1IS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 2, .opc2 = 5,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae1is_write },
+    { .name = "TLBI_RVAALE1IS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 2, .opc2 = 7,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae1is_write },
+    { .name = "TLBI_RVAE1OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 5, .opc2 = 1,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae1is_write },
+    { .name = "TLBI_RVAAE1OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 5, .opc2 = 3,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae1is_write },
+    { .name = "TLBI_RVALE1OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 5, .opc2 = 5,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae1is_write },
+    { .name = "TLBI_RVAALE1OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 5, .opc2 = 7,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae1is_write },
+    { .name = "TLBI_RVAE1", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 6, .opc2 = 1,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae1_write },
+    { .name = "TLBI_RVAAE1", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 6, .opc2 = 3,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae1_write },
+    { .name = "TLBI_RVALE1", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 6, .opc2 = 5,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae1_write },
+    { .name = "TLBI_RVAALE1", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 0, .crn = 8, .crm = 6, .opc2 = 7,
+      .access = PL1_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae1_write },
+    { .name = "TLBI_ALLE2OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 1, .opc2 = 0,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_alle2is_write },
+    { .name = "TLBI_VAE2OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 1, .opc2 = 1,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_vae2is_write },
+    { .name = "TLBI_ALLE1OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 1, .opc2 = 4,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_alle1is_write },
+    { .name = "TLBI_VALE2OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 1, .opc2 = 5,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_vae2is_write },
+    { .name = "TLBI_VMALLS12E1OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 1, .opc2 = 6,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_alle1is_write },
+    { .name = "TLBI_IPAS2E1OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 4, .opc2 = 0,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_ipas2e1is_write },
+    { .name = "TLBI_IPAS2LE1OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 4, .opc2 = 4,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_ipas2e1is_write },
+    { .name = "TLBI_RIPAS2E1IS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 0, .opc2 = 2,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_ripas2e1is_write },
+    { .name = "TLBI_RIPAS2LE1IS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 0, .opc2 = 6,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_ripas2e1is_write },
+    { .name = "TLBI_RIPAS2E1", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 4, .opc2 = 2,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_ripas2e1_write },
+    { .name = "TLBI_RIPAS2E1OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 4, .opc2 = 3,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_ripas2e1is_write },
+    { .name = "TLBI_RIPAS2LE1", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 4, .opc2 = 6,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_ripas2e1_write },
+    { .name = "TLBI_RIPAS2LE1OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 4, .opc2 = 7,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_ripas2e1is_write },
+    { .name = "TLBI_RVAE2IS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 2, .opc2 = 1,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae2is_write },
+    { .name = "TLBI_RVALE2IS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 2, .opc2 = 5,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae2is_write },
+    { .name = "TLBI_RVAE2OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 5, .opc2 = 1,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae2is_write },
+    { .name = "TLBI_RVALE2OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 5, .opc2 = 5,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae2is_write },
+    { .name = "TLBI_RVAE2", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 6, .opc2 = 1,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae2_write },
+    { .name = "TLBI_RVALE2", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 4, .crn = 8, .crm = 6, .opc2 = 5,
+      .access = PL2_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae2_write },
+    { .name = "TLBI_ALLE3OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 6, .crn = 8, .crm = 1, .opc2 = 0,
+      .access = PL3_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_alle3is_write },
+    { .name = "TLBI_VAE3OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 6, .crn = 8, .crm = 1, .opc2 = 1,
+      .access = PL3_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_vae3is_write },
+    { .name = "TLBI_VALE3OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 6, .crn = 8, .crm = 1, .opc2 = 5,
+      .access = PL3_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_vae3is_write },
+    { .name = "TLBI_RVAE3IS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 6, .crn = 8, .crm = 2, .opc2 = 1,
+      .access = PL3_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae3is_write },
+    { .name = "TLBI_RVALE3IS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 6, .crn = 8, .crm = 2, .opc2 = 5,
+      .access = PL3_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae3is_write },
+    { .name = "TLBI_RVAE3OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 6, .crn = 8, .crm = 5, .opc2 = 1,
+      .access = PL3_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae3is_write },
+    { .name = "TLBI_RVALE3OS", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 6, .crn = 8, .crm = 5, .opc2 = 5,
+      .access = PL3_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae3is_write },
+    { .name = "TLBI_RVAE3", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 6, .crn = 8, .crm = 6, .opc2 = 1,
+      .access = PL3_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae3_write },
+    { .name = "TLBI_RVALE3", .state = ARM_CP_STATE_AA64,
+      .opc0 = 1, .opc1 = 6, .crn = 8, .crm = 6, .opc2 = 5,
+      .access = PL3_W, .type = ARM_CP_NO_RAW,
+      .writefn = tlbi_aa64_rvae3_write },
+    REGINFO_SENTINEL
+};
 #endif
 
 static CPAccessResult access_predinv(CPUARMState *env, const ARMCPRegInfo *ri,
@@ -6853,6 +7279,9 @@ void register_cp_regs_for_features(ARMCPU *cpu)
     if (cpu_isar_feature(aa64_rndr, cpu)) {
         define_arm_cp_regs(cpu, rndr_reginfo);
     }
+    if (cpu_isar_feature(aa64_tlbirange, cpu)) {
+        define_arm_cp_regs(cpu, tlbirange_reginfo);
+    }
 #endif
 
     /*
@@ -9469,6 +9898,63 @@ static ARMVAParameters aa32_va_parameters(CPUARMState *env, uint32_t va,
     };
 }
 
+/*
+ * Page table walk cache.  A TLB miss normally walks the tables from the
+ * top, although neighbouring pages share all but the last table; so the
+ * tables reached by recent walks are remembered, together with a host
+ * pointer for the ones in RAM, and a walk starts at the deepest table
+ * that is known for its address.  The architecture allows walks to be
+ * cached until the next TLB maintenance operation, and every TLB flush
+ * of the CPU (including the ones caused by memory map changes, which
+ * also invalidate the host pointers) bumps the flush generation that
+ * entries are tagged with.
+ */
+static inline ARMPTWCacheEntry *ptw_cache_entry(ARMCPU *cpu, uint32_t level,
+                                                ARMMMUIdx mmu_idx, int select,
+                                                uint64_t tag)
+{
+    unsigned idx = (tag ^ mmu_idx ^ (select << 3)) &
+                   ((1 << ARM_PTW_CACHE_BITS) - 1);
+
+    return &cpu->ptw_cache[level - 1][idx];
+}
+
+/* Bits of @address above the part translated by a table at @level */
+static inline uint64_t ptw_cache_tag(target_ulong address, uint32_t level,
+                                     int stride, int inputsize)
+{
+    int span = stride * (5 - level) + 3;
+
+    return extract64(address, span, inputsize - span);
+}
+
+/* Return the host address of a whole table in RAM, or NULL */
+static uint8_t *ptw_table_host(CPUARMState *env, ARMMMUIdx mmu_idx,
+                               hwaddr table, bool is_secure, int stride)
+{
+    CPUState *cs = env_cpu(env);
+    MemTxAttrs attrs = { .secure = is_secure };
+    hwaddr size = 1ULL << (stride + 3);
+    hwaddr xlat, len = size;
+    MemoryRegion *mr;
+    uint8_t *host = NULL;
+
+    if ((mmu_idx == ARMMMUIdx_S1NSE0 || mmu_idx == ARMMMUIdx_S1NSE1) &&
+        !regime_translation_disabled(env, ARMMMUIdx_S2NS)) {
+        /* the table address still needs a stage 2 walk */
+        return NULL;
+    }
+
+    rcu_read_lock();
+    mr = address_space_translate(arm_addressspace(cs, attrs), table,
+                                 &xlat, &len, false, attrs);
+    if (len == size && memory_access_is_direct(mr, false)) {
+        host = (uint8_t *)memory_region_get_ram_ptr(mr) + xlat;
+    }
+    rcu_read_unlock();
+    return host;
+}
+
 static bool get_phys_addr_lpae(CPUARMState *env, target_ulong address,
                                MMUAccessType access_type, ARMMMUIdx mmu_idx,
                                hwaddr *phys_ptr, MemTxAttrs *txattrs, int *prot,
@@ -9493,6 +9979,8 @@ static bool get_phys_addr_lpae(CPUARMState *env, target_ulong address,
     uint32_t el = regime_el(env, mmu_idx);
     bool ttbr1_valid;
     uint64_t descaddrmask;
+    bool use_cache;
+    uint8_t *host = NULL;
     bool aarch64 = arm_el_is_aa64(env, el);
     bool guarded = false;
 
@@ -9628,6 +10116,34 @@ static bool get_phys_addr_lpae(CPUARMState *env, target_ulong address,
      * bits at each step.
      */
     tableattrs = regime_is_secure(env, mmu_idx) ? 0 : (1 << 4);
+
+    /*
+     * Start from the deepest table cached for the address.  Debug
+     * accesses can come from other threads and must not use the cache.
+     */
+    use_cache = tcg_enabled() && current_cpu == cs;
+    if (use_cache) {
+        uint64_t gen = env_tlb(env)->c.flush_gen;
+        uint32_t l;
+
+        for (l = 3; l > level; l--) {
+            uint64_t tag = ptw_cache_tag(address, l, stride, inputsize);
+            ARMPTWCacheEntry *e = ptw_cache_entry(cpu, l, mmu_idx,
+                                                  param.select, tag);
+
+            if (e->level == l && e->flush_gen == gen && e->tag == tag &&
+                e->ttbr == ttbr && e->mmu_idx == mmu_idx &&
+                e->select == param.select && e->stride == stride) {
+                level = l;
+                descaddr = e->table;
+                tableattrs = e->tableattrs;
+                host = e->host;
+                indexmask = indexmask_grainsize;
+                break;
+            }
+        }
+    }
+
     for (;;) {
         uint64_t descriptor;
         bool nstable;
@@ -9635,9 +10151,19 @@ static bool get_phys_addr_lpae(CPUARMState *env, target_ulong address,
         descaddr |= (address >> (stride * (4 - level))) & indexmask;
         descaddr &= ~7ULL;
         nstable = extract32(tableattrs, 4, 1);
-        descriptor = arm_ldq_ptw(cs, descaddr, !nstable, mmu_idx, fi);
-        if (fi->type != ARMFault_None) {
-            goto do_fault;
+        if (host) {
+            uint8_t *p = host + (descaddr & indexmask_grainsize);
+
+            if (regime_translation_big_endian(env, mmu_idx)) {
+                descriptor = ldq_be_p(p);
+            } else {
+                descriptor = ldq_le_p(p);
+            }
+        } else {
+            descriptor = arm_ldq_ptw(cs, descaddr, !nstable, mmu_idx, fi);
+            if (fi->type != ARMFault_None) {
+                goto do_fault;
+            }
         }
 
         if (!(descriptor & 1) ||
@@ -9656,6 +10182,26 @@ static bool get_phys_addr_lpae(CPUARMState *env, target_ulong address,
             tableattrs |= extract64(descriptor, 59, 5);
             level++;
             indexmask = indexmask_grainsize;
+            host = NULL;
+            if (use_cache) {
+                uint64_t tag = ptw_cache_tag(address, level, stride,
+                                             inputsize);
+                ARMPTWCacheEntry *e = ptw_cache_entry(cpu, level, mmu_idx,
+                                                      param.select, tag);
+
+                host = ptw_table_host(env, mmu_idx, descaddr,
+                                      !extract32(tableattrs, 4, 1), stride);
+                e->flush_gen = env_tlb(env)->c.flush_gen;
+                e->ttbr = ttbr;
+                e->tag = tag;
+                e->table = descaddr;
+                e->host = host;
+                e->tableattrs = tableattrs;
+                e->mmu_idx = mmu_idx;
+                e->select = param.select;
+                e->stride = stride;
+                e->level = level;
+            }
             continue;
         }
         /* Block entry at level 1 or 2, or page entry at level 3.
@@ -9724,6 +10270,13 @@ static bool get_phys_addr_lpae(CPUARMState *env, target_ulong address,
     if (aarch64 && guarded && cpu_isar_feature(aa64_bti, cpu)) {
         txattrs->target_tlb_bit0 = true;
     }
+    /*
+     * Remember global (nG == 0) stage 1 translations in the IOTLB, so that
+     * an ASID change need not flush them; see arm_tlb_entry_is_global().
+     */
+    if (mmu_idx != ARMMMUIdx_S2NS && !extract32(attrs, 9, 1)) {
+        txattrs->target_tlb_bit1 = true;
+    }
 
     if (cacheattrs != NULL) {
         if (mmu_idx == ARMMMUIdx_S2NS) {
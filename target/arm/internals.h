@@ -72,6 +72,12 @@ FIELD(V7M_EXCRET, DCRS, 5, 1)
 FIELD(V7M_EXCRET, S, 6, 1)
 FIELD(V7M_EXCRET, RES1, 7, 25) /* including the must-be-1 prefix */
 
+/* Descriptor for the AdvSIMD load/store multiple structures helpers */
+FIELD(LDST_MULTI, OI, 0, 16)
+FIELD(LDST_MULTI, RT, 16, 5)
+FIELD(LDST_MULTI, SELEM, 21, 3)
+FIELD(LDST_MULTI, Q, 24, 1)
+
 /* Minimum value which is a magic number for exception return */
 #define EXC_RETURN_MIN_MAGIC 0xff000000
 /* Minimum number which is a magic number for function or exception return
@@ -499,6 +505,16 @@ static inline uint32_t syn_wfx(int cv, int cond, int ti, bool is_16bit)
            (cv << 24) | (cond << 20) | ti;
 }
 
+#ifndef CONFIG_USER_ONLY
+/*
+ * Return the counter value at which the next generic timer event stream
+ * event fires, or -1 if both event streams are disabled.
+ */
+int64_t arm_gt_evnt_next(CPUARMState *env);
+/* Set the event register of @cpu and wake it from WFE; BQL must be held */
+void arm_cpu_send_event(ARMCPU *cpu);
+#endif
+
 /* Update a QEMU watchpoint based on the information the guest has set in the
  * DBGWCR<n>_EL1 and DBGWVR<n>_EL1 registers.
  */
@@ -189,6 +189,26 @@ static const VMStateDescription vmstate_serror = {
     }
 };
 
+static bool wfe_needed(void *opaque)
+{
+    ARMCPU *cpu = opaque;
+    CPUARMState *env = &cpu->env;
+
+    return atomic_read(&env->event_register) || env->halted_in_wfi;
+}
+
+static const VMStateDescription vmstate_wfe = {
+    .name = "cpu/wfe",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = wfe_needed,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT32(env.event_register, ARMCPU),
+        VMSTATE_BOOL(env.halted_in_wfi, ARMCPU),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static bool irq_line_state_needed(void *opaque)
 {
     return true;
@@ -757,6 +777,19 @@ static int cpu_post_load(void *opaque, int version_id)
         pmu_op_finish(&cpu->env);
     }
 
+    /*
+     * A CPU halted in WFE waits for the next event stream tick, whose
+     * timer is not migrated: arm it again from the incoming counters.
+     */
+    if (!kvm_enabled() && CPU(cpu)->halted && !env->halted_in_wfi &&
+        cpu->power_state == PSCI_ON) {
+        int64_t next = arm_gt_evnt_next(env);
+
+        if (next >= 0) {
+            timer_mod(cpu->gt_evnt_timer, next);
+        }
+    }
+
     return 0;
 }
 
@@ -835,6 +868,7 @@ const VMStateDescription vmstate_arm_cpu = {
 #endif
         &vmstate_serror,
         &vmstate_irq_line_state,
+        &vmstate_wfe,
         NULL
     }
 };
@@ -2208,6 +2208,32 @@ void HELPER(neon_zip16)(void *vd, void *vm)
     rd[0] = d0;
 }
 
+#ifdef CONFIG_AESNI_OPT
+/* On x86 hosts with PCLMULQDQ the whole product is a single insn */
+#include "qemu/host-cpuinfo.h"
+
+#pragma GCC push_options
+#pragma GCC target("pclmul")
+#include <wmmintrin.h>
+
+static __m128i pmull_64_pclmul(uint64_t op1, uint64_t op2)
+{
+    return _mm_clmulepi64_si128(_mm_cvtsi64_si128(op1),
+                                _mm_cvtsi64_si128(op2), 0);
+}
+
+static uint64_t pmull_64_lo_pclmul(uint64_t op1, uint64_t op2)
+{
+    return _mm_cvtsi128_si64(pmull_64_pclmul(op1, op2));
+}
+
+static uint64_t pmull_64_hi_pclmul(uint64_t op1, uint64_t op2)
+{
+    return _mm_cvtsi128_si64(_mm_srli_si128(pmull_64_pclmul(op1, op2), 8));
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AESNI_OPT */
+
 /* Helper function for 64 bit polynomial multiply case:
  * perform PolynomialMult(op1, op2) and return either the top or
  * bottom half of the 128 bit result.
@@ -2217,6 +2243,12 @@ uint64_t HELPER(neon_pmull_64_lo)(uint64_t op1, uint64_t op2)
     int bitnum;
     uint64_t res = 0;
 
+#ifdef CONFIG_AESNI_OPT
+    if (host_cpuinfo & CPUINFO_PCLMUL) {
+        return pmull_64_lo_pclmul(op1, op2);
+    }
+#endif
+
     for (bitnum = 0; bitnum < 64; bitnum++) {
         if (op1 & (1ULL << bitnum)) {
             res ^= op2 << bitnum;
@@ -2229,6 +2261,12 @@ uint64_t HELPER(neon_pmull_64_hi)(uint64_t op1, uint64_t op2)
     int bitnum;
     uint64_t res = 0;
 
+#ifdef CONFIG_AESNI_OPT
+    if (host_cpuinfo & CPUINFO_PCLMUL) {
+        return pmull_64_hi_pclmul(op1, op2);
+    }
+#endif
+
     /* bit 0 of op1 can't influence the high 64 bits at all */
     for (bitnum = 1; bitnum < 64; bitnum++) {
         if (op1 & (1ULL << bitnum)) {
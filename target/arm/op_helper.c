@@ -20,6 +20,7 @@
 #include "qemu/units.h"
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
+#include "qemu/processor.h"
 #include "cpu.h"
 #include "exec/helper-proto.h"
 #include "internals.h"
@@ -286,6 +287,7 @@ void HELPER(wfi)(CPUARMState *env, uint32_t insn_len)
     CPUState *cs = env_cpu(env);
     int target_el = check_wfx_trap(env, false);
 
+    env->halted_in_wfi = true;
     if (cpu_has_work(cs)) {
         /* Don't bother to go into our "low power state" if
          * we would just wake up immediately.
@@ -304,16 +306,120 @@ void HELPER(wfi)(CPUARMState *env, uint32_t insn_len)
     cpu_loop_exit(cs);
 }
 
-void HELPER(wfe)(CPUARMState *env)
+void HELPER(wfe)(CPUARMState *env, uint32_t insn_len)
 {
-    /* This is a hint instruction that is semantically different
-     * from YIELD even though we currently implement it identically.
-     * Don't actually halt the CPU, just yield back to top
-     * level loop. This is not going into a "low power state"
-     * (ie halting until some event occurs), so we never take
-     * a configurable trap to a different exception level.
-     */
+#ifdef CONFIG_USER_ONLY
+    /* There is no low power state to go to, just yield */
     HELPER(yield)(env);
+#else
+    CPUState *cs = env_cpu(env);
+    int target_el = check_wfx_trap(env, true);
+    int64_t next;
+
+    /*
+     * Clear halted_in_wfi first, so that an event sent from now on ends
+     * the halt even if we do not see it below.
+     */
+    env->halted_in_wfi = false;
+    smp_mb();
+    if (atomic_xchg(&env->event_register, 0) || cpu_has_work(cs)) {
+        return;
+    }
+
+    if (target_el) {
+        if (is_a64(env)) {
+            env->pc -= insn_len;
+        } else {
+            env->regs[15] -= insn_len;
+        }
+        raise_exception(env, EXCP_UDEF, syn_wfx(1, 0xe, 1, insn_len == 2),
+                        target_el);
+    }
+
+    /*
+     * Clearing the global exclusive monitor also sends an event, but we
+     * do not see stores from other CPUs.  A CPU that waits with the
+     * monitor armed (like arm64 Linux spinlocks) keeps polling instead.
+     */
+    if (env->exclusive_addr != -1) {
+        HELPER(yield)(env);
+    }
+
+    next = arm_gt_evnt_next(env);
+    if (next >= 0) {
+        timer_mod(env_archcpu(env)->gt_evnt_timer, next);
+    }
+    cs->exception_index = EXCP_HLT;
+    cs->halted = 1;
+    cpu_loop_exit(cs);
+#endif
+}
+
+#ifndef CONFIG_USER_ONLY
+void arm_cpu_send_event(ARMCPU *cpu)
+{
+    CPUState *cs = CPU(cpu);
+
+    atomic_set(&cpu->env.event_register, 1);
+    smp_mb();
+    if (atomic_read(&cs->halted)) {
+        qemu_cpu_kick(cs);
+    }
+}
+#endif
+
+void HELPER(sev)(CPUARMState *env)
+{
+#ifndef CONFIG_USER_ONLY
+    CPUState *cs;
+    bool halted = false;
+
+    CPU_FOREACH(cs) {
+        atomic_set(&ARM_CPU(cs)->env.event_register, 1);
+    }
+    smp_mb();
+    CPU_FOREACH(cs) {
+        halted |= atomic_read(&cs->halted);
+    }
+
+    /*
+     * Only take the BQL when somebody may sleep in WFE: it orders the
+     * kick against the vCPU thread checking for work before it waits.
+     */
+    if (halted) {
+        qemu_mutex_lock_iothread();
+        CPU_FOREACH(cs) {
+            arm_cpu_send_event(ARM_CPU(cs));
+        }
+        qemu_mutex_unlock_iothread();
+    }
+#endif
+}
+
+void HELPER(sevl)(CPUARMState *env)
+{
+    atomic_set(&env->event_register, 1);
+}
+
+/* Limit of the exponential backoff, in doublings */
+#define EXCLUSIVE_BACKOFF_MAX 6
+
+/*
+ * A store exclusive lost against a store from another CPU.  The guest
+ * will go back to its load exclusive at once, and retrying right away
+ * would mostly make the other CPU fail in turn while the cache line
+ * bounces between them; so wait, longer for each consecutive failure.
+ */
+void HELPER(exclusive_backoff)(CPUARMState *env)
+{
+    unsigned n = 1u << env->exclusive_fails;
+
+    if (env->exclusive_fails < EXCLUSIVE_BACKOFF_MAX) {
+        env->exclusive_fails++;
+    }
+    while (n--) {
+        cpu_relax();
+    }
 }
 
 void HELPER(yield)(CPUARMState *env)
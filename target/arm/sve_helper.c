@@ -3993,6 +3993,7 @@ typedef intptr_t sve_ld1_host_fn(void *vd, void *vg, void *host,
 typedef void sve_ld1_tlb_fn(CPUARMState *env, void *vd, intptr_t reg_off,
                             target_ulong vaddr, TCGMemOpIdx oi, uintptr_t ra);
 typedef sve_ld1_tlb_fn sve_st1_tlb_fn;
+typedef sve_ld1_host_fn sve_st1_host_fn;
 
 /*
  * Generate the above primitives.
@@ -4674,6 +4675,21 @@ DO_LDFF1_LDNF1_2(dd,  3, 3)
  * Store contiguous data, protected by a governing predicate.
  */
 
+#define DO_ST_HOST(NAME, H, TYPEE, TYPEM, HOST) \
+static intptr_t sve_##NAME##_host(void *vd, void *vg, void *host,           \
+                                  intptr_t mem_off, const intptr_t mem_max) \
+{                                                                           \
+    intptr_t reg_off = mem_off * (sizeof(TYPEE) / sizeof(TYPEM));           \
+    uint64_t *pg = vg;                                                      \
+    while (mem_off + sizeof(TYPEM) <= mem_max) {                            \
+        if ((pg[reg_off >> 6] >> (reg_off & 63)) & 1) {                     \
+            HOST(host + mem_off, *(TYPEM *)(vd + H(reg_off)));              \
+        }                                                                   \
+        mem_off += sizeof(TYPEM), reg_off += sizeof(TYPEE);                 \
+    }                                                                       \
+    return mem_off;                                                         \
+}
+
 #ifdef CONFIG_SOFTMMU
 #define DO_ST_TLB(NAME, H, TYPEM, HOST, MOEND, TLB) \
 static void sve_##NAME##_tlb(CPUARMState *env, void *vd, intptr_t reg_off,  \
@@ -4690,30 +4706,48 @@ static void sve_##NAME##_tlb(CPUARMState *env, void *vd, intptr_t reg_off,  \
 }
 #endif
 
-DO_ST_TLB(st1bb,   H1,  uint8_t, stb_p, 0, helper_ret_stb_mmu)
-DO_ST_TLB(st1bh, H1_2, uint16_t, stb_p, 0, helper_ret_stb_mmu)
-DO_ST_TLB(st1bs, H1_4, uint32_t, stb_p, 0, helper_ret_stb_mmu)
-DO_ST_TLB(st1bd,     , uint64_t, stb_p, 0, helper_ret_stb_mmu)
-
-DO_ST_TLB(st1hh_le, H1_2, uint16_t, stw_le_p, MO_LE, helper_le_stw_mmu)
-DO_ST_TLB(st1hs_le, H1_4, uint32_t, stw_le_p, MO_LE, helper_le_stw_mmu)
-DO_ST_TLB(st1hd_le,     , uint64_t, stw_le_p, MO_LE, helper_le_stw_mmu)
-
-DO_ST_TLB(st1ss_le, H1_4, uint32_t, stl_le_p, MO_LE, helper_le_stl_mmu)
-DO_ST_TLB(st1sd_le,     , uint64_t, stl_le_p, MO_LE, helper_le_stl_mmu)
-
-DO_ST_TLB(st1dd_le,     , uint64_t, stq_le_p, MO_LE, helper_le_stq_mmu)
-
-DO_ST_TLB(st1hh_be, H1_2, uint16_t, stw_be_p, MO_BE, helper_be_stw_mmu)
-DO_ST_TLB(st1hs_be, H1_4, uint32_t, stw_be_p, MO_BE, helper_be_stw_mmu)
-DO_ST_TLB(st1hd_be,     , uint64_t, stw_be_p, MO_BE, helper_be_stw_mmu)
-
-DO_ST_TLB(st1ss_be, H1_4, uint32_t, stl_be_p, MO_BE, helper_be_stl_mmu)
-DO_ST_TLB(st1sd_be,     , uint64_t, stl_be_p, MO_BE, helper_be_stl_mmu)
-
-DO_ST_TLB(st1dd_be,     , uint64_t, stq_be_p, MO_BE, helper_be_stq_mmu)
-
+#define DO_ST_PRIM(NAME, H, TE, TM, HOST, MOEND, TLB) \
+    DO_ST_HOST(NAME, H, TE, TM, HOST)                 \
+    DO_ST_TLB(NAME, H, TM, HOST, MOEND, TLB)
+
+DO_ST_PRIM(st1bb,   H1,  uint8_t, uint8_t, stb_p, 0, helper_ret_stb_mmu)
+DO_ST_PRIM(st1bh, H1_2, uint16_t, uint8_t, stb_p, 0, helper_ret_stb_mmu)
+DO_ST_PRIM(st1bs, H1_4, uint32_t, uint8_t, stb_p, 0, helper_ret_stb_mmu)
+DO_ST_PRIM(st1bd,     , uint64_t, uint8_t, stb_p, 0, helper_ret_stb_mmu)
+
+DO_ST_PRIM(st1hh_le, H1_2, uint16_t, uint16_t, stw_le_p, MO_LE,
+           helper_le_stw_mmu)
+DO_ST_PRIM(st1hs_le, H1_4, uint32_t, uint16_t, stw_le_p, MO_LE,
+           helper_le_stw_mmu)
+DO_ST_PRIM(st1hd_le,     , uint64_t, uint16_t, stw_le_p, MO_LE,
+           helper_le_stw_mmu)
+
+DO_ST_PRIM(st1ss_le, H1_4, uint32_t, uint32_t, stl_le_p, MO_LE,
+           helper_le_stl_mmu)
+DO_ST_PRIM(st1sd_le,     , uint64_t, uint32_t, stl_le_p, MO_LE,
+           helper_le_stl_mmu)
+
+DO_ST_PRIM(st1dd_le,     , uint64_t, uint64_t, stq_le_p, MO_LE,
+           helper_le_stq_mmu)
+
+DO_ST_PRIM(st1hh_be, H1_2, uint16_t, uint16_t, stw_be_p, MO_BE,
+           helper_be_stw_mmu)
+DO_ST_PRIM(st1hs_be, H1_4, uint32_t, uint16_t, stw_be_p, MO_BE,
+           helper_be_stw_mmu)
+DO_ST_PRIM(st1hd_be,     , uint64_t, uint16_t, stw_be_p, MO_BE,
+           helper_be_stw_mmu)
+
+DO_ST_PRIM(st1ss_be, H1_4, uint32_t, uint32_t, stl_be_p, MO_BE,
+           helper_be_stl_mmu)
+DO_ST_PRIM(st1sd_be,     , uint64_t, uint32_t, stl_be_p, MO_BE,
+           helper_be_stl_mmu)
+
+DO_ST_PRIM(st1dd_be,     , uint64_t, uint64_t, stq_be_p, MO_BE,
+           helper_be_stq_mmu)
+
+#undef DO_ST_PRIM
 #undef DO_ST_TLB
+#undef DO_ST_HOST
 
 /*
  * Common helpers for all contiguous 1,2,3,4-register predicated stores.
@@ -4721,14 +4755,32 @@ DO_ST_TLB(st1dd_be,     , uint64_t, stq_be_p, MO_BE, helper_be_stq_mmu)
 static void sve_st1_r(CPUARMState *env, void *vg, target_ulong addr,
                       uint32_t desc, const uintptr_t ra,
                       const int esize, const int msize,
+                      sve_st1_host_fn *host_fn,
                       sve_st1_tlb_fn *tlb_fn)
 {
     const TCGMemOpIdx oi = extract32(desc, SIMD_DATA_SHIFT, MEMOPIDX_SHIFT);
     const unsigned rd = extract32(desc, SIMD_DATA_SHIFT + MEMOPIDX_SHIFT, 5);
     intptr_t i, oprsz = simd_oprsz(desc);
+    const intptr_t mem_max = oprsz / esize * msize;
     void *vd = &env->vfp.zregs[rd];
 
     set_helper_retaddr(ra);
+
+    /*
+     * As for sve_ld1_r: if the whole store is within one page, then
+     * either the tlb hits and no fault can occur, or for user-only the
+     * first store faults before anything is written.  Store directly.
+     */
+    if (likely(max_for_page(addr, 0, mem_max) == mem_max)) {
+        void *host = tlb_vaddr_to_host(env, addr, MMU_DATA_STORE,
+                                       get_mmuidx(oi));
+        if (test_host_page(host)) {
+            host_fn(vd, vg, host, 0, mem_max);
+            clear_helper_retaddr();
+            return;
+        }
+    }
+
     for (i = 0; i < oprsz; ) {
         uint16_t pg = *(uint16_t *)(vg + H1_2(i >> 3));
         do {
@@ -4826,6 +4878,28 @@ static void sve_st4_r(CPUARMState *env, void *vg, target_ulong addr,
     clear_helper_retaddr();
 }
 
+#define DO_ST1_1(NAME, ESIZE) \
+void QEMU_FLATTEN HELPER(sve_st1##NAME##_r) \
+    (CPUARMState *env, void *vg, target_ulong addr, uint32_t desc)  \
+{                                                                   \
+    sve_st1_r(env, vg, addr, desc, GETPC(), ESIZE, 1,               \
+              sve_st1##NAME##_host, sve_st1##NAME##_tlb);           \
+}
+
+#define DO_ST1_2(NAME, ESIZE, MSIZE) \
+void QEMU_FLATTEN HELPER(sve_st1##NAME##_le_r) \
+    (CPUARMState *env, void *vg, target_ulong addr, uint32_t desc)    \
+{                                                                     \
+    sve_st1_r(env, vg, addr, desc, GETPC(), ESIZE, MSIZE,             \
+              sve_st1##NAME##_le_host, sve_st1##NAME##_le_tlb);       \
+}                                                                     \
+void QEMU_FLATTEN HELPER(sve_st1##NAME##_be_r)                        \
+    (CPUARMState *env, void *vg, target_ulong addr, uint32_t desc)    \
+{                                                                     \
+    sve_st1_r(env, vg, addr, desc, GETPC(), ESIZE, MSIZE,             \
+              sve_st1##NAME##_be_host, sve_st1##NAME##_be_tlb);       \
+}
+
 #define DO_STN_1(N, NAME, ESIZE) \
 void QEMU_FLATTEN HELPER(sve_st##N##NAME##_r) \
     (CPUARMState *env, void *vg, target_ulong addr, uint32_t desc)  \
@@ -4848,32 +4922,34 @@ void QEMU_FLATTEN HELPER(sve_st##N##NAME##_be_r)                      \
                   sve_st1##NAME##_be_tlb);                            \
 }
 
-DO_STN_1(1, bb, 1)
-DO_STN_1(1, bh, 2)
-DO_STN_1(1, bs, 4)
-DO_STN_1(1, bd, 8)
+DO_ST1_1(bb, 1)
+DO_ST1_1(bh, 2)
+DO_ST1_1(bs, 4)
+DO_ST1_1(bd, 8)
 DO_STN_1(2, bb, 1)
 DO_STN_1(3, bb, 1)
 DO_STN_1(4, bb, 1)
 
-DO_STN_2(1, hh, 2, 2)
-DO_STN_2(1, hs, 4, 2)
-DO_STN_2(1, hd, 8, 2)
+DO_ST1_2(hh, 2, 2)
+DO_ST1_2(hs, 4, 2)
+DO_ST1_2(hd, 8, 2)
 DO_STN_2(2, hh, 2, 2)
 DO_STN_2(3, hh, 2, 2)
 DO_STN_2(4, hh, 2, 2)
 
-DO_STN_2(1, ss, 4, 4)
-DO_STN_2(1, sd, 8, 4)
+DO_ST1_2(ss, 4, 4)
+DO_ST1_2(sd, 8, 4)
 DO_STN_2(2, ss, 4, 4)
 DO_STN_2(3, ss, 4, 4)
 DO_STN_2(4, ss, 4, 4)
 
-DO_STN_2(1, dd, 8, 8)
+DO_ST1_2(dd, 8, 8)
 DO_STN_2(2, dd, 8, 8)
 DO_STN_2(3, dd, 8, 8)
 DO_STN_2(4, dd, 8, 8)
 
+#undef DO_ST1_1
+#undef DO_ST1_2
 #undef DO_STN_1
 #undef DO_STN_2
 
@@ -1242,6 +1242,10 @@ static void disas_uncond_b_imm(DisasContext *s, uint32_t insn)
 
     /* B Branch / BL Branch with link */
     reset_btype(s);
+    if (use_goto_tb(s, 0, addr) &&
+        translator_follow_branch(&s->base, addr, 4)) {
+        return;
+    }
     gen_goto_tb(s, 0, addr);
 }
 
@@ -1356,23 +1360,21 @@ static void handle_hint(DisasContext *s, uint32_t insn,
         s->base.is_jmp = DISAS_WFI;
         break;
     case 0b00001: /* YIELD */
-        /* When running in MTTCG we don't generate jumps to the yield and
-         * WFE helpers as it won't affect the scheduling of other vCPUs.
-         * If we wanted to more completely model WFE/SEV so we don't busy
-         * spin unnecessarily we would need to do something more involved.
+        /* When running in MTTCG we don't generate jumps to the yield
+         * helper as it won't affect the scheduling of other vCPUs.
          */
         if (!(tb_cflags(s->base.tb) & CF_PARALLEL)) {
             s->base.is_jmp = DISAS_YIELD;
         }
         break;
     case 0b00010: /* WFE */
-        if (!(tb_cflags(s->base.tb) & CF_PARALLEL)) {
-            s->base.is_jmp = DISAS_WFE;
-        }
+        s->base.is_jmp = DISAS_WFE;
         break;
     case 0b00100: /* SEV */
+        gen_helper_sev(cpu_env);
+        break;
     case 0b00101: /* SEVL */
-        /* we treat all as NOP at least for now */
+        gen_helper_sevl(cpu_env);
         break;
     case 0b00111: /* XPACLRI */
         if (s->pauth_active) {
@@ -2245,6 +2247,7 @@ static void gen_store_exclusive(DisasContext *s, int rd, int rt, int rt2,
      */
     TCGLabel *fail_label = gen_new_label();
     TCGLabel *done_label = gen_new_label();
+    TCGLabel *backoff_label = NULL;
     TCGv_i64 tmp;
 
     tcg_gen_brcond_i64(TCG_COND_NE, addr, cpu_exclusive_addr, fail_label);
@@ -2291,9 +2294,25 @@ static void gen_store_exclusive(DisasContext *s, int rd, int rt, int rt2,
         tcg_gen_setcond_i64(TCG_COND_NE, tmp, tmp, cpu_exclusive_val);
     }
     tcg_gen_mov_i64(cpu_reg(s, rd), tmp);
+    if (tb_cflags(s->base.tb) & CF_PARALLEL) {
+        /* Back off when another CPU wrote the location, see helper */
+        TCGv_i32 zero;
+
+        backoff_label = gen_new_label();
+        tcg_gen_brcondi_i64(TCG_COND_NE, tmp, 0, backoff_label);
+        zero = tcg_const_i32(0);
+        tcg_gen_st_i32(zero, cpu_env,
+                       offsetof(CPUARMState, exclusive_fails));
+        tcg_temp_free_i32(zero);
+    }
     tcg_temp_free_i64(tmp);
     tcg_gen_br(done_label);
 
+    if (backoff_label) {
+        gen_set_label(backoff_label);
+        gen_helper_exclusive_backoff(cpu_env);
+        tcg_gen_br(done_label);
+    }
     gen_set_label(fail_label);
     tcg_gen_movi_i64(cpu_reg(s, rd), 1);
     gen_set_label(done_label);
@@ -3358,24 +3377,45 @@ static void disas_ldst_multiple_struct(DisasContext *s, uint32_t insn)
 
     tcg_rn = cpu_reg_sp(s, rn);
     clean_addr = clean_data_tbi(s, tcg_rn);
-    tcg_ebytes = tcg_const_i64(ebytes);
 
-    for (r = 0; r < rpt; r++) {
-        int e;
-        for (e = 0; e < elements; e++) {
-            int xs;
-            for (xs = 0; xs < selem; xs++) {
-                int tt = (rt + r + xs) % 32;
-                if (is_store) {
-                    do_vec_st(s, tt, e, clean_addr, size, endian);
-                } else {
-                    do_vec_ld(s, tt, e, clean_addr, size, endian);
+    /* Interleaved structures of small elements are moved out of line,
+     * so that the whole block costs a single TLB lookup.
+     */
+    if (selem > 1 && elements * selem >= 8) {
+        uint32_t desc = 0;
+        TCGv_i32 tcg_desc;
+
+        desc = FIELD_DP32(desc, LDST_MULTI, OI,
+                          make_memop_idx(endian | size, get_mem_index(s)));
+        desc = FIELD_DP32(desc, LDST_MULTI, RT, rt);
+        desc = FIELD_DP32(desc, LDST_MULTI, SELEM, selem);
+        desc = FIELD_DP32(desc, LDST_MULTI, Q, is_q);
+        tcg_desc = tcg_const_i32(desc);
+        if (is_store) {
+            gen_helper_advsimd_stn(cpu_env, clean_addr, tcg_desc);
+        } else {
+            gen_helper_advsimd_ldn(cpu_env, clean_addr, tcg_desc);
+        }
+        tcg_temp_free_i32(tcg_desc);
+    } else {
+        tcg_ebytes = tcg_const_i64(ebytes);
+        for (r = 0; r < rpt; r++) {
+            int e;
+            for (e = 0; e < elements; e++) {
+                int xs;
+                for (xs = 0; xs < selem; xs++) {
+                    int tt = (rt + r + xs) % 32;
+                    if (is_store) {
+                        do_vec_st(s, tt, e, clean_addr, size, endian);
+                    } else {
+                        do_vec_ld(s, tt, e, clean_addr, size, endian);
+                    }
+                    tcg_gen_add_i64(clean_addr, clean_addr, tcg_ebytes);
                 }
-                tcg_gen_add_i64(clean_addr, clean_addr, tcg_ebytes);
             }
         }
+        tcg_temp_free_i64(tcg_ebytes);
     }
-    tcg_temp_free_i64(tcg_ebytes);
 
     if (!is_store) {
         /* For non-quad operations, setting a slice of the low
@@ -11116,6 +11156,12 @@ static void disas_simd_3same_int(DisasContext *s, uint32_t insn)
             gen_gvec_op3(s, is_q, rd, rn, rm, &mla_op[size]);
         }
         return;
+    case 0x0e: /* SABD, UABD */
+        gen_gvec_op3(s, is_q, rd, rn, rm, u ? &uabd_op[size] : &sabd_op[size]);
+        return;
+    case 0x0f: /* SABA, UABA */
+        gen_gvec_op3(s, is_q, rd, rn, rm, u ? &uaba_op[size] : &saba_op[size]);
+        return;
     case 0x11:
         if (!u) { /* CMTST */
             gen_gvec_op3(s, is_q, rd, rn, rm, &cmtst_op[size]);
@@ -11237,17 +11283,6 @@ static void disas_simd_3same_int(DisasContext *s, uint32_t insn)
                 genenvfn = fns[size][u];
                 break;
             }
-            case 0xe: /* SABD, UABD */
-            case 0xf: /* SABA, UABA */
-            {
-                static NeonGenTwoOpFn * const fns[3][2] = {
-                    { gen_helper_neon_abd_s8, gen_helper_neon_abd_u8 },
-                    { gen_helper_neon_abd_s16, gen_helper_neon_abd_u16 },
-                    { gen_helper_neon_abd_s32, gen_helper_neon_abd_u32 },
-                };
-                genfn = fns[size][u];
-                break;
-            }
             case 0x13: /* MUL, PMUL */
                 assert(u); /* PMUL */
                 assert(size == 0);
@@ -11273,18 +11308,6 @@ static void disas_simd_3same_int(DisasContext *s, uint32_t insn)
                 genfn(tcg_res, tcg_op1, tcg_op2);
             }
 
-            if (opcode == 0xf) {
-                /* SABA, UABA: accumulating ops */
-                static NeonGenTwoOpFn * const fns[3] = {
-                    gen_helper_neon_add_u8,
-                    gen_helper_neon_add_u16,
-                    tcg_gen_add_i32,
-                };
-
-                read_vec_element_i32(s, tcg_op1, rd, pass, MO_32);
-                fns[size](tcg_res, tcg_op1, tcg_res);
-            }
-
             write_vec_element_i32(s, tcg_res, rd, pass, MO_32);
 
             tcg_temp_free_i32(tcg_res);
@@ -14305,9 +14328,16 @@ static void aarch64_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
         case DISAS_SWI:
             break;
         case DISAS_WFE:
+        {
+            TCGv_i32 tmp = tcg_const_i32(4);
+
             gen_a64_set_pc_im(dc->base.pc_next);
-            gen_helper_wfe(cpu_env);
+            gen_helper_wfe(cpu_env, tmp);
+            tcg_temp_free_i32(tmp);
+            /* As for WFI, go back to the main loop if we did not halt */
+            tcg_gen_exit_tb(NULL, 0);
             break;
+        }
         case DISAS_YIELD:
             gen_a64_set_pc_im(dc->base.pc_next);
             gen_helper_yield(cpu_env);
@@ -3244,20 +3244,16 @@ static void gen_exception_return(DisasContext *s, TCGv_i32 pc)
 }
 
 /*
- * For WFI we will halt the vCPU until an IRQ. For WFE and YIELD we
- * only call the helper when running single threaded TCG code to ensure
- * the next round-robin scheduled vCPU gets a crack. In MTTCG mode we
- * just skip this instruction. Currently the SEV/SEVL instructions
- * which are *one* of many ways to wake the CPU from WFE are not
- * implemented so we can't sleep like WFI does.
+ * For WFI we will halt the vCPU until an IRQ, and for WFE until an IRQ
+ * or an event. For YIELD we only call the helper when running single
+ * threaded TCG code to ensure the next round-robin scheduled vCPU gets
+ * a crack. In MTTCG mode we just skip this instruction.
  */
 static void gen_nop_hint(DisasContext *s, int val)
 {
     switch (val) {
-        /* When running in MTTCG we don't generate jumps to the yield and
-         * WFE helpers as it won't affect the scheduling of other vCPUs.
-         * If we wanted to more completely model WFE/SEV so we don't busy
-         * spin unnecessarily we would need to do something more involved.
+        /* When running in MTTCG we don't generate jumps to the yield
+         * helper as it won't affect the scheduling of other vCPUs.
          */
     case 1: /* yield */
         if (!(tb_cflags(s->base.tb) & CF_PARALLEL)) {
@@ -3270,14 +3266,15 @@ static void gen_nop_hint(DisasContext *s, int val)
         s->base.is_jmp = DISAS_WFI;
         break;
     case 2: /* wfe */
-        if (!(tb_cflags(s->base.tb) & CF_PARALLEL)) {
-            gen_set_pc_im(s, s->base.pc_next);
-            s->base.is_jmp = DISAS_WFE;
-        }
+        gen_set_pc_im(s, s->base.pc_next);
+        s->base.is_jmp = DISAS_WFE;
         break;
     case 4: /* sev */
+        gen_helper_sev(cpu_env);
+        break;
     case 5: /* sevl */
-        /* TODO: Implement SEV, SEVL and WFE.  May help SMP performance.  */
+        gen_helper_sevl(cpu_env);
+        break;
     default: /* nop */
         break;
     }
@@ -4601,6 +4598,182 @@ const GVecGen3 mls_op[4] = {
       .vece = MO_64 },
 };
 
+/* Absolute difference, SABD/UABD, and accumulating it, SABA/UABA.  */
+
+static void gen_sabd_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
+{
+    TCGv_i32 t = tcg_temp_new_i32();
+
+    tcg_gen_smin_i32(t, a, b);
+    tcg_gen_smax_i32(d, a, b);
+    tcg_gen_sub_i32(d, d, t);
+    tcg_temp_free_i32(t);
+}
+
+static void gen_uabd_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
+{
+    TCGv_i32 t = tcg_temp_new_i32();
+
+    tcg_gen_umin_i32(t, a, b);
+    tcg_gen_umax_i32(d, a, b);
+    tcg_gen_sub_i32(d, d, t);
+    tcg_temp_free_i32(t);
+}
+
+static void gen_saba8_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
+{
+    gen_helper_neon_abd_s8(a, a, b);
+    gen_helper_neon_add_u8(d, d, a);
+}
+
+static void gen_uaba8_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
+{
+    gen_helper_neon_abd_u8(a, a, b);
+    gen_helper_neon_add_u8(d, d, a);
+}
+
+static void gen_saba16_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
+{
+    gen_helper_neon_abd_s16(a, a, b);
+    gen_helper_neon_add_u16(d, d, a);
+}
+
+static void gen_uaba16_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
+{
+    gen_helper_neon_abd_u16(a, a, b);
+    gen_helper_neon_add_u16(d, d, a);
+}
+
+static void gen_saba32_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
+{
+    gen_sabd_i32(a, a, b);
+    tcg_gen_add_i32(d, d, a);
+}
+
+static void gen_uaba32_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
+{
+    gen_uabd_i32(a, a, b);
+    tcg_gen_add_i32(d, d, a);
+}
+
+static void gen_sabd_vec(unsigned vece, TCGv_vec d, TCGv_vec a, TCGv_vec b)
+{
+    TCGv_vec t = tcg_temp_new_vec_matching(d);
+
+    tcg_gen_smin_vec(vece, t, a, b);
+    tcg_gen_smax_vec(vece, d, a, b);
+    tcg_gen_sub_vec(vece, d, d, t);
+    tcg_temp_free_vec(t);
+}
+
+static void gen_uabd_vec(unsigned vece, TCGv_vec d, TCGv_vec a, TCGv_vec b)
+{
+    TCGv_vec t = tcg_temp_new_vec_matching(d);
+
+    tcg_gen_umin_vec(vece, t, a, b);
+    tcg_gen_umax_vec(vece, d, a, b);
+    tcg_gen_sub_vec(vece, d, d, t);
+    tcg_temp_free_vec(t);
+}
+
+static void gen_saba_vec(unsigned vece, TCGv_vec d, TCGv_vec a, TCGv_vec b)
+{
+    gen_sabd_vec(vece, a, a, b);
+    tcg_gen_add_vec(vece, d, d, a);
+}
+
+static void gen_uaba_vec(unsigned vece, TCGv_vec d, TCGv_vec a, TCGv_vec b)
+{
+    gen_uabd_vec(vece, a, a, b);
+    tcg_gen_add_vec(vece, d, d, a);
+}
+
+static const TCGOpcode vecop_list_sabd[] = {
+    INDEX_op_smin_vec, INDEX_op_smax_vec, INDEX_op_sub_vec, 0
+};
+
+static const TCGOpcode vecop_list_uabd[] = {
+    INDEX_op_umin_vec, INDEX_op_umax_vec, INDEX_op_sub_vec, 0
+};
+
+static const TCGOpcode vecop_list_saba[] = {
+    INDEX_op_smin_vec, INDEX_op_smax_vec, INDEX_op_sub_vec,
+    INDEX_op_add_vec, 0
+};
+
+static const TCGOpcode vecop_list_uaba[] = {
+    INDEX_op_umin_vec, INDEX_op_umax_vec, INDEX_op_sub_vec,
+    INDEX_op_add_vec, 0
+};
+
+/* There are no 64-bit element forms of these.  */
+
+const GVecGen3 sabd_op[3] = {
+    { .fni4 = gen_helper_neon_abd_s8,
+      .fniv = gen_sabd_vec,
+      .opt_opc = vecop_list_sabd,
+      .vece = MO_8 },
+    { .fni4 = gen_helper_neon_abd_s16,
+      .fniv = gen_sabd_vec,
+      .opt_opc = vecop_list_sabd,
+      .vece = MO_16 },
+    { .fni4 = gen_sabd_i32,
+      .fniv = gen_sabd_vec,
+      .opt_opc = vecop_list_sabd,
+      .vece = MO_32 },
+};
+
+const GVecGen3 uabd_op[3] = {
+    { .fni4 = gen_helper_neon_abd_u8,
+      .fniv = gen_uabd_vec,
+      .opt_opc = vecop_list_uabd,
+      .vece = MO_8 },
+    { .fni4 = gen_helper_neon_abd_u16,
+      .fniv = gen_uabd_vec,
+      .opt_opc = vecop_list_uabd,
+      .vece = MO_16 },
+    { .fni4 = gen_uabd_i32,
+      .fniv = gen_uabd_vec,
+      .opt_opc = vecop_list_uabd,
+      .vece = MO_32 },
+};
+
+const GVecGen3 saba_op[3] = {
+    { .fni4 = gen_saba8_i32,
+      .fniv = gen_saba_vec,
+      .load_dest = true,
+      .opt_opc = vecop_list_saba,
+      .vece = MO_8 },
+    { .fni4 = gen_saba16_i32,
+      .fniv = gen_saba_vec,
+      .load_dest = true,
+      .opt_opc = vecop_list_saba,
+      .vece = MO_16 },
+    { .fni4 = gen_saba32_i32,
+      .fniv = gen_saba_vec,
+      .load_dest = true,
+      .opt_opc = vecop_list_saba,
+      .vece = MO_32 },
+};
+
+const GVecGen3 uaba_op[3] = {
+    { .fni4 = gen_uaba8_i32,
+      .fniv = gen_uaba_vec,
+      .load_dest = true,
+      .opt_opc = vecop_list_uaba,
+      .vece = MO_8 },
+    { .fni4 = gen_uaba16_i32,
+      .fniv = gen_uaba_vec,
+      .load_dest = true,
+      .opt_opc = vecop_list_uaba,
+      .vece = MO_16 },
+    { .fni4 = gen_uaba32_i32,
+      .fniv = gen_uaba_vec,
+      .load_dest = true,
+      .opt_opc = vecop_list_uaba,
+      .vece = MO_32 },
+};
+
 /* CMTST : test is "if (X & Y != 0)". */
 static void gen_cmtst_i32(TCGv_i32 d, TCGv_i32 a, TCGv_i32 b)
 {
@@ -7475,6 +7648,7 @@ static void gen_store_exclusive(DisasContext *s, int rd, int rt, int rt2,
     TCGv taddr;
     TCGLabel *done_label;
     TCGLabel *fail_label;
+    TCGLabel *backoff_label = NULL;
     MemOp opc = size | MO_ALIGN | s->be_data;
 
     /* if (env->exclusive_addr == addr && env->exclusive_val == [addr]) {
@@ -7532,9 +7706,21 @@ static void gen_store_exclusive(DisasContext *s, int rd, int rt, int rt2,
     tcg_temp_free_i32(t1);
     tcg_temp_free(taddr);
     tcg_gen_mov_i32(cpu_R[rd], t0);
+    if (tb_cflags(s->base.tb) & CF_PARALLEL) {
+        /* Back off when another CPU wrote the location, see helper */
+        backoff_label = gen_new_label();
+        tcg_gen_brcondi_i32(TCG_COND_NE, t0, 0, backoff_label);
+        tcg_gen_movi_i32(t0, 0);
+        tcg_gen_st_i32(t0, cpu_env, offsetof(CPUARMState, exclusive_fails));
+    }
     tcg_temp_free_i32(t0);
     tcg_gen_br(done_label);
 
+    if (backoff_label) {
+        gen_set_label(backoff_label);
+        gen_helper_exclusive_backoff(cpu_env);
+        tcg_gen_br(done_label);
+    }
     gen_set_label(fail_label);
     tcg_gen_movi_i32(cpu_R[rd], 1);
     gen_set_label(done_label);
@@ -12214,8 +12400,16 @@ static void arm_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
             break;
         }
         case DISAS_WFE:
-            gen_helper_wfe(cpu_env);
+        {
+            TCGv_i32 tmp = tcg_const_i32((dc->thumb &&
+                                          !(dc->insn & (1U << 31))) ? 2 : 4);
+
+            gen_helper_wfe(cpu_env, tmp);
+            tcg_temp_free_i32(tmp);
+            /* As for WFI, go back to the main loop if we did not halt */
+            tcg_gen_exit_tb(NULL, 0);
             break;
+        }
         case DISAS_YIELD:
             gen_helper_yield(cpu_env);
             break;
@@ -273,6 +273,10 @@ uint64_t vfp_expand_imm(int size, uint8_t imm8);
 /* Vector operations shared between ARM and AArch64.  */
 extern const GVecGen3 mla_op[4];
 extern const GVecGen3 mls_op[4];
+extern const GVecGen3 sabd_op[3];
+extern const GVecGen3 uabd_op[3];
+extern const GVecGen3 saba_op[3];
+extern const GVecGen3 uaba_op[3];
 extern const GVecGen3 cmtst_op[4];
 extern const GVecGen2i ssra_op[4];
 extern const GVecGen2i usra_op[4];
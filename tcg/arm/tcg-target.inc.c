@@ -1242,13 +1242,21 @@ static TCGReg tcg_out_tlb_read(TCGContext *s, TCGReg addrlo, TCGReg addrhi,
     int table_off = fast_off + offsetof(CPUTLBDescFast, table);
     unsigned s_bits = opc & MO_SIZE;
     unsigned a_bits = get_alignment_bits(opc);
+    TCGReg addr_page = addrlo;
 
     /*
-     * We don't support inline unaligned acceses, but we can easily
+     * ARMv6 and later perform unaligned LDR, LDRH, LDRSH, STR and STRH,
+     * so the unaligned accesses that do not cross a page stay inline:
+     * the page is checked with the address of their last byte.  LDRD and
+     * STRD still need alignment, as did earlier cores.  We can easily
      * support overalignment checks.
      */
     if (a_bits < s_bits) {
-        a_bits = s_bits;
+        if (use_armv6_instructions && s_bits <= MO_32) {
+            addr_page = TCG_REG_R0;
+        } else {
+            a_bits = s_bits;
+        }
     }
 
     /* Load env_tlb(env)->f[mmu_idx].{mask,table} into {r0,r1}.  */
@@ -1290,6 +1298,15 @@ static TCGReg tcg_out_tlb_read(TCGContext *s, TCGReg addrlo, TCGReg addrhi,
     tcg_out_ld32_12(s, COND_AL, TCG_REG_R1, TCG_REG_R1,
                     offsetof(CPUTLBEntry, addend));
 
+    /*
+     * Check the page of the last byte.  The offset does not change the
+     * low a_bits of the address, so the alignment check is unaffected.
+     */
+    if (addr_page != addrlo) {
+        tcg_out_dat_imm(s, COND_AL, ARITH_ADD, addr_page, addrlo,
+                        (1 << s_bits) - (1 << a_bits));
+    }
+
     /*
      * Check alignment, check comparators.
      * Do this in no more than 3 insns.  Use MOVW for v7, if possible,
@@ -1303,14 +1320,14 @@ static TCGReg tcg_out_tlb_read(TCGContext *s, TCGReg addrlo, TCGReg addrhi,
 
         tcg_out_movi32(s, COND_AL, TCG_REG_TMP, mask);
         tcg_out_dat_reg(s, COND_AL, ARITH_BIC, TCG_REG_TMP,
-                        addrlo, TCG_REG_TMP, 0);
+                        addr_page, TCG_REG_TMP, 0);
         tcg_out_dat_reg(s, COND_AL, ARITH_CMP, 0, TCG_REG_R2, TCG_REG_TMP, 0);
     } else {
         if (a_bits) {
             tcg_out_dat_imm(s, COND_AL, ARITH_TST, 0, addrlo,
                             (1 << a_bits) - 1);
         }
-        tcg_out_dat_reg(s, COND_AL, ARITH_MOV, TCG_REG_TMP, 0, addrlo,
+        tcg_out_dat_reg(s, COND_AL, ARITH_MOV, TCG_REG_TMP, 0, addr_page,
                         SHIFT_IMM_LSR(TARGET_PAGE_BITS));
         tcg_out_dat_reg(s, (a_bits ? COND_EQ : COND_AL), ARITH_CMP,
                         0, TCG_REG_R2, TCG_REG_TMP,
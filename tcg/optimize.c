@@ -594,6 +594,248 @@ static bool swap_commutative2(TCGArg *p1, TCGArg *p2)
     return false;
 }
 
+/* Loads and stores to env tracked within a basic block */
+#define ENV_ACCESS_MAX 32
+
+typedef struct EnvAccess {
+    intptr_t ofs;
+    intptr_t size;
+    TCGOpcode load;     /* load that reads back VAL, NB_OPS if none */
+    TCGTemp *val;
+    TCGOp *store;       /* store not read back yet, or NULL */
+} EnvAccess;
+
+/* Return the size in bytes of the host memory access done by OP, or 0 */
+static intptr_t env_access_size(TCGOp *op, bool *is_store, TCGOpcode *load)
+{
+    *is_store = false;
+    *load = op->opc;
+
+    switch (op->opc) {
+    case INDEX_op_ld8u_i32:
+    case INDEX_op_ld8s_i32:
+    case INDEX_op_ld8u_i64:
+    case INDEX_op_ld8s_i64:
+        return 1;
+    case INDEX_op_ld16u_i32:
+    case INDEX_op_ld16s_i32:
+    case INDEX_op_ld16u_i64:
+    case INDEX_op_ld16s_i64:
+        return 2;
+    case INDEX_op_ld_i32:
+    case INDEX_op_ld32u_i64:
+    case INDEX_op_ld32s_i64:
+        return 4;
+    case INDEX_op_ld_i64:
+        return 8;
+    case INDEX_op_ld_vec:
+        return 8 << TCGOP_VECL(op);
+    case INDEX_op_dupm_vec:
+        *load = NB_OPS;
+        return 8 << TCGOP_VECL(op);
+    default:
+        break;
+    }
+
+    *is_store = true;
+    *load = NB_OPS;
+    switch (op->opc) {
+    case INDEX_op_st8_i32:
+    case INDEX_op_st8_i64:
+        return 1;
+    case INDEX_op_st16_i32:
+    case INDEX_op_st16_i64:
+        return 2;
+    case INDEX_op_st32_i64:
+        return 4;
+    case INDEX_op_st_i32:
+        *load = INDEX_op_ld_i32;
+        return 4;
+    case INDEX_op_st_i64:
+        *load = INDEX_op_ld_i64;
+        return 8;
+    case INDEX_op_st_vec:
+        *load = INDEX_op_ld_vec;
+        return 8 << TCGOP_VECL(op);
+    default:
+        return 0;
+    }
+}
+
+static inline bool env_access_overlap(EnvAccess *e, intptr_t ofs,
+                                      intptr_t size)
+{
+    return e->ofs < ofs + size && ofs < e->ofs + e->size;
+}
+
+/* Forget everything, or only that the stores have not been read yet */
+static void env_access_flush(EnvAccess *acc, int *n, bool clobber)
+{
+    int i;
+
+    if (clobber) {
+        *n = 0;
+        return;
+    }
+    for (i = 0; i < *n; i++) {
+        acc[i].store = NULL;
+    }
+    for (i = 0; i < *n; ) {
+        if (acc[i].load == NB_OPS) {
+            acc[i] = acc[--*n];
+        } else {
+            i++;
+        }
+    }
+}
+
+static void env_access_add(EnvAccess *acc, int *n, intptr_t ofs,
+                           intptr_t size, TCGOpcode load, TCGTemp *val,
+                           TCGOp *store)
+{
+    EnvAccess *e;
+
+    if (load == NB_OPS && !store) {
+        return;
+    }
+    if (*n == ENV_ACCESS_MAX) {
+        /* Evict one, which at worst keeps a redundant access */
+        acc[0] = acc[--*n];
+    }
+    e = &acc[(*n)++];
+    e->ofs = ofs;
+    e->size = size;
+    e->load = load;
+    e->val = val;
+    e->store = store;
+}
+
+/*
+ * Forward stores and loads of env to later loads of the same field, and
+ * remove stores to env overwritten before anything may read them.
+ *
+ * Nothing is kept across the end of a basic block.  Helpers may access
+ * any of env through pointers whatever their flags, so a call is taken to
+ * read all of it, and to write it too unless it has no side effects.
+ * Guest memory accesses may fault or call the slow path, and accesses
+ * through any other base may point into env: they count as both.
+ *
+ * This runs before the main pass, which then propagates the copies made
+ * here.
+ */
+static void tcg_optimize_env(TCGContext *s)
+{
+    TCGTemp *env = tcgv_ptr_temp(cpu_env);
+    EnvAccess acc[ENV_ACCESS_MAX];
+    TCGOp *op, *op_next;
+    int n = 0;
+
+    QTAILQ_FOREACH_SAFE(op, &s->ops, link, op_next) {
+        TCGOpcode opc = op->opc, load;
+        const TCGOpDef *def = &tcg_op_defs[opc];
+        intptr_t ofs, size;
+        bool is_store, forwarded = false;
+        int nb_oargs, i;
+
+        if (opc == INDEX_op_call) {
+            int nb_iargs = TCGOP_CALLI(op);
+            int flags;
+
+            nb_oargs = TCGOP_CALLO(op);
+            flags = op->args[nb_oargs + nb_iargs + 1];
+            env_access_flush(acc, &n, !(flags & TCG_CALL_NO_SIDE_EFFECTS));
+        } else if (def->flags & (TCG_OPF_BB_END | TCG_OPF_SIDE_EFFECTS)) {
+            n = 0;
+            continue;
+        } else {
+            nb_oargs = def->nb_oargs;
+        }
+
+        size = env_access_size(op, &is_store, &load);
+        if (size && arg_temp(op->args[1]) != env) {
+            env_access_flush(acc, &n, is_store);
+            size = 0;
+        }
+        ofs = op->args[2];
+
+        if (size && is_store) {
+            for (i = 0; i < n; ) {
+                EnvAccess *e = &acc[i];
+
+                if (!env_access_overlap(e, ofs, size)) {
+                    i++;
+                    continue;
+                }
+                if (e->store && e->ofs >= ofs &&
+                    e->ofs + e->size <= ofs + size) {
+                    tcg_op_remove(s, e->store);
+                }
+                *e = acc[--n];
+            }
+            env_access_add(acc, &n, ofs, size, load,
+                           arg_temp(op->args[0]), op);
+            continue;
+        }
+
+        if (size) {
+            for (i = 0; i < n; i++) {
+                EnvAccess *e = &acc[i];
+
+                if (e->ofs == ofs && e->size == size && e->load == opc) {
+                    break;
+                }
+            }
+            if (i < n) {
+                TCGTemp *val = acc[i].val;
+
+                if (arg_temp(op->args[0]) == val) {
+                    tcg_op_remove(s, op);
+                    continue;
+                }
+                if (def->flags & TCG_OPF_VECTOR) {
+                    op->opc = INDEX_op_mov_vec;
+                } else if (def->flags & TCG_OPF_64BIT) {
+                    op->opc = INDEX_op_mov_i64;
+                } else {
+                    op->opc = INDEX_op_mov_i32;
+                }
+                /* TCGOP_VECL remains unchanged.  */
+                op->args[1] = temp_arg(val);
+                forwarded = true;
+            } else {
+                /* The pending stores have now been read */
+                for (i = 0; i < n; i++) {
+                    if (env_access_overlap(&acc[i], ofs, size)) {
+                        acc[i].store = NULL;
+                    }
+                }
+            }
+        }
+
+        /* The values held in the outputs are gone */
+        for (i = 0; i < nb_oargs; i++) {
+            TCGTemp *ts = arg_temp(op->args[i]);
+            int j;
+
+            for (j = 0; j < n; ) {
+                if (acc[j].val == ts) {
+                    acc[j].load = NB_OPS;
+                }
+                if (acc[j].load == NB_OPS && !acc[j].store) {
+                    acc[j] = acc[--n];
+                } else {
+                    j++;
+                }
+            }
+        }
+
+        if (size && !forwarded) {
+            env_access_add(acc, &n, ofs, size, load,
+                           arg_temp(op->args[0]), NULL);
+        }
+    }
+}
+
 /* Propagate constants and copies, fold constant expressions. */
 void tcg_optimize(TCGContext *s)
 {
@@ -607,6 +849,8 @@ void tcg_optimize(TCGContext *s)
        If this temp is a copy of other ones then the other copies are
        available through the doubly linked circular list. */
 
+    tcg_optimize_env(s);
+
     nb_temps = s->nb_temps;
     nb_globals = s->nb_globals;
     bitmap_zero(temps_used.l, nb_temps);
@@ -161,9 +161,20 @@ static TCGContext **tcg_ctxs;
 static unsigned int n_tcg_ctxs;
 TCGv_env cpu_env = 0;
 
-struct tcg_region_tree {
-    QemuMutex lock;
-    GTree *tree;
+/*
+ * The TBs of a region, sorted by host address, to map a host PC back to
+ * its TB.  A region is filled only by the context it is assigned to, or
+ * under mmap_lock in user-mode, and TBs are allocated upwards in it: an
+ * insertion is an append by a single writer, published by the release
+ * store of @n.  Lookups are binary searches over the published entries,
+ * without any lock.  Removed TBs leave a NULL entry behind, and the
+ * entries go away when the region is reset, in a safe-work context.
+ */
+struct tcg_region_tbs {
+    size_t n;
+    size_t capacity;
+    uintptr_t *starts;          /* tc.ptr of each entry, for the search */
+    TranslationBlock **tbs;
     /* padding to avoid false sharing is computed at run-time */
 };
 
@@ -185,18 +196,20 @@ struct tcg_region_state {
     size_t stride; /* .size + guard size */
 
     /* fields protected by the lock */
-    size_t current; /* current region index */
+    unsigned long *used; /* regions handed out since the last reset */
+    uint64_t *alloc_seq; /* allocation order of the used regions */
+    uint64_t seq;
     size_t agg_size_full; /* aggregate size of full regions */
 };
 
 static struct tcg_region_state region;
 /*
- * This is an array of struct tcg_region_tree's, with padding.
- * We use void * to simplify the computation of region_trees[i]; each
- * struct is found every tree_size bytes.
+ * This is an array of struct tcg_region_tbs's, with padding.
+ * We use void * to simplify the computation of region_tbs[i]; each
+ * struct is found every region_tbs_size bytes.
  */
-static void *region_trees;
-static size_t tree_size;
+static void *region_tbs;
+static size_t region_tbs_size;
 static TCGRegSet tcg_target_available_regs[TCG_TYPE_COUNT];
 static TCGRegSet tcg_target_call_clobber_regs;
 
@@ -343,196 +356,197 @@ static void set_jmp_reset_offset(TCGContext *s, int which)
 
 #include "tcg-target.inc.c"
 
-/* compare a pointer @ptr and a tb_tc @s */
-static int ptr_cmp_tb_tc(const void *ptr, const struct tb_tc *s)
+static void tcg_region_bounds(size_t curr_region, void **pstart, void **pend)
 {
-    if (ptr >= s->ptr + s->size) {
-        return 1;
-    } else if (ptr < s->ptr) {
-        return -1;
-    }
-    return 0;
-}
+    void *start, *end;
 
-static gint tb_tc_cmp(gconstpointer ap, gconstpointer bp)
-{
-    const struct tb_tc *a = ap;
-    const struct tb_tc *b = bp;
+    start = region.start_aligned + curr_region * region.stride;
+    end = start + region.size;
 
-    /*
-     * When both sizes are set, we know this isn't a lookup.
-     * This is the most likely case: every TB must be inserted; lookups
-     * are a lot less frequent.
-     */
-    if (likely(a->size && b->size)) {
-        if (a->ptr > b->ptr) {
-            return 1;
-        } else if (a->ptr < b->ptr) {
-            return -1;
-        }
-        /* a->ptr == b->ptr should happen only on deletions */
-        g_assert(a->size == b->size);
-        return 0;
+    if (curr_region == 0) {
+        start = region.start;
     }
-    /*
-     * All lookups have either .size field set to 0.
-     * From the glib sources we see that @ap is always the lookup key. However
-     * the docs provide no guarantee, so we just mark this case as likely.
-     */
-    if (likely(a->size == 0)) {
-        return ptr_cmp_tb_tc(a->ptr, b);
+    if (curr_region == region.n - 1) {
+        end = region.end;
     }
-    return ptr_cmp_tb_tc(b->ptr, a);
+
+    *pstart = start;
+    *pend = end;
 }
 
-static void tcg_region_trees_init(void)
+static inline struct tcg_region_tbs *region_tbs_at(size_t i)
 {
+    return region_tbs + i * region_tbs_size;
+}
+
+/*
+ * Every TB takes at least its own struct, which tcg_tb_alloc() places in
+ * the region, so the number of TBs of a region is bounded.  The arrays
+ * are only touched as they fill up.
+ */
+static void tcg_region_tbs_init(void)
+{
+    size_t min_tb_size =
+        ROUND_UP(sizeof(TranslationBlock), qemu_icache_linesize);
     size_t i;
 
-    tree_size = ROUND_UP(sizeof(struct tcg_region_tree), qemu_dcache_linesize);
-    region_trees = qemu_memalign(qemu_dcache_linesize, region.n * tree_size);
+    region_tbs_size = ROUND_UP(sizeof(struct tcg_region_tbs),
+                               qemu_dcache_linesize);
+    region_tbs = qemu_memalign(qemu_dcache_linesize,
+                               region.n * region_tbs_size);
     for (i = 0; i < region.n; i++) {
-        struct tcg_region_tree *rt = region_trees + i * tree_size;
+        struct tcg_region_tbs *rt = region_tbs_at(i);
+        void *start, *end;
 
-        qemu_mutex_init(&rt->lock);
-        rt->tree = g_tree_new(tb_tc_cmp);
+        tcg_region_bounds(i, &start, &end);
+        rt->n = 0;
+        rt->capacity = (end - start) / min_tb_size + 1;
+        rt->starts = g_new(uintptr_t, rt->capacity);
+        rt->tbs = g_new(TranslationBlock *, rt->capacity);
     }
 }
 
-static struct tcg_region_tree *tc_ptr_to_region_tree(void *p)
+static size_t tc_ptr_to_region_idx(void *p)
 {
-    size_t region_idx;
-
     if (p < region.start_aligned) {
-        region_idx = 0;
+        return 0;
     } else {
         ptrdiff_t offset = p - region.start_aligned;
 
         if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
+            return region.n - 1;
+        }
+        return offset / region.stride;
+    }
+}
+
+static struct tcg_region_tbs *tc_ptr_to_region_tbs(void *p)
+{
+    return region_tbs_at(tc_ptr_to_region_idx(p));
+}
+
+/*
+ * Return the index of the last of the first @n entries of @rt that
+ * starts at or below @p, or -1 if there is none.
+ */
+static ssize_t tcg_region_tbs_find(const struct tcg_region_tbs *rt,
+                                   size_t n, uintptr_t p)
+{
+    size_t lo = 0;
+    size_t hi = n;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (rt->starts[mid] <= p) {
+            lo = mid + 1;
         } else {
-            region_idx = offset / region.stride;
+            hi = mid;
         }
     }
-    return region_trees + region_idx * tree_size;
+    return (ssize_t)lo - 1;
 }
 
 void tcg_tb_insert(TranslationBlock *tb)
 {
-    struct tcg_region_tree *rt = tc_ptr_to_region_tree(tb->tc.ptr);
+    struct tcg_region_tbs *rt = tc_ptr_to_region_tbs(tb->tc.ptr);
+    size_t n = rt->n;
 
-    qemu_mutex_lock(&rt->lock);
-    g_tree_insert(rt->tree, &tb->tc, tb);
-    qemu_mutex_unlock(&rt->lock);
+    g_assert(n < rt->capacity);
+    tcg_debug_assert(n == 0 || rt->starts[n - 1] < (uintptr_t)tb->tc.ptr);
+    rt->starts[n] = (uintptr_t)tb->tc.ptr;
+    rt->tbs[n] = tb;
+    atomic_store_release(&rt->n, n + 1);
 }
 
 void tcg_tb_remove(TranslationBlock *tb)
 {
-    struct tcg_region_tree *rt = tc_ptr_to_region_tree(tb->tc.ptr);
+    struct tcg_region_tbs *rt = tc_ptr_to_region_tbs(tb->tc.ptr);
+    size_t n = atomic_load_acquire(&rt->n);
+    ssize_t i = tcg_region_tbs_find(rt, n, (uintptr_t)tb->tc.ptr);
 
-    qemu_mutex_lock(&rt->lock);
-    g_tree_remove(rt->tree, &tb->tc);
-    qemu_mutex_unlock(&rt->lock);
+    if (i >= 0 && rt->starts[i] == (uintptr_t)tb->tc.ptr) {
+        atomic_set(&rt->tbs[i], NULL);
+    }
 }
 
 /*
  * Find the TB 'tb' such that
  * tb->tc.ptr <= tc_ptr < tb->tc.ptr + tb->tc.size
  * Return NULL if not found.
+ *
+ * The TBs of a region are contiguous, so the candidate is the last one
+ * that starts at or below @tc_ptr.
  */
 TranslationBlock *tcg_tb_lookup(uintptr_t tc_ptr)
 {
-    struct tcg_region_tree *rt = tc_ptr_to_region_tree((void *)tc_ptr);
+    struct tcg_region_tbs *rt = tc_ptr_to_region_tbs((void *)tc_ptr);
+    size_t n = atomic_load_acquire(&rt->n);
+    ssize_t i = tcg_region_tbs_find(rt, n, tc_ptr);
     TranslationBlock *tb;
-    struct tb_tc s = { .ptr = (void *)tc_ptr };
 
-    qemu_mutex_lock(&rt->lock);
-    tb = g_tree_lookup(rt->tree, &s);
-    qemu_mutex_unlock(&rt->lock);
+    if (i < 0) {
+        return NULL;
+    }
+    tb = atomic_read(&rt->tbs[i]);
+    if (tb == NULL || tc_ptr >= (uintptr_t)tb->tc.ptr + tb->tc.size) {
+        return NULL;
+    }
     return tb;
 }
 
-static void tcg_region_tree_lock_all(void)
+/*
+ * Call @func on each TB of @rt, until it returns true.  TBs inserted
+ * or removed meanwhile may or may not be seen.
+ */
+static void tcg_region_tbs_foreach(struct tcg_region_tbs *rt,
+                                   GTraverseFunc func, gpointer user_data)
 {
+    size_t n = atomic_load_acquire(&rt->n);
     size_t i;
 
-    for (i = 0; i < region.n; i++) {
-        struct tcg_region_tree *rt = region_trees + i * tree_size;
+    for (i = 0; i < n; i++) {
+        TranslationBlock *tb = atomic_read(&rt->tbs[i]);
 
-        qemu_mutex_lock(&rt->lock);
+        if (tb && func(&tb->tc, tb, user_data)) {
+            break;
+        }
     }
 }
 
-static void tcg_region_tree_unlock_all(void)
+void tcg_tb_foreach(GTraverseFunc func, gpointer user_data)
 {
     size_t i;
 
     for (i = 0; i < region.n; i++) {
-        struct tcg_region_tree *rt = region_trees + i * tree_size;
-
-        qemu_mutex_unlock(&rt->lock);
+        tcg_region_tbs_foreach(region_tbs_at(i), func, user_data);
     }
 }
 
-void tcg_tb_foreach(GTraverseFunc func, gpointer user_data)
+static gboolean tcg_tb_count_iter(gpointer key, gpointer value,
+                                  gpointer data)
 {
-    size_t i;
-
-    tcg_region_tree_lock_all();
-    for (i = 0; i < region.n; i++) {
-        struct tcg_region_tree *rt = region_trees + i * tree_size;
+    size_t *nb_tbs = data;
 
-        g_tree_foreach(rt->tree, func, user_data);
-    }
-    tcg_region_tree_unlock_all();
+    (*nb_tbs)++;
+    return false;
 }
 
 size_t tcg_nb_tbs(void)
 {
     size_t nb_tbs = 0;
-    size_t i;
-
-    tcg_region_tree_lock_all();
-    for (i = 0; i < region.n; i++) {
-        struct tcg_region_tree *rt = region_trees + i * tree_size;
 
-        nb_tbs += g_tree_nnodes(rt->tree);
-    }
-    tcg_region_tree_unlock_all();
+    tcg_tb_foreach(tcg_tb_count_iter, &nb_tbs);
     return nb_tbs;
 }
 
-static void tcg_region_tree_reset_all(void)
+static void tcg_region_tbs_reset_all(void)
 {
     size_t i;
 
-    tcg_region_tree_lock_all();
     for (i = 0; i < region.n; i++) {
-        struct tcg_region_tree *rt = region_trees + i * tree_size;
-
-        /* Increment the refcount first so that destroy acts as a reset */
-        g_tree_ref(rt->tree);
-        g_tree_destroy(rt->tree);
-    }
-    tcg_region_tree_unlock_all();
-}
-
-static void tcg_region_bounds(size_t curr_region, void **pstart, void **pend)
-{
-    void *start, *end;
-
-    start = region.start_aligned + curr_region * region.stride;
-    end = start + region.size;
-
-    if (curr_region == 0) {
-        start = region.start;
-    }
-    if (curr_region == region.n - 1) {
-        end = region.end;
+        atomic_set(&region_tbs_at(i)->n, 0);
     }
-
-    *pstart = start;
-    *pend = end;
 }
 
 static void tcg_region_assign(TCGContext *s, size_t curr_region)
@@ -549,11 +563,14 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
+    size_t i = find_first_zero_bit(region.used, region.n);
+
+    if (i == region.n) {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    set_bit(i, region.used);
+    region.alloc_seq[i] = region.seq++;
+    tcg_region_assign(s, i);
     return false;
 }
 
@@ -592,7 +609,8 @@ void tcg_region_reset_all(void)
     unsigned int i;
 
     qemu_mutex_lock(&region.lock);
-    region.current = 0;
+    bitmap_zero(region.used, region.n);
+    region.seq = 0;
     region.agg_size_full = 0;
 
     for (i = 0; i < n_ctxs; i++) {
@@ -603,7 +621,81 @@ void tcg_region_reset_all(void)
     }
     qemu_mutex_unlock(&region.lock);
 
-    tcg_region_tree_reset_all();
+    tcg_region_tbs_reset_all();
+}
+
+static int tcg_region_seq_cmp(const void *ap, const void *bp)
+{
+    uint64_t a = *(const uint64_t *)ap;
+    uint64_t b = *(const uint64_t *)bp;
+
+    return a < b ? -1 : a > b;
+}
+
+/*
+ * Call from a safe-work context.
+ *
+ * Reclaim the older half of the full regions, i.e. those that are not
+ * currently assigned to a context: every TB in them is passed to @func,
+ * which must detach it from the rest of the system, and the regions
+ * then become available for allocation again.  This keeps recently
+ * generated code resident, unlike tcg_region_reset_all().
+ *
+ * Returns false without doing anything if there are too few full
+ * regions for this to be worthwhile; flush everything instead.
+ */
+bool tcg_region_reclaim(GTraverseFunc func, gpointer user_data)
+{
+    unsigned int n_ctxs = atomic_read(&n_tcg_ctxs);
+    unsigned long *full = bitmap_new(region.n);
+    uint64_t *seqs = g_new(uint64_t, region.n);
+    uint64_t limit;
+    size_t i, n_full, n_victims;
+
+    qemu_mutex_lock(&region.lock);
+    bitmap_copy(full, region.used, region.n);
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = atomic_read(&tcg_ctxs[i]);
+
+        clear_bit(tc_ptr_to_region_idx(s->code_gen_buffer), full);
+    }
+
+    n_full = 0;
+    for (i = find_first_bit(full, region.n); i < region.n;
+         i = find_next_bit(full, region.n, i + 1)) {
+        seqs[n_full++] = region.alloc_seq[i];
+    }
+    n_victims = n_full / 2;
+    if (n_victims == 0) {
+        qemu_mutex_unlock(&region.lock);
+        g_free(seqs);
+        g_free(full);
+        return false;
+    }
+    qsort(seqs, n_full, sizeof(uint64_t), tcg_region_seq_cmp);
+    limit = seqs[n_victims - 1];
+
+    for (i = find_first_bit(full, region.n); i < region.n;
+         i = find_next_bit(full, region.n, i + 1)) {
+        struct tcg_region_tbs *rt = region_tbs_at(i);
+        void *start, *end;
+
+        if (region.alloc_seq[i] > limit) {
+            continue;
+        }
+
+        tcg_region_tbs_foreach(rt, func, user_data);
+        atomic_set(&rt->n, 0);
+
+        tcg_region_bounds(i, &start, &end);
+        region.agg_size_full -= (end - start) - TCG_HIGHWATER;
+        clear_bit(i, region.used);
+    }
+    qemu_mutex_unlock(&region.lock);
+
+    g_free(seqs);
+    g_free(full);
+    return true;
 }
 
 #ifdef CONFIG_USER_ONLY
@@ -709,6 +801,8 @@ void tcg_region_init(void)
     region.stride = region_size;
     region.start = buf;
     region.start_aligned = aligned;
+    region.used = bitmap_new(region.n);
+    region.alloc_seq = g_new0(uint64_t, region.n);
     /* page-align the end, since its last page will be a guard page */
     region.end = QEMU_ALIGN_PTR_DOWN(buf + size, page_size);
     /* account for that last guard page */
@@ -724,7 +818,7 @@ void tcg_region_init(void)
         g_assert(!rc);
     }
 
-    tcg_region_trees_init();
+    tcg_region_tbs_init();
 
     /* In user-mode we support only one ctx, so do the initial allocation now */
 #ifdef CONFIG_USER_ONLY
@@ -3150,6 +3244,40 @@ static void tcg_reg_free(TCGContext *s, TCGReg reg, TCGRegSet allocated_regs)
     }
 }
 
+/* A value that is still live in call-clobbered register 'reg' across a
+   call would otherwise be stored to memory and reloaded after the call.
+   If a call-saved register is free, move it there instead.  Returns
+   false if no such register is available.  */
+static bool tcg_reg_preserve(TCGContext *s, TCGReg reg,
+                             TCGRegSet allocated_regs)
+{
+    TCGTemp *ts = s->reg_to_temp[reg];
+    TCGRegSet set;
+    int i;
+
+    if (ts == NULL) {
+        return true;
+    }
+    set = tcg_target_available_regs[ts->type]
+        & ~tcg_target_call_clobber_regs & ~allocated_regs;
+    if (set == 0) {
+        return false;
+    }
+    for (i = 0; i < ARRAY_SIZE(tcg_target_reg_alloc_order); i++) {
+        TCGReg nreg = tcg_target_reg_alloc_order[i];
+        if (tcg_regset_test_reg(set, nreg) && s->reg_to_temp[nreg] == NULL) {
+            if (!tcg_out_mov(s, ts->type, nreg, reg)) {
+                return false;
+            }
+            s->reg_to_temp[reg] = NULL;
+            s->reg_to_temp[nreg] = ts;
+            ts->reg = nreg;
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * tcg_reg_alloc:
  * @required_regs: Set of registers in which we must allocate.
@@ -3835,9 +3963,11 @@ static void tcg_reg_alloc_call(TCGContext *s, TCGOp *op)
         }
     }
     
-    /* clobber call registers */
+    /* clobber call registers, keeping live values in call-saved
+       registers where possible */
     for (i = 0; i < TCG_TARGET_NB_REGS; i++) {
-        if (tcg_regset_test_reg(tcg_target_call_clobber_regs, i)) {
+        if (tcg_regset_test_reg(tcg_target_call_clobber_regs, i)
+            && !tcg_reg_preserve(s, i, allocated_regs)) {
             tcg_reg_free(s, i, allocated_regs);
         }
     }
@@ -0,0 +1,231 @@
+# Boot-time benchmark for the raspi machines
+#
+# Boots a kernel and a minimal initramfs on the raspi machines a number
+# of times, and checks the boot times against a stored baseline, so that
+# slowdowns in TCG or in the bcm283x models show up.
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or
+# later.  See the COPYING file in the top-level directory.
+
+import os
+import gzip
+import json
+import time
+import shutil
+import logging
+
+from avocado_qemu import Test
+from avocado.utils import process
+from avocado.utils import archive
+
+
+class BootTimeRaspi(Test):
+    """
+    Measures, for every boot of a raspi machine:
+
+    - first_byte: seconds from starting QEMU to the first console byte
+    - init: seconds from starting QEMU to init running
+    - cpu: host CPU seconds used by QEMU up to init running
+
+    The median of each is compared with the baseline.  Parameters, given
+    with "avocado run -p NAME=VALUE":
+
+    iterations        boots per machine (default: 3)
+    baseline          JSON file with the reference times.  Machines that
+                      it lacks are added from this run.
+    update_baseline   "yes" to store this run as the new baseline
+    threshold         allowed slowdown over the baseline, in percent
+                      (default: 15)
+    init_pattern      console line printed once init runs
+                      (default: "Boot successful.")
+    MACHINE_kernel, MACHINE_dtb, MACHINE_initrd
+                      local files to boot on MACHINE instead of the
+                      default assets.  raspi3 and raspi4 have no default
+                      and are skipped without them.
+
+    The results of the run are written to boot-time.json in the test's
+    output directory.
+    """
+
+    timeout = 1800
+
+    KERNEL_COMMON_COMMAND_LINE = 'printk.time=0 '
+
+    def extract_from_deb(self, deb, path):
+        """
+        Extracts a file from a deb package into the test workdir
+
+        :param deb: path to the deb archive
+        :param file: path within the deb archive of the file to be extracted
+        :returns: path of the extracted file
+        """
+        cwd = os.getcwd()
+        os.chdir(self.workdir)
+        file_path = process.run("ar t %s" % deb).stdout_text.split()[2]
+        process.run("ar x %s %s" % (deb, file_path))
+        archive.extract(file_path, self.workdir)
+        os.chdir(cwd)
+        return self.workdir + path
+
+    def gunzip(self, path_gz, name):
+        path = os.path.join(self.workdir, name)
+        with gzip.open(path_gz, 'rb') as f_in:
+            with open(path, 'wb') as f_out:
+                shutil.copyfileobj(f_in, f_out)
+        return path
+
+    def raspi2_assets(self):
+        deb_url = ('http://archive.raspberrypi.org/debian/'
+                   'pool/main/r/raspberrypi-firmware/'
+                   'raspberrypi-kernel_1.20190215-1_armhf.deb')
+        deb_hash = 'cd284220b32128c5084037553db3c482426f3972'
+        deb_path = self.fetch_asset(deb_url, asset_hash=deb_hash)
+        kernel_path = self.extract_from_deb(deb_path, '/boot/kernel7.img')
+        dtb_path = self.extract_from_deb(deb_path, '/boot/bcm2709-rpi-2-b.dtb')
+        initrd_url = ('https://github.com/groeck/linux-build-test/raw/'
+                      '2eb0a73b5d5a28df3170c546ddaaa9757e1e0848/rootfs/'
+                      'arm/rootfs-armv7a.cpio.gz')
+        initrd_hash = '604b2e45cdf35045846b8bbfbf2129b1891bdc9c'
+        initrd_path_gz = self.fetch_asset(initrd_url, asset_hash=initrd_hash)
+        initrd_path = self.gunzip(initrd_path_gz, 'rootfs.cpio')
+        return kernel_path, dtb_path, initrd_path
+
+    def get_assets(self, machine, default=None):
+        files = [self.params.get('%s_%s' % (machine, what))
+                 for what in ('kernel', 'dtb', 'initrd')]
+        if all(files):
+            return files
+        if default is None:
+            self.cancel('%s_kernel, %s_dtb and %s_initrd are needed to '
+                        'boot %s' % (machine, machine, machine, machine))
+        return default()
+
+    @staticmethod
+    def cpu_seconds(pid):
+        """Host CPU time (user + system) used so far by process @pid"""
+        with open('/proc/%d/stat' % pid) as f:
+            # the command name, in parentheses, may contain spaces
+            fields = f.read().rsplit(')', 1)[1].split()
+        return (int(fields[11]) + int(fields[12])) / os.sysconf('SC_CLK_TCK')
+
+    def boot_once(self, machine, kernel, dtb, initrd, init_pattern):
+        vm = self.get_vm()
+        vm.set_machine(machine)
+        vm.set_console()
+        kernel_command_line = (self.KERNEL_COMMON_COMMAND_LINE +
+                               'console=ttyAMA0 rdinit=/sbin/init')
+        # Stopped until the console is connected, so that no byte is lost
+        vm.add_args('-S',
+                    '-kernel', kernel,
+                    '-dtb', dtb,
+                    '-initrd', initrd,
+                    '-append', kernel_command_line,
+                    '-no-reboot')
+
+        start = time.monotonic()
+        vm.launch()
+        console = vm.console_socket
+        console.settimeout(self.timeout)
+        vm.command('cont')
+
+        console_logger = logging.getLogger('console')
+        first_byte = None
+        line = b''
+        while True:
+            data = console.recv(4096)
+            if not data:
+                self.fail('Console closed before init started')
+            if first_byte is None:
+                first_byte = time.monotonic() - start
+            line += data
+            *lines, line = line.split(b'\n')
+            for msg in lines:
+                msg = msg.decode(errors='replace').strip()
+                console_logger.debug(msg)
+                if 'Kernel panic - not syncing' in msg:
+                    self.fail('Kernel panic on %s' % machine)
+                if init_pattern in msg:
+                    result = {'first_byte': first_byte,
+                              'init': time.monotonic() - start,
+                              'cpu': self.cpu_seconds(vm.get_pid())}
+                    vm.shutdown()
+                    return result
+
+    @staticmethod
+    def median(values):
+        values = sorted(values)
+        mid = len(values) // 2
+        if len(values) % 2:
+            return values[mid]
+        return (values[mid - 1] + values[mid]) / 2
+
+    def load_baseline(self, path):
+        if path and os.path.exists(path):
+            with open(path) as f:
+                return json.load(f)
+        return {}
+
+    def store_json(self, path, data):
+        with open(path, 'w') as f:
+            json.dump(data, f, indent=4, sort_keys=True)
+            f.write('\n')
+
+    def do_test_boot_time(self, machine, default_assets=None):
+        kernel, dtb, initrd = self.get_assets(machine, default_assets)
+        iterations = int(self.params.get('iterations', default=3))
+        threshold = float(self.params.get('threshold', default=15))
+        init_pattern = self.params.get('init_pattern',
+                                       default='Boot successful.')
+        baseline_path = self.params.get('baseline')
+        update = self.params.get('update_baseline', default='no') == 'yes'
+
+        boots = [self.boot_once(machine, kernel, dtb, initrd, init_pattern)
+                 for _ in range(iterations)]
+        result = {key: self.median([b[key] for b in boots])
+                  for key in ('first_byte', 'init', 'cpu')}
+        for key, value in sorted(result.items()):
+            self.log.info('%s %s: %.3f s (%s)', machine, key, value,
+                          ' '.join('%.3f' % b[key] for b in boots))
+        self.store_json(os.path.join(self.outputdir, 'boot-time.json'),
+                        {machine: result})
+
+        baseline = self.load_baseline(baseline_path)
+        reference = baseline.get(machine)
+        if baseline_path and (update or reference is None):
+            baseline[machine] = result
+            self.store_json(baseline_path, baseline)
+        if update or reference is None:
+            return
+
+        slower = ['%s %.3f s over baseline %.3f s' % (key, result[key],
+                                                       reference[key])
+                  for key in sorted(result)
+                  if key in reference and
+                  result[key] > reference[key] * (1 + threshold / 100)]
+        if slower:
+            self.fail('%s boots more than %g%% slower: %s' %
+                      (machine, threshold, ', '.join(slower)))
+
+    def test_raspi2(self):
+        """
+        :avocado: tags=arch:arm
+        :avocado: tags=machine:raspi2
+        :avocado: tags=benchmark
+        """
+        self.do_test_boot_time('raspi2', self.raspi2_assets)
+
+    def test_raspi3(self):
+        """
+        :avocado: tags=arch:aarch64
+        :avocado: tags=machine:raspi3
+        :avocado: tags=benchmark
+        """
+        self.do_test_boot_time('raspi3')
+
+    def test_raspi4(self):
+        """
+        :avocado: tags=arch:aarch64
+        :avocado: tags=machine:raspi4
+        :avocado: tags=benchmark
+        """
+        self.do_test_boot_time('raspi4')
@@ -587,6 +587,29 @@ static void test_dummy_delchild(void)
     object_unparent(OBJECT(dev));
 }
 
+/* Checks that class properties added late are seen by the subclasses */
+#define TYPE_DUMMY_LATE "qemu-dummy-late"
+
+static const TypeInfo dummy_late_info = {
+    .name          = TYPE_DUMMY_LATE,
+    .parent        = TYPE_DUMMY_BACKEND,
+};
+
+static void test_dummy_late_class_prop(void)
+{
+    ObjectClass *parent = object_class_by_name(TYPE_DUMMY_BACKEND);
+    Object *obj = object_new(TYPE_DUMMY_LATE);
+
+    /* The lookup caches the properties of the class hierarchy... */
+    g_assert(!object_property_find(obj, "late", NULL));
+
+    /* ...which must not hide those added later to an ancestor */
+    object_class_property_add_bool(parent, "late", NULL, NULL, &error_abort);
+    g_assert(object_property_find(obj, "late", NULL));
+    g_assert(object_class_property_find(object_get_class(obj), "late", NULL));
+    object_unref(obj);
+}
+
 static void test_qom_partial_path(void)
 {
     Object *root  = object_get_objects_root();
@@ -637,6 +660,7 @@ int main(int argc, char **argv)
     type_register_static(&dummy_dev_info);
     type_register_static(&dummy_bus_info);
     type_register_static(&dummy_backend_info);
+    type_register_static(&dummy_late_info);
 
     g_test_add_func("/qom/proplist/createlist", test_dummy_createlist);
     g_test_add_func("/qom/proplist/createv", test_dummy_createv);
@@ -646,6 +670,8 @@ int main(int argc, char **argv)
     g_test_add_func("/qom/proplist/iterator", test_dummy_iterator);
     g_test_add_func("/qom/proplist/class_iterator", test_dummy_class_iterator);
     g_test_add_func("/qom/proplist/delchild", test_dummy_delchild);
+    g_test_add_func("/qom/proplist/late_class_prop",
+                    test_dummy_late_class_prop);
     g_test_add_func("/qom/resolve/partial", test_qom_partial_path);
 
     return g_test_run();
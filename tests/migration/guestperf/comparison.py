@@ -24,6 +24,27 @@ class Comparison(object):
         self._name = name
         self._scenarios = scenarios
 
+
+# Guest dirty rates, in MiB per second, swept for each migration mode:
+# 0 lets the guest dirty memory as fast as it can
+DIRTY_RATES = [100, 500, 1000, 0]
+
+DIRTY_RATE_MODES = [
+    ("pre-copy", {}),
+    ("post-copy", {"post_copy": True}),
+    ("multifd-4", {"multifd": True, "multifd_channels": 4}),
+    ("compr-mt-4", {"compression_mt": True, "compression_mt_threads": 4}),
+    ("compr-xbzrle-10", {"compression_xbzrle": True,
+                         "compression_xbzrle_cache": 10}),
+]
+
+def dirty_rate_comparison(mode, options):
+    scenarios = []
+    for rate in DIRTY_RATES:
+        name = "%s-dirty-%s" % (mode, "%dmbs" % rate if rate else "max")
+        scenarios.append(Scenario(name, dirty_rate=rate, **options))
+    return Comparison("%s-dirty-rate" % mode, scenarios=scenarios)
+
 COMPARISONS = [
     # Looking at effect of pausing guest during migration
     # at various stages of iteration over RAM
@@ -117,8 +138,42 @@ COMPARISONS = [
         Scenario("compr-xbzrle-cache-10",
                  compression_xbzrle=True, compression_xbzrle_cache=10),
         Scenario("compr-xbzrle-cache-20",
-                 compression_xbzrle=True, compression_xbzrle_cache=10),
+                 compression_xbzrle=True, compression_xbzrle_cache=20),
         Scenario("compr-xbzrle-cache-50",
                  compression_xbzrle=True, compression_xbzrle_cache=50),
     ]),
+
+
+    # Looking at effect of multifd with varying numbers
+    # of channels
+    Comparison("multifd-channels", scenarios = [
+        Scenario("multifd-channels-1",
+                 multifd=True, multifd_channels=1),
+        Scenario("multifd-channels-2",
+                 multifd=True, multifd_channels=2),
+        Scenario("multifd-channels-4",
+                 multifd=True, multifd_channels=4),
+        Scenario("multifd-channels-8",
+                 multifd=True, multifd_channels=8),
+    ]),
+
+
+    # Looking at effect of the zlib level of multi-thread
+    # compression
+    Comparison("compr-mt-level", scenarios = [
+        Scenario("compr-mt-level-1",
+                 compression_mt=True, compression_mt_threads=4,
+                 compression_mt_level=1),
+        Scenario("compr-mt-level-6",
+                 compression_mt=True, compression_mt_threads=4,
+                 compression_mt_level=6),
+        Scenario("compr-mt-level-9",
+                 compression_mt=True, compression_mt_threads=4,
+                 compression_mt_level=9),
+    ]),
+] + [
+    # Looking at how each migration mode copes with the rate
+    # at which the guest dirties its memory
+    dirty_rate_comparison(mode, options)
+    for mode, options in DIRTY_RATE_MODES
 ]
@@ -36,12 +36,13 @@ from qemu.machine import QEMUMachine
 class Engine(object):
 
     def __init__(self, binary, dst_host, kernel, initrd, transport="tcp",
-                 sleep=15, verbose=False, debug=False):
+                 sleep=15, verbose=False, debug=False, dtb=None):
 
         self._binary = binary # Path to QEMU binary
         self._dst_host = dst_host # Hostname of target host
         self._kernel = kernel # Path to kernel image
         self._initrd = initrd # Path to stress initrd
+        self._dtb = dtb # Path to device tree blob, for raspi4
         self._transport = transport # 'unix' or 'tcp' or 'rdma'
         self._sleep = sleep
         self._verbose = verbose
@@ -150,6 +151,22 @@ class Engine(object):
                                      "state": True }
                                ])
 
+        if scenario._multifd:
+            resp = src.command("migrate-set-capabilities",
+                               capabilities = [
+                                   { "capability": "multifd",
+                                     "state": True }
+                               ])
+            resp = src.command("migrate-set-parameters",
+                               multifd_channels=scenario._multifd_channels)
+            resp = dst.command("migrate-set-capabilities",
+                               capabilities = [
+                                   { "capability": "multifd",
+                                     "state": True }
+                               ])
+            resp = dst.command("migrate-set-parameters",
+                               multifd_channels=scenario._multifd_channels)
+
         resp = src.command("migrate_set_speed",
                            value=scenario._bandwidth * 1024 * 1024)
 
@@ -163,7 +180,8 @@ class Engine(object):
                                      "state": True }
                                ])
             resp = src.command("migrate-set-parameters",
-                               compress_threads=scenario._compression_mt_threads)
+                               compress_threads=scenario._compression_mt_threads,
+                               compress_level=scenario._compression_mt_level)
             resp = dst.command("migrate-set-capabilities",
                                capabilities = [
                                    { "capability": "compress",
@@ -265,15 +283,56 @@ class Engine(object):
                 resp = src.command("stop")
                 paused = True
 
-    def _get_common_args(self, hardware, tunnelled=False):
-        args = [
-            "noapic",
-            "edd=off",
+    def _get_machine_args(self, hardware):
+        mem = (hardware._mem * 1024) + 512
+        if hardware._machine == "pc":
+            args = [
+                "noapic",
+                "edd=off",
+                "noreplace-smp",
+                "pci=noearly",
+                "console=ttyS0",
+            ]
+            argv = [
+                "-machine", "accel=kvm",
+                "-cpu", "host",
+                "-device", "isa-serial,chardev=cdev0",
+                "-m", str(mem),
+                "-smp", str(hardware._cpus),
+            ]
+            if self._debug:
+                argv.extend(["-device", "sga"])
+        elif hardware._machine == "virt":
+            args = ["console=ttyAMA0"]
+            argv = [
+                "-machine", "virt,accel=kvm:tcg",
+                "-cpu", "max",
+                "-serial", "chardev:cdev0",
+                "-m", str(mem),
+                "-smp", str(hardware._cpus),
+            ]
+        elif hardware._machine == "raspi4":
+            # The board has 4 CPUs and a power of 2 of RAM
+            ramsize = 1024
+            while ramsize < mem:
+                ramsize *= 2
+            args = ["console=ttyAMA0"]
+            argv = [
+                "-machine", "raspi4",
+                "-serial", "chardev:cdev0",
+                "-m", str(ramsize),
+            ]
+            if self._dtb:
+                argv.extend(["-dtb", self._dtb])
+        else:
+            raise Exception("Unsupported machine %s" % hardware._machine)
+        return args, argv
+
+    def _get_common_args(self, hardware, scenario, tunnelled=False):
+        args, machine_argv = self._get_machine_args(hardware)
+        args += [
             "printk.time=1",
-            "noreplace-smp",
             "cgroup_disable=memory",
-            "pci=noearly",
-            "console=ttyS0",
         ]
         if self._debug:
             args.append("debug")
@@ -281,25 +340,19 @@ class Engine(object):
             args.append("quiet")
 
         args.append("ramsize=%s" % hardware._mem)
+        if scenario._dirty_rate:
+            args.append("dirtyrate=%d" % scenario._dirty_rate)
 
         cmdline = " ".join(args)
         if tunnelled:
             cmdline = "'" + cmdline + "'"
 
         argv = [
-            "-machine", "accel=kvm",
-            "-cpu", "host",
             "-kernel", self._kernel,
             "-initrd", self._initrd,
             "-append", cmdline,
             "-chardev", "stdio,id=cdev0",
-            "-device", "isa-serial,chardev=cdev0",
-            "-m", str((hardware._mem * 1024) + 512),
-            "-smp", str(hardware._cpus),
-        ]
-
-        if self._debug:
-            argv.extend(["-device", "sga"])
+        ] + machine_argv
 
         if hardware._prealloc_pages:
             argv_source += ["-mem-path", "/dev/shm",
@@ -311,14 +364,14 @@ class Engine(object):
 
         return argv
 
-    def _get_src_args(self, hardware):
-        return self._get_common_args(hardware)
+    def _get_src_args(self, hardware, scenario):
+        return self._get_common_args(hardware, scenario)
 
-    def _get_dst_args(self, hardware, uri):
+    def _get_dst_args(self, hardware, scenario, uri):
         tunnelled = False
         if self._dst_host != "localhost":
             tunnelled = True
-        argv = self._get_common_args(hardware, tunnelled)
+        argv = self._get_common_args(hardware, scenario, tunnelled)
         return argv + ["-incoming", uri]
 
     @staticmethod
@@ -387,13 +440,13 @@ class Engine(object):
         srcmonaddr = "/var/tmp/qemu-src-%d-monitor.sock" % os.getpid()
 
         src = QEMUMachine(self._binary,
-                          args=self._get_src_args(hardware),
+                          args=self._get_src_args(hardware, scenario),
                           wrapper=self._get_src_wrapper(hardware),
                           name="qemu-src-%d" % os.getpid(),
                           monitor_address=srcmonaddr)
 
         dst = QEMUMachine(self._binary,
-                          args=self._get_dst_args(hardware, uri),
+                          args=self._get_dst_args(hardware, scenario, uri),
                           wrapper=self._get_dst_wrapper(hardware),
                           name="qemu-dst-%d" % os.getpid(),
                           monitor_address=dstmonaddr)
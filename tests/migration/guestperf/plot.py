@@ -52,7 +52,8 @@ class Plot(object):
                  total_guest_cpu,
                  split_guest_cpu,
                  qemu_cpu,
-                 vcpu_cpu):
+                 vcpu_cpu,
+                 summary=False):
 
         self._reports = reports
         self._migration_iters = migration_iters
@@ -60,6 +61,7 @@ class Plot(object):
         self._split_guest_cpu = split_guest_cpu
         self._qemu_cpu = qemu_cpu
         self._vcpu_cpu = vcpu_cpu
+        self._summary = summary
         self._color_idx = 0
 
     def _next_color(self):
@@ -413,6 +415,47 @@ class Plot(object):
                     output_type="div")
 
 
+    SUMMARY_CHARTS = [("total_time", "Total migration time", "secs"),
+                      ("downtime", "Downtime", "milli-sec"),
+                      ("cpu_per_gb", "Source QEMU CPU time, excluding vCPUs",
+                       "secs per GB transferred")]
+
+    def _generate_summary_chart(self, key, title, unit):
+        from plotly.offline import plot
+        from plotly import graph_objs as go
+
+        names = []
+        values = []
+        for report in self._reports:
+            summary = report.summary()
+            if summary is None:
+                continue
+            names.append("%s (%s)" % (summary["name"], summary["machine"]))
+            values.append(summary[key])
+
+        bar = go.Bar(x=names, y=values,
+                     marker={"color": self._next_color()})
+        layout = go.Layout(title=title,
+                           xaxis={"title": "Scenario"},
+                           yaxis={"title": unit})
+        figure = go.Figure(data=[bar], layout=layout)
+
+        return plot(figure,
+                    show_link=False,
+                    include_plotlyjs=False,
+                    output_type="div")
+
+    def _generate_summary_charts(self):
+        return "\n".join([self._generate_summary_chart(key, title, unit)
+                          for key, title, unit in self.SUMMARY_CHARTS])
+
+    def _has_time_chart(self):
+        return (self._migration_iters or
+                self._total_guest_cpu or
+                self._split_guest_cpu or
+                self._qemu_cpu or
+                self._vcpu_cpu)
+
     def _generate_report(self):
         pieces = []
         for report in self._reports:
@@ -453,6 +496,10 @@ class Plot(object):
   <tr class="subhead">
     <th colspan="2">Hardware config</th>
   </tr>
+  <tr>
+    <th>Machine:</th>
+    <td>%s</td>
+  </tr>
   <tr>
     <th>CPUs:</th>
     <td>%d</td>
@@ -489,7 +536,7 @@ class Plot(object):
     <th>Huge pages:</th>
     <td>%s</td>
   </tr>
-""" % (hardware._cpus, hardware._mem,
+""" % (hardware._machine, hardware._cpus, hardware._mem,
        ",".join(hardware._src_cpu_bind),
        ",".join(hardware._src_mem_bind),
        ",".join(hardware._dst_cpu_bind),
@@ -551,6 +598,10 @@ class Plot(object):
     <th>MT compression threads:</th>
     <td>%d</td>
   </tr>
+  <tr>
+    <th>MT compression level:</th>
+    <td>%d</td>
+  </tr>
   <tr>
     <th>XBZRLE compression:</th>
     <td>%s</td>
@@ -559,13 +610,28 @@ class Plot(object):
     <th>XBZRLE compression cache:</th>
     <td>%d%% of RAM</td>
   </tr>
+  <tr>
+    <th>Multifd:</th>
+    <td>%s</td>
+  </tr>
+  <tr>
+    <th>Multifd channels:</th>
+    <td>%d</td>
+  </tr>
+  <tr>
+    <th>Guest dirty rate:</th>
+    <td>%s</td>
+  </tr>
 """ % (scenario._downtime, scenario._bandwidth,
        scenario._max_iters, scenario._max_time,
        "yes" if scenario._pause else "no", scenario._pause_iters,
        "yes" if scenario._post_copy else "no", scenario._post_copy_iters,
        "yes" if scenario._auto_converge else "no", scenario._auto_converge_step,
        "yes" if scenario._compression_mt else "no", scenario._compression_mt_threads,
-       "yes" if scenario._compression_xbzrle else "no", scenario._compression_xbzrle_cache))
+       scenario._compression_mt_level,
+       "yes" if scenario._compression_xbzrle else "no", scenario._compression_xbzrle_cache,
+       "yes" if scenario._multifd else "no", scenario._multifd_channels,
+       ("%d MB/sec" % scenario._dirty_rate) if scenario._dirty_rate else "unlimited"))
 
             pieces.append("""
 </table>
@@ -603,7 +669,10 @@ class Plot(object):
     <h2>Chart summary</h2>
     <div id="chart">
 """ % self._generate_style(), file=fh)
-        print(self._generate_chart(), file=fh)
+        if self._has_time_chart():
+            print(self._generate_chart(), file=fh)
+        if self._summary:
+            print(self._generate_summary_charts(), file=fh)
         print("""
     </div>
     <h2>Report details</h2>
@@ -85,6 +85,49 @@ class Report(object):
             data["transport"],
             data["sleep"])
 
+    @staticmethod
+    def _cpu_time(timings, start, end):
+        # CPU milliseconds used by each thread between start and end
+        first = {}
+        last = {}
+        for record in timings._records:
+            if record._timestamp <= start or record._tid not in first:
+                first[record._tid] = record._value
+            if record._timestamp <= end:
+                last[record._tid] = record._value
+        return {tid: last[tid] - first[tid] for tid in last}
+
+    def summary(self):
+        """
+        Returns the figures used to plan migration capacity: status,
+        total time (secs), downtime (ms), data transferred (GiB), and
+        CPU time of the source QEMU outside of its vCPUs, per GiB
+        transferred (secs).
+        """
+        if len(self._progress_history) == 0:
+            return None
+        start = self._progress_history[0]
+        end = self._progress_history[-1]
+
+        transferred = end._ram._transferred_bytes / (1024.0 * 1024 * 1024)
+        qemu = sum(self._cpu_time(self._qemu_timings,
+                                  start._now, end._now).values())
+        vcpu = sum(self._cpu_time(self._vcpu_timings,
+                                  start._now, end._now).values())
+        cpu_per_gb = 0
+        if transferred > 0:
+            cpu_per_gb = (qemu - vcpu) / 1000.0 / transferred
+
+        return {
+            "name": self._scenario._name,
+            "machine": self._hardware._machine,
+            "status": end._status,
+            "total_time": end._duration / 1000.0,
+            "downtime": end._downtime,
+            "transferred": transferred,
+            "cpu_per_gb": cpu_per_gb,
+        }
+
     def to_json(self):
         return json.dumps(self.serialize(), indent=4)
 
@@ -29,7 +29,10 @@ class Scenario(object):
                  post_copy=False, post_copy_iters=5,
                  auto_converge=False, auto_converge_step=10,
                  compression_mt=False, compression_mt_threads=1,
-                 compression_xbzrle=False, compression_xbzrle_cache=10):
+                 compression_xbzrle=False, compression_xbzrle_cache=10,
+                 multifd=False, multifd_channels=2,
+                 compression_mt_level=1,
+                 dirty_rate=0):
 
         self._name = name
 
@@ -55,6 +58,13 @@ class Scenario(object):
 
         self._compression_xbzrle = compression_xbzrle
         self._compression_xbzrle_cache = compression_xbzrle_cache # percentage of guest RAM
+        self._compression_mt_level = compression_mt_level # zlib level
+
+        self._multifd = multifd
+        self._multifd_channels = multifd_channels
+
+        # Guest workload
+        self._dirty_rate = dirty_rate # MiB per second, 0 is unlimited
 
     def serialize(self):
         return {
@@ -73,6 +83,10 @@ class Scenario(object):
             "compression_mt_threads": self._compression_mt_threads,
             "compression_xbzrle": self._compression_xbzrle,
             "compression_xbzrle_cache": self._compression_xbzrle_cache,
+            "multifd": self._multifd,
+            "multifd_channels": self._multifd_channels,
+            "compression_mt_level": self._compression_mt_level,
+            "dirty_rate": self._dirty_rate,
         }
 
     @classmethod
@@ -92,4 +106,8 @@ class Scenario(object):
             data["compression_mt"],
             data["compression_mt_threads"],
             data["compression_xbzrle"],
-            data["compression_xbzrle_cache"])
+            data["compression_xbzrle_cache"],
+            data.get("multifd", False),
+            data.get("multifd_channels", 2),
+            data.get("compression_mt_level", 1),
+            data.get("dirty_rate", 0))
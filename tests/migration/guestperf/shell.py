@@ -49,6 +49,7 @@ class BaseShell(object):
         parser.add_argument("--kernel", dest="kernel", default="/boot/vmlinuz-%s" % platform.release())
         parser.add_argument("--initrd", dest="initrd", default="tests/migration/initrd-stress.img")
         parser.add_argument("--transport", dest="transport", default="unix")
+        parser.add_argument("--dtb", dest="dtb", default=None)
 
 
         # Hardware args
@@ -61,6 +62,8 @@ class BaseShell(object):
         parser.add_argument("--prealloc-pages", dest="prealloc_pages", default=False)
         parser.add_argument("--huge-pages", dest="huge_pages", default=False)
         parser.add_argument("--locked-pages", dest="locked_pages", default=False)
+        parser.add_argument("--machine", dest="machine", default="pc",
+                            choices=["pc", "virt", "raspi4"])
 
         self._parser = parser
 
@@ -72,7 +75,8 @@ class BaseShell(object):
                       transport=args.transport,
                       sleep=args.sleep,
                       debug=args.debug,
-                      verbose=args.verbose)
+                      verbose=args.verbose,
+                      dtb=args.dtb)
 
     def get_hardware(self, args):
         def split_map(value):
@@ -90,7 +94,8 @@ class BaseShell(object):
 
                         locked_pages=args.locked_pages,
                         huge_pages=args.huge_pages,
-                        prealloc_pages=args.prealloc_pages)
+                        prealloc_pages=args.prealloc_pages,
+                        machine=args.machine)
 
 
 class Shell(BaseShell):
@@ -119,10 +124,16 @@ class Shell(BaseShell):
 
         parser.add_argument("--compression-mt", dest="compression_mt", default=False, action="store_true")
         parser.add_argument("--compression-mt-threads", dest="compression_mt_threads", default=1, type=int)
+        parser.add_argument("--compression-mt-level", dest="compression_mt_level", default=1, type=int)
 
         parser.add_argument("--compression-xbzrle", dest="compression_xbzrle", default=False, action="store_true")
         parser.add_argument("--compression-xbzrle-cache", dest="compression_xbzrle_cache", default=10, type=int)
 
+        parser.add_argument("--multifd", dest="multifd", default=False, action="store_true")
+        parser.add_argument("--multifd-channels", dest="multifd_channels", default=2, type=int)
+
+        parser.add_argument("--dirty-rate", dest="dirty_rate", default=0, type=int)
+
     def get_scenario(self, args):
         return Scenario(name="perfreport",
                         downtime=args.downtime,
@@ -143,7 +154,13 @@ class Shell(BaseShell):
                         compression_mt_threads=args.compression_mt_threads,
 
                         compression_xbzrle=args.compression_xbzrle,
-                        compression_xbzrle_cache=args.compression_xbzrle_cache)
+                        compression_xbzrle_cache=args.compression_xbzrle_cache,
+                        compression_mt_level=args.compression_mt_level,
+
+                        multifd=args.multifd,
+                        multifd_channels=args.multifd_channels,
+
+                        dirty_rate=args.dirty_rate)
 
     def run(self, argv):
         args = self._parser.parse_args(argv)
@@ -234,9 +251,23 @@ class PlotShell(object):
         self._parser.add_argument("--split-guest-cpu", dest="split_guest_cpu", default=False, action="store_true")
         self._parser.add_argument("--qemu-cpu", dest="qemu_cpu", default=False, action="store_true")
         self._parser.add_argument("--vcpu-cpu", dest="vcpu_cpu", default=False, action="store_true")
+        self._parser.add_argument("--summary", dest="summary", default=False, action="store_true")
+        self._parser.add_argument("--summary-csv", dest="summary_csv", default=None)
 
         self._parser.add_argument("reports", nargs='*')
 
+    @staticmethod
+    def write_summary_csv(reports, filename):
+        keys = ["name", "machine", "status", "total_time", "downtime",
+                "transferred", "cpu_per_gb"]
+        with open(filename, "w") as fh:
+            print(",".join(keys), file=fh)
+            for report in reports:
+                summary = report.summary()
+                if summary is not None:
+                    print(",".join([str(summary[key]) for key in keys]),
+                          file=fh)
+
     def run(self, argv):
         args = self._parser.parse_args(argv)
         logging.basicConfig(level=(logging.DEBUG if args.debug else
@@ -251,7 +282,9 @@ class PlotShell(object):
         if not (args.qemu_cpu or
                 args.vcpu_cpu or
                 args.total_guest_cpu or
-                args.split_guest_cpu):
+                args.split_guest_cpu or
+                args.summary or
+                args.summary_csv):
             print("At least one chart type is required", file=sys.stderr)
             return 1
 
@@ -259,11 +292,21 @@ class PlotShell(object):
         for report in args.reports:
             reports.append(Report.from_json_file(report))
 
+        if args.summary_csv:
+            self.write_summary_csv(reports, args.summary_csv)
+            if not (args.qemu_cpu or
+                    args.vcpu_cpu or
+                    args.total_guest_cpu or
+                    args.split_guest_cpu or
+                    args.summary):
+                return 0
+
         plot = Plot(reports,
                     args.migration_iters,
                     args.total_guest_cpu,
                     args.split_guest_cpu,
                     args.qemu_cpu,
-                    args.vcpu_cpu)
+                    args.vcpu_cpu,
+                    args.summary)
 
         plot.generate(args.output)
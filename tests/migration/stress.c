@@ -27,6 +27,9 @@
 
 const char *argv0;
 
+/* MB per second that each thread may dirty, 0 for no limit */
+static unsigned long long dirtyrateMB;
+
 #define PAGE_SIZE 4096
 
 static int gettid(void)
@@ -177,6 +180,7 @@ static int stressone(unsigned long long ramsizeMB)
     char *dataptr;
     size_t nMB = 0;
     unsigned long long before, after;
+    unsigned long long throttle_start, throttle_MB = 0, elapsed, target;
 
     if (!ram) {
         fprintf(stderr, "%s (%05d): ERROR: cannot allocate %llu MB of RAM: %s\n",
@@ -203,7 +207,7 @@ static int stressone(unsigned long long ramsizeMB)
         return -1;
     }
 
-    before = now();
+    before = throttle_start = now();
 
     while (1) {
 
@@ -225,6 +229,20 @@ static int stressone(unsigned long long ramsizeMB)
                 before = now();
                 nMB = 0;
             }
+
+            if (dirtyrateMB) {
+                /* Sleep off whatever is ahead of the dirty rate, but
+                 * don't make up for lost time with a burst */
+                throttle_MB++;
+                elapsed = now() - throttle_start;
+                target = throttle_MB * 1000 / dirtyrateMB;
+                if (elapsed < target) {
+                    usleep((target - elapsed) * 1000);
+                } else {
+                    throttle_start = now();
+                    throttle_MB = 0;
+                }
+            }
         }
     }
 
@@ -242,10 +260,15 @@ static void *stressthread(void *arg)
     return NULL;
 }
 
-static int stress(unsigned long long ramsizeGB, int ncpus)
+static int stress(unsigned long long ramsizeGB, int ncpus,
+                  unsigned long long rateMB)
 {
     size_t i;
     unsigned long long ramsizeMB = ramsizeGB * 1024 / ncpus;
+
+    if (rateMB) {
+        dirtyrateMB = MAX(rateMB / ncpus, 1);
+    }
     ncpus--;
 
     for (i = 0; i < ncpus; i++) {
@@ -293,14 +316,16 @@ static int mount_all(void)
 int main(int argc, char **argv)
 {
     unsigned long long ramsizeGB = 1;
+    unsigned long long rateMB = 0;
     char *end;
     int ch;
     int opt_ind = 0;
-    const char *sopt = "hr:c:";
+    const char *sopt = "hr:c:d:";
     struct option lopt[] = {
         { "help", no_argument, NULL, 'h' },
         { "ramsize", required_argument, NULL, 'r' },
         { "cpus", required_argument, NULL, 'c' },
+        { "dirtyrate", required_argument, NULL, 'd' },
         { NULL, 0, NULL, 0 }
     };
     int ret;
@@ -330,9 +355,20 @@ int main(int argc, char **argv)
             }
             break;
 
+        case 'd':
+            errno = 0;
+            rateMB = strtoll(optarg, &end, 10);
+            if (errno != 0 || *end) {
+                fprintf(stderr, "%s (%05d): ERROR: Cannot parse dirty rate %s\n",
+                        argv0, gettid(), optarg);
+                exit_failure();
+            }
+            break;
+
         case '?':
         case 'h':
-            fprintf(stderr, "%s: [--help][--ramsize GB][--cpus N]\n", argv0);
+            fprintf(stderr, "%s: [--help][--ramsize GB][--cpus N]"
+                    "[--dirtyrate MB/s]\n", argv0);
             exit_failure();
         }
     }
@@ -344,6 +380,10 @@ int main(int argc, char **argv)
         ret = get_command_arg_ull("ramsize", &ramsizeGB);
         if (ret < 0)
             exit_failure();
+
+        ret = get_command_arg_ull("dirtyrate", &rateMB);
+        if (ret < 0)
+            exit_failure();
     }
 
     if (ncpus == 0)
@@ -352,7 +392,7 @@ int main(int argc, char **argv)
     fprintf(stdout, "%s (%05d): INFO: RAM %llu GiB across %d CPUs\n",
             argv0, gettid(), ramsizeGB, ncpus);
 
-    if (stress(ramsizeGB, ncpus) < 0)
+    if (stress(ramsizeGB, ncpus, rateMB) < 0)
         exit_failure();
 
     exit_success();
@@ -0,0 +1,741 @@
+/*
+ * Raspberry Pi device model benchmarks
+ *
+ * Drives the bcm283x peripherals of the raspi machines through qtest and
+ * measures how fast the device models go.  Every result is printed on a
+ * line of its own, so that runs can be compared from one commit to the
+ * next:
+ *
+ *     raspi-bench,MACHINE,BENCHMARK,VALUE,UNIT
+ *
+ * Latencies include the qtest round trips needed to drive the device;
+ * they are only meaningful compared with other runs on the same host.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitops.h"
+#include "qemu/bswap.h"
+#include "qemu/units.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "hw/arm/raspi_platform.h"
+#include "hw/misc/bcm2835_mbox_defs.h"
+
+#define GPIO_PATH           "/machine/soc/peripherals/gpio"
+
+/* The peripherals on the VideoCore bus, as the DMA engine sees them */
+#define BUS_PERI_BASE       0x7e000000
+
+/* Scratch RAM, below the VideoCore RAM limit of every board */
+#define RAM_CB              0x01000000 /* DMA control blocks */
+#define RAM_MBOX            0x01100000 /* mailbox property buffer */
+#define RAM_SRC             0x02000000
+#define RAM_DST             0x04000000
+
+/* Legacy DMA channel 0 */
+#define DMA_CS              0x00
+#define DMA_CONBLK_AD       0x04
+#define DMA_CS_ACTIVE       (1 << 0)
+#define DMA_CS_END          (1 << 1)
+#define DMA_CS_ERROR        (1 << 8)
+#define DMA_CS_RESET        (1u << 31)
+#define DMA_TI_TDMODE       (1 << 1)
+#define DMA_TI_D_INC        (1 << 4)
+#define DMA_TI_D_DREQ       (1 << 6)
+#define DMA_TI_S_INC        (1 << 8)
+#define DMA_TI_S_DREQ       (1 << 10)
+#define DMA_TI_PERMAP(n)    ((n) << 16)
+#define DREQ_SDHOST         13
+
+/* Mailbox 0 is read by the ARM, mailbox 1 written */
+#define MAIL0_READ          0x80
+#define MAIL0_STATUS        0x98
+#define MAIL1_WRITE         0xa0
+#define MAIL_EMPTY          (1 << 30)
+
+/* Interrupt controller and GPIO */
+#define IRQ_PENDING_2       0x08
+#define IRQ_ENABLE_2        0x14
+#define GPFSEL1             0x04
+#define GPFSEL4             0x10
+#define GPFSEL5             0x14
+#define GPSET0              0x1c
+#define GPCLR0              0x28
+#define GPEDS0              0x40
+#define GPREN0              0x4c
+#define GPIO_IN_PIN         17
+#define GPIO_OUT_PIN        18
+
+/* SD Host Controller (sdhci, emmc2) */
+#define SDHC_BLKSIZE        0x04
+#define SDHC_ARGUMENT       0x08
+#define SDHC_TRNMOD         0x0c
+#define SDHC_TRNS_BLK_CNT_EN 0x0002
+#define SDHC_TRNS_ACMD12    0x0004
+#define SDHC_TRNS_READ      0x0010
+#define SDHC_TRNS_MULTI     0x0020
+#define SDHC_CMD_DATA       (1 << 5)
+#define SDHC_RSPREG0        0x10
+#define SDHC_BDATA          0x20
+#define SDHC_HOSTCTL        0x28
+#define SDHC_CLKCON         0x2c
+#define SDHC_NORINTSTS      0x30
+#define SDHC_NIS_TRSCMP     0x0002
+#define SDHC_NIS_ERR        0x8000
+#define SDHC_NORINTSTSEN    0x34
+
+/* bcm2835 sdhost */
+#define SDCMD               0x00
+#define SDARG               0x04
+#define SDRSP0              0x10
+#define SDHSTS              0x20
+#define SDVDD               0x30
+#define SDEDM               0x34
+#define SDHBCT              0x3c
+#define SDDATA              0x40
+#define SDHBLC              0x50
+#define SDCMD_NEW_FLAG      0x8000
+#define SDCMD_FAIL_FLAG     0x4000
+#define SDCMD_BUSYWAIT      0x800
+#define SDCMD_NO_RESPONSE   0x400
+#define SDCMD_LONG_RESPONSE 0x200
+#define SDCMD_WRITE_CMD     0x80
+#define SDCMD_READ_CMD      0x40
+#define SDEDM_FIFO_LEVEL(edm) (((edm) >> 4) & 0x1f)
+
+#define SD_IMG_SIZE         (16 * MiB)
+#define SD_XFER_SIZE        (4 * MiB)
+#define SD_BLOCK            512
+
+typedef struct RaspiMachine {
+    const char *name;
+    uint64_t peri_base;     /* seen by the CPU */
+    uint32_t sd_offset;     /* SD Host Controller wired to the card */
+    bool has_sdhost;        /* whether the GPIO mux can move the card */
+} RaspiMachine;
+
+static const RaspiMachine raspi_machines[] = {
+    { "raspi2", 0x3f000000, EMMC1_OFFSET, true },
+    { "raspi3", 0x3f000000, EMMC1_OFFSET, true },
+    { "raspi4", 0xfe000000, EMMC2_OFFSET, false },
+};
+
+typedef struct Bench {
+    const RaspiMachine *m;
+    QTestState *qts;
+    char *img;
+} Bench;
+
+typedef struct BenchCase {
+    const char *name;
+    void (*run)(Bench *b);
+    bool sd;
+    bool sdhost;
+} BenchCase;
+
+typedef struct BenchRun {
+    const RaspiMachine *m;
+    const BenchCase *c;
+} BenchRun;
+
+static void bench_report(Bench *b, const char *name, double value,
+                         const char *unit)
+{
+    g_print("raspi-bench,%s,%s,%.3f,%s\n", b->m->name, name, value, unit);
+}
+
+static uint32_t peri_readl(Bench *b, uint32_t offset)
+{
+    return qtest_readl(b->qts, b->m->peri_base + offset);
+}
+
+static void peri_writel(Bench *b, uint32_t offset, uint32_t value)
+{
+    qtest_writel(b->qts, b->m->peri_base + offset, value);
+}
+
+static double mb_per_sec(uint64_t bytes, int64_t usecs)
+{
+    return (double)bytes / MiB / (MAX(usecs, 1) / 1e6);
+}
+
+/*
+ * DMA
+ */
+
+static void dma_start(Bench *b, uint32_t ti, uint32_t src, uint32_t dst,
+                      uint32_t len, uint32_t stride)
+{
+    uint32_t cb[8] = { ti, src, dst, len, stride, 0, 0, 0 };
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(cb); i++) {
+        cb[i] = cpu_to_le32(cb[i]);
+    }
+    qtest_memwrite(b->qts, RAM_CB, cb, sizeof(cb));
+    peri_writel(b, DMA_OFFSET + DMA_CONBLK_AD, RAM_CB);
+    peri_writel(b, DMA_OFFSET + DMA_CS, DMA_CS_ACTIVE);
+}
+
+static void dma_wait(Bench *b)
+{
+    uint32_t cs;
+
+    /* The engine works from a bottom half, in slices */
+    do {
+        cs = peri_readl(b, DMA_OFFSET + DMA_CS);
+    } while (!(cs & DMA_CS_END));
+    g_assert(!(cs & DMA_CS_ERROR));
+    peri_writel(b, DMA_OFFSET + DMA_CS, DMA_CS_END);
+}
+
+static void dma_run(Bench *b, uint32_t ti, uint32_t src, uint32_t dst,
+                    uint32_t len, uint32_t stride)
+{
+    dma_start(b, ti, src, dst, len, stride);
+    dma_wait(b);
+}
+
+static void bench_dma_1d(Bench *b)
+{
+    const uint32_t len = 4 * MiB;
+    const int iters = 32;
+    int64_t t;
+    int i;
+
+    peri_writel(b, DMA_OFFSET + DMA_CS, DMA_CS_RESET);
+    qtest_memset(b->qts, RAM_SRC, 0x5a, len);
+
+    t = g_get_monotonic_time();
+    for (i = 0; i < iters; i++) {
+        dma_run(b, DMA_TI_S_INC | DMA_TI_D_INC, RAM_SRC, RAM_DST, len, 0);
+    }
+    t = g_get_monotonic_time() - t;
+    g_assert_cmphex(qtest_readl(b->qts, RAM_DST + len - 4), ==, 0x5a5a5a5a);
+
+    bench_report(b, "dma-1d", mb_per_sec((uint64_t)len * iters, t), "MB/s");
+}
+
+static void bench_dma_2d(Bench *b)
+{
+    /* Gather every other 1 KiB row of the source into a packed buffer */
+    const uint32_t xlen = 1 * KiB, ylen = 1024;
+    const int iters = 32;
+    int64_t t;
+    int i;
+
+    peri_writel(b, DMA_OFFSET + DMA_CS, DMA_CS_RESET);
+    qtest_memset(b->qts, RAM_SRC, 0xa5, 2 * xlen * ylen);
+
+    t = g_get_monotonic_time();
+    for (i = 0; i < iters; i++) {
+        dma_run(b, DMA_TI_TDMODE | DMA_TI_S_INC | DMA_TI_D_INC,
+                RAM_SRC, RAM_DST, (ylen << 16) | xlen, xlen);
+    }
+    t = g_get_monotonic_time() - t;
+
+    bench_report(b, "dma-2d",
+                 mb_per_sec((uint64_t)xlen * ylen * iters, t), "MB/s");
+}
+
+/*
+ * Mailbox property channel
+ */
+
+static void mbox_call(Bench *b, uint32_t addr)
+{
+    uint32_t mbox = ARMCTRL_0_SBM_OFFSET;
+
+    peri_writel(b, mbox + MAIL1_WRITE, addr | MBOX_CHAN_PROPERTY);
+    while (peri_readl(b, mbox + MAIL0_STATUS) & MAIL_EMPTY) {
+        /* wait for the answer */
+    }
+    g_assert_cmphex(peri_readl(b, mbox + MAIL0_READ), ==,
+                    addr | MBOX_CHAN_PROPERTY);
+}
+
+static void mbox_write_request(Bench *b, const uint32_t *req, size_t words)
+{
+    uint32_t *buf = g_new(uint32_t, words);
+    size_t i;
+
+    for (i = 0; i < words; i++) {
+        buf[i] = cpu_to_le32(req[i]);
+    }
+    qtest_memwrite(b->qts, RAM_MBOX, buf, words * 4);
+    g_free(buf);
+}
+
+static void bench_mbox(Bench *b)
+{
+    static const uint32_t req[] = {
+        7 * 4, 0,
+        0x00010002, 4, 0, 0,    /* get board revision */
+        0,
+    };
+    const int iters = 2000;
+    int64_t t;
+    int i;
+
+    mbox_write_request(b, req, ARRAY_SIZE(req));
+
+    t = g_get_monotonic_time();
+    for (i = 0; i < iters; i++) {
+        mbox_call(b, RAM_MBOX);
+    }
+    t = g_get_monotonic_time() - t;
+    g_assert_cmphex(qtest_readl(b->qts, RAM_MBOX + 4), ==, 0x80000000);
+
+    bench_report(b, "mbox-property", (double)t / iters, "us");
+}
+
+/*
+ * Framebuffer
+ */
+
+static void bench_fb(Bench *b)
+{
+    static const uint32_t req[] = {
+        22 * 4, 0,
+        0x00048003, 8, 0, 640, 480,     /* set physical display size */
+        0x00048004, 8, 0, 640, 480,     /* set virtual display size */
+        0x00048005, 4, 0, 32,           /* set depth */
+        0x00040001, 8, 0, 16, 0,        /* allocate buffer */
+        0,
+    };
+    const int iters = 50;
+    uint32_t base, size;
+    char *ppm;
+    int64_t t;
+    int fd, i;
+
+    mbox_write_request(b, req, ARRAY_SIZE(req));
+    mbox_call(b, RAM_MBOX);
+    base = qtest_readl(b->qts, RAM_MBOX + 19 * 4) & 0x3fffffff;
+    size = qtest_readl(b->qts, RAM_MBOX + 20 * 4);
+    g_assert_cmpuint(size, >=, 640 * 480 * 4);
+
+    fd = g_file_open_tmp("raspi-bench-XXXXXX.ppm", &ppm, NULL);
+    g_assert(fd >= 0);
+    close(fd);
+
+    /* Every frame is redrawn completely, then pulled through the display */
+    t = g_get_monotonic_time();
+    for (i = 0; i < iters; i++) {
+        qtest_memset(b->qts, base, i, size);
+        qobject_unref(qtest_qmp(b->qts, "{'execute': 'screendump',"
+                                " 'arguments': {'filename': %s}}", ppm));
+    }
+    t = g_get_monotonic_time() - t;
+
+    unlink(ppm);
+    g_free(ppm);
+    bench_report(b, "fb-frame", (double)t / iters / 1000, "ms");
+}
+
+/*
+ * GPIO
+ */
+
+static void bench_gpio_irq(Bench *b)
+{
+    const uint32_t bit = 1 << (INTERRUPT_GPIO0 - 32);
+    const int iters = 1000;
+    int64_t t, total = 0;
+    int i;
+
+    peri_writel(b, ARMCTRL_IC_OFFSET + IRQ_ENABLE_2, bit);
+    peri_writel(b, GPIO_OFFSET + GPREN0, 1 << GPIO_IN_PIN);
+
+    /* From the pin going up to the interrupt pending in the controller */
+    for (i = 0; i < iters; i++) {
+        t = g_get_monotonic_time();
+        qtest_set_irq_in(b->qts, GPIO_PATH, NULL, GPIO_IN_PIN, 1);
+        while (!(peri_readl(b, ARMCTRL_IC_OFFSET + IRQ_PENDING_2) & bit)) {
+            /* wait for the edge */
+        }
+        total += g_get_monotonic_time() - t;
+
+        qtest_set_irq_in(b->qts, GPIO_PATH, NULL, GPIO_IN_PIN, 0);
+        peri_writel(b, GPIO_OFFSET + GPEDS0, 1 << GPIO_IN_PIN);
+    }
+
+    bench_report(b, "gpio-irq", (double)total / iters, "us");
+}
+
+static void bench_gpio_out(Bench *b)
+{
+    const int iters = 1000;
+    uint32_t fsel;
+    int64_t t;
+    int i;
+
+    qtest_irq_intercept_out(b->qts, GPIO_PATH);
+    fsel = peri_readl(b, GPIO_OFFSET + GPFSEL1);
+    fsel = deposit32(fsel, (GPIO_OUT_PIN - 10) * 3, 3, 1);
+    peri_writel(b, GPIO_OFFSET + GPFSEL1, fsel);
+
+    /* From the register write to the output line toggling */
+    t = g_get_monotonic_time();
+    for (i = 0; i < iters; i++) {
+        peri_writel(b, GPIO_OFFSET + GPSET0, 1 << GPIO_OUT_PIN);
+        g_assert(qtest_get_irq(b->qts, GPIO_OUT_PIN));
+        peri_writel(b, GPIO_OFFSET + GPCLR0, 1 << GPIO_OUT_PIN);
+        g_assert(!qtest_get_irq(b->qts, GPIO_OUT_PIN));
+    }
+    t = g_get_monotonic_time() - t;
+
+    bench_report(b, "gpio-out", (double)t / (2 * iters), "us");
+}
+
+/*
+ * SD card
+ */
+
+typedef enum {
+    SD_RSP_NONE,
+    SD_RSP_R1,
+    SD_RSP_R1B,
+    SD_RSP_R2,
+    SD_RSP_R3,          /* no CRC, no index */
+} SDResponse;
+
+typedef struct SDOps {
+    const char *name;
+    void (*setup)(Bench *b);
+    uint32_t (*cmd)(Bench *b, uint8_t cmd, uint32_t arg, SDResponse rsp);
+    void (*read)(Bench *b, uint32_t ram, uint32_t addr, uint32_t len);
+    void (*write)(Bench *b, uint32_t ram, uint32_t addr, uint32_t len);
+} SDOps;
+
+static void sd_card_init(Bench *b, const SDOps *ops)
+{
+    uint32_t ocr, rca;
+    int i;
+
+    ops->cmd(b, 0, 0, SD_RSP_NONE);
+    ops->cmd(b, 8, 0x1aa, SD_RSP_R1);
+    for (i = 0; ; i++) {
+        ops->cmd(b, 55, 0, SD_RSP_R1);
+        ocr = ops->cmd(b, 41, 0x40ff8000, SD_RSP_R3);
+        if (ocr & (1u << 31)) {
+            break;
+        }
+        g_assert_cmpint(i, <, 100);
+        /* the card powers up after a while of virtual time */
+        qtest_clock_step(b->qts, 1000000);
+    }
+    ops->cmd(b, 2, 0, SD_RSP_R2);
+    rca = ops->cmd(b, 3, 0, SD_RSP_R1) >> 16;
+    ops->cmd(b, 7, rca << 16, SD_RSP_R1B);
+    ops->cmd(b, 16, SD_BLOCK, SD_RSP_R1);
+}
+
+static void sd_bench(Bench *b, const SDOps *ops)
+{
+    char name[32];
+    uint32_t pos, probe;
+    int64_t t;
+
+    ops->setup(b);
+    sd_card_init(b, ops);
+    qtest_memset(b->qts, RAM_SRC, 0xc3, SD_XFER_SIZE);
+
+    t = g_get_monotonic_time();
+    for (pos = 0; pos < SD_IMG_SIZE; pos += SD_XFER_SIZE) {
+        ops->write(b, RAM_SRC, pos, SD_XFER_SIZE);
+    }
+    t = g_get_monotonic_time() - t;
+    snprintf(name, sizeof(name), "sd-%s-write", ops->name);
+    bench_report(b, name, mb_per_sec(SD_IMG_SIZE, t), "MB/s");
+
+    t = g_get_monotonic_time();
+    for (pos = 0; pos < SD_IMG_SIZE; pos += SD_XFER_SIZE) {
+        ops->read(b, RAM_DST, pos, SD_XFER_SIZE);
+    }
+    t = g_get_monotonic_time() - t;
+    snprintf(name, sizeof(name), "sd-%s-read", ops->name);
+    bench_report(b, name, mb_per_sec(SD_IMG_SIZE, t), "MB/s");
+
+    /* The last chunk read back must be what was written */
+    probe = qtest_readl(b->qts, RAM_DST + SD_XFER_SIZE - 4);
+    g_assert_cmphex(probe, ==, 0xc3c3c3c3);
+}
+
+static void sdhci_setup(Bench *b)
+{
+    uint32_t sdhc = b->m->sd_offset;
+
+    peri_writel(b, sdhc + SDHC_HOSTCTL, 0x0f << 8);     /* 3.3V, power on */
+    peri_writel(b, sdhc + SDHC_CLKCON, 0x000e0005);     /* clock on */
+    peri_writel(b, sdhc + SDHC_NORINTSTSEN, 0xffffffff);
+}
+
+static uint32_t sdhci_send(Bench *b, uint8_t cmd, uint32_t arg,
+                           SDResponse rsp, uint16_t flags, uint16_t trnmod)
+{
+    static const uint8_t rsp_flags[] = {
+        [SD_RSP_NONE] = 0x00,
+        [SD_RSP_R1] = 0x1a,
+        [SD_RSP_R1B] = 0x1b,
+        [SD_RSP_R2] = 0x09,
+        [SD_RSP_R3] = 0x02,
+    };
+    uint32_t sdhc = b->m->sd_offset;
+
+    peri_writel(b, sdhc + SDHC_NORINTSTS, 0xffffffff);
+    peri_writel(b, sdhc + SDHC_ARGUMENT, arg);
+    peri_writel(b, sdhc + SDHC_TRNMOD,
+                (uint32_t)(cmd << 8 | rsp_flags[rsp] | flags) << 16 | trnmod);
+    g_assert(!(peri_readl(b, sdhc + SDHC_NORINTSTS) & SDHC_NIS_ERR));
+    return peri_readl(b, sdhc + SDHC_RSPREG0);
+}
+
+static uint32_t sdhci_cmd(Bench *b, uint8_t cmd, uint32_t arg,
+                          SDResponse rsp)
+{
+    return sdhci_send(b, cmd, arg, rsp, 0, 0);
+}
+
+static void sdhci_wait_done(Bench *b)
+{
+    uint32_t sdhc = b->m->sd_offset;
+
+    while (!(peri_readl(b, sdhc + SDHC_NORINTSTS) & SDHC_NIS_TRSCMP)) {
+        /* Auto CMD12 ends the transfer */
+    }
+}
+
+/*
+ * The controller's data port stays valid across block boundaries, so a
+ * single DMA transfer moves the whole request; no need for DREQ pacing.
+ */
+static void sdhci_read(Bench *b, uint32_t ram, uint32_t addr, uint32_t len)
+{
+    uint32_t sdhc = b->m->sd_offset;
+
+    peri_writel(b, sdhc + SDHC_BLKSIZE, (len / SD_BLOCK) << 16 | SD_BLOCK);
+    sdhci_send(b, 18, addr, SD_RSP_R1, SDHC_CMD_DATA,
+               SDHC_TRNS_BLK_CNT_EN | SDHC_TRNS_ACMD12 | SDHC_TRNS_READ |
+               SDHC_TRNS_MULTI);
+    dma_run(b, DMA_TI_D_INC, BUS_PERI_BASE + sdhc + SDHC_BDATA, ram, len, 0);
+    sdhci_wait_done(b);
+}
+
+static void sdhci_write(Bench *b, uint32_t ram, uint32_t addr, uint32_t len)
+{
+    uint32_t sdhc = b->m->sd_offset;
+
+    peri_writel(b, sdhc + SDHC_BLKSIZE, (len / SD_BLOCK) << 16 | SD_BLOCK);
+    sdhci_send(b, 25, addr, SD_RSP_R1, SDHC_CMD_DATA,
+               SDHC_TRNS_BLK_CNT_EN | SDHC_TRNS_ACMD12 | SDHC_TRNS_MULTI);
+    dma_run(b, DMA_TI_S_INC, ram, BUS_PERI_BASE + sdhc + SDHC_BDATA, len, 0);
+    sdhci_wait_done(b);
+}
+
+static const SDOps sdhci_ops = {
+    .name = "sdhci",
+    .setup = sdhci_setup,
+    .cmd = sdhci_cmd,
+    .read = sdhci_read,
+    .write = sdhci_write,
+};
+
+static void sdhost_setup(Bench *b)
+{
+    uint32_t fsel;
+
+    /* GPIO 48-53 to ALT0 hands the card over to sdhost */
+    fsel = peri_readl(b, GPIO_OFFSET + GPFSEL4);
+    peri_writel(b, GPIO_OFFSET + GPFSEL4, deposit32(fsel, 24, 6, 044));
+    fsel = peri_readl(b, GPIO_OFFSET + GPFSEL5);
+    peri_writel(b, GPIO_OFFSET + GPFSEL5, deposit32(fsel, 0, 12, 04444));
+    peri_writel(b, MMCI0_OFFSET + SDVDD, 1);
+}
+
+static uint32_t sdhost_send(Bench *b, uint8_t cmd, uint32_t arg,
+                            SDResponse rsp, uint32_t flags)
+{
+    static const uint32_t rsp_flags[] = {
+        [SD_RSP_NONE] = SDCMD_NO_RESPONSE,
+        [SD_RSP_R1] = 0,
+        [SD_RSP_R1B] = SDCMD_BUSYWAIT,
+        [SD_RSP_R2] = SDCMD_LONG_RESPONSE,
+        [SD_RSP_R3] = 0,
+    };
+
+    peri_writel(b, MMCI0_OFFSET + SDHSTS, 0x7f8);
+    peri_writel(b, MMCI0_OFFSET + SDARG, arg);
+    peri_writel(b, MMCI0_OFFSET + SDCMD,
+                SDCMD_NEW_FLAG | rsp_flags[rsp] | flags | cmd);
+    g_assert(!(peri_readl(b, MMCI0_OFFSET + SDCMD) & SDCMD_FAIL_FLAG));
+    return peri_readl(b, MMCI0_OFFSET + SDRSP0);
+}
+
+static uint32_t sdhost_cmd(Bench *b, uint8_t cmd, uint32_t arg,
+                           SDResponse rsp)
+{
+    return sdhost_send(b, cmd, arg, rsp, 0);
+}
+
+/*
+ * Without DREQ pacing the channel cannot wait for the card, and the FIFO
+ * stays empty while the card waits for the backend at the start of a
+ * block, so each block is its own DMA transfer, started once the FIFO
+ * has filled up.  Unpaced transfers move one word per register access.
+ */
+static void sdhost_read(Bench *b, uint32_t ram, uint32_t addr, uint32_t len)
+{
+    uint32_t pos;
+
+    peri_writel(b, MMCI0_OFFSET + SDHBCT, SD_BLOCK);
+    peri_writel(b, MMCI0_OFFSET + SDHBLC, len / SD_BLOCK);
+    sdhost_send(b, 18, addr, SD_RSP_R1, SDCMD_READ_CMD);
+    for (pos = 0; pos < len; pos += SD_BLOCK) {
+        while (!SDEDM_FIFO_LEVEL(peri_readl(b, MMCI0_OFFSET + SDEDM))) {
+            /* wait for the card */
+        }
+        dma_run(b, DMA_TI_D_INC, BUS_PERI_BASE + MMCI0_OFFSET + SDDATA,
+                ram + pos, SD_BLOCK, 0);
+    }
+    sdhost_cmd(b, 12, 0, SD_RSP_R1B);
+}
+
+static void sdhost_write(Bench *b, uint32_t ram, uint32_t addr, uint32_t len)
+{
+    peri_writel(b, MMCI0_OFFSET + SDHBCT, SD_BLOCK);
+    peri_writel(b, MMCI0_OFFSET + SDHBLC, len / SD_BLOCK);
+    sdhost_send(b, 25, addr, SD_RSP_R1, SDCMD_WRITE_CMD);
+    dma_run(b, DMA_TI_S_INC, ram, BUS_PERI_BASE + MMCI0_OFFSET + SDDATA,
+            len, 0);
+    sdhost_cmd(b, 12, 0, SD_RSP_R1B);
+}
+
+static const SDOps sdhost_ops = {
+    .name = "sdhost",
+    .setup = sdhost_setup,
+    .cmd = sdhost_cmd,
+    .read = sdhost_read,
+    .write = sdhost_write,
+};
+
+/*
+ * Paced by the sdhost DREQ, a single transfer moves the whole request:
+ * the channel is held while the FIFO is empty (or full), and otherwise
+ * moves bursts straight between the FIFO and RAM.
+ */
+static void sdhost_dreq_read(Bench *b, uint32_t ram, uint32_t addr,
+                             uint32_t len)
+{
+    peri_writel(b, MMCI0_OFFSET + SDHBCT, SD_BLOCK);
+    peri_writel(b, MMCI0_OFFSET + SDHBLC, len / SD_BLOCK);
+    sdhost_send(b, 18, addr, SD_RSP_R1, SDCMD_READ_CMD);
+    dma_run(b, DMA_TI_D_INC | DMA_TI_S_DREQ | DMA_TI_PERMAP(DREQ_SDHOST),
+            BUS_PERI_BASE + MMCI0_OFFSET + SDDATA, ram, len, 0);
+    sdhost_cmd(b, 12, 0, SD_RSP_R1B);
+}
+
+static void sdhost_dreq_write(Bench *b, uint32_t ram, uint32_t addr,
+                              uint32_t len)
+{
+    peri_writel(b, MMCI0_OFFSET + SDHBCT, SD_BLOCK);
+    peri_writel(b, MMCI0_OFFSET + SDHBLC, len / SD_BLOCK);
+    sdhost_send(b, 25, addr, SD_RSP_R1, SDCMD_WRITE_CMD);
+    dma_run(b, DMA_TI_S_INC | DMA_TI_D_DREQ | DMA_TI_PERMAP(DREQ_SDHOST),
+            ram, BUS_PERI_BASE + MMCI0_OFFSET + SDDATA, len, 0);
+    sdhost_cmd(b, 12, 0, SD_RSP_R1B);
+}
+
+static const SDOps sdhost_dreq_ops = {
+    .name = "sdhost-dreq",
+    .setup = sdhost_setup,
+    .cmd = sdhost_cmd,
+    .read = sdhost_dreq_read,
+    .write = sdhost_dreq_write,
+};
+
+static void bench_sdhci(Bench *b)
+{
+    sd_bench(b, &sdhci_ops);
+}
+
+static void bench_sdhost(Bench *b)
+{
+    sd_bench(b, &sdhost_ops);
+}
+
+static void bench_sdhost_dreq(Bench *b)
+{
+    sd_bench(b, &sdhost_dreq_ops);
+}
+
+static const BenchCase bench_cases[] = {
+    { "dma-1d", bench_dma_1d },
+    { "dma-2d", bench_dma_2d },
+    { "mbox-property", bench_mbox },
+    { "fb-frame", bench_fb },
+    { "gpio-irq", bench_gpio_irq },
+    { "gpio-out", bench_gpio_out },
+    { "sd-sdhci", bench_sdhci, .sd = true },
+    { "sd-sdhost", bench_sdhost, .sd = true, .sdhost = true },
+    { "sd-sdhost-dreq", bench_sdhost_dreq, .sd = true, .sdhost = true },
+};
+
+static void bench_run(const void *data)
+{
+    const BenchRun *r = data;
+    Bench b = { .m = r->m };
+    int fd;
+
+    if (r->c->sd) {
+        fd = g_file_open_tmp("raspi-bench-XXXXXX.img", &b.img, NULL);
+        g_assert(fd >= 0);
+        g_assert(ftruncate(fd, SD_IMG_SIZE) == 0);
+        close(fd);
+        b.qts = qtest_initf("-M %s -m 1G "
+                            "-drive if=sd,format=raw,file=%s",
+                            r->m->name, b.img);
+    } else {
+        b.qts = qtest_initf("-M %s -m 1G", r->m->name);
+    }
+
+    r->c->run(&b);
+
+    qtest_quit(b.qts);
+    if (b.img) {
+        unlink(b.img);
+        g_free(b.img);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    BenchRun runs[ARRAY_SIZE(raspi_machines) * ARRAY_SIZE(bench_cases)];
+    const char *arch = qtest_get_arch();
+    int nr_machines, i, j, n = 0;
+    char *path;
+
+    g_test_init(&argc, &argv, NULL);
+
+    /* qemu-system-arm only has the raspi2 */
+    nr_machines = strcmp(arch, "aarch64") ? 1 : ARRAY_SIZE(raspi_machines);
+    for (i = 0; i < nr_machines; i++) {
+        for (j = 0; j < ARRAY_SIZE(bench_cases); j++) {
+            if (bench_cases[j].sdhost && !raspi_machines[i].has_sdhost) {
+                continue;
+            }
+            runs[n].m = &raspi_machines[i];
+            runs[n].c = &bench_cases[j];
+            path = g_strdup_printf("raspi-bench/%s/%s", raspi_machines[i].name,
+                                   bench_cases[j].name);
+            qtest_add_data_func(path, &runs[n], bench_run);
+            g_free(path);
+            n++;
+        }
+    }
+
+    return g_test_run();
+}
@@ -0,0 +1,87 @@
+/*
+ * Count the executed blocks and instructions of each vCPU
+ *
+ * The counters are per-vCPU scoreboard entries bumped by inline ops, so
+ * that the vCPUs of an MTTCG guest never share a cache line.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+typedef struct {
+    uint64_t bb_count;
+    uint64_t insn_count;
+} CPUCount;
+
+static struct qemu_plugin_scoreboard *counts;
+static qemu_plugin_u64 bb_count;
+static qemu_plugin_u64 insn_count;
+static bool do_per_vcpu;
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    GString *out = g_string_new(NULL);
+    int i;
+
+    if (do_per_vcpu) {
+        for (i = 0; i < qemu_plugin_n_vcpus(); i++) {
+            g_string_append_printf(out, "CPU%d: bb's: %" PRIu64
+                                   ", insns: %" PRIu64 "\n", i,
+                                   qemu_plugin_u64_get(bb_count, i),
+                                   qemu_plugin_u64_get(insn_count, i));
+        }
+    }
+    g_string_append_printf(out, "bb's: %" PRIu64 ", insns: %" PRIu64 "\n",
+                           qemu_plugin_u64_sum(bb_count),
+                           qemu_plugin_u64_sum(insn_count));
+    qemu_plugin_outs(out->str);
+    g_string_free(out, true);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    size_t n_insns = qemu_plugin_tb_n_insns(tb);
+
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, bb_count, 1);
+    qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+        tb, QEMU_PLUGIN_INLINE_ADD_U64, insn_count, n_insns);
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+                                           const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    int i;
+
+    for (i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "vcpu") == 0) {
+            do_per_vcpu = true;
+        } else {
+            fprintf(stderr, "bb: unknown argument '%s'\n", argv[i]);
+            return -1;
+        }
+    }
+
+    counts = qemu_plugin_scoreboard_new(sizeof(CPUCount));
+    if (!counts) {
+        fprintf(stderr, "bb: no scoreboard left\n");
+        return -1;
+    }
+    bb_count.score = counts;
+    bb_count.offset = offsetof(CPUCount, bb_count);
+    insn_count.score = counts;
+    insn_count.offset = offsetof(CPUCount, insn_count);
+
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
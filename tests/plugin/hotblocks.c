@@ -0,0 +1,113 @@
+/*
+ * List the most executed blocks
+ *
+ * Each translated block bumps its own counter with an inline op.  The
+ * counters are shared by the vCPUs and are not updated atomically, so
+ * the counts are approximate under MTTCG.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+static int limit = 20;
+static GMutex lock;
+static GHashTable *hotblocks;
+
+typedef struct {
+    uint64_t start_addr;
+    uint64_t exec_count;
+    int trans_count;
+    unsigned long insns;
+} ExecCount;
+
+static gint cmp_exec_count(gconstpointer a, gconstpointer b)
+{
+    const ExecCount *ea = a;
+    const ExecCount *eb = b;
+
+    return ea->exec_count > eb->exec_count ? -1 : 1;
+}
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    GString *report = g_string_new("collected ");
+    GList *counts, *it;
+    int i;
+
+    g_mutex_lock(&lock);
+    g_string_append_printf(report, "%d entries in the hash table\n",
+                           g_hash_table_size(hotblocks));
+    counts = g_list_sort(g_hash_table_get_values(hotblocks), cmp_exec_count);
+
+    g_string_append_printf(report, "pc, tcount, icount, ecount\n");
+    for (i = 0, it = counts; i < limit && it; i++, it = it->next) {
+        ExecCount *rec = it->data;
+
+        g_string_append_printf(report, "%#016" PRIx64 ", %d, %ld, %"
+                               PRIu64 "\n", rec->start_addr,
+                               rec->trans_count, rec->insns,
+                               rec->exec_count);
+    }
+    g_list_free(counts);
+    g_mutex_unlock(&lock);
+
+    qemu_plugin_outs(report->str);
+    g_string_free(report, true);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    uint64_t pc = qemu_plugin_tb_vaddr(tb);
+    size_t insns = qemu_plugin_tb_n_insns(tb);
+    ExecCount *cnt;
+
+    /* the vCPUs of an MTTCG guest translate concurrently */
+    g_mutex_lock(&lock);
+    cnt = g_hash_table_lookup(hotblocks, &pc);
+    if (cnt) {
+        cnt->trans_count++;
+    } else {
+        cnt = g_new0(ExecCount, 1);
+        cnt->start_addr = pc;
+        cnt->trans_count = 1;
+        cnt->insns = insns;
+        g_hash_table_insert(hotblocks, &cnt->start_addr, cnt);
+    }
+    g_mutex_unlock(&lock);
+
+    qemu_plugin_register_vcpu_tb_exec_inline(tb, QEMU_PLUGIN_INLINE_ADD_U64,
+                                             &cnt->exec_count, 1);
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+                                           const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    int i;
+
+    for (i = 0; i < argc; i++) {
+        if (g_str_has_prefix(argv[i], "limit=")) {
+            limit = atoi(argv[i] + strlen("limit="));
+        } else {
+            fprintf(stderr, "hotblocks: unknown argument '%s'\n", argv[i]);
+            return -1;
+        }
+    }
+
+    g_mutex_init(&lock);
+    hotblocks = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                      NULL, g_free);
+
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Count the guest memory accesses
+ *
+ * Arguments:
+ *   inline    count with per-vCPU inline ops rather than with callbacks
+ *   r, w, rw  count loads, stores or both (default)
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include <qemu-plugin.h>
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
+
+static struct qemu_plugin_scoreboard *counts;
+static qemu_plugin_u64 mem_count;
+static bool do_inline;
+static enum qemu_plugin_mem_rw rw = QEMU_PLUGIN_MEM_RW;
+
+static void plugin_exit(qemu_plugin_id_t id, void *p)
+{
+    g_autofree gchar *out =
+        g_strdup_printf("mem accesses: %" PRIu64 "\n",
+                        qemu_plugin_u64_sum(mem_count));
+
+    qemu_plugin_outs(out);
+}
+
+static void vcpu_mem(unsigned int vcpu_index, qemu_plugin_meminfo_t meminfo,
+                     uint64_t vaddr, void *udata)
+{
+    qemu_plugin_u64_add(mem_count, vcpu_index, 1);
+}
+
+static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
+{
+    size_t n = qemu_plugin_tb_n_insns(tb);
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
+
+        if (do_inline) {
+            qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+                insn, rw, QEMU_PLUGIN_INLINE_ADD_U64, mem_count, 1);
+        } else {
+            qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem, rw, NULL);
+        }
+    }
+}
+
+QEMU_PLUGIN_EXPORT int qemu_plugin_install(qemu_plugin_id_t id,
+                                           const qemu_info_t *info,
+                                           int argc, char **argv)
+{
+    int i;
+
+    for (i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "inline") == 0) {
+            do_inline = true;
+        } else if (strcmp(argv[i], "r") == 0) {
+            rw = QEMU_PLUGIN_MEM_R;
+        } else if (strcmp(argv[i], "w") == 0) {
+            rw = QEMU_PLUGIN_MEM_W;
+        } else if (strcmp(argv[i], "rw") == 0) {
+            rw = QEMU_PLUGIN_MEM_RW;
+        } else {
+            fprintf(stderr, "mem: unknown argument '%s'\n", argv[i]);
+            return -1;
+        }
+    }
+
+    counts = qemu_plugin_scoreboard_new(sizeof(uint64_t));
+    if (!counts) {
+        fprintf(stderr, "mem: no scoreboard left\n");
+        return -1;
+    }
+    mem_count.score = counts;
+    mem_count.offset = 0;
+
+    qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
+    qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
+    return 0;
+}
@@ -43,6 +43,7 @@ static int query_error_class(const char *cmd)
         { "query-balloon", ERROR_CLASS_DEVICE_NOT_ACTIVE },
         { "query-hotpluggable-cpus", ERROR_CLASS_GENERIC_ERROR },
         { "query-vm-generation-id", ERROR_CLASS_GENERIC_ERROR },
+        { "x-query-jit-htable", ERROR_CLASS_GENERIC_ERROR },
         { NULL, -1 }
     };
     int i;
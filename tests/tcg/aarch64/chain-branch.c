@@ -0,0 +1,83 @@
+/*
+ * Forward direct branches within a page, which the translator follows
+ * instead of ending the TB.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define MOVZ_X0(imm)    (0xd2800000 | ((imm) << 5))
+#define ADD_X0(imm)     (0x91000000 | ((imm) << 10))
+#define B(off)          (0x14000000 | ((off) / 4))
+#define BL(off)         (0x94000000 | ((off) / 4))
+#define MOV_X9_X30      0xaa1e03e9
+#define MOV_X0_X30      0xaa1e03e0
+#define MOV_X30_X9      0xaa0903fe
+#define BRK             0xd4200000
+#define RET             0xd65f03c0
+
+/* Two branches over code that must never run */
+static const uint32_t sum[] = {
+    MOVZ_X0(1),
+    B(12),
+    MOVZ_X0(100),
+    RET,
+    ADD_X0(2),          /* 16 */
+    B(8),
+    RET,
+    ADD_X0(4),          /* 28 */
+    RET,
+};
+
+/* Returns the link register set by a followed BL */
+static const uint32_t link[] = {
+    MOV_X9_X30,
+    BL(8),
+    BRK,
+    MOV_X0_X30,         /* 12 */
+    MOV_X30_X9,
+    RET,
+};
+
+typedef uint64_t code_fn(void);
+
+static void patch(uint32_t *insn, uint32_t val)
+{
+    *insn = val;
+    __builtin___clear_cache((char *)insn, (char *)(insn + 1));
+}
+
+int main(void)
+{
+    uint32_t *page = mmap(NULL, 4096, PROT_READ | PROT_WRITE | PROT_EXEC,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    code_fn *fn = (code_fn *)page;
+    int i;
+
+    assert(page != MAP_FAILED);
+
+    memcpy(page, sum, sizeof(sum));
+    __builtin___clear_cache((char *)page, (char *)page + sizeof(sum));
+    for (i = 0; i < 10; i++) {
+        assert(fn() == 7);
+    }
+
+    /* A write to the code after a followed branch invalidates the TB */
+    patch(&page[4], ADD_X0(8));
+    assert(fn() == 13);
+
+    /* The skipped gap is in the TB's extent, but never executed */
+    patch(&page[2], MOVZ_X0(200));
+    assert(fn() == 13);
+
+    memcpy(page, link, sizeof(link));
+    __builtin___clear_cache((char *)page, (char *)page + sizeof(link));
+    assert(fn() == (uintptr_t)&page[2]);
+
+    munmap(page, 4096);
+    printf("PASS\n");
+    return 0;
+}
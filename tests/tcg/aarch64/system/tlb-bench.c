@@ -0,0 +1,383 @@
+/*
+ * TLB and memory subsystem benchmark, system test version
+ *
+ * Times the paths of the softmmu that a guest kernel leans on: TLB
+ * refills, local and broadcast TLB invalidation, MMIO dispatch and
+ * self-modifying code.  The benchmarks to run, and a few settings, are
+ * taken from the semihosting command line (-append):
+ *
+ *   NAME...     benchmarks to run (default: all of them)
+ *   iter=N      multiply the number of iterations by N
+ *   uart=ADDR   base of the PL011 used for MMIO (default: virt's)
+ *   wait        park the CPU once done instead of exiting, so that
+ *               the host can still query QEMU
+ *
+ * Each result is printed as "tlb-bench,NAME,ITERATIONS,NANOSECONDS".
+ * scripts/tlb-bench.py runs this on virt and the raspi machines, and
+ * adds QEMU's own TLB flush counts.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <minilib.h>
+
+#define PAGE_SIZE       4096
+#define BLOCK_SIZE      (2 * 1024 * 1024)
+#define ARRAY_SIZE(x)   ((sizeof(x) / sizeof((x)[0])))
+
+/* Translation table descriptors, as set up by boot.S */
+#define DESC_TYPE_MASK  3ULL
+#define DESC_BLOCK      1ULL
+#define DESC_TABLE      3ULL
+#define DESC_PAGE       3ULL
+#define DESC_AF         (1ULL << 10)
+#define DESC_XN         (3ULL << 53)
+#define DESC_ATTR_DEV   (1ULL << 2)     /* MAIR_EL1 attr1 is 0, Device */
+#define DESC_ADDR_MASK  0x0000fffffffff000ULL
+
+/* Pages touched by the TLB benchmarks, mapped after the data block */
+#define REGION_BLOCKS   16
+#define REGION_PAGES    (REGION_BLOCKS * BLOCK_SIZE / PAGE_SIZE)
+#define HOT_PAGES       64
+
+#define PL011_FR        0x18
+#define PL011_ILPR      0x20
+
+#define SYS_GET_CMDLINE 0x15
+
+static uintptr_t uart = 0x09000000;
+static volatile uint8_t *region;
+
+__attribute__((aligned(PAGE_SIZE)))
+static uint32_t smc_code[PAGE_SIZE / sizeof(uint32_t)];
+
+/* The first block of the region is mapped with pages */
+__attribute__((aligned(PAGE_SIZE)))
+static uint64_t region_l3[PAGE_SIZE / sizeof(uint64_t)];
+
+static char cmdline[256];
+
+static long semihosting_call(long op, void *arg)
+{
+    register long x0 asm("x0") = op;
+    register void *x1 asm("x1") = arg;
+
+    asm volatile("hlt 0xf000" : "+r" (x0) : "r" (x1) : "memory");
+    return x0;
+}
+
+static uint64_t get_ticks(void)
+{
+    uint64_t ticks;
+
+    asm volatile("isb; mrs %0, cntvct_el0" : "=r" (ticks));
+    return ticks;
+}
+
+static uint64_t ticks_to_ns(uint64_t ticks)
+{
+    uint64_t freq;
+
+    asm("mrs %0, cntfrq_el0" : "=r" (freq));
+    return ticks / freq * 1000000000ULL +
+           ticks % freq * 1000000000ULL / freq;
+}
+
+static void tlb_flush_local(void)
+{
+    asm volatile("dsb ishst; tlbi vmalle1; dsb ish; isb" : : : "memory");
+}
+
+/*
+ * Find the descriptor that maps @addr: the level 1 entry unless it
+ * points to a level 2 table, as it does for the GB the image is in.
+ */
+static uint64_t *find_desc(uintptr_t addr, bool *level2)
+{
+    uint64_t ttbr, *l1, *l2;
+
+    asm("mrs %0, ttbr0_el1" : "=r" (ttbr));
+    l1 = (uint64_t *)(uintptr_t)(ttbr & DESC_ADDR_MASK);
+    l1 += (addr >> 30) & 0x1ff;
+    *level2 = (*l1 & DESC_TYPE_MASK) == DESC_TABLE;
+    if (!*level2) {
+        return l1;
+    }
+    l2 = (uint64_t *)(uintptr_t)(*l1 & DESC_ADDR_MASK);
+    return l2 + ((addr >> 21) & 0x1ff);
+}
+
+/*
+ * boot.S only maps the 2MB blocks of the text and of the data.  Add the
+ * UART, the blocks after the data for the TLB benchmarks, and make the
+ * data executable for the self-modifying code.  The hot pages are mapped
+ * one by one, or QEMU would flush the whole TLB for each TLBI of a page
+ * within a block.
+ */
+static void setup_mappings(void)
+{
+    uintptr_t data = (uintptr_t)smc_code & ~(uintptr_t)(BLOCK_SIZE - 1);
+    uint64_t *desc;
+    bool level2;
+    unsigned i;
+
+    desc = find_desc(uart, &level2);
+    *desc = (uart & ~(uintptr_t)((level2 ? BLOCK_SIZE : 1 << 30) - 1)) |
+            DESC_XN | DESC_AF | DESC_ATTR_DEV | DESC_BLOCK;
+
+    desc = find_desc(data, &level2);
+    *desc &= ~DESC_XN;
+
+    region = (volatile uint8_t *)(data + BLOCK_SIZE);
+    for (i = 0; i < ARRAY_SIZE(region_l3); i++) {
+        region_l3[i] = ((uintptr_t)region + i * PAGE_SIZE) |
+                       DESC_XN | DESC_AF | DESC_PAGE;
+    }
+    desc = find_desc((uintptr_t)region, &level2);
+    *desc = (uintptr_t)region_l3 | DESC_TABLE;
+    for (i = 1; i < REGION_BLOCKS; i++) {
+        desc = find_desc((uintptr_t)region + i * BLOCK_SIZE, &level2);
+        *desc = ((uintptr_t)region + i * BLOCK_SIZE) |
+                DESC_XN | DESC_AF | DESC_BLOCK;
+    }
+    tlb_flush_local();
+}
+
+/* The same few pages again and again: the TLB fast path */
+static bool bench_tlb_hit(uint64_t iterations)
+{
+    uint64_t i;
+
+    for (i = 0; i < iterations; i++) {
+        region[(i % HOT_PAGES) * PAGE_SIZE]++;
+    }
+    return true;
+}
+
+/* Every page once after a flush: a refill for each access */
+static bool bench_tlb_miss(uint64_t iterations)
+{
+    uint64_t i;
+
+    for (i = 0; i < iterations; i++) {
+        if (i % REGION_PAGES == 0) {
+            tlb_flush_local();
+        }
+        region[(i % REGION_PAGES) * PAGE_SIZE]++;
+    }
+    return true;
+}
+
+/* Flush a single page and fault it back in */
+static bool bench_tlbi_page(uint64_t iterations)
+{
+    uint64_t i;
+    uintptr_t addr;
+
+    for (i = 0; i < iterations; i++) {
+        addr = (uintptr_t)&region[(i % HOT_PAGES) * PAGE_SIZE];
+        asm volatile("tlbi vae1, %0; dsb ish; isb"
+                     : : "r" (addr >> 12) : "memory");
+        *(volatile uint8_t *)addr += 1;
+    }
+    return true;
+}
+
+/* Flush every CPU of the inner shareable domain, run with -smp N */
+static bool bench_tlbi_is(uint64_t iterations)
+{
+    uint64_t i;
+
+    for (i = 0; i < iterations; i++) {
+        asm volatile("tlbi vmalle1is; dsb ish; isb" : : : "memory");
+        region[(i % HOT_PAGES) * PAGE_SIZE]++;
+    }
+    return true;
+}
+
+static bool bench_mmio_read(uint64_t iterations)
+{
+    volatile uint32_t *fr = (volatile uint32_t *)(uart + PL011_FR);
+    uint64_t i;
+
+    for (i = 0; i < iterations; i++) {
+        (void)*fr;
+    }
+    return true;
+}
+
+static bool bench_mmio_write(uint64_t iterations)
+{
+    volatile uint32_t *ilpr = (volatile uint32_t *)(uart + PL011_ILPR);
+    uint64_t i;
+
+    for (i = 0; i < iterations; i++) {
+        *ilpr = i & 0xff;
+    }
+    return true;
+}
+
+/* Patch a function and call it: a TB invalidation and a retranslation */
+static bool bench_smc(uint64_t iterations)
+{
+    uint32_t (*fn)(void) = (uint32_t (*)(void))smc_code;
+    uint32_t imm;
+    uint64_t i;
+
+    for (i = 0; i < iterations; i++) {
+        imm = i & 0xffff;
+        smc_code[0] = 0x52800000 | (imm << 5);  /* mov w0, #imm */
+        smc_code[1] = 0xd65f03c0;               /* ret */
+        asm volatile("dc cvau, %0; dsb ish; ic ivau, %0; dsb ish; isb"
+                     : : "r" (smc_code) : "memory");
+        if (fn() != imm) {
+            ml_printf("smc: stale code run at iteration %lu\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+typedef struct Bench {
+    const char *name;
+    uint64_t iterations;
+    bool (*fn)(uint64_t iterations);
+    bool selected;
+} Bench;
+
+static Bench benches[] = {
+    { "tlb-hit", 1 << 16, bench_tlb_hit },
+    { "tlb-miss", 16 * REGION_PAGES, bench_tlb_miss },
+    { "tlbi-page", 1 << 16, bench_tlbi_page },
+    { "tlbi-is", 1 << 12, bench_tlbi_is },
+    { "mmio-read", 1 << 16, bench_mmio_read },
+    { "mmio-write", 1 << 16, bench_mmio_write },
+    { "smc", 1 << 12, bench_smc },
+};
+
+static bool str_eq(const char *a, const char *b)
+{
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static bool str_start(const char *str, const char *prefix)
+{
+    while (*prefix && *prefix == *str) {
+        prefix++;
+        str++;
+    }
+    return !*prefix;
+}
+
+static uint64_t parse_num(const char *str)
+{
+    uint64_t val = 0;
+    int base = 10, digit;
+
+    if (str[0] == '0' && str[1] == 'x') {
+        base = 16;
+        str += 2;
+    }
+    for (;; str++) {
+        if (*str >= '0' && *str <= '9') {
+            digit = *str - '0';
+        } else if (base == 16 && *str >= 'a' && *str <= 'f') {
+            digit = *str - 'a' + 10;
+        } else {
+            return val;
+        }
+        val = val * base + digit;
+    }
+}
+
+/* Returns true if the CPU should be parked at the end */
+static bool parse_cmdline(uint64_t *scale)
+{
+    struct {
+        char *buf;
+        long len;
+    } args = { cmdline, sizeof(cmdline) };
+    bool wait = false;
+    char *arg, *p;
+    unsigned i;
+
+    if (semihosting_call(SYS_GET_CMDLINE, &args) != 0) {
+        return false;
+    }
+    /* the first word is the name of the image */
+    for (p = cmdline; *p && *p != ' '; p++) {
+        continue;
+    }
+    while (*p) {
+        while (*p == ' ') {
+            *p++ = 0;
+        }
+        arg = p;
+        while (*p && *p != ' ') {
+            p++;
+        }
+        if (*p) {
+            *p++ = 0;
+        }
+        if (!*arg) {
+            break;
+        }
+
+        if (str_eq(arg, "wait")) {
+            wait = true;
+        } else if (str_start(arg, "iter=")) {
+            *scale = parse_num(arg + 5);
+        } else if (str_start(arg, "uart=")) {
+            uart = parse_num(arg + 5);
+        } else {
+            for (i = 0; i < ARRAY_SIZE(benches); i++) {
+                if (str_eq(arg, benches[i].name)) {
+                    benches[i].selected = true;
+                    break;
+                }
+            }
+            if (i == ARRAY_SIZE(benches)) {
+                ml_printf("unknown benchmark %s\n", arg);
+            }
+        }
+    }
+    return wait;
+}
+
+int main(void)
+{
+    uint64_t scale = 1, iterations, start, ticks;
+    bool wait, all = true, ok = true;
+    unsigned i;
+
+    wait = parse_cmdline(&scale);
+    for (i = 0; i < ARRAY_SIZE(benches); i++) {
+        all &= !benches[i].selected;
+    }
+    for (i = 0; i < ARRAY_SIZE(benches) && all; i++) {
+        benches[i].selected = true;
+    }
+    setup_mappings();
+
+    for (i = 0; i < ARRAY_SIZE(benches) && ok; i++) {
+        if (!benches[i].selected) {
+            continue;
+        }
+        iterations = benches[i].iterations * scale;
+        start = get_ticks();
+        ok = benches[i].fn(iterations);
+        ticks = get_ticks() - start;
+        ml_printf("tlb-bench,%s,%lu,%lu\n", benches[i].name, iterations,
+                  ticks_to_ns(ticks));
+    }
+
+    ml_printf("tlb-bench,%s\n", ok ? "done" : "failed");
+    while (wait) {
+        asm volatile("wfi");
+    }
+    return ok ? 0 : -1;
+}
@@ -390,6 +390,20 @@ static void test_hbitmap_reset(TestHBitmapData *data,
     hbitmap_test_set(data, L3 / 2, L3);
 }
 
+static void test_hbitmap_reset_long(TestHBitmapData *data,
+                                    const void *unused)
+{
+    hbitmap_test_init(data, L3 * 2, 0);
+    hbitmap_test_set(data, 3, L2 * 5 + L1 * 7);
+    hbitmap_test_reset(data, L1 + 1, L2 * 3 - 2);
+    hbitmap_test_set(data, L2 - 1, L1 * 9 + 2);
+    hbitmap_test_reset(data, L2 * 3 + L1 * 3, L1 * 4);
+    hbitmap_test_reset(data, L2 * 3, L2 * 3);
+    hbitmap_test_set(data, L3 - L2 - 5, L3);
+    hbitmap_test_reset(data, L3 + 1, L3 - 2);
+    hbitmap_test_reset(data, 0, L3 * 2);
+}
+
 static void test_hbitmap_reset_all(TestHBitmapData *data,
                                    const void *unused)
 {
@@ -990,6 +1004,13 @@ static void test_hbitmap_next_zero_do(TestHBitmapData *data, int granularity)
     test_hbitmap_next_zero_check_range(data, L2 * 2 - L1, L1 + 1);
     test_hbitmap_next_zero_check_range(data, L2 * 2, L2);
 
+    /* A hole after a run of full words that is not a multiple of four */
+    hbitmap_reset(data->hb, L2 * 2 + L1 * 5 + 3, 1);
+    test_hbitmap_next_zero_check(data, L2 * 2);
+    test_hbitmap_next_zero_check(data, L2 * 2 + L1);
+    test_hbitmap_next_zero_check_range(data, L2 * 2, L1 * 5 + 3);
+    test_hbitmap_next_zero_check_range(data, L2 * 2, L1 * 5 + 4);
+
     hbitmap_set(data->hb, 0, L3);
     test_hbitmap_next_zero_check(data, 0);
 }
@@ -1140,6 +1161,7 @@ int main(int argc, char **argv)
     hbitmap_test_add("/hbitmap/set/overlap", test_hbitmap_set_overlap);
     hbitmap_test_add("/hbitmap/reset/empty", test_hbitmap_reset_empty);
     hbitmap_test_add("/hbitmap/reset/general", test_hbitmap_reset);
+    hbitmap_test_add("/hbitmap/reset/long", test_hbitmap_reset_long);
     hbitmap_test_add("/hbitmap/reset/all", test_hbitmap_reset_all);
     hbitmap_test_add("/hbitmap/granularity", test_hbitmap_granularity);
 
@@ -0,0 +1,289 @@
+/*
+ * JSON Output Visitor unit-tests.
+ *
+ * Copyright (C) 2019 Red Hat Inc.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+
+#include "qemu-common.h"
+#include "qapi/error.h"
+#include "qapi/json-output-visitor.h"
+#include "qapi/qobject-output-visitor.h"
+#include "test-qapi-visit.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qjson.h"
+#include "qapi/qmp/qnum.h"
+#include "qapi/qmp/qstring.h"
+
+typedef struct TestOutputVisitorData {
+    Visitor *ov;
+    QString *str;
+} TestOutputVisitorData;
+
+static void visitor_output_setup_internal(TestOutputVisitorData *data,
+                                          bool pretty)
+{
+    data->ov = json_output_visitor_new(pretty, &data->str);
+    g_assert(data->ov);
+}
+
+static void visitor_output_setup(TestOutputVisitorData *data,
+                                 const void *unused)
+{
+    visitor_output_setup_internal(data, false);
+}
+
+static void visitor_output_setup_pretty(TestOutputVisitorData *data,
+                                        const void *unused)
+{
+    visitor_output_setup_internal(data, true);
+}
+
+static void visitor_output_teardown(TestOutputVisitorData *data,
+                                    const void *unused)
+{
+    visit_free(data->ov);
+    data->ov = NULL;
+    qobject_unref(data->str);
+    data->str = NULL;
+}
+
+static const char *visitor_get(TestOutputVisitorData *data)
+{
+    visit_complete(data->ov, &data->str);
+    g_assert(data->str);
+    return qstring_get_str(data->str);
+}
+
+static void visitor_reset(TestOutputVisitorData *data, bool pretty)
+{
+    visitor_output_teardown(data, NULL);
+    visitor_output_setup_internal(data, pretty);
+}
+
+static void test_visitor_out_int(TestOutputVisitorData *data,
+                                 const void *unused)
+{
+    int64_t value = -42;
+    uint64_t uvalue = UINT64_MAX;
+
+    visit_type_int(data->ov, NULL, &value, &error_abort);
+    g_assert_cmpstr(visitor_get(data), ==, "-42");
+
+    visitor_reset(data, false);
+    visit_type_uint64(data->ov, NULL, &uvalue, &error_abort);
+    g_assert_cmpstr(visitor_get(data), ==, "18446744073709551615");
+}
+
+static void test_visitor_out_bool(TestOutputVisitorData *data,
+                                  const void *unused)
+{
+    bool value = true;
+
+    visit_type_bool(data->ov, NULL, &value, &error_abort);
+    g_assert_cmpstr(visitor_get(data), ==, "true");
+}
+
+static void test_visitor_out_number(TestOutputVisitorData *data,
+                                    const void *unused)
+{
+    double value = 3.1415926535897932;
+    QNum *qnum = qnum_from_double(value);
+    QString *expected = qobject_to_json(QOBJECT(qnum));
+
+    visit_type_number(data->ov, NULL, &value, &error_abort);
+    g_assert_cmpstr(visitor_get(data), ==, qstring_get_str(expected));
+    qobject_unref(expected);
+    qobject_unref(qnum);
+}
+
+static void test_visitor_out_string(TestOutputVisitorData *data,
+                                    const void *unused)
+{
+    char *string = (char *) "Q \"E\"\nM\tU";
+    char *no_string = NULL;
+
+    visit_type_str(data->ov, NULL, &string, &error_abort);
+    g_assert_cmpstr(visitor_get(data), ==, "\"Q \\\"E\\\"\\nM\\tU\"");
+
+    /* A null string is formatted as an empty one */
+    visitor_reset(data, false);
+    visit_type_str(data->ov, NULL, &no_string, &error_abort);
+    g_assert_cmpstr(visitor_get(data), ==, "\"\"");
+}
+
+static void test_visitor_out_enum(TestOutputVisitorData *data,
+                                  const void *unused)
+{
+    EnumOne value = ENUM_ONE_VALUE2;
+
+    visit_type_EnumOne(data->ov, NULL, &value, &error_abort);
+    g_assert_cmpstr(visitor_get(data), ==, "\"value2\"");
+}
+
+static UserDefOne *make_user_def_one(int64_t integer, const char *string)
+{
+    UserDefOne *ud1 = g_new0(UserDefOne, 1);
+
+    ud1->integer = integer;
+    ud1->string = g_strdup(string);
+    return ud1;
+}
+
+static void test_visitor_out_struct(TestOutputVisitorData *data,
+                                    const void *unused)
+{
+    UserDefOne *ud1 = make_user_def_one(42, "foo");
+
+    ud1->has_enum1 = true;
+    ud1->enum1 = ENUM_ONE_VALUE1;
+
+    /* Members come in the order they are visited, base first */
+    visit_type_UserDefOne(data->ov, NULL, &ud1, &error_abort);
+    g_assert_cmpstr(visitor_get(data), ==,
+                    "{\"integer\": 42, \"string\": \"foo\", "
+                    "\"enum1\": \"value1\"}");
+    qapi_free_UserDefOne(ud1);
+}
+
+static void test_visitor_out_list(TestOutputVisitorData *data,
+                                  const void *unused)
+{
+    UserDefOneList *head, *tail;
+    intList *empty = NULL;
+
+    head = g_new0(UserDefOneList, 1);
+    head->value = make_user_def_one(1, "one");
+    tail = head->next = g_new0(UserDefOneList, 1);
+    tail->value = make_user_def_one(2, "two");
+
+    visit_type_UserDefOneList(data->ov, NULL, &head, &error_abort);
+    g_assert_cmpstr(visitor_get(data), ==,
+                    "[{\"integer\": 1, \"string\": \"one\"}, "
+                    "{\"integer\": 2, \"string\": \"two\"}]");
+
+    visitor_reset(data, false);
+    visit_type_intList(data->ov, NULL, &empty, &error_abort);
+    g_assert_cmpstr(visitor_get(data), ==, "[]");
+
+    qapi_free_UserDefOneList(head);
+}
+
+static void test_visitor_out_pretty(TestOutputVisitorData *data,
+                                    const void *unused)
+{
+    UserDefOneList *head = g_new0(UserDefOneList, 1);
+    QDict *qdict = qdict_new();
+    QObject *qobj;
+
+    head->value = make_user_def_one(1, "one");
+    visit_type_UserDefOneList(data->ov, NULL, &head, &error_abort);
+    g_assert_cmpstr(visitor_get(data), ==,
+                    "[\n"
+                    "    {\n"
+                    "        \"integer\": 1,\n"
+                    "        \"string\": \"one\"\n"
+                    "    }\n"
+                    "]");
+    qapi_free_UserDefOneList(head);
+
+    /* An 'any' value is indented at the depth it is visited at */
+    visitor_reset(data, true);
+    qdict_put_int(qdict, "a", 1);
+    qobj = QOBJECT(qdict);
+    visit_start_struct(data->ov, NULL, NULL, 0, &error_abort);
+    visit_type_any(data->ov, "x", &qobj, &error_abort);
+    visit_check_struct(data->ov, &error_abort);
+    visit_end_struct(data->ov, NULL);
+    g_assert_cmpstr(visitor_get(data), ==,
+                    "{\n"
+                    "    \"x\": {\n"
+                    "        \"a\": 1\n"
+                    "    }\n"
+                    "}");
+    qobject_unref(qdict);
+}
+
+/*
+ * The text must parse back to what a QObject output visitor builds,
+ * whose qobject_to_json() the visitor replaces in QMP replies
+ */
+static void test_visitor_out_same_as_qobject(TestOutputVisitorData *data,
+                                             const void *unused)
+{
+    UserDefTwo *ud2 = g_new0(UserDefTwo, 1);
+    QObject *expected, *parsed;
+    Visitor *v;
+    int pretty;
+
+    ud2->string0 = g_strdup("forty two");
+    ud2->dict1 = g_new0(UserDefTwoDict, 1);
+    ud2->dict1->string1 = g_strdup("forty three");
+    ud2->dict1->dict2 = g_new0(UserDefTwoDictDict, 1);
+    ud2->dict1->dict2->userdef = make_user_def_one(42, "user def string");
+    ud2->dict1->dict2->string = g_strdup("forty four");
+    ud2->dict1->has_dict3 = true;
+    ud2->dict1->dict3 = g_new0(UserDefTwoDictDict, 1);
+    ud2->dict1->dict3->userdef = make_user_def_one(-1, "\"quoted\"");
+    ud2->dict1->dict3->string = g_strdup("forty five");
+
+    v = qobject_output_visitor_new(&expected);
+    visit_type_UserDefTwo(v, NULL, &ud2, &error_abort);
+    visit_complete(v, &expected);
+    visit_free(v);
+
+    for (pretty = 0; pretty < 2; pretty++) {
+        visitor_reset(data, pretty);
+        visit_type_UserDefTwo(data->ov, NULL, &ud2, &error_abort);
+        parsed = qobject_from_json(visitor_get(data), &error_abort);
+        g_assert(qobject_is_equal(parsed, expected));
+        qobject_unref(parsed);
+    }
+
+    qobject_unref(expected);
+    qapi_free_UserDefTwo(ud2);
+}
+
+static void output_visitor_test_add(const char *testpath,
+                                    TestOutputVisitorData *data,
+                                    void (*test_func)(TestOutputVisitorData *data, const void *user_data))
+{
+    g_test_add(testpath, TestOutputVisitorData, data, visitor_output_setup,
+               test_func, visitor_output_teardown);
+}
+
+int main(int argc, char **argv)
+{
+    TestOutputVisitorData out_visitor_data;
+
+    g_test_init(&argc, &argv, NULL);
+
+    output_visitor_test_add("/visitor/json/int",
+                            &out_visitor_data, test_visitor_out_int);
+    output_visitor_test_add("/visitor/json/bool",
+                            &out_visitor_data, test_visitor_out_bool);
+    output_visitor_test_add("/visitor/json/number",
+                            &out_visitor_data, test_visitor_out_number);
+    output_visitor_test_add("/visitor/json/string",
+                            &out_visitor_data, test_visitor_out_string);
+    output_visitor_test_add("/visitor/json/enum",
+                            &out_visitor_data, test_visitor_out_enum);
+    output_visitor_test_add("/visitor/json/struct",
+                            &out_visitor_data, test_visitor_out_struct);
+    output_visitor_test_add("/visitor/json/list",
+                            &out_visitor_data, test_visitor_out_list);
+    g_test_add("/visitor/json/pretty", TestOutputVisitorData,
+               &out_visitor_data, visitor_output_setup_pretty,
+               test_visitor_out_pretty, visitor_output_teardown);
+    output_visitor_test_add("/visitor/json/same-as-qobject",
+                            &out_visitor_data,
+                            test_visitor_out_same_as_qobject);
+
+    g_test_run();
+
+    return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Framebuffer line conversion tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "ui/pixel-conv.h"
+
+/* Long enough for several vector iterations plus every tail length */
+#define MAX_WIDTH   97
+
+static const int bytes_per_pixel[PIXEL_CONV__MAX] = {
+    [PIXEL_CONV_PAL8] = 1,
+    [PIXEL_CONV_RGB444] = 2,
+    [PIXEL_CONV_RGB555] = 2,
+    [PIXEL_CONV_RGB565] = 2,
+    [PIXEL_CONV_RGB888] = 3,
+    [PIXEL_CONV_XRGB8888] = 4,
+};
+
+static uint32_t palette[256];
+static uint8_t src[MAX_WIDTH * 4];
+
+/* One pixel at a time, straight from the description in pixel-conv.h */
+static uint32_t ref_pixel(PixelConvFormat format, unsigned flags, int i)
+{
+    int bytes = bytes_per_pixel[format];
+    uint32_t v, r, g, b;
+
+    if (flags & PIXEL_CONV_BE32) {
+        /* Pixels fill each big-endian word from the bottom up */
+        uint32_t word = ldl_be_p(src + (i * bytes / 4) * 4);
+        int shift = (i * bytes % 4) * 8;
+
+        v = bytes == 4 ? word : (word >> shift) & ((1u << (bytes * 8)) - 1);
+    } else {
+        const uint8_t *p = src + i * bytes;
+        int j;
+
+        v = 0;
+        for (j = 0; j < bytes; j++) {
+            if (flags & PIXEL_CONV_BE) {
+                v = (v << 8) | p[j];
+            } else {
+                v |= p[j] << (j * 8);
+            }
+        }
+    }
+
+    switch (format) {
+    case PIXEL_CONV_PAL8:
+        return palette[v];
+    case PIXEL_CONV_RGB444:
+        r = ((v >> 8) & 0xf) << 4;
+        g = ((v >> 4) & 0xf) << 4;
+        b = (v & 0xf) << 4;
+        break;
+    case PIXEL_CONV_RGB555:
+        r = ((v >> 10) & 0x1f) << 3;
+        g = ((v >> 5) & 0x1f) << 3;
+        b = (v & 0x1f) << 3;
+        break;
+    case PIXEL_CONV_RGB565:
+        r = ((v >> 11) & 0x1f) << 3;
+        g = ((v >> 5) & 0x3f) << 2;
+        b = (v & 0x1f) << 3;
+        break;
+    default:
+        r = (v >> 16) & 0xff;
+        g = (v >> 8) & 0xff;
+        b = v & 0xff;
+        break;
+    }
+    if (flags & PIXEL_CONV_BGR) {
+        return (b << 16) | (g << 8) | r;
+    }
+    return (r << 16) | (g << 8) | b;
+}
+
+static void test_fixed(void)
+{
+    static const uint8_t rgb565_red_le[] = { 0x00, 0xf8 };
+    static const uint8_t rgb565_red_be[] = { 0xf8, 0x00 };
+    static const uint8_t rgb888_le[] = { 0x33, 0x22, 0x11 };
+    static const uint8_t xrgb8888_le[] = { 0x33, 0x22, 0x11, 0xff };
+    uint32_t dst[1];
+
+    pixel_conv_get(PIXEL_CONV_RGB565, 0)(dst, rgb565_red_le, 1, NULL);
+    g_assert_cmphex(dst[0], ==, 0xf80000);
+    pixel_conv_get(PIXEL_CONV_RGB565, PIXEL_CONV_BE)(dst, rgb565_red_be,
+                                                     1, NULL);
+    g_assert_cmphex(dst[0], ==, 0xf80000);
+    pixel_conv_get(PIXEL_CONV_RGB565, PIXEL_CONV_BGR)(dst, rgb565_red_le,
+                                                      1, NULL);
+    g_assert_cmphex(dst[0], ==, 0x0000f8);
+    pixel_conv_get(PIXEL_CONV_RGB888, 0)(dst, rgb888_le, 1, NULL);
+    g_assert_cmphex(dst[0], ==, 0x112233);
+    /* The padding byte does not reach the surface */
+    pixel_conv_get(PIXEL_CONV_XRGB8888, 0)(dst, xrgb8888_le, 1, NULL);
+    g_assert_cmphex(dst[0], ==, 0x112233);
+}
+
+static void test_format(PixelConvFormat format, unsigned flags)
+{
+    PixelConvFunc *fn = pixel_conv_get(format, flags);
+    uint32_t dst[MAX_WIDTH + 1];
+    int width, i;
+
+    if (format == PIXEL_CONV_RGB888 && (flags & PIXEL_CONV_BE32)) {
+        g_assert(fn == NULL);
+        return;
+    }
+    g_assert(fn);
+
+    for (width = 1; width <= MAX_WIDTH; width++) {
+        dst[width] = 0xdeadbeef;
+        fn(dst, src, width, palette);
+        for (i = 0; i < width; i++) {
+            g_assert_cmphex(dst[i], ==, ref_pixel(format, flags, i));
+        }
+        g_assert_cmphex(dst[width], ==, 0xdeadbeef);
+    }
+}
+
+static void test_all_formats(void)
+{
+    PixelConvFormat format;
+    unsigned flags;
+
+    for (format = 0; format < PIXEL_CONV__MAX; format++) {
+        /* PIXEL_CONV_BE32 comes last, and PIXEL_CONV_BE is moot with it */
+        for (flags = 0; flags <= (PIXEL_CONV_BE32 | PIXEL_CONV_BGR); flags++) {
+            test_format(format, flags);
+        }
+    }
+}
+
+static void test_conv(void)
+{
+    /* Every set of converters, from the best the host has down to C */
+    do {
+        test_fixed();
+        test_all_formats();
+    } while (test_pixel_conv_next_accel());
+}
+
+int main(int argc, char **argv)
+{
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(palette); i++) {
+        palette[i] = g_test_rand_int() & 0xffffff;
+    }
+    for (i = 0; i < ARRAY_SIZE(src); i++) {
+        src[i] = g_test_rand_int();
+    }
+
+    g_test_add_func("/ui/pixel-conv", test_conv);
+
+    return g_test_run();
+}
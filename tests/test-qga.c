@@ -5,6 +5,7 @@
 #include <sys/un.h>
 
 #include "libqtest.h"
+#include "qemu/bswap.h"
 #include "qapi/qmp/qdict.h"
 #include "qapi/qmp/qlist.h"
 
@@ -638,6 +639,120 @@ static void test_qga_file_write_read(gconstpointer fix)
     qobject_unref(ret);
 }
 
+static void qga_read_exactly(int fd, void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    ssize_t n;
+
+    while (len) {
+        n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        g_assert_cmpint(n, >, 0);
+        p += n;
+        len -= n;
+    }
+}
+
+/* Read the frames of a read stream, acknowledging them, up to its end */
+static GString *qga_stream_read_frames(int fd)
+{
+    GString *data = g_string_new(NULL);
+    uint8_t hdr[8], ack = 0x06;
+    uint8_t *payload;
+    uint32_t len;
+
+    /* the newline behind the response of the command */
+    qga_read_exactly(fd, hdr, 1);
+    g_assert_cmpint(hdr[0], ==, '\n');
+
+    for (;;) {
+        qga_read_exactly(fd, hdr, sizeof(hdr));
+        len = ldl_be_p(hdr + 4);
+        payload = g_malloc(len);
+        qga_read_exactly(fd, payload, len);
+        if (hdr[0] != 1) {
+            g_assert_cmpint(hdr[0], ==, 2);
+            g_assert_cmpint(len, ==, 8);
+            g_assert_cmpint(ldq_be_p(payload), ==, data->len);
+            g_free(payload);
+            return data;
+        }
+        g_assert_cmpint(hdr[1], ==, 0);
+        g_string_append_len(data, (gchar *)payload, len);
+        g_free(payload);
+        g_assert_cmpint(write(fd, &ack, 1), ==, 1);
+    }
+}
+
+static void test_qga_file_stream_pipelined(gconstpointer fix)
+{
+    const TestFixture *fixture = fix;
+    const unsigned char helloworld[] = "Hello World!\n";
+    gchar *enc;
+    QDict *ret;
+    GString *data;
+    int64_t id;
+    int i;
+
+    ret = qmp_fd(fixture->fd, "{'execute': 'guest-file-open',"
+                 " 'arguments': { 'path': 'foo', 'mode': 'w+' } }");
+    g_assert_nonnull(ret);
+    qmp_assert_no_error(ret);
+    id = qdict_get_int(ret, "return");
+    qobject_unref(ret);
+
+    enc = g_base64_encode(helloworld, sizeof(helloworld));
+    ret = qmp_fd(fixture->fd,
+                 "{'execute': 'guest-file-write',"
+                 " 'arguments': { 'handle': %" PRId64 ","
+                 " 'buf-b64': %s } }", id, enc);
+    qmp_assert_no_error(ret);
+    qobject_unref(ret);
+    g_free(enc);
+
+    ret = qmp_fd(fixture->fd,
+                 "{'execute': 'guest-file-seek',"
+                 " 'arguments': { 'handle': %" PRId64 ", "
+                 " 'offset': %d, 'whence': %s } }",
+                 id, 0, "set");
+    qmp_assert_no_error(ret);
+    qobject_unref(ret);
+
+    /*
+     * The second stream is only set up once the first one is over, and
+     * its response does not land in the middle of the first one's frames.
+     */
+    qmp_fd_send_raw(fixture->fd,
+                    "{'execute': 'guest-file-stream-read',"
+                    " 'arguments': { 'handle': %" PRId64 " } }"
+                    "{'execute': 'guest-file-stream-read',"
+                    " 'arguments': { 'handle': %" PRId64 " } }", id, id);
+    for (i = 0; i < 2; i++) {
+        ret = qmp_fd_receive(fixture->fd);
+        qmp_assert_no_error(ret);
+        qobject_unref(ret);
+
+        data = qga_stream_read_frames(fixture->fd);
+        g_assert_cmpint(data->len, ==, sizeof(helloworld));
+        g_assert(!memcmp(data->str, helloworld, sizeof(helloworld)));
+        g_string_free(data, true);
+    }
+
+    /* the agent is still there, and back to JSON */
+    ret = qmp_fd(fixture->fd, "{'execute': 'guest-ping'}");
+    g_assert_nonnull(ret);
+    qmp_assert_no_error(ret);
+    qobject_unref(ret);
+
+    ret = qmp_fd(fixture->fd,
+                 "{'execute': 'guest-file-close',"
+                 " 'arguments': {'handle': %" PRId64 "} }",
+                 id);
+    qobject_unref(ret);
+}
+
 static void test_qga_get_time(gconstpointer fix)
 {
     const TestFixture *fixture = fix;
@@ -988,6 +1103,8 @@ int main(int argc, char **argv)
                          test_qga_get_memory_blocks);
     g_test_add_data_func("/qga/file-ops", &fix, test_qga_file_ops);
     g_test_add_data_func("/qga/file-write-read", &fix, test_qga_file_write_read);
+    g_test_add_data_func("/qga/file-stream-pipelined", &fix,
+                         test_qga_file_stream_pipelined);
     g_test_add_data_func("/qga/get-time", &fix, test_qga_get_time);
     g_test_add_data_func("/qga/id", &fix, test_qga_id);
     g_test_add_data_func("/qga/invalid-oob", &fix, test_qga_invalid_oob);
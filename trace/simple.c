@@ -25,17 +25,20 @@
 #define HEADER_MAGIC 0xf2b177cb0aa429b4ULL
 
 /** Trace file version number, bump if format changes */
-#define HEADER_VERSION 4
+#define HEADER_VERSION 5
 
 /** Records were dropped event ID */
-#define DROPPED_EVENT_ID (~(uint64_t)0 - 1)
+#define DROPPED_EVENT_ID (~(uint32_t)0 - 1)
 
-/** Trace record is valid */
-#define TRACE_RECORD_VALID ((uint64_t)1 << 63)
+/** Stored in TraceRecord.delta_ns when an absolute timestamp follows */
+#define TRACE_DELTA_ABSOLUTE UINT32_MAX
 
 /*
- * Trace records are written out by a dedicated thread.  The thread waits for
- * records to become available, writes them out, and then waits again.
+ * Each thread records into a ring buffer of its own, with a single producer
+ * (the thread) and a single consumer (the writeout thread), so recording
+ * takes no lock and does not contend with other recording threads.  The
+ * writeout thread waits for records to become available, copies every
+ * buffer out to the file, and then waits again.
  */
 static GMutex trace_lock;
 static GCond trace_available_cond;
@@ -45,30 +48,68 @@ static bool trace_available;
 static bool trace_writeout_enabled;
 
 enum {
-    TRACE_BUF_LEN = 4096 * 64,
+    TRACE_BUF_LEN = 4096 * 16,      /* per thread, must be a power of two */
     TRACE_BUF_FLUSH_THRESHOLD = TRACE_BUF_LEN / 4,
 };
 
-uint8_t trace_buf[TRACE_BUF_LEN];
-static volatile gint trace_idx;
-static unsigned int writeout_idx;
+typedef struct TraceThreadBuf {
+    /* Written by the owning thread */
+    unsigned int head;          /* end of the last finished record */
+    uint64_t last_timestamp;    /* of the last record, 0 if none */
+    uint32_t tid;
+
+    /* Written by the writeout thread */
+    unsigned int tail;
+
+    /* Set when the owner exits; the buffer is reused once drained */
+    bool orphaned;
+    struct TraceThreadBuf *next;
+    uint8_t data[TRACE_BUF_LEN];
+} TraceThreadBuf;
+
+/* All buffers ever allocated.  Buffers are never freed, only reused. */
+static TraceThreadBuf *trace_bufs;
+static __thread TraceThreadBuf *trace_thread_buf;
+
+static void trace_thread_exit(gpointer opaque);
+static GPrivate trace_thread_key = G_PRIVATE_INIT(trace_thread_exit);
+
 static volatile gint dropped_events;
 static uint32_t trace_pid;
 static FILE *trace_fp;
 static char *trace_file_name;
 
 #define TRACE_RECORD_TYPE_MAPPING 0
-#define TRACE_RECORD_TYPE_EVENT   1
+#define TRACE_RECORD_TYPE_EVENT   1     /* version 4 records, not written */
+#define TRACE_RECORD_TYPE_CHUNK   2
+#define TRACE_RECORD_TYPE_ROUND   3
 
-/* * Trace buffer entry */
+/*
+ * Trace buffer entry.  Timestamps are deltas from the previous record of
+ * the same thread; the first record of a thread, and any record more than
+ * about four seconds after the previous one, has delta_ns set to
+ * TRACE_DELTA_ABSOLUTE and is followed by a uint64_t absolute timestamp.
+ * The arguments come next.
+ */
 typedef struct {
-    uint64_t event; /* event ID value */
-    uint64_t timestamp_ns;
-    uint32_t length;   /*    in bytes */
-    uint32_t pid;
-    uint64_t arguments[];
+    uint32_t event; /* event ID value */
+    uint32_t length;   /*    in bytes, including the header */
+    uint32_t delta_ns;
 } TraceRecord;
 
+/*
+ * A thread's records, copied as they are from its buffer and preceded by
+ * a uint64_t TRACE_RECORD_TYPE_CHUNK.  The ordering of records between
+ * threads is only given by their timestamps; a TRACE_RECORD_TYPE_ROUND
+ * entry, with the time at which the writeout thread started to drain the
+ * buffers, separates the chunks of consecutive writeout rounds.
+ */
+typedef struct {
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t length;   /*    in bytes, of the records that follow */
+} TraceChunk;
+
 typedef struct {
     uint64_t header_event_id; /* HEADER_EVENT_ID */
     uint64_t header_magic;    /* HEADER_MAGIC    */
@@ -76,53 +117,59 @@ typedef struct {
 } TraceLogHeader;
 
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size);
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size);
-
-static void clear_buffer_range(unsigned int idx, size_t len)
+/*
+ * Find an orphaned buffer that has been drained, or allocate a new one.
+ * Don't use g_malloc here, it can deadlock when traced.
+ */
+static TraceThreadBuf *trace_thread_buf_get(void)
 {
-    uint32_t num = 0;
-    while (num < len) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
+    TraceThreadBuf *buf, *first;
+
+    for (buf = atomic_rcu_read(&trace_bufs); buf; buf = buf->next) {
+        if (atomic_read(&buf->orphaned) &&
+            atomic_load_acquire(&buf->tail) == buf->head &&
+            atomic_cmpxchg(&buf->orphaned, true, false)) {
+            goto found;
         }
-        trace_buf[idx++] = 0;
-        num++;
     }
+
+    buf = malloc(sizeof(*buf));
+    if (!buf) {
+        return NULL;
+    }
+    buf->head = 0;
+    buf->tail = 0;
+    buf->orphaned = false;
+    do {
+        first = atomic_read(&trace_bufs);
+        buf->next = first;
+    } while (atomic_cmpxchg(&trace_bufs, first, buf) != first);
+
+found:
+    buf->last_timestamp = 0;
+    atomic_set(&buf->tid, qemu_get_thread_id());
+    trace_thread_buf = buf;
+    g_private_set(&trace_thread_key, buf);
+    return buf;
 }
-/**
- * Read a trace record from the trace buffer
- *
- * @idx         Trace buffer index
- * @record      Trace record to fill
- *
- * Returns false if the record is not valid.
- */
-static bool get_trace_record(unsigned int idx, TraceRecord **recordptr)
+
+static void trace_thread_exit(gpointer opaque)
 {
-    uint64_t event_flag = 0;
-    TraceRecord record;
-    /* read the event flag to see if its a valid record */
-    read_from_buffer(idx, &record, sizeof(event_flag));
+    TraceThreadBuf *buf = opaque;
 
-    if (!(record.event & TRACE_RECORD_VALID)) {
-        return false;
-    }
+    trace_thread_buf = NULL;
+    atomic_store_release(&buf->orphaned, true);
+}
 
-    smp_rmb(); /* read memory barrier before accessing record */
-    /* read the record header to know record length */
-    read_from_buffer(idx, &record, sizeof(TraceRecord));
-    *recordptr = malloc(record.length); /* don't use g_malloc, can deadlock when traced */
-    /* make a copy of record to avoid being overwritten */
-    read_from_buffer(idx, *recordptr, record.length);
-    smp_rmb(); /* memory barrier before clearing valid flag */
-    (*recordptr)->event &= ~TRACE_RECORD_VALID;
-    /* clear the trace buffer range for consumed record otherwise any byte
-     * with its MSB set may be considered as a valid event id when the writer
-     * thread crosses this range of buffer again.
-     */
-    clear_buffer_range(idx, record.length);
-    return true;
+static unsigned int write_to_buffer(TraceThreadBuf *buf, unsigned int idx,
+                                    const void *dataptr, size_t size)
+{
+    unsigned int off = idx & (TRACE_BUF_LEN - 1);
+    size_t first = MIN(size, TRACE_BUF_LEN - off);
+
+    memcpy(&buf->data[off], dataptr, first);
+    memcpy(&buf->data[0], (const uint8_t *)dataptr + first, size - first);
+    return idx + size; /* most callers wants to know where to write next */
 }
 
 /**
@@ -154,41 +201,80 @@ static void wait_for_trace_records_available(void)
     g_mutex_unlock(&trace_lock);
 }
 
+static void write_chunk(uint32_t tid, const void *first, size_t first_len,
+                        const void *second, size_t second_len)
+{
+    uint64_t type = TRACE_RECORD_TYPE_CHUNK;
+    TraceChunk chunk = {
+        .pid = trace_pid,
+        .tid = tid,
+        .length = first_len + second_len,
+    };
+    size_t unused __attribute__ ((unused));
+
+    unused = fwrite(&type, sizeof(type), 1, trace_fp);
+    unused = fwrite(&chunk, sizeof(chunk), 1, trace_fp);
+    unused = fwrite(first, first_len, 1, trace_fp);
+    if (second_len) {
+        unused = fwrite(second, second_len, 1, trace_fp);
+    }
+}
+
 static gpointer writeout_thread(gpointer opaque)
 {
-    TraceRecord *recordptr;
-    union {
+    TraceThreadBuf *buf;
+    struct {
         TraceRecord rec;
-        uint8_t bytes[sizeof(TraceRecord) + sizeof(uint64_t)];
-    } dropped;
-    unsigned int idx = 0;
+        uint64_t timestamp_ns;
+        uint64_t count;
+    } QEMU_PACKED dropped;
+    struct {
+        uint64_t type;
+        uint64_t timestamp_ns;
+    } round;
+    unsigned int head, tail, off, len;
     int dropped_count;
     size_t unused __attribute__ ((unused));
-    uint64_t type = TRACE_RECORD_TYPE_EVENT;
 
     for (;;) {
         wait_for_trace_records_available();
 
+        round.type = TRACE_RECORD_TYPE_ROUND;
+        round.timestamp_ns = get_clock();
+        unused = fwrite(&round, sizeof(round), 1, trace_fp);
+
         if (g_atomic_int_get(&dropped_events)) {
-            dropped.rec.event = DROPPED_EVENT_ID;
-            dropped.rec.timestamp_ns = get_clock();
-            dropped.rec.length = sizeof(TraceRecord) + sizeof(uint64_t);
-            dropped.rec.pid = trace_pid;
             do {
                 dropped_count = g_atomic_int_get(&dropped_events);
             } while (!g_atomic_int_compare_and_exchange(&dropped_events,
                                                         dropped_count, 0));
-            dropped.rec.arguments[0] = dropped_count;
-            unused = fwrite(&type, sizeof(type), 1, trace_fp);
-            unused = fwrite(&dropped.rec, dropped.rec.length, 1, trace_fp);
+            dropped.rec.event = DROPPED_EVENT_ID;
+            dropped.rec.length = sizeof(dropped);
+            dropped.rec.delta_ns = TRACE_DELTA_ABSOLUTE;
+            dropped.timestamp_ns = round.timestamp_ns;
+            dropped.count = dropped_count;
+            /* tid 0 is not a thread, so it never has relative timestamps */
+            write_chunk(0, &dropped, sizeof(dropped), NULL, 0);
         }
 
-        while (get_trace_record(idx, &recordptr)) {
-            unused = fwrite(&type, sizeof(type), 1, trace_fp);
-            unused = fwrite(recordptr, recordptr->length, 1, trace_fp);
-            writeout_idx += recordptr->length;
-            free(recordptr); /* don't use g_free, can deadlock when traced */
-            idx = writeout_idx % TRACE_BUF_LEN;
+        for (buf = atomic_rcu_read(&trace_bufs); buf; buf = buf->next) {
+            head = atomic_load_acquire(&buf->head);
+            tail = buf->tail;
+            if (head == tail) {
+                continue;
+            }
+
+            len = head - tail;
+            off = tail & (TRACE_BUF_LEN - 1);
+            if (off + len <= TRACE_BUF_LEN) {
+                write_chunk(atomic_read(&buf->tid), &buf->data[off], len,
+                            NULL, 0);
+            } else {
+                write_chunk(atomic_read(&buf->tid),
+                            &buf->data[off], TRACE_BUF_LEN - off,
+                            &buf->data[0], len - (TRACE_BUF_LEN - off));
+            }
+            atomic_store_release(&buf->tail, head);
         }
 
         fflush(trace_fp);
@@ -198,84 +284,72 @@ static gpointer writeout_thread(gpointer opaque)
 
 void trace_record_write_u64(TraceBufferRecord *rec, uint64_t val)
 {
-    rec->rec_off = write_to_buffer(rec->rec_off, &val, sizeof(uint64_t));
+    rec->rec_off = write_to_buffer(trace_thread_buf, rec->rec_off,
+                                   &val, sizeof(uint64_t));
 }
 
 void trace_record_write_str(TraceBufferRecord *rec, const char *s, uint32_t slen)
 {
     /* Write string length first */
-    rec->rec_off = write_to_buffer(rec->rec_off, &slen, sizeof(slen));
+    rec->rec_off = write_to_buffer(trace_thread_buf, rec->rec_off,
+                                   &slen, sizeof(slen));
     /* Write actual string now */
-    rec->rec_off = write_to_buffer(rec->rec_off, (void*)s, slen);
+    rec->rec_off = write_to_buffer(trace_thread_buf, rec->rec_off, s, slen);
 }
 
 int trace_record_start(TraceBufferRecord *rec, uint32_t event, size_t datasize)
 {
-    unsigned int idx, rec_off, old_idx, new_idx;
-    uint32_t rec_len = sizeof(TraceRecord) + datasize;
-    uint64_t event_u64 = event;
+    TraceThreadBuf *buf = trace_thread_buf;
     uint64_t timestamp_ns = get_clock();
+    uint64_t delta_ns;
+    TraceRecord record;
+    size_t rec_len;
 
-    do {
-        old_idx = g_atomic_int_get(&trace_idx);
-        smp_rmb();
-        new_idx = old_idx + rec_len;
-
-        if (new_idx - writeout_idx > TRACE_BUF_LEN) {
-            /* Trace Buffer Full, Event dropped ! */
+    if (unlikely(!buf)) {
+        buf = trace_thread_buf_get();
+        if (!buf) {
             g_atomic_int_inc(&dropped_events);
             return -ENOSPC;
         }
-    } while (!g_atomic_int_compare_and_exchange(&trace_idx, old_idx, new_idx));
-
-    idx = old_idx % TRACE_BUF_LEN;
-
-    rec_off = idx;
-    rec_off = write_to_buffer(rec_off, &event_u64, sizeof(event_u64));
-    rec_off = write_to_buffer(rec_off, &timestamp_ns, sizeof(timestamp_ns));
-    rec_off = write_to_buffer(rec_off, &rec_len, sizeof(rec_len));
-    rec_off = write_to_buffer(rec_off, &trace_pid, sizeof(trace_pid));
+    }
 
-    rec->tbuf_idx = idx;
-    rec->rec_off  = (idx + sizeof(TraceRecord)) % TRACE_BUF_LEN;
-    return 0;
-}
+    delta_ns = timestamp_ns - buf->last_timestamp;
+    rec_len = sizeof(TraceRecord) + datasize;
+    if (!buf->last_timestamp || delta_ns >= TRACE_DELTA_ABSOLUTE) {
+        delta_ns = TRACE_DELTA_ABSOLUTE;
+        rec_len += sizeof(timestamp_ns);
+    }
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size)
-{
-    uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        data_ptr[x++] = trace_buf[idx++];
+    if (rec_len > TRACE_BUF_LEN - (buf->head - atomic_read(&buf->tail))) {
+        /* Trace Buffer Full, Event dropped ! */
+        g_atomic_int_inc(&dropped_events);
+        return -ENOSPC;
     }
-}
 
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size)
-{
-    uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        trace_buf[idx++] = data_ptr[x++];
+    record.event = event;
+    record.length = rec_len;
+    record.delta_ns = delta_ns;
+    rec->tbuf_idx = buf->head;
+    rec->rec_off = write_to_buffer(buf, buf->head, &record, sizeof(record));
+    if (delta_ns == TRACE_DELTA_ABSOLUTE) {
+        rec->rec_off = write_to_buffer(buf, rec->rec_off, &timestamp_ns,
+                                       sizeof(timestamp_ns));
     }
-    return idx; /* most callers wants to know where to write next */
+    buf->last_timestamp = timestamp_ns;
+    return 0;
 }
 
 void trace_record_finish(TraceBufferRecord *rec)
 {
-    TraceRecord record;
-    read_from_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
-    smp_wmb(); /* write barrier before marking as valid */
-    record.event |= TRACE_RECORD_VALID;
-    write_to_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
+    TraceThreadBuf *buf = trace_thread_buf;
+    unsigned int used = rec->tbuf_idx - atomic_read(&buf->tail);
+
+    /* Publish the record to the writeout thread */
+    atomic_store_release(&buf->head, rec->rec_off);
 
-    if (((unsigned int)g_atomic_int_get(&trace_idx) - writeout_idx)
-        > TRACE_BUF_FLUSH_THRESHOLD) {
+    /* Only kick the writeout thread once, when crossing the threshold */
+    if (used <= TRACE_BUF_FLUSH_THRESHOLD &&
+        rec->rec_off - rec->tbuf_idx + used > TRACE_BUF_FLUSH_THRESHOLD) {
         flush_trace_file(false);
     }
 }
@@ -0,0 +1,48 @@
+/*
+ * Framebuffer line conversion to x8r8g8b8: one set of converters
+ *
+ * Include with SUFFIX defined; pixel-conv.c does it once for each
+ * instruction set it may pick at run time.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#define PIXEL_CONV_FN(format, flags) \
+    glue(glue(glue(glue(format, _), flags), _), SUFFIX)
+
+#define PIXEL_CONV_DEFINE(format, flags)                                \
+static void PIXEL_CONV_FN(format, flags)(uint32_t *restrict dst,        \
+                                         const uint8_t *restrict src,   \
+                                         int width,                     \
+                                         const uint32_t *palette)       \
+{                                                                       \
+    pixel_conv_line(dst, src, width, palette, format, flags);           \
+}
+
+#define PIXEL_CONV_DEFINE_ALL(format)                                   \
+    PIXEL_CONV_DEFINE(format, 0)                                        \
+    PIXEL_CONV_DEFINE(format, 1)                                        \
+    PIXEL_CONV_DEFINE(format, 2)                                        \
+    PIXEL_CONV_DEFINE(format, 3)                                        \
+    PIXEL_CONV_DEFINE(format, 4)                                        \
+    PIXEL_CONV_DEFINE(format, 5)
+
+PIXEL_CONV_FORMATS(PIXEL_CONV_DEFINE_ALL)
+
+#define PIXEL_CONV_ROW(format)                                          \
+    [format] = {                                                        \
+        PIXEL_CONV_FN(format, 0), PIXEL_CONV_FN(format, 1),             \
+        PIXEL_CONV_FN(format, 2), PIXEL_CONV_FN(format, 3),             \
+        PIXEL_CONV_FN(format, 4), PIXEL_CONV_FN(format, 5),             \
+    },
+
+static PixelConvTable glue(pixel_conv_table_, SUFFIX) = {
+    PIXEL_CONV_FORMATS(PIXEL_CONV_ROW)
+};
+
+#undef PIXEL_CONV_ROW
+#undef PIXEL_CONV_DEFINE_ALL
+#undef PIXEL_CONV_DEFINE
+#undef PIXEL_CONV_FN
+#undef SUFFIX
@@ -0,0 +1,210 @@
+/*
+ * Framebuffer line conversion to x8r8g8b8
+ *
+ * Display devices used to carry per-pixel converters for each of their
+ * source formats and each surface depth.  The surface is 32 bits per
+ * pixel in practice, so this only converts to x8r8g8b8, with loops
+ * simple enough for the compiler to vectorize (the file is built with
+ * -ftree-vectorize, which gives NEON code on ARM hosts).  On x86 the
+ * converters are built once more for SSE4.1 and AVX2, and the best
+ * supported set is picked at startup.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "ui/pixel-conv.h"
+
+#define PIXEL_CONV_FORMATS(X)   \
+    X(PIXEL_CONV_PAL8)          \
+    X(PIXEL_CONV_RGB444)        \
+    X(PIXEL_CONV_RGB555)        \
+    X(PIXEL_CONV_RGB565)        \
+    X(PIXEL_CONV_RGB888)        \
+    X(PIXEL_CONV_XRGB8888)
+
+/* PIXEL_CONV_BE is meaningless with PIXEL_CONV_BE32, leaving 6 masks */
+#define PIXEL_CONV_FLAGS_MAX    6
+
+typedef PixelConvFunc *const PixelConvTable[PIXEL_CONV__MAX]
+                                           [PIXEL_CONV_FLAGS_MAX];
+
+static inline int pixel_conv_bytes(PixelConvFormat format)
+{
+    switch (format) {
+    case PIXEL_CONV_PAL8:
+        return 1;
+    case PIXEL_CONV_RGB888:
+        return 3;
+    case PIXEL_CONV_XRGB8888:
+        return 4;
+    default:
+        return 2;
+    }
+}
+
+static inline uint32_t pixel_conv_load(const uint8_t *src, int i,
+                                       int bytes, unsigned flags)
+{
+    if (flags & PIXEL_CONV_BE32) {
+        switch (bytes) {
+        case 1:
+            return src[i ^ 3];
+        case 2:
+            return lduw_be_p(src + (i ^ 1) * 2);
+        default:
+            return ldl_be_p(src + i * 4);
+        }
+    }
+
+    switch (bytes) {
+    case 1:
+        return src[i];
+    case 2:
+        return flags & PIXEL_CONV_BE ? lduw_be_p(src + i * 2)
+                                     : lduw_le_p(src + i * 2);
+    case 3:
+        src += i * 3;
+        return flags & PIXEL_CONV_BE ? (src[0] << 16) | (src[1] << 8) | src[2]
+                                     : (src[2] << 16) | (src[1] << 8) | src[0];
+    default:
+        return flags & PIXEL_CONV_BE ? ldl_be_p(src + i * 4)
+                                     : ldl_le_p(src + i * 4);
+    }
+}
+
+static inline uint32_t pixel_conv_expand(uint32_t v, PixelConvFormat format,
+                                         unsigned flags,
+                                         const uint32_t *palette)
+{
+    uint32_t r, g, b;
+
+    switch (format) {
+    case PIXEL_CONV_PAL8:
+        return palette[v];
+    case PIXEL_CONV_RGB444:
+        r = (v >> 4) & 0xf0;
+        g = v & 0xf0;
+        b = (v << 4) & 0xf0;
+        break;
+    case PIXEL_CONV_RGB555:
+        r = (v >> 7) & 0xf8;
+        g = (v >> 2) & 0xf8;
+        b = (v << 3) & 0xf8;
+        break;
+    case PIXEL_CONV_RGB565:
+        r = (v >> 8) & 0xf8;
+        g = (v >> 3) & 0xfc;
+        b = (v << 3) & 0xf8;
+        break;
+    default:
+        r = (v >> 16) & 0xff;
+        g = (v >> 8) & 0xff;
+        b = v & 0xff;
+        break;
+    }
+    if (flags & PIXEL_CONV_BGR) {
+        return (b << 16) | (g << 8) | r;
+    }
+    return (r << 16) | (g << 8) | b;
+}
+
+/*
+ * Every converter is this loop with constant @format and @flags, so
+ * that the compiler drops the switches and vectorizes what is left.
+ */
+static inline __attribute__((always_inline))
+void pixel_conv_line(uint32_t *dst, const uint8_t *src, int width,
+                     const uint32_t *palette, PixelConvFormat format,
+                     unsigned flags)
+{
+    int bytes = pixel_conv_bytes(format);
+    int i;
+
+    for (i = 0; i < width; i++) {
+        dst[i] = pixel_conv_expand(pixel_conv_load(src, i, bytes, flags),
+                                   format, flags, palette);
+    }
+}
+
+#define SUFFIX int
+#include "pixel-conv-template.h"
+
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("sse4.1")
+#define SUFFIX sse4
+#include "pixel-conv-template.h"
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#define SUFFIX avx2
+#include "pixel-conv-template.h"
+#pragma GCC pop_options
+#endif
+
+/* As in bufferiszero.c, the preferred set has the least significant bit */
+#define CACHE_AVX2    1
+#define CACHE_SSE4    2
+
+static unsigned cpuid_cache;
+static PixelConvTable *pixel_conv_table = &pixel_conv_table_int;
+
+static void init_accel(unsigned cache)
+{
+    PixelConvTable *table = &pixel_conv_table_int;
+
+#ifdef CONFIG_AVX2_OPT
+    if (cache & CACHE_SSE4) {
+        table = &pixel_conv_table_sse4;
+    }
+    if (cache & CACHE_AVX2) {
+        table = &pixel_conv_table_avx2;
+    }
+#endif
+    pixel_conv_table = table;
+}
+
+#ifdef CONFIG_AVX2_OPT
+#include "qemu/host-cpuinfo.h"
+
+static void __attribute__((constructor)) init_pixel_conv_accel(void)
+{
+    unsigned info = host_cpuinfo_init();
+    unsigned cache = 0;
+
+    if (info & CPUINFO_SSE4) {
+        cache |= CACHE_SSE4;
+    }
+    if (info & CPUINFO_AVX2) {
+        cache |= CACHE_AVX2;
+    }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+#endif /* CONFIG_AVX2_OPT */
+
+bool test_pixel_conv_next_accel(void)
+{
+    /* If no bits are set, the plain C converters were the last to test */
+    if (cpuid_cache == 0) {
+        return false;
+    }
+    cpuid_cache &= cpuid_cache - 1;
+    init_accel(cpuid_cache);
+    return true;
+}
+
+PixelConvFunc *pixel_conv_get(PixelConvFormat format, unsigned flags)
+{
+    if (format >= PIXEL_CONV__MAX || flags >= PIXEL_CONV_FLAGS_MAX) {
+        return NULL;
+    }
+    if (format == PIXEL_CONV_RGB888 && (flags & PIXEL_CONV_BE32)) {
+        return NULL;
+    }
+    return (*pixel_conv_table)[format][flags];
+}
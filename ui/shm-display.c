@@ -0,0 +1,282 @@
+/*
+ * Shared memory display sink
+ *
+ * Publishes the guest display, with the rectangles changed by each frame,
+ * in a file that other processes map; see include/ui/shm-display.h for
+ * the layout.  The main loop only copies changed pixels, it never
+ * encodes an image.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <sys/mman.h>
+#include "qemu/error-report.h"
+#include "qemu/module.h"
+#include "ui/console.h"
+#include "ui/shm-display.h"
+
+typedef struct ShmDisplayBox {
+    int x1, y1, x2, y2;         /* empty if x1 >= x2 */
+} ShmDisplayBox;
+
+typedef struct ShmDisplay {
+    DisplayChangeListener dcl;
+    DisplaySurface *ds;
+    int fd;
+    ShmDisplayHeader *hdr;
+    size_t size;
+    size_t header_size;
+    int nr_slots;
+    /* Where each slot's frame buffer is, and how large it is */
+    size_t slot_offset[SHM_DISPLAY_MAX_SLOTS];
+    size_t slot_size[SHM_DISPLAY_MAX_SLOTS];
+
+    /* Parts of each slot that are older than the surface */
+    ShmDisplayBox stale[SHM_DISPLAY_MAX_SLOTS];
+    /* Changes since the last frame */
+    ShmDisplayRect rects[SHM_DISPLAY_MAX_RECTS];
+    int nr_rects;
+} ShmDisplay;
+
+static void shm_display_box_add(ShmDisplayBox *box, int x, int y, int w, int h)
+{
+    if (box->x1 >= box->x2) {
+        *box = (ShmDisplayBox) { x, y, x + w, y + h };
+        return;
+    }
+    box->x1 = MIN(box->x1, x);
+    box->y1 = MIN(box->y1, y);
+    box->x2 = MAX(box->x2, x + w);
+    box->y2 = MAX(box->y2, y + h);
+}
+
+static void shm_display_add_rect(ShmDisplay *sd, int x, int y, int w, int h)
+{
+    ShmDisplayBox box = { x, y, x + w, y + h };
+    int i;
+
+    if (w <= 0 || h <= 0) {
+        return;
+    }
+    for (i = 0; i < sd->nr_slots; i++) {
+        shm_display_box_add(&sd->stale[i], x, y, w, h);
+    }
+
+    if (sd->nr_rects == SHM_DISPLAY_MAX_RECTS) {
+        /* Too many changes: merge them with the new one */
+        for (i = 0; i < sd->nr_rects; i++) {
+            shm_display_box_add(&box, sd->rects[i].x, sd->rects[i].y,
+                                sd->rects[i].w, sd->rects[i].h);
+        }
+        sd->nr_rects = 0;
+    }
+    sd->rects[sd->nr_rects++] = (ShmDisplayRect) {
+        box.x1, box.y1, box.x2 - box.x1, box.y2 - box.y1
+    };
+}
+
+/* Grow the file to @size bytes and map it again */
+static void shm_display_grow(ShmDisplay *sd, size_t size)
+{
+    void *p;
+
+    if (ftruncate(sd->fd, size) < 0) {
+        error_report("shm display: cannot grow the frame file: %s",
+                     strerror(errno));
+        exit(1);
+    }
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, sd->fd, 0);
+    if (p == MAP_FAILED) {
+        error_report("shm display: cannot map the frame file: %s",
+                     strerror(errno));
+        exit(1);
+    }
+    if (sd->hdr) {
+        munmap(sd->hdr, sd->size);
+    }
+    sd->hdr = p;
+    sd->size = size;
+    sd->hdr->size = size;
+    smp_wmb();
+}
+
+/*
+ * Make room in slot @i for a frame of the current surface.  A slot that
+ * is too small gets a new frame buffer at the end of the file rather
+ * than moving the others, which readers may still be copying from.
+ */
+static void shm_display_reserve_slot(ShmDisplay *sd, int i)
+{
+    int width = surface_width(sd->ds);
+    int height = surface_height(sd->ds);
+    size_t size = ROUND_UP((size_t)width * 4 * height,
+                           qemu_real_host_page_size);
+
+    if (size <= sd->slot_size[i]) {
+        return;
+    }
+    sd->slot_offset[i] = sd->size;
+    sd->slot_size[i] = size;
+    shm_display_grow(sd, sd->size + size);
+    /* Nothing of the current surface is in the new buffer yet */
+    sd->stale[i] = (ShmDisplayBox) { 0, 0, width, height };
+}
+
+static void shm_display_publish(ShmDisplay *sd)
+{
+    int i = (sd->hdr->latest + 1) % sd->nr_slots;
+    ShmDisplayHeader *hdr;
+    ShmDisplaySlot *slot;
+    ShmDisplayBox *box = &sd->stale[i];
+    uint32_t frame;
+    pixman_image_t *dst;
+
+    /* This may map the file again */
+    shm_display_reserve_slot(sd, i);
+    hdr = sd->hdr;
+    slot = &hdr->slots[i];
+    frame = hdr->frame + 1;
+
+    atomic_set(&slot->seq, frame * 2 - 1);
+    smp_wmb();
+
+    slot->offset = sd->slot_offset[i];
+    slot->width = surface_width(sd->ds);
+    slot->height = surface_height(sd->ds);
+    slot->stride = slot->width * 4;
+    if (box->x1 < box->x2) {
+        dst = pixman_image_create_bits(PIXMAN_x8r8g8b8,
+                                       slot->width, slot->height,
+                                       (void *)hdr + slot->offset,
+                                       slot->stride);
+        pixman_image_composite(PIXMAN_OP_SRC, sd->ds->image, NULL, dst,
+                               box->x1, box->y1, 0, 0, box->x1, box->y1,
+                               box->x2 - box->x1, box->y2 - box->y1);
+        pixman_image_unref(dst);
+        box->x1 = box->x2 = 0;
+    }
+    memcpy(slot->rects, sd->rects, sd->nr_rects * sizeof(sd->rects[0]));
+    slot->nr_rects = sd->nr_rects;
+    sd->nr_rects = 0;
+
+    smp_wmb();
+    atomic_set(&slot->seq, frame * 2);
+    atomic_set(&hdr->latest, i);
+    smp_wmb();
+    atomic_set(&hdr->frame, frame);
+}
+
+static void shm_display_refresh(DisplayChangeListener *dcl)
+{
+    ShmDisplay *sd = container_of(dcl, ShmDisplay, dcl);
+
+    graphic_hw_update(dcl->con);
+    if (sd->ds && sd->nr_rects) {
+        shm_display_publish(sd);
+    }
+}
+
+static void shm_display_gfx_update(DisplayChangeListener *dcl,
+                                   int x, int y, int w, int h)
+{
+    ShmDisplay *sd = container_of(dcl, ShmDisplay, dcl);
+    int x1, y1, x2, y2;
+
+    if (!sd->ds) {
+        return;
+    }
+    x1 = MAX(x, 0);
+    y1 = MAX(y, 0);
+    x2 = MIN(x + w, surface_width(sd->ds));
+    y2 = MIN(y + h, surface_height(sd->ds));
+    shm_display_add_rect(sd, x1, y1, x2 - x1, y2 - y1);
+}
+
+static void shm_display_gfx_switch(DisplayChangeListener *dcl,
+                                   DisplaySurface *new_surface)
+{
+    ShmDisplay *sd = container_of(dcl, ShmDisplay, dcl);
+
+    sd->ds = new_surface;
+    if (!new_surface) {
+        return;
+    }
+    shm_display_add_rect(sd, 0, 0, surface_width(new_surface),
+                         surface_height(new_surface));
+}
+
+static const DisplayChangeListenerOps shm_display_ops = {
+    .dpy_name          = "shm",
+    .dpy_refresh       = shm_display_refresh,
+    .dpy_gfx_update    = shm_display_gfx_update,
+    .dpy_gfx_switch    = shm_display_gfx_switch,
+};
+
+static void shm_display_init(DisplayState *ds, DisplayOptions *opts)
+{
+    DisplayShm *shm = &opts->u.shm;
+    QemuConsole *con = qemu_console_lookup_by_index(0);
+    ShmDisplay *sd;
+
+    if (shm->has_slots &&
+        (shm->slots < 2 || shm->slots > SHM_DISPLAY_MAX_SLOTS)) {
+        error_report("shm display: slots must be between 2 and %d",
+                     SHM_DISPLAY_MAX_SLOTS);
+        exit(1);
+    }
+    if (!con || !qemu_console_is_graphic(con)) {
+        warn_report("shm display: no graphical console");
+        return;
+    }
+
+    sd = g_new0(ShmDisplay, 1);
+    sd->nr_slots = shm->has_slots ? shm->slots : 3;
+    sd->fd = qemu_open(shm->path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (sd->fd < 0) {
+        error_report("shm display: cannot create '%s': %s",
+                     shm->path, strerror(errno));
+        exit(1);
+    }
+
+    sd->header_size = ROUND_UP(sizeof(ShmDisplayHeader),
+                               qemu_real_host_page_size);
+    sd->size = 0;
+    if (ftruncate(sd->fd, sd->header_size) < 0) {
+        error_report("shm display: cannot size '%s': %s",
+                     shm->path, strerror(errno));
+        exit(1);
+    }
+    sd->hdr = mmap(NULL, sd->header_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, sd->fd, 0);
+    if (sd->hdr == MAP_FAILED) {
+        error_report("shm display: cannot map '%s': %s",
+                     shm->path, strerror(errno));
+        exit(1);
+    }
+    sd->size = sd->header_size;
+    sd->hdr->version = SHM_DISPLAY_VERSION;
+    sd->hdr->format = PIXMAN_x8r8g8b8;
+    sd->hdr->size = sd->size;
+    sd->hdr->nr_slots = sd->nr_slots;
+    sd->hdr->latest = sd->nr_slots - 1;     /* first frame goes to slot 0 */
+    smp_wmb();
+    sd->hdr->magic = SHM_DISPLAY_MAGIC;
+
+    sd->dcl.con = con;
+    sd->dcl.ops = &shm_display_ops;
+    register_displaychangelistener(&sd->dcl);
+}
+
+static QemuDisplay qemu_display_shm = {
+    .type       = DISPLAY_TYPE_SHM,
+    .init       = shm_display_init,
+};
+
+static void register_shm_display(void)
+{
+    qemu_display_register(&qemu_display_shm);
+}
+
+type_init(register_shm_display);
@@ -44,18 +44,27 @@
  * - VncState::output lock: used to make sure the output buffer is not corrupted
  *                          if two threads try to write on it at the same time
  *
- * While the VNC worker thread is working, the VncDisplay global lock is held
- * to avoid screen corruption (this does not block vnc_refresh() because it
- * uses trylock()) but the output lock is not held because the thread works on
- * its own output buffer.
+ * While a VNC worker thread is working, the VncDisplay global lock is held
+ * shared to avoid screen corruption (this does not block vnc_refresh() because
+ * it uses trylock()) but the output lock is not held because the thread works
+ * on its own output buffer.
  * When the encoding job is done, the worker thread will hold the output lock
  * and copy its output buffer in vs->output.
+ *
+ * There are several worker threads.  Jobs for different clients are encoded
+ * in parallel, but a client's jobs run one at a time and in the order they
+ * were pushed: its encoders keep state (zlib streams) from one update to the
+ * next, and its updates must reach it in order.
  */
 
+/* Upper bound for the number of worker and refresh threads */
+#define VNC_WORKERS_MAX 8
+
 struct VncJobQueue {
     QemuCond cond;
     QemuMutex mutex;
-    QemuThread thread;
+    QemuThread threads[VNC_WORKERS_MAX];
+    int nr_threads;
     bool exit;
     QTAILQ_HEAD(, VncJob) jobs;
 };
@@ -63,11 +72,28 @@ struct VncJobQueue {
 typedef struct VncJobQueue VncJobQueue;
 
 /*
- * We use a single global queue, but most of the functions are
- * already reentrant, so we can easily add more than one encoding thread
+ * We use a single global queue, served by all encoding threads
  */
 static VncJobQueue *queue;
 
+/*
+ * Threads that help the main loop with vnc_parallel_run()
+ */
+typedef struct VncHelper {
+    QemuThread thread;
+    QemuSemaphore start;
+    int index;
+} VncHelper;
+
+static struct {
+    VncHelper helpers[VNC_WORKERS_MAX - 1];
+    int nr_helpers;
+    QemuSemaphore done;
+    VncParallelFunc *fn;
+    void *opaque;
+    int n;
+} vnc_parallel;
+
 static void vnc_lock_queue(VncJobQueue *queue)
 {
     qemu_mutex_lock(&queue->mutex);
@@ -117,6 +143,31 @@ void vnc_job_push(VncJob *job)
     vnc_unlock_queue(queue);
 }
 
+/*
+ * Return the first job that no other thread is working on and that is
+ * the oldest one for its client.
+ */
+static VncJob *vnc_next_job_locked(VncJobQueue *queue)
+{
+    VncJob *job, *prev;
+
+    QTAILQ_FOREACH(job, &queue->jobs, next) {
+        if (job->running) {
+            continue;
+        }
+        for (prev = QTAILQ_FIRST(&queue->jobs); prev != job;
+             prev = QTAILQ_NEXT(prev, next)) {
+            if (prev->vs == job->vs) {
+                break;
+            }
+        }
+        if (prev == job) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
 static bool vnc_has_job_locked(VncState *vs)
 {
     VncJob *job;
@@ -210,17 +261,16 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
     int saved_offset;
 
     vnc_lock_queue(queue);
-    while (QTAILQ_EMPTY(&queue->jobs) && !queue->exit) {
+    while (!queue->exit && !(job = vnc_next_job_locked(queue))) {
         qemu_cond_wait(&queue->cond, &queue->mutex);
     }
-    /* Here job can only be NULL if queue->exit is true */
-    job = QTAILQ_FIRST(&queue->jobs);
-    vnc_unlock_queue(queue);
-    assert(job->vs->magic == VNC_MAGIC);
-
     if (queue->exit) {
+        vnc_unlock_queue(queue);
         return -1;
     }
+    job->running = true;
+    vnc_unlock_queue(queue);
+    assert(job->vs->magic == VNC_MAGIC);
 
     vnc_lock_output(job->vs);
     if (job->vs->ioc == NULL || job->vs->abort == true) {
@@ -248,12 +298,12 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
     saved_offset = vs.output.offset;
     vnc_write_u16(&vs, 0);
 
-    vnc_lock_display(job->vs->vd);
+    vnc_lock_display_shared(job->vs->vd);
     QLIST_FOREACH_SAFE(entry, &job->rectangles, next, tmp) {
         int n;
 
         if (job->vs->ioc == NULL) {
-            vnc_unlock_display(job->vs->vd);
+            vnc_unlock_display_shared(job->vs->vd);
             /* Copy persistent encoding data */
             vnc_async_encoding_end(job->vs, &vs);
             goto disconnected;
@@ -267,7 +317,7 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
         }
         g_free(entry);
     }
-    vnc_unlock_display(job->vs->vd);
+    vnc_unlock_display_shared(job->vs->vd);
 
     /* Put n_rectangles at the beginning of the message */
     vs.output.buffer[saved_offset] = (n_rectangles >> 8) & 0xFF;
@@ -318,14 +368,54 @@ static void vnc_queue_clear(VncJobQueue *q)
 static void *vnc_worker_thread(void *arg)
 {
     VncJobQueue *queue = arg;
-
-    qemu_thread_get_self(&queue->thread);
+    bool last;
 
     while (!vnc_worker_thread_loop(queue)) ;
-    vnc_queue_clear(queue);
+
+    vnc_lock_queue(queue);
+    last = !--queue->nr_threads;
+    vnc_unlock_queue(queue);
+    if (last) {
+        vnc_queue_clear(queue);
+    }
+    return NULL;
+}
+
+static void *vnc_helper_thread(void *arg)
+{
+    VncHelper *h = arg;
+
+    for (;;) {
+        qemu_sem_wait(&h->start);
+        vnc_parallel.fn(vnc_parallel.opaque, h->index, vnc_parallel.n);
+        qemu_sem_post(&vnc_parallel.done);
+    }
     return NULL;
 }
 
+/*
+ * Call @fn(@opaque, i, n) for i = 0 ... n - 1 and wait until all calls
+ * returned.  n is at most @max, and at most the number of host CPUs.
+ * The calls run in parallel, the first one in the calling thread.  Only
+ * used from the main loop.
+ */
+void vnc_parallel_run(VncParallelFunc *fn, void *opaque, int max)
+{
+    int n = MAX(MIN(max, vnc_parallel.nr_helpers + 1), 1);
+    int i;
+
+    vnc_parallel.fn = fn;
+    vnc_parallel.opaque = opaque;
+    vnc_parallel.n = n;
+    for (i = 1; i < n; i++) {
+        qemu_sem_post(&vnc_parallel.helpers[i - 1].start);
+    }
+    fn(opaque, 0, n);
+    for (i = 1; i < n; i++) {
+        qemu_sem_wait(&vnc_parallel.done);
+    }
+}
+
 static bool vnc_worker_thread_running(void)
 {
     return queue; /* Check global queue */
@@ -334,12 +424,28 @@ static bool vnc_worker_thread_running(void)
 void vnc_start_worker_thread(void)
 {
     VncJobQueue *q;
+    int nr_threads = MIN(g_get_num_processors(), VNC_WORKERS_MAX);
+    int i;
 
     if (vnc_worker_thread_running())
         return ;
 
     q = vnc_queue_init();
-    qemu_thread_create(&q->thread, "vnc_worker", vnc_worker_thread, q,
-                       QEMU_THREAD_DETACHED);
+    q->nr_threads = nr_threads;
+    for (i = 0; i < nr_threads; i++) {
+        qemu_thread_create(&q->threads[i], "vnc_worker", vnc_worker_thread, q,
+                           QEMU_THREAD_DETACHED);
+    }
     queue = q; /* Set global queue */
+
+    qemu_sem_init(&vnc_parallel.done, 0);
+    vnc_parallel.nr_helpers = nr_threads - 1;
+    for (i = 0; i < vnc_parallel.nr_helpers; i++) {
+        VncHelper *h = &vnc_parallel.helpers[i];
+
+        h->index = i + 1;
+        qemu_sem_init(&h->start, 0);
+        qemu_thread_create(&h->thread, "vnc_refresh", vnc_helper_thread, h,
+                           QEMU_THREAD_DETACHED);
+    }
 }
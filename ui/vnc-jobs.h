@@ -39,19 +39,44 @@ void vnc_jobs_join(VncState *vs);
 void vnc_jobs_consume_buffer(VncState *vs);
 void vnc_start_worker_thread(void);
 
-/* Locks */
+typedef void VncParallelFunc(void *opaque, int i, int n);
+void vnc_parallel_run(VncParallelFunc *fn, void *opaque, int max);
+
+/*
+ * Locks
+ *
+ * Encoding workers only read the server surface, so any number of them
+ * can share the display lock.  vnc_refresh() writes the surface and
+ * needs it exclusively; it only tries to take it, and retries later.
+ */
 static inline int vnc_trylock_display(VncDisplay *vd)
 {
-    return qemu_mutex_trylock(&vd->mutex);
+    if (qemu_mutex_trylock(&vd->mutex)) {
+        return -EBUSY;
+    }
+    if (vd->mutex_readers) {
+        qemu_mutex_unlock(&vd->mutex);
+        return -EBUSY;
+    }
+    return 0;
+}
+
+static inline void vnc_unlock_display(VncDisplay *vd)
+{
+    qemu_mutex_unlock(&vd->mutex);
 }
 
-static inline void vnc_lock_display(VncDisplay *vd)
+static inline void vnc_lock_display_shared(VncDisplay *vd)
 {
     qemu_mutex_lock(&vd->mutex);
+    vd->mutex_readers++;
+    qemu_mutex_unlock(&vd->mutex);
 }
 
-static inline void vnc_unlock_display(VncDisplay *vd)
+static inline void vnc_unlock_display_shared(VncDisplay *vd)
 {
+    qemu_mutex_lock(&vd->mutex);
+    vd->mutex_readers--;
     qemu_mutex_unlock(&vd->mutex);
 }
 
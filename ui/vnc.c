@@ -54,6 +54,8 @@
 #define VNC_REFRESH_INTERVAL_BASE GUI_REFRESH_INTERVAL_DEFAULT
 #define VNC_REFRESH_INTERVAL_INC  50
 #define VNC_REFRESH_INTERVAL_MAX  GUI_REFRESH_INTERVAL_IDLE
+/* Rows of the server surface refreshed by each thread, at least */
+#define VNC_REFRESH_ROWS_MIN      (4 * VNC_STAT_RECT)
 static const struct timeval VNC_REFRESH_STATS = { 0, 500000 };
 static const struct timeval VNC_REFRESH_LOSSY = { 2, 0 };
 
@@ -2891,25 +2893,22 @@ static void vnc_rect_updated(VncDisplay *vd, int x, int y, struct timeval * tv)
     rect->updated = true;
 }
 
-static int vnc_refresh_server_surface(VncDisplay *vd)
+/*
+ * Refresh rows [@y, @end) of the server surface.  Several of these run in
+ * parallel on disjoint bands of rows; bands start at a multiple of
+ * VNC_STAT_RECT so that each VncRectStat is only updated by one of them.
+ */
+static int vnc_refresh_server_rows(VncDisplay *vd, int y, int end,
+                                   struct timeval *tv)
 {
     int width = MIN(pixman_image_get_width(vd->guest.fb),
                     pixman_image_get_width(vd->server));
-    int height = MIN(pixman_image_get_height(vd->guest.fb),
-                     pixman_image_get_height(vd->server));
-    int cmp_bytes, server_stride, line_bytes, guest_ll, guest_stride, y = 0;
+    int cmp_bytes, server_stride, line_bytes, guest_ll, guest_stride;
     uint8_t *guest_row0 = NULL, *server_row0;
     VncState *vs;
     int has_dirty = 0;
     pixman_image_t *tmpbuf = NULL;
 
-    struct timeval tv = { 0, 0 };
-
-    if (!vd->non_adaptive) {
-        gettimeofday(&tv, NULL);
-        has_dirty = vnc_update_stats(vd, &tv);
-    }
-
     /*
      * Walk through the guest dirty map.
      * Check and copy modified bits from guest to server surface.
@@ -2937,9 +2936,9 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
         int x;
         uint8_t *guest_ptr, *server_ptr;
         unsigned long offset = find_next_bit((unsigned long *) &vd->guest.dirty,
-                                             height * VNC_DIRTY_BPL(&vd->guest),
+                                             end * VNC_DIRTY_BPL(&vd->guest),
                                              y * VNC_DIRTY_BPL(&vd->guest));
-        if (offset == height * VNC_DIRTY_BPL(&vd->guest)) {
+        if (offset >= end * VNC_DIRTY_BPL(&vd->guest)) {
             /* no more dirty bits */
             break;
         }
@@ -2972,7 +2971,7 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
             memcpy(server_ptr, guest_ptr, _cmp_bytes);
             if (!vd->non_adaptive) {
                 vnc_rect_updated(vd, x * VNC_DIRTY_PIXELS_PER_BIT,
-                                 y, &tv);
+                                 y, tv);
             }
             QTAILQ_FOREACH(vs, &vd->clients, next) {
                 set_bit(x, vs->dirty[y]);
@@ -2986,6 +2985,46 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
     return has_dirty;
 }
 
+typedef struct VncRefreshBands {
+    VncDisplay *vd;
+    int height;
+    struct timeval *tv;
+    int has_dirty;
+} VncRefreshBands;
+
+static void vnc_refresh_server_band(void *opaque, int i, int n)
+{
+    VncRefreshBands *bands = opaque;
+    int rows = ROUND_UP(DIV_ROUND_UP(bands->height, n), VNC_STAT_RECT);
+    int y = MIN(i * rows, bands->height);
+    int end = MIN(y + rows, bands->height);
+
+    atomic_add(&bands->has_dirty,
+               vnc_refresh_server_rows(bands->vd, y, end, bands->tv));
+}
+
+static int vnc_refresh_server_surface(VncDisplay *vd)
+{
+    int height = MIN(pixman_image_get_height(vd->guest.fb),
+                     pixman_image_get_height(vd->server));
+    struct timeval tv = { 0, 0 };
+    VncRefreshBands bands = {
+        .vd = vd,
+        .height = height,
+        .tv = &tv,
+    };
+
+    if (!vd->non_adaptive) {
+        gettimeofday(&tv, NULL);
+        bands.has_dirty = vnc_update_stats(vd, &tv);
+    }
+
+    /* Only split large surfaces, a wakeup costs more than a few rows */
+    vnc_parallel_run(vnc_refresh_server_band, &bands,
+                     height / VNC_REFRESH_ROWS_MIN);
+    return bands.has_dirty;
+}
+
 static void vnc_refresh(DisplayChangeListener *dcl)
 {
     VncDisplay *vd = container_of(dcl, VncDisplay, dcl);
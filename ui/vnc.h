@@ -157,6 +157,7 @@ struct VncDisplay
     int ledstate;
     QKbdState *kbd;
     QemuMutex mutex;
+    int mutex_readers;          /* encoding workers sharing @mutex */
 
     QEMUCursor *cursor;
     int cursor_msize;
@@ -247,6 +248,7 @@ struct VncRectEntry
 struct VncJob
 {
     VncState *vs;
+    bool running;           /* picked up by a worker thread */
 
     QLIST_HEAD(, VncRectEntry) rectangles;
     QTAILQ_ENTRY(VncJob) next;
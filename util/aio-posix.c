@@ -607,6 +607,25 @@ static bool try_poll_mode(AioContext *ctx, int64_t *timeout)
     return run_poll_handlers_once(ctx, timeout);
 }
 
+static void aio_poll_account(AioContext *ctx, bool polled, bool progress,
+                             int64_t block_ns)
+{
+    int64_t limit = 1000;
+    int i;
+
+    if (polled) {
+        stat64_add(progress ? &ctx->poll_hits : &ctx->poll_misses, 1);
+    }
+
+    for (i = 0; i < AIO_POLL_WAIT_HIST_BUCKETS - 1; i++) {
+        if (block_ns < limit) {
+            break;
+        }
+        limit *= 4;
+    }
+    stat64_add(&ctx->poll_wait_hist[i], 1);
+}
+
 bool aio_poll(AioContext *ctx, bool blocking)
 {
     AioHandler *node;
@@ -615,6 +634,7 @@ bool aio_poll(AioContext *ctx, bool blocking)
     bool progress;
     int64_t timeout;
     int64_t start = 0;
+    bool polled;
 
     assert(in_aio_context_home_thread(ctx));
 
@@ -636,6 +656,7 @@ bool aio_poll(AioContext *ctx, bool blocking)
     }
 
     timeout = blocking ? aio_compute_timeout(ctx) : 0;
+    polled = blocking && timeout && ctx->poll_ns;
     progress = try_poll_mode(ctx, &timeout);
     assert(!(timeout && progress));
 
@@ -679,6 +700,8 @@ bool aio_poll(AioContext *ctx, bool blocking)
     if (ctx->poll_max_ns) {
         int64_t block_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start;
 
+        aio_poll_account(ctx, polled, progress, block_ns);
+
         if (block_ns <= ctx->poll_ns) {
             /* This is the sweet spot, no adjustment needed */
         } else if (block_ns > ctx->poll_max_ns) {
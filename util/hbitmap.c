@@ -12,6 +12,7 @@
 #include "qemu/osdep.h"
 #include "qemu/hbitmap.h"
 #include "qemu/host-utils.h"
+#include "qemu/cutils.h"
 #include "trace.h"
 #include "crypto/hash.h"
 
@@ -193,6 +194,23 @@ void hbitmap_iter_init(HBitmapIter *hbi, const HBitmap *hb, uint64_t first)
     }
 }
 
+/* Return the index of the first word in [pos, end) that is not all ones, or
+ * @end.  Long runs of dirty words are skipped four words at a time.
+ */
+static size_t hb_find_not_full(const unsigned long *words, size_t pos,
+                               size_t end)
+{
+    while (pos + 4 <= end &&
+           (words[pos] & words[pos + 1] &
+            words[pos + 2] & words[pos + 3]) == (unsigned long)-1) {
+        pos += 4;
+    }
+    while (pos < end && words[pos] == (unsigned long)-1) {
+        pos++;
+    }
+    return pos;
+}
+
 int64_t hbitmap_next_zero(const HBitmap *hb, uint64_t start, uint64_t count)
 {
     size_t pos = (start >> hb->granularity) >> BITS_PER_LEVEL;
@@ -219,10 +237,7 @@ int64_t hbitmap_next_zero(const HBitmap *hb, uint64_t start, uint64_t count)
     assert((start >> hb->granularity) < hb->size);
 
     if (cur == (unsigned long)-1) {
-        do {
-            pos++;
-        } while (pos < sz && last_lev[pos] == (unsigned long)-1);
-
+        pos = hb_find_not_full(last_lev, pos + 1, sz);
         if (pos >= sz) {
             return -1;
         }
@@ -346,6 +361,20 @@ static inline bool hb_set_elem(unsigned long *elem, uint64_t start, uint64_t las
     return old != *elem;
 }
 
+/* Set words [start, end) of a level and return whether one of them was
+ * zero, in which case the level above changes too.
+ */
+static bool hb_fill_words(unsigned long *words, size_t start, size_t end)
+{
+    size_t i = start;
+
+    while (i < end && words[i] != 0) {
+        i++;
+    }
+    memset(&words[start], 0xff, (end - start) * sizeof(unsigned long));
+    return i < end;
+}
+
 /* The recursive workhorse (the depth is limited to HBITMAP_LEVELS)...
  * Returns true if at least one bit is changed. */
 static bool hb_set_between(HBitmap *hb, int level, uint64_t start,
@@ -360,15 +389,9 @@ static bool hb_set_between(HBitmap *hb, int level, uint64_t start,
     if (i < lastpos) {
         uint64_t next = (start | (BITS_PER_LONG - 1)) + 1;
         changed |= hb_set_elem(&hb->levels[level][i], start, next - 1);
-        for (;;) {
-            start = next;
-            next += BITS_PER_LONG;
-            if (++i == lastpos) {
-                break;
-            }
-            changed |= (hb->levels[level][i] == 0);
-            hb->levels[level][i] = ~0UL;
-        }
+        changed |= hb_fill_words(hb->levels[level], i + 1, lastpos);
+        start = (uint64_t)lastpos << BITS_PER_LEVEL;
+        i = lastpos;
     }
     changed |= hb_set_elem(&hb->levels[level][i], start, last);
 
@@ -420,6 +443,18 @@ static inline bool hb_reset_elem(unsigned long *elem, uint64_t start, uint64_t l
     return blanked;
 }
 
+/* Clear words [start, end) of a level and return whether one of them was
+ * not zero already.  buffer_is_zero() checks whole vectors at a time.
+ */
+static bool hb_clear_words(unsigned long *words, size_t start, size_t end)
+{
+    size_t len = (end - start) * sizeof(unsigned long);
+    bool changed = !buffer_is_zero(&words[start], len);
+
+    memset(&words[start], 0, len);
+    return changed;
+}
+
 /* The recursive workhorse (the depth is limited to HBITMAP_LEVELS)...
  * Returns true if at least one bit is changed. */
 static bool hb_reset_between(HBitmap *hb, int level, uint64_t start,
@@ -445,15 +480,9 @@ static bool hb_reset_between(HBitmap *hb, int level, uint64_t start,
             pos++;
         }
 
-        for (;;) {
-            start = next;
-            next += BITS_PER_LONG;
-            if (++i == lastpos) {
-                break;
-            }
-            changed |= (hb->levels[level][i] != 0);
-            hb->levels[level][i] = 0UL;
-        }
+        changed |= hb_clear_words(hb->levels[level], i + 1, lastpos);
+        start = (uint64_t)lastpos << BITS_PER_LEVEL;
+        i = lastpos;
     }
 
     /* Same as above, this time for lastpos.  */
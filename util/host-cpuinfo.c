@@ -0,0 +1,60 @@
+/*
+ * Probe the features of the x86 host
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/host-cpuinfo.h"
+#ifdef CONFIG_CPUID_H
+#include "qemu/cpuid.h"
+#endif
+
+unsigned host_cpuinfo;
+
+#ifdef CONFIG_CPUID_H
+static unsigned host_cpuinfo_probe(void)
+{
+    int max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned info = 0;
+
+    if (max >= 1) {
+        __cpuid(1, a, b, c, d);
+        info |= (d & bit_SSE2 ? CPUINFO_SSE2 : 0);
+        info |= (c & bit_SSE4_1 ? CPUINFO_SSE4 : 0);
+        info |= (c & bit_AES ? CPUINFO_AES : 0);
+        info |= (c & bit_PCLMUL ? CPUINFO_PCLMUL : 0);
+
+        /* We must check that AVX is not just available, but usable.  */
+        if ((c & bit_OSXSAVE) && (c & bit_AVX) && max >= 7) {
+            int bv;
+            __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+            __cpuid_count(7, 0, a, b, c, d);
+            if ((bv & 6) == 6 && (b & bit_AVX2)) {
+                info |= CPUINFO_AVX2;
+            }
+            /* Also check that the OS saves the opmask and ZMM state.  */
+            if ((bv & 0xe6) == 0xe6) {
+                info |= (b & bit_AVX512F ? CPUINFO_AVX512F : 0);
+                info |= (b & bit_AVX512BW ? CPUINFO_AVX512BW : 0);
+            }
+        }
+    }
+    return info;
+}
+#else
+static unsigned host_cpuinfo_probe(void)
+{
+    return 0;
+}
+#endif
+
+unsigned __attribute__((constructor)) host_cpuinfo_init(void)
+{
+    if (!host_cpuinfo) {
+        host_cpuinfo = CPUINFO_ALWAYS | host_cpuinfo_probe();
+    }
+    return host_cpuinfo;
+}
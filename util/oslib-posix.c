@@ -741,8 +741,9 @@ void qemu_free_stack(void *stack, size_t sz)
     }
     usage = sz - (uintptr_t) (ptr - stack);
     if (usage > max_stack_usage) {
-        error_report("thread %d max stack usage increased from %u to %u",
-                     qemu_get_thread_id(), max_stack_usage, usage);
+        error_report("thread %d max stack usage increased from %u to %u "
+                     "(of %zu)", qemu_get_thread_id(), max_stack_usage, usage,
+                     sz - getpagesize());
         max_stack_usage = usage;
     }
 #endif
@@ -22,8 +22,8 @@
  * - Writes (i.e. insertions/removals) can be concurrent with writes to
  *   different buckets; writes to the same bucket are serialized through a lock.
  * - Optional auto-resizing: the hash table resizes up if the load surpasses
- *   a certain threshold. Resizing is done concurrently with readers; writes
- *   are serialized with the resize operation.
+ *   a certain threshold. Resizing is done concurrently with readers and,
+ *   for automatic resizes, with writers as well.
  *
  * The key structure is the bucket, which is cacheline-sized. Buckets
  * contain a few hash values and pointers; the u32 hash values are stored in
@@ -43,10 +43,19 @@
  * just-removed entry. This makes lookups slightly faster, since the moment an
  * invalid entry is found, the (failed) lookup is over.
  *
- * Resizing is done by taking all bucket spinlocks (so that no other writers can
- * race with us) and then copying all entries into a new hash map. Then, the
- * ht->map pointer is set, and the old map is freed once no RCU readers can see
- * it anymore.
+ * Explicit resizes (qht_resize, qht_reset_size) are done by taking all bucket
+ * spinlocks (so that no other writers can race with us) and then copying all
+ * entries into a new hash map. Then, the ht->map pointer is set, and the old
+ * map is freed once no RCU readers can see it anymore.
+ *
+ * Automatic resizes instead publish an empty map right away, which keeps a
+ * pointer to the old one. Head buckets of the old map are then migrated one
+ * at a time: each writer first migrates the old bucket its hash maps to, plus
+ * the next not-yet-migrated one, so that the whole old map is drained after
+ * at most as many writes as it has head buckets. A bitmap tracks which old
+ * buckets have been migrated; lookups search the old bucket as well until
+ * its bit is set. Once the last bucket is migrated, the old map is freed
+ * after an RCU grace period. Old buckets are always locked before new ones.
  *
  * Writers check for concurrent resizes by comparing ht->map before and after
  * acquiring their bucket lock. If they don't match, a resize has occured
@@ -69,6 +78,7 @@
 #include "qemu/qht.h"
 #include "qemu/atomic.h"
 #include "qemu/rcu.h"
+#include "qemu/bitmap.h"
 
 //#define QHT_DEBUG
 
@@ -159,6 +169,11 @@ QEMU_BUILD_BUG_ON(sizeof(struct qht_bucket) > QHT_BUCKET_ALIGN);
  * @n_added_buckets: number of added (i.e. "non-head") buckets
  * @n_added_buckets_threshold: threshold to trigger an upward resize once the
  *                             number of added buckets surpasses it.
+ * @old: map whose entries are being migrated into this one, or NULL.
+ *       Set before the map is published; cleared once, with ht->lock held.
+ * @migrated: bitmap of the head buckets of @old that have been migrated
+ * @n_migrated: number of bits set in @migrated
+ * @migrate_next: next head bucket of @old that a writer should migrate
  *
  * Buckets are tracked in what we call a "map", i.e. this structure.
  */
@@ -168,6 +183,10 @@ struct qht_map {
     size_t n_buckets;
     size_t n_added_buckets;
     size_t n_added_buckets_threshold;
+    struct qht_map *old;
+    unsigned long *migrated;
+    size_t n_migrated;
+    size_t migrate_next;
 };
 
 /* trigger a resize when n_added_buckets > n_buckets / div */
@@ -176,6 +195,11 @@ struct qht_map {
 static void qht_do_resize_reset(struct qht *ht, struct qht_map *new,
                                 bool reset);
 static void qht_grow_maybe(struct qht *ht);
+static void *qht_insert__locked(const struct qht *ht, struct qht_map *map,
+                                struct qht_bucket *head, void *p, uint32_t hash,
+                                bool *needs_resize);
+static void qht_bucket_reset__locked(struct qht_bucket *head);
+static void qht_map_destroy(struct qht_map *map);
 
 #ifdef QHT_DEBUG
 
@@ -274,6 +298,112 @@ static inline bool qht_map_is_stale__locked(const struct qht *ht,
     return map != ht->map;
 }
 
+static inline bool qht_map_bucket_migrated(const struct qht_map *map,
+                                           size_t idx)
+{
+    return atomic_read(&map->migrated[BIT_WORD(idx)]) & BIT_MASK(idx);
+}
+
+/*
+ * Move the entries of head bucket @idx of @old (i.e. map->old) into @map.
+ * Returns true if this was the last bucket of @old to be migrated.
+ *
+ * Call without holding any bucket lock. @ht is const since it is only used
+ * for ht->cmp().
+ */
+static bool qht_map_migrate_bucket(const struct qht *ht, struct qht_map *map,
+                                   struct qht_map *old, size_t idx)
+{
+    struct qht_bucket *head = &old->buckets[idx];
+    struct qht_bucket *b = head;
+    bool last;
+    int i;
+
+    if (qht_map_bucket_migrated(map, idx)) {
+        return false;
+    }
+    qemu_spin_lock(&head->lock);
+    if (qht_map_bucket_migrated(map, idx)) {
+        qemu_spin_unlock(&head->lock);
+        return false;
+    }
+    do {
+        for (i = 0; i < QHT_BUCKET_ENTRIES; i++) {
+            struct qht_bucket *to;
+
+            if (b->pointers[i] == NULL) {
+                goto done;
+            }
+            to = qht_map_to_bucket(map, b->hashes[i]);
+            qemu_spin_lock(&to->lock);
+            qht_insert__locked(ht, map, to, b->pointers[i], b->hashes[i], NULL);
+            qht_bucket_debug__locked(to);
+            qemu_spin_unlock(&to->lock);
+        }
+        b = b->next;
+    } while (b);
+ done:
+    /*
+     * Lookups check the bit before searching @head, and search the new
+     * buckets after it: clear @head first, so that a lookup never misses an
+     * entry that is being moved.
+     */
+    qht_bucket_reset__locked(head);
+    set_bit_atomic(idx, map->migrated);
+    last = atomic_fetch_inc(&map->n_migrated) + 1 == old->n_buckets;
+    qemu_spin_unlock(&head->lock);
+    return last;
+}
+
+/* call with ht->lock held */
+static void qht_map_migration_done__locked(struct qht_map *map)
+{
+    struct qht_map *old = map->old;
+
+    if (old) {
+        atomic_set(&map->old, NULL);
+        call_rcu(old, qht_map_destroy, rcu);
+    }
+}
+
+/*
+ * Migrate the old bucket that @hash maps to, plus the next bucket in line,
+ * so that writes to @map never see entries left in map->old.
+ * Returns true if the migration has just completed.
+ */
+static inline bool
+qht_map_migrate_step(const struct qht *ht, struct qht_map *map, uint32_t hash)
+{
+    struct qht_map *old = atomic_rcu_read(&map->old);
+    size_t idx;
+    bool last;
+
+    if (likely(old == NULL)) {
+        return false;
+    }
+    last = qht_map_migrate_bucket(ht, map, old, hash & (old->n_buckets - 1));
+    idx = atomic_fetch_inc(&map->migrate_next);
+    if (idx < old->n_buckets) {
+        last |= qht_map_migrate_bucket(ht, map, old, idx);
+    }
+    return last;
+}
+
+/* call with ht->lock held and no bucket lock held */
+static void qht_map_migrate_all(struct qht *ht, struct qht_map *map)
+{
+    struct qht_map *old = map->old;
+    size_t i;
+
+    if (old == NULL) {
+        return;
+    }
+    for (i = 0; i < old->n_buckets; i++) {
+        qht_map_migrate_bucket(ht, map, old, i);
+    }
+    qht_map_migration_done__locked(map);
+}
+
 /*
  * Grab all bucket locks, and set @pmap after making sure the map isn't stale.
  *
@@ -287,16 +417,23 @@ void qht_map_lock_buckets__no_stale(struct qht *ht, struct qht_map **pmap)
     struct qht_map *map;
 
     map = atomic_rcu_read(&ht->map);
-    qht_map_lock_buckets(map);
-    if (likely(!qht_map_is_stale__locked(ht, map))) {
-        *pmap = map;
-        return;
+    if (likely(atomic_read(&map->old) == NULL)) {
+        qht_map_lock_buckets(map);
+        if (likely(!qht_map_is_stale__locked(ht, map))) {
+            *pmap = map;
+            return;
+        }
+        qht_map_unlock_buckets(map);
     }
-    qht_map_unlock_buckets(map);
 
-    /* we raced with a resize; acquire ht->lock to see the updated ht->map */
+    /*
+     * We raced with a resize, or one is still migrating entries; acquire
+     * ht->lock to see the updated ht->map and finish the migration, since
+     * our caller wants to see every entry.
+     */
     qht_lock(ht);
     map = ht->map;
+    qht_map_migrate_all(ht, map);
     qht_map_lock_buckets(map);
     qht_unlock(ht);
     *pmap = map;
@@ -319,6 +456,11 @@ struct qht_bucket *qht_bucket_lock__no_stale(struct qht *ht, uint32_t hash,
     struct qht_map *map;
 
     map = atomic_rcu_read(&ht->map);
+    if (unlikely(qht_map_migrate_step(ht, map, hash))) {
+        qht_lock(ht);
+        qht_map_migration_done__locked(map);
+        qht_unlock(ht);
+    }
     b = qht_map_to_bucket(map, hash);
 
     qemu_spin_lock(&b->lock);
@@ -331,6 +473,9 @@ struct qht_bucket *qht_bucket_lock__no_stale(struct qht *ht, uint32_t hash,
     /* we raced with a resize; acquire ht->lock to see the updated ht->map */
     qht_lock(ht);
     map = ht->map;
+    if (unlikely(qht_map_migrate_step(ht, map, hash))) {
+        qht_map_migration_done__locked(map);
+    }
     b = qht_map_to_bucket(map, hash);
     qemu_spin_lock(&b->lock);
     qht_unlock(ht);
@@ -364,6 +509,7 @@ static void qht_map_destroy(struct qht_map *map)
         qht_chain_destroy(&map->buckets[i]);
     }
     qemu_vfree(map->buckets);
+    g_free(map->migrated);
     g_free(map);
 }
 
@@ -376,6 +522,10 @@ static struct qht_map *qht_map_create(size_t n_buckets)
     map->n_buckets = n_buckets;
 
     map->n_added_buckets = 0;
+    map->old = NULL;
+    map->migrated = NULL;
+    map->n_migrated = 0;
+    map->migrate_next = 0;
     map->n_added_buckets_threshold = n_buckets /
         QHT_NR_ADDED_BUCKETS_THRESHOLD_DIV;
 
@@ -409,6 +559,9 @@ void qht_init(struct qht *ht, qht_cmp_func_t cmp, size_t n_elems,
 /* call only when there are no readers/writers left */
 void qht_destroy(struct qht *ht)
 {
+    if (ht->map->old) {
+        qht_map_destroy(ht->map->old);
+    }
     qht_map_destroy(ht->map);
     memset(ht, 0, sizeof(*ht));
 }
@@ -523,15 +676,39 @@ void *qht_lookup__slowpath(const struct qht_bucket *b, qht_lookup_func_t func,
     return ret;
 }
 
+/*
+ * Search the bucket of the map being migrated into @map, unless it has been
+ * migrated already. This must be done before searching @map's own bucket.
+ */
+static __attribute__((noinline))
+void *qht_lookup__old(const struct qht_map *map, const struct qht_map *old,
+                      qht_lookup_func_t func, const void *userp, uint32_t hash)
+{
+    size_t idx = hash & (old->n_buckets - 1);
+
+    if (qht_map_bucket_migrated(map, idx)) {
+        return NULL;
+    }
+    return qht_lookup__slowpath(&old->buckets[idx], func, userp, hash);
+}
+
 void *qht_lookup_custom(const struct qht *ht, const void *userp, uint32_t hash,
                         qht_lookup_func_t func)
 {
     const struct qht_bucket *b;
     const struct qht_map *map;
+    const struct qht_map *old;
     unsigned int version;
     void *ret;
 
     map = atomic_rcu_read(&ht->map);
+    old = atomic_rcu_read(&map->old);
+    if (unlikely(old)) {
+        ret = qht_lookup__old(map, old, func, userp, hash);
+        if (ret) {
+            return ret;
+        }
+    }
     b = qht_map_to_bucket(map, hash);
 
     version = seqlock_read_begin(&b->sequence);
@@ -613,11 +790,18 @@ static __attribute__((noinline)) void qht_grow_maybe(struct qht *ht)
         return;
     }
     map = ht->map;
-    /* another thread might have just performed the resize we were after */
-    if (qht_map_needs_resize(map)) {
+    /*
+     * Another thread might have just performed the resize we were after.
+     * If the previous resize is still migrating entries, let it finish;
+     * a later insertion will trigger the resize again.
+     */
+    if (qht_map_needs_resize(map) && atomic_read(&map->old) == NULL) {
         struct qht_map *new = qht_map_create(map->n_buckets * 2);
 
-        qht_do_resize(ht, new);
+        /* entries are migrated by writers, see qht_map_migrate_step() */
+        new->old = map;
+        new->migrated = bitmap_new(map->n_buckets);
+        atomic_rcu_set(&ht->map, new);
     }
     qht_unlock(ht);
 }
@@ -802,8 +986,7 @@ do_qht_iter(struct qht *ht, const struct qht_iter *iter, void *userp)
 {
     struct qht_map *map;
 
-    map = atomic_rcu_read(&ht->map);
-    qht_map_lock_buckets(map);
+    qht_map_lock_buckets__no_stale(ht, &map);
     qht_map_iter__all_locked(map, iter, userp);
     qht_map_unlock_buckets(map);
 }
@@ -858,6 +1041,7 @@ static void qht_do_resize_reset(struct qht *ht, struct qht_map *new, bool reset)
     struct qht_map_copy_data data;
 
     old = ht->map;
+    qht_map_migrate_all(ht, old);
     qht_map_lock_buckets(old);
 
     if (reset) {
@@ -898,10 +1082,41 @@ bool qht_resize(struct qht *ht, size_t n_elems)
     return ret;
 }
 
+static void qht_bucket_count(const struct qht_bucket *head, size_t *pbuckets,
+                             size_t *pentries)
+{
+    const struct qht_bucket *b;
+    unsigned int version;
+    size_t buckets;
+    size_t entries;
+    int j;
+
+    do {
+        version = seqlock_read_begin(&head->sequence);
+        buckets = 0;
+        entries = 0;
+        b = head;
+        do {
+            for (j = 0; j < QHT_BUCKET_ENTRIES; j++) {
+                if (atomic_read(&b->pointers[j]) == NULL) {
+                    break;
+                }
+                entries++;
+            }
+            buckets++;
+            b = atomic_rcu_read(&b->next);
+        } while (b);
+    } while (seqlock_read_retry(&head->sequence, version));
+
+    *pbuckets = buckets;
+    *pentries = entries;
+}
+
 /* pass @stats to qht_statistics_destroy() when done */
 void qht_statistics_init(const struct qht *ht, struct qht_stats *stats)
 {
     const struct qht_map *map;
+    const struct qht_map *old;
     int i;
 
     map = atomic_rcu_read(&ht->map);
@@ -913,35 +1128,16 @@ void qht_statistics_init(const struct qht *ht, struct qht_stats *stats)
     /* bail out if the qht has not yet been initialized */
     if (unlikely(map == NULL)) {
         stats->head_buckets = 0;
+        stats->pending_buckets = 0;
         return;
     }
     stats->head_buckets = map->n_buckets;
 
     for (i = 0; i < map->n_buckets; i++) {
-        const struct qht_bucket *head = &map->buckets[i];
-        const struct qht_bucket *b;
-        unsigned int version;
         size_t buckets;
         size_t entries;
-        int j;
-
-        do {
-            version = seqlock_read_begin(&head->sequence);
-            buckets = 0;
-            entries = 0;
-            b = head;
-            do {
-                for (j = 0; j < QHT_BUCKET_ENTRIES; j++) {
-                    if (atomic_read(&b->pointers[j]) == NULL) {
-                        break;
-                    }
-                    entries++;
-                }
-                buckets++;
-                b = atomic_rcu_read(&b->next);
-            } while (b);
-        } while (seqlock_read_retry(&head->sequence, version));
 
+        qht_bucket_count(&map->buckets[i], &buckets, &entries);
         if (entries) {
             qdist_inc(&stats->chain, buckets);
             qdist_inc(&stats->occupancy,
@@ -952,6 +1148,23 @@ void qht_statistics_init(const struct qht *ht, struct qht_stats *stats)
             qdist_inc(&stats->occupancy, 0);
         }
     }
+
+    /* entries not yet migrated by an ongoing resize */
+    old = atomic_rcu_read(&map->old);
+    stats->pending_buckets = 0;
+    if (unlikely(old)) {
+        for (i = 0; i < old->n_buckets; i++) {
+            size_t buckets;
+            size_t entries;
+
+            if (qht_map_bucket_migrated(map, i)) {
+                continue;
+            }
+            qht_bucket_count(&old->buckets[i], &buckets, &entries);
+            stats->pending_buckets++;
+            stats->entries += entries;
+        }
+    }
 }
 
 void qht_statistics_destroy(struct qht_stats *stats)
@@ -24,12 +24,20 @@
  * synchronization objects this might be expensive, but note that it is
  * very rarely called -- reports are generated only when requested by users.
  *
+ * Each entry also keeps a histogram of its wait times, with power-of-two
+ * intervals, so that a few long waits can be told apart from many short ones.
+ *
  * Reports are generated as a table where each row represents a call site. A
  * call site is the triplet formed by the __file__ and __LINE__ of the caller
  * as well as the address of the "object" (i.e. mutex, rec. mutex or condvar)
  * being operated on. Optionally, call sites that operate on different objects
  * of the same type can be coalesced, which can be particularly useful when
- * profiling dynamically-allocated objects.
+ * profiling dynamically-allocated objects. Call sites can also be reported
+ * separately for each thread.
+ *
+ * The same data is available over QMP with x-query-sync-profile, which can
+ * also reset the profile atomically with taking it, and thus report only
+ * what happened since the previous query.
  *
  * Alternative designs considered:
  *
@@ -61,9 +69,12 @@
 #include "qemu/qemu-print.h"
 #include "qemu/thread.h"
 #include "qemu/timer.h"
+#include "qemu/host-utils.h"
 #include "qemu/qht.h"
 #include "qemu/rcu.h"
 #include "qemu/xxhash.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-misc.h"
 
 enum QSPType {
     QSP_MUTEX,
@@ -80,11 +91,21 @@ struct QSPCallSite {
 };
 typedef struct QSPCallSite QSPCallSite;
 
+/*
+ * Wait time histogram: interval 0 counts waits shorter than
+ * 2^QSP_HIST_SHIFT ns, interval i those shorter than 2^(QSP_HIST_SHIFT + i) ns,
+ * and the last interval all longer waits.
+ */
+#define QSP_HIST_SHIFT 10
+#define QSP_HIST_BUCKETS 16
+
 struct QSPEntry {
     void *thread_ptr;
     const QSPCallSite *callsite;
     uint64_t n_acqs;
     uint64_t ns;
+    uint64_t hist[QSP_HIST_BUCKETS];
+    int thread_id;
     unsigned int n_objs; /* count of coalesced objs; only used for reporting */
 };
 typedef struct QSPEntry QSPEntry;
@@ -104,7 +125,10 @@ typedef struct QSPSnapshot QSPSnapshot;
 /* this file's full path. Used to present all call sites with relative paths */
 static size_t qsp_qemu_path_len;
 
-/* the address of qsp_thread gives us a unique 'thread ID' */
+/*
+ * The address of qsp_thread gives us a unique 'thread ID'; its value is the
+ * thread's host ID, which is only used for reporting.
+ */
 static __thread int qsp_thread;
 
 /*
@@ -167,6 +191,17 @@ static uint32_t qsp_entry_no_thread_hash(const QSPEntry *entry)
     return do_qsp_entry_hash(entry, 0);
 }
 
+static uint32_t qsp_entry_no_obj_hash(const QSPEntry *entry)
+{
+    const QSPCallSite *callsite = entry->callsite;
+    uint64_t ab = g_str_hash(callsite->file);
+    uint64_t cd = (uint64_t)(uintptr_t)entry->thread_ptr;
+    uint32_t e = callsite->line;
+    uint32_t f = callsite->type;
+
+    return qemu_xxhash6(ab, cd, e, f);
+}
+
 /* without the objects we need to hash the file name to get a decent hash */
 static uint32_t qsp_entry_no_thread_obj_hash(const QSPEntry *entry)
 {
@@ -226,6 +261,15 @@ static bool qsp_entry_cmp(const void *ap, const void *bp)
         qsp_callsite_cmp(a->callsite, b->callsite);
 }
 
+static bool qsp_entry_no_obj_cmp(const void *ap, const void *bp)
+{
+    const QSPEntry *a = ap;
+    const QSPEntry *b = bp;
+
+    return a->thread_ptr == b->thread_ptr &&
+        qsp_callsite_no_obj_cmp(a->callsite, b->callsite);
+}
+
 /*
  * Normally we'd call this from a constructor function, but we want it to work
  * via libutil as well.
@@ -292,6 +336,7 @@ qsp_entry_create(struct qht *ht, const QSPEntry *entry, uint32_t hash)
 
     e = g_new0(QSPEntry, 1);
     e->thread_ptr = entry->thread_ptr;
+    e->thread_id = entry->thread_id;
     e->callsite = qsp_callsite_find(entry->callsite);
 
     qht_insert(ht, e, hash, &existing);
@@ -332,7 +377,11 @@ static QSPEntry *qsp_entry_get(const void *obj, const char *file, int line,
 
     qsp_init();
 
+    if (unlikely(qsp_thread == 0)) {
+        qsp_thread = qemu_get_thread_id();
+    }
     orig.thread_ptr = &qsp_thread;
+    orig.thread_id = qsp_thread;
     orig.callsite = &callsite;
 
     hash = qsp_entry_hash(&orig);
@@ -347,6 +396,15 @@ static inline void do_qsp_entry_record(QSPEntry *e, int64_t delta, bool acq)
 {
     atomic_set_u64(&e->ns, e->ns + delta);
     if (acq) {
+        uint64_t *bucket;
+        int i = 0;
+
+        if (delta >> QSP_HIST_SHIFT) {
+            i = MIN(63 - clz64(delta) - QSP_HIST_SHIFT + 1,
+                    QSP_HIST_BUCKETS - 1);
+        }
+        bucket = &e->hist[i];
+        atomic_set_u64(bucket, *bucket + 1);
         atomic_set_u64(&e->n_acqs, e->n_acqs + 1);
     }
 }
@@ -485,11 +543,13 @@ static gint qsp_tree_cmp(gconstpointer ap, gconstpointer bp, gpointer up)
             return cmp;
         }
         /* same callsite file. Break the tie with the callsite's line */
-        g_assert(ca->line != cb->line);
         if (ca->line < cb->line) {
             return -1;
         } else if (ca->line > cb->line) {
             return 1;
+        } else if (a->thread_ptr != b->thread_ptr) {
+            /* per-thread report: same call site, different threads */
+            return a->thread_ptr < b->thread_ptr ? -1 : 1;
         } else {
             /* break the tie with the callsite's type */
             return cb->type - ca->type;
@@ -505,14 +565,11 @@ static void qsp_sort(void *p, uint32_t h, void *userp)
     g_tree_insert(tree, e, NULL);
 }
 
-static void qsp_aggregate(void *p, uint32_t h, void *up)
+static void do_qsp_aggregate(struct qht *ht, const QSPEntry *e, uint32_t hash)
 {
-    struct qht *ht = up;
-    const QSPEntry *e = p;
     QSPEntry *agg;
-    uint32_t hash;
+    int i;
 
-    hash = qsp_entry_no_thread_hash(e);
     agg = qsp_entry_find(ht, e, hash);
     /*
      * The entry is in the global hash table; read from it atomically (as in
@@ -520,15 +577,44 @@ static void qsp_aggregate(void *p, uint32_t h, void *up)
      */
     agg->ns += atomic_read_u64(&e->ns);
     agg->n_acqs += atomic_read_u64(&e->n_acqs);
+    for (i = 0; i < QSP_HIST_BUCKETS; i++) {
+        agg->hist[i] += atomic_read_u64(&e->hist[i]);
+    }
+}
+
+static void qsp_aggregate(void *p, uint32_t h, void *up)
+{
+    const QSPEntry *e = p;
+
+    do_qsp_aggregate(up, e, qsp_entry_no_thread_hash(e));
 }
 
-static void qsp_iter_diff(void *p, uint32_t hash, void *htp)
+/* like qsp_aggregate, but keeps the entries of each thread apart */
+static void qsp_aggregate_thread(void *p, uint32_t h, void *up)
+{
+    const QSPEntry *e = p;
+
+    do_qsp_aggregate(up, e, qsp_entry_hash(e));
+}
+
+struct QSPDiffData {
+    struct qht *ht;
+    bool per_thread;
+};
+typedef struct QSPDiffData QSPDiffData;
+
+/* snapshots keep the entries of each thread apart; see qsp_snapshot_new() */
+static void qsp_iter_diff(void *p, uint32_t h, void *up)
 {
-    struct qht *ht = htp;
+    QSPDiffData *data = up;
     QSPEntry *old = p;
     QSPEntry *new;
+    uint32_t hash;
+    int i;
 
-    new = qht_lookup(ht, old, hash);
+    hash = data->per_thread ? qsp_entry_hash(old) :
+                              qsp_entry_no_thread_hash(old);
+    new = qht_lookup(data->ht, old, hash);
     /* entries are never deleted, so we must have this one */
     g_assert(new != NULL);
     /* our reading of the stats happened after the snapshot was taken */
@@ -537,29 +623,44 @@ static void qsp_iter_diff(void *p, uint32_t hash, void *htp)
 
     new->n_acqs -= old->n_acqs;
     new->ns -= old->ns;
+    for (i = 0; i < QSP_HIST_BUCKETS; i++) {
+        new->hist[i] -= old->hist[i];
+    }
+}
 
-    /* No point in reporting an empty entry */
-    if (new->n_acqs == 0 && new->ns == 0) {
-        bool removed = qht_remove(ht, new, hash);
+static bool qsp_iter_remove_empty(void *p, uint32_t h, void *up)
+{
+    QSPEntry *e = p;
 
-        g_assert(removed);
-        g_free(new);
+    /* No point in reporting an empty entry */
+    if (e->n_acqs == 0 && e->ns == 0) {
+        g_free(e);
+        return true;
     }
+    return false;
 }
 
-static void qsp_diff(struct qht *orig, struct qht *new)
+static void qsp_diff(struct qht *orig, struct qht *new, bool per_thread)
 {
-    qht_iter(orig, qsp_iter_diff, new);
+    QSPDiffData data = {
+        .ht = new,
+        .per_thread = per_thread,
+    };
+
+    /*
+     * Several per-thread snapshot entries may be subtracted from the same
+     * entry, so only remove the empty ones once all of them are done.
+     */
+    qht_iter(orig, qsp_iter_diff, &data);
+    qht_iter_remove(new, qsp_iter_remove_empty, NULL);
 }
 
-static void qsp_iter_callsite_coalesce(void *p, uint32_t h, void *htp)
+static void do_qsp_callsite_coalesce(struct qht *ht, const QSPEntry *old,
+                                     uint32_t hash)
 {
-    struct qht *ht = htp;
-    QSPEntry *old = p;
     QSPEntry *e;
-    uint32_t hash;
+    int i;
 
-    hash = qsp_entry_no_thread_obj_hash(old);
     e = qht_lookup(ht, old, hash);
     if (e == NULL) {
         e = qsp_entry_create(ht, old, hash);
@@ -569,6 +670,23 @@ static void qsp_iter_callsite_coalesce(void *p, uint32_t h, void *htp)
     }
     e->ns += old->ns;
     e->n_acqs += old->n_acqs;
+    for (i = 0; i < QSP_HIST_BUCKETS; i++) {
+        e->hist[i] += old->hist[i];
+    }
+}
+
+static void qsp_iter_callsite_coalesce(void *p, uint32_t h, void *htp)
+{
+    const QSPEntry *old = p;
+
+    do_qsp_callsite_coalesce(htp, old, qsp_entry_no_thread_obj_hash(old));
+}
+
+static void qsp_iter_callsite_coalesce_thread(void *p, uint32_t h, void *htp)
+{
+    const QSPEntry *old = p;
+
+    do_qsp_callsite_coalesce(htp, old, qsp_entry_no_obj_hash(old));
 }
 
 static void qsp_ht_delete(void *p, uint32_t h, void *htp)
@@ -576,11 +694,38 @@ static void qsp_ht_delete(void *p, uint32_t h, void *htp)
     g_free(p);
 }
 
-static void qsp_mktree(GTree *tree, bool callsite_coalesce)
+static QSPSnapshot *qsp_snapshot_new(void)
+{
+    QSPSnapshot *snap = g_new(QSPSnapshot, 1);
+
+    qht_init(&snap->ht, qsp_entry_cmp, QSP_INITIAL_SIZE,
+             QHT_MODE_AUTO_RESIZE | QHT_MODE_RAW_MUTEXES);
+
+    /* take a snapshot of the current state */
+    qht_iter(&qsp_ht, qsp_aggregate_thread, &snap->ht);
+    return snap;
+}
+
+static void qsp_snapshot_destroy(QSPSnapshot *snap)
+{
+    qht_iter(&snap->ht, qsp_ht_delete, NULL);
+    qht_destroy(&snap->ht);
+    g_free(snap);
+}
+
+/*
+ * If @reset is true, a new snapshot is taken, and the tree holds the
+ * difference between it and the previous one. This way nothing that happens
+ * while the tree is being built is lost between two resets.
+ */
+static void qsp_mktree(GTree *tree, bool callsite_coalesce, bool per_thread,
+                       bool reset)
 {
     QSPSnapshot *snap;
+    QSPSnapshot *new = NULL;
     struct qht ht, coalesce_ht;
     struct qht *htp;
+    struct qht *src = &qsp_ht;
 
     /*
      * First, see if there's a prior snapshot, so that we read the global hash
@@ -591,25 +736,47 @@ static void qsp_mktree(GTree *tree, bool callsite_coalesce)
      * with the snapshot.
      */
     rcu_read_lock();
-    snap = atomic_rcu_read(&qsp_snapshot);
+    if (reset) {
+        new = qsp_snapshot_new();
+        snap = atomic_xchg(&qsp_snapshot, new);
+        src = &new->ht;
+    } else {
+        snap = atomic_rcu_read(&qsp_snapshot);
+    }
 
     /* Aggregate all results from the global hash table into a local one */
-    qht_init(&ht, qsp_entry_no_thread_cmp, QSP_INITIAL_SIZE,
-             QHT_MODE_AUTO_RESIZE | QHT_MODE_RAW_MUTEXES);
-    qht_iter(&qsp_ht, qsp_aggregate, &ht);
+    if (per_thread) {
+        qht_init(&ht, qsp_entry_cmp, QSP_INITIAL_SIZE,
+                 QHT_MODE_AUTO_RESIZE | QHT_MODE_RAW_MUTEXES);
+        qht_iter(src, qsp_aggregate_thread, &ht);
+    } else {
+        qht_init(&ht, qsp_entry_no_thread_cmp, QSP_INITIAL_SIZE,
+                 QHT_MODE_AUTO_RESIZE | QHT_MODE_RAW_MUTEXES);
+        qht_iter(src, qsp_aggregate, &ht);
+    }
 
     /* compute the difference wrt the snapshot, if any */
     if (snap) {
-        qsp_diff(&snap->ht, &ht);
+        qsp_diff(&snap->ht, &ht, per_thread);
     }
     /* done with the snapshot; RCU can reclaim it */
     rcu_read_unlock();
+    if (reset && snap) {
+        call_rcu(snap, qsp_snapshot_destroy, rcu);
+    }
 
     htp = &ht;
     if (callsite_coalesce) {
-        qht_init(&coalesce_ht, qsp_entry_no_thread_obj_cmp, QSP_INITIAL_SIZE,
-                 QHT_MODE_AUTO_RESIZE | QHT_MODE_RAW_MUTEXES);
-        qht_iter(&ht, qsp_iter_callsite_coalesce, &coalesce_ht);
+        if (per_thread) {
+            qht_init(&coalesce_ht, qsp_entry_no_obj_cmp, QSP_INITIAL_SIZE,
+                     QHT_MODE_AUTO_RESIZE | QHT_MODE_RAW_MUTEXES);
+            qht_iter(&ht, qsp_iter_callsite_coalesce_thread, &coalesce_ht);
+        } else {
+            qht_init(&coalesce_ht, qsp_entry_no_thread_obj_cmp,
+                     QSP_INITIAL_SIZE,
+                     QHT_MODE_AUTO_RESIZE | QHT_MODE_RAW_MUTEXES);
+            qht_iter(&ht, qsp_iter_callsite_coalesce, &coalesce_ht);
+        }
 
         /* free the previous hash table, and point htp to coalesce_ht */
         qht_iter(&ht, qsp_ht_delete, NULL);
@@ -759,7 +926,7 @@ void qsp_report(size_t max, enum QSPSortBy sort_by,
     rep.n_entries = 0;
     rep.max_n_entries = max;
 
-    qsp_mktree(tree, callsite_coalesce);
+    qsp_mktree(tree, callsite_coalesce, false, false);
     g_tree_foreach(tree, qsp_tree_report, &rep);
     g_tree_destroy(tree);
 
@@ -767,25 +934,14 @@ void qsp_report(size_t max, enum QSPSortBy sort_by,
     report_destroy(&rep);
 }
 
-static void qsp_snapshot_destroy(QSPSnapshot *snap)
-{
-    qht_iter(&snap->ht, qsp_ht_delete, NULL);
-    qht_destroy(&snap->ht);
-    g_free(snap);
-}
-
 void qsp_reset(void)
 {
-    QSPSnapshot *new = g_new(QSPSnapshot, 1);
+    QSPSnapshot *new;
     QSPSnapshot *old;
 
     qsp_init();
 
-    qht_init(&new->ht, qsp_entry_cmp, QSP_INITIAL_SIZE,
-             QHT_MODE_AUTO_RESIZE | QHT_MODE_RAW_MUTEXES);
-
-    /* take a snapshot of the current state */
-    qht_iter(&qsp_ht, qsp_aggregate, &new->ht);
+    new = qsp_snapshot_new();
 
     /* replace the previous snapshot, if any */
     old = atomic_xchg(&qsp_snapshot, new);
@@ -793,3 +949,114 @@ void qsp_reset(void)
         call_rcu(old, qsp_snapshot_destroy, rcu);
     }
 }
+
+static const SyncProfilePrimitive qsp_primitives[] = {
+    [QSP_MUTEX]     = SYNC_PROFILE_PRIMITIVE_MUTEX,
+    [QSP_BQL_MUTEX] = SYNC_PROFILE_PRIMITIVE_BQL_MUTEX,
+    [QSP_REC_MUTEX] = SYNC_PROFILE_PRIMITIVE_REC_MUTEX,
+    [QSP_CONDVAR]   = SYNC_PROFILE_PRIMITIVE_CONDVAR,
+};
+
+struct QSPQueryData {
+    SyncProfileEntryList **tail;
+    int64_t n_entries;
+    int64_t max_n_entries;
+    bool per_thread;
+};
+typedef struct QSPQueryData QSPQueryData;
+
+static gboolean qsp_tree_query(gpointer key, gpointer value, gpointer udata)
+{
+    const QSPEntry *e = key;
+    QSPQueryData *data = udata;
+    SyncProfileEntryList *elem;
+    SyncProfileEntry *entry;
+    intList **hist_tail;
+    int i;
+
+    if (data->n_entries == data->max_n_entries) {
+        return TRUE;
+    }
+    data->n_entries++;
+
+    entry = g_new0(SyncProfileEntry, 1);
+    entry->type = qsp_primitives[e->callsite->type];
+    entry->call_site = qsp_at(e->callsite);
+    entry->objects = MAX(e->n_objs, 1);
+    if (entry->objects == 1) {
+        entry->has_object = true;
+        entry->object = (uintptr_t)e->callsite->obj;
+    }
+    if (data->per_thread) {
+        entry->has_thread_id = true;
+        entry->thread_id = e->thread_id;
+    }
+    entry->wait_time_ns = e->ns;
+    entry->count = e->n_acqs;
+
+    hist_tail = &entry->histogram;
+    for (i = 0; i < QSP_HIST_BUCKETS; i++) {
+        intList *bucket = g_new0(intList, 1);
+
+        bucket->value = e->hist[i];
+        *hist_tail = bucket;
+        hist_tail = &bucket->next;
+    }
+
+    elem = g_new0(SyncProfileEntryList, 1);
+    elem->value = entry;
+    *data->tail = elem;
+    data->tail = &elem->next;
+    return FALSE;
+}
+
+SyncProfileInfo *qmp_x_query_sync_profile(bool has_max, int64_t max,
+                                          bool has_mean, bool mean,
+                                          bool has_coalesce, bool coalesce,
+                                          bool has_per_thread, bool per_thread,
+                                          bool has_reset, bool reset,
+                                          Error **errp)
+{
+    enum QSPSortBy sort_by;
+    SyncProfileInfo *info;
+    QSPQueryData data;
+    intList **limit_tail;
+    GTree *tree;
+    int i;
+
+    if (has_max && max <= 0) {
+        error_setg(errp, "Parameter 'max' expects a positive number");
+        return NULL;
+    }
+
+    qsp_init();
+
+    info = g_new0(SyncProfileInfo, 1);
+    info->enabled = qsp_is_enabled();
+
+    /* the last interval has no upper limit */
+    limit_tail = &info->histogram_limits;
+    for (i = 0; i < QSP_HIST_BUCKETS - 1; i++) {
+        intList *limit = g_new0(intList, 1);
+
+        limit->value = 1ULL << (QSP_HIST_SHIFT + i);
+        *limit_tail = limit;
+        limit_tail = &limit->next;
+    }
+
+    sort_by = has_mean && mean ? QSP_SORT_BY_AVG_WAIT_TIME :
+                                 QSP_SORT_BY_TOTAL_WAIT_TIME;
+    coalesce = !has_coalesce || coalesce;
+    per_thread = has_per_thread && per_thread;
+    tree = g_tree_new_full(qsp_tree_cmp, &sort_by, g_free, NULL);
+    qsp_mktree(tree, coalesce, per_thread, has_reset && reset);
+
+    data.tail = &info->entries;
+    data.n_entries = 0;
+    data.max_n_entries = has_max ? max : -1;
+    data.per_thread = per_thread;
+    g_tree_foreach(tree, qsp_tree_query, &data);
+    g_tree_destroy(tree);
+
+    return info;
+}
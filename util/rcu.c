@@ -31,6 +31,7 @@
 #include "qemu/atomic.h"
 #include "qemu/thread.h"
 #include "qemu/main-loop.h"
+#include "qemu/processor.h"
 #if defined(CONFIG_MALLOC_TRIM)
 #include <malloc.h>
 #endif
@@ -69,11 +70,36 @@ __thread struct rcu_reader_data rcu_reader;
 typedef QLIST_HEAD(, rcu_reader_data) ThreadList;
 static ThreadList registry = QLIST_HEAD_INITIALIZER(registry);
 
+/*
+ * Read-side critical sections are usually short, so poll the readers
+ * this many times before sleeping on rcu_gp_event.
+ */
+#define RCU_GP_SPINS            1000
+
+/* Move the readers that crossed a quiescent state to @qsreaders.  */
+static void move_quiescent_readers(ThreadList *qsreaders)
+{
+    struct rcu_reader_data *index, *tmp;
+
+    QLIST_FOREACH_SAFE(index, &registry, node, tmp) {
+        if (!rcu_gp_ongoing(&index->ctr)) {
+            QLIST_REMOVE(index, node);
+            QLIST_INSERT_HEAD(qsreaders, index, node);
+
+            /* No need for mb_set here, worst of all we
+             * get some extra futex wakeups.
+             */
+            atomic_set(&index->waiting, false);
+        }
+    }
+}
+
 /* Wait for previous parity/grace period to be empty of readers.  */
 static void wait_for_readers(void)
 {
     ThreadList qsreaders = QLIST_HEAD_INITIALIZER(qsreaders);
-    struct rcu_reader_data *index, *tmp;
+    struct rcu_reader_data *index;
+    int spins;
 
     for (;;) {
         /* We want to be notified of changes made to rcu_gp_ongoing
@@ -97,16 +123,16 @@ static void wait_for_readers(void)
          */
         smp_mb_global();
 
-        QLIST_FOREACH_SAFE(index, &registry, node, tmp) {
-            if (!rcu_gp_ongoing(&index->ctr)) {
-                QLIST_REMOVE(index, node);
-                QLIST_INSERT_HEAD(&qsreaders, index, node);
+        move_quiescent_readers(&qsreaders);
 
-                /* No need for mb_set here, worst of all we
-                 * get some extra futex wakeups.
-                 */
-                atomic_set(&index->waiting, false);
-            }
+        /* The stores to index->ctr in rcu_read_unlock() are releases, so
+         * seeing a quiescent state needs no further barrier.  A reader
+         * that is still busy after the polls will set rcu_gp_event.
+         */
+        for (spins = 0; spins < RCU_GP_SPINS && !QLIST_EMPTY(&registry);
+             spins++) {
+            cpu_relax();
+            move_quiescent_readers(&qsreaders);
         }
 
         if (QLIST_EMPTY(&registry)) {
@@ -175,7 +201,17 @@ void synchronize_rcu(void)
 }
 
 
+/*
+ * The call_rcu thread lets callbacks pile up to amortize the cost of
+ * the grace period, but only while they keep coming: it polls the queue
+ * every RCU_CALL_POLL_US and starts as soon as the queue stops growing,
+ * holds RCU_CALL_MIN_SIZE callbacks, or RCU_CALL_MAX_WAIT_US elapsed.
+ * It drops the BQL every RCU_CALL_BQL_BATCH callbacks.
+ */
 #define RCU_CALL_MIN_SIZE        30
+#define RCU_CALL_POLL_US         1000
+#define RCU_CALL_MAX_WAIT_US     50000
+#define RCU_CALL_BQL_BATCH       256
 
 /* Multi-producer, single-consumer queue based on urcu/static/wfqueue.h
  * from liburcu.  Note that head is only used by the consumer.
@@ -241,28 +277,36 @@ static void *call_rcu_thread(void *opaque)
     rcu_register_thread();
 
     for (;;) {
-        int tries = 0;
+        int waited, last, done = 0;
         int n = atomic_read(&rcu_call_count);
 
-        /* Heuristically wait for a decent number of callbacks to pile up.
-         * Fetch rcu_call_count now, we only must process elements that were
-         * added before synchronize_rcu() starts.
-         */
-        while (n == 0 || (n < RCU_CALL_MIN_SIZE && ++tries <= 5)) {
-            g_usleep(10000);
+        while (n == 0) {
+            qemu_event_reset(&rcu_call_ready_event);
+            n = atomic_read(&rcu_call_count);
             if (n == 0) {
-                qemu_event_reset(&rcu_call_ready_event);
-                n = atomic_read(&rcu_call_count);
-                if (n == 0) {
 #if defined(CONFIG_MALLOC_TRIM)
-                    malloc_trim(4 * 1024 * 1024);
+                malloc_trim(4 * 1024 * 1024);
 #endif
-                    qemu_event_wait(&rcu_call_ready_event);
-                }
+                qemu_event_wait(&rcu_call_ready_event);
             }
             n = atomic_read(&rcu_call_count);
         }
 
+        /* Wait for the rest of a burst of callbacks, see above.
+         * Fetch rcu_call_count now, we only must process elements that were
+         * added before synchronize_rcu() starts.
+         */
+        for (waited = 0;
+             n < RCU_CALL_MIN_SIZE && waited < RCU_CALL_MAX_WAIT_US;
+             waited += RCU_CALL_POLL_US) {
+            g_usleep(RCU_CALL_POLL_US);
+            last = n;
+            n = atomic_read(&rcu_call_count);
+            if (n == last) {
+                break;
+            }
+        }
+
         atomic_sub(&rcu_call_count, n);
         synchronize_rcu();
         qemu_mutex_lock_iothread();
@@ -281,6 +325,12 @@ static void *call_rcu_thread(void *opaque)
 
             n--;
             node->func(node);
+
+            /* Do not stall the vCPUs for the whole of a large batch */
+            if (++done % RCU_CALL_BQL_BATCH == 0 && n > 0) {
+                qemu_mutex_unlock_iothread();
+                qemu_mutex_lock_iothread();
+            }
         }
         qemu_mutex_unlock_iothread();
     }
@@ -19,6 +19,13 @@ membarrier(int cmd, int flags)
 {
     return syscall(__NR_membarrier, cmd, flags);
 }
+
+/*
+ * MEMBARRIER_CMD_SHARED waits for a scheduler grace period on all CPUs,
+ * which takes milliseconds.  The private expedited flavor only sends an
+ * IPI to the CPUs that run our threads, and is used when available.
+ */
+static int membarrier_cmd = MEMBARRIER_CMD_SHARED;
 #endif
 
 void smp_mb_global(void)
@@ -26,7 +33,18 @@ void smp_mb_global(void)
 #if defined CONFIG_WIN32
     FlushProcessWriteBuffers();
 #elif defined CONFIG_LINUX
-    membarrier(MEMBARRIER_CMD_SHARED, 0);
+    if (membarrier(membarrier_cmd, 0) < 0) {
+        /* The registration does not survive fork(), redo it */
+        if (membarrier_cmd == MEMBARRIER_CMD_PRIVATE_EXPEDITED &&
+            membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0 &&
+            membarrier(membarrier_cmd, 0) == 0) {
+            return;
+        }
+        membarrier_cmd = MEMBARRIER_CMD_SHARED;
+        if (membarrier(membarrier_cmd, 0) < 0) {
+            abort();
+        }
+    }
 #else
 #error --enable-membarrier is not supported on this operating system.
 #endif
@@ -41,6 +59,11 @@ void smp_mb_global_init(void)
         error_report("Please upgrade your system to a newer version of Linux");
         exit(1);
     }
+    if ((ret & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+        membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0) {
+        membarrier_cmd = MEMBARRIER_CMD_PRIVATE_EXPEDITED;
+        return;
+    }
     if (!(ret & MEMBARRIER_CMD_SHARED)) {
         error_report("This QEMU binary requires MEMBARRIER_CMD_SHARED support.");
         error_report("Please upgrade your system to a newer version of Linux");
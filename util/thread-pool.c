@@ -50,6 +50,9 @@ struct ThreadPoolElement {
 
     /* Access to this list is protected by the global mutex.  */
     QLIST_ENTRY(ThreadPoolElement) all;
+
+    /* Linked into pool->done once state is THREAD_DONE.  */
+    QSLIST_ENTRY(ThreadPoolElement) done;
 };
 
 struct ThreadPool {
@@ -63,6 +66,10 @@ struct ThreadPool {
 
     /* The following variables are only accessed from one AioContext. */
     QLIST_HEAD(, ThreadPoolElement) head;
+    QSLIST_HEAD(, ThreadPoolElement) done_bh;
+
+    /* Completed requests, pushed atomically by the workers.  */
+    QSLIST_HEAD(, ThreadPoolElement) done;
 
     /* The following variables are protected by lock.  */
     QTAILQ_HEAD(, ThreadPoolElement) request_list;
@@ -73,6 +80,14 @@ struct ThreadPool {
     bool stopping;
 };
 
+/* Hand a finished request to the completion BH.  Does not need lock.  */
+static void thread_pool_done(ThreadPool *pool, ThreadPoolElement *req)
+{
+    /* The cmpxchg orders the writes to ret and state before the push.  */
+    QSLIST_INSERT_HEAD_ATOMIC(&pool->done, req, done);
+    qemu_bh_schedule(pool->completion_bh);
+}
+
 static void *worker_thread(void *opaque)
 {
     ThreadPool *pool = opaque;
@@ -107,10 +122,9 @@ static void *worker_thread(void *opaque)
         /* Write ret before state.  */
         smp_wmb();
         req->state = THREAD_DONE;
+        thread_pool_done(pool, req);
 
         qemu_mutex_lock(&pool->lock);
-
-        qemu_bh_schedule(pool->completion_bh);
     }
 
     pool->cur_threads--;
@@ -159,17 +173,28 @@ static void spawn_thread(ThreadPool *pool)
     }
 }
 
+/*
+ * Only the requests on pool->done are looked at, so the cost of a run is
+ * proportional to the number of completions rather than to the number
+ * of requests in flight.  Completions that a callback leaves for a
+ * nested aio_poll() wait on pool->done_bh.
+ */
 static void thread_pool_completion_bh(void *opaque)
 {
     ThreadPool *pool = opaque;
-    ThreadPoolElement *elem, *next;
+    ThreadPoolElement *elem;
 
     aio_context_acquire(pool->ctx);
-restart:
-    QLIST_FOREACH_SAFE(elem, &pool->head, all, next) {
-        if (elem->state != THREAD_DONE) {
-            continue;
+    for (;;) {
+        if (QSLIST_EMPTY(&pool->done_bh)) {
+            QSLIST_MOVE_ATOMIC(&pool->done_bh, &pool->done);
+            if (QSLIST_EMPTY(&pool->done_bh)) {
+                break;
+            }
         }
+        elem = QSLIST_FIRST(&pool->done_bh);
+        QSLIST_REMOVE_HEAD(&pool->done_bh, done);
+        assert(elem->state == THREAD_DONE);
 
         trace_thread_pool_complete(pool, elem, elem->common.opaque,
                                    elem->ret);
@@ -189,16 +214,12 @@ restart:
             aio_context_acquire(pool->ctx);
 
             /* We can safely cancel the completion_bh here regardless of someone
-             * else having scheduled it meanwhile because we reenter the
-             * completion function anyway (goto restart).
+             * else having scheduled it meanwhile because the loop looks at
+             * pool->done again before returning.
              */
             qemu_bh_cancel(pool->completion_bh);
-
-            qemu_aio_unref(elem);
-            goto restart;
-        } else {
-            qemu_aio_unref(elem);
         }
+        qemu_aio_unref(elem);
     }
     aio_context_release(pool->ctx);
 }
@@ -219,10 +240,10 @@ static void thread_pool_cancel(BlockAIOCB *acb)
          */
         qemu_sem_timedwait(&pool->sem, 0) == 0) {
         QTAILQ_REMOVE(&pool->request_list, elem, reqs);
-        qemu_bh_schedule(pool->completion_bh);
 
         elem->state = THREAD_DONE;
         elem->ret = -ECANCELED;
+        thread_pool_done(pool, elem);
     }
 
     qemu_mutex_unlock(&pool->lock);
@@ -311,6 +332,8 @@ static void thread_pool_init_one(ThreadPool *pool, AioContext *ctx)
     pool->new_thread_bh = aio_bh_new(ctx, spawn_thread_bh_fn, pool);
 
     QLIST_INIT(&pool->head);
+    QSLIST_INIT(&pool->done_bh);
+    QSLIST_INIT(&pool->done);
     QTAILQ_INIT(&pool->request_list);
 }
 
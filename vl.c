@@ -130,6 +130,7 @@ int main(int argc, char **argv)
 #include "qapi/qmp/qerror.h"
 #include "sysemu/iothread.h"
 #include "qemu/guest-random.h"
+#include "qemu/plugin.h"
 
 #define MAX_VIRTIO_CONSOLES 1
 
@@ -305,6 +306,11 @@ static QemuOptsList qemu_accel_opts = {
             .type = QEMU_OPT_STRING,
             .help = "Enable/disable multi-threaded TCG",
         },
+        {
+            .name = "halt-poll-ns",
+            .type = QEMU_OPT_NUMBER,
+            .help = "Maximum time halted vCPUs poll for a wake-up (MTTCG)",
+        },
         { /* end of list */ }
     },
 };
@@ -718,7 +724,8 @@ void runstate_set(RunState new_state)
         abort();
     }
 
-    current_run_state = new_state;
+    /* Read without the BQL by qmp_query_status() */
+    atomic_set(&current_run_state, new_state);
 }
 
 int runstate_is_running(void)
@@ -732,13 +739,17 @@ bool runstate_needs_reset(void)
         runstate_check(RUN_STATE_SHUTDOWN);
 }
 
+/*
+ * This can run out-of-band, without the BQL, so only take a single
+ * snapshot of the run state.
+ */
 StatusInfo *qmp_query_status(Error **errp)
 {
     StatusInfo *info = g_malloc0(sizeof(*info));
 
-    info->running = runstate_is_running();
-    info->singlestep = singlestep;
-    info->status = current_run_state;
+    info->status = atomic_read(&current_run_state);
+    info->running = info->status == RUN_STATE_RUNNING;
+    info->singlestep = atomic_read(&singlestep);
 
     return info;
 }
@@ -2888,6 +2899,7 @@ int main(int argc, char **argv, char **envp)
     const char *cpu_option;
     const char *vga_model = NULL;
     const char *qtest_chrdev = NULL;
+    QemuPluginList plugin_list = QTAILQ_HEAD_INITIALIZER(plugin_list);
     const char *qtest_log = NULL;
     const char *incoming = NULL;
     bool userconfig = true;
@@ -2934,6 +2946,7 @@ int main(int argc, char **argv, char **envp)
     qemu_add_opts(&qemu_global_opts);
     qemu_add_opts(&qemu_mon_opts);
     qemu_add_opts(&qemu_trace_opts);
+    qemu_plugin_add_opts();
     qemu_add_opts(&qemu_option_rom_opts);
     qemu_add_opts(&qemu_machine_opts);
     qemu_add_opts(&qemu_accel_opts);
@@ -3712,6 +3725,9 @@ int main(int argc, char **argv, char **envp)
                 g_free(trace_file);
                 trace_file = trace_opt_parse(optarg);
                 break;
+            case QEMU_OPTION_plugin:
+                qemu_plugin_opt_parse(optarg, &plugin_list);
+                break;
             case QEMU_OPTION_readconfig:
                 {
                     int ret = qemu_read_config_file(optarg);
@@ -4016,6 +4032,11 @@ int main(int argc, char **argv, char **envp)
         exit(1);
     }
 
+    /* the plugins are told the number of vCPUs, load them after -smp */
+    if (qemu_plugin_load_list(&plugin_list)) {
+        exit(1);
+    }
+
     /*
      * Get the default machine options from the machine if it is not already
      * specified either by the configuration file or by the command line.